@@ -1,12 +1,17 @@
 #include "accelerator.h"
 
+#include "cpu/image/image_mixer.h"
 #include "ogl/image/image_mixer.h"
 #include "ogl/util/device.h"
 
+#include <common/env.h>
+#include <common/log.h>
+
 #include <boost/property_tree/ptree.hpp>
 
 #include <core/mixer/image/image_mixer.h>
 
+#include <map>
 #include <memory>
 #include <mutex>
 #include <utility>
@@ -15,35 +20,57 @@ namespace caspar { namespace accelerator {
 
 struct accelerator::impl
 {
-    const std::wstring           path_;
-    std::mutex                   mutex_;
-    std::shared_ptr<ogl::device> ogl_device_;
+    const std::wstring                          platform_;
+    const std::size_t                           texture_pool_size_;
+    const std::size_t                           buffer_pool_size_;
+    std::mutex                                  mutex_;
+    std::map<int, std::shared_ptr<ogl::device>> ogl_devices_;
 
-    impl(std::wstring path)
-        : path_(std::move(path))
+    impl(std::wstring platform)
+        : platform_(std::move(platform))
+        , texture_pool_size_(env::properties().get(L"configuration.ogl.texture-pool-size", 0) * 1024ULL * 1024ULL)
+        , buffer_pool_size_(env::properties().get(L"configuration.ogl.buffer-pool-size", 0) * 1024ULL * 1024ULL)
     {
     }
 
-    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id)
+    std::unique_ptr<core::image_mixer> create_image_mixer(int channel_id, int gpu, int bit_depth)
     {
-        if (!ogl_device_) {
-            ogl_device_ = std::make_shared<ogl::device>();
+        if (platform_ == L"cpu") {
+            return std::make_unique<cpu::image_mixer>(channel_id);
         }
 
-        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(ogl_device_), channel_id);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& ogl_device = ogl_devices_[gpu];
+        if (!ogl_device) {
+            try {
+                ogl_device = std::make_shared<ogl::device>(platform_, gpu, texture_pool_size_, buffer_pool_size_);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(error) << L"No OpenGL device for channel " << channel_id
+                                  << L", mixing it on the CPU instead.";
+                return std::make_unique<cpu::image_mixer>(channel_id);
+            }
+        }
+
+        auto precision = bit_depth == 16   ? ogl::texture_precision::float16
+                         : bit_depth == 10 ? ogl::texture_precision::unorm10
+                                           : ogl::texture_precision::unorm8;
+
+        return std::make_unique<ogl::image_mixer>(spl::make_shared_ptr(ogl_device), channel_id, precision);
     }
 };
 
-accelerator::accelerator(const std::wstring& path)
-    : impl_(std::make_unique<impl>(path))
+accelerator::accelerator(const std::wstring& platform)
+    : impl_(std::make_unique<impl>(platform))
 {
 }
 
 accelerator::~accelerator() {}
 
-std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(int channel_id)
+std::unique_ptr<core::image_mixer> accelerator::create_image_mixer(int channel_id, int gpu, int bit_depth)
 {
-    return impl_->create_image_mixer(channel_id);
+    return impl_->create_image_mixer(channel_id, gpu, bit_depth);
 }
 
 }} // namespace caspar::accelerator
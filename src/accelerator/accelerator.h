@@ -10,13 +10,15 @@ namespace caspar { namespace accelerator {
 class accelerator
 {
   public:
-    accelerator(const std::wstring& path);
+    // The platform creates the OpenGL contexts of the devices, see ogl::context.
+    explicit accelerator(const std::wstring& platform);
     accelerator(accelerator&) = delete;
     ~accelerator();
 
     accelerator& operator=(accelerator&) = delete;
 
-    std::unique_ptr<caspar::core::image_mixer> create_image_mixer(int channel_id);
+    // bit_depth selects RGBA8 (8), RGB10_A2 (10) or RGBA16F (16) intermediate targets.
+    std::unique_ptr<caspar::core::image_mixer> create_image_mixer(int channel_id, int gpu = 0, int bit_depth = 8);
 
   private:
     struct impl;
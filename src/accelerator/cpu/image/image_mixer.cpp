@@ -0,0 +1,964 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_mixer.h"
+
+#include <common/log.h>
+#include <common/pixel_convert.h>
+
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/blend_modes.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <set>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+namespace {
+
+// Where an item lands on the target. Source coordinates are linear in target pixels, u = u_x * x + u_y * y + u_c.
+struct placement
+{
+    double u_x = 0.0, u_y = 0.0, u_c = 0.0;
+    double v_x = 0.0, v_y = 0.0, v_c = 0.0;
+
+    // Visible part of the source, normalized.
+    double u_lo = 0.0, u_hi = 1.0, v_lo = 0.0, v_hi = 1.0;
+
+    // Clip rectangle on the target, in pixels.
+    int left = 0, top = 0, right = 0, bottom = 0;
+};
+
+struct item
+{
+    core::pixel_format_desc pix_desc = core::pixel_format::invalid;
+    core::image_transform   transform;
+    core::const_frame       frame;
+    placement               place;
+};
+
+struct layer
+{
+    std::vector<layer> sublayers;
+    std::vector<item>  items;
+    core::blend_mode   blend_mode;
+
+    explicit layer(core::blend_mode blend_mode)
+        : blend_mode(blend_mode)
+    {
+    }
+};
+
+bool is_supported(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::gray:
+        case core::pixel_format::bgra:
+        case core::pixel_format::rgba:
+        case core::pixel_format::argb:
+        case core::pixel_format::abgr:
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra:
+        case core::pixel_format::luma:
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb:
+        case core::pixel_format::uyvy:
+        case core::pixel_format::v210:
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010:
+        case core::pixel_format::color:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns false if the item covers nothing. A field target holds every other line of the frame.
+bool place(item& item, const core::video_format_desc& format_desc, core::field_mode field)
+{
+    static const double epsilon = 0.001;
+
+    const auto& t = item.transform;
+    if (std::abs(t.fill_scale[0]) < epsilon || std::abs(t.fill_scale[1]) < epsilon) {
+        return false;
+    }
+
+    const double w      = format_desc.width;
+    const double h      = format_desc.height;
+    const double aspect = static_cast<double>(format_desc.square_width) / format_desc.square_height;
+    const auto   c      = std::cos(t.angle);
+    const auto   s      = std::sin(t.angle);
+
+    // The inverse of the vertex transform in image_kernel, evaluated at pixel centres.
+    const auto x0 = 0.5 / w - t.fill_translation[0];
+    const auto y0 = (0.5 / h - t.fill_translation[1]) / aspect;
+
+    auto& p = item.place;
+    p.u_x   = c / (w * t.fill_scale[0]);
+    p.u_y   = s / (h * aspect * t.fill_scale[0]);
+    p.u_c   = (c * x0 + s * y0) / t.fill_scale[0] + t.anchor[0];
+    p.v_x   = -s * aspect / (w * t.fill_scale[1]);
+    p.v_y   = c / (h * t.fill_scale[1]);
+    p.v_c   = (-s * x0 + c * y0) * aspect / t.fill_scale[1] + t.anchor[1];
+
+    p.u_lo = std::max(0.0, t.crop.ul[0]);
+    p.u_hi = std::min(1.0, t.crop.lr[0]);
+    p.v_lo = std::max(0.0, t.crop.ul[1]);
+    p.v_hi = std::min(1.0, t.crop.lr[1]);
+
+    const auto& m_p = t.clip_translation;
+    const auto& m_s = t.clip_scale;
+    p.left          = std::max(0, static_cast<int>(std::lround(m_p[0] * w)));
+    p.top           = std::max(0, static_cast<int>(std::lround(m_p[1] * h)));
+    p.right         = std::min(format_desc.width, static_cast<int>(std::lround((m_p[0] + m_s[0]) * w)));
+    p.bottom        = std::min(format_desc.height, static_cast<int>(std::lround((m_p[1] + m_s[1]) * h)));
+
+    if (field != core::field_mode::progressive) {
+        // Row y of the field is line 2 * y + first of the frame.
+        const auto first = field == core::field_mode::lower ? 1 : 0;
+        p.u_c += first * p.u_y;
+        p.v_c += first * p.v_y;
+        p.u_y *= 2.0;
+        p.v_y *= 2.0;
+        p.top    = (p.top - first + 1) / 2;
+        p.bottom = (p.bottom - first + 1) / 2;
+    }
+
+    return p.u_lo < p.u_hi && p.v_lo < p.v_hi && p.left < p.right && p.top < p.bottom;
+}
+
+// Narrows [x0, x1) to where lo <= a * x + b < hi.
+void narrow(double a, double b, double lo, double hi, double& x0, double& x1)
+{
+    if (std::abs(a) < 1e-12) {
+        if (b < lo || b >= hi) {
+            x1 = x0;
+        }
+        return;
+    }
+    auto p = (lo - b) / a;
+    auto q = (hi - b) / a;
+    if (p > q) {
+        std::swap(p, q);
+    }
+    x0 = std::max(x0, p);
+    x1 = std::min(x1, q);
+}
+
+std::uint8_t clamp8(int value) { return static_cast<std::uint8_t>(std::min(255, std::max(0, value))); }
+
+int div255(int value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+__m128i div255_epi16(__m128i value)
+{
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+__m128i alpha_epi16(__m128i value) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(value, 0xFF), 0xFF); }
+
+// Premultiplied BGRA kernels, 4 pixels at a time.
+
+void scale(std::uint8_t* pixels, int count, int factor)
+{
+    const auto zero = _mm_setzero_si128();
+    const auto f    = _mm_set1_epi16(static_cast<short>(factor));
+
+    int n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto ptr = reinterpret_cast<__m128i*>(pixels + n * 4);
+        auto p   = _mm_loadu_si128(ptr);
+        auto lo  = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), f));
+        auto hi  = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), f));
+        _mm_storeu_si128(ptr, _mm_packus_epi16(lo, hi));
+    }
+    for (; n < count * 4; ++n) {
+        pixels[n] = static_cast<std::uint8_t>(div255(pixels[n] * factor));
+    }
+}
+
+void over(std::uint8_t* dst, const std::uint8_t* src, int count)
+{
+    const auto zero = _mm_setzero_si128();
+    const auto full = _mm_set1_epi16(255);
+
+    int n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto s  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 4));
+        auto d  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n * 4));
+        auto sl = _mm_unpacklo_epi8(s, zero);
+        auto sh = _mm_unpackhi_epi8(s, zero);
+        auto dl = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, alpha_epi16(sl))));
+        auto dh = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, alpha_epi16(sh))));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n * 4),
+                         _mm_packus_epi16(_mm_add_epi16(sl, dl), _mm_add_epi16(sh, dh)));
+    }
+    for (n *= 4; n < count * 4; n += 4) {
+        const auto inv = 255 - src[n + 3];
+        for (int c = 0; c < 4; ++c) {
+            dst[n + c] = clamp8(src[n + c] + div255(dst[n + c] * inv));
+        }
+    }
+}
+
+void add(std::uint8_t* dst, const std::uint8_t* src, int count)
+{
+    int n = 0;
+    for (; n + 4 <= count; n += 4) {
+        auto ptr = reinterpret_cast<__m128i*>(dst + n * 4);
+        _mm_storeu_si128(
+            ptr, _mm_adds_epu8(_mm_loadu_si128(ptr), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n * 4))));
+    }
+    for (n *= 4; n < count * 4; ++n) {
+        dst[n] = clamp8(dst[n] + src[n]);
+    }
+}
+
+// The colour of a separable blend mode, straight colours from 0 to 1. Others are left to normal.
+float blend_channel(core::blend_mode mode, float back, float fore)
+{
+    switch (mode) {
+        case core::blend_mode::lighten:
+            return std::max(back, fore);
+        case core::blend_mode::darken:
+            return std::min(back, fore);
+        case core::blend_mode::multiply:
+            return back * fore;
+        case core::blend_mode::average:
+            return (back + fore) * 0.5f;
+        case core::blend_mode::add:
+        case core::blend_mode::linear_dodge:
+            return std::min(1.0f, back + fore);
+        case core::blend_mode::subtract:
+        case core::blend_mode::linear_burn:
+            return std::max(0.0f, back + fore - 1.0f);
+        case core::blend_mode::difference:
+            return std::abs(back - fore);
+        case core::blend_mode::negation:
+            return 1.0f - std::abs(1.0f - back - fore);
+        case core::blend_mode::exclusion:
+            return back + fore - 2.0f * back * fore;
+        case core::blend_mode::screen:
+            return 1.0f - (1.0f - back) * (1.0f - fore);
+        case core::blend_mode::overlay:
+            return back < 0.5f ? 2.0f * back * fore : 1.0f - 2.0f * (1.0f - back) * (1.0f - fore);
+        case core::blend_mode::hard_light:
+            return fore < 0.5f ? 2.0f * back * fore : 1.0f - 2.0f * (1.0f - back) * (1.0f - fore);
+        default:
+            return fore;
+    }
+}
+
+// Replaces the colour of src by its blend with dst, as the shader does before compositing.
+void blend(core::blend_mode mode, const std::uint8_t* dst, std::uint8_t* src, int count)
+{
+    for (int n = 0; n < count * 4; n += 4) {
+        const auto back_a = dst[n + 3] / 255.0f + 0.0000001f;
+        const auto fore_a = src[n + 3] / 255.0f + 0.0000001f;
+        for (int c = 0; c < 3; ++c) {
+            const auto color = blend_channel(mode, dst[n + c] / 255.0f / back_a, src[n + c] / 255.0f / fore_a);
+            src[n + c]       = clamp8(static_cast<int>(color * fore_a * 255.0f + 0.5f));
+        }
+    }
+}
+
+// Y'CbCr to RGB, scaled by 1024, see ycbcra_to_rgba in shader.frag.
+struct ycbcr_matrix
+{
+    int y, r_cr, g_cr, g_cb, b_cb;
+};
+
+const ycbcr_matrix bt601  = {1192, 1634, 833, 400, 2066};
+const ycbcr_matrix bt709  = {1192, 1836, 547, 218, 2166};
+const ycbcr_matrix bt2020 = {1192, 1719, 666, 191, 2193};
+
+const ycbcr_matrix& get_matrix(const core::pixel_format_desc& desc)
+{
+    switch (desc.color_space) {
+        case core::color_space::bt601:
+            return bt601;
+        case core::color_space::bt709:
+            return bt709;
+        case core::color_space::bt2020:
+            return bt2020;
+        default:
+            return desc.planes[0].height >= 720 ? bt709 : bt601;
+    }
+}
+
+void ycbcr_to_bgra(const ycbcr_matrix& m, int y, int cb, int cr, int a, std::uint8_t* out)
+{
+    const auto l = (y - 16) * m.y;
+    cb -= 128;
+    cr -= 128;
+    out[0] = clamp8(div255((l + m.b_cb * cb + 512) / 1024 * a));
+    out[1] = clamp8(div255((l - m.g_cr * cr - m.g_cb * cb + 512) / 1024 * a));
+    out[2] = clamp8(div255((l + m.r_cr * cr + 512) / 1024 * a));
+    out[3] = static_cast<std::uint8_t>(a);
+}
+
+// Converts the source pixels at xs and ys to premultiplied BGRA.
+void fetch(const item& item, const int* xs, const int* ys, int count, std::uint8_t* out)
+{
+    const auto& desc = item.pix_desc;
+
+    const std::uint8_t* data[4] = {};
+    int                 line[4] = {};
+    for (int n = 0; n < static_cast<int>(desc.planes.size()) && n < 4; ++n) {
+        data[n] = item.frame.image_data(n).data();
+        line[n] = desc.planes[n].linesize;
+    }
+
+    const auto at = [&](int plane, int x, int y) {
+        return data[plane] + y * line[plane] + x * desc.planes[plane].stride;
+    };
+
+    // The 8 most significant bits of a Y'CbCr sample, wider ones take 16 bits.
+    const auto shift  = desc.format == core::pixel_format::p010 ? 8 : desc.bit_depth - 8;
+    const auto sample = [&](int plane, int x, int y, int component) -> int {
+        auto p = at(plane, x, y);
+        return desc.bit_depth > 8 ? reinterpret_cast<const std::uint16_t*>(p)[component] >> shift : p[component];
+    };
+
+    switch (desc.format) {
+        case core::pixel_format::bgra:
+            for (int n = 0; n < count; ++n, out += 4) {
+                std::memcpy(out, at(0, xs[n], ys[n]), 4);
+            }
+            break;
+        case core::pixel_format::rgba:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto p = at(0, xs[n], ys[n]);
+                out[0] = p[2], out[1] = p[1], out[2] = p[0], out[3] = p[3];
+            }
+            break;
+        case core::pixel_format::argb:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto p = at(0, xs[n], ys[n]);
+                out[0] = p[3], out[1] = p[2], out[2] = p[1], out[3] = p[0];
+            }
+            break;
+        case core::pixel_format::abgr:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto p = at(0, xs[n], ys[n]);
+                out[0] = p[1], out[1] = p[2], out[2] = p[3], out[3] = p[0];
+            }
+            break;
+        case core::pixel_format::bgr:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto p = at(0, xs[n], ys[n]);
+                out[0] = p[0], out[1] = p[1], out[2] = p[2], out[3] = 255;
+            }
+            break;
+        case core::pixel_format::rgb:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto p = at(0, xs[n], ys[n]);
+                out[0] = p[2], out[1] = p[1], out[2] = p[0], out[3] = 255;
+            }
+            break;
+        case core::pixel_format::gray:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto v = *at(0, xs[n], ys[n]);
+                out[0] = v, out[1] = v, out[2] = v, out[3] = 255;
+            }
+            break;
+        case core::pixel_format::luma:
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto v = clamp8((*at(0, xs[n], ys[n]) - 16) * 255 / 219);
+                out[0] = v, out[1] = v, out[2] = v, out[3] = 255;
+            }
+            break;
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra: {
+            const auto& m     = get_matrix(desc);
+            const auto  alpha = desc.format == core::pixel_format::ycbcra;
+            const auto  w0    = desc.planes[0].width;
+            const auto  h0    = desc.planes[0].height;
+            const auto  w1    = desc.planes[1].width;
+            const auto  h1    = desc.planes[1].height;
+            for (int n = 0; n < count; ++n, out += 4) {
+                const auto cx = xs[n] * w1 / w0;
+                const auto cy = ys[n] * h1 / h0;
+                ycbcr_to_bgra(m,
+                              sample(0, xs[n], ys[n], 0),
+                              sample(1, cx, cy, 0),
+                              sample(2, cx, cy, 0),
+                              alpha ? sample(3, xs[n], ys[n], 0) : 255,
+                              out);
+            }
+            break;
+        }
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010: {
+            const auto& m  = get_matrix(desc);
+            const auto  w0 = desc.planes[0].width;
+            const auto  h0 = desc.planes[0].height;
+            const auto  w1 = desc.planes[1].width;
+            const auto  h1 = desc.planes[1].height;
+            for (int n = 0; n < count; ++n, out += 4) {
+                const auto cx = xs[n] * w1 / w0;
+                const auto cy = ys[n] * h1 / h0;
+                ycbcr_to_bgra(m, sample(0, xs[n], ys[n], 0), sample(1, cx, cy, 0), sample(1, cx, cy, 1), 255, out);
+            }
+            break;
+        }
+        case core::pixel_format::uyvy: {
+            const auto& m = get_matrix(desc);
+            for (int n = 0; n < count; ++n, out += 4) {
+                auto p = at(0, xs[n] / 2, ys[n]);
+                ycbcr_to_bgra(m, p[1 + (xs[n] & 1) * 2], p[0], p[2], 255, out);
+            }
+            break;
+        }
+        case core::pixel_format::v210: {
+            // Component n of a line, laid out like UYVY with 3 components of 10 bits per little endian word.
+            const auto component = [&](int c, int y) {
+                auto p    = at(0, c / 12 * 4 + c % 12 / 3, y);
+                auto word = static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8 |
+                            static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+                return static_cast<int>((word >> (c % 3 * 10)) & 0x3FF) >> 2;
+            };
+            const auto& m = get_matrix(desc);
+            for (int n = 0; n < count; ++n, out += 4) {
+                const auto chroma = xs[n] / 2 * 4;
+                ycbcr_to_bgra(m,
+                              component(xs[n] * 2 + 1, ys[n]),
+                              component(chroma, ys[n]),
+                              component(chroma + 2, ys[n]),
+                              255,
+                              out);
+            }
+            break;
+        }
+        case core::pixel_format::color:
+            for (int n = 0; n < count; ++n, out += 4) {
+                std::memcpy(out, data[0], 4);
+            }
+            break;
+        default:
+            std::memset(out, 0, count * 4);
+            break;
+    }
+}
+
+// Image size of the first plane in pixels.
+std::pair<int, int> source_size(const core::pixel_format_desc& desc)
+{
+    if (desc.format == core::pixel_format::color) {
+        return {1, 1};
+    }
+    const auto& plane = desc.planes[0];
+    if (desc.format == core::pixel_format::v210) {
+        return {desc.packed_width, plane.height};
+    }
+    return {desc.format == core::pixel_format::uyvy ? plane.width * 2 : plane.width, plane.height};
+}
+
+using surface = std::shared_ptr<std::vector<std::uint8_t>>;
+
+// Renders the rows [top, bottom) of the target, mirroring the layer, key and mix handling of the OpenGL mixer.
+class band
+{
+    const int width_;
+    const int top_;
+    const int rows_;
+
+    std::vector<int>          xs_;
+    std::vector<int>          ys_;
+    std::vector<std::uint8_t> pixels_;
+
+  public:
+    band(int width, int top, int bottom)
+        : width_(width)
+        , top_(top)
+        , rows_(bottom - top)
+        , xs_(width)
+        , ys_(width)
+        , pixels_(width * 4)
+    {
+    }
+
+    void draw(std::uint8_t* target, const std::vector<layer>& layers)
+    {
+        surface layer_key;
+        for (auto& layer : layers) {
+            draw(target, layer.sublayers);
+            draw(target, layer, layer_key);
+        }
+    }
+
+  private:
+    surface create(int channels) const
+    {
+        return std::make_shared<std::vector<std::uint8_t>>(width_ * rows_ * channels);
+    }
+
+    void draw(std::uint8_t* target, const layer& layer, surface& layer_key)
+    {
+        if (layer.items.empty()) {
+            return;
+        }
+
+        surface local_key;
+        surface local_mix;
+
+        auto color_items = std::count_if(
+            layer.items.begin(), layer.items.end(), [](const item& item) { return !item.transform.is_key; });
+        auto has_mix = std::any_of(
+            layer.items.begin(), layer.items.end(), [](const item& item) { return item.transform.is_mix; });
+
+        if (layer.blend_mode != core::blend_mode::normal && (color_items > 1 || has_mix)) {
+            auto layer_surface = create(4);
+            for (auto& item : layer.items) {
+                draw(layer_surface->data(), item, layer_key, local_key, local_mix, core::blend_mode::normal);
+            }
+            composite(layer_surface->data(), local_mix, core::blend_mode::normal);
+            composite(target, layer_surface, layer.blend_mode);
+        } else {
+            for (auto& item : layer.items) {
+                draw(target, item, layer_key, local_key, local_mix, layer.blend_mode);
+            }
+            composite(target, local_mix, core::blend_mode::normal);
+        }
+
+        layer_key = std::move(local_key);
+    }
+
+    void draw(std::uint8_t*    target,
+              const item&      item,
+              const surface&   layer_key,
+              surface&         local_key,
+              surface&         local_mix,
+              core::blend_mode blend_mode)
+    {
+        if (item.transform.is_key) {
+            local_key = local_key ? local_key : create(1);
+            draw(local_key->data(), 1, item, nullptr, nullptr, false, core::blend_mode::normal);
+        } else if (item.transform.is_mix) {
+            local_mix = local_mix ? local_mix : create(4);
+            draw(local_mix->data(), 4, item, local_key, layer_key, true, core::blend_mode::normal);
+            local_key = nullptr;
+        } else {
+            composite(target, local_mix, core::blend_mode::normal);
+            draw(target, 4, item, local_key, layer_key, false, blend_mode);
+            local_key = nullptr;
+        }
+    }
+
+    void composite(std::uint8_t* target, surface&& source, core::blend_mode blend_mode)
+    {
+        if (!source) {
+            return;
+        }
+        for (int row = 0; row < rows_; ++row) {
+            auto dst = target + row * width_ * 4;
+            auto src = source->data() + row * width_ * 4;
+            if (blend_mode != core::blend_mode::normal) {
+                blend(blend_mode, dst, src, width_);
+            }
+            over(dst, src, width_);
+        }
+        source = nullptr;
+    }
+
+    void composite(std::uint8_t* target, surface& source, core::blend_mode blend_mode)
+    {
+        composite(target, std::move(source), blend_mode);
+    }
+
+    void draw(std::uint8_t*    target,
+              int              channels,
+              const item&      item,
+              const surface&   local_key,
+              const surface&   layer_key,
+              bool             additive,
+              core::blend_mode blend_mode)
+    {
+        const auto& p       = item.place;
+        const auto  size    = source_size(item.pix_desc);
+        const auto  opacity = std::min(255, static_cast<int>(item.transform.opacity * 255.0 + 0.5));
+
+        for (int y = std::max(top_, p.top); y < std::min(top_ + rows_, p.bottom); ++y) {
+            double x0 = p.left;
+            double x1 = p.right;
+            narrow(p.u_x, p.u_y * y + p.u_c, p.u_lo, p.u_hi, x0, x1);
+            narrow(p.v_x, p.v_y * y + p.v_c, p.v_lo, p.v_hi, x0, x1);
+
+            const auto begin = std::max(p.left, static_cast<int>(std::ceil(x0)));
+            const auto end   = std::min(p.right, static_cast<int>(std::ceil(x1)));
+            const auto count = end - begin;
+            if (count <= 0) {
+                continue;
+            }
+
+            for (int n = 0; n < count; ++n) {
+                const auto x = begin + n;
+                const auto u = p.u_x * x + p.u_y * y + p.u_c;
+                const auto v = p.v_x * x + p.v_y * y + p.v_c;
+                xs_[n]       = std::min(size.first - 1, std::max(0, static_cast<int>(u * size.first)));
+                ys_[n]       = std::min(size.second - 1, std::max(0, static_cast<int>(v * size.second)));
+            }
+
+            auto src = pixels_.data();
+            fetch(item, xs_.data(), ys_.data(), count, src);
+
+            const auto offset = (y - top_) * width_ + begin;
+            if (local_key || layer_key) {
+                for (int n = 0; n < count; ++n) {
+                    auto factor = opacity;
+                    if (local_key) {
+                        factor = div255(factor * (*local_key)[offset + n]);
+                    }
+                    if (layer_key) {
+                        factor = div255(factor * (*layer_key)[offset + n]);
+                    }
+                    for (int c = 0; c < 4; ++c) {
+                        src[n * 4 + c] = static_cast<std::uint8_t>(div255(src[n * 4 + c] * factor));
+                    }
+                }
+            } else if (opacity < 255) {
+                scale(src, count, opacity);
+            }
+
+            if (item.transform.invert) {
+                for (int n = 0; n < count * 4; ++n) {
+                    src[n] = static_cast<std::uint8_t>(255 - src[n]);
+                }
+            }
+
+            if (channels == 1) {
+                // Keys keep the red channel, see the key targets of the OpenGL mixer.
+                auto dst = target + offset;
+                for (int n = 0; n < count; ++n) {
+                    dst[n] = clamp8(src[n * 4 + 2] + div255(dst[n] * (255 - src[n * 4 + 3])));
+                }
+                continue;
+            }
+
+            auto dst = target + offset * 4;
+            if (additive) {
+                add(dst, src, count);
+                continue;
+            }
+            if (blend_mode != core::blend_mode::normal) {
+                blend(blend_mode, dst, src, count);
+            }
+            over(dst, src, count);
+        }
+    }
+};
+
+// Target conversions, see convert.frag. Y'CbCr targets are converted by common/pixel_convert.
+
+// Converts a target of height rows into the planes of desc.
+std::vector<array<const std::uint8_t>> convert(const std::uint8_t*            source,
+                                               const core::video_format_desc& format_desc,
+                                               int                            height,
+                                               const core::pixel_format_desc& desc)
+{
+    const auto width    = format_desc.width;
+    const auto linesize = static_cast<std::size_t>(width) * 4;
+    const auto matrix   = format_desc.height > 700 ? convert::ycbcr_matrix::bt709 : convert::ycbcr_matrix::bt601;
+
+    std::vector<array<std::uint8_t>> planes;
+    for (auto& plane : desc.planes) {
+        planes.push_back(array<std::uint8_t>(plane.size));
+    }
+
+    switch (desc.format) {
+        case core::pixel_format::uyvy:
+            convert::bgra_to_uyvy(
+                source, linesize, width, height, planes[0].data(), desc.planes[0].linesize, matrix);
+            break;
+        case core::pixel_format::v210:
+            convert::bgra_to_v210(
+                source, linesize, width, height, planes[0].data(), desc.planes[0].linesize, matrix);
+            break;
+        case core::pixel_format::pgroup:
+            convert::bgra_to_pgroup(
+                source, linesize, width, height, planes[0].data(), desc.planes[0].linesize, matrix);
+            break;
+        case core::pixel_format::nv12:
+            convert::bgra_to_nv12(source,
+                                  linesize,
+                                  width,
+                                  height,
+                                  planes[0].data(),
+                                  desc.planes[0].linesize,
+                                  planes[1].data(),
+                                  desc.planes[1].linesize,
+                                  matrix);
+            break;
+        default:
+            for (std::size_t n = 0; n < desc.planes.size(); ++n) {
+                const auto& plane = desc.planes[n];
+                auto        data  = planes[n].data();
+                tbb::parallel_for(tbb::blocked_range<int>(0, plane.height), [&](const tbb::blocked_range<int>& r) {
+                    for (int y = r.begin(); y < r.end(); ++y) {
+                        auto       dst = data + y * plane.linesize;
+                        const auto row = source + std::min(y, height - 1) * linesize;
+                        if (desc.format != core::pixel_format::r210) {
+                            std::memcpy(dst, row, std::min<std::size_t>(plane.linesize, linesize));
+                            continue;
+                        }
+                        for (int x = 0; x < plane.width; ++x, dst += 4) {
+                            auto          p     = row + std::min(x, width - 1) * 4;
+                            std::uint32_t value = 0;
+                            for (int c = 2; c >= 0; --c) {
+                                auto level = std::min(940.0f, std::max(64.0f, p[c] / 255.0f * 876.0f + 64.5f));
+                                value      = (value << 10) | static_cast<std::uint32_t>(level);
+                            }
+                            dst[0] = static_cast<std::uint8_t>(value >> 24);
+                            dst[1] = static_cast<std::uint8_t>(value >> 16);
+                            dst[2] = static_cast<std::uint8_t>(value >> 8);
+                            dst[3] = static_cast<std::uint8_t>(value);
+                        }
+                    }
+                });
+            }
+            break;
+    }
+
+    std::vector<array<const std::uint8_t>> result;
+    for (auto& plane : planes) {
+        result.push_back(std::move(plane));
+    }
+    return result;
+}
+
+// Averages the source pixels under each pixel of a smaller bgra plane.
+array<const std::uint8_t>
+preview(const std::uint8_t* source, int width, int height, const core::pixel_format_desc::plane& plane)
+{
+    array<std::uint8_t> result(plane.size);
+    auto                data = result.data();
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, plane.height), [&](const tbb::blocked_range<int>& r) {
+        for (int y = r.begin(); y < r.end(); ++y) {
+            const auto top    = y * height / plane.height;
+            const auto bottom = std::max(top + 1, (y + 1) * height / plane.height);
+            auto       dst    = data + y * plane.linesize;
+            for (int x = 0; x < plane.width; ++x, dst += 4) {
+                const auto left  = x * width / plane.width;
+                const auto right = std::max(left + 1, (x + 1) * width / plane.width);
+
+                int sum[4] = {};
+                for (int sy = top; sy < bottom; ++sy) {
+                    auto src = source + (sy * width + left) * 4;
+                    for (int sx = left; sx < right; ++sx, src += 4) {
+                        for (int c = 0; c < 4; ++c) {
+                            sum[c] += src[c];
+                        }
+                    }
+                }
+                const auto count = (bottom - top) * (right - left);
+                for (int c = 0; c < 4; ++c) {
+                    dst[c] = static_cast<std::uint8_t>((sum[c] + count / 2) / count);
+                }
+            }
+        }
+    });
+
+    return std::move(result);
+}
+
+} // namespace
+
+struct image_mixer::impl
+{
+    const int                          channel_id_;
+    std::vector<core::image_transform> transform_stack_;
+    std::vector<layer>                 layers_;
+    std::vector<layer*>                layer_stack_;
+    std::set<core::pixel_format>       unsupported_;
+    std::atomic<double>                render_ms_{0.0};
+
+    explicit impl(int channel_id)
+        : channel_id_(channel_id)
+        , transform_stack_(1)
+    {
+        CASPAR_LOG(info) << L"Initialized CPU Image Mixer for channel " << channel_id;
+    }
+
+    void push(const core::frame_transform& transform)
+    {
+        auto previous_layer_depth = transform_stack_.back().layer_depth;
+        transform_stack_.push_back(transform_stack_.back() * transform.image_transform);
+        auto new_layer_depth = transform_stack_.back().layer_depth;
+
+        if (previous_layer_depth < new_layer_depth) {
+            layer new_layer(transform_stack_.back().blend_mode);
+
+            if (layer_stack_.empty()) {
+                layers_.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layers_.back());
+            } else {
+                layer_stack_.back()->sublayers.push_back(std::move(new_layer));
+                layer_stack_.push_back(&layer_stack_.back()->sublayers.back());
+            }
+        }
+    }
+
+    void visit(const core::const_frame& frame)
+    {
+        const auto& desc = frame.pixel_format_desc();
+        if (desc.format == core::pixel_format::invalid || desc.planes.empty()) {
+            return;
+        }
+
+        if (!is_supported(desc.format)) {
+            if (unsupported_.insert(desc.format).second) {
+                CASPAR_LOG(warning) << L"[cpu image mixer] Channel " << channel_id_ << L" can't draw pixel format "
+                                    << static_cast<int>(desc.format) << L", frames in it are skipped.";
+            }
+            return;
+        }
+
+        item item;
+        item.pix_desc  = desc;
+        item.transform = transform_stack_.back();
+        item.frame     = frame;
+
+        if (!item.transform.is_key && !item.transform.is_mix && item.transform.opacity < 0.001) {
+            return;
+        }
+
+        layer_stack_.back()->items.push_back(std::move(item));
+    }
+
+    void pop()
+    {
+        transform_stack_.pop_back();
+        layer_stack_.resize(transform_stack_.back().layer_depth);
+    }
+
+    // Drops items that cover nothing.
+    static void place(std::vector<layer>& layers, const core::video_format_desc& format_desc, core::field_mode field)
+    {
+        for (auto& layer : layers) {
+            place(layer.sublayers, format_desc, field);
+            auto& items = layer.items;
+            items.erase(std::remove_if(items.begin(),
+                                       items.end(),
+                                       [&](item& item) {
+                                           return !cpu::place(item, format_desc, field) && !item.transform.is_key &&
+                                                  !item.transform.is_mix;
+                                       }),
+                        items.end());
+        }
+    }
+
+    std::future<std::vector<array<const std::uint8_t>>>
+    render(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& descs)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        // A field is drawn at half height.
+        const auto field  = descs.empty() ? core::field_mode::progressive : descs[0].field;
+        const auto height = field != core::field_mode::progressive ? format_desc.height / 2 : format_desc.height;
+
+        auto layers = std::move(layers_);
+        layers_.clear();
+        place(layers, format_desc, field);
+
+        array<std::uint8_t> target(format_desc.width * height * 4);
+        auto                data = target.data();
+
+        if (!layers.empty()) {
+            // Bands of 16 rows keep a band's keys and mixes in cache while every layer is drawn into it.
+            tbb::parallel_for(tbb::blocked_range<int>(0, height, 16),
+                              [&](const tbb::blocked_range<int>& r) {
+                                  band(format_desc.width, r.begin(), r.end())
+                                      .draw(data + r.begin() * format_desc.width * 4, layers);
+                              });
+        }
+
+        array<const std::uint8_t> image(std::move(target));
+
+        std::vector<array<const std::uint8_t>> planes;
+        for (auto& desc : descs) {
+            if (desc.format == core::pixel_format::bgra) {
+                planes.push_back(desc.planes[0].width == format_desc.width
+                                     ? image
+                                     : preview(image.data(), format_desc.width, height, desc.planes[0]));
+                continue;
+            }
+            for (auto& plane : convert(image.data(), format_desc, height, desc)) {
+                planes.push_back(std::move(plane));
+            }
+        }
+
+        render_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::promise<std::vector<array<const std::uint8_t>>> promise;
+        promise.set_value(std::move(planes));
+        return promise.get_future();
+    }
+
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc)
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes) {
+            image_data.push_back(array<std::uint8_t>(plane.size));
+        }
+        return core::mutable_frame(tag, std::move(image_data), array<std::int32_t>{}, desc);
+    }
+};
+
+image_mixer::image_mixer(int channel_id)
+    : impl_(std::make_unique<impl>(channel_id))
+{
+}
+image_mixer::~image_mixer() {}
+void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
+void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
+void image_mixer::pop() { impl_->pop(); }
+core::monitor::state image_mixer::state() const
+{
+    core::monitor::state state;
+    state["cpu-render-ms"] = impl_->render_ms_.load();
+    return state;
+}
+std::future<std::vector<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& descs)
+{
+    return impl_->render(format_desc, descs);
+}
+core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
+{
+    return impl_->create_frame(tag, desc);
+}
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/array.h>
+
+#include <core/frame/frame.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/video_format.h>
+
+#include <future>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace cpu {
+
+// Composites on the CPU, for nodes without a usable GPU. The frame is rendered in bands of rows on the TBB pool, each
+// band drawing every layer in turn.
+//
+// Draws 8 bit RGB, planar and semi-planar Y'CbCr, uyvy, v210 and solid colour frames with fill, anchor, rotation, crop,
+// clip, opacity, invert, keys, mixes and the separable blend modes, others blend as normal. Y'CbCr of more than 8 bits
+// is truncated to 8. Sampling is nearest neighbour. Perspective, levels, contrast, saturation, brightness, chroma keys
+// and field modes are ignored, and frames in other pixel formats are not drawn.
+class image_mixer final : public core::image_mixer
+{
+  public:
+    explicit image_mixer(int channel_id);
+    image_mixer(const image_mixer&) = delete;
+
+    ~image_mixer();
+
+    image_mixer& operator=(const image_mixer&) = delete;
+
+    std::future<std::vector<array<const std::uint8_t>>>
+                        operator()(const core::video_format_desc&              format_desc,
+                                   const std::vector<core::pixel_format_desc>& descs) override;
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+
+    core::monitor::state state() const override;
+
+    // core::image_mixer
+
+    void push(const core::frame_transform& frame) override;
+    void visit(const core::const_frame& frame) override;
+    void pop() override;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::cpu
@@ -0,0 +1,175 @@
+#version 450
+out vec4 fragColor;
+
+uniform sampler2D source;
+uniform int       format;
+uniform int       plane;
+uniform bool      is_hd;
+uniform bool      scaled;
+uniform vec2      target_size;
+
+// Keep in sync with core::pixel_format.
+const int UYVY   = 10;
+const int V210   = 11;
+const int NV12   = 12;
+const int R210   = 13;
+const int PGROUP = 18;
+
+/*
+** Limited range Y'CbCr, normalized to 0..1.
+*/
+vec3 ycbcr(vec3 rgb)
+{
+    float kr = is_hd ? 0.2126 : 0.299;
+    float kb = is_hd ? 0.0722 : 0.114;
+    float y  = kr * rgb.r + (1.0 - kr - kb) * rgb.g + kb * rgb.b;
+    float cb = (rgb.b - y) / (2.0 - 2.0 * kb);
+    float cr = (rgb.r - y) / (2.0 - 2.0 * kr);
+    return vec3(16.0 + 219.0 * y, 128.0 + 224.0 * cb, 128.0 + 224.0 * cr) / 255.0;
+}
+
+vec3 fetch(int x, int y)
+{
+    ivec2 size = textureSize(source, 0);
+    return texelFetch(source, ivec2(clamp(x, 0, size.x - 1), clamp(y, 0, size.y - 1)), 0).rgb;
+}
+
+/*
+** Targets are read back as BGRA, so byte n of a 4 byte texel is written to the channel that ends up at offset n.
+*/
+vec4 pack_bytes(vec4 bytes)
+{
+    return bytes.bgra;
+}
+
+vec4 pack_word(uint word)
+{
+    return pack_bytes(unpackUnorm4x8(word));
+}
+
+uint to_10bit(float value)
+{
+    return uint(clamp(value * 255.0 * 4.0 + 0.5, 4.0, 1019.0));
+}
+
+vec4 uyvy(ivec2 pos)
+{
+    vec3 yuv0 = ycbcr(fetch(pos.x * 2 + 0, pos.y));
+    vec3 yuv1 = ycbcr(fetch(pos.x * 2 + 1, pos.y));
+    vec2 c    = (yuv0.yz + yuv1.yz) * 0.5;
+    return pack_bytes(vec4(c.x, yuv0.x, c.y, yuv1.x));
+}
+
+vec4 v210(ivec2 pos)
+{
+    int  word = pos.x % 4;
+    int  x    = pos.x / 4 * 6;
+    uint y[6];
+    uint cb[3];
+    uint cr[3];
+    for (int n = 0; n < 3; ++n) {
+        vec3 yuv0 = ycbcr(fetch(x + n * 2 + 0, pos.y));
+        vec3 yuv1 = ycbcr(fetch(x + n * 2 + 1, pos.y));
+        y[n * 2 + 0] = to_10bit(yuv0.x);
+        y[n * 2 + 1] = to_10bit(yuv1.x);
+        cb[n]        = to_10bit((yuv0.y + yuv1.y) * 0.5);
+        cr[n]        = to_10bit((yuv0.z + yuv1.z) * 0.5);
+    }
+
+    uint value;
+    if (word == 0)
+        value = cb[0] | (y[0] << 10) | (cr[0] << 20);
+    else if (word == 1)
+        value = y[1] | (cb[1] << 10) | (y[2] << 20);
+    else if (word == 2)
+        value = cr[1] | (y[3] << 10) | (cb[2] << 20);
+    else
+        value = y[4] | (cr[2] << 10) | (y[5] << 20);
+
+    return pack_word(value);
+}
+
+/*
+** Big endian, 2 padding bits followed by 10 bits each of R, G and B, in the 64..940 range.
+*/
+vec4 r210(ivec2 pos)
+{
+    uvec3 rgb   = uvec3(clamp(fetch(pos.x, pos.y) * 876.0 + 64.5, 64.0, 940.0));
+    uint  value = (rgb.r << 20) | (rgb.g << 10) | rgb.b;
+    return pack_bytes(unpackUnorm4x8(value).wzyx);
+}
+
+/*
+** Pgroups of ST 2110-20, Cb Y0 Cr Y1 as 40 big endian bits per 2 pixels. A texel holds 4 bytes of the line and spans
+** at most 2 pgroups.
+*/
+uint pgroup_byte(uvec4 group, int index)
+{
+    uint cb = group.x, y0 = group.y, cr = group.z, y1 = group.w;
+    if (index == 0)
+        return cb >> 2;
+    if (index == 1)
+        return ((cb & 3u) << 6) | (y0 >> 4);
+    if (index == 2)
+        return ((y0 & 15u) << 4) | (cr >> 6);
+    if (index == 3)
+        return ((cr & 63u) << 2) | (y1 >> 8);
+    return y1 & 255u;
+}
+
+uvec4 pgroup_at(int group, int y)
+{
+    vec3 yuv0 = ycbcr(fetch(group * 2 + 0, y));
+    vec3 yuv1 = ycbcr(fetch(group * 2 + 1, y));
+    return uvec4(
+        to_10bit((yuv0.y + yuv1.y) * 0.5), to_10bit(yuv0.x), to_10bit((yuv0.z + yuv1.z) * 0.5), to_10bit(yuv1.x));
+}
+
+vec4 pgroup(ivec2 pos)
+{
+    int   first = pos.x * 4 / 5;
+    uvec4 a     = pgroup_at(first, pos.y);
+    uvec4 b     = pgroup_at(first + 1, pos.y);
+    uint  word  = 0u;
+    for (int n = 0; n < 4; ++n) {
+        int  offset = pos.x * 4 + n - first * 5;
+        uint value  = offset < 5 ? pgroup_byte(a, offset) : pgroup_byte(b, offset - 5);
+        word |= value << (n * 8);
+    }
+    return pack_word(word);
+}
+
+vec4 nv12(ivec2 pos)
+{
+    if (plane == 0)
+        return vec4(ycbcr(fetch(pos.x, pos.y)).x, 0.0, 0.0, 1.0);
+
+    vec3 rgb = fetch(pos.x * 2 + 0, pos.y * 2 + 0) + fetch(pos.x * 2 + 1, pos.y * 2 + 0) +
+               fetch(pos.x * 2 + 0, pos.y * 2 + 1) + fetch(pos.x * 2 + 1, pos.y * 2 + 1);
+    return vec4(ycbcr(rgb * 0.25).yz, 0.0, 1.0);
+}
+
+void main()
+{
+    ivec2 pos = ivec2(gl_FragCoord.xy);
+    switch (format) {
+        case UYVY:
+            fragColor = uyvy(pos);
+            break;
+        case V210:
+            fragColor = v210(pos);
+            break;
+        case NV12:
+            fragColor = nv12(pos);
+            break;
+        case R210:
+            fragColor = r210(pos);
+            break;
+        case PGROUP:
+            fragColor = pgroup(pos);
+            break;
+        default:
+            fragColor = scaled ? texture(source, gl_FragCoord.xy / target_size) : texelFetch(source, pos, 0);
+            break;
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+#include "format_converter.h"
+
+#include "../util/device.h"
+#include "../util/shader.h"
+#include "../util/texture.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include "ogl_convert_fragment.h"
+#include "ogl_convert_vertex.h"
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+struct format_converter::impl
+{
+    spl::shared_ptr<device> ogl_;
+    std::unique_ptr<shader> shader_;
+    GLuint                  vao_;
+
+    explicit impl(const spl::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+        ogl_->dispatch_sync([&] {
+            shader_ =
+                std::make_unique<shader>(std::string(convert_vertex_shader), std::string(convert_fragment_shader));
+            GL(glGenVertexArrays(1, &vao_));
+        });
+    }
+
+    ~impl()
+    {
+        ogl_->dispatch_sync([&] {
+            GL(glDeleteVertexArrays(1, &vao_));
+            shader_.reset();
+        });
+    }
+
+    void convert(const std::shared_ptr<texture>& source,
+                 const std::shared_ptr<texture>& target,
+                 core::pixel_format              format,
+                 int                             plane,
+                 bool                            is_hd)
+    {
+        shader_->use();
+        shader_->set("source", 0);
+        shader_->set("format", format);
+        shader_->set("plane", plane);
+        shader_->set("is_hd", is_hd);
+
+        // A smaller target of the source's own format is a preview, sampled from the mipmaps.
+        const auto scaled = format == core::pixel_format::bgra &&
+                            (target->width() != source->width() || target->height() != source->height());
+        shader_->set("scaled", scaled);
+        shader_->set("target_size", static_cast<double>(target->width()), static_cast<double>(target->height()));
+
+        if (scaled) {
+            source->bind_mipmaps(0);
+        } else {
+            source->bind(0);
+        }
+        target->attach();
+
+        GL(glViewport(0, 0, target->width(), target->height()));
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        GL(glBindVertexArray(vao_));
+        GL(glDrawArrays(GL_TRIANGLES, 0, 3));
+        GL(glBindVertexArray(0));
+
+        source->unbind();
+    }
+};
+
+format_converter::format_converter(const spl::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+format_converter::~format_converter() {}
+void format_converter::convert(const std::shared_ptr<texture>& source,
+                               const std::shared_ptr<texture>& target,
+                               core::pixel_format              format,
+                               int                             plane,
+                               bool                            is_hd)
+{
+    impl_->convert(source, target, format, plane, is_hd);
+}
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/frame/pixel_format.h>
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+class format_converter final
+{
+  public:
+    explicit format_converter(const spl::shared_ptr<class device>& ogl);
+    format_converter(const format_converter&) = delete;
+
+    ~format_converter();
+
+    format_converter& operator=(const format_converter&) = delete;
+
+    // Renders plane of format from the bgra source into target, a bgra target of another size gets a minified copy.
+    // Must be called on the device thread.
+    void convert(const std::shared_ptr<class texture>& source,
+                 const std::shared_ptr<class texture>& target,
+                 core::pixel_format                    format,
+                 int                                   plane,
+                 bool                                  is_hd);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -27,18 +27,26 @@
 #include "../util/texture.h"
 
 #include <common/assert.h>
+#include <common/env.h>
 #include <common/gl/gl_check.h>
 
 #include <core/frame/frame_transform.h>
 #include <core/frame/pixel_format.h>
 
 #include <boost/algorithm/cxx11/all_of.hpp>
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 
 #include <GL/glew.h>
 
 #include <array>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
@@ -106,20 +114,315 @@ bool is_outside_screen(const std::vector<core::frame_geometry::coord>& coords)
            boost::algorithm::all_of(y_coords, &is_above_screen) || boost::algorithm::all_of(y_coords, &is_below_screen);
 }
 
+// Moves the vertices to where the transform puts them on the screen, which spans 0 to 1 on both axes.
+void transform_coords(std::vector<core::frame_geometry::coord>& coords,
+                      bool                                      is_default_geometry,
+                      const core::image_transform&              transform,
+                      double                                    aspect)
+{
+    auto f_p    = transform.fill_translation;
+    auto f_s    = transform.fill_scale;
+    auto angle  = transform.angle;
+    auto anchor = transform.anchor;
+    auto crop   = transform.crop;
+    auto pers   = transform.perspective;
+    pers.ur[0] -= 1.0;
+    pers.lr[0] -= 1.0;
+    pers.lr[1] -= 1.0;
+    pers.ll[1] -= 1.0;
+    std::vector<std::array<double, 2>> pers_corners = {pers.ul, pers.ur, pers.lr, pers.ll};
+
+    auto do_crop = [&](core::frame_geometry::coord& coord) {
+        if (!is_default_geometry) {
+            // TODO implement support for non-default geometry.
+            return;
+        }
+
+        coord.vertex_x  = std::max(coord.vertex_x, crop.ul[0]);
+        coord.vertex_x  = std::min(coord.vertex_x, crop.lr[0]);
+        coord.vertex_y  = std::max(coord.vertex_y, crop.ul[1]);
+        coord.vertex_y  = std::min(coord.vertex_y, crop.lr[1]);
+        coord.texture_x = std::max(coord.texture_x, crop.ul[0]);
+        coord.texture_x = std::min(coord.texture_x, crop.lr[0]);
+        coord.texture_y = std::max(coord.texture_y, crop.ul[1]);
+        coord.texture_y = std::min(coord.texture_y, crop.lr[1]);
+    };
+    auto do_perspective = [=](core::frame_geometry::coord& coord, const std::array<double, 2>& pers_corner) {
+        if (!is_default_geometry) {
+            // TODO implement support for non-default geometry.
+            return;
+        }
+
+        coord.vertex_x += pers_corner[0];
+        coord.vertex_y += pers_corner[1];
+    };
+    auto rotate = [&](core::frame_geometry::coord& coord) {
+        auto orig_x    = (coord.vertex_x - anchor[0]) * f_s[0];
+        auto orig_y    = (coord.vertex_y - anchor[1]) * f_s[1] / aspect;
+        coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle);
+        coord.vertex_y = orig_x * std::sin(angle) + orig_y * std::cos(angle);
+        coord.vertex_y *= aspect;
+    };
+    auto move = [&](core::frame_geometry::coord& coord) {
+        coord.vertex_x += f_p[0];
+        coord.vertex_y += f_p[1];
+    };
+
+    int corner = 0;
+    for (auto& coord : coords) {
+        do_crop(coord);
+        do_perspective(coord, pers_corners.at(corner));
+        rotate(coord);
+        move(coord);
+
+        if (++corner == 4) {
+            corner = 0;
+        }
+    }
+}
+
+bool is_hidden(const core::image_transform& transform, const core::frame_geometry& geometry)
+{
+    if (transform.opacity < 0.001) {
+        return true;
+    }
+
+    auto coords = geometry.data();
+    if (coords.empty()) {
+        return true;
+    }
+
+    // Rotation depends on the aspect ratio of the channel, which is not known until render, so rotated items are kept.
+    if (transform.angle != 0.0) {
+        return false;
+    }
+
+    transform_coords(coords, boost::equal(coords, core::frame_geometry::get_default().data()), transform, 1.0);
+    return is_outside_screen(coords);
+}
+
+// Host copy of draw_block in shader.frag, std140 lays out these scalars packed in declaration order.
+struct alignas(16) uniform_block
+{
+    std::int32_t is_hd;
+    std::int32_t has_local_key;
+    std::int32_t has_layer_key;
+    std::int32_t blend_mode;
+    std::int32_t keyer;
+    std::int32_t pixel_format;
+
+    std::int32_t invert;
+    std::int32_t levels;
+    std::int32_t csb;
+    std::int32_t chroma; // 1 keys in HSV, 2 in YCbCr
+    std::int32_t chroma_show_mask;
+
+    float opacity;
+    float min_input;
+    float max_input;
+    float gamma;
+    float min_output;
+    float max_output;
+
+    float brt;
+    float sat;
+    float con;
+
+    float chroma_target_hue;
+    float chroma_hue_width;
+    float chroma_min_saturation;
+    float chroma_min_brightness;
+    float chroma_softness;
+    float chroma_spill_suppress;
+    float chroma_spill_suppress_saturation;
+
+    float chroma_axis_cb;
+    float chroma_axis_cr;
+    float chroma_target_magnitude;
+    float chroma_target_luma;
+    float chroma_spill_cos;
+    float chroma_spill_sin;
+    float chroma_kr;
+    float chroma_kb;
+
+    std::int32_t field_mode;
+    std::int32_t color_space;
+    std::int32_t scaling;
+    float        sample_scale;
+    std::int32_t packed_width;
+
+    float solid_color[4];
+};
+
+static_assert(sizeof(uniform_block) % 16 == 0, "draw_block must be a multiple of vec4");
+
+// Key of the shader variant compiled for a draw, 0 is the generic shader that branches on every uniform.
+std::uint32_t variant_key(const uniform_block& u)
+{
+    return 1u << 31 | static_cast<std::uint32_t>(u.pixel_format & 0x1F) |
+           static_cast<std::uint32_t>(u.blend_mode & 0x3F) << 5 | static_cast<std::uint32_t>(u.keyer & 1) << 11 |
+           static_cast<std::uint32_t>(u.has_local_key) << 12 | static_cast<std::uint32_t>(u.has_layer_key) << 13 |
+           static_cast<std::uint32_t>(u.invert) << 14 | static_cast<std::uint32_t>(u.levels) << 15 |
+           static_cast<std::uint32_t>(u.csb) << 16 | static_cast<std::uint32_t>(u.chroma & 1) << 17 |
+           static_cast<std::uint32_t>(u.field_mode & 0x3) << 18 |
+           static_cast<std::uint32_t>(u.color_space & 0x3) << 20 | static_cast<std::uint32_t>(u.scaling & 0x3) << 22 |
+           static_cast<std::uint32_t>(u.chroma >> 1 & 1) << 24;
+}
+
+std::string variant_defines(const uniform_block& u)
+{
+    std::ostringstream defines;
+    defines << std::boolalpha;
+    defines << "#define PIXEL_FORMAT " << u.pixel_format << "\n";
+    defines << "#define BLEND_MODE " << u.blend_mode << "\n";
+    defines << "#define KEYER " << u.keyer << "\n";
+    defines << "#define HAS_LOCAL_KEY " << (u.has_local_key != 0) << "\n";
+    defines << "#define HAS_LAYER_KEY " << (u.has_layer_key != 0) << "\n";
+    defines << "#define INVERT " << (u.invert != 0) << "\n";
+    defines << "#define LEVELS " << (u.levels != 0) << "\n";
+    defines << "#define CSB " << (u.csb != 0) << "\n";
+    defines << "#define CHROMA " << u.chroma << "\n";
+    defines << "#define FIELD_MODE " << u.field_mode << "\n";
+    defines << "#define COLOR_SPACE " << u.color_space << "\n";
+    defines << "#define SCALING " << u.scaling << "\n";
+    return defines.str();
+}
+
+// Kernel the shader resamples scaled draws with, 0 is the texture units' bilinear filtering.
+std::int32_t get_scaling(const std::wstring& mode)
+{
+    if (mode == L"bicubic") {
+        return 1;
+    }
+    if (mode == L"lanczos") {
+        return 2;
+    }
+    return 0;
+}
+
+// Factor that takes samples of more than 8 bits, read from 16 bit textures, to full range.
+float sample_scale(const core::pixel_format_desc& desc)
+{
+    if (desc.bit_depth <= 8 || desc.bit_depth >= 16) {
+        return 1.0f;
+    }
+    const auto max = static_cast<float>((1 << desc.bit_depth) - 1);
+    return desc.format == core::pixel_format::p010 ? 65535.0f / (max * (1 << (16 - desc.bit_depth))) : 65535.0f / max;
+}
+
+core::color_space resolve_color_space(const core::pixel_format_desc& desc)
+{
+    if (desc.color_space != core::color_space::unspecified) {
+        return desc.color_space;
+    }
+    return desc.planes.at(0).height > 700 ? core::color_space::bt709 : core::color_space::bt601;
+}
+
+// Parameters of the YCbCr keyer in shader.frag that only depend on the key and the color space of the source, so
+// the shader measures hue, saturation and brightness against the target without converting to HSV.
+void set_ycbcr_key(uniform_block& u, const core::chroma& chroma)
+{
+    static const double PI   = 3.141592653589793;
+    static const double kr[] = {0.299, 0.2126, 0.2627};
+    static const double kb[] = {0.114, 0.0722, 0.0593};
+    const auto          cs   = std::max(0, std::min(2, u.color_space));
+
+    // The target hue at full saturation and brightness, as in hsv2rgb.
+    const auto hue = chroma.target_hue / 360.0 - std::floor(chroma.target_hue / 360.0);
+    const auto r   = std::max(0.0, std::min(1.0, std::abs(hue * 6.0 - 3.0) - 1.0));
+    const auto g   = std::max(0.0, std::min(1.0, 2.0 - std::abs(hue * 6.0 - 2.0)));
+    const auto b   = std::max(0.0, std::min(1.0, 2.0 - std::abs(hue * 6.0 - 4.0)));
+
+    const auto y         = kr[cs] * r + (1.0 - kr[cs] - kb[cs]) * g + kb[cs] * b;
+    const auto cb        = (b - y) / (2.0 * (1.0 - kb[cs]));
+    const auto cr        = (r - y) / (2.0 * (1.0 - kr[cs]));
+    const auto magnitude = std::sqrt(cb * cb + cr * cr);
+    const auto spill     = chroma.spill_suppress * PI / 180.0;
+
+    u.chroma_axis_cb          = static_cast<float>(cb / magnitude);
+    u.chroma_axis_cr          = static_cast<float>(cr / magnitude);
+    u.chroma_target_magnitude = static_cast<float>(magnitude);
+    u.chroma_target_luma      = static_cast<float>(y);
+    u.chroma_spill_cos        = static_cast<float>(std::cos(spill));
+    u.chroma_spill_sin        = static_cast<float>(std::sin(spill));
+    u.chroma_kr               = static_cast<float>(kr[cs]);
+    u.chroma_kb               = static_cast<float>(kb[cs]);
+}
+
+struct bounds
+{
+    double left   = std::numeric_limits<double>::max();
+    double top    = std::numeric_limits<double>::max();
+    double right  = std::numeric_limits<double>::lowest();
+    double bottom = std::numeric_limits<double>::lowest();
+
+    bool intersects(const bounds& other) const
+    {
+        return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+    }
+};
+
 struct image_kernel::impl
 {
-    spl::shared_ptr<device> ogl_;
-    spl::shared_ptr<shader> shader_;
-    GLuint                  vao_;
-    GLuint                  vbo_;
+    // Draws in one batch share a render target, blend mode and keyer, and don't overlap, so they don't need a
+    // texture barrier between them.
+    struct pending_draw
+    {
+        draw_params                              params;
+        uniform_block                            uniforms{};
+        std::uint32_t                            variant = 0;
+        std::vector<core::frame_geometry::coord> vertices;
+        bounds                                   area;
+        bool                                     scissor = false;
+        bool                                     mipmaps = false;
+        std::array<int, 4>                       scissor_rect{};
+    };
+
+    static const std::size_t max_batch_size = 64;
+    static const std::size_t max_variants   = 64;
+
+    spl::shared_ptr<device>   ogl_;
+    spl::shared_ptr<shader>   shader_;
+    GLuint                    vao_;
+    GLuint                    vbo_;
+    GLuint                    ubo_;
+    GLint                     ubo_alignment_ = 256;
+    std::vector<pending_draw> pending_;
+    std::vector<char>         uniform_data_;
+
+    const bool                                       use_variants_;
+    const std::int32_t                               scaling_;
+    std::map<std::uint32_t, std::shared_ptr<shader>> variants_;
+
+    std::atomic<std::uint64_t> draw_calls_{0};
+    std::atomic<std::uint64_t> batches_{0};
 
     explicit impl(const spl::shared_ptr<device>& ogl)
         : ogl_(ogl)
         , shader_(ogl_->dispatch_sync([&] { return get_image_shader(ogl); }))
+        , use_variants_(env::properties().get(L"configuration.ogl.shader-variants", true))
+        , scaling_(get_scaling(env::properties().get(L"configuration.ogl.scaling", std::wstring(L"linear"))))
     {
         ogl_->dispatch_sync([&] {
             GL(glGenVertexArrays(1, &vao_));
             GL(glGenBuffers(1, &vbo_));
+            GL(glGenBuffers(1, &ubo_));
+            GL(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ubo_alignment_));
+
+            setup_samplers(*shader_);
+
+            auto stride  = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+            auto vtx_loc = shader_->get_attrib_location("Position");
+            auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+
+            GL(glBindVertexArray(vao_));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            GL(glEnableVertexAttribArray(vtx_loc));
+            GL(glEnableVertexAttribArray(tex_loc));
+            GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
+            GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+            GL(glBindVertexArray(0));
+            GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
         });
     }
 
@@ -128,208 +431,248 @@ struct image_kernel::impl
         ogl_->dispatch_sync([&] {
             GL(glDeleteVertexArrays(1, &vao_));
             GL(glDeleteBuffers(1, &vbo_));
+            GL(glDeleteBuffers(1, &ubo_));
         });
     }
 
+    static void setup_samplers(shader& program)
+    {
+        program.use();
+        program.set("plane[0]", texture_id::plane0);
+        program.set("plane[1]", texture_id::plane1);
+        program.set("plane[2]", texture_id::plane2);
+        program.set("plane[3]", texture_id::plane3);
+        program.set("local_key", texture_id::local_key);
+        program.set("layer_key", texture_id::layer_key);
+        program.set("background", texture_id::background);
+    }
+
+    // Compiles variants on first use, on the device thread.
+    shader& program(const pending_draw& draw)
+    {
+        if (draw.variant == 0) {
+            return *shader_;
+        }
+
+        auto it = variants_.find(draw.variant);
+        if (it == variants_.end()) {
+            auto variant = get_image_shader(ogl_, variant_defines(draw.uniforms));
+            setup_samplers(*variant);
+            it = variants_.emplace(draw.variant, std::move(variant)).first;
+        }
+        return *it->second;
+    }
+
+    static bool uses(const draw_params& params, const std::shared_ptr<texture>& tex)
+    {
+        for (auto& source : params.textures) {
+            if (source.get() == tex.get()) {
+                return true;
+            }
+        }
+        return params.local_key == tex || params.layer_key == tex;
+    }
+
+    bool fits_batch(const pending_draw& draw) const
+    {
+        if (pending_.empty()) {
+            return true;
+        }
+
+        auto& first = pending_.front().params;
+        if (pending_.size() >= max_batch_size || first.background != draw.params.background ||
+            first.blend_mode != draw.params.blend_mode || first.keyer != draw.params.keyer ||
+            pending_.front().variant != draw.variant || uses(draw.params, first.background)) {
+            return false;
+        }
+
+        for (auto& other : pending_) {
+            if (other.area.intersects(draw.area)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     void draw(draw_params params)
+    {
+        pending_draw draw;
+        if (!prepare(std::move(params), draw)) {
+            return;
+        }
+
+        if (!fits_batch(draw)) {
+            flush();
+        }
+
+        pending_.push_back(std::move(draw));
+    }
+
+    // The kernel of a scaled draw, the configured one unless its transform asks for another.
+    std::int32_t scaling(core::scale_filter filter) const
+    {
+        return filter == core::scale_filter::configured ? scaling_ : static_cast<std::int32_t>(filter) - 1;
+    }
+
+    bool prepare(draw_params params, pending_draw& draw)
     {
         static const double epsilon = 0.001;
 
-        CASPAR_ASSERT(params.pix_desc.planes.size() == params.textures.size());
+        // Solid colours are a quad of a uniform colour, without textures.
+        const auto solid = params.pix_desc.format == core::pixel_format::color;
 
-        if (params.textures.empty() || !params.background) {
-            return;
+        CASPAR_ASSERT(solid || params.pix_desc.planes.size() == params.textures.size());
+
+        if ((params.textures.empty() && !solid) || !params.background) {
+            return false;
         }
 
         if (params.transform.opacity < epsilon) {
-            return;
+            return false;
         }
 
         auto coords = params.geometry.data();
 
         if (coords.empty()) {
-            return;
+            return false;
         }
 
-        // Calculate transforms
-        auto f_p = params.transform.fill_translation;
-        auto f_s = params.transform.fill_scale;
-
         bool is_default_geometry = boost::equal(coords, core::frame_geometry::get_default().data());
-        auto aspect              = params.aspect_ratio;
-        auto angle               = params.transform.angle;
-        auto anchor              = params.transform.anchor;
         auto crop                = params.transform.crop;
         auto pers                = params.transform.perspective;
         pers.ur[0] -= 1.0;
         pers.lr[0] -= 1.0;
         pers.lr[1] -= 1.0;
         pers.ll[1] -= 1.0;
-        std::vector<std::array<double, 2>> pers_corners = {pers.ul, pers.ur, pers.lr, pers.ll};
-
-        auto do_crop = [&](core::frame_geometry::coord& coord) {
-            if (!is_default_geometry) {
-                // TODO implement support for non-default geometry.
-                return;
-            }
 
-            coord.vertex_x  = std::max(coord.vertex_x, crop.ul[0]);
-            coord.vertex_x  = std::min(coord.vertex_x, crop.lr[0]);
-            coord.vertex_y  = std::max(coord.vertex_y, crop.ul[1]);
-            coord.vertex_y  = std::min(coord.vertex_y, crop.lr[1]);
-            coord.texture_x = std::max(coord.texture_x, crop.ul[0]);
-            coord.texture_x = std::min(coord.texture_x, crop.lr[0]);
-            coord.texture_y = std::max(coord.texture_y, crop.ul[1]);
-            coord.texture_y = std::min(coord.texture_y, crop.lr[1]);
-        };
-        auto do_perspective = [=](core::frame_geometry::coord& coord, const std::array<double, 2>& pers_corner) {
-            if (!is_default_geometry) {
-                // TODO implement support for non-default geometry.
-                return;
-            }
+        transform_coords(coords, is_default_geometry, params.transform, params.aspect_ratio);
 
-            coord.vertex_x += pers_corner[0];
-            coord.vertex_y += pers_corner[1];
-        };
-        auto rotate = [&](core::frame_geometry::coord& coord) {
-            auto orig_x    = (coord.vertex_x - anchor[0]) * f_s[0];
-            auto orig_y    = (coord.vertex_y - anchor[1]) * f_s[1] / aspect;
-            coord.vertex_x = orig_x * std::cos(angle) - orig_y * std::sin(angle);
-            coord.vertex_y = orig_x * std::sin(angle) + orig_y * std::cos(angle);
-            coord.vertex_y *= aspect;
-        };
-        auto move = [&](core::frame_geometry::coord& coord) {
-            coord.vertex_x += f_p[0];
-            coord.vertex_y += f_p[1];
-        };
-
-        int corner = 0;
-        for (auto& coord : coords) {
-            do_crop(coord);
-            do_perspective(coord, pers_corners.at(corner));
-            rotate(coord);
-            move(coord);
-
-            if (++corner == 4) {
-                corner = 0;
+        // A field is drawn over the lines of the whole frame, its row centres lie half a frame line below the upper
+        // field's lines and above the lower field's.
+        const auto frame_height =
+            params.background->height() * (params.target_field != core::field_mode::progressive ? 2.0 : 1.0);
+        if (params.target_field != core::field_mode::progressive) {
+            const auto offset = (params.target_field == core::field_mode::upper ? 0.5 : -0.5) / frame_height;
+            for (auto& coord : coords) {
+                coord.vertex_y += offset;
             }
         }
 
         // Skip drawing if all the coordinates will be outside the screen.
         if (is_outside_screen(coords)) {
-            return;
-        }
-
-        // Bind textures
-
-        for (int n = 0; n < params.textures.size(); ++n) {
-            params.textures[n]->bind(n);
-        }
-
-        if (params.local_key) {
-            params.local_key->bind(static_cast<int>(texture_id::local_key));
-        }
-
-        if (params.layer_key) {
-            params.layer_key->bind(static_cast<int>(texture_id::layer_key));
+            return false;
         }
 
-        // Setup shader
-
-        shader_->use();
-
-        shader_->set("plane[0]", texture_id::plane0);
-        shader_->set("plane[1]", texture_id::plane1);
-        shader_->set("plane[2]", texture_id::plane2);
-        shader_->set("plane[3]", texture_id::plane3);
-        shader_->set("local_key", texture_id::local_key);
-        shader_->set("layer_key", texture_id::layer_key);
-        shader_->set("is_hd", params.pix_desc.planes.at(0).height > 700 ? 1 : 0);
-        shader_->set("has_local_key", static_cast<bool>(params.local_key));
-        shader_->set("has_layer_key", static_cast<bool>(params.layer_key));
-        shader_->set("pixel_format", params.pix_desc.format);
-        shader_->set("opacity", params.transform.is_key ? 1.0 : params.transform.opacity);
-
-        if (params.transform.chroma.enable) {
-            shader_->set("chroma", true);
-            shader_->set("chroma_show_mask", params.transform.chroma.show_mask);
-            shader_->set("chroma_target_hue", params.transform.chroma.target_hue / 360.0);
-            shader_->set("chroma_hue_width", params.transform.chroma.hue_width);
-            shader_->set("chroma_min_saturation", params.transform.chroma.min_saturation);
-            shader_->set("chroma_min_brightness", params.transform.chroma.min_brightness);
-            shader_->set("chroma_softness", 1.0 + params.transform.chroma.softness);
-            shader_->set("chroma_spill_suppress", params.transform.chroma.spill_suppress / 360.0);
-            shader_->set("chroma_spill_suppress_saturation", params.transform.chroma.spill_suppress_saturation);
-        } else {
-            shader_->set("chroma", false);
+        // Texels per target pixel of the first plane, pixels for v210, before the perspective correction below
+        // rescales the texture coordinates.
+        bounds source;
+        bounds target;
+        for (auto& coord : coords) {
+            source.left   = std::min(source.left, coord.texture_x);
+            source.right  = std::max(source.right, coord.texture_x);
+            source.top    = std::min(source.top, coord.texture_y);
+            source.bottom = std::max(source.bottom, coord.texture_y);
+            target.left   = std::min(target.left, coord.vertex_x);
+            target.right  = std::max(target.right, coord.vertex_x);
+            target.top    = std::min(target.top, coord.vertex_y);
+            target.bottom = std::max(target.bottom, coord.vertex_y);
         }
+        auto source_width =
+            params.pix_desc.packed_width > 0 ? params.pix_desc.packed_width : params.pix_desc.planes.at(0).width;
+        auto scale_x = (source.right - source.left) * source_width /
+                       std::max(epsilon, (target.right - target.left) * params.background->width());
+        auto scale_y = (source.bottom - source.top) * params.pix_desc.planes.at(0).height /
+                       std::max(epsilon, (target.bottom - target.top) * frame_height);
+        auto is_scaled = !solid && (std::abs(scale_x - 1.0) > epsilon || std::abs(scale_y - 1.0) > epsilon);
 
-        // Setup blend_func
+        // Setup uniforms
 
         if (params.transform.is_key) {
             params.blend_mode = core::blend_mode::normal;
         }
 
-        params.background->bind(static_cast<int>(texture_id::background));
-        shader_->set("background", texture_id::background);
-        shader_->set("blend_mode", params.blend_mode);
-        shader_->set("keyer", params.keyer);
+        auto& u         = draw.uniforms;
+        u.color_space   = static_cast<std::int32_t>(resolve_color_space(params.pix_desc)) - 1;
+        u.is_hd         = u.color_space > 0 ? 1 : 0;
+        u.has_local_key = params.local_key ? 1 : 0;
+        u.has_layer_key = params.layer_key ? 1 : 0;
+        u.blend_mode    = static_cast<std::int32_t>(params.blend_mode);
+        u.keyer         = static_cast<std::int32_t>(params.keyer);
+        u.pixel_format  = static_cast<std::int32_t>(params.pix_desc.format);
+        u.invert        = params.transform.invert ? 1 : 0;
+        u.opacity       = static_cast<float>(params.transform.is_key ? 1.0 : params.transform.opacity);
+        u.field_mode    = static_cast<std::int32_t>(params.transform.field);
+        u.scaling       = is_scaled ? scaling(params.transform.scaling) : 0;
+        u.sample_scale  = sample_scale(params.pix_desc);
+        u.packed_width  = params.pix_desc.packed_width;
+        std::copy(params.color.begin(), params.color.end(), u.solid_color);
+
+        // Minified sources are sampled from mipmaps, magnified ones through the scaling kernel in the shader.
+        draw.mipmaps = u.scaling != 0 && (scale_x > 1.0 + epsilon || scale_y > 1.0 + epsilon);
 
-        // Setup image-adjustements
-        shader_->set("invert", params.transform.invert);
+        if (params.transform.chroma.enable) {
+            u.chroma                           = params.transform.chroma.ycbcr ? 2 : 1;
+            u.chroma_show_mask                 = params.transform.chroma.show_mask ? 1 : 0;
+            u.chroma_target_hue                = static_cast<float>(params.transform.chroma.target_hue / 360.0);
+            u.chroma_hue_width                 = static_cast<float>(params.transform.chroma.hue_width);
+            u.chroma_min_saturation            = static_cast<float>(params.transform.chroma.min_saturation);
+            u.chroma_min_brightness            = static_cast<float>(params.transform.chroma.min_brightness);
+            u.chroma_softness                  = static_cast<float>(1.0 + params.transform.chroma.softness);
+            u.chroma_spill_suppress            = static_cast<float>(params.transform.chroma.spill_suppress / 360.0);
+            u.chroma_spill_suppress_saturation = static_cast<float>(params.transform.chroma.spill_suppress_saturation);
+            if (params.transform.chroma.ycbcr) {
+                set_ycbcr_key(u, params.transform.chroma);
+            }
+        }
 
         if (params.transform.levels.min_input > epsilon || params.transform.levels.max_input < 1.0 - epsilon ||
             params.transform.levels.min_output > epsilon || params.transform.levels.max_output < 1.0 - epsilon ||
             std::abs(params.transform.levels.gamma - 1.0) > epsilon) {
-            shader_->set("levels", true);
-            shader_->set("min_input", params.transform.levels.min_input);
-            shader_->set("max_input", params.transform.levels.max_input);
-            shader_->set("min_output", params.transform.levels.min_output);
-            shader_->set("max_output", params.transform.levels.max_output);
-            shader_->set("gamma", params.transform.levels.gamma);
-        } else {
-            shader_->set("levels", false);
+            u.levels     = 1;
+            u.min_input  = static_cast<float>(params.transform.levels.min_input);
+            u.max_input  = static_cast<float>(params.transform.levels.max_input);
+            u.min_output = static_cast<float>(params.transform.levels.min_output);
+            u.max_output = static_cast<float>(params.transform.levels.max_output);
+            u.gamma      = static_cast<float>(params.transform.levels.gamma);
         }
 
         if (std::abs(params.transform.brightness - 1.0) > epsilon ||
             std::abs(params.transform.saturation - 1.0) > epsilon ||
             std::abs(params.transform.contrast - 1.0) > epsilon) {
-            shader_->set("csb", true);
+            u.csb = 1;
+            u.brt = static_cast<float>(params.transform.brightness);
+            u.sat = static_cast<float>(params.transform.saturation);
+            u.con = static_cast<float>(params.transform.contrast);
+        }
 
-            shader_->set("brt", params.transform.brightness);
-            shader_->set("sat", params.transform.saturation);
-            shader_->set("con", params.transform.contrast);
-        } else {
-            shader_->set("csb", false);
+        if (use_variants_) {
+            draw.variant = variant_key(u);
+            if (variants_.size() >= max_variants && variants_.find(draw.variant) == variants_.end()) {
+                draw.variant = 0;
+            }
         }
 
         // Setup drawing area
 
-        GL(glViewport(0, 0, params.background->width(), params.background->height()));
-        glDisable(GL_DEPTH_TEST);
-
         auto m_p = params.transform.clip_translation;
         auto m_s = params.transform.clip_scale;
 
-        bool scissor = m_p[0] > std::numeric_limits<double>::epsilon() ||
+        draw.scissor = m_p[0] > std::numeric_limits<double>::epsilon() ||
                        m_p[1] > std::numeric_limits<double>::epsilon() ||
                        m_s[0] < 1.0 - std::numeric_limits<double>::epsilon() ||
                        m_s[1] < 1.0 - std::numeric_limits<double>::epsilon();
 
-        if (scissor) {
+        if (draw.scissor) {
             double w = static_cast<double>(params.background->width());
             double h = static_cast<double>(params.background->height());
 
-            GL(glEnable(GL_SCISSOR_TEST));
-            GL(glScissor(static_cast<int>(m_p[0] * w),
-                         static_cast<int>(m_p[1] * h),
-                         std::max(0, static_cast<int>(m_s[0] * w)),
-                         std::max(0, static_cast<int>(m_s[1] * h))));
+            draw.scissor_rect = {static_cast<int>(m_p[0] * w),
+                                 static_cast<int>(m_p[1] * h),
+                                 std::max(0, static_cast<int>(m_s[0] * w)),
+                                 std::max(0, static_cast<int>(m_s[1] * h))};
         }
 
-        // Set render target
-        params.background->attach();
-
         // Perspective correction
         double diagonal_intersection_x;
         double diagonal_intersection_y;
@@ -362,7 +705,7 @@ struct image_kernel::impl
 
             std::vector<double> q_values = {ulq, urq, lrq, llq};
 
-            corner = 0;
+            int corner = 0;
             for (auto& coord : coords) {
                 coord.texture_q = q_values[corner];
                 coord.texture_x *= q_values[corner];
@@ -373,49 +716,120 @@ struct image_kernel::impl
             }
         }
 
-        // Draw
+        for (auto& coord : coords) {
+            draw.area.left   = std::min(draw.area.left, coord.vertex_x);
+            draw.area.right  = std::max(draw.area.right, coord.vertex_x);
+            draw.area.top    = std::min(draw.area.top, coord.vertex_y);
+            draw.area.bottom = std::max(draw.area.bottom, coord.vertex_y);
+        }
+
         switch (params.geometry.type()) {
-            case core::frame_geometry::geometry_type::quad: {
-                GL(glBindVertexArray(vao_));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+            case core::frame_geometry::geometry_type::quad:
+                draw.vertices = {coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+                break;
+            default:
+                return false;
+        }
 
-                std::vector<core::frame_geometry::coord> coords_triangles{
-                    coords[0], coords[1], coords[2], coords[0], coords[2], coords[3]};
+        draw.params = std::move(params);
 
-                GL(glBufferData(GL_ARRAY_BUFFER,
-                                static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord)) * coords_triangles.size(),
-                                coords_triangles.data(),
-                                GL_STATIC_DRAW));
+        return true;
+    }
+
+    void flush()
+    {
+        if (pending_.empty()) {
+            return;
+        }
 
-                auto stride = static_cast<GLsizei>(sizeof(core::frame_geometry::coord));
+        auto& first = pending_.front().params;
 
-                auto vtx_loc = shader_->get_attrib_location("Position");
-                auto tex_loc = shader_->get_attrib_location("TexCoordIn");
+        // Upload vertices and parameters for the whole batch at once.
 
-                GL(glEnableVertexAttribArray(vtx_loc));
-                GL(glEnableVertexAttribArray(tex_loc));
+        auto block_size = (static_cast<GLsizeiptr>(sizeof(uniform_block)) + ubo_alignment_ - 1) / ubo_alignment_ *
+                          ubo_alignment_;
 
-                GL(glVertexAttribPointer(vtx_loc, 2, GL_DOUBLE, GL_FALSE, stride, nullptr));
-                GL(glVertexAttribPointer(tex_loc, 4, GL_DOUBLE, GL_FALSE, stride, (GLvoid*)(2 * sizeof(GLdouble))));
+        std::vector<core::frame_geometry::coord> vertices;
+        uniform_data_.resize(pending_.size() * block_size);
 
-                GL(glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(coords_triangles.size())));
-                GL(glTextureBarrier());
+        for (std::size_t n = 0; n < pending_.size(); ++n) {
+            vertices.insert(vertices.end(), pending_[n].vertices.begin(), pending_[n].vertices.end());
+            std::memcpy(uniform_data_.data() + n * block_size, &pending_[n].uniforms, sizeof(uniform_block));
+        }
 
-                GL(glDisableVertexAttribArray(vtx_loc));
-                GL(glDisableVertexAttribArray(tex_loc));
+        program(pending_.front()).use();
 
-                GL(glBindVertexArray(0));
-                GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        GL(glBindVertexArray(vao_));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, vbo_));
+        GL(glBufferData(GL_ARRAY_BUFFER,
+                        static_cast<GLsizeiptr>(sizeof(core::frame_geometry::coord) * vertices.size()),
+                        vertices.data(),
+                        GL_STREAM_DRAW));
 
-                break;
+        GL(glBindBuffer(GL_UNIFORM_BUFFER, ubo_));
+        GL(glBufferData(GL_UNIFORM_BUFFER,
+                        static_cast<GLsizeiptr>(uniform_data_.size()),
+                        uniform_data_.data(),
+                        GL_STREAM_DRAW));
+
+        // Set render target
+
+        first.background->bind(static_cast<int>(texture_id::background));
+        first.background->attach();
+
+        GL(glViewport(0, 0, first.background->width(), first.background->height()));
+        glDisable(GL_DEPTH_TEST);
+
+        // Draw
+
+        GLint first_vertex = 0;
+        for (std::size_t n = 0; n < pending_.size(); ++n) {
+            auto& draw = pending_[n];
+
+            for (int i = 0; i < draw.params.textures.size(); ++i) {
+                if (draw.mipmaps) {
+                    draw.params.textures[i]->bind_mipmaps(i);
+                } else {
+                    draw.params.textures[i]->bind(i);
+                }
             }
-            default:
-                break;
+
+            if (draw.params.local_key) {
+                draw.params.local_key->bind(static_cast<int>(texture_id::local_key));
+            }
+
+            if (draw.params.layer_key) {
+                draw.params.layer_key->bind(static_cast<int>(texture_id::layer_key));
+            }
+
+            GL(glBindBufferRange(GL_UNIFORM_BUFFER, 0, ubo_, n * block_size, sizeof(uniform_block)));
+
+            if (draw.scissor) {
+                GL(glEnable(GL_SCISSOR_TEST));
+                GL(glScissor(draw.scissor_rect[0], draw.scissor_rect[1], draw.scissor_rect[2], draw.scissor_rect[3]));
+            } else {
+                GL(glDisable(GL_SCISSOR_TEST));
+            }
+
+            auto count = static_cast<GLsizei>(draw.vertices.size());
+            GL(glDrawArrays(GL_TRIANGLES, first_vertex, count));
+            first_vertex += count;
         }
 
+        GL(glTextureBarrier());
+
+        draw_calls_ += pending_.size();
+        ++batches_;
+
         // Cleanup
+
+        GL(glBindVertexArray(0));
+        GL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        GL(glBindBuffer(GL_UNIFORM_BUFFER, 0));
         GL(glDisable(GL_SCISSOR_TEST));
         GL(glDisable(GL_BLEND));
+
+        pending_.clear();
     }
 };
 
@@ -424,6 +838,9 @@ image_kernel::image_kernel(const spl::shared_ptr<device>& ogl)
 {
 }
 image_kernel::~image_kernel() {}
-void image_kernel::draw(const draw_params& params) { impl_->draw(params); }
+void          image_kernel::draw(const draw_params& params) { impl_->draw(params); }
+void          image_kernel::flush() { impl_->flush(); }
+std::uint64_t image_kernel::draw_calls() const { return impl_->draw_calls_; }
+std::uint64_t image_kernel::batches() const { return impl_->batches_; }
 
 }}} // namespace caspar::accelerator::ogl
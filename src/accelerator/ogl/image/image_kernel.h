@@ -29,6 +29,9 @@
 #include <core/frame/geometry.h>
 #include <core/frame/pixel_format.h>
 
+#include <array>
+#include <cstdint>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 enum class keyer
@@ -49,8 +52,15 @@ struct draw_params final
     std::shared_ptr<class texture>              local_key;
     std::shared_ptr<class texture>              layer_key;
     double                                      aspect_ratio = 1.0;
+    std::array<float, 4>                        color{}; // RGBA of a pixel_format::color draw, which has no textures.
+    // The background holds only the lines of this field of the frame, at half its height.
+    core::field_mode                            target_field = core::field_mode::progressive;
 };
 
+// Whether an item is certainly not drawn, because it is transparent or entirely outside the screen. Its textures
+// need not be uploaded.
+bool is_hidden(const core::image_transform& transform, const core::frame_geometry& geometry);
+
 class image_kernel final
 {
     image_kernel(const image_kernel&);
@@ -60,7 +70,13 @@ class image_kernel final
     explicit image_kernel(const spl::shared_ptr<class device>& ogl);
     ~image_kernel();
 
+    // Draws are queued and issued in batches, flush before reading back or converting a target.
     void draw(const draw_params& params);
+    void flush();
+
+    // Number of draw calls and batches issued so far.
+    std::uint64_t draw_calls() const;
+    std::uint64_t batches() const;
 
   private:
     struct impl;
@@ -20,15 +20,21 @@
  */
 #include "image_mixer.h"
 
+#include "format_converter.h"
 #include "image_kernel.h"
 
 #include "../util/buffer.h"
 #include "../util/device.h"
 #include "../util/texture.h"
+#include "../util/timer_query.h"
 
 #include <common/array.h>
+#include <common/diagnostics/trace.h>
 #include <common/future.h>
+#include <common/scope_exit.h>
 
+#include <core/diagnostics/call_context.h>
+#include <core/diagnostics/layer_resources.h>
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
 #include <core/frame/geometry.h>
@@ -38,20 +44,64 @@
 #include <GL/glew.h>
 
 #include <boost/any.hpp>
+#include <boost/range/algorithm/equal.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 using future_texture = std::shared_future<std::shared_ptr<texture>>;
 
+// Textures of a committed frame, tagged with the device they live on. They are uploaded the first time the frame is
+// drawn, frames that are never drawn or only hidden are never uploaded. The bytes uploaded, and held until the frame
+// is released, account to the layer the frame was created for.
+struct frame_textures
+{
+    const device*                                       owner;
+    std::function<std::vector<future_texture>()>       upload;
+    std::once_flag                                      uploaded;
+    std::vector<future_texture>                         textures;
+    std::shared_ptr<core::diagnostics::layer_resources> resources;
+    std::int64_t                                        bytes = 0;
+
+    ~frame_textures()
+    {
+        if (resources && !textures.empty()) {
+            resources->texture_bytes -= bytes;
+        }
+    }
+
+    const std::vector<future_texture>& get()
+    {
+        std::call_once(uploaded, [this] {
+            textures = upload();
+            upload   = nullptr;
+            if (resources && !textures.empty()) {
+                resources->texture_bytes += bytes;
+                resources->upload_bytes += bytes;
+            }
+        });
+        return textures;
+    }
+};
+
 struct item
 {
-    core::pixel_format_desc     pix_desc = core::pixel_format::invalid;
-    std::vector<future_texture> textures;
-    core::image_transform       transform;
-    core::frame_geometry        geometry = core::frame_geometry::get_default();
+    core::pixel_format_desc                             pix_desc = core::pixel_format::invalid;
+    std::vector<future_texture>                         textures;
+    core::image_transform                               transform;
+    core::frame_geometry                                geometry = core::frame_geometry::get_default();
+    // Uploaded at render time if there are no textures, unless occluded.
+    core::const_frame                                   frame;
+    std::shared_ptr<core::diagnostics::layer_resources> resources;
 };
 
 struct layer
@@ -66,52 +116,415 @@ struct layer
     }
 };
 
+bool has_alpha(core::pixel_format format)
+{
+    switch (format) {
+        case core::pixel_format::gray:
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::luma:
+        case core::pixel_format::bgr:
+        case core::pixel_format::rgb:
+        case core::pixel_format::uyvy:
+        case core::pixel_format::v210:
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010:
+            return false;
+        default:
+            return true;
+    }
+}
+
+texture_precision upload_precision(const core::pixel_format_desc& desc)
+{
+    switch (desc.format) {
+        case core::pixel_format::bc3:
+            return texture_precision::bc3;
+        case core::pixel_format::bc7:
+            return texture_precision::bc7;
+        case core::pixel_format::p010:
+            return texture_precision::unorm16;
+        case core::pixel_format::ycbcr:
+        case core::pixel_format::ycbcra:
+            // Planes of more than 8 bits are uploaded as decoded and scaled to full range by the shader.
+            return desc.bit_depth > 8 ? texture_precision::unorm16 : texture_precision::unorm8;
+        default:
+            return texture_precision::unorm8;
+    }
+}
+
+bool is_key(const layer& layer)
+{
+    return std::any_of(
+        layer.items.begin(), layer.items.end(), [](const item& item) { return item.transform.is_key; });
+}
+
+// Whether the item replaces every pixel of the target, i.e. nothing drawn before it is visible.
+bool is_opaque_fullscreen(const item& item)
+{
+    static const double epsilon = 0.001;
+
+    auto& t = item.transform;
+
+    if (has_alpha(item.pix_desc.format) || t.is_key || t.is_mix || t.invert || t.chroma.enable ||
+        t.opacity < 1.0 - epsilon || std::abs(t.angle) > epsilon) {
+        return false;
+    }
+
+    if (item.geometry.type() != core::frame_geometry::geometry_type::quad ||
+        !boost::equal(item.geometry.data(), core::frame_geometry::get_default().data())) {
+        return false;
+    }
+
+    const core::rectangle default_crop;
+    const core::corners   default_perspective;
+    if (t.crop.ul != default_crop.ul || t.crop.lr != default_crop.lr || t.perspective.ul != default_perspective.ul ||
+        t.perspective.ur != default_perspective.ur || t.perspective.lr != default_perspective.lr ||
+        t.perspective.ll != default_perspective.ll) {
+        return false;
+    }
+
+    for (int n = 0; n < 2; ++n) {
+        if (t.clip_translation[n] > epsilon || t.clip_translation[n] + t.clip_scale[n] < 1.0 - epsilon) {
+            return false;
+        }
+
+        auto first = (0.0 - t.anchor[n]) * t.fill_scale[n] + t.fill_translation[n];
+        auto last  = (1.0 - t.anchor[n]) * t.fill_scale[n] + t.fill_translation[n];
+        if (first > epsilon || last < 1.0 - epsilon) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Removes items hidden under the topmost opaque full screen item, walking the tree in reverse draw order. Key
+// items are kept since later layers may still be keyed by them. Returns the number of removed items.
+int cull_occluded(std::vector<layer>& layers, bool& occluded)
+{
+    int culled = 0;
+
+    for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+        auto& layer    = *it;
+        auto  previous = std::next(it);
+        auto  keyed    = previous != layers.rend() && is_key(*previous);
+
+        for (auto item = layer.items.rbegin(); item != layer.items.rend();) {
+            if (occluded && !item->transform.is_key) {
+                item = decltype(item)(layer.items.erase(std::next(item).base()));
+                ++culled;
+                continue;
+            }
+
+            if (!occluded && !keyed && layer.blend_mode == core::blend_mode::normal && is_opaque_fullscreen(*item) &&
+                std::none_of(std::next(item), layer.items.rend(), [](const struct item& other) {
+                    return other.transform.is_key;
+                })) {
+                occluded = true;
+            }
+            ++item;
+        }
+
+        culled += cull_occluded(layer.sublayers, occluded);
+    }
+
+    return culled;
+}
+
+// Whether two layer trees render to the same image.
+bool is_same(const std::vector<layer>& lhs, const std::vector<layer>& rhs)
+{
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+
+    for (std::size_t n = 0; n < lhs.size(); ++n) {
+        if (lhs[n].blend_mode != rhs[n].blend_mode || lhs[n].items.size() != rhs[n].items.size() ||
+            !is_same(lhs[n].sublayers, rhs[n].sublayers)) {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < lhs[n].items.size(); ++i) {
+            auto& a = lhs[n].items[i];
+            auto& b = rhs[n].items[i];
+            if (a.frame != b.frame || a.transform != b.transform || a.geometry.type() != b.geometry.type() ||
+                !boost::equal(a.geometry.data(), b.geometry.data())) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Keeps the frames of a layer tree, which pins their identity, but releases the textures.
+std::vector<layer> strip_textures(std::vector<layer> layers)
+{
+    for (auto& layer : layers) {
+        layer.sublayers = strip_textures(std::move(layer.sublayers));
+        for (auto& item : layer.items) {
+            item.textures.clear();
+        }
+    }
+    return layers;
+}
+
 class image_renderer
 {
     spl::shared_ptr<device> ogl_;
     image_kernel            kernel_;
+    format_converter        converter_;
+    texture_precision       precision_;
+
+    // GPU time of this channel's passes, published once per frame.
+    std::shared_ptr<timer_query> render_timer_;
+    std::shared_ptr<timer_query> upload_timer_;
+    std::shared_ptr<timer_query> readback_timer_;
+
+    std::atomic<std::uint64_t> frame_draw_calls_{0};
+    std::atomic<std::uint64_t> frame_batches_{0};
+    std::atomic<std::int64_t>  frame_occluded_{0};
+    std::atomic<std::int64_t>  reused_frames_{0};
+    std::atomic<bool>          keep_output_{false};
+
+    // The previous composition and its output, reused while nothing changes.
+    std::vector<layer>                                         last_layers_;
+    core::video_format_desc                                    last_format_desc_;
+    std::vector<std::pair<core::pixel_format, int>>            last_formats_;
+    core::field_mode                                           last_field_ = core::field_mode::progressive;
+    std::shared_future<std::vector<array<const std::uint8_t>>> last_result_;
+
+    // Zeroes handed out for channels with nothing to draw, sized to the largest format seen.
+    std::shared_ptr<void> empty_buffer_;
+    std::size_t           empty_size_ = 0;
 
   public:
-    explicit image_renderer(const spl::shared_ptr<device>& ogl)
+    image_renderer(const spl::shared_ptr<device>& ogl, texture_precision precision)
         : ogl_(ogl)
         , kernel_(ogl_)
+        , converter_(ogl_)
+        , precision_(precision)
+        , render_timer_(std::make_shared<timer_query>(ogl))
+        , upload_timer_(std::make_shared<timer_query>(ogl))
+        , readback_timer_(std::make_shared<timer_query>(ogl))
     {
     }
 
-    std::future<array<const std::uint8_t>> operator()(std::vector<layer>             layers,
-                                                      const core::video_format_desc& format_desc)
+    std::future<std::vector<array<const std::uint8_t>>> operator()(std::vector<layer>                    layers,
+                                                                   const core::video_format_desc&        format_desc,
+                                                                   std::vector<core::pixel_format_desc> descs)
     {
-        if (layers.empty()) { // Bypass GPU with empty frame.
-            static const std::vector<uint8_t> buffer(4096 * 4096 * 4, 0);
-            return make_ready_future(array<const std::uint8_t>(buffer.data(), format_desc.size, true));
+        const auto field = descs.empty() ? core::field_mode::progressive : descs[0].field;
+
+        if (layers.empty() && descs.size() == 1 && descs[0].format == core::pixel_format::bgra) {
+            // Bypass GPU with empty frame. The zeroes are calloc'ed, large ones are mapped lazily and stay off the
+            // resident set until written, which they never are.
+            const auto size = static_cast<std::size_t>(descs[0].planes.at(0).size);
+            if (!empty_buffer_ || empty_size_ < size) {
+                empty_buffer_ = std::shared_ptr<void>(std::calloc(size, 1), std::free);
+                empty_size_   = size;
+            }
+            std::vector<array<const std::uint8_t>> planes;
+            planes.emplace_back(static_cast<const std::uint8_t*>(empty_buffer_.get()), size, empty_buffer_);
+            return make_ready_future(std::move(planes));
         }
 
-        return flatten(ogl_->dispatch_async([=]() mutable -> std::shared_future<array<const std::uint8_t>> {
-            auto target_texture = ogl_->create_texture(format_desc.width, format_desc.height, 4);
+        bool occluded   = false;
+        frame_occluded_ = cull_occluded(layers, occluded);
 
-            draw(target_texture, std::move(layers), format_desc);
+        std::vector<std::pair<core::pixel_format, int>> formats;
+        for (auto& desc : descs) {
+            formats.emplace_back(desc.format, desc.planes.at(0).width);
+        }
 
-            return ogl_->copy_async(target_texture);
-        }));
+        // Frames are immutable, so the same frames with the same transforms give the same image.
+        if (last_result_.valid() && format_desc == last_format_desc_ && formats == last_formats_ &&
+            field == last_field_ && is_same(layers, last_layers_)) {
+            ++reused_frames_;
+            return std::async(std::launch::deferred, [result = last_result_] { return result.get(); });
+        }
+
+        last_layers_      = strip_textures(layers);
+        last_format_desc_ = format_desc;
+        last_formats_     = std::move(formats);
+        last_field_       = field;
+        last_result_      = render(std::move(layers), format_desc, std::move(descs)).share();
+
+        return std::async(std::launch::deferred, [result = last_result_] { return result.get(); });
     }
 
+    core::monitor::state state() const
+    {
+        core::monitor::state state;
+        state["draw-calls"] = static_cast<std::int64_t>(frame_draw_calls_.load());
+        state["batches"]    = static_cast<std::int64_t>(frame_batches_.load());
+        state["occluded"]   = frame_occluded_.load();
+        state["reused"]     = reused_frames_.load();
+
+        state["gpu-render-ms"]   = render_timer_->elapsed_ms();
+        state["gpu-upload-ms"]   = upload_timer_->elapsed_ms();
+        state["gpu-readback-ms"] = readback_timer_->elapsed_ms();
+        return state;
+    }
+
+    const std::shared_ptr<timer_query>& upload_timer() const { return upload_timer_; }
+
+    // Pools the target and the converted planes of a format with buffers for the frames read back in flight.
+    void prepare(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& descs)
+    {
+        const auto field  = descs.empty() ? core::field_mode::progressive : descs[0].field;
+        const auto height = field != core::field_mode::progressive ? format_desc.height / 2 : format_desc.height;
+
+        auto target_readbacks = 0;
+        for (auto& desc : descs) {
+            if (desc.format == core::pixel_format::bgra && desc.planes.at(0).width == format_desc.width) {
+                target_readbacks = 2;
+                continue;
+            }
+            for (auto& plane : desc.planes) {
+                ogl_->reserve(plane.width, plane.height, plane.stride, texture_precision::unorm8, 2);
+            }
+        }
+        ogl_->reserve(format_desc.width, height, 4, precision_, target_readbacks);
+    }
+
+    void keep_output(bool keep) { keep_output_ = keep; }
+
   private:
+    std::future<std::vector<array<const std::uint8_t>>> render(std::vector<layer>                    layers,
+                                                               const core::video_format_desc&        format_desc,
+                                                               std::vector<core::pixel_format_desc> descs)
+    {
+        const auto sequence = caspar::diagnostics::trace::current_frame();
+        const auto channel  = caspar::diagnostics::trace::current_channel();
+
+        {
+            caspar::diagnostics::trace::scope scope("upload");
+
+            upload(layers);
+
+            // Uploads may still be staging on other threads and are only posted to the device once done, so wait for
+            // them here rather than on the device thread.
+            wait(layers);
+        }
+
+        return flatten(ogl_->dispatch_async([=]() mutable {
+            caspar::diagnostics::trace::scoped_frame traced(sequence, channel);
+
+            render_timer_->frame();
+            upload_timer_->frame();
+            readback_timer_->frame();
+
+            std::vector<std::shared_ptr<texture>> outputs;
+            {
+                caspar::diagnostics::trace::scope scope("render");
+
+                render_timer_->begin();
+
+                // A field is drawn at half height, see draw_params::target_field.
+                const auto field = descs.empty() ? core::field_mode::progressive : descs[0].field;
+                const auto height =
+                    field != core::field_mode::progressive ? format_desc.height / 2 : format_desc.height;
+
+                auto target_texture = ogl_->create_texture(format_desc.width, height, 4, precision_);
+
+                auto draw_calls = kernel_.draw_calls();
+                auto batches    = kernel_.batches();
+
+                draw(target_texture, std::move(layers), format_desc, field);
+                kernel_.flush();
+
+                frame_draw_calls_ = kernel_.draw_calls() - draw_calls;
+                frame_batches_    = kernel_.batches() - batches;
+
+                // Only the requested formats are read back, bgra is skipped if no consumer wants it. Smaller bgra
+                // descs are previews, minified from the mipmaps of the target.
+                for (auto& desc : descs) {
+                    if (desc.format == core::pixel_format::bgra && desc.planes.at(0).width == target_texture->width()) {
+                        outputs.push_back(target_texture);
+                        continue;
+                    }
+                    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+                        auto& plane         = desc.planes[n];
+                        auto  plane_texture = ogl_->create_texture(plane.width, plane.height, plane.stride);
+                        converter_.convert(target_texture, plane_texture, desc.format, n, format_desc.height > 700);
+                        outputs.push_back(plane_texture);
+                    }
+                }
+
+                // Readbacks run inline on the device thread and are timed separately.
+                render_timer_->end();
+            }
+
+            caspar::diagnostics::trace::scope scope("readback");
+
+            std::vector<std::future<array<const std::uint8_t>>> planes;
+            for (auto& output : outputs) {
+                planes.push_back(ogl_->copy_async(output, readback_timer_, keep_output_));
+            }
+
+            return std::async(std::launch::deferred, [planes = std::move(planes), sequence]() mutable {
+                caspar::diagnostics::trace::scope scope("readback-wait", sequence);
+
+                std::vector<array<const std::uint8_t>> result;
+                for (auto& plane : planes) {
+                    result.push_back(plane.get());
+                }
+                return result;
+            });
+        }));
+    }
+
+    void upload(std::vector<layer>& layers)
+    {
+        for (auto& layer : layers) {
+            upload(layer.sublayers);
+            for (auto& item : layer.items) {
+                if (!item.textures.empty() || !item.frame || item.pix_desc.format == core::pixel_format::color) {
+                    continue;
+                }
+                for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
+                    item.textures.emplace_back(ogl_->copy_async(item.frame.image_data(n),
+                                                                item.pix_desc.planes[n].width,
+                                                                item.pix_desc.planes[n].height,
+                                                                item.pix_desc.planes[n].stride,
+                                                                upload_timer_,
+                                                                upload_precision(item.pix_desc)));
+                }
+            }
+        }
+    }
+
+    static void wait(const std::vector<layer>& layers)
+    {
+        for (auto& layer : layers) {
+            wait(layer.sublayers);
+            for (auto& item : layer.items) {
+                for (auto& texture : item.textures) {
+                    texture.wait();
+                }
+            }
+        }
+    }
+
     void draw(std::shared_ptr<texture>&      target_texture,
               std::vector<layer>             layers,
-              const core::video_format_desc& format_desc)
+              const core::video_format_desc& format_desc,
+              core::field_mode               field)
     {
         std::shared_ptr<texture> layer_key_texture;
 
         for (auto& layer : layers) {
-            draw(target_texture, layer.sublayers, format_desc);
-            draw(target_texture, std::move(layer), layer_key_texture, format_desc);
+            draw(target_texture, layer.sublayers, format_desc, field);
+            draw(target_texture, std::move(layer), layer_key_texture, format_desc, field);
         }
     }
 
     void draw(std::shared_ptr<texture>&      target_texture,
               layer                          layer,
               std::shared_ptr<texture>&      layer_key_texture,
-              const core::video_format_desc& format_desc)
+              const core::video_format_desc& format_desc,
+              core::field_mode               field)
     {
         if (layer.items.empty())
             return;
@@ -119,8 +532,17 @@ class image_renderer
         std::shared_ptr<texture> local_key_texture;
         std::shared_ptr<texture> local_mix_texture;
 
-        if (layer.blend_mode != core::blend_mode::normal) {
-            auto layer_texture = ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+        // A layer texture is only needed to composite several items, or mixes, before blending them together. A single
+        // item (plus keys, which only go into the key texture) is blended straight onto the target.
+        auto color_items = std::count_if(layer.items.begin(), layer.items.end(), [](const item& item) {
+            return !item.transform.is_key;
+        });
+        auto has_mix     = std::any_of(
+            layer.items.begin(), layer.items.end(), [](const item& item) { return item.transform.is_mix; });
+
+        if (layer.blend_mode != core::blend_mode::normal && (color_items > 1 || has_mix)) {
+            auto layer_texture =
+                ogl_->create_texture(target_texture->width(), target_texture->height(), 4, precision_);
 
             for (auto& item : layer.items)
                 draw(layer_texture,
@@ -128,7 +550,8 @@ class image_renderer
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
-                     format_desc);
+                     format_desc,
+                     field);
 
             draw(layer_texture, std::move(local_mix_texture), core::blend_mode::normal);
             draw(target_texture, std::move(layer_texture), layer.blend_mode);
@@ -140,7 +563,9 @@ class image_renderer
                      layer_key_texture,
                      local_key_texture,
                      local_mix_texture,
-                     format_desc);
+                     format_desc,
+                     field,
+                     layer.blend_mode);
 
             draw(target_texture, std::move(local_mix_texture), core::blend_mode::normal);
         }
@@ -153,23 +578,43 @@ class image_renderer
               std::shared_ptr<texture>&      layer_key_texture,
               std::shared_ptr<texture>&      local_key_texture,
               std::shared_ptr<texture>&      local_mix_texture,
-              const core::video_format_desc& format_desc)
+              const core::video_format_desc& format_desc,
+              core::field_mode               field,
+              core::blend_mode               blend_mode = core::blend_mode::normal)
     {
+        const auto begin     = std::chrono::steady_clock::now();
+        const auto resources = std::move(item.resources);
+        CASPAR_SCOPE_EXIT
+        {
+            if (resources) {
+                resources->draw_us += std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::steady_clock::now() - begin)
+                                          .count();
+            }
+        };
+
         draw_params draw_params;
         draw_params.pix_desc  = std::move(item.pix_desc);
         draw_params.transform = std::move(item.transform);
         draw_params.geometry  = item.geometry;
         draw_params.aspect_ratio =
             static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+        draw_params.target_field = field;
 
         for (auto& future_texture : item.textures) {
             draw_params.textures.push_back(spl::make_shared_ptr(future_texture.get()));
         }
 
+        if (draw_params.pix_desc.format == core::pixel_format::color) {
+            auto bgra         = item.frame.image_data(0).data();
+            draw_params.color = {bgra[2] / 255.0f, bgra[1] / 255.0f, bgra[0] / 255.0f, bgra[3] / 255.0f};
+        }
+
         if (item.transform.is_key) {
             local_key_texture = local_key_texture
                                     ? local_key_texture
-                                    : ogl_->create_texture(target_texture->width(), target_texture->height(), 1);
+                                    : ogl_->create_texture(
+                                          target_texture->width(), target_texture->height(), 1, precision_);
 
             draw_params.background = local_key_texture;
             draw_params.local_key  = nullptr;
@@ -179,7 +624,8 @@ class image_renderer
         } else if (item.transform.is_mix) {
             local_mix_texture = local_mix_texture
                                     ? local_mix_texture
-                                    : ogl_->create_texture(target_texture->width(), target_texture->height(), 4);
+                                    : ogl_->create_texture(
+                                          target_texture->width(), target_texture->height(), 4, precision_);
 
             draw_params.background = local_mix_texture;
             draw_params.local_key  = std::move(local_key_texture);
@@ -194,6 +640,7 @@ class image_renderer
             draw_params.background = target_texture;
             draw_params.local_key  = std::move(local_key_texture);
             draw_params.layer_key  = layer_key_texture;
+            draw_params.blend_mode = blend_mode;
 
             kernel_.draw(std::move(draw_params));
         }
@@ -231,9 +678,9 @@ struct image_mixer::impl
     std::vector<layer*>                layer_stack_;
 
   public:
-    impl(const spl::shared_ptr<device>& ogl, int channel_id)
+    impl(const spl::shared_ptr<device>& ogl, int channel_id, texture_precision precision)
         : ogl_(ogl)
-        , renderer_(ogl)
+        , renderer_(ogl, precision)
         , transform_stack_(1)
     {
         CASPAR_LOG(info) << L"Initialized OpenGL Accelerated GPU Image Mixer for channel " << channel_id;
@@ -271,17 +718,21 @@ struct image_mixer::impl
         item.transform = transform_stack_.back();
         item.geometry  = frame.geometry();
 
-        auto textures_ptr = boost::any_cast<std::shared_ptr<std::vector<future_texture>>>(frame.opaque());
+        // Frames that were never committed, such as mixed or imported ones, carry no textures and are looked up in the
+        // upload cache or uploaded.
+        auto textures_ptr = boost::any_cast<std::shared_ptr<frame_textures>>(&frame.opaque());
 
-        if (textures_ptr) {
-            item.textures = *textures_ptr;
-        } else {
-            for (int n = 0; n < static_cast<int>(item.pix_desc.planes.size()); ++n) {
-                item.textures.emplace_back(ogl_->copy_async(frame.image_data(n),
-                                                            item.pix_desc.planes[n].width,
-                                                            item.pix_desc.planes[n].height,
-                                                            item.pix_desc.planes[n].stride));
-            }
+        // Hidden items are dropped before anything is uploaded for them. Keys and mixes are kept, as they affect the
+        // items after them even when not drawn.
+        if (!item.transform.is_key && !item.transform.is_mix && is_hidden(item.transform, item.geometry)) {
+            return;
+        }
+
+        // Frames from another device (e.g. routed from a channel on another GPU) are uploaded again from host memory.
+        item.frame = frame;
+        if (textures_ptr && *textures_ptr && (*textures_ptr)->owner == ogl_.get()) {
+            item.textures  = (*textures_ptr)->get();
+            item.resources = (*textures_ptr)->resources;
         }
 
         layer_stack_.back()->items.push_back(item);
@@ -293,9 +744,10 @@ struct image_mixer::impl
         layer_stack_.resize(transform_stack_.back().layer_depth);
     }
 
-    std::future<array<const std::uint8_t>> render(const core::video_format_desc& format_desc)
+    std::future<std::vector<array<const std::uint8_t>>>
+    render(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& descs)
     {
-        return renderer_(std::move(layers_), format_desc);
+        return renderer_(std::move(layers_), format_desc, descs);
     }
 
     core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
@@ -305,42 +757,111 @@ struct image_mixer::impl
             image_data.push_back(ogl_->create_array(plane.size));
         }
 
+        // Producers create frames on threads working for their layer, see core::diagnostics::layer_resources.
+        auto resources = core::diagnostics::layer_resources::find(core::diagnostics::call_context::for_thread());
+
         std::weak_ptr<image_mixer::impl> weak_self = shared_from_this();
         return core::mutable_frame(
             tag,
             std::move(image_data),
             array<int32_t>{},
             desc,
-            [weak_self, desc](std::vector<array<const std::uint8_t>> image_data) -> boost::any {
+            [weak_self, desc, resources](std::vector<array<const std::uint8_t>> image_data) -> boost::any {
                 auto self = weak_self.lock();
                 if (!self) {
                     return boost::any{};
                 }
-                std::vector<future_texture> textures;
-                for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
-                    textures.emplace_back(self->ogl_->copy_async(
-                        image_data[n], desc.planes[n].width, desc.planes[n].height, desc.planes[n].stride));
+                auto textures       = std::make_shared<frame_textures>();
+                textures->owner     = self->ogl_.get();
+                textures->resources = resources;
+                for (auto& plane : desc.planes) {
+                    textures->bytes += plane.size;
                 }
-                return std::make_shared<decltype(textures)>(std::move(textures));
+                textures->upload = [weak_self, desc, image_data = std::move(image_data)] {
+                    std::vector<future_texture> result;
+                    auto                        self = weak_self.lock();
+                    if (!self) {
+                        return result;
+                    }
+                    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+                        result.emplace_back(self->ogl_->copy_async(image_data[n],
+                                                                   desc.planes[n].width,
+                                                                   desc.planes[n].height,
+                                                                   desc.planes[n].stride,
+                                                                   self->renderer_.upload_timer(),
+                                                                   upload_precision(desc)));
+                    }
+                    return result;
+                };
+                return textures;
             });
     }
 };
 
-image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, int channel_id)
-    : impl_(std::make_unique<impl>(ogl, channel_id))
+image_mixer::image_mixer(const spl::shared_ptr<device>& ogl, int channel_id, texture_precision precision)
+    : impl_(std::make_unique<impl>(ogl, channel_id, precision))
 {
 }
 image_mixer::~image_mixer() {}
 void image_mixer::push(const core::frame_transform& transform) { impl_->push(transform); }
 void image_mixer::visit(const core::const_frame& frame) { impl_->visit(frame); }
 void image_mixer::pop() { impl_->pop(); }
-std::future<array<const std::uint8_t>> image_mixer::operator()(const core::video_format_desc& format_desc)
+void image_mixer::prepare(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& descs)
+{
+    impl_->renderer_.prepare(format_desc, descs);
+}
+void                 image_mixer::keep_output(bool keep) { impl_->renderer_.keep_output(keep); }
+core::monitor::state image_mixer::state() const
+{
+    core::monitor::state state;
+    state           = impl_->renderer_.state();
+    state["device"] = impl_->ogl_->state();
+    return state;
+}
+std::future<std::vector<array<const std::uint8_t>>>
+image_mixer::operator()(const core::video_format_desc& format_desc, const std::vector<core::pixel_format_desc>& descs)
 {
-    return impl_->render(format_desc);
+    return impl_->render(format_desc, descs);
 }
 core::mutable_frame image_mixer::create_frame(const void* tag, const core::pixel_format_desc& desc)
 {
     return impl_->create_frame(tag, desc);
 }
+core::const_frame image_mixer::import_shared_texture(const void* tag, void* handle, int width, int height)
+{
+    auto image = impl_->ogl_->import_shared_texture(handle, width, height);
+    if (image.size() == 0) {
+        return core::const_frame{};
+    }
+
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+
+    std::vector<array<const std::uint8_t>> image_data;
+    image_data.push_back(std::move(image));
+    return core::const_frame(std::move(image_data), array<const std::int32_t>{}, desc);
+}
+
+core::const_frame image_mixer::update_frame(const void*                          tag,
+                                            const core::const_frame&             previous,
+                                            const void*                          image,
+                                            const std::vector<core::frame_rect>& regions)
+{
+    if (!previous || previous.pixel_format_desc().format != core::pixel_format::bgra) {
+        return core::const_frame{};
+    }
+
+    const auto width  = static_cast<int>(previous.width());
+    const auto height = static_cast<int>(previous.height());
+
+    auto image_data = impl_->ogl_->update_texture(previous.image_data(0), image, width, height, 4, regions);
+    if (image_data.size() == 0) {
+        return core::const_frame{};
+    }
+
+    std::vector<array<const std::uint8_t>> planes;
+    planes.push_back(std::move(image_data));
+    return core::const_frame(std::move(planes), array<const std::int32_t>{}, previous.pixel_format_desc());
+}
 
 }}} // namespace caspar::accelerator::ogl
@@ -28,22 +28,40 @@
 #include <core/mixer/image/image_mixer.h>
 #include <core/video_format.h>
 
+#include "../util/texture.h"
+
 #include <future>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 class image_mixer final : public core::image_mixer
 {
   public:
-    image_mixer(const spl::shared_ptr<class device>& ogl, int channel_id);
+    image_mixer(const spl::shared_ptr<class device>& ogl,
+                int                                   channel_id,
+                texture_precision                     precision = texture_precision::unorm8);
     image_mixer(const image_mixer&) = delete;
 
     ~image_mixer();
 
     image_mixer& operator=(const image_mixer&) = delete;
 
-    std::future<array<const std::uint8_t>> operator()(const core::video_format_desc& format_desc) override;
-    core::mutable_frame                    create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    std::future<std::vector<array<const std::uint8_t>>>
+                        operator()(const core::video_format_desc&              format_desc,
+                                   const std::vector<core::pixel_format_desc>& descs) override;
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override;
+    core::const_frame   import_shared_texture(const void* tag, void* handle, int width, int height) override;
+    core::const_frame   update_frame(const void*                          tag,
+                                     const core::const_frame&             previous,
+                                     const void*                          image,
+                                     const std::vector<core::frame_rect>& regions) override;
+
+    void prepare(const core::video_format_desc&              format_desc,
+                 const std::vector<core::pixel_format_desc>& descs) override;
+    void keep_output(bool keep) override;
+
+    core::monitor::state state() const override;
 
     // core::image_mixer
 
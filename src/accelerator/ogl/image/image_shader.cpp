@@ -26,15 +26,20 @@
 #include "ogl_image_fragment.h"
 #include "ogl_image_vertex.h"
 
+#include <map>
+#include <mutex>
+#include <utility>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
-std::weak_ptr<shader> g_shader;
-std::mutex            g_shader_mutex;
+std::map<std::pair<const device*, std::string>, std::weak_ptr<shader>> g_shaders;
+std::mutex                                                             g_shader_mutex;
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
+std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl, const std::string& defines)
 {
     std::lock_guard<std::mutex> lock(g_shader_mutex);
-    auto                        existing_shader = g_shader.lock();
+    auto&                       cached          = g_shaders[std::make_pair(ogl.get(), defines)];
+    auto                        existing_shader = cached.lock();
 
     if (existing_shader) {
         return existing_shader;
@@ -52,9 +57,12 @@ std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl)
         }
     };
 
-    existing_shader.reset(new shader(std::string(vertex_shader), std::string(fragment_shader)), deleter);
+    std::string fragment_source(fragment_shader);
+    fragment_source.insert(fragment_source.find('\n') + 1, defines);
+
+    existing_shader.reset(new shader(std::string(vertex_shader), fragment_source), deleter);
 
-    g_shader = existing_shader;
+    cached = existing_shader;
 
     return existing_shader;
 }
@@ -23,6 +23,8 @@
 
 #include <common/memory.h>
 
+#include <string>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 class shader;
@@ -39,6 +41,7 @@ enum class texture_id
     background
 };
 
-std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl);
+// Shaders are shared per device and set of defines, which are inserted after the #version line of shader.frag.
+std::shared_ptr<shader> get_image_shader(const spl::shared_ptr<device>& ogl, const std::string& defines = "");
 
 }}} // namespace caspar::accelerator::ogl
@@ -8,36 +8,96 @@ uniform sampler2D	plane[4];
 uniform sampler2D	local_key;
 uniform sampler2D	layer_key;
 
-uniform bool		is_hd;
-uniform bool		has_local_key;
-uniform bool		has_layer_key;
-uniform int			blend_mode;
-uniform int			keyer;
-uniform int			pixel_format;
-
-uniform bool        invert;
-uniform float		opacity;
-uniform bool		levels;
-uniform float		min_input;
-uniform float		max_input;
-uniform float		gamma;
-uniform float		min_output;
-uniform float		max_output;
-
-uniform bool		csb;
-uniform float		brt;
-uniform float		sat;
-uniform float		con;
-
-uniform bool		chroma;
-uniform bool		chroma_show_mask;
-uniform float		chroma_target_hue;
-uniform float		chroma_hue_width;
-uniform float		chroma_min_saturation;
-uniform float		chroma_min_brightness;
-uniform float		chroma_softness;
-uniform float		chroma_spill_suppress;
-uniform float		chroma_spill_suppress_saturation;
+// Per draw parameters, see image_kernel.cpp for the matching host layout.
+layout(std140, binding = 0) uniform draw_block
+{
+    bool        is_hd;
+    bool        has_local_key;
+    bool        has_layer_key;
+    int         blend_mode;
+    int         keyer;
+    int         pixel_format;
+
+    bool        invert;
+    bool        levels;
+    bool        csb;
+    int         chroma;
+    bool        chroma_show_mask;
+
+    float       opacity;
+    float       min_input;
+    float       max_input;
+    float       gamma;
+    float       min_output;
+    float       max_output;
+
+    float       brt;
+    float       sat;
+    float       con;
+
+    float       chroma_target_hue;
+    float       chroma_hue_width;
+    float       chroma_min_saturation;
+    float       chroma_min_brightness;
+    float       chroma_softness;
+    float       chroma_spill_suppress;
+    float       chroma_spill_suppress_saturation;
+
+    float       chroma_axis_cb;
+    float       chroma_axis_cr;
+    float       chroma_target_magnitude;
+    float       chroma_target_luma;
+    float       chroma_spill_cos;
+    float       chroma_spill_sin;
+    float       chroma_kr;
+    float       chroma_kb;
+
+    int         field_mode;
+    int         color_space;
+    int         scaling;
+    float       sample_scale;
+    int         packed_width;
+
+    vec4        solid_color;
+};
+
+// Specialised variants define these as constants so that unused paths are compiled out, see image_shader.cpp.
+#ifndef PIXEL_FORMAT
+#define PIXEL_FORMAT    pixel_format
+#endif
+#ifndef BLEND_MODE
+#define BLEND_MODE      blend_mode
+#endif
+#ifndef KEYER
+#define KEYER           keyer
+#endif
+#ifndef HAS_LOCAL_KEY
+#define HAS_LOCAL_KEY   has_local_key
+#endif
+#ifndef HAS_LAYER_KEY
+#define HAS_LAYER_KEY   has_layer_key
+#endif
+#ifndef INVERT
+#define INVERT          invert
+#endif
+#ifndef LEVELS
+#define LEVELS          levels
+#endif
+#ifndef CSB
+#define CSB             csb
+#endif
+#ifndef CHROMA
+#define CHROMA          chroma
+#endif
+#ifndef FIELD_MODE
+#define FIELD_MODE      field_mode
+#endif
+#ifndef COLOR_SPACE
+#define COLOR_SPACE     color_space
+#endif
+#ifndef SCALING
+#define SCALING         scaling
+#endif
 
 /*
 ** Contrast, saturation, brightness
@@ -386,7 +446,7 @@ vec4 ChromaOnCustomColor(vec4 c)
 
 vec3 get_blend_color(vec3 back, vec3 fore)
 {
-    switch(blend_mode)
+    switch(BLEND_MODE)
     {
     case  0: return BlendNormal(back, fore);
     case  1: return BlendLighten(back, fore);
@@ -424,9 +484,9 @@ vec3 get_blend_color(vec3 back, vec3 fore)
 vec4 blend(vec4 fore)
 {
     vec4 back = texture(background, TexCoord2.st).bgra;
-    if(blend_mode != 0)
+    if(BLEND_MODE != 0)
         fore.rgb = get_blend_color(back.rgb/(back.a+0.0000001), fore.rgb/(fore.a+0.0000001))*fore.a;
-    switch(keyer)
+    switch(KEYER)
     {
         case 1:  return fore + back; // additive
         default: return fore + (1.0-fore.a)*back; // linear
@@ -438,6 +498,45 @@ vec4 chroma_key(vec4 c)
     return ChromaOnCustomColor(c.bgra).bgra;
 }
 
+/*
+** The same key evaluated on full range YCbCr, chroma centered on zero, without going through HSV. The unit chroma
+** axis of the target hue, its magnitude and luma at full saturation, the spill rotation and the luma coefficients
+** are computed on the host, see image_kernel.cpp. Brightness and saturation derived from luma and chroma magnitude
+** match those of HSV for colors of the target hue. Spill is rotated out of the chroma with luma kept as is.
+*/
+vec4 chroma_key_ycbcr(vec4 c)
+{
+    const float PI = 3.14159265;
+
+    vec2  axis    = vec2(chroma_axis_cb, chroma_axis_cr);
+    vec2  normal  = vec2(-axis.y, axis.x);
+    vec2  rotated = vec2(dot(c.yz, axis), dot(c.yz, normal));
+    float angle   = length(rotated) > 1.0e-6 ? atan(rotated.y, rotated.x) : PI;
+
+    float amount     = length(rotated) / chroma_target_magnitude;
+    float brightness = c.x + amount * (1.0 - chroma_target_luma);
+    float saturation = amount / (brightness + 1.0e-10);
+
+    float hueScore = abs(angle) / PI - chroma_hue_width;
+    float sbScore  = max(Distance(brightness, chroma_min_brightness), Distance(saturation, chroma_min_saturation));
+    float alpha    = alpha_map(hueScore * sbScore * 2.0 + 1.0);
+
+    float distance = abs(angle) / (2.0 * PI * chroma_spill_suppress);
+    if (distance < 1.0)
+    {
+        float r = length(rotated) * min(1.0, distance + chroma_spill_suppress_saturation);
+        rotated = r * vec2(chroma_spill_cos, angle < 0.0 ? -chroma_spill_sin : chroma_spill_sin);
+    }
+    vec2 cbcr = axis * rotated.x + normal * rotated.y;
+
+    float r = c.x + 2.0 * (1.0 - chroma_kr) * cbcr.y;
+    float b = c.x + 2.0 * (1.0 - chroma_kb) * cbcr.x;
+    float g = (c.x - chroma_kr * r - chroma_kb * b) / (1.0 - chroma_kr - chroma_kb);
+    vec4 keyed = vec4(clamp(vec3(b, g, r), 0.0, 1.0), 1.0) * alpha;
+
+    return chroma_show_mask ? vec4(alpha, alpha, alpha, 1) : keyed;
+}
+
 vec4 ycbcra_to_rgba_sd(float Y, float Cb, float Cr, float A)
 {
     vec4 rgba;
@@ -458,22 +557,207 @@ vec4 ycbcra_to_rgba_hd(float Y, float Cb, float Cr, float A)
     return rgba;
 }
 
+vec4 ycbcra_to_rgba_uhd(float Y, float Cb, float Cr, float A)
+{
+    vec4 rgba;
+    rgba.b = (1.164*(Y*255 - 16) + 1.679*(Cr*255 - 128))/255;
+    rgba.g = (1.164*(Y*255 - 16) - 0.650*(Cr*255 - 128) - 0.187*(Cb*255 - 128))/255;
+    rgba.r = (1.164*(Y*255 - 16) + 2.142*(Cb*255 - 128))/255;
+    rgba.a = A;
+    return rgba;
+}
+
 vec4 ycbcra_to_rgba(float y, float cb, float cr, float a)
 {
-    if(is_hd)
-        return ycbcra_to_rgba_hd(y, cb, cr, a);
-    else
-        return ycbcra_to_rgba_sd(y, cb, cr, a);
+    switch(COLOR_SPACE)
+    {
+    case 1:  return ycbcra_to_rgba_hd(y, cb, cr, a);
+    case 2:  return ycbcra_to_rgba_uhd(y, cb, cr, a);
+    default: return ycbcra_to_rgba_sd(y, cb, cr, a);
+    }
+}
+
+/*
+** Deinterlacing of the frames the ffmpeg producer sends with auto-deinterlace=gpu. Lines of the shown field are
+** sampled as is. A missing line is the median of the other field's line and the shown field's lines above and below
+** it, taken along the edge direction with the least difference. Static areas keep the full resolution of both fields
+** while moving ones are interpolated, like the spatial check of yadif and bwdif.
+*/
+vec4 get_field_sample(sampler2D sampler, vec2 coords)
+{
+    vec2  size = vec2(textureSize(sampler, 0));
+    float row  = floor(coords.y * size.y);
+    float y    = (row + 0.5) / size.y;
+
+    if (mod(row, 2.0) == float(FIELD_MODE - 1))
+        return texture(sampler, vec2(coords.x, y));
+
+    float dx = 1.0 / size.x;
+    float dy = 1.0 / size.y;
+
+    vec4  above = texture(sampler, vec2(coords.x, y - dy));
+    vec4  below = texture(sampler, vec2(coords.x, y + dy));
+    float diff  = dot(abs(above - below), vec4(1.0));
+
+    for (int i = -1; i <= 1; i += 2)
+    {
+        vec4  a = texture(sampler, vec2(coords.x + float(i) * dx, y - dy));
+        vec4  b = texture(sampler, vec2(coords.x - float(i) * dx, y + dy));
+        float d = dot(abs(a - b), vec4(1.0));
+        if (d < diff)
+        {
+            diff  = d;
+            above = a;
+            below = b;
+        }
+    }
+
+    vec4 other = texture(sampler, vec2(coords.x, y));
+    return clamp(other, min(above, below), max(above, below));
+}
+
+/*
+** Resampling of scaled draws, see image_kernel.cpp. Magnified planes are filtered with a Catmull-Rom bicubic or a
+** three lobe Lanczos kernel. Minified ones are bound with mipmaps and use trilinear filtering, which keeps the taps
+** constant whatever the ratio.
+*/
+float bicubic_weight(float x)
+{
+    x = abs(x);
+    if (x < 1.0)
+        return (1.5 * x - 2.5) * x * x + 1.0;
+    if (x < 2.0)
+        return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+    return 0.0;
+}
+
+float lanczos_weight(float x)
+{
+    const float PI = 3.14159265;
+    x = abs(x);
+    if (x < 0.0001)
+        return 1.0;
+    if (x >= 3.0)
+        return 0.0;
+    float px = PI * x;
+    return 3.0 * sin(px) * sin(px / 3.0) / (px * px);
+}
+
+float scaling_weight(float x)
+{
+    return SCALING == 2 ? lanczos_weight(x) : bicubic_weight(x);
+}
+
+vec4 get_scaled_sample(sampler2D sampler, vec2 coords)
+{
+    vec2 size  = vec2(textureSize(sampler, 0));
+    vec2 texel = coords * size;
+
+    if (max(length(dFdx(texel)), length(dFdy(texel))) > 1.0)
+        return texture(sampler, coords);
+
+    int  radius = SCALING == 2 ? 3 : 2;
+    vec2 pos    = texel - 0.5;
+    vec2 base   = floor(pos);
+    vec2 f      = pos - base;
+
+    vec4  sum   = vec4(0.0);
+    float total = 0.0;
+    for (int j = 1 - radius; j <= radius; ++j)
+    {
+        float wy = scaling_weight(float(j) - f.y);
+        for (int i = 1 - radius; i <= radius; ++i)
+        {
+            float w = scaling_weight(float(i) - f.x) * wy;
+            sum   += w * textureLod(sampler, (base + vec2(i, j) + 0.5) / size, 0.0);
+            total += w;
+        }
+    }
+    return clamp(sum / total, 0.0, 1.0);
 }
 
 vec4 get_sample(sampler2D sampler, vec2 coords)
 {
+    if (FIELD_MODE != 0)
+        return get_field_sample(sampler, coords);
+    if (SCALING != 0)
+        return get_scaled_sample(sampler, coords);
     return texture2D(sampler, coords);
 }
 
+/*
+** UYVY is uploaded as one BGRA texel per two pixels, b = Cb, g = Y0, r = Cr and a = Y1. Chroma is filtered at its
+** own resolution, luma is interpolated between the pixels it belongs to.
+*/
+float get_uyvy_luma(ivec2 pos)
+{
+    ivec2 size = textureSize(plane[0], 0);
+    pos = clamp(pos, ivec2(0), ivec2(size.x * 2 - 1, size.y - 1));
+    vec4 texel = texelFetch(plane[0], ivec2(pos.x / 2, pos.y), 0);
+    return (pos.x & 1) == 0 ? texel.g : texel.a;
+}
+
+vec3 get_uyvy_ycbcr(vec2 coords)
+{
+    ivec2 size = textureSize(plane[0], 0);
+    vec2  pos  = coords * vec2(size.x * 2, size.y) - 0.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2  f    = pos - vec2(base);
+
+    float y = mix(mix(get_uyvy_luma(base), get_uyvy_luma(base + ivec2(1, 0)), f.x),
+                  mix(get_uyvy_luma(base + ivec2(0, 1)), get_uyvy_luma(base + ivec2(1, 1)), f.x),
+                  f.y);
+    vec4 chroma = texture(plane[0], coords);
+    return vec3(y, chroma.b, chroma.r);
+}
+
+vec4 get_uyvy_color(vec2 coords)
+{
+    vec3 c = get_uyvy_ycbcr(coords);
+    return ycbcra_to_rgba(c.x, c.y, c.z, 1.0);
+}
+
+/*
+** v210 is uploaded as one BGRA texel per 32 bit word, each holding three 10 bit components. A line is the sequence
+** Cb0 Y0 Cr0 Y1 Cb2 Y2 ... of UYVY packed 12 components to 4 words, so a texel has to be taken apart as an integer
+** before the pixels around coords are interpolated.
+*/
+float get_v210_component(int n, int line)
+{
+    uvec4 bytes = uvec4(round(texelFetch(plane[0], ivec2(n / 12 * 4 + n % 12 / 3, line), 0) * 255.0));
+    uint  word  = bytes.b | bytes.g << 8 | bytes.r << 16 | bytes.a << 24;
+    return float((word >> (n % 3 * 10)) & 0x3FFu) / 1023.0;
+}
+
+vec3 get_v210_pixel(ivec2 pos)
+{
+    pos = clamp(pos, ivec2(0), ivec2(packed_width - 1, textureSize(plane[0], 0).y - 1));
+    int chroma = pos.x / 2 * 4;
+    return vec3(get_v210_component(pos.x * 2 + 1, pos.y),
+                get_v210_component(chroma, pos.y),
+                get_v210_component(chroma + 2, pos.y));
+}
+
+vec3 get_v210_ycbcr(vec2 coords)
+{
+    vec2  pos  = coords * vec2(packed_width, textureSize(plane[0], 0).y) - 0.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2  f    = pos - vec2(base);
+
+    return mix(mix(get_v210_pixel(base), get_v210_pixel(base + ivec2(1, 0)), f.x),
+               mix(get_v210_pixel(base + ivec2(0, 1)), get_v210_pixel(base + ivec2(1, 1)), f.x),
+               f.y);
+}
+
+vec4 get_v210_color(vec2 coords)
+{
+    vec3 c = get_v210_ycbcr(coords);
+    return ycbcra_to_rgba(c.x, c.y, c.z, 1.0);
+}
+
 vec4 get_rgba_color()
 {
-    switch(pixel_format)
+    switch(PIXEL_FORMAT)
     {
     case 0:		//gray
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rrr, 1.0);
@@ -487,17 +771,17 @@ vec4 get_rgba_color()
         return get_sample(plane[0], TexCoord.st / TexCoord.q).gbar;
     case 5:		//ycbcr,
         {
-            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
-            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
-            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r;
+            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r * sample_scale;
             return ycbcra_to_rgba(y, cb, cr, 1.0);
         }
     case 6:		//ycbcra
         {
-            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r;
-            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r;
-            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r;
-            float a  = get_sample(plane[3], TexCoord.st / TexCoord.q).r;
+            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cb = get_sample(plane[1], TexCoord.st / TexCoord.q).r * sample_scale;
+            float cr = get_sample(plane[2], TexCoord.st / TexCoord.q).r * sample_scale;
+            float a  = get_sample(plane[3], TexCoord.st / TexCoord.q).r * sample_scale;
             return ycbcra_to_rgba(y, cb, cr, a);
         }
     case 7:		//luma
@@ -509,27 +793,89 @@ vec4 get_rgba_color()
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).bgr, 1.0);
     case 9:		//rgb,
         return vec4(get_sample(plane[0], TexCoord.st / TexCoord.q).rgb, 1.0);
+    case 10:	//uyvy,
+        return get_uyvy_color(TexCoord.st / TexCoord.q);
+    case 11:	//v210,
+        return get_v210_color(TexCoord.st / TexCoord.q);
+    case 12:	//nv12,
+    case 17:	//p010, chroma interleaved in the second plane
+        {
+            float y  = get_sample(plane[0], TexCoord.st / TexCoord.q).r * sample_scale;
+            vec2  c  = get_sample(plane[1], TexCoord.st / TexCoord.q).rg * sample_scale;
+            return ycbcra_to_rgba(y, c.x, c.y, 1.0);
+        }
+    case 14:	//bc3,
+    case 15:	//bc7, straight alpha
+        {
+            vec4 c = get_sample(plane[0], TexCoord.st / TexCoord.q).rgba;
+            return vec4(c.rgb * c.a, c.a);
+        }
+    case 16:	//color
+        return solid_color;
     }
     return vec4(0.0, 0.0, 0.0, 0.0);
 }
 
+// Video range samples to full range luma and chroma centered on zero.
+vec4 normalize_ycbcra(vec3 c, float a)
+{
+    return vec4((c.x * 255.0 - 16.0) / 219.0, (c.yz * 255.0 - 128.0) / 224.0, a);
+}
+
+// Full range YCbCr for the YCbCr keyer. YCbCr sources are taken as sampled, others are converted from RGB.
+vec4 get_ycbcra_color()
+{
+    vec2 coords = TexCoord.st / TexCoord.q;
+    switch(PIXEL_FORMAT)
+    {
+    case 5:		//ycbcr,
+    case 6:		//ycbcra
+        {
+            vec3  c = vec3(get_sample(plane[0], coords).r,
+                           get_sample(plane[1], coords).r,
+                           get_sample(plane[2], coords).r) * sample_scale;
+            float a = PIXEL_FORMAT == 6 ? get_sample(plane[3], coords).r * sample_scale : 1.0;
+            return normalize_ycbcra(c, a);
+        }
+    case 10:	//uyvy,
+        return normalize_ycbcra(get_uyvy_ycbcr(coords), 1.0);
+    case 11:	//v210,
+        return normalize_ycbcra(get_v210_ycbcr(coords), 1.0);
+    case 12:	//nv12,
+    case 17:	//p010,
+        {
+            float y = get_sample(plane[0], coords).r;
+            vec2  c = get_sample(plane[1], coords).rg;
+            return normalize_ycbcra(vec3(y, c) * sample_scale, 1.0);
+        }
+    }
+
+    vec4  c = get_rgba_color();
+    float y = chroma_kr * c.b + (1.0 - chroma_kr - chroma_kb) * c.g + chroma_kb * c.r;
+    return vec4(y, (c.r - y) / (2.0 * (1.0 - chroma_kb)), (c.b - y) / (2.0 * (1.0 - chroma_kr)), c.a);
+}
+
 void main()
 {
-    vec4 color = get_rgba_color();
-    if (chroma)
+    vec4 color;
+    if (CHROMA == 2)
+        color = chroma_key_ycbcr(get_ycbcra_color());
+    else
+        color = get_rgba_color();
+    if (CHROMA == 1)
         color = chroma_key(color);
-    if(levels)
+    if(LEVELS)
         color.rgb = LevelsControl(color.rgb, min_input, gamma, max_input, min_output, max_output);
-    if(csb)
+    if(CSB)
         color.rgb = ContrastSaturationBrightness(color, brt, sat, con);
-    if(has_local_key)
+    if(HAS_LOCAL_KEY)
         color *= texture(local_key, TexCoord2.st).r;
-    if(has_layer_key)
+    if(HAS_LAYER_KEY)
         color *= texture(layer_key, TexCoord2.st).r;
     color *= opacity;
-    if (invert)
+    if (INVERT)
         color = 1.0 - color;
-    if (blend_mode >= 0)
+    if (BLEND_MODE >= 0)
         color = blend(color);
     fragColor = color.bgra;
 }
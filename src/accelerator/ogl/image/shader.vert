@@ -1,6 +1,6 @@
 #version 450
-in vec4 TexCoordIn;
-in vec2 Position;
+layout(location = 0) in vec2 Position;
+layout(location = 1) in vec4 TexCoordIn;
 
 out vec4 TexCoord;
 out vec4 TexCoord2;
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+#include "context.h"
+
+#include <common/except.h>
+#include <common/gl/gl_check.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <GL/glew.h>
+
+#include <SFML/Window/Context.hpp>
+
+#ifndef _WIN32
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+namespace {
+
+class sfml_context final : public context
+{
+    sf::Context context_;
+
+  public:
+    sfml_context()
+        : context_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
+    {
+    }
+
+    // SFML shares objects between all of its contexts.
+    std::unique_ptr<context> create_shared() override { return std::make_unique<sfml_context>(); }
+
+    void set_active(bool active) override { context_.setActive(active); }
+
+    bool init_glew() override { return glewInit() == GLEW_OK; }
+};
+
+#ifndef _WIN32
+
+template <typename Proc>
+Proc get_proc(const char* name)
+{
+    auto proc = reinterpret_cast<Proc>(eglGetProcAddress(name));
+    if (!proc) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info(std::string("EGL does not provide ") + name + "."));
+    }
+    return proc;
+}
+
+// Displays stay initialized for the lifetime of the process, eglTerminate would invalidate the contexts of every
+// device on them.
+EGLDisplay get_display(int index)
+{
+    static std::mutex                mutex;
+    static std::map<int, EGLDisplay> displays;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = displays.find(index);
+    if (it != displays.end()) {
+        return it->second;
+    }
+
+    auto query_devices        = get_proc<PFNEGLQUERYDEVICESEXTPROC>("eglQueryDevicesEXT");
+    auto query_device_string  = get_proc<PFNEGLQUERYDEVICESTRINGEXTPROC>("eglQueryDeviceStringEXT");
+    auto get_platform_display = get_proc<PFNEGLGETPLATFORMDISPLAYEXTPROC>("eglGetPlatformDisplayEXT");
+
+    EGLint count = 0;
+    if (!query_devices(0, nullptr, &count) || count < 1) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("No EGL devices found."));
+    }
+    std::vector<EGLDeviceEXT> devices(count);
+    query_devices(count, devices.data(), &count);
+
+    for (int n = 0; n < count; ++n) {
+        auto file = query_device_string(devices[n], EGL_DRM_DEVICE_FILE_EXT);
+        CASPAR_LOG(info) << L"EGL device " << n << L": " << (file ? u16(file) : L"no DRM device") << L".";
+    }
+
+    if (index < 0 || index >= count) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("There is no EGL device " + std::to_string(index) +
+                                                               ", " + std::to_string(count) + " found."));
+    }
+
+    auto display = get_platform_display(EGL_PLATFORM_DEVICE_EXT, devices[index], nullptr);
+
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        CASPAR_THROW_EXCEPTION(gl::ogl_exception()
+                               << msg_info("Failed to initialize EGL device " + std::to_string(index) + "."));
+    }
+
+    CASPAR_LOG(info) << L"Initialized EGL " << major << L"." << minor << L" on device " << index << L" ("
+                     << u16(eglQueryString(display, EGL_VENDOR)) << L").";
+
+    displays[index] = display;
+    return display;
+}
+
+class egl_context final : public context
+{
+    EGLDisplay display_;
+    EGLConfig  config_  = nullptr;
+    EGLContext context_ = EGL_NO_CONTEXT;
+    EGLSurface surface_ = EGL_NO_SURFACE;
+
+  public:
+    egl_context(EGLDisplay display, EGLContext share)
+        : display_(display)
+    {
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLint count = 0;
+        if (!eglChooseConfig(display_, config_attribs, &config_, 1, &count) || count < 1) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("No EGL config supports OpenGL."));
+        }
+
+        // Unused, but not every driver can make a context current without a surface.
+        const EGLint surface_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        surface_                       = eglCreatePbufferSurface(display_, config_, surface_attribs);
+        if (surface_ == EGL_NO_SURFACE) {
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to create EGL surface."));
+        }
+
+        const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                          4,
+                                          EGL_CONTEXT_MINOR_VERSION,
+                                          5,
+                                          EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                          EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                          EGL_NONE};
+        eglBindAPI(EGL_OPENGL_API);
+        context_ = eglCreateContext(display_, config_, share, context_attribs);
+        if (context_ == EGL_NO_CONTEXT) {
+            eglDestroySurface(display_, surface_);
+            CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to create OpenGL 4.5 EGL context."));
+        }
+    }
+
+    ~egl_context()
+    {
+        if (eglGetCurrentContext() == context_) {
+            eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+        eglDestroyContext(display_, context_);
+        eglDestroySurface(display_, surface_);
+    }
+
+    std::unique_ptr<context> create_shared() override { return std::make_unique<egl_context>(display_, context_); }
+
+    void set_active(bool active) override
+    {
+        // The API is bound per thread.
+        eglBindAPI(EGL_OPENGL_API);
+        if (active) {
+            if (!eglMakeCurrent(display_, surface_, surface_, context_)) {
+                CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to activate EGL context."));
+            }
+        } else {
+            eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+    }
+
+    // glewInit would also load the GLX extensions, which fails without an X display.
+    bool init_glew() override { return glewContextInit() == GLEW_OK; }
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<context> context::create(const std::wstring& platform, int index)
+{
+    if (platform == L"egl") {
+#ifndef _WIN32
+        return std::make_unique<egl_context>(get_display(index), EGL_NO_CONTEXT);
+#else
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("EGL is only supported on Linux."));
+#endif
+    }
+    return std::make_unique<sfml_context>();
+}
+
+}}} // namespace caspar::accelerator::ogl
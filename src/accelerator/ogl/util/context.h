@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// An OpenGL 4.5 core context for a device. "auto" creates it through the windowing system, which needs a display on
+// Linux. "egl" creates it without one, on the EGL device of the given index, and is only available on Linux.
+class context
+{
+  public:
+    static std::unique_ptr<context> create(const std::wstring& platform, int index);
+
+    virtual ~context() {}
+
+    // A context that shares objects with this one, for use on another thread.
+    virtual std::unique_ptr<context> create_shared() = 0;
+
+    virtual void set_active(bool active) = 0;
+
+    // Loads the OpenGL entry points, with the context active. Returns false if they could not be loaded.
+    virtual bool init_glew() = 0;
+};
+
+}}} // namespace caspar::accelerator::ogl
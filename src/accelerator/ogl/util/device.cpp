@@ -21,43 +21,100 @@
 #include "device.h"
 
 #include "buffer.h"
+#include "context.h"
+#include "resource_pool.h"
 #include "shader.h"
+#include "shared_texture.h"
 #include "texture.h"
+#include "timer_query.h"
 
 #include <common/array.h>
 #include <common/assert.h>
+#include <common/diagnostics/graph.h>
 #include <common/except.h>
+#include <common/future.h>
 #include <common/gl/gl_check.h>
 #include <common/os/thread.h>
 
-#include <GL/glew.h>
+#include <core/frame/frame_factory.h>
 
-#include <SFML/Window/Context.hpp>
+#include <GL/glew.h>
 
-#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/dispatch.hpp>
-#include <boost/asio/spawn.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/format.hpp>
 
+#include <tbb/blocked_range.h>
 #include <tbb/concurrent_queue.h>
-#include <tbb/concurrent_unordered_map.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <future>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 using namespace boost::asio;
 
+// Array storage for host buffers handed out by create_array. The owner is recorded so that arrays coming from
+// another device (e.g. a channel routed from another GPU) are copied rather than bound in the wrong context.
+struct host_buffer
+{
+    // Textures already uploaded from this buffer. The contents are immutable once the frame is committed, so
+    // re-submitting the same array can reuse them.
+    struct upload
+    {
+        const void*                   device;
+        int                           width;
+        int                           height;
+        int                           stride;
+        std::shared_ptr<ogl::texture> texture;
+    };
+
+    struct upload_cache
+    {
+        std::mutex          mutex;
+        std::vector<upload> uploads;
+    };
+
+    const void*                   owner;
+    std::shared_ptr<ogl::buffer>  buffer;
+    std::shared_ptr<upload_cache> uploads = std::make_shared<upload_cache>();
+};
+
 struct device::impl : public std::enable_shared_from_this<impl>
 {
-    using texture_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<texture>>;
-    using buffer_queue_t  = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
+    struct readback
+    {
+        GLsync                                fence = nullptr;
+        std::shared_ptr<buffer>               buf;
+        std::shared_ptr<texture>              source;
+        int                                   size = 0;
+        std::chrono::steady_clock::time_point start;
+        std::promise<array<const uint8_t>>    promise;
+    };
 
-    sf::Context device_;
+    const int index_;
 
-    std::array<tbb::concurrent_unordered_map<size_t, texture_queue_t>, 4> device_pools_;
-    std::array<tbb::concurrent_unordered_map<size_t, buffer_queue_t>, 2>  host_pools_;
+    std::unique_ptr<context> device_;
+
+    resource_pool<texture> texture_pool_;
+    resource_pool<buffer>  buffer_pool_;
+    std::atomic<bool>      texture_budget_exceeded_{false};
+    std::atomic<bool>      buffer_budget_exceeded_{false};
+
+    std::mutex                replenish_mutex_;
+    std::set<std::uint64_t>   replenishing_;
+    std::atomic<std::int64_t> buffer_stalls_{0};
+    std::atomic<std::int64_t> buffer_fallbacks_{0};
+    std::atomic<std::int64_t> buffers_replenished_{0};
 
     using sync_queue_t = tbb::concurrent_bounded_queue<std::shared_ptr<buffer>>;
 
@@ -65,28 +122,51 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
     GLuint fbo_;
 
+    std::unique_ptr<shared_texture_importer> importer_;
+
     std::wstring version_;
 
+    const spl::shared_ptr<diagnostics::graph> graph_;
+    std::vector<double>                       readback_latencies_;
+    std::atomic<std::int64_t>                 upload_hits_{0};
+    std::atomic<std::int64_t>                 upload_misses_{0};
+
+    tbb::task_arena  copy_arena_;
+    std::atomic<int> pending_copies_{0};
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<readback>> readback_queue_;
+
     io_context                          service_;
     decltype(make_work_guard(service_)) work_;
     std::thread                         thread_;
-
-    impl()
-        : device_(sf::ContextSettings(0, 0, 0, 4, 5, sf::ContextSettings::Attribute::Core), 1, 1)
+    std::thread                         readback_thread_;
+
+    impl(const std::wstring& platform, int index, std::size_t texture_pool_size, std::size_t buffer_pool_size)
+        : index_(index)
+        , device_(context::create(platform, index))
+        , texture_pool_("ogl/texture-pool",
+                        texture_pool_size,
+                        std::chrono::seconds(60),
+                        [this](auto items) { release(std::move(items)); })
+        , buffer_pool_("ogl/buffer-pool",
+                       buffer_pool_size,
+                       std::chrono::seconds(60),
+                       [this](auto items) { release(std::move(items)); })
         , work_(make_work_guard(service_))
     {
-        CASPAR_LOG(info) << L"Initializing OpenGL Device.";
+        CASPAR_LOG(info) << L"Initializing OpenGL Device " << index_ << L".";
 
-        device_.setActive(true);
+        device_->set_active(true);
 
-        if (glewInit() != GLEW_OK) {
+        if (!device_->init_glew()) {
             CASPAR_THROW_EXCEPTION(gl::ogl_exception() << msg_info("Failed to initialize GLEW."));
         }
 
         version_ = u16(reinterpret_cast<const char*>(GL2(glGetString(GL_VERSION)))) + L" " +
                    u16(reinterpret_cast<const char*>(GL2(glGetString(GL_VENDOR))));
 
-        CASPAR_LOG(info) << L"Initialized OpenGL " << version();
+        CASPAR_LOG(info) << L"Initialized OpenGL " << version() << L" on device " << index_ << L" ("
+                         << u16(reinterpret_cast<const char*>(GL2(glGetString(GL_RENDERER)))) << L").";
 
         if (!GLEW_VERSION_4_5 && !glewIsSupported("GL_ARB_sync GL_ARB_shader_objects GL_ARB_multitexture "
                                                   "GL_ARB_direct_state_access GL_ARB_texture_barrier")) {
@@ -98,44 +178,49 @@ struct device::impl : public std::enable_shared_from_this<impl>
         GL(glCreateFramebuffers(1, &fbo_));
         GL(glBindFramebuffer(GL_FRAMEBUFFER, fbo_));
 
-        device_.setActive(false);
+        device_->set_active(false);
+
+        graph_->set_color("readback-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("upload-hit-ratio", diagnostics::color(0.6f, 0.9f, 0.0f));
+        graph_->set_text(L"ogl[" + std::to_wstring(index_) + L"]");
+        diagnostics::register_graph(graph_);
+
+        readback_thread_ = std::thread([&] { run_readback_waiter(); });
 
         thread_ = std::thread([&] {
-            device_.setActive(true);
-            set_thread_name(L"OpenGL Device");
+            device_->set_active(true);
+            set_thread_name(L"OpenGL Device " + std::to_wstring(index_));
             service_.run();
-            device_.setActive(false);
+            device_->set_active(false);
         });
     }
 
     ~impl()
     {
+        while (pending_copies_ > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
         work_.reset();
         thread_.join();
 
-        device_.setActive(true);
+        readback_queue_.push(std::make_shared<readback>());
+        readback_thread_.join();
 
-        for (auto& pool : host_pools_)
-            pool.clear();
+        device_->set_active(true);
 
-        for (auto& pool : device_pools_)
-            pool.clear();
+        // Release fences and buffers of readbacks that completed after the device thread stopped.
+        service_.restart();
+        service_.poll();
 
-        sync_queue_.clear();
+        buffer_pool_.clear();
+        texture_pool_.clear();
 
-        GL(glDeleteFramebuffers(1, &fbo_));
-    }
+        sync_queue_.clear();
 
-    template <typename Func>
-    auto spawn_async(Func&& func)
-    {
-        using result_type = decltype(func(std::declval<yield_context>()));
-        using task_type   = std::packaged_task<result_type(yield_context)>;
+        importer_.reset();
 
-        auto task   = task_type(std::forward<Func>(func));
-        auto future = task.get_future();
-        boost::asio::spawn(service_, std::move(task));
-        return future;
+        GL(glDeleteFramebuffers(1, &fbo_));
     }
 
     template <typename Func>
@@ -158,17 +243,56 @@ struct device::impl : public std::enable_shared_from_this<impl>
 
     std::wstring version() { return version_; }
 
-    std::shared_ptr<texture> create_texture(int width, int height, int stride, bool clear)
+    template <typename T>
+    void release(std::vector<std::shared_ptr<T>> items)
+    {
+        // GL objects must be deleted on the device thread.
+        boost::asio::post(service_, [items = std::move(items)]() mutable { items.clear(); });
+    }
+
+    static std::uint64_t texture_key(int width, int height, int stride, texture_precision precision)
+    {
+        return static_cast<std::uint64_t>(precision) << 40 | static_cast<std::uint64_t>(stride) << 32 |
+               static_cast<std::uint64_t>(width & 0xFFFF) << 16 | static_cast<std::uint64_t>(height & 0xFFFF);
+    }
+
+    static std::uint64_t buffer_key(int size, bool write)
+    {
+        return static_cast<std::uint64_t>(write ? 1 : 0) << 32 | static_cast<std::uint64_t>(size);
+    }
+
+    // Buffers are pooled in size classes of a quarter of the next lower power of two, so that similar formats
+    // share entries at the cost of at most 25% overallocation.
+    static int buffer_size_class(int size)
+    {
+        if (size <= 4096) {
+            return 4096;
+        }
+        int step = 1;
+        while (step <= size / 2) {
+            step <<= 1;
+        }
+        step /= 4;
+        return (size + step - 1) / step * step;
+    }
+
+    std::shared_ptr<texture> create_texture(int               width,
+                                            int               height,
+                                            int               stride,
+                                            bool              clear,
+                                            texture_precision precision = texture_precision::unorm8)
     {
         CASPAR_VERIFY(stride > 0 && stride < 5);
         CASPAR_VERIFY(width > 0 && height > 0);
 
-        // TODO (perf) Shared pool.
-        auto pool = &device_pools_[stride - 1][(width << 16 & 0xFFFF0000) | (height & 0x0000FFFF)];
+        auto key = texture_key(width, height, stride, precision);
 
-        std::shared_ptr<texture> tex;
-        if (!pool->try_pop(tex)) {
-            tex = std::make_shared<texture>(width, height, stride);
+        auto tex = texture_pool_.pop(key);
+        if (!tex) {
+            if (!texture_pool_.reserve(width * height * stride) && !texture_budget_exceeded_.exchange(true)) {
+                CASPAR_LOG(warning) << L"[ogl] Device " << index_ << L" exceeded its texture pool budget.";
+            }
+            tex = std::make_shared<texture>(width, height, stride, precision);
         }
 
         if (clear) {
@@ -176,118 +300,470 @@ struct device::impl : public std::enable_shared_from_this<impl>
         }
 
         auto ptr = tex.get();
-        return std::shared_ptr<texture>(
-            ptr, [tex = std::move(tex), pool, self = shared_from_this()](texture*) mutable { pool->push(tex); });
+        return std::shared_ptr<texture>(ptr, [tex = std::move(tex), key, self = shared_from_this()](texture*) mutable {
+            auto size = tex->size();
+            self->texture_pool_.push(key, std::move(tex), size);
+        });
     }
 
-    std::shared_ptr<buffer> create_buffer(int size, bool write)
-    {
-        CASPAR_VERIFY(size > 0);
+    bool is_device_thread() { return service_.get_executor().running_in_this_thread(); }
 
-        // TODO (perf) Shared pool.
-        auto pool = &host_pools_[static_cast<int>(write ? 1 : 0)][size];
+    std::shared_ptr<buffer> allocate_buffer(int buffer_size, bool write)
+    {
+        if (!buffer_pool_.reserve(buffer_size) && !buffer_budget_exceeded_.exchange(true)) {
+            CASPAR_LOG(warning) << L"[ogl] Device " << index_ << L" exceeded its host buffer pool budget.";
+        }
+        return std::make_shared<buffer>(buffer_size, write);
+    }
 
-        std::shared_ptr<buffer> buf;
-        if (!pool->try_pop(buf)) {
-            // TODO (perf) Avoid blocking in create_array.
-            dispatch_sync([&] { buf = std::make_shared<buffer>(size, write); });
+    // Allocates count buffers of a size class on the device thread and adds them to the pool as idle.
+    void replenish(int buffer_size, bool write, int count)
+    {
+        auto key = buffer_key(buffer_size, write);
+        {
+            std::lock_guard<std::mutex> lock(replenish_mutex_);
+            if (!replenishing_.insert(key).second) {
+                return;
+            }
         }
 
+        boost::asio::post(service_, [=] {
+            try {
+                for (int n = 0; n < count; ++n) {
+                    buffer_pool_.push(key, allocate_buffer(buffer_size, write), buffer_size);
+                    ++buffers_replenished_;
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+
+            std::lock_guard<std::mutex> lock(replenish_mutex_);
+            replenishing_.erase(key);
+        });
+    }
+
+    // Fills the pools with an idle texture and readbacks buffers of its size on the device thread, unless they hold
+    // them already, so that the first frames of a format don't allocate them.
+    void reserve(int width, int height, int stride, texture_precision precision, int readbacks)
+    {
+        boost::asio::post(service_, [=, self = shared_from_this()] {
+            try {
+                if (texture_pool_.idle_count(texture_key(width, height, stride, precision)) > 0) {
+                    return;
+                }
+                auto size = create_texture(width, height, stride, false, precision)->size();
+
+                auto buffer_size = buffer_size_class(size);
+                auto idle        = static_cast<int>(buffer_pool_.idle_count(buffer_key(buffer_size, false)));
+                if (idle < readbacks) {
+                    replenish(buffer_size, false, readbacks - idle);
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
+    }
+
+    std::shared_ptr<buffer> wrap_buffer(std::shared_ptr<buffer> buf)
+    {
         auto ptr = buf.get();
         return std::shared_ptr<buffer>(ptr, [buf = std::move(buf), self = shared_from_this()](buffer*) mutable {
             self->sync_queue_.emplace(std::move(buf));
         });
     }
 
+    std::shared_ptr<buffer> create_buffer(int size, bool write)
+    {
+        CASPAR_VERIFY(size > 0);
+
+        auto buffer_size = buffer_size_class(size);
+
+        auto buf = buffer_pool_.pop(buffer_key(buffer_size, write));
+        if (!buf) {
+            if (is_device_thread()) {
+                buf = allocate_buffer(buffer_size, write);
+            } else {
+                ++buffer_stalls_;
+                dispatch_sync([&] { buf = allocate_buffer(buffer_size, write); });
+            }
+        }
+
+        return wrap_buffer(std::move(buf));
+    }
+
     array<uint8_t> create_array(int size)
     {
-        auto buf = create_buffer(size, true);
+        CASPAR_VERIFY(size > 0);
+
+        auto buffer_size = buffer_size_class(size);
+        auto key         = buffer_key(buffer_size, true);
+
+        auto buf = buffer_pool_.pop(key);
+
+        if (!buf && is_device_thread()) {
+            buf = allocate_buffer(buffer_size, true);
+        }
+
+        if (!buf) {
+            // Don't stall the producer behind the device queue. Hand out heap memory for this frame, it gets staged
+            // on upload, and allocate mapped buffers of this size class in the background.
+            ++buffer_fallbacks_;
+            replenish(buffer_size, true, 2);
+
+            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
+            return array<uint8_t>(reinterpret_cast<uint8_t*>(storage.get()), size, std::move(storage));
+        }
+
+        if (buffer_pool_.idle_count(key) == 0) {
+            replenish(buffer_size, true, 1);
+        }
+
+        buf      = wrap_buffer(std::move(buf));
         auto ptr = reinterpret_cast<uint8_t*>(buf->data());
-        return array<uint8_t>(ptr, buf->size(), buf);
+        return array<uint8_t>(ptr, size, host_buffer{this, buf});
     }
 
-    std::future<std::shared_ptr<texture>>
-    copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+    array<const uint8_t> import_shared_texture(void* handle, int width, int height)
     {
-        return dispatch_async([=] {
-            std::shared_ptr<buffer> buf;
+        return dispatch_sync([&]() -> array<const uint8_t> {
+            if (!importer_) {
+                importer_ = std::make_unique<shared_texture_importer>();
+            }
 
-            auto tmp = source.storage<std::shared_ptr<buffer>>();
-            if (tmp) {
-                buf = *tmp;
-            } else {
-                buf = create_buffer(static_cast<int>(source.size()), true);
-                // TODO (perf) Copy inside a TBB worker.
-                std::memcpy(buf->data(), source.data(), source.size());
+            auto tex = create_texture(width, height, 4, false);
+            if (!importer_->copy(handle, *tex)) {
+                return array<const uint8_t>{};
+            }
+
+            host_buffer storage{this, nullptr};
+            storage.uploads->uploads.push_back(host_buffer::upload{this, width, height, 4, std::move(tex)});
+            return array<const uint8_t>(nullptr, static_cast<std::size_t>(width) * height * 4, std::move(storage));
+        });
+    }
+
+    array<const uint8_t> update_texture(const array<const uint8_t>&          previous,
+                                        const void*                          image,
+                                        int                                  width,
+                                        int                                  height,
+                                        int                                  stride,
+                                        const std::vector<core::frame_rect>& regions)
+    {
+        return dispatch_sync([&]() -> array<const uint8_t> {
+            auto source = find_upload(previous.storage<host_buffer>(), width, height, stride);
+            if (!source) {
+                return array<const uint8_t>{};
             }
 
             auto tex = create_texture(width, height, stride, false);
-            tex->copy_from(*buf);
-            // TODO (perf) save tex on source
-            return tex;
+            tex->copy_from(*source);
+            for (auto& region : regions) {
+                auto data = reinterpret_cast<const uint8_t*>(image) +
+                            (static_cast<std::size_t>(region.y) * width + region.x) * stride;
+                tex->copy_from(data, region.x, region.y, region.width, region.height, width);
+            }
+
+            host_buffer storage{this, nullptr};
+            storage.uploads->uploads.push_back(host_buffer::upload{this, width, height, stride, std::move(tex)});
+            return array<const uint8_t>(nullptr, static_cast<std::size_t>(width) * height * stride, std::move(storage));
+        });
+    }
+
+    core::monitor::state state()
+    {
+        core::monitor::state state;
+
+        auto add = [&](const std::string& name, const auto& stats) {
+            state["pool"][name]["budget"]         = static_cast<std::int64_t>(stats.budget_bytes);
+            state["pool"][name]["resident"]       = static_cast<std::int64_t>(stats.resident_bytes);
+            state["pool"][name]["idle"]           = static_cast<std::int64_t>(stats.idle_bytes);
+            state["pool"][name]["resident-count"] = static_cast<std::int64_t>(stats.resident_count);
+            state["pool"][name]["idle-count"]     = static_cast<std::int64_t>(stats.idle_count);
+            state["pool"][name]["hits"]           = stats.hits;
+            state["pool"][name]["misses"]         = stats.misses;
+        };
+
+        state["index"] = index_;
+        add("texture", texture_pool_.get_stats());
+        add("buffer", buffer_pool_.get_stats());
+
+        state["pool"]["buffer"]["stalls"]      = buffer_stalls_.load();
+        state["pool"]["buffer"]["fallbacks"]   = buffer_fallbacks_.load();
+        state["pool"]["buffer"]["replenished"] = buffers_replenished_.load();
+
+        return state;
+    }
+
+    std::shared_ptr<texture> find_upload(host_buffer* source, int width, int height, int stride)
+    {
+        if (!source) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(source->uploads->mutex);
+        for (auto& upload : source->uploads->uploads) {
+            if (upload.device == this && upload.width == width && upload.height == height && upload.stride == stride) {
+                return upload.texture;
+            }
+        }
+        return nullptr;
+    }
+
+    std::shared_ptr<texture> upload(host_buffer*                        source,
+                                    const std::shared_ptr<buffer>&      buf,
+                                    int                                 width,
+                                    int                                 height,
+                                    int                                 stride,
+                                    const std::shared_ptr<timer_query>& timer,
+                                    texture_precision                   precision = texture_precision::unorm8)
+    {
+        auto tex = create_texture(width, height, stride, false, precision);
+
+        if (timer) {
+            timer->begin();
+        }
+        tex->copy_from(*buf);
+        if (timer) {
+            timer->end();
+        }
+
+        if (source) {
+            std::lock_guard<std::mutex> lock(source->uploads->mutex);
+            source->uploads->uploads.push_back(host_buffer::upload{this, width, height, stride, tex});
+        }
+        update_upload_stats(false);
+
+        return tex;
+    }
+
+    std::future<std::shared_ptr<texture>>
+    copy_async(const array<const uint8_t>&         source,
+               int                                 width,
+               int                                 height,
+               int                                 stride,
+               const std::shared_ptr<timer_query>& timer,
+               texture_precision                   precision)
+    {
+        auto tmp = source.storage<host_buffer>();
+
+        auto cached = find_upload(tmp, width, height, stride);
+        if (cached) {
+            update_upload_stats(true);
+            return make_ready_future(std::move(cached));
+        }
+
+        if (tmp && !tmp->buffer) {
+            // Imported on another device, there is no host copy to upload from.
+            return dispatch_async([=] { return create_texture(width, height, stride, true, precision); });
+        }
+
+        if (tmp && tmp->owner == this) {
+            // Channels sharing a frame may ask for it at once, the first upload on the device thread serves them all.
+            return dispatch_async([=] {
+                auto uploaded = find_upload(tmp, width, height, stride);
+                if (uploaded) {
+                    update_upload_stats(true);
+                    return uploaded;
+                }
+                return upload(tmp, tmp->buffer, width, height, stride, timer, precision);
+            });
+        }
+
+        // Foreign memory is staged into a pinned buffer on TBB workers, only the upload runs on the device thread.
+        // A pool miss then blocks a worker rather than the caller.
+        auto promise = std::make_shared<std::promise<std::shared_ptr<texture>>>();
+        auto future  = promise->get_future();
+
+        ++pending_copies_;
+        copy_arena_.enqueue([=] {
+            try {
+                auto buf = create_buffer(static_cast<int>(source.size()), true);
+                auto dst = reinterpret_cast<uint8_t*>(buf->data());
+                tbb::parallel_for(tbb::blocked_range<std::size_t>(0, source.size(), 1 << 20), [&](const auto& r) {
+                    std::memcpy(dst + r.begin(), source.data() + r.begin(), r.size());
+                });
+
+                boost::asio::post(service_, [=] {
+                    try {
+                        promise->set_value(upload(tmp, buf, width, height, stride, timer, precision));
+                    } catch (...) {
+                        promise->set_exception(std::current_exception());
+                    }
+                    --pending_copies_;
+                });
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+                --pending_copies_;
+            }
         });
+
+        return future;
     }
 
-    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<texture>& source)
+    std::future<array<const uint8_t>>
+    copy_async(const std::shared_ptr<texture>& source, const std::shared_ptr<timer_query>& timer, bool keep_source)
     {
-        return spawn_async([=](yield_context yield) {
+        return flatten(dispatch_async([=] {
             auto buf = create_buffer(source->size(), false);
+
+            if (timer) {
+                timer->begin();
+            }
             source->copy_to(*buf);
+            if (timer) {
+                timer->end();
+            }
 
             sync_queue_.push(nullptr);
 
-            auto fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            auto job   = std::make_shared<readback>();
+            job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            job->buf   = std::move(buf);
+            job->size  = source->size();
+            job->start = std::chrono::steady_clock::now();
+            if (keep_source) {
+                job->source = source;
+            }
 
             GL(glFlush());
 
-            deadline_timer timer(service_);
-            for (auto n = 0; true; ++n) {
-                // TODO (perf) Smarter non-polling solution?
-                timer.expires_from_now(boost::posix_time::milliseconds(2));
-                timer.async_wait(yield);
+            auto future = job->promise.get_future();
+            readback_queue_.push(std::move(job));
+            return future;
+        }));
+    }
 
-                auto wait = glClientWaitSync(fence, 0, 1);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
-                    break;
-                }
+    void run_readback_waiter()
+    {
+        set_thread_name(L"OpenGL Readback " + std::to_wstring(index_));
+
+        // Shares objects with device_, which allows waiting on its fences without touching the device thread.
+        auto context = device_->create_shared();
+        context->set_active(true);
+
+        while (true) {
+            std::shared_ptr<readback> job;
+            readback_queue_.pop(job);
+
+            if (!job->fence) {
+                break;
             }
 
-            glDeleteSync(fence);
+            while (glClientWaitSync(job->fence, 0, 1000000000) == GL_TIMEOUT_EXPIRED) {
+            }
 
-            {
-                std::shared_ptr<buffer> buf2;
-                while (sync_queue_.try_pop(buf2) && buf2) {
-                    auto pool = &host_pools_[static_cast<int>(buf2->write() ? 1 : 0)][buf2->size()];
-                    pool->push(std::move(buf2));
-                }
+            boost::asio::post(service_, [this, job] { complete_readback(*job); });
+        }
+
+        context->set_active(false);
+    }
+
+    void complete_readback(readback& job)
+    {
+        glDeleteSync(job.fence);
+
+        {
+            std::shared_ptr<buffer> buf2;
+            while (sync_queue_.try_pop(buf2) && buf2) {
+                auto size = buf2->size();
+                buffer_pool_.push(buffer_key(size, buf2->write()), std::move(buf2), size);
             }
+        }
 
-            auto ptr  = reinterpret_cast<uint8_t*>(buf->data());
-            auto size = buf->size();
-            return array<const uint8_t>(ptr, size, std::move(buf));
-        });
+        update_readback_stats(std::chrono::duration<double>(std::chrono::steady_clock::now() - job.start).count());
+
+        // The pixels are what was rendered into the source, so it serves as the upload of the buffer.
+        auto        ptr = reinterpret_cast<uint8_t*>(job.buf->data());
+        host_buffer storage{this, std::move(job.buf)};
+        if (job.source) {
+            auto& source = *job.source;
+            storage.uploads->uploads.push_back(
+                host_buffer::upload{this, source.width(), source.height(), source.stride(), std::move(job.source)});
+        }
+        job.promise.set_value(array<const uint8_t>(ptr, job.size, std::move(storage)));
+    }
+
+    void update_upload_stats(bool hit)
+    {
+        if (hit) {
+            ++upload_hits_;
+        } else {
+            ++upload_misses_;
+        }
+        graph_->set_value("upload-hit-ratio",
+                          static_cast<double>(upload_hits_) / static_cast<double>(upload_hits_ + upload_misses_));
+    }
+
+    void update_readback_stats(double latency)
+    {
+        // 0.5 on the graph corresponds to 20 ms.
+        graph_->set_value("readback-time", latency * 25.0);
+
+        readback_latencies_.push_back(latency);
+        if (readback_latencies_.size() < 256) {
+            return;
+        }
+
+        auto percentile = [&](double p) {
+            auto n = static_cast<std::size_t>(p * static_cast<double>(readback_latencies_.size() - 1));
+            std::nth_element(readback_latencies_.begin(), readback_latencies_.begin() + n, readback_latencies_.end());
+            return readback_latencies_[n] * 1000.0;
+        };
+
+        auto p50 = percentile(0.50);
+        auto p95 = percentile(0.95);
+        auto p99 = percentile(0.99);
+        readback_latencies_.clear();
+
+        graph_->set_text(boost::str(
+            boost::wformat(L"ogl[%1%] readback p50 %2$.1fms p95 %3$.1fms p99 %4$.1fms, upload hit %5% miss %6%") %
+            index_ % p50 % p95 % p99 % upload_hits_.load() % upload_misses_.load()));
     }
 };
 
-device::device()
-    : impl_(new impl())
+device::device(const std::wstring& platform, int index, std::size_t texture_pool_size, std::size_t buffer_pool_size)
+    : impl_(new impl(platform, index, texture_pool_size, buffer_pool_size))
 {
 }
 device::~device() {}
-std::shared_ptr<texture> device::create_texture(int width, int height, int stride)
+std::shared_ptr<texture> device::create_texture(int width, int height, int stride, texture_precision precision)
 {
-    return impl_->create_texture(width, height, stride, true);
+    return impl_->create_texture(width, height, stride, true, precision);
+}
+void device::reserve(int width, int height, int stride, texture_precision precision, int readbacks)
+{
+    impl_->reserve(width, height, stride, precision, readbacks);
 }
 array<uint8_t> device::create_array(int size) { return impl_->create_array(size); }
 std::future<std::shared_ptr<texture>>
-device::copy_async(const array<const uint8_t>& source, int width, int height, int stride)
+device::copy_async(const array<const uint8_t>&         source,
+                   int                                 width,
+                   int                                 height,
+                   int                                 stride,
+                   const std::shared_ptr<timer_query>& timer,
+                   texture_precision                   precision)
+{
+    return impl_->copy_async(source, width, height, stride, timer, precision);
+}
+std::future<array<const uint8_t>>
+device::copy_async(const std::shared_ptr<texture>& source, const std::shared_ptr<timer_query>& timer, bool keep_source)
+{
+    return impl_->copy_async(source, timer, keep_source);
+}
+array<const uint8_t> device::import_shared_texture(void* handle, int width, int height)
 {
-    return impl_->copy_async(source, width, height, stride);
+    return impl_->import_shared_texture(handle, width, height);
 }
-std::future<array<const uint8_t>> device::copy_async(const std::shared_ptr<texture>& source)
+array<const uint8_t> device::update_texture(const array<const uint8_t>&          previous,
+                                            const void*                          image,
+                                            int                                  width,
+                                            int                                  height,
+                                            int                                  stride,
+                                            const std::vector<core::frame_rect>& regions)
 {
-    return impl_->copy_async(source);
+    return impl_->update_texture(previous, image, width, height, stride, regions);
 }
-void         device::dispatch(std::function<void()> func) { boost::asio::dispatch(impl_->service_, std::move(func)); }
-std::wstring device::version() const { return impl_->version(); }
+void device::dispatch(std::function<void()> func) { boost::asio::dispatch(impl_->service_, std::move(func)); }
+std::wstring         device::version() const { return impl_->version(); }
+int                  device::index() const { return impl_->index_; }
+core::monitor::state device::state() const { return impl_->state(); }
 }}} // namespace caspar::accelerator::ogl
@@ -21,29 +21,75 @@
 
 #pragma once
 
+#include "texture.h"
+#include "timer_query.h"
+
 #include <common/array.h>
 
+#include <core/monitor/monitor.h>
+
+#include <cstddef>
 #include <functional>
 #include <future>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+struct frame_rect;
+}} // namespace caspar::core
 
 namespace caspar { namespace accelerator { namespace ogl {
 
 class device final : public std::enable_shared_from_this<device>
 {
   public:
-    device();
+    // The platform selects how the context is created, see context. Pool sizes are the resident byte budgets for
+    // textures and pinned host buffers, 0 means unlimited.
+    explicit device(const std::wstring& platform          = L"auto",
+                    int                 index             = 0,
+                    std::size_t         texture_pool_size = 0,
+                    std::size_t         buffer_pool_size  = 0);
     ~device();
 
     device(const device&) = delete;
 
     device& operator=(const device&) = delete;
 
-    std::shared_ptr<class texture> create_texture(int width, int height, int stride);
+    std::shared_ptr<class texture>
+    create_texture(int width, int height, int stride, texture_precision precision = texture_precision::unorm8);
     array<uint8_t>                 create_array(int size);
 
+    // Pools a texture and readbacks host buffers for reading it back ahead of their first use, in the background.
+    void reserve(int width, int height, int stride, texture_precision precision, int readbacks);
+
+    // The optional timer measures the GPU time of the transfer. Block compressed data is uploaded with the matching
+    // precision and a stride of 1.
     std::future<std::shared_ptr<class texture>>
-                                      copy_async(const array<const uint8_t>& source, int width, int height, int stride);
-    std::future<array<const uint8_t>> copy_async(const std::shared_ptr<class texture>& source);
+    copy_async(const array<const uint8_t>&         source,
+               int                                 width,
+               int                                 height,
+               int                                 stride,
+               const std::shared_ptr<timer_query>& timer     = nullptr,
+               texture_precision                   precision = texture_precision::unorm8);
+    // With keep_source the texture stays referenced by the returned array, which is then drawn from it again on this
+    // device instead of being uploaded.
+    std::future<array<const uint8_t>>           copy_async(const std::shared_ptr<class texture>& source,
+                                                           const std::shared_ptr<timer_query>&   timer       = nullptr,
+                                                           bool                                  keep_source = false);
+
+    // Copies a BGRA texture another graphics API shares by handle, a D3D11 shared handle on Windows, on the device
+    // thread. The array has no host memory and is drawn from the copy on this device, it is empty when the handle
+    // can't be imported.
+    array<const uint8_t> import_shared_texture(void* handle, int width, int height);
+
+    // Copies the texture previous was drawn from on this device and uploads the regions of image, an image of the
+    // same size, into it on the device thread. The array has no host memory, it is empty when previous isn't resident.
+    array<const uint8_t> update_texture(const array<const uint8_t>&          previous,
+                                        const void*                          image,
+                                        int                                  width,
+                                        int                                  height,
+                                        int                                  stride,
+                                        const std::vector<core::frame_rect>& regions);
 
     template <typename Func>
     auto dispatch_async(Func&& func)
@@ -64,6 +110,9 @@ class device final : public std::enable_shared_from_this<device>
     }
 
     std::wstring version() const;
+    int          index() const;
+
+    core::monitor::state state() const;
 
   private:
     void dispatch(std::function<void()> func);
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <common/diagnostics/memory.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Idle GL objects of one kind, shared across all sizes. Entries are evicted least recently used first once the
+// resident size (idle and in use) exceeds the budget, or after they have been idle for too long. Evicted objects
+// are handed to the release function, which is expected to destroy them on the device thread. The resident size is
+// reported to the memory counter of the pool's name.
+template <typename T>
+class resource_pool final
+{
+    using clock_t = std::chrono::steady_clock;
+
+    struct entry
+    {
+        std::uint64_t       key;
+        std::shared_ptr<T>  item;
+        std::size_t         bytes;
+        clock_t::time_point released;
+    };
+
+    using release_t = std::function<void(std::vector<std::shared_ptr<T>>)>;
+
+    const std::size_t               budget_;
+    const clock_t::duration         max_idle_;
+    const release_t                 release_;
+    mutable std::mutex              mutex_;
+    std::list<entry>                idle_; // Most recently released first.
+    std::size_t                     resident_bytes_ = 0;
+    std::size_t                     idle_bytes_     = 0;
+    std::size_t                     resident_count_ = 0;
+    std::int64_t                    hits_           = 0;
+    std::int64_t                    misses_         = 0;
+    diagnostics::memory::held_bytes held_;
+
+  public:
+    struct stats
+    {
+        std::size_t  budget_bytes;
+        std::size_t  resident_bytes;
+        std::size_t  idle_bytes;
+        std::size_t  resident_count;
+        std::size_t  idle_count;
+        std::int64_t hits;
+        std::int64_t misses;
+    };
+
+    resource_pool(const std::string& name, std::size_t budget, clock_t::duration max_idle, release_t release)
+        : budget_(budget)
+        , max_idle_(max_idle)
+        , release_(std::move(release))
+        , held_(name)
+    {
+    }
+
+    resource_pool(const resource_pool&) = delete;
+    resource_pool& operator=(const resource_pool&) = delete;
+
+    std::shared_ptr<T> pop(std::uint64_t key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+            if (it->key == key) {
+                auto item = std::move(it->item);
+                idle_bytes_ -= it->bytes;
+                idle_.erase(it);
+                ++hits_;
+                return item;
+            }
+        }
+        ++misses_;
+        return nullptr;
+    }
+
+    std::size_t idle_count(std::uint64_t key) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<std::size_t>(
+            std::count_if(idle_.begin(), idle_.end(), [&](const entry& e) { return e.key == key; }));
+    }
+
+    // Accounts for a new object of bytes. Returns false if the budget is exceeded even with nothing idle.
+    bool reserve(std::size_t bytes)
+    {
+        std::vector<std::shared_ptr<T>> evicted;
+        bool                            result;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            resident_bytes_ += bytes;
+            resident_count_ += 1;
+            trim(evicted);
+            held_.set(static_cast<std::int64_t>(resident_bytes_));
+            result = budget_ == 0 || resident_bytes_ <= budget_;
+        }
+        if (!evicted.empty()) {
+            release_(std::move(evicted));
+        }
+        return result;
+    }
+
+    void push(std::uint64_t key, std::shared_ptr<T> item, std::size_t bytes)
+    {
+        std::vector<std::shared_ptr<T>> evicted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.push_front(entry{key, std::move(item), bytes, clock_t::now()});
+            idle_bytes_ += bytes;
+            trim(evicted);
+            held_.set(static_cast<std::int64_t>(resident_bytes_));
+        }
+        if (!evicted.empty()) {
+            release_(std::move(evicted));
+        }
+    }
+
+    // Drops all idle entries on the calling thread.
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& e : idle_) {
+            resident_bytes_ -= e.bytes;
+            resident_count_ -= 1;
+        }
+        idle_.clear();
+        idle_bytes_ = 0;
+        held_.set(static_cast<std::int64_t>(resident_bytes_));
+    }
+
+    stats get_stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats{budget_, resident_bytes_, idle_bytes_, resident_count_, idle_.size(), hits_, misses_};
+    }
+
+  private:
+    void trim(std::vector<std::shared_ptr<T>>& evicted)
+    {
+        auto now = clock_t::now();
+        while (!idle_.empty() &&
+               ((budget_ > 0 && resident_bytes_ > budget_) || now - idle_.back().released > max_idle_)) {
+            auto& e = idle_.back();
+            resident_bytes_ -= e.bytes;
+            resident_count_ -= 1;
+            idle_bytes_ -= e.bytes;
+            evicted.push_back(std::move(e.item));
+            idle_.pop_back();
+        }
+    }
+};
+
+}}} // namespace caspar::accelerator::ogl
@@ -20,14 +20,68 @@
  */
 #include "shader.h"
 
+#include <common/env.h>
 #include <common/gl/gl_check.h>
+#include <common/log.h>
+#include <common/utf.h>
 
 #include <GL/glew.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
 #include <unordered_map>
+#include <vector>
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+namespace {
+
+std::uint64_t fnv1a(const std::string& str, std::uint64_t hash = 14695981039346656037ULL)
+{
+    for (auto c : str) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string gl_string(GLenum name)
+{
+    auto str = glGetString(name);
+    return str ? reinterpret_cast<const char*>(str) : "";
+}
+
+// Linked programs are kept in ogl/shader-cache, named by a hash of the driver and the sources. Returns an empty path
+// if the cache is off or the driver cannot save programs.
+boost::filesystem::path cache_path(const std::string& vertex_source, const std::string& fragment_source)
+{
+    static const auto folder = env::properties().get(L"configuration.ogl.shader-cache", std::wstring(L"shader-cache/"));
+    if (folder.empty() || (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)) {
+        return boost::filesystem::path();
+    }
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats < 1) {
+        return boost::filesystem::path();
+    }
+
+    auto hash = fnv1a(gl_string(GL_VENDOR) + '\0' + gl_string(GL_RENDERER) + '\0' + gl_string(GL_VERSION) + '\0');
+    hash      = fnv1a(fragment_source, fnv1a(vertex_source + '\0', hash));
+
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return boost::filesystem::path(folder) / name.str();
+}
+
+} // namespace
+
 struct shader::impl
 {
     GLuint                                 program_;
@@ -41,6 +95,12 @@ struct shader::impl
     impl(const std::string& vertex_source_str, const std::string& fragment_source_str)
         : program_(0)
     {
+        const auto cached = cache_path(vertex_source_str, fragment_source_str);
+        if (load(cached)) {
+            GL(glUseProgramObjectARB(program_));
+            return;
+        }
+
         GLint success;
 
         const char* vertex_source = vertex_source_str.c_str();
@@ -82,6 +142,10 @@ struct shader::impl
         GL(glAttachObjectARB(program_, vertex_shader));
         GL(glAttachObjectARB(program_, fragmemt_shader));
 
+        if (!cached.empty()) {
+            GL(glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+        }
+
         GL(glLinkProgramARB(program_));
 
         GL(glDeleteObjectARB(vertex_shader));
@@ -97,10 +161,91 @@ struct shader::impl
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(str.str()));
         }
         GL(glUseProgramObjectARB(program_));
+
+        save(cached);
     }
 
     ~impl() { glDeleteProgram(program_); }
 
+    // Binaries are stored as their GLenum format followed by the program. Drivers reject binaries they can no longer
+    // load, those are compiled again and replaced.
+    bool load(const boost::filesystem::path& path)
+    {
+        if (path.empty()) {
+            return false;
+        }
+
+        std::ifstream file(path.string(), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.size() <= sizeof(GLenum)) {
+            return false;
+        }
+
+        GLenum format = 0;
+        std::memcpy(&format, data.data(), sizeof(format));
+
+        program_ = glCreateProgram();
+        glProgramBinary(
+            program_, format, data.data() + sizeof(format), static_cast<GLsizei>(data.size() - sizeof(format)));
+
+        GLint success = GL_FALSE;
+        glGetProgramiv(program_, GL_LINK_STATUS, &success);
+
+        // An unknown format is an error rather than a failed link, which must not reach the next GL check.
+        while (glGetError() != GL_NO_ERROR) {
+            success = GL_FALSE;
+        }
+
+        if (success == GL_FALSE) {
+            glDeleteProgram(program_);
+            program_ = 0;
+            CASPAR_LOG(debug) << L"[shader] Recompiling " << path.wstring() << L", the driver rejected it.";
+            return false;
+        }
+        return true;
+    }
+
+    void save(const boost::filesystem::path& path)
+    {
+        if (path.empty()) {
+            return;
+        }
+
+        GLint size = 0;
+        GL(glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &size));
+        if (size < 1) {
+            return;
+        }
+
+        std::vector<char> data(sizeof(GLenum) + size);
+        GLenum            format = 0;
+        GL(glGetProgramBinary(program_, size, &size, &format, data.data() + sizeof(format)));
+        std::memcpy(data.data(), &format, sizeof(format));
+
+        // Written under a temporary name, devices linking the same program at once each replace the file whole.
+        try {
+            boost::filesystem::create_directories(path.parent_path());
+
+            auto tmp = path;
+            tmp += boost::filesystem::unique_path(".%%%%%%%%.tmp");
+            {
+                std::ofstream file(tmp.string(), std::ios::binary);
+                file.write(data.data(), sizeof(format) + size);
+            }
+            if (boost::filesystem::file_size(tmp) != data.size()) {
+                boost::filesystem::remove(tmp);
+                CASPAR_LOG(warning) << L"[shader] Failed to write " << tmp.wstring() << L".";
+                return;
+            }
+            boost::filesystem::rename(tmp, path);
+        } catch (boost::filesystem::filesystem_error& e) {
+            CASPAR_LOG(warning) << L"[shader] Failed to cache program: " << u16(e.what());
+        }
+    }
+
     GLint get_uniform_location(const char* name)
     {
         auto it = uniform_locations_.find(name);
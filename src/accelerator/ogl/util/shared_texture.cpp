@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shared_texture.h"
+
+#include "texture.h"
+
+#include <common/gl/gl_check.h>
+#include <common/log.h>
+
+#include <GL/glew.h>
+
+#ifdef _MSC_VER
+#include <GL/wglew.h>
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+#include <algorithm>
+#include <map>
+
+#pragma comment(lib, "d3d11.lib")
+#endif
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+#ifdef _MSC_VER
+
+// Producers cycle through a few shared textures, anything beyond this is an old set and the cache starts over.
+const std::size_t MAX_SHARED_TEXTURES = 8;
+
+struct shared_texture_importer::impl
+{
+    struct entry
+    {
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+        GLuint                                  name   = 0;
+        HANDLE                                  object = nullptr;
+        int                                     width  = 0;
+        int                                     height = 0;
+    };
+
+    Microsoft::WRL::ComPtr<ID3D11Device> device_;
+    HANDLE                               interop_ = nullptr;
+    std::map<void*, entry>               entries_;
+
+    impl()
+    {
+        if (!WGLEW_NV_DX_interop2) {
+            CASPAR_LOG(warning) << L"[ogl] WGL_NV_DX_interop2 is not supported, shared textures can't be imported.";
+            return;
+        }
+        if (FAILED(D3D11CreateDevice(nullptr,
+                                     D3D_DRIVER_TYPE_HARDWARE,
+                                     nullptr,
+                                     0,
+                                     nullptr,
+                                     0,
+                                     D3D11_SDK_VERSION,
+                                     device_.GetAddressOf(),
+                                     nullptr,
+                                     nullptr))) {
+            CASPAR_LOG(warning) << L"[ogl] Failed to create a D3D11 device, shared textures can't be imported.";
+            return;
+        }
+        interop_ = wglDXOpenDeviceNV(device_.Get());
+        if (!interop_) {
+            CASPAR_LOG(warning) << L"[ogl] Failed to open the D3D11 device for interop.";
+        }
+    }
+
+    ~impl()
+    {
+        clear();
+        if (interop_) {
+            wglDXCloseDeviceNV(interop_);
+        }
+    }
+
+    void clear()
+    {
+        for (auto& p : entries_) {
+            wglDXUnregisterObjectNV(interop_, p.second.object);
+            GL(glDeleteTextures(1, &p.second.name));
+        }
+        entries_.clear();
+    }
+
+    entry* open(void* handle)
+    {
+        auto it = entries_.find(handle);
+        if (it != entries_.end()) {
+            return &it->second;
+        }
+        if (entries_.size() >= MAX_SHARED_TEXTURES) {
+            clear();
+        }
+
+        entry result;
+        if (FAILED(device_->OpenSharedResource(
+                handle, __uuidof(ID3D11Texture2D), reinterpret_cast<void**>(result.texture.GetAddressOf())))) {
+            return nullptr;
+        }
+
+        D3D11_TEXTURE2D_DESC desc;
+        result.texture->GetDesc(&desc);
+        result.width  = static_cast<int>(desc.Width);
+        result.height = static_cast<int>(desc.Height);
+
+        GL(glGenTextures(1, &result.name));
+        result.object =
+            wglDXRegisterObjectNV(interop_, result.texture.Get(), result.name, GL_TEXTURE_2D, WGL_ACCESS_READ_ONLY_NV);
+        if (!result.object) {
+            GL(glDeleteTextures(1, &result.name));
+            return nullptr;
+        }
+
+        return &(entries_[handle] = std::move(result));
+    }
+
+    bool copy(void* handle, texture& target)
+    {
+        if (!interop_) {
+            return false;
+        }
+        auto entry = open(handle);
+        if (!entry || !wglDXLockObjectsNV(interop_, 1, &entry->object)) {
+            return false;
+        }
+        GL(glCopyImageSubData(entry->name,
+                              GL_TEXTURE_2D,
+                              0,
+                              0,
+                              0,
+                              0,
+                              target.id(),
+                              GL_TEXTURE_2D,
+                              0,
+                              0,
+                              0,
+                              0,
+                              std::min(entry->width, target.width()),
+                              std::min(entry->height, target.height()),
+                              1));
+        wglDXUnlockObjectsNV(interop_, 1, &entry->object);
+        return true;
+    }
+};
+
+#else
+
+struct shared_texture_importer::impl
+{
+    bool copy(void* handle, texture& target) { return false; }
+};
+
+#endif
+
+shared_texture_importer::shared_texture_importer()
+    : impl_(new impl())
+{
+}
+shared_texture_importer::~shared_texture_importer() {}
+bool shared_texture_importer::copy(void* handle, texture& target) { return impl_->copy(handle, target); }
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Opens textures another graphics API shares by handle in the device context. Only D3D11 shared handles on Windows
+// are supported, through WGL_NV_DX_interop2. Used on the device thread only.
+class shared_texture_importer final
+{
+  public:
+    shared_texture_importer();
+    ~shared_texture_importer();
+
+    shared_texture_importer(const shared_texture_importer&) = delete;
+
+    shared_texture_importer& operator=(const shared_texture_importer&) = delete;
+
+    // Copies the shared texture into the target, false when the handle can't be opened.
+    bool copy(void* handle, class texture& target);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
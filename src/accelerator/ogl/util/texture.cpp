@@ -26,12 +26,45 @@
 
 #include <GL/glew.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace caspar { namespace accelerator { namespace ogl {
 
 static GLenum FORMAT[]          = {0, GL_RED, GL_RG, GL_BGR, GL_BGRA};
 static GLenum INTERNAL_FORMAT[] = {0, GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
 static GLenum TYPE[] = {0, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_8_8_8_8_REV};
 
+// Uploads and readbacks of other than unorm16 still use the 8 bit FORMAT and TYPE, GL converts to and from the
+// internal format.
+GLenum upload_format(int stride, texture_precision precision)
+{
+    return precision == texture_precision::unorm16 ? FORMAT[stride / 2] : FORMAT[stride];
+}
+
+GLenum upload_type(int stride, texture_precision precision)
+{
+    return precision == texture_precision::unorm16 ? GL_UNSIGNED_SHORT : TYPE[stride];
+}
+
+GLenum internal_format(int stride, texture_precision precision)
+{
+    switch (precision) {
+        case texture_precision::unorm16:
+            return stride == 4 ? GL_RG16 : GL_R16;
+        case texture_precision::unorm10:
+            return stride == 4 ? GL_RGB10_A2 : stride == 1 ? GL_R16 : INTERNAL_FORMAT[stride];
+        case texture_precision::float16:
+            return stride == 4 ? GL_RGBA16F : stride == 1 ? GL_R16F : INTERNAL_FORMAT[stride];
+        case texture_precision::bc3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case texture_precision::bc7:
+            return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        default:
+            return INTERNAL_FORMAT[stride];
+    }
+}
+
 struct texture::impl
 {
     GLuint  id_     = 0;
@@ -40,25 +73,42 @@ struct texture::impl
     GLsizei stride_ = 0;
     GLsizei size_   = 0;
 
+    // Full mip chain of the texture for minified draws, built on first use and refreshed after each upload.
+    GLuint mip_id_    = 0;
+    bool   mip_dirty_ = true;
+
+    texture_precision precision_;
+
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
 
   public:
-    impl(int width, int height, int stride)
+    impl(int width, int height, int stride, texture_precision precision)
         : width_(width)
         , height_(height)
         , stride_(stride)
         , size_(width * height * stride)
+        , precision_(precision)
     {
         GL(glCreateTextures(GL_TEXTURE_2D, 1, &id_));
         GL(glTextureParameteri(id_, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
         GL(glTextureParameteri(id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        GL(glTextureStorage2D(id_, 1, INTERNAL_FORMAT[stride_], width_, height_));
+        GL(glTextureStorage2D(id_, 1, internal_format(stride_, precision_), width_, height_));
+    }
+
+    ~impl()
+    {
+        glDeleteTextures(1, &id_);
+        if (mip_id_) {
+            glDeleteTextures(1, &mip_id_);
+        }
     }
 
-    ~impl() { glDeleteTextures(1, &id_); }
+    GLenum format() const { return upload_format(stride_, precision_); }
+
+    GLenum type() const { return upload_type(stride_, precision_); }
 
     void bind() { GL(glBindTexture(GL_TEXTURE_2D, id_)); }
 
@@ -68,37 +118,108 @@ struct texture::impl
         bind();
     }
 
+    void bind_mipmaps(int index)
+    {
+        // Compressed formats have no mipmap generation, and still graphics are rarely drawn much smaller.
+        if (is_compressed(precision_)) {
+            bind(index);
+            return;
+        }
+
+        if (!mip_id_) {
+            GLsizei levels = 1;
+            while ((std::max(width_, height_) >> levels) > 0) {
+                ++levels;
+            }
+            GL(glCreateTextures(GL_TEXTURE_2D, 1, &mip_id_));
+            GL(glTextureParameteri(mip_id_, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+            GL(glTextureParameteri(mip_id_, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+            GL(glTextureParameteri(mip_id_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+            GL(glTextureParameteri(mip_id_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+            GL(glTextureStorage2D(mip_id_, levels, internal_format(stride_, precision_), width_, height_));
+        }
+
+        if (mip_dirty_) {
+            GL(glCopyImageSubData(
+                id_, GL_TEXTURE_2D, 0, 0, 0, 0, mip_id_, GL_TEXTURE_2D, 0, 0, 0, 0, width_, height_, 1));
+            GL(glGenerateTextureMipmap(mip_id_));
+            mip_dirty_ = false;
+        }
+
+        GL(glActiveTexture(GL_TEXTURE0 + index));
+        GL(glBindTexture(GL_TEXTURE_2D, mip_id_));
+    }
+
     void unbind() { GL(glBindTexture(GL_TEXTURE_2D, 0)); }
 
-    void attach() { GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0)); }
+    void attach()
+    {
+        GL(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, id_, 0));
+        mip_dirty_ = true;
+    }
 
-    void clear() { GL(glClearTexImage(id_, 0, FORMAT[stride_], TYPE[stride_], nullptr)); }
+    void clear()
+    {
+        if (is_compressed(precision_)) {
+            // Zeroed blocks decode to transparent black in both formats.
+            std::vector<char> blocks(size_);
+            GL(glCompressedTextureSubImage2D(
+                id_, 0, 0, 0, width_, height_, internal_format(stride_, precision_), size_, blocks.data()));
+            mip_dirty_ = true;
+            return;
+        }
+        GL(glClearTexImage(id_, 0, format(), type(), nullptr));
+        mip_dirty_ = true;
+    }
 
     void copy_from(buffer& src)
     {
         src.bind();
 
+        if (is_compressed(precision_)) {
+            GL(glCompressedTextureSubImage2D(
+                id_, 0, 0, 0, width_, height_, internal_format(stride_, precision_), size_, nullptr));
+            src.unbind();
+            return;
+        }
+
         if (width_ % 16 > 0) {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         } else {
             glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
         }
 
-        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, FORMAT[stride_], TYPE[stride_], nullptr));
+        GL(glTextureSubImage2D(id_, 0, 0, 0, width_, height_, format(), type(), nullptr));
+        mip_dirty_ = true;
 
         src.unbind();
     }
 
+    void copy_from(const impl& src)
+    {
+        GL(glCopyImageSubData(src.id_, GL_TEXTURE_2D, 0, 0, 0, 0, id_, GL_TEXTURE_2D, 0, 0, 0, 0, width_, height_, 1));
+        mip_dirty_ = true;
+    }
+
+    void copy_from(const void* data, int x, int y, int width, int height, int row_length)
+    {
+        GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length));
+        GL(glTextureSubImage2D(id_, 0, x, y, width, height, format(), type(), data));
+        GL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+        mip_dirty_ = true;
+    }
+
     void copy_to(buffer& dst)
     {
         dst.bind();
-        GL(glGetTextureImage(id_, 0, FORMAT[stride_], TYPE[stride_], size_, nullptr));
+        GL(glGetTextureImage(id_, 0, format(), type(), size_, nullptr));
         dst.unbind();
     }
 };
 
-texture::texture(int width, int height, int stride)
-    : impl_(new impl(width, height, stride))
+texture::texture(int width, int height, int stride, texture_precision precision)
+    : impl_(new impl(width, height, stride, precision))
 {
 }
 texture::texture(texture&& other)
@@ -112,10 +233,16 @@ texture& texture::operator=(texture&& other)
     return *this;
 }
 void texture::bind(int index) { impl_->bind(index); }
+void texture::bind_mipmaps(int index) { impl_->bind_mipmaps(index); }
 void texture::unbind() { impl_->unbind(); }
 void texture::attach() { impl_->attach(); }
 void texture::clear() { impl_->clear(); }
 void texture::copy_from(buffer& source) { impl_->copy_from(source); }
+void texture::copy_from(const texture& source) { impl_->copy_from(*source.impl_); }
+void texture::copy_from(const void* data, int x, int y, int width, int height, int row_length)
+{
+    impl_->copy_from(data, x, y, width, height, row_length);
+}
 void texture::copy_to(buffer& dest) { impl_->copy_to(dest); }
 int  texture::width() const { return impl_->width_; }
 int  texture::height() const { return impl_->height_; }
@@ -123,4 +250,6 @@ int  texture::stride() const { return impl_->stride_; }
 int  texture::size() const { return impl_->width_ * impl_->height_ * impl_->stride_; }
 int  texture::id() const { return impl_->id_; }
 
+texture_precision texture::precision() const { return impl_->precision_; }
+
 }}} // namespace caspar::accelerator::ogl
@@ -25,10 +25,27 @@
 
 namespace caspar { namespace accelerator { namespace ogl {
 
+// Internal precision of single and four channel textures, used for the mixer's intermediate targets. The block
+// compressed formats are single channel by stride, a byte per pixel, and uploaded as is.
+enum class texture_precision
+{
+    unorm8 = 0,
+    unorm10, // RGB10_A2, only 2 bits of alpha.
+    float16,
+    bc3,     // DXT5
+    bc7,     // BPTC
+    unorm16, // 16 bit samples, stride is still in bytes, 2 for R16 and 4 for RG16.
+};
+
+inline bool is_compressed(texture_precision precision)
+{
+    return precision == texture_precision::bc3 || precision == texture_precision::bc7;
+}
+
 class texture final
 {
   public:
-    texture(int width, int height, int stride);
+    texture(int width, int height, int stride, texture_precision precision = texture_precision::unorm8);
     texture(const texture&) = delete;
     texture(texture&& other);
     ~texture();
@@ -37,16 +54,23 @@ class texture final
     texture& operator                  =(texture&& other);
 
     void copy_from(class buffer& source);
+    // Copies a texture of the same size and format on the GPU.
+    void copy_from(const texture& source);
+    // Uploads a region from client memory whose rows are row_length pixels apart.
+    void copy_from(const void* data, int x, int y, int width, int height, int row_length);
     void copy_to(class buffer& dest);
 
     void attach();
     void clear();
     void bind(int index);
+    // Binds a mipmapped copy for minified sampling, regenerated after the texture changes.
+    void bind_mipmaps(int index);
     void unbind();
 
     int width() const;
     int height() const;
     int stride() const;
+    texture_precision precision() const;
     int size() const;
     int id() const;
 
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+#include "timer_query.h"
+
+#include "device.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+struct timer_query::impl
+{
+    std::weak_ptr<device> ogl_;
+    std::vector<GLuint>   free_;
+    std::deque<GLuint>    pending_;
+    GLuint                active_ = 0;
+    double                sum_ms_ = 0.0;
+    std::atomic<double>   elapsed_ms_{0.0};
+
+    explicit impl(const std::shared_ptr<device>& ogl)
+        : ogl_(ogl)
+    {
+    }
+
+    ~impl()
+    {
+        std::vector<GLuint> queries(free_.begin(), free_.end());
+        queries.insert(queries.end(), pending_.begin(), pending_.end());
+        if (active_) {
+            queries.push_back(active_);
+        }
+
+        auto ogl = ogl_.lock();
+        if (ogl && !queries.empty()) {
+            ogl->dispatch_async([queries] { glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data()); });
+        }
+    }
+
+    void begin()
+    {
+        if (free_.empty()) {
+            GLuint query = 0;
+            GL(glGenQueries(1, &query));
+            free_.push_back(query);
+        }
+
+        active_ = free_.back();
+        free_.pop_back();
+
+        GL(glBeginQuery(GL_TIME_ELAPSED, active_));
+    }
+
+    void end()
+    {
+        if (!active_) {
+            return;
+        }
+
+        GL(glEndQuery(GL_TIME_ELAPSED));
+        pending_.push_back(active_);
+        active_ = 0;
+    }
+
+    void frame()
+    {
+        // Queries complete in order, so stop at the first one that isn't done.
+        while (!pending_.empty()) {
+            GLint available = 0;
+            GL(glGetQueryObjectiv(pending_.front(), GL_QUERY_RESULT_AVAILABLE, &available));
+            if (!available) {
+                break;
+            }
+
+            GLuint64 elapsed = 0;
+            GL(glGetQueryObjectui64v(pending_.front(), GL_QUERY_RESULT, &elapsed));
+            sum_ms_ += static_cast<double>(elapsed) / 1000000.0;
+
+            free_.push_back(pending_.front());
+            pending_.pop_front();
+        }
+
+        elapsed_ms_ = sum_ms_;
+        sum_ms_     = 0.0;
+    }
+};
+
+timer_query::timer_query(const std::shared_ptr<device>& ogl)
+    : impl_(new impl(ogl))
+{
+}
+timer_query::~timer_query() {}
+void   timer_query::begin() { impl_->begin(); }
+void   timer_query::end() { impl_->end(); }
+void   timer_query::frame() { impl_->frame(); }
+double timer_query::elapsed_ms() const { return impl_->elapsed_ms_; }
+
+}}} // namespace caspar::accelerator::ogl
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Author: Robert Nagy, ronag89@gmail.com
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace caspar { namespace accelerator { namespace ogl {
+
+// Measures GPU time with GL_TIME_ELAPSED queries without waiting for their results. begin, end and frame must be
+// called on the device thread, and measurements must not overlap.
+class timer_query final
+{
+  public:
+    explicit timer_query(const std::shared_ptr<class device>& ogl);
+    timer_query(const timer_query&) = delete;
+    ~timer_query();
+
+    timer_query& operator=(const timer_query&) = delete;
+
+    void begin();
+    void end();
+
+    // Collects finished measurements and publishes their sum since the previous call.
+    void frame();
+
+    double elapsed_ms() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}}} // namespace caspar::accelerator::ogl
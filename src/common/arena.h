@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace caspar {
+
+// Monotonic allocator for objects that all die together, e.g. everything a channel builds for one tick.
+// Deallocation is a no-op; reset() rewinds the arena and, once it has grown, keeps a single block large
+// enough for a whole tick so that steady state does not touch the heap at all.
+class arena final
+{
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+    struct block
+    {
+        std::unique_ptr<char[]> data;
+        std::size_t             size;
+    };
+
+    std::vector<block> blocks_;
+    std::size_t        used_       = 0;
+    std::size_t        block_size_ = 0;
+
+  public:
+    explicit arena(std::size_t block_size = 64 * 1024)
+        : block_size_(block_size)
+    {
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment)
+    {
+        auto offset = (used_ + alignment - 1) & ~(alignment - 1);
+        if (blocks_.empty() || offset + size > blocks_.back().size) {
+            auto block_size = std::max(block_size_, size + alignment);
+            blocks_.push_back(block{std::unique_ptr<char[]>(new char[block_size]), block_size});
+            offset = 0;
+        }
+        used_ = offset + size;
+        return blocks_.back().data.get() + offset;
+    }
+
+    void reset()
+    {
+        if (blocks_.size() > 1) {
+            std::size_t total = 0;
+            for (auto& b : blocks_) {
+                total += b.size;
+            }
+            blocks_.clear();
+            block_size_ = total;
+        }
+        used_ = 0;
+    }
+};
+
+template <typename T>
+class arena_allocator
+{
+    template <typename>
+    friend class arena_allocator;
+
+    arena* arena_ = nullptr;
+
+  public:
+    using value_type = T;
+
+    // Falls back to the heap so that containers using this allocator stay default constructible.
+    arena_allocator() = default;
+
+    arena_allocator(arena& a)
+        : arena_(&a)
+    {
+    }
+
+    template <typename T2>
+    arena_allocator(const arena_allocator<T2>& other)
+        : arena_(other.arena_)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (!arena_) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        if (!arena_) {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename T2>
+    bool operator==(const arena_allocator<T2>& other) const
+    {
+        return arena_ == other.arena_;
+    }
+
+    template <typename T2>
+    bool operator!=(const arena_allocator<T2>& other) const
+    {
+        return arena_ != other.arena_;
+    }
+};
+
+// Hands out arenas that nothing else references anymore. Objects allocated from an arena must hold on to the
+// returned pointer for as long as they live, so that it is not reset underneath a frame still in flight on
+// another pipeline stage. Not thread safe, acquire() is meant to be called from a single thread.
+class arena_pool final
+{
+    arena_pool(const arena_pool&);
+    arena_pool& operator=(const arena_pool&);
+
+    std::vector<std::shared_ptr<arena>> arenas_;
+
+  public:
+    arena_pool() = default;
+
+    std::shared_ptr<arena> acquire()
+    {
+        for (auto& a : arenas_) {
+            if (a.use_count() == 1) {
+                // Pairs with the release in the last holder's shared_ptr destructor, so everything it destroyed
+                // in the arena happens before the reset.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                a->reset();
+                return a;
+            }
+        }
+        arenas_.push_back(std::make_shared<arena>());
+        return arenas_.back();
+    }
+};
+
+} // namespace caspar
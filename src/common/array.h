@@ -1,9 +1,11 @@
 #pragma once
 
+#include "os/memory.h"
+
 #include <boost/any.hpp>
 
 #include <cstddef>
-#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -25,7 +27,7 @@ class array final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
+            auto storage = alloc_large_buffer(size);
             ptr_         = reinterpret_cast<T*>(storage.get());
             std::memset(ptr_, 0, size_);
             storage_ = std::make_shared<boost::any>(std::move(storage));
@@ -102,7 +104,7 @@ class array<const T> final
         : size_(size)
     {
         if (size_ > 0) {
-            auto storage = std::shared_ptr<void>(std::malloc(size), std::free);
+            auto storage = alloc_large_buffer(size);
             ptr_         = reinterpret_cast<T*>(storage.get());
             std::memset(ptr_, 0, size_);
             storage_ = std::make_shared<boost::any>(storage);
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "destroyer.h"
+
+#include "log.h"
+#include "os/thread.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar {
+
+using destroyer_clock = std::chrono::steady_clock;
+
+struct destroyer::impl
+{
+    struct job
+    {
+        std::wstring          what;
+        std::function<void()> task;
+    };
+
+    struct worker
+    {
+        std::wstring                what;
+        destroyer_clock::time_point started;
+        bool                        busy    = false;
+        bool                        overdue = false;
+    };
+
+    const std::wstring              name_;
+    const int                       workers_;
+    const std::chrono::milliseconds deadline_;
+
+    mutable std::mutex       mutex_;
+    std::condition_variable  cond_;
+    std::deque<job>          queue_;
+    std::list<worker>        state_;
+    std::vector<std::thread> threads_;
+    std::size_t              idle_     = 0;
+    bool                     stopping_ = false;
+
+    impl(std::wstring name, int workers, std::chrono::milliseconds deadline)
+        : name_(std::move(name))
+        , workers_(std::max(1, workers))
+        , deadline_(deadline)
+    {
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void post(std::wstring what, std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(job{std::move(what), std::move(task)});
+
+            const auto now    = destroyer_clock::now();
+            auto       active = 0;
+            for (auto& w : state_) {
+                if (w.busy && !w.overdue && now - w.started > deadline_) {
+                    w.overdue = true;
+                    CASPAR_LOG(warning) << name_ << L" " << w.what << L" is still being destroyed after "
+                                        << deadline_.count() << L" ms.";
+                }
+                if (!w.overdue) {
+                    ++active;
+                }
+            }
+
+            // Workers are started as the queue needs them, overdue ones are replaced up to a limit.
+            if (queue_.size() > idle_ && active < workers_ && state_.size() < static_cast<std::size_t>(workers_) * 4) {
+                state_.emplace_back();
+                auto& w = state_.back();
+                ++idle_;
+                threads_.emplace_back([this, &w] { run(w); });
+            }
+        }
+        cond_.notify_one();
+    }
+
+    void run(worker& w)
+    {
+        set_thread_name(name_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+
+            auto next = std::move(queue_.front());
+            queue_.pop_front();
+            --idle_;
+            w.busy    = true;
+            w.what    = next.what;
+            w.started = destroyer_clock::now();
+            lock.unlock();
+
+            try {
+                next.task();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+            next = job{};
+
+            lock.lock();
+            const auto elapsed = destroyer_clock::now() - w.started;
+            if (elapsed > deadline_) {
+                CASPAR_LOG(warning) << name_ << L" " << w.what << L" took "
+                                    << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+                                    << L" ms to destroy.";
+            }
+            w.busy    = false;
+            w.overdue = false;
+            ++idle_;
+        }
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto result = queue_.size();
+        for (auto& w : state_) {
+            result += w.busy ? 1 : 0;
+        }
+        return result;
+    }
+};
+
+destroyer::destroyer(std::wstring name, int workers, std::chrono::milliseconds deadline)
+    : impl_(new impl(std::move(name), workers, deadline))
+{
+}
+
+destroyer::~destroyer() {}
+
+void destroyer::post(std::wstring what, std::function<void()> task) { impl_->post(std::move(what), std::move(task)); }
+
+std::size_t destroyer::size() const { return impl_->size(); }
+
+} // namespace caspar
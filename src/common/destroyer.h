@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace caspar {
+
+// Tears down producers and consumers on a pool of threads, so that the thread dropping one does not wait for it. The
+// queue is unbounded and up to workers tasks run at once. A task still running after deadline is reported and no
+// longer counts as a worker, another one is started so that a hung teardown does not hold up the rest.
+class destroyer final
+{
+    destroyer(const destroyer&);
+    destroyer& operator=(const destroyer&);
+
+  public:
+    destroyer(std::wstring name, int workers, std::chrono::milliseconds deadline);
+
+    // Waits for the queued tasks to run.
+    ~destroyer();
+
+    // what names the task in the log.
+    void post(std::wstring what, std::function<void()> task);
+
+    // Tasks queued or running.
+    std::size_t size() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} // namespace caspar
@@ -44,6 +44,10 @@ std::tuple<float, float, float, float> color(int code)
     return std::make_tuple(r, g, b, a);
 }
 
+namespace detail {
+std::atomic<int> g_visible_sinks{0};
+}
+
 using sink_factories_t = std::vector<spi::sink_factory_t>;
 static std::mutex       g_sink_factories_mutex;
 static sink_factories_t g_sink_factories;
@@ -113,9 +117,9 @@ graph::graph()
 }
 
 void graph::set_text(const std::wstring& value) { impl_->set_text(value); }
-void graph::set_value(const std::string& name, double value) { impl_->set_value(name, value); }
+void graph::do_set_value(const std::string& name, double value) { impl_->set_value(name, value); }
 void graph::set_color(const std::string& name, int color) { impl_->set_color(name, color); }
-void graph::set_tag(tag_severity severity, const std::string& name) { impl_->set_tag(severity, name); }
+void graph::do_set_tag(tag_severity severity, const std::string& name) { impl_->set_tag(severity, name); }
 void graph::auto_reset() { impl_->auto_reset(); }
 
 void register_graph(const spl::shared_ptr<graph>& graph) { graph->impl_->activate(); }
@@ -129,6 +133,15 @@ void register_sink_factory(sink_factory_t factory)
     g_sink_factories.push_back(std::move(factory));
 }
 
+void set_sink_visible(bool visible)
+{
+    if (visible) {
+        ++detail::g_visible_sinks;
+    } else {
+        --detail::g_visible_sinks;
+    }
+}
+
 } // namespace spi
 
 }} // namespace caspar::diagnostics
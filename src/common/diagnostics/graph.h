@@ -23,6 +23,7 @@
 
 #include "../memory.h"
 
+#include <atomic>
 #include <functional>
 #include <string>
 #include <tuple>
@@ -39,6 +40,10 @@ enum class tag_severity
     SILENT,
 };
 
+namespace detail {
+extern std::atomic<int> g_visible_sinks;
+}
+
 class graph
 {
     friend void register_graph(const spl::shared_ptr<graph>& graph);
@@ -46,12 +51,33 @@ class graph
   public:
     graph();
     void set_text(const std::wstring& value);
-    void set_value(const std::string& name, double value);
     void set_color(const std::string& name, int color);
-    void set_tag(tag_severity severity, const std::string& name);
     void auto_reset();
 
+    // Values and tags are sent every tick. While no sink shows graphs they are dropped here, before the name is
+    // even turned into a string.
+    static bool is_visible() { return detail::g_visible_sinks.load(std::memory_order_relaxed) > 0; }
+
+    template <typename Name>
+    void set_value(const Name& name, double value)
+    {
+        if (is_visible()) {
+            do_set_value(name, value);
+        }
+    }
+
+    template <typename Name>
+    void set_tag(tag_severity severity, const Name& name)
+    {
+        if (is_visible()) {
+            do_set_tag(severity, name);
+        }
+    }
+
   private:
+    void do_set_value(const std::string& name, double value);
+    void do_set_tag(tag_severity severity, const std::string& name);
+
     struct impl;
     std::shared_ptr<impl> impl_;
 
@@ -82,6 +108,9 @@ class graph_sink
 using sink_factory_t = std::function<spl::shared_ptr<graph_sink>()>;
 void register_sink_factory(sink_factory_t factory);
 
+// Sinks report when they start and stop showing graphs, graphs only send values and tags while one does.
+void set_sink_visible(bool visible);
+
 } // namespace spi
 
 }} // namespace caspar::diagnostics
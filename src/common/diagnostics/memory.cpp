@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memory.h"
+
+#include "../log.h"
+#include "../os/thread.h"
+#include "../utf.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace diagnostics { namespace memory {
+
+namespace {
+
+std::mutex& registry_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::map<std::string, std::unique_ptr<counter>>& registry()
+{
+    static std::map<std::string, std::unique_ptr<counter>> counters;
+    return counters;
+}
+
+double megabytes(std::int64_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+} // namespace
+
+void counter::add(std::int64_t bytes)
+{
+    const auto current = current_ += bytes;
+
+    auto peak = peak_.load();
+    while (current > peak && !peak_.compare_exchange_weak(peak, current)) {
+    }
+}
+
+counter& get(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+
+    auto& result = registry()[name];
+    if (!result) {
+        result = std::make_unique<counter>();
+    }
+    return *result;
+}
+
+held_bytes::held_bytes(const std::string& name)
+    : counter_(&get(name))
+{
+}
+
+held_bytes::~held_bytes() { counter_->add(-bytes_); }
+
+void held_bytes::add(std::int64_t bytes)
+{
+    bytes_ += bytes;
+    counter_->add(bytes);
+}
+
+void held_bytes::set(std::int64_t bytes) { counter_->add(bytes - bytes_.exchange(bytes)); }
+
+std::vector<usage> snapshot()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+
+    std::vector<usage> result;
+    for (auto& p : registry()) {
+        result.push_back(usage{p.first, p.second->current(), p.second->peak()});
+    }
+    return result;
+}
+
+std::shared_ptr<void> log_periodically(std::chrono::seconds interval)
+{
+    struct logger
+    {
+        std::mutex              mutex;
+        std::condition_variable cond;
+        bool                    stop = false;
+        std::thread             thread;
+
+        ~logger()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            cond.notify_all();
+            thread.join();
+        }
+    };
+
+    auto result    = std::make_shared<logger>();
+    result->thread = std::thread([self = result.get(), interval] {
+        set_thread_name(L"memory-log");
+
+        std::unique_lock<std::mutex> lock(self->mutex);
+        while (!self->cond.wait_for(lock, interval, [&] { return self->stop; })) {
+            for (auto& u : snapshot()) {
+                CASPAR_LOG(info) << L"[memory] " << u16(u.name) << L" " << megabytes(u.current) << L" MB (peak "
+                                 << megabytes(u.peak) << L" MB)";
+            }
+        }
+    });
+    return result;
+}
+
+}}} // namespace caspar::diagnostics::memory
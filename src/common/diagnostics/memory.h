@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace memory {
+
+// Bytes held by the pools, queues and buffers of the server, by subsystem, to find what grows over a long uptime
+// without a heap profiler. All instances of a subsystem add to the counter of its name, such as "ogl/texture-pool".
+
+class counter final
+{
+    std::atomic<std::int64_t> current_{0};
+    std::atomic<std::int64_t> peak_{0};
+
+  public:
+    // Negative for bytes released.
+    void add(std::int64_t bytes);
+
+    std::int64_t current() const { return current_; }
+    std::int64_t peak() const { return peak_; } // Since startup.
+};
+
+// The counter of a subsystem, created on first use and kept until exit.
+counter& get(const std::string& name);
+
+// The bytes one holder has in the counter of its subsystem, taken off again when it is destroyed.
+class held_bytes final
+{
+    counter*                  counter_;
+    std::atomic<std::int64_t> bytes_{0};
+
+    held_bytes(const held_bytes&) = delete;
+    held_bytes& operator=(const held_bytes&) = delete;
+
+  public:
+    explicit held_bytes(const std::string& name);
+    ~held_bytes();
+
+    void add(std::int64_t bytes);
+    void set(std::int64_t bytes);
+};
+
+struct usage
+{
+    std::string  name;
+    std::int64_t current;
+    std::int64_t peak;
+};
+
+// All counters, by name.
+std::vector<usage> snapshot();
+
+// Logs the counters every interval for as long as the returned token is alive.
+std::shared_ptr<void> log_periodically(std::chrono::seconds interval);
+
+}}} // namespace caspar::diagnostics::memory
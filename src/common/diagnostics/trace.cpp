@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include "../utf.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+namespace {
+
+// Events kept per thread, some seconds of a channel thread.
+const std::uint64_t capacity = 4096;
+
+struct event
+{
+    char         name[32];
+    char         track[24];
+    std::int64_t frame;
+    std::int64_t begin;
+    std::int64_t end;
+};
+
+// Open scopes kept per thread, deeper ones are only counted.
+const int max_depth = 8;
+
+struct open_scope
+{
+    std::atomic<const char*>  name{nullptr};
+    std::atomic<int>          channel{-1};
+    std::atomic<std::int64_t> frame{-1};
+    std::atomic<std::int64_t> detail{-1};
+    std::atomic<std::int64_t> begin{0};
+};
+
+// Written only by its thread. head counts the events ever recorded, the slot of the next one is head % capacity.
+// depth counts the open scopes, a slot is filled before depth is raised past it.
+struct thread_buffer
+{
+    int                               id;
+    std::vector<event>                events = std::vector<event>(capacity);
+    std::atomic<std::uint64_t>        head{0};
+    std::atomic<bool>                 exited{false};
+    std::array<open_scope, max_depth> open;
+    std::atomic<int>                  depth{0};
+
+    std::mutex  name_mutex;
+    std::string name;
+};
+
+std::mutex                                  g_buffers_mutex;
+std::vector<std::shared_ptr<thread_buffer>> g_buffers;
+
+// Buffers of exited threads are kept for this long after their last event.
+const std::int64_t exited_retention = 60 * 1000000;
+
+struct thread_slot
+{
+    std::shared_ptr<thread_buffer> buffer;
+
+    ~thread_slot()
+    {
+        if (buffer) {
+            buffer->exited = true;
+        }
+    }
+};
+
+thread_local std::string  t_name;
+thread_local std::int64_t t_frame   = -1;
+thread_local int          t_channel = -1;
+thread_local thread_slot  t_slot;
+
+int g_next_id = 1;
+
+thread_buffer& buffer_for_thread()
+{
+    if (!t_slot.buffer) {
+        auto buffer  = std::make_shared<thread_buffer>();
+        buffer->name = t_name;
+
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+
+        // Threads come and go with producers and consumers, so the buffers of those long gone are dropped here.
+        const auto expired = now() - exited_retention;
+        g_buffers.erase(std::remove_if(g_buffers.begin(),
+                                       g_buffers.end(),
+                                       [&](const std::shared_ptr<thread_buffer>& other) {
+                                           auto head = other->head.load();
+                                           return other->exited &&
+                                                  (head == 0 || other->events[(head - 1) % capacity].end < expired);
+                                       }),
+                        g_buffers.end());
+
+        buffer->id = g_next_id++;
+        g_buffers.push_back(buffer);
+        t_slot.buffer = std::move(buffer);
+    }
+    return *t_slot.buffer;
+}
+
+void copy_name(char* target, std::size_t size, const char* source)
+{
+    std::strncpy(target, source ? source : "", size - 1);
+    target[size - 1] = '\0';
+}
+
+void write_string(std::ostringstream& out, const std::string& str)
+{
+    out << '"';
+    for (auto c : str) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void write_thread_name(std::ostringstream& out, int tid, const std::string& name)
+{
+    out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+    write_string(out, name);
+    out << "}}";
+}
+
+} // namespace
+
+std::int64_t now()
+{
+    using namespace std::chrono;
+
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void record(const char* name, std::int64_t frame, std::int64_t begin, std::int64_t end, const char* track)
+{
+    auto& buffer = buffer_for_thread();
+    auto  head   = buffer.head.load(std::memory_order_relaxed);
+    auto& e      = buffer.events[head % capacity];
+
+    copy_name(e.name, sizeof(e.name), name);
+    copy_name(e.track, sizeof(e.track), track);
+    e.frame = frame;
+    e.begin = begin;
+    e.end   = end;
+
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+std::int64_t current_frame() { return t_frame; }
+
+int current_channel() { return t_channel; }
+
+scoped_frame::scoped_frame(std::int64_t frame, int channel)
+    : saved_frame_(t_frame)
+    , saved_channel_(t_channel)
+{
+    t_frame   = frame;
+    t_channel = channel;
+}
+
+scoped_frame::~scoped_frame()
+{
+    t_frame   = saved_frame_;
+    t_channel = saved_channel_;
+}
+
+std::int64_t enter(const char* name, std::int64_t frame, std::int64_t detail)
+{
+    auto& buffer = buffer_for_thread();
+    auto  depth  = buffer.depth.load(std::memory_order_relaxed);
+    auto  begin  = now();
+
+    if (depth < max_depth) {
+        auto& s = buffer.open[depth];
+        s.name.store(name, std::memory_order_relaxed);
+        s.channel.store(t_channel, std::memory_order_relaxed);
+        s.frame.store(frame, std::memory_order_relaxed);
+        s.detail.store(detail, std::memory_order_relaxed);
+        s.begin.store(begin, std::memory_order_relaxed);
+    }
+    buffer.depth.store(depth + 1, std::memory_order_release);
+
+    return begin;
+}
+
+void leave(const char* name, std::int64_t frame, std::int64_t begin)
+{
+    auto& buffer = buffer_for_thread();
+    buffer.depth.store(buffer.depth.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+
+    record(name, frame, begin, now());
+}
+
+void set_thread_name(const std::wstring& name)
+{
+    t_name = u8(name);
+
+    // Threads that have not recorded yet take the name when they create their buffer.
+    if (t_slot.buffer) {
+        std::lock_guard<std::mutex> lock(t_slot.buffer->name_mutex);
+        t_slot.buffer->name = t_name;
+    }
+}
+
+std::vector<event_info> collect(double seconds)
+{
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+        buffers = g_buffers;
+    }
+
+    const auto since = now() - static_cast<std::int64_t>(seconds * 1e6);
+
+    std::vector<event_info> result;
+    for (auto& buffer : buffers) {
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(buffer->name_mutex);
+            name = buffer->name.empty() ? "thread " + std::to_string(buffer->id) : buffer->name;
+        }
+
+        // Copied without stopping the thread, events it may have overwritten meanwhile are left out.
+        auto head   = buffer->head.load(std::memory_order_acquire);
+        auto first  = head > capacity ? head - capacity : 0;
+        auto events = std::vector<event>();
+        events.reserve(static_cast<std::size_t>(head - first));
+        for (auto n = first; n < head; ++n) {
+            events.push_back(buffer->events[n % capacity]);
+        }
+        auto after = buffer->head.load(std::memory_order_acquire);
+        auto valid = after >= capacity ? after - capacity + 1 : 0;
+
+        for (auto n = std::max(first, valid); n < head; ++n) {
+            auto& e = events[static_cast<std::size_t>(n - first)];
+            if (e.end >= since) {
+                result.push_back(event_info{e.name, name, e.track, buffer->id, e.frame, e.begin, e.end});
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<scope_info> running()
+{
+    std::vector<std::shared_ptr<thread_buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+        buffers = g_buffers;
+    }
+
+    std::vector<scope_info> result;
+    for (auto& buffer : buffers) {
+        auto depth = std::min(buffer->depth.load(std::memory_order_acquire), max_depth);
+        if (depth <= 0 || buffer->exited) {
+            continue;
+        }
+
+        std::string name;
+        {
+            std::lock_guard<std::mutex> lock(buffer->name_mutex);
+            name = buffer->name.empty() ? "thread " + std::to_string(buffer->id) : buffer->name;
+        }
+
+        for (int n = 0; n < depth; ++n) {
+            auto& s = buffer->open[n];
+            result.push_back(scope_info{s.name.load(std::memory_order_relaxed),
+                                        name,
+                                        buffer->id,
+                                        n,
+                                        s.channel.load(std::memory_order_relaxed),
+                                        s.frame.load(std::memory_order_relaxed),
+                                        s.detail.load(std::memory_order_relaxed),
+                                        s.begin.load(std::memory_order_relaxed)});
+        }
+    }
+    return result;
+}
+
+std::string export_json(double seconds)
+{
+    std::ostringstream out;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"casparcg\"}}";
+
+    auto events = collect(seconds);
+
+    // Tracks get ids after those of the threads.
+    auto next_track = 1;
+    for (auto& e : events) {
+        next_track = std::max(next_track, e.thread_id + 1);
+    }
+
+    std::map<std::pair<int, std::string>, int> threads;
+    for (auto& e : events) {
+        auto key = std::make_pair(e.thread_id, e.track);
+        auto it  = threads.find(key);
+        if (it == threads.end()) {
+            it = threads.emplace(key, e.track.empty() ? e.thread_id : next_track++).first;
+            write_thread_name(out, it->second, e.track.empty() ? e.thread : e.thread + " / " + e.track);
+        }
+
+        out << ",\n{\"name\":";
+        write_string(out, e.name);
+        out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << it->second << ",\"ts\":" << e.begin
+            << ",\"dur\":" << std::max<std::int64_t>(0, e.end - e.begin);
+        if (e.frame >= 0) {
+            out << ",\"args\":{\"frame\":" << e.frame << "}";
+        }
+        out << "}";
+    }
+
+    out << "\n]}\n";
+    return out.str();
+}
+
+}}} // namespace caspar::diagnostics::trace
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace diagnostics { namespace trace {
+
+// Begin and end of the stages frames pass through, each tagged with the sequence number of its frame. Every thread
+// keeps its most recent events in a ring of its own, recording takes no lock. The rings are exported in the trace event
+// format that chrome://tracing and Perfetto open.
+
+// Microseconds on the steady clock, the time base of all events.
+std::int64_t now();
+
+// Records an event of the calling thread that ran from begin to end, names are cut to 31 and tracks to 23 characters.
+// Events with a track are shown apart from those of the thread, for work the thread only waits on such as a
+// consumer's send.
+void record(const char* name, std::int64_t frame, std::int64_t begin, std::int64_t end, const char* track = nullptr);
+
+// Sequence number of the frame the calling thread works on, -1 for none. Events are tagged with it by default.
+std::int64_t current_frame();
+
+// Channel the calling thread works for, -1 for none. Open scopes are tagged with it, see running.
+int current_channel();
+
+class scoped_frame
+{
+    std::int64_t saved_frame_;
+    int          saved_channel_;
+
+    scoped_frame(const scoped_frame&) = delete;
+    scoped_frame& operator=(const scoped_frame&) = delete;
+
+  public:
+    explicit scoped_frame(std::int64_t frame, int channel = current_channel());
+    ~scoped_frame();
+};
+
+// Marks a scope of the calling thread as open until the matching leave, which records it as an event. Returns the
+// begin. Only the innermost 8 scopes of a thread are kept open, deeper ones are recorded all the same.
+std::int64_t enter(const char* name, std::int64_t frame, std::int64_t detail);
+void         leave(const char* name, std::int64_t frame, std::int64_t begin);
+
+// Records the lifetime of the scope as an event. The detail tells which of several alike scopes it is, such as the
+// index of a layer or a consumer port, -1 for none.
+class scope
+{
+    const char*  name_;
+    std::int64_t frame_;
+    std::int64_t begin_;
+
+    scope(const scope&) = delete;
+    scope& operator=(const scope&) = delete;
+
+  public:
+    explicit scope(const char* name, std::int64_t frame = current_frame(), std::int64_t detail = -1)
+        : name_(name)
+        , frame_(frame)
+        , begin_(enter(name, frame, detail))
+    {
+    }
+
+    ~scope() { leave(name_, frame_, begin_); }
+};
+
+// Names the calling thread in exported traces, see set_thread_name.
+void set_thread_name(const std::wstring& name);
+
+struct event_info
+{
+    std::string  name;
+    std::string  thread;
+    std::string  track; // Empty for events of the thread itself.
+    int          thread_id;
+    std::int64_t frame;
+    std::int64_t begin;
+    std::int64_t end;
+};
+
+// The events that ended within the last seconds, of each thread in the order they were recorded.
+std::vector<event_info> collect(double seconds);
+
+struct scope_info
+{
+    std::string  name;
+    std::string  thread;
+    int          thread_id;
+    int          depth; // 0 for the outermost open scope of the thread.
+    int          channel;
+    std::int64_t frame;
+    std::int64_t detail;
+    std::int64_t begin;
+};
+
+// The scopes open on each thread right now, outermost first. Sampled without stopping the threads, so a scope entered
+// or left meanwhile may be missing or reported with the begin of the next one.
+std::vector<scope_info> running();
+
+// The events that ended within the last seconds, as trace event JSON.
+std::string export_json(double seconds);
+
+}}} // namespace caspar::diagnostics::trace
@@ -41,6 +41,7 @@ std::wstring                 media;
 std::wstring                 log;
 std::wstring                 ftemplate;
 std::wstring                 data;
+std::wstring                 config_file;
 boost::property_tree::wptree pt;
 
 void check_is_configured()
@@ -95,7 +96,9 @@ void configure(const std::wstring& filename)
     try {
         initial = clean_path(boost::filesystem::initial_path().wstring());
 
-        boost::filesystem::wifstream file(initial + L"/" + filename);
+        config_file = initial + L"/" + filename;
+
+        boost::filesystem::wifstream file(config_file);
         boost::property_tree::read_xml(file,
                                        pt,
                                        boost::property_tree::xml_parser::trim_whitespace |
@@ -162,6 +165,12 @@ const std::wstring& version()
     return ver;
 }
 
+const std::wstring& configuration_file()
+{
+    check_is_configured();
+    return config_file;
+}
+
 const boost::property_tree::wptree& properties()
 {
     check_is_configured();
@@ -36,6 +36,9 @@ const std::wstring& template_folder();
 const std::wstring& data_folder();
 const std::wstring& version();
 
+// The file configure() read, to read again when channels are reloaded.
+const std::wstring& configuration_file();
+
 const boost::property_tree::wptree& properties();
 
 void log_configuration_warnings();
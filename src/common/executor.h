@@ -25,26 +25,163 @@
 #include "log.h"
 #include "os/thread.h"
 
-#include <tbb/concurrent_queue.h>
-
 #include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <functional>
 #include <future>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace caspar {
 
+namespace detail {
+
+// Move-only callable. Small callables, which covers the typical promise plus a few captures, are stored inline
+// so that queueing them does not allocate.
+class task final
+{
+    struct concept_t
+    {
+        virtual ~concept_t() {}
+        virtual void       operator()()           = 0;
+        virtual concept_t* move_to(void* storage) = 0;
+    };
+
+    template <typename F>
+    struct model final : concept_t
+    {
+        F func;
+
+        template <typename F2>
+        explicit model(F2&& func)
+            : func(std::forward<F2>(func))
+        {
+        }
+
+        void       operator()() override { func(); }
+        concept_t* move_to(void* storage) override { return new (storage) model(std::move(func)); }
+    };
+
+    std::aligned_storage<96>::type storage_;
+    concept_t*                     impl_ = nullptr;
+
+    bool is_inline() const { return impl_ == reinterpret_cast<const concept_t*>(&storage_); }
+
+    void reset()
+    {
+        if (is_inline()) {
+            impl_->~concept_t();
+        } else {
+            delete impl_;
+        }
+        impl_ = nullptr;
+    }
+
+    template <typename M, typename F>
+    void construct(F&& func, std::true_type)
+    {
+        impl_ = new (&storage_) M(std::forward<F>(func));
+    }
+
+    template <typename M, typename F>
+    void construct(F&& func, std::false_type)
+    {
+        impl_ = new M(std::forward<F>(func));
+    }
+
+  public:
+    task() = default;
+
+    template <typename F, typename = typename std::enable_if<!std::is_same<std::decay_t<F>, task>::value>::type>
+    task(F&& func)
+    {
+        using model_t = model<std::decay_t<F>>;
+
+        construct<model_t>(std::forward<F>(func),
+                           std::integral_constant<bool,
+                                                  sizeof(model_t) <= sizeof(storage_) &&
+                                                      std::is_nothrow_move_constructible<std::decay_t<F>>::value>());
+    }
+
+    task(task&& other) { *this = std::move(other); }
+
+    task& operator=(task&& other)
+    {
+        if (this != &other) {
+            if (impl_) {
+                reset();
+            }
+            if (other.is_inline()) {
+                impl_ = other.impl_->move_to(&storage_);
+                other.reset();
+            } else {
+                impl_       = other.impl_;
+                other.impl_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task()
+    {
+        if (impl_) {
+            reset();
+        }
+    }
+
+    void operator()() { (*impl_)(); }
+
+    explicit operator bool() const { return impl_ != nullptr; }
+};
+
+template <typename R, typename F>
+void fulfil(std::promise<R>& promise, F& func)
+{
+    try {
+        promise.set_value(func());
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+template <typename F>
+void fulfil(std::promise<void>& promise, F& func)
+{
+    try {
+        func();
+        promise.set_value();
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
 class executor final
 {
     executor(const executor&);
     executor& operator=(const executor&);
 
-    using task_t  = std::function<void()>;
-    using queue_t = tbb::concurrent_bounded_queue<task_t>;
+    using task_t = detail::task;
 
-    std::wstring      name_;
-    std::atomic<bool> is_running_{true};
-    queue_t           queue_;
-    std::thread       thread_;
+    std::wstring             name_;
+    std::atomic<bool>        is_running_{true};
+    std::mutex               mutex_;
+    std::condition_variable  pushed_;
+    std::condition_variable  popped_;
+    std::vector<task_t>      queue_;
+    std::size_t              capacity_ = std::numeric_limits<std::size_t>::max();
+    std::atomic<std::size_t> size_{0};
+    std::thread              thread_;
 
   public:
     executor(const std::wstring& name)
@@ -68,11 +205,14 @@ class executor final
 
         using result_type = decltype(func());
 
-        auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+        std::promise<result_type> promise;
+        auto                      future = promise.get_future();
 
-        queue_.push([=]() mutable { (*task)(); });
+        push(task_t([promise = std::move(promise), func = std::forward<Func>(func)]() mutable {
+            detail::fulfil(promise, func);
+        }));
 
-        return task->get_future();
+        return future;
     }
 
     template <typename Func>
@@ -90,6 +230,7 @@ class executor final
     {
         if (is_current()) { // Avoids potential deadlock.
             func();
+            return;
         }
 
         begin_invoke(std::forward<Func>(func)).wait();
@@ -97,11 +238,28 @@ class executor final
 
     void yield() {}
 
-    void set_capacity(queue_t::size_type capacity) { queue_.set_capacity(capacity); }
+    void set_capacity(std::size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+    }
 
-    queue_t::size_type capacity() const { return queue_.capacity(); }
+    std::size_t capacity() const { return capacity_; }
 
-    void clear() { queue_.clear(); }
+    void clear()
+    {
+        std::vector<task_t> tasks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks.swap(queue_);
+            size_ -= tasks.size();
+            if (!is_running_) {
+                // Keep the stop request.
+                queue_.push_back(task_t());
+            }
+        }
+        popped_.notify_all();
+    }
 
     void stop()
     {
@@ -109,7 +267,7 @@ class executor final
             return;
         }
         is_running_ = false;
-        queue_.push(nullptr);
+        push(task_t(), true);
     }
 
     void wait()
@@ -117,7 +275,7 @@ class executor final
         invoke([] {});
     }
 
-    queue_t::size_type size() const { return queue_.size(); }
+    std::size_t size() const { return size_; }
 
     bool is_running() const { return is_running_; }
 
@@ -126,24 +284,47 @@ class executor final
     const std::wstring& name() const { return name_; }
 
   private:
+    void push(task_t&& task, bool force = false)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            popped_.wait(lock, [&] { return force || queue_.size() < capacity_; });
+            queue_.push_back(std::move(task));
+            ++size_;
+        }
+        pushed_.notify_one();
+    }
+
     void run()
     {
         set_thread_name(name_);
 
-        task_t task;
+        // Swapped with the queue, so that tasks are taken in batches under a single lock and neither vector
+        // reallocates once it has grown to the usual backlog.
+        std::vector<task_t> batch;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                pushed_.wait(lock, [&] { return !queue_.empty(); });
+                batch.swap(queue_);
+            }
+            popped_.notify_all();
 
-        while (is_running_) {
-            try {
-                queue_.pop(task);
-                do {
-                    if (!task) {
-                        return;
-                    }
+            for (auto& task : batch) {
+                if (!task) {
+                    return;
+                }
+                try {
                     task();
-                } while (queue_.try_pop(task));
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+                // Release captures as soon as the task has run rather than with the rest of the batch.
+                task = task_t();
+                --size_;
             }
+            batch.clear();
         }
     }
 };
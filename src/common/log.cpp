@@ -31,6 +31,7 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/sinks/async_frontend.hpp>
+#include <boost/log/sinks/bounded_fifo_queue.hpp>
 #include <boost/log/sinks/sync_frontend.hpp>
 #include <boost/log/sinks/text_file_backend.hpp>
 #include <boost/log/sinks/text_ostream_backend.hpp>
@@ -42,6 +43,8 @@
 #include <boost/smart_ptr/shared_ptr.hpp>
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 
 namespace logging  = boost::log;
@@ -132,7 +135,35 @@ class column_writer
     }
 };
 
-template <typename Stream>
+// Drops records while a sink's queue is full instead of blocking the logging thread, which may be a realtime one.
+// The sink reports the count with its next record.
+template <typename Tag>
+struct count_and_drop_on_overflow
+{
+    static std::atomic<std::uint64_t> dropped;
+
+    template <typename LockT>
+    static bool on_overflow(const boost::log::record_view&, LockT&)
+    {
+        ++dropped;
+        return false;
+    }
+
+    static void on_queue_space_available() {}
+
+    static void interrupt() {}
+};
+
+template <typename Tag>
+std::atomic<std::uint64_t> count_and_drop_on_overflow<Tag>::dropped{0};
+
+struct file_sink_tag;
+struct cout_sink_tag;
+
+template <typename Tag>
+using bounded_queue = sinks::bounded_fifo_queue<10000, count_and_drop_on_overflow<Tag>>;
+
+template <typename Tag, typename Stream>
 void my_formatter(bool print_all_characters, const boost::log::record_view& rec, Stream& strm)
 {
     static column_writer thread_id_column;
@@ -147,6 +178,11 @@ void my_formatter(bool print_all_characters, const boost::log::record_view& rec,
 
     auto pre_message = pre_message_stream.str();
 
+    auto dropped = count_and_drop_on_overflow<Tag>::dropped.exchange(0);
+    if (dropped > 0) {
+        strm << pre_message << dropped << L" log messages were dropped, the log could not keep up.\n";
+    }
+
     strm << pre_message;
 
     auto line_break_replacement = L"\n" + pre_message;
@@ -161,7 +197,7 @@ void my_formatter(bool print_all_characters, const boost::log::record_view& rec,
 
 void add_file_sink(const std::wstring& file)
 {
-    using file_sink_type = boost::log::sinks::synchronous_sink<boost::log::sinks::text_file_backend>;
+    using file_sink_type = sinks::asynchronous_sink<sinks::text_file_backend, bounded_queue<file_sink_tag>>;
 
     try {
         if (!boost::filesystem::is_directory(boost::filesystem::path(file).parent_path())) {
@@ -174,7 +210,8 @@ void add_file_sink(const std::wstring& file)
             boost::log::keywords::auto_flush          = true,
             boost::log::keywords::open_mode           = std::ios::app);
 
-        file_sink->set_formatter(boost::bind(&my_formatter<boost::log::formatting_ostream>, true, _1, _2));
+        file_sink->set_formatter(
+            boost::bind(&my_formatter<file_sink_tag, boost::log::formatting_ostream>, true, _1, _2));
 
         boost::log::core::get()->add_sink(file_sink);
     } catch (...) {
@@ -191,7 +228,7 @@ void add_cout_sink()
                                                       return boost::posix_time::microsec_clock::local_time();
                                                   }));
 
-    using stream_sink_type = sinks::asynchronous_sink<sinks::wtext_ostream_backend>;
+    using stream_sink_type = sinks::asynchronous_sink<sinks::wtext_ostream_backend, bounded_queue<cout_sink_tag>>;
 
     auto stream_backend = boost::make_shared<boost::log::sinks::wtext_ostream_backend>();
     stream_backend->add_stream(boost::shared_ptr<std::wostream>(&std::wcout, boost::null_deleter()));
@@ -199,7 +236,8 @@ void add_cout_sink()
 
     auto stream_sink = boost::make_shared<stream_sink_type>(stream_backend);
 
-    stream_sink->set_formatter(boost::bind(&my_formatter<boost::log::wformatting_ostream>, false, _1, _2));
+    stream_sink->set_formatter(
+        boost::bind(&my_formatter<cout_sink_tag, boost::log::wformatting_ostream>, false, _1, _2));
 
     logging::core::get()->add_sink(stream_sink);
 }
@@ -229,4 +267,21 @@ bool set_log_level(const std::wstring& lvl)
 
 std::wstring& get_log_level() { return current_log_level; }
 
+void flush() { logging::core::get()->flush(); }
+
+int rate_limiter::acquire(int interval_ms)
+{
+    auto now  = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+    auto next = next_.load();
+
+    if (now < next || !next_.compare_exchange_strong(next, now + interval_ms)) {
+        ++suppressed_;
+        return -1;
+    }
+
+    return suppressed_.exchange(0);
+}
+
 }} // namespace caspar::log
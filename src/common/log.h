@@ -31,6 +31,8 @@
 #define WIN32_LEAN_AND_MEAN
 #include <boost/stacktrace.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 
 namespace caspar { namespace log {
@@ -60,11 +62,38 @@ using caspar_logger = boost::log::sources::wseverity_logger<boost::log::trivial:
 BOOST_LOG_INLINE_GLOBAL_LOGGER_DEFAULT(logger, caspar_logger)
 #define CASPAR_LOG(lvl) BOOST_LOG_SEV(::caspar::log::logger::get(), boost::log::trivial::severity_level::lvl)
 
+// Both sinks write on their own thread. Records are dropped, and later counted in the log, when they cannot keep up.
 void          add_file_sink(const std::wstring& file);
 void          add_cout_sink();
 bool          set_log_level(const std::wstring& lvl);
 std::wstring& get_log_level();
 
+// Writes out everything queued in the sinks, before exiting.
+void flush();
+
+class rate_limiter
+{
+    std::atomic<std::int64_t> next_{0};
+    std::atomic<int>          suppressed_{0};
+
+  public:
+    // The number of messages suppressed since the last one, or -1 if this one should be suppressed as well.
+    int acquire(int interval_ms);
+};
+
+// Logs at most once per interval from this call site, for warnings that could otherwise repeat every frame.
+#define CASPAR_LOG_RATE_LIMITED(lvl, interval_ms)                                                                      \
+    for (int caspar_log_suppressed_ =                                                                                  \
+             [&] {                                                                                                     \
+                 static ::caspar::log::rate_limiter limiter;                                                           \
+                 return limiter.acquire(interval_ms);                                                                  \
+             }();                                                                                                      \
+         caspar_log_suppressed_ >= 0;                                                                                  \
+         caspar_log_suppressed_ = -1)                                                                                  \
+    CASPAR_LOG(lvl) << (caspar_log_suppressed_ > 0                                                                     \
+                            ? L"(" + std::to_wstring(caspar_log_suppressed_) + L" similar messages suppressed) "     \
+                            : std::wstring())
+
 inline std::wstring get_stack_trace()
 {
     auto bt = boost::stacktrace::stacktrace();
@@ -30,4 +30,7 @@ namespace caspar {
 boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive);
 
 std::wstring clean_path(std::wstring path);
+
+// Flushes a written file to disk, false if it could not be opened or flushed.
+bool sync_file(const std::wstring& path);
 } // namespace caspar
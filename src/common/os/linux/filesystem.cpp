@@ -28,6 +28,9 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace boost::filesystem;
 
 namespace caspar {
@@ -76,4 +79,15 @@ std::wstring clean_path(std::wstring path)
     return path;
 }
 
+bool sync_file(const std::wstring& file)
+{
+    const auto fd = open(boost::filesystem::path(file).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const auto result = fsync(fd) == 0;
+    close(fd);
+    return result;
+}
+
 } // namespace caspar
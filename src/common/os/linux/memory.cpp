@@ -0,0 +1,94 @@
+#include "../memory.h"
+
+#include "../../log.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace caspar {
+
+namespace {
+
+const std::size_t huge_page_size = 2 * 1024 * 1024;
+
+void* map_huge(std::size_t size)
+{
+    auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+        return ptr;
+    }
+
+    static std::atomic<bool> warned{false};
+    if (!warned.exchange(true)) {
+        CASPAR_LOG(warning) << L"No reserved huge pages available (vm.nr_hugepages). Using transparent huge pages.";
+    }
+    return nullptr;
+}
+
+// Over maps by a huge page and trims to its alignment, so transparent huge pages can back the whole range.
+void* map_aligned(std::size_t size)
+{
+    auto total = size + huge_page_size;
+    auto ptr   = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto begin   = reinterpret_cast<std::uintptr_t>(ptr);
+    auto aligned = (begin + huge_page_size - 1) & ~(huge_page_size - 1);
+    if (aligned > begin) {
+        munmap(ptr, aligned - begin);
+    }
+    if (begin + total > aligned + size) {
+        munmap(reinterpret_cast<void*>(aligned + size), begin + total - aligned - size);
+    }
+    return reinterpret_cast<void*>(aligned);
+}
+
+} // namespace
+
+void* map_pages(std::size_t size, huge_pages huge, bool lock)
+{
+    void* ptr = huge == huge_pages::reserved ? map_huge(size) : nullptr;
+    if (!ptr) {
+        ptr = map_aligned(size);
+        if (!ptr) {
+            return nullptr;
+        }
+        madvise(ptr, size, huge == huge_pages::none ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+    }
+
+    // Faults the pages in now, on the node of this thread, instead of on first use by a frame.
+    auto bytes = static_cast<volatile char*>(ptr);
+    for (std::size_t n = 0; n < size; n += 4096) {
+        bytes[n] = 0;
+    }
+
+    if (lock && mlock(ptr, size) != 0) {
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            CASPAR_LOG(warning) << L"Failed to lock buffers in memory. Raise RLIMIT_MEMLOCK (ulimit -l).";
+        }
+    }
+    return ptr;
+}
+
+void unmap_pages(void* ptr, std::size_t size) { munmap(ptr, size); }
+
+std::size_t large_page_size() { return huge_page_size; }
+
+int current_numa_node()
+{
+    unsigned cpu  = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return 0;
+    }
+    return static_cast<int>(node);
+}
+
+} // namespace caspar
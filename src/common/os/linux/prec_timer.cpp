@@ -26,6 +26,7 @@
 #include <time.h>
 
 #include <chrono>
+#include <thread>
 
 using namespace std::chrono;
 
@@ -72,4 +73,18 @@ void prec_timer::tick_nanos(int64_t ticks_to_wait)
     time_ = t;
 }
 
+void prec_timer::sleep_until(steady_clock::time_point deadline)
+{
+    // nanosleep usually wakes within a few tens of microseconds, the last millisecond is spun to be sure.
+    const auto spin = milliseconds(1);
+
+    for (auto now = steady_clock::now(); now < deadline; now = steady_clock::now()) {
+        if (deadline - now > spin) {
+            std::this_thread::sleep_for(deadline - now - spin);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
 } // namespace caspar
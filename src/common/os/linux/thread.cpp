@@ -1,8 +1,88 @@
 #include "../thread.h"
+#include "../../diagnostics/trace.h"
 #include "../../utf.h"
 
+#include <fstream>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
 namespace caspar {
 
-void set_thread_name(const std::wstring& name) { pthread_setname_np(pthread_self(), u8(name).c_str()); }
+void set_thread_name(const std::wstring& name)
+{
+    pthread_setname_np(pthread_self(), u8(name).c_str());
+    place_thread(name);
+    diagnostics::trace::set_thread_name(name);
+}
+
+// Linux applies nice values to single threads.
+void set_thread_low_priority() { setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19); }
+
+// IOPRIO_CLASS_IDLE for IOPRIO_WHO_PROCESS, from linux/ioprio.h, honoured by the bfq and cfq schedulers.
+void set_thread_background_io()
+{
+    const int ioprio_who_process = 1;
+    const int ioprio_class_idle  = 3;
+    syscall(SYS_ioprio_set, ioprio_who_process, static_cast<int>(syscall(SYS_gettid)), ioprio_class_idle << 13);
+}
+
+std::int64_t thread_cpu_time_us()
+{
+    timespec time = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<std::int64_t>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+}
+
+bool set_thread_placement(const thread_placement& placement)
+{
+    auto ok  = true;
+    auto tid = static_cast<id_t>(syscall(SYS_gettid));
+
+    auto cpus = placement.cpus;
+    if (cpus.empty() && placement.numa_node >= 0) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(placement.numa_node) + "/cpulist");
+        std::string   list;
+        std::getline(file, list);
+        cpus = parse_cpu_list(list);
+        ok   = ok && !cpus.empty();
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        ok = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 && ok;
+    }
+
+    if (placement.numa_node >= 0 && placement.numa_node < 64) {
+        // Prefer the node for new pages, without depending on libnuma. MPOL_PREFERRED from linux/mempolicy.h.
+        const int     mpol_preferred = 1;
+        unsigned long nodes          = 1UL << placement.numa_node;
+
+        ok = syscall(SYS_set_mempolicy, mpol_preferred, &nodes, sizeof(nodes) * 8) == 0 && ok;
+    }
+
+    if (placement.priority == L"realtime") {
+        sched_param param    = {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+
+        ok = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 && ok;
+    } else if (!placement.priority.empty()) {
+        // Negative nice values need CAP_SYS_NICE or a raised RLIMIT_NICE.
+        auto nice = placement.priority == L"low" ? 19 : placement.priority == L"high" ? -10 : 0;
+        ok        = setpriority(PRIO_PROCESS, tid, nice) == 0 && ok;
+    }
+
+    return ok;
+}
 
 } // namespace caspar
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memory.h"
+
+#include "../diagnostics/memory.h"
+#include "../log.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace caspar {
+
+namespace {
+
+struct block
+{
+    void*       ptr;
+    std::size_t size;
+    int         node;
+};
+
+// Never destroyed, buffers may be freed by static destructors.
+struct large_buffers
+{
+    std::mutex   mutex;
+    huge_pages   huge  = huge_pages::transparent;
+    bool         lock  = false;
+    std::int64_t limit = 256LL * 1024 * 1024;
+
+    // Freed buffers kept for reuse, the most recently freed last.
+    std::vector<block> cache;
+    std::int64_t       cache_bytes = 0;
+
+    diagnostics::memory::counter& used   = diagnostics::memory::get("memory/large-buffers");
+    diagnostics::memory::counter& cached = diagnostics::memory::get("memory/large-buffer-cache");
+};
+
+large_buffers& get_large_buffers()
+{
+    static auto buffers = new large_buffers();
+    return *buffers;
+}
+
+void release(block b)
+{
+    auto& buffers = get_large_buffers();
+
+    buffers.used.add(-static_cast<std::int64_t>(b.size));
+    {
+        std::lock_guard<std::mutex> lock(buffers.mutex);
+
+        // The oldest make room, one larger than the whole budget is unmapped right away.
+        while (!buffers.cache.empty() && buffers.cache_bytes + static_cast<std::int64_t>(b.size) > buffers.limit) {
+            auto oldest = buffers.cache.front();
+            buffers.cache.erase(buffers.cache.begin());
+            buffers.cache_bytes -= oldest.size;
+            buffers.cached.add(-static_cast<std::int64_t>(oldest.size));
+            unmap_pages(oldest.ptr, oldest.size);
+        }
+        if (static_cast<std::int64_t>(b.size) <= buffers.limit) {
+            buffers.cache.push_back(b);
+            buffers.cache_bytes += b.size;
+            buffers.cached.add(b.size);
+            return;
+        }
+    }
+    unmap_pages(b.ptr, b.size);
+}
+
+} // namespace
+
+std::shared_ptr<void> alloc_large_buffer(std::size_t size)
+{
+    if (size < large_buffer_threshold) {
+        auto ptr = std::malloc(std::max<std::size_t>(size, 1));
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return std::shared_ptr<void>(ptr, std::free);
+    }
+
+    auto&      buffers = get_large_buffers();
+    const auto page    = large_page_size();
+    const auto node    = current_numa_node();
+
+    block b{nullptr, (size + page - 1) / page * page, node};
+
+    huge_pages huge;
+    bool       lock;
+    {
+        std::lock_guard<std::mutex> guard(buffers.mutex);
+
+        auto it = std::find_if(buffers.cache.rbegin(), buffers.cache.rend(), [&](const block& cached) {
+            return cached.size == b.size && cached.node == node;
+        });
+        if (it != buffers.cache.rend()) {
+            b = *it;
+            buffers.cache.erase(std::next(it).base());
+            buffers.cache_bytes -= b.size;
+            buffers.cached.add(-static_cast<std::int64_t>(b.size));
+        }
+        huge = buffers.huge;
+        lock = buffers.lock;
+    }
+
+    if (!b.ptr) {
+        b.ptr = map_pages(b.size, huge, lock);
+        if (!b.ptr) {
+            throw std::bad_alloc();
+        }
+    }
+    buffers.used.add(b.size);
+
+    return std::shared_ptr<void>(b.ptr, [b](void*) { release(b); });
+}
+
+void configure_memory(const boost::property_tree::wptree& config)
+{
+    auto& buffers = get_large_buffers();
+
+    const auto huge = config.get(L"configuration.memory.huge-pages", L"transparent");
+    const auto lock = config.get(L"configuration.memory.lock", false);
+    const auto mb   = config.get(L"configuration.memory.buffer-cache", 256);
+
+    std::lock_guard<std::mutex> guard(buffers.mutex);
+
+    if (huge == L"none") {
+        buffers.huge = huge_pages::none;
+    } else if (huge == L"explicit") {
+        buffers.huge = huge_pages::reserved;
+    } else {
+        if (huge != L"transparent") {
+            CASPAR_LOG(warning) << L"Invalid memory/huge-pages " << huge << L". Using transparent.";
+        }
+        buffers.huge = huge_pages::transparent;
+    }
+    buffers.lock  = lock;
+    buffers.limit = std::max(0, mb) * 1024LL * 1024;
+}
+
+} // namespace caspar
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstddef>
+#include <memory>
+
+namespace caspar {
+
+// Buffers from this size on are large media buffers, smaller ones come from the heap.
+const std::size_t large_buffer_threshold = 1024 * 1024;
+
+// A frame sized or larger buffer, e.g. a frame, a file chunk or a card's output buffer. It is backed by huge pages,
+// faulted in by the calling thread so it lands on that thread's NUMA node, and optionally locked in RAM, as configured
+// by configure_memory. Freed buffers are kept for reuse on the same node up to a budget, so pools that grow do not
+// fault pages in again. The contents are undefined.
+std::shared_ptr<void> alloc_large_buffer(std::size_t size);
+
+// Reads configuration.memory. Buffers already allocated keep the settings they were allocated with.
+void configure_memory(const boost::property_tree::wptree& config);
+
+enum class huge_pages
+{
+    none,
+    transparent, // Linux transparent huge pages, where the kernel enables them.
+    reserved,    // The pool reserved with vm.nr_hugepages, or large pages on Windows, falling back to transparent.
+};
+
+// Platform specific. Maps size bytes, a multiple of large_page_size, faulted in by the calling thread. Returns
+// nullptr on failure.
+void*       map_pages(std::size_t size, huge_pages huge, bool lock);
+void        unmap_pages(void* ptr, std::size_t size);
+std::size_t large_page_size();
+
+// Platform specific. The NUMA node of the cpu the calling thread runs on, 0 if unknown.
+int current_numa_node();
+
+} // namespace caspar
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread.h"
+
+#include "../log.h"
+#include "../utf.h"
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/task_scheduler_observer.h>
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+
+namespace caspar {
+
+namespace {
+
+struct thread_rule
+{
+    std::wstring     pattern;
+    thread_placement placement;
+};
+
+std::mutex               rules_mutex;
+std::vector<thread_rule> rules;
+
+bool match(const wchar_t* pattern, const wchar_t* name)
+{
+    const wchar_t* star      = nullptr;
+    const wchar_t* backtrack = nullptr;
+
+    while (*name) {
+        if (*pattern == L'*') {
+            star      = pattern++;
+            backtrack = name;
+        } else if (*pattern == *name) {
+            ++pattern;
+            ++name;
+        } else if (star) {
+            pattern = star + 1;
+            name    = ++backtrack;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == L'*') {
+        ++pattern;
+    }
+    return !*pattern;
+}
+
+class tbb_worker_observer : public tbb::task_scheduler_observer
+{
+  public:
+    tbb_worker_observer() { observe(true); }
+
+    ~tbb_worker_observer() { observe(false); }
+
+    void on_scheduler_entry(bool is_worker) override
+    {
+        if (is_worker) {
+            set_thread_name(L"tbb-worker");
+        }
+    }
+};
+
+} // namespace
+
+std::vector<int> parse_cpu_list(const std::string& list)
+{
+    std::vector<int>   cpus;
+    std::istringstream stream(list);
+    std::string        range;
+
+    while (std::getline(stream, range, ',')) {
+        auto dash = range.find('-');
+        try {
+            auto first = std::stoi(range.substr(0, dash));
+            auto last  = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (...) {
+            // Skip empty or malformed ranges.
+        }
+    }
+
+    return cpus;
+}
+
+void configure_threads(const boost::property_tree::wptree& config)
+{
+    std::vector<thread_rule> result;
+
+    auto threads = config.get_child_optional(L"configuration.threads");
+    if (threads) {
+        for (auto& xml_thread : *threads) {
+            if (xml_thread.first != L"thread") {
+                continue;
+            }
+
+            thread_rule rule;
+            rule.pattern             = xml_thread.second.get(L"name", L"*");
+            rule.placement.cpus      = parse_cpu_list(u8(xml_thread.second.get(L"cpus", L"")));
+            rule.placement.numa_node = xml_thread.second.get(L"numa-node", -1);
+            rule.placement.priority  = xml_thread.second.get(L"priority", L"");
+
+            if (!rule.placement.priority.empty() && rule.placement.priority != L"low" &&
+                rule.placement.priority != L"normal" && rule.placement.priority != L"high" &&
+                rule.placement.priority != L"realtime") {
+                CASPAR_LOG(warning) << L"Invalid thread priority " << rule.placement.priority << L" for "
+                                    << rule.pattern << L". Ignoring.";
+                rule.placement.priority.clear();
+            }
+
+            result.push_back(std::move(rule));
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(rules_mutex);
+    rules = std::move(result);
+}
+
+std::shared_ptr<void> observe_tbb_workers() { return std::make_shared<tbb_worker_observer>(); }
+
+void place_thread(const std::wstring& name)
+{
+    thread_placement placement;
+    {
+        std::lock_guard<std::mutex> lock(rules_mutex);
+
+        auto it = std::find_if(
+            rules.begin(), rules.end(), [&](const thread_rule& rule) { return match(rule.pattern.c_str(), name.c_str()); });
+        if (it == rules.end()) {
+            return;
+        }
+        placement = it->placement;
+    }
+
+    if (!set_thread_placement(placement)) {
+        CASPAR_LOG(warning) << L"Failed to fully apply the configured placement for thread " << name << L".";
+    }
+}
+
+} // namespace caspar
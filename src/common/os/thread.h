@@ -1,8 +1,48 @@
 #pragma once
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace caspar {
 
+// Also applies the placement configured for the name, see configure_threads.
 void set_thread_name(const std::wstring& name);
-}
+
+// Lets the calling thread yield to everything else, for background work that must not disturb playout.
+void set_thread_low_priority();
+
+// Lets the disk reads of the calling thread wait for everyone else's, for reads ahead of time. Platform specific.
+void set_thread_background_io();
+
+// CPU time the calling thread has used so far, in microseconds. Platform specific.
+std::int64_t thread_cpu_time_us();
+
+// Where and how a thread runs.
+struct thread_placement
+{
+    std::vector<int> cpus;           // Empty leaves the affinity alone, unless numa_node is set.
+    int              numa_node = -1; // Pins to the node's cpus when cpus is empty and prefers its memory.
+    std::wstring     priority;       // low, normal, high or realtime. Empty leaves the priority alone.
+};
+
+// Reads the configuration.threads rules. Threads named after this get the placement of the first rule whose
+// name pattern matches, '*' matching any characters.
+void configure_threads(const boost::property_tree::wptree& config);
+
+// Names TBB worker threads "tbb-worker" as they enter the scheduler, so that rules apply to them as well.
+// The workers are observed for as long as the returned token is alive.
+std::shared_ptr<void> observe_tbb_workers();
+
+// "0-3,8,10-11" style list, as used in the configuration and by Linux sysfs.
+std::vector<int> parse_cpu_list(const std::string& list);
+
+// Platform specific. Returns false if any part of the placement could not be applied.
+bool set_thread_placement(const thread_placement& placement);
+
+// Applies the configured placement for name to the calling thread.
+void place_thread(const std::wstring& name);
+} // namespace caspar
@@ -25,6 +25,8 @@
 
 #include <boost/filesystem.hpp>
 
+#include <windows.h>
+
 namespace caspar {
 
 boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_insensitive)
@@ -36,4 +38,16 @@ boost::optional<std::wstring> find_case_insensitive(const std::wstring& case_ins
 
 std::wstring clean_path(std::wstring path) { return path; }
 
+bool sync_file(const std::wstring& file)
+{
+    const auto handle = CreateFileW(
+        file.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    const auto result = FlushFileBuffers(handle) != FALSE;
+    CloseHandle(handle);
+    return result;
+}
+
 } // namespace caspar
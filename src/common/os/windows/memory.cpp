@@ -0,0 +1,108 @@
+#include "../memory.h"
+
+#include <windows.h>
+
+#include "../../log.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace caspar {
+
+namespace {
+
+// Large pages need SeLockMemoryPrivilege, granted to the user by policy and enabled in the process token.
+bool enable_large_pages()
+{
+    static bool enabled = [] {
+        HANDLE token = nullptr;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return false;
+        }
+
+        TOKEN_PRIVILEGES privileges         = {};
+        privileges.PrivilegeCount           = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+        auto ok = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                  AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                  GetLastError() == ERROR_SUCCESS;
+        CloseHandle(token);
+
+        if (!ok) {
+            CASPAR_LOG(warning) << L"Large pages need the \"Lock pages in memory\" right. Using normal pages.";
+        }
+        return ok;
+    }();
+    return enabled;
+}
+
+DWORD numa_node()
+{
+    auto node = current_numa_node();
+    return node > 0 ? static_cast<DWORD>(node) : NUMA_NO_PREFERRED_NODE;
+}
+
+} // namespace
+
+void* map_pages(std::size_t size, huge_pages huge, bool lock)
+{
+    void* ptr = nullptr;
+    if (huge == huge_pages::reserved && enable_large_pages()) {
+        // Large pages are always locked.
+        ptr = VirtualAllocExNuma(GetCurrentProcess(),
+                                 nullptr,
+                                 size,
+                                 MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                 PAGE_READWRITE,
+                                 numa_node());
+        if (ptr) {
+            return ptr;
+        }
+    }
+
+    ptr = VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, numa_node());
+    if (!ptr) {
+        return nullptr;
+    }
+
+    if (lock) {
+        static std::once_flag grown;
+        std::call_once(grown, [] {
+            // The default working set only allows a few MB to be locked.
+            SetProcessWorkingSetSize(GetCurrentProcess(), 256LL * 1024 * 1024, 2048LL * 1024 * 1024);
+        });
+        if (!VirtualLock(ptr, size)) {
+            static std::atomic<bool> warned{false};
+            if (!warned.exchange(true)) {
+                CASPAR_LOG(warning) << L"Failed to lock buffers in memory.";
+            }
+        }
+    }
+    return ptr;
+}
+
+void unmap_pages(void* ptr, std::size_t) { VirtualFree(ptr, 0, MEM_RELEASE); }
+
+std::size_t large_page_size()
+{
+    static const std::size_t size = [] {
+        auto minimum = GetLargePageMinimum();
+        return minimum > 0 ? minimum : 2 * 1024 * 1024;
+    }();
+    return size;
+}
+
+int current_numa_node()
+{
+    PROCESSOR_NUMBER processor = {};
+    GetCurrentProcessorNumberEx(&processor);
+
+    USHORT node = 0;
+    if (!GetNumaProcessorNodeEx(&processor, &node)) {
+        return 0;
+    }
+    return node;
+}
+
+} // namespace caspar
@@ -70,4 +70,16 @@ void prec_timer::tick_nanos(int64_t ticks_to_wait)
     time_ = t;
 }
 
+void prec_timer::sleep_until(steady_clock::time_point deadline)
+{
+    // Sleep(1) takes 1-2 ms, the rest is passed giving up the timeslice.
+    for (auto now = steady_clock::now(); now < deadline; now = steady_clock::now()) {
+        if (deadline - now > milliseconds(2)) {
+            Sleep(1);
+        } else {
+            Sleep(0);
+        }
+    }
+}
+
 } // namespace caspar
@@ -4,6 +4,7 @@
 
 #include <windows.h>
 
+#include "../../diagnostics/trace.h"
 #include "../../utf.h"
 
 namespace caspar {
@@ -31,6 +32,60 @@ inline void SetThreadName(DWORD dwThreadID, LPCSTR szThreadName)
     }
 }
 
-void set_thread_name(const std::wstring& name) { SetThreadName(GetCurrentThreadId(), u8(name).c_str()); }
+void set_thread_name(const std::wstring& name)
+{
+    SetThreadName(GetCurrentThreadId(), u8(name).c_str());
+    place_thread(name);
+    diagnostics::trace::set_thread_name(name);
+}
+
+void set_thread_low_priority() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST); }
+
+// Background mode lowers the I/O and memory priority along with the CPU priority.
+void set_thread_background_io() { SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN); }
+
+std::int64_t thread_cpu_time_us()
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    auto to_us = [](const FILETIME& time) {
+        return static_cast<std::int64_t>((static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) /
+               10;
+    };
+    return to_us(kernel) + to_us(user);
+}
+
+bool set_thread_placement(const thread_placement& placement)
+{
+    auto ok = true;
+
+    // Windows allocates memory from the node of the processor a thread runs on, so pinning to a node is enough
+    // for node local memory.
+    if (!placement.cpus.empty()) {
+        DWORD_PTR mask = 0;
+        for (auto cpu : placement.cpus) {
+            if (cpu >= 0 && cpu < static_cast<int>(sizeof(DWORD_PTR) * 8)) {
+                mask |= DWORD_PTR(1) << cpu;
+            }
+        }
+        ok = SetThreadAffinityMask(GetCurrentThread(), mask) != 0 && ok;
+    } else if (placement.numa_node >= 0) {
+        GROUP_AFFINITY affinity = {};
+        ok = GetNumaNodeProcessorMaskEx(static_cast<USHORT>(placement.numa_node), &affinity) &&
+             SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) && ok;
+    }
+
+    if (!placement.priority.empty()) {
+        auto priority = placement.priority == L"low"        ? THREAD_PRIORITY_LOWEST
+                        : placement.priority == L"high"     ? THREAD_PRIORITY_HIGHEST
+                        : placement.priority == L"realtime" ? THREAD_PRIORITY_TIME_CRITICAL
+                                                            : THREAD_PRIORITY_NORMAL;
+        ok            = SetThreadPriority(GetCurrentThread(), priority) && ok;
+    }
+
+    return ok;
+}
 
 } // namespace caspar
@@ -0,0 +1,476 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pixel_convert.h"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef _MSC_VER
+#define CASPAR_TARGET_AVX2
+#else
+#define CASPAR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace caspar { namespace convert {
+
+namespace {
+
+bool has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const auto os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return os_avx && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// Weights of B, G and R scaled by 2^13, giving 10 bit video range Y', and Cb and Cr before the offset of 512.
+struct coefficients
+{
+    std::int16_t y[3];
+    std::int16_t cb[3];
+    std::int16_t cr[3];
+};
+
+const int SHIFT = 13;
+
+coefficients make_coefficients(ycbcr_matrix matrix)
+{
+    const auto kr = matrix == ycbcr_matrix::bt709 ? 0.2126 : 0.299;
+    const auto kb = matrix == ycbcr_matrix::bt709 ? 0.0722 : 0.114;
+    const auto scale = static_cast<double>(1 << SHIFT);
+    const auto y     = 876.0 / 255.0 * scale;
+    const auto cb    = 896.0 / 255.0 / (2.0 - 2.0 * kb) * scale;
+    const auto cr    = 896.0 / 255.0 / (2.0 - 2.0 * kr) * scale;
+
+    const auto round = [](double value) { return static_cast<std::int16_t>(value < 0.0 ? value - 0.5 : value + 0.5); };
+
+    // The rounded weights sum to white exactly and to 0 for the colour differences, so that greys stay grey.
+    coefficients c;
+    c.y[0]  = round(kb * y);
+    c.y[2]  = round(kr * y);
+    c.y[1]  = static_cast<std::int16_t>(round(y) - c.y[0] - c.y[2]);
+    c.cb[0] = round((1.0 - kb) * cb);
+    c.cb[2] = round(-kr * cb);
+    c.cb[1] = static_cast<std::int16_t>(-c.cb[0] - c.cb[2]);
+    c.cr[2] = round((1.0 - kr) * cr);
+    c.cr[0] = round(-kb * cr);
+    c.cr[1] = static_cast<std::int16_t>(-c.cr[0] - c.cr[2]);
+    return c;
+}
+
+std::uint16_t clamp10(int value) { return static_cast<std::uint16_t>(std::min(1019, std::max(4, value))); }
+
+int weigh(const std::int16_t* w, const std::uint8_t* px) { return w[0] * px[0] + w[1] * px[1] + w[2] * px[2]; }
+
+// 10 bit Y' of the pixels from begin to end and Cb Cr of their pairs, begin and end being even.
+void ycbcr_row_scalar(const std::uint8_t* src,
+                      int                 width,
+                      int                 begin,
+                      int                 end,
+                      const coefficients& c,
+                      std::uint16_t*      y,
+                      std::uint16_t*      cb,
+                      std::uint16_t*      cr)
+{
+    for (int x = begin; x < end; x += 2) {
+        const auto p0 = src + std::min(x, width - 1) * 4;
+        const auto p1 = src + std::min(x + 1, width - 1) * 4;
+
+        y[x]      = clamp10((weigh(c.y, p0) + (64 << SHIFT) + (1 << (SHIFT - 1))) >> SHIFT);
+        y[x + 1]  = clamp10((weigh(c.y, p1) + (64 << SHIFT) + (1 << (SHIFT - 1))) >> SHIFT);
+        cb[x / 2] = clamp10((weigh(c.cb, p0) + weigh(c.cb, p1) + (512 << (SHIFT + 1)) + (1 << SHIFT)) >> (SHIFT + 1));
+        cr[x / 2] = clamp10((weigh(c.cr, p0) + weigh(c.cr, p1) + (512 << (SHIFT + 1)) + (1 << SHIFT)) >> (SHIFT + 1));
+    }
+}
+
+// The weighted sums of eight pixels, in order.
+CASPAR_TARGET_AVX2 __m256i weigh_avx2(__m256i lo, __m256i hi, __m256i weights)
+{
+    return _mm256_hadd_epi32(_mm256_madd_epi16(lo, weights), _mm256_madd_epi16(hi, weights));
+}
+
+CASPAR_TARGET_AVX2 __m256i weights_avx2(const std::int16_t* w)
+{
+    return _mm256_setr_epi16(w[0], w[1], w[2], 0, w[0], w[1], w[2], 0, w[0], w[1], w[2], 0, w[0], w[1], w[2], 0);
+}
+
+// Y' of eight pixels, and Cb of their pairs followed by Cr of their pairs, as 32 bit values.
+CASPAR_TARGET_AVX2 void ycbcr8_avx2(const std::uint8_t* src,
+                                    __m256i             y_weights,
+                                    __m256i             cb_weights,
+                                    __m256i             cr_weights,
+                                    __m256i&            y,
+                                    __m256i&            cbcr)
+{
+    const auto zero = _mm256_setzero_si256();
+    const auto bgra = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    const auto lo   = _mm256_unpacklo_epi8(bgra, zero);
+    const auto hi   = _mm256_unpackhi_epi8(bgra, zero);
+
+    y = _mm256_srai_epi32(
+        _mm256_add_epi32(weigh_avx2(lo, hi, y_weights), _mm256_set1_epi32((64 << SHIFT) + (1 << (SHIFT - 1)))),
+        SHIFT);
+
+    // Pairs 0 1 of Cb, 0 1 of Cr, then 2 3 of Cb and 2 3 of Cr, reordered to Cb 0 1 2 3 and Cr 0 1 2 3.
+    const auto pairs = _mm256_hadd_epi32(weigh_avx2(lo, hi, cb_weights), weigh_avx2(lo, hi, cr_weights));
+    cbcr             = _mm256_permutevar8x32_epi32(
+        _mm256_srai_epi32(_mm256_add_epi32(pairs, _mm256_set1_epi32((512 << (SHIFT + 1)) + (1 << SHIFT))), SHIFT + 1),
+        _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+}
+
+CASPAR_TARGET_AVX2 void ycbcr_row_avx2(const std::uint8_t* src,
+                                       int                 width,
+                                       int                 begin,
+                                       int                 end,
+                                       const coefficients& c,
+                                       std::uint16_t*      y,
+                                       std::uint16_t*      cb,
+                                       std::uint16_t*      cr)
+{
+    const auto y_weights  = weights_avx2(c.y);
+    const auto cb_weights = weights_avx2(c.cb);
+    const auto cr_weights = weights_avx2(c.cr);
+    const auto min        = _mm256_set1_epi16(4);
+    const auto max        = _mm256_set1_epi16(1019);
+
+    auto x = begin;
+    for (; x + 16 <= std::min(end, width); x += 16) {
+        __m256i y0, y1, cbcr0, cbcr1;
+        ycbcr8_avx2(src + x * 4, y_weights, cb_weights, cr_weights, y0, cbcr0);
+        ycbcr8_avx2(src + x * 4 + 32, y_weights, cb_weights, cr_weights, y1, cbcr1);
+
+        // Packing interleaves the lanes, Y' is put back in order and Cb Cr end up in the low and high lane.
+        const auto y16    = _mm256_permute4x64_epi64(_mm256_packus_epi32(y0, y1), _MM_SHUFFLE(3, 1, 2, 0));
+        const auto cbcr16 = _mm256_packus_epi32(cbcr0, cbcr1);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x), _mm256_min_epi16(_mm256_max_epi16(y16, min), max));
+
+        const auto clamped = _mm256_min_epi16(_mm256_max_epi16(cbcr16, min), max);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cb + x / 2), _mm256_castsi256_si128(clamped));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(cr + x / 2), _mm256_extracti128_si256(clamped, 1));
+    }
+    ycbcr_row_scalar(src, width, x, end, c, y, cb, cr);
+}
+
+using ycbcr_row_t = void (*)(const std::uint8_t*,
+                             int,
+                             int,
+                             int,
+                             const coefficients&,
+                             std::uint16_t*,
+                             std::uint16_t*,
+                             std::uint16_t*);
+
+ycbcr_row_t ycbcr_row()
+{
+    static const ycbcr_row_t row = has_avx2() ? ycbcr_row_avx2 : ycbcr_row_scalar;
+    return row;
+}
+
+std::uint8_t to_8bit(int value) { return static_cast<std::uint8_t>((value + 2) >> 2); }
+
+std::uint32_t pack_v210(std::uint32_t a, std::uint32_t b, std::uint32_t c) { return a | (b << 10) | (c << 20); }
+
+// Y' and Cb Cr of a line of pixels, the width rounded up to pairs or to the groups of v210.
+struct ycbcr_line
+{
+    std::vector<std::uint16_t> y;
+    std::vector<std::uint16_t> cb;
+    std::vector<std::uint16_t> cr;
+
+    explicit ycbcr_line(int padded_width)
+        : y(padded_width)
+        , cb(padded_width / 2)
+        , cr(padded_width / 2)
+    {
+    }
+
+    void convert(const std::uint8_t* src, int width, const coefficients& c)
+    {
+        ycbcr_row()(src, width, 0, static_cast<int>(y.size()), c, y.data(), cb.data(), cr.data());
+    }
+};
+
+// Converts the lines of 4:2:0 chroma, each from two lines of pixels.
+template <typename Store>
+void convert_420(const std::uint8_t* src,
+                 std::size_t         src_linesize,
+                 int                 width,
+                 int                 height,
+                 ycbcr_matrix        matrix,
+                 Store               store)
+{
+    const auto c = make_coefficients(matrix);
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, (height + 1) / 2), [&](const tbb::blocked_range<int>& r) {
+        ycbcr_line top((width + 1) & ~1);
+        ycbcr_line bottom((width + 1) & ~1);
+        for (int row = r.begin(); row < r.end(); ++row) {
+            top.convert(src + row * 2 * src_linesize, width, c);
+            bottom.convert(src + std::min(row * 2 + 1, height - 1) * src_linesize, width, c);
+            store(row, top, bottom);
+        }
+    });
+}
+
+void extract_alpha_scalar(const std::uint8_t* src, std::uint8_t* dst, int begin, int end)
+{
+    for (int x = begin; x < end; ++x) {
+        dst[x] = src[x * 4 + 3];
+    }
+}
+
+CASPAR_TARGET_AVX2 void extract_alpha_avx2(const std::uint8_t* src, std::uint8_t* dst, int begin, int end)
+{
+    const auto gather = _mm256_setr_epi8(3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                         3, 7, 11, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const auto join   = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+
+    auto x = begin;
+    for (; x + 8 <= end; x += 8) {
+        const auto bgra  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        const auto alpha = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(bgra, gather), join);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(alpha));
+    }
+    extract_alpha_scalar(src, dst, x, end);
+}
+
+void extract_key_scalar(const std::uint8_t* src, std::uint8_t* dst, int begin, int end)
+{
+    for (int x = begin; x < end; ++x) {
+        std::memset(dst + x * 4, src[x * 4 + 3], 4);
+    }
+}
+
+CASPAR_TARGET_AVX2 void extract_key_avx2(const std::uint8_t* src, std::uint8_t* dst, int begin, int end)
+{
+    const auto spread = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+                                         3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+
+    auto x = begin;
+    for (; x + 8 <= end; x += 8) {
+        const auto bgra = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), _mm256_shuffle_epi8(bgra, spread));
+    }
+    extract_key_scalar(src, dst, x, end);
+}
+
+using extract_row_t = void (*)(const std::uint8_t*, std::uint8_t*, int, int);
+
+void extract(const std::uint8_t* src,
+             std::size_t         src_linesize,
+             int                 width,
+             int                 height,
+             std::uint8_t*       dst,
+             std::size_t         dst_linesize,
+             extract_row_t       row)
+{
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+        for (int line = r.begin(); line < r.end(); ++line) {
+            row(src + line * src_linesize, dst + line * dst_linesize, 0, width);
+        }
+    });
+}
+
+} // namespace
+
+void bgra_to_uyvy(const std::uint8_t* src,
+                  std::size_t         src_linesize,
+                  int                 width,
+                  int                 height,
+                  std::uint8_t*       dst,
+                  std::size_t         dst_linesize,
+                  ycbcr_matrix        matrix)
+{
+    const auto c = make_coefficients(matrix);
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+        ycbcr_line line((width + 1) & ~1);
+        for (int row = r.begin(); row < r.end(); ++row) {
+            line.convert(src + row * src_linesize, width, c);
+
+            auto out = dst + row * dst_linesize;
+            for (std::size_t n = 0; n < line.cb.size(); ++n, out += 4) {
+                out[0] = to_8bit(line.cb[n]);
+                out[1] = to_8bit(line.y[n * 2]);
+                out[2] = to_8bit(line.cr[n]);
+                out[3] = to_8bit(line.y[n * 2 + 1]);
+            }
+        }
+    });
+}
+
+void bgra_to_v210(const std::uint8_t* src,
+                  std::size_t         src_linesize,
+                  int                 width,
+                  int                 height,
+                  std::uint8_t*       dst,
+                  std::size_t         dst_linesize,
+                  ycbcr_matrix        matrix)
+{
+    const auto c      = make_coefficients(matrix);
+    const auto groups = static_cast<int>(dst_linesize / 16);
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+        ycbcr_line line(groups * 6);
+        for (int row = r.begin(); row < r.end(); ++row) {
+            line.convert(src + row * src_linesize, width, c);
+
+            auto out = dst + row * dst_linesize;
+            for (int n = 0; n < groups; ++n, out += 16) {
+                const auto ys  = line.y.data() + n * 6;
+                const auto cbs = line.cb.data() + n * 3;
+                const auto crs = line.cr.data() + n * 3;
+
+                const std::uint32_t words[4] = {pack_v210(cbs[0], ys[0], crs[0]),
+                                                pack_v210(ys[1], cbs[1], ys[2]),
+                                                pack_v210(crs[1], ys[3], cbs[2]),
+                                                pack_v210(ys[4], crs[2], ys[5])};
+                for (int w = 0; w < 4; ++w) {
+                    for (int b = 0; b < 4; ++b) {
+                        out[w * 4 + b] = static_cast<std::uint8_t>(words[w] >> (b * 8));
+                    }
+                }
+            }
+        }
+    });
+}
+
+void bgra_to_pgroup(const std::uint8_t* src,
+                    std::size_t         src_linesize,
+                    int                 width,
+                    int                 height,
+                    std::uint8_t*       dst,
+                    std::size_t         dst_linesize,
+                    ycbcr_matrix        matrix)
+{
+    const auto c = make_coefficients(matrix);
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, height), [&](const tbb::blocked_range<int>& r) {
+        ycbcr_line line((width + 1) & ~1);
+        for (int row = r.begin(); row < r.end(); ++row) {
+            line.convert(src + row * src_linesize, width, c);
+
+            auto out = dst + row * dst_linesize;
+            for (std::size_t n = 0; n < line.cb.size(); ++n, out += 5) {
+                const auto value = static_cast<std::uint64_t>(line.cb[n]) << 30 |
+                                   static_cast<std::uint64_t>(line.y[n * 2]) << 20 |
+                                   static_cast<std::uint64_t>(line.cr[n]) << 10 | line.y[n * 2 + 1];
+                for (int b = 0; b < 5; ++b) {
+                    out[b] = static_cast<std::uint8_t>(value >> ((4 - b) * 8));
+                }
+            }
+        }
+    });
+}
+
+void bgra_to_nv12(const std::uint8_t* src,
+                  std::size_t         src_linesize,
+                  int                 width,
+                  int                 height,
+                  std::uint8_t*       y,
+                  std::size_t         y_linesize,
+                  std::uint8_t*       cbcr,
+                  std::size_t         cbcr_linesize,
+                  ycbcr_matrix        matrix)
+{
+    convert_420(src, src_linesize, width, height, matrix, [&](int row, const ycbcr_line& top, const ycbcr_line& bot) {
+        for (int x = 0; x < width; ++x) {
+            y[row * 2 * y_linesize + x] = to_8bit(top.y[x]);
+        }
+        if (row * 2 + 1 < height) {
+            for (int x = 0; x < width; ++x) {
+                y[(row * 2 + 1) * y_linesize + x] = to_8bit(bot.y[x]);
+            }
+        }
+        auto out = cbcr + row * cbcr_linesize;
+        for (std::size_t n = 0; n < top.cb.size(); ++n, out += 2) {
+            out[0] = to_8bit((top.cb[n] + bot.cb[n] + 1) >> 1);
+            out[1] = to_8bit((top.cr[n] + bot.cr[n] + 1) >> 1);
+        }
+    });
+}
+
+void bgra_to_yuv420p(const std::uint8_t* src,
+                     std::size_t         src_linesize,
+                     int                 width,
+                     int                 height,
+                     std::uint8_t*       y,
+                     std::size_t         y_linesize,
+                     std::uint8_t*       cb,
+                     std::size_t         cb_linesize,
+                     std::uint8_t*       cr,
+                     std::size_t         cr_linesize,
+                     ycbcr_matrix        matrix)
+{
+    convert_420(src, src_linesize, width, height, matrix, [&](int row, const ycbcr_line& top, const ycbcr_line& bot) {
+        for (int x = 0; x < width; ++x) {
+            y[row * 2 * y_linesize + x] = to_8bit(top.y[x]);
+        }
+        if (row * 2 + 1 < height) {
+            for (int x = 0; x < width; ++x) {
+                y[(row * 2 + 1) * y_linesize + x] = to_8bit(bot.y[x]);
+            }
+        }
+        for (std::size_t n = 0; n < top.cb.size(); ++n) {
+            cb[row * cb_linesize + n] = to_8bit((top.cb[n] + bot.cb[n] + 1) >> 1);
+            cr[row * cr_linesize + n] = to_8bit((top.cr[n] + bot.cr[n] + 1) >> 1);
+        }
+    });
+}
+
+void bgra_to_alpha(const std::uint8_t* src,
+                   std::size_t         src_linesize,
+                   int                 width,
+                   int                 height,
+                   std::uint8_t*       dst,
+                   std::size_t         dst_linesize)
+{
+    static const auto row = has_avx2() ? extract_alpha_avx2 : extract_alpha_scalar;
+    extract(src, src_linesize, width, height, dst, dst_linesize, row);
+}
+
+void bgra_to_key(const std::uint8_t* src,
+                 std::size_t         src_linesize,
+                 int                 width,
+                 int                 height,
+                 std::uint8_t*       dst,
+                 std::size_t         dst_linesize)
+{
+    static const auto row = has_avx2() ? extract_key_avx2 : extract_key_scalar;
+    extract(src, src_linesize, width, height, dst, dst_linesize, row);
+}
+
+}} // namespace caspar::convert
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversions of BGRA images on the CPU, for outputs that cannot have the GPU convert them. Rows are split over the
+// task scheduler and converted with AVX2 when the CPU has it, both paths give the same result. Y'CbCr is video range,
+// chroma is the average of the pixels it covers, and pixels past the width or height repeat the last ones.
+namespace caspar { namespace convert {
+
+enum class ycbcr_matrix
+{
+    bt601,
+    bt709,
+};
+
+// Two pixels per four bytes, Cb Y0 Cr Y1.
+void bgra_to_uyvy(const std::uint8_t* src,
+                  std::size_t         src_linesize,
+                  int                 width,
+                  int                 height,
+                  std::uint8_t*       dst,
+                  std::size_t         dst_linesize,
+                  ycbcr_matrix        matrix);
+
+// Six pixels per four little endian words of three 10 bit components. Each line is filled with as many groups as fit
+// in dst_linesize, 128 bytes per 48 pixels by convention.
+void bgra_to_v210(const std::uint8_t* src,
+                  std::size_t         src_linesize,
+                  int                 width,
+                  int                 height,
+                  std::uint8_t*       dst,
+                  std::size_t         dst_linesize,
+                  ycbcr_matrix        matrix);
+
+// The pgroups of SMPTE ST 2110-20 4:2:2 10 bit, five bytes per two pixels holding Cb Y0 Cr Y1 big endian.
+void bgra_to_pgroup(const std::uint8_t* src,
+                    std::size_t         src_linesize,
+                    int                 width,
+                    int                 height,
+                    std::uint8_t*       dst,
+                    std::size_t         dst_linesize,
+                    ycbcr_matrix        matrix);
+
+// A plane of Y and one of interleaved Cb Cr at half width and height.
+void bgra_to_nv12(const std::uint8_t* src,
+                  std::size_t         src_linesize,
+                  int                 width,
+                  int                 height,
+                  std::uint8_t*       y,
+                  std::size_t         y_linesize,
+                  std::uint8_t*       cbcr,
+                  std::size_t         cbcr_linesize,
+                  ycbcr_matrix        matrix);
+
+// Planes of Y, Cb and Cr, the latter two at half width and height.
+void bgra_to_yuv420p(const std::uint8_t* src,
+                     std::size_t         src_linesize,
+                     int                 width,
+                     int                 height,
+                     std::uint8_t*       y,
+                     std::size_t         y_linesize,
+                     std::uint8_t*       cb,
+                     std::size_t         cb_linesize,
+                     std::uint8_t*       cr,
+                     std::size_t         cr_linesize,
+                     ycbcr_matrix        matrix);
+
+// The alpha of each pixel, one byte per pixel.
+void bgra_to_alpha(const std::uint8_t* src,
+                   std::size_t         src_linesize,
+                   int                 width,
+                   int                 height,
+                   std::uint8_t*       dst,
+                   std::size_t         dst_linesize);
+
+// The alpha of each pixel in all four bytes, the key of a fill and key output.
+void bgra_to_key(const std::uint8_t* src,
+                 std::size_t         src_linesize,
+                 int                 width,
+                 int                 height,
+                 std::uint8_t*       dst,
+                 std::size_t         dst_linesize);
+
+}} // namespace caspar::convert
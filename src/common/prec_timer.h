@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 
 namespace caspar {
@@ -38,6 +39,9 @@ class prec_timer
     // http://www.geisswerks.com/ryan/FAQS/timing.html
     void tick_nanos(int64_t interval);
 
+    // Sleeps until the deadline and spins through the last stretch, which the scheduler would otherwise overshoot.
+    static void sleep_until(std::chrono::steady_clock::time_point deadline);
+
   private:
     int64_t time_;
 };
@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "preload.h"
+
+#include "diagnostics/memory.h"
+#include "env.h"
+#include "except.h"
+#include "log.h"
+#include "os/memory.h"
+#include "os/thread.h"
+#include "utf.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace caspar { namespace preload {
+
+namespace {
+
+enum class state
+{
+    queued,
+    loading,
+    locked,
+    cached,
+    failed,
+};
+
+const wchar_t* state_name(state value)
+{
+    switch (value) {
+        case state::queued:
+            return L"queued";
+        case state::loading:
+            return L"loading";
+        case state::locked:
+            return L"locked";
+        case state::cached:
+            return L"cached";
+        default:
+            return L"failed";
+    }
+}
+
+struct entry
+{
+    std::wstring                        clip;
+    double                              seconds    = 0.0;
+    std::uint64_t                       generation = 0;
+    state                               status     = state::queued;
+    std::wstring                        path;
+    std::int64_t                        size     = 0;
+    std::int64_t                        bytes    = 0;
+    std::int64_t                        loaded   = 0;
+    std::time_t                         modified = 0;
+    std::int64_t                        reserved = 0; // Of the locked budget.
+    std::shared_ptr<const std::uint8_t> data;
+};
+
+using resolver_func = std::function<target(const std::wstring& clip, double seconds)>;
+
+std::wstring normalize(const std::wstring& path)
+{
+    boost::system::error_code ec;
+    auto                      result = boost::filesystem::weakly_canonical(path, ec);
+    return ec ? path : result.generic_wstring();
+}
+
+class cache
+{
+    const std::int64_t      chunk_size_ = 4 * 1024 * 1024;
+    const std::int64_t      budget_;
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::vector<entry>      entries_; // In the order they were added.
+
+    std::deque<std::pair<std::wstring, std::uint64_t>> queue_;
+    resolver_func                                      resolver_;
+    std::int64_t                                       locked_     = 0;
+    std::uint64_t                                      generation_ = 0;
+    bool                                               abort_      = false;
+    std::thread                                        thread_;
+
+  public:
+    cache()
+        : budget_(env::properties().get(L"configuration.preload.locked-budget", static_cast<std::int64_t>(0)) * 1024 *
+                  1024)
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~cache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    void set_resolver(resolver_func resolver)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        resolver_ = std::move(resolver);
+    }
+
+    void add(const std::wstring& clip, double seconds)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        it = find_clip(clip);
+            if (it == entries_.end()) {
+                it = entries_.insert(entries_.end(), entry{});
+            } else {
+                locked_ -= it->reserved;
+                *it = entry{};
+            }
+            it->clip       = clip;
+            it->seconds    = seconds;
+            it->generation = ++generation_;
+            queue_.emplace_back(clip, it->generation);
+        }
+        cond_.notify_all();
+    }
+
+    void remove(const std::wstring& clip)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (clip.empty() || boost::iequals(it->clip, clip)) {
+                locked_ -= it->reserved;
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    cached find(const std::wstring& path)
+    {
+        const auto key = normalize(path);
+
+        entry found;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) {
+                return e.path == key && (e.status == state::locked || e.status == state::cached);
+            });
+            if (it == entries_.end()) {
+                return cached{};
+            }
+            found = *it;
+        }
+
+        boost::system::error_code ec;
+        const auto                size     = boost::filesystem::file_size(found.path, ec);
+        const auto                modified = boost::filesystem::last_write_time(found.path, ec);
+        if (ec || static_cast<std::int64_t>(size) != found.size || modified != found.modified) {
+            return cached{};
+        }
+
+        return cached{found.data, found.data ? found.loaded : 0, true};
+    }
+
+    boost::property_tree::wptree info()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        boost::property_tree::wptree result;
+        result.add(L"preload.locked-budget", budget_);
+        result.add(L"preload.locked", locked_);
+        for (auto& e : entries_) {
+            boost::property_tree::wptree clip;
+            clip.add(L"name", e.clip);
+            clip.add(L"path", e.path);
+            clip.add(L"state", state_name(e.status));
+            clip.add(L"size", e.size);
+            clip.add(L"bytes", e.bytes);
+            clip.add(L"loaded", e.loaded);
+            result.add_child(L"preload.clip", clip);
+        }
+        return result;
+    }
+
+  private:
+    std::vector<entry>::iterator find_clip(const std::wstring& clip)
+    {
+        return std::find_if(
+            entries_.begin(), entries_.end(), [&](const entry& e) { return boost::iequals(e.clip, clip); });
+    }
+
+    // The entry of a load in progress, unless it was removed or queued again since.
+    entry* current(const std::wstring& clip, std::uint64_t generation)
+    {
+        auto it = find_clip(clip);
+        return it != entries_.end() && it->generation == generation && !abort_ ? &*it : nullptr;
+    }
+
+    void run()
+    {
+        set_thread_name(L"preload");
+        set_thread_low_priority();
+        set_thread_background_io();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort_) {
+            if (queue_.empty()) {
+                cond_.wait(lock);
+                continue;
+            }
+
+            const auto next = std::move(queue_.front());
+            queue_.pop_front();
+
+            auto e = current(next.first, next.second);
+            if (!e || e->status != state::queued) {
+                continue;
+            }
+            e->status = state::loading;
+
+            const auto seconds  = e->seconds;
+            const auto resolver = resolver_;
+            lock.unlock();
+
+            try {
+                load(next.first, next.second, seconds, resolver);
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                CASPAR_LOG(warning) << L"[preload] Failed to preload " << next.first << L".";
+
+                std::lock_guard<std::mutex> failed_lock(mutex_);
+                if (auto failed = current(next.first, next.second)) {
+                    locked_ -= failed->reserved;
+                    failed->reserved = 0;
+                    failed->data     = nullptr;
+                    failed->status   = state::failed;
+                }
+            }
+
+            lock.lock();
+        }
+    }
+
+    void load(const std::wstring& clip, std::uint64_t generation, double seconds, const resolver_func& resolver)
+    {
+        const auto resolved = resolver ? resolver(clip, seconds) : target{env::media_folder() + clip, 0};
+        const auto path     = normalize(resolved.path);
+        const auto size     = static_cast<std::int64_t>(boost::filesystem::file_size(path));
+        const auto modified = boost::filesystem::last_write_time(path);
+        const auto bytes    = resolved.bytes > 0 ? std::min(resolved.bytes, size) : size;
+
+        // Whole large pages are reserved from the budget, or the clip is only read into the page cache.
+        const auto page     = static_cast<std::int64_t>(large_page_size());
+        const auto mapped   = (bytes + page - 1) / page * page;
+        auto       reserved = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        e = current(clip, generation);
+            if (!e) {
+                return;
+            }
+            e->path     = path;
+            e->size     = size;
+            e->bytes    = bytes;
+            e->modified = modified;
+            if (mapped > 0 && locked_ + mapped <= budget_) {
+                locked_ += mapped;
+                e->reserved = mapped;
+                reserved    = true;
+            }
+        }
+
+        std::shared_ptr<std::uint8_t> data;
+        if (reserved) {
+            auto ptr = map_pages(static_cast<std::size_t>(mapped), huge_pages::none, true);
+            if (ptr) {
+                static auto& locked = diagnostics::memory::get("preload/locked");
+                locked.add(mapped);
+                data = std::shared_ptr<std::uint8_t>(static_cast<std::uint8_t*>(ptr), [mapped](std::uint8_t* ptr) {
+                    unmap_pages(ptr, static_cast<std::size_t>(mapped));
+                    locked.add(-mapped);
+                });
+            } else {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (auto e = current(clip, generation)) {
+                    locked_ -= e->reserved;
+                    e->reserved = 0;
+                }
+            }
+        }
+
+        boost::filesystem::ifstream file(boost::filesystem::path(path), std::ios::binary);
+        if (!file) {
+            CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(L"Could not open " + path));
+        }
+
+        std::vector<char> scratch(data ? 0 : static_cast<std::size_t>(std::min(chunk_size_, bytes)));
+        std::int64_t      loaded = 0;
+        while (loaded < bytes) {
+            const auto count = std::min(chunk_size_, bytes - loaded);
+            const auto dst   = data ? reinterpret_cast<char*>(data.get() + loaded) : scratch.data();
+            file.read(dst, count);
+            if (file.gcount() <= 0) {
+                break;
+            }
+            loaded += file.gcount();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto                        e = current(clip, generation);
+            if (!e) {
+                return;
+            }
+            e->loaded = loaded;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (auto e = current(clip, generation)) {
+            e->loaded = loaded;
+            e->data   = data;
+            e->status = data ? state::locked : state::cached;
+        }
+    }
+};
+
+cache& get_cache()
+{
+    static cache instance;
+    return instance;
+}
+
+} // namespace
+
+void set_resolver(std::function<target(const std::wstring& clip, double seconds)> resolver)
+{
+    get_cache().set_resolver(std::move(resolver));
+}
+
+void add(const std::wstring& clip, double seconds) { get_cache().add(clip, seconds); }
+
+void remove(const std::wstring& clip) { get_cache().remove(clip); }
+
+cached find(const std::wstring& path) { return get_cache().find(path); }
+
+boost::property_tree::wptree info() { return get_cache().info(); }
+
+}} // namespace caspar::preload
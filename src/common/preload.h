@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Media read ahead of air time, so that a show's clips do not all come cold from a NAS as they are loaded. Files are
+// read one at a time on a thread with idle I/O priority. They are held in RAM locked by the server while the
+// configuration.preload.locked-budget in MB lasts, and otherwise read once so that they are in the page cache.
+namespace caspar { namespace preload {
+
+// The file of a clip as given to PRELOAD, and how many bytes of it to read for a number of seconds, 0 for all.
+struct target
+{
+    std::wstring path;
+    std::int64_t bytes = 0;
+};
+
+// Registered by the module that plays files. Without a resolver clips are paths relative to the media folder and
+// are read whole.
+void set_resolver(std::function<target(const std::wstring& clip, double seconds)> resolver);
+
+// Queues a clip, all of it when seconds is 0. A clip queued again is read again.
+void add(const std::wstring& clip, double seconds = 0.0);
+
+// Drops a clip, or every clip when empty, releasing its locked memory.
+void remove(const std::wstring& clip = L"");
+
+// The locked bytes of a file from its start, empty when the file is not held or changed since it was read. Files
+// that were only read into the page cache report preloaded without data.
+struct cached
+{
+    std::shared_ptr<const std::uint8_t> data;
+    std::int64_t                        size      = 0;
+    bool                                preloaded = false;
+};
+cached find(const std::wstring& path);
+
+// <preload> with the budget and a <clip> per clip with its path, state (queued, loading, locked, cached or failed),
+// size and the bytes read.
+boost::property_tree::wptree info();
+
+}} // namespace caspar::preload
@@ -56,6 +56,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -497,14 +498,39 @@ tweener_t get_tweener(std::wstring name)
     return [=](double t, double b, double c, double d) { return tween(t, b, c, d, params); };
 };
 
+// Tweeners are created for every tweened transform and transition, the parsed functions are kept by name.
+tweener_t find_tweener(const std::wstring& name)
+{
+    static std::mutex                                  mutex;
+    static std::unordered_map<std::wstring, tweener_t> tweeners;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = tweeners.find(name);
+    if (it == tweeners.end()) {
+        it = tweeners.emplace(name, get_tweener(name)).first;
+    }
+    return it->second;
+}
+
+// An elastic tween given an amplitude swings by that rather than by the distance, the others all scale with it.
+bool is_affine(std::wstring name)
+{
+    std::transform(name.begin(), name.end(), name.begin(), std::towlower);
+    return name.find(L"elastic") == std::wstring::npos || std::count(name.begin(), name.end(), L':') < 2;
+}
+
 tweener::tweener(const std::wstring& name)
-    : func_(get_tweener(name))
+    : func_(find_tweener(name))
     , name_(name)
+    , affine_(is_affine(name))
 {
 }
 
 double tweener::operator()(double t, double b, double c, double d) const { return func_(t, b, c, d); }
 
+bool tweener::affine() const { return affine_; }
+
 bool tweener::operator==(const tweener& other) const { return name_ == other.name_; }
 
 bool tweener::operator!=(const tweener& other) const { return !(*this == other); }
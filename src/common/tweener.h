@@ -71,12 +71,20 @@ class tweener
      */
     double operator()(double t, double b, double c, double d) const;
 
+    /**
+     * @return Whether the tweened value is always b + c * (*this)(t, 0, 1, d),
+     *         so that one call gives the progress of any number of values
+     *         tweened over the same time.
+     */
+    bool affine() const;
+
     bool operator==(const tweener& other) const;
     bool operator!=(const tweener& other) const;
 
   private:
     std::function<double(double, double, double, double)> func_;
     std::wstring                                          name_;
+    bool                                                  affine_;
 };
 
 } // namespace caspar
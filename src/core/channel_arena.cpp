@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "StdAfx.h"
+
+#include "channel_arena.h"
+
+#include <map>
+#include <mutex>
+
+namespace caspar { namespace core {
+
+namespace {
+
+std::mutex                                      arenas_mutex;
+std::map<int, std::shared_ptr<tbb::task_arena>> arenas;
+
+} // namespace
+
+void configure_channel_arena(int channel_index, int concurrency)
+{
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+
+    if (concurrency > 0) {
+        arenas[channel_index] = std::make_shared<tbb::task_arena>(concurrency);
+    } else {
+        arenas.erase(channel_index);
+    }
+}
+
+std::shared_ptr<tbb::task_arena> channel_arena(int channel_index)
+{
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+
+    auto it = arenas.find(channel_index);
+    return it != arenas.end() ? it->second : nullptr;
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <tbb/task_arena.h>
+
+#include <memory>
+#include <utility>
+
+namespace caspar { namespace core {
+
+// Gives a channel its own TBB arena, so that parallel work of its producers can use at most concurrency threads
+// and a decode burst on one channel cannot take the workers of another. 0 keeps the channel in the shared arena.
+void configure_channel_arena(int channel_index, int concurrency);
+
+// The arena of the channel, or null when it shares the global one. Producers look it up on creation with the
+// channel index of the call context.
+std::shared_ptr<tbb::task_arena> channel_arena(int channel_index);
+
+template <typename Func>
+void execute_in(const std::shared_ptr<tbb::task_arena>& arena, Func&& func)
+{
+    if (arena) {
+        arena->execute(std::forward<Func>(func));
+    } else {
+        func();
+    }
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "channel_group.h"
+
+namespace caspar { namespace core {
+
+channel_group::channel_group(std::wstring name)
+    : name_(std::move(name))
+{
+}
+
+const std::wstring& channel_group::name() const { return name_; }
+
+void channel_group::join()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++members_;
+}
+
+void channel_group::leave()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    --members_;
+    if (arrived_ > 0 && arrived_ >= members_) {
+        release();
+    }
+}
+
+bool channel_group::arrive(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    const auto generation = generation_;
+    if (++arrived_ >= members_) {
+        release();
+        return true;
+    }
+
+    if (cond_.wait_for(lock, timeout, [&] { return generation_ != generation; })) {
+        return true;
+    }
+
+    release();
+    return false;
+}
+
+int channel_group::members() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return members_;
+}
+
+void channel_group::release()
+{
+    arrived_ = 0;
+    ++generation_;
+    cond_.notify_all();
+}
+
+}} // namespace caspar::core
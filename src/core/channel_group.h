@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace caspar { namespace core {
+
+// Channels that tick in lockstep, such as the outputs of one video wall. Every member waits at the start of a tick
+// until all members have arrived, so they produce and mix frame N together at the pace of the one member with a
+// clock, see video_channel::group.
+class channel_group final
+{
+    channel_group(const channel_group&);
+    channel_group& operator=(const channel_group&);
+
+  public:
+    explicit channel_group(std::wstring name);
+
+    const std::wstring& name() const;
+
+    void join();
+    void leave();
+
+    // Waits for the other members to arrive for the same tick. Gives up after timeout and lets every member waiting
+    // go, so that a stalled member does not stop the others. Returns false then.
+    bool arrive(std::chrono::milliseconds timeout);
+
+    int members() const;
+
+  private:
+    void release();
+
+    const std::wstring name_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cond_;
+    int                     members_    = 0;
+    int                     arrived_    = 0;
+    std::int64_t            generation_ = 0;
+};
+
+}} // namespace caspar::core
@@ -23,6 +23,7 @@
 
 #include "frame_consumer.h"
 
+#include <common/destroyer.h>
 #include <common/except.h>
 #include <common/future.h>
 
@@ -67,7 +68,19 @@ std::atomic<bool>& destroy_consumers_in_separate_thread()
     return state;
 }
 
-void destroy_consumers_synchronously() { destroy_consumers_in_separate_thread() = false; }
+std::shared_ptr<destroyer>& consumer_destroyer()
+{
+    static auto destroyer = std::make_shared<caspar::destroyer>(L"Consumer destroyer", 4, std::chrono::seconds(5));
+
+    return destroyer;
+}
+
+void destroy_consumers_synchronously()
+{
+    destroy_consumers_in_separate_thread() = false;
+    // Waits for the destroyer to finish the consumers already queued.
+    consumer_destroyer().reset();
+}
 
 class destroy_consumer_proxy : public frame_consumer
 {
@@ -82,20 +95,19 @@ class destroy_consumer_proxy : public frame_consumer
 
     ~destroy_consumer_proxy()
     {
-        static std::atomic<int> counter;
-        static std::once_flag   counter_init_once;
-        std::call_once(counter_init_once, [] { counter = 0; });
-
         if (!destroy_consumers_in_separate_thread())
             return;
 
-        ++counter;
-        CASPAR_VERIFY(counter < 8);
+        auto destroyer = consumer_destroyer();
+
+        if (!destroyer)
+            return;
 
+        auto str      = consumer_->print();
         auto consumer = new std::shared_ptr<frame_consumer>(std::move(consumer_));
-        std::thread([=] {
+
+        destroyer->post(str, [=] {
             std::unique_ptr<std::shared_ptr<frame_consumer>> pointer_guard(consumer);
-            auto                                             str = (*consumer)->print();
 
             try {
                 if (!consumer->unique())
@@ -106,10 +118,12 @@ class destroy_consumer_proxy : public frame_consumer
             } catch (...) {
             }
 
-            pointer_guard.reset();
-            counter--;
-        })
-            .detach();
+            try {
+                pointer_guard.reset();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        });
     }
 
     std::future<bool> send(const_frame frame) override { return consumer_->send(std::move(frame)); }
@@ -117,11 +131,25 @@ class destroy_consumer_proxy : public frame_consumer
     {
         return consumer_->initialize(format_desc, channel_index);
     }
+    void prepare(const video_format_desc& format_desc, int channel_index) override
+    {
+        consumer_->prepare(format_desc, channel_index);
+    }
     std::wstring         print() const override { return consumer_->print(); }
     std::wstring         name() const override { return consumer_->name(); }
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
+    void                 set_synchronization_clock(bool enabled) override
+    {
+        consumer_->set_synchronization_clock(enabled);
+    }
+    std::int64_t         clock_time() const override { return consumer_->clock_time(); }
     int                  index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    pixel_format         preferred_pixel_format() const override { return consumer_->preferred_pixel_format(); }
+    bool                 accepts_fields() const override { return consumer_->accepts_fields(); }
+    int                  preview_width() const override { return consumer_->preview_width(); }
+    bool                 audio_only() const override { return consumer_->audio_only(); }
+    int                  buffered_frames() const override { return consumer_->buffered_frames(); }
 };
 
 class print_consumer_proxy : public frame_consumer
@@ -148,11 +176,25 @@ class print_consumer_proxy : public frame_consumer
         consumer_->initialize(format_desc, channel_index);
         CASPAR_LOG(info) << consumer_->print() << L" Initialized.";
     }
+    void prepare(const video_format_desc& format_desc, int channel_index) override
+    {
+        consumer_->prepare(format_desc, channel_index);
+    }
     std::wstring         print() const override { return consumer_->print(); }
     std::wstring         name() const override { return consumer_->name(); }
     bool                 has_synchronization_clock() const override { return consumer_->has_synchronization_clock(); }
+    void                 set_synchronization_clock(bool enabled) override
+    {
+        consumer_->set_synchronization_clock(enabled);
+    }
+    std::int64_t         clock_time() const override { return consumer_->clock_time(); }
     int                  index() const override { return consumer_->index(); }
     core::monitor::state state() const override { return consumer_->state(); }
+    pixel_format         preferred_pixel_format() const override { return consumer_->preferred_pixel_format(); }
+    bool                 accepts_fields() const override { return consumer_->accepts_fields(); }
+    int                  preview_width() const override { return consumer_->preview_width(); }
+    bool                 audio_only() const override { return consumer_->audio_only(); }
+    int                  buffered_frames() const override { return consumer_->buffered_frames(); }
 };
 
 spl::shared_ptr<core::frame_consumer>
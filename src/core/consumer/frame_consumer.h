@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include "../frame/pixel_format.h"
 #include "../fwd.h"
 #include "../monitor/monitor.h"
 
@@ -28,6 +29,7 @@
 
 #include <boost/property_tree/ptree_fwd.hpp>
 
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <string>
@@ -49,6 +51,11 @@ class frame_consumer
     virtual std::future<bool> send(const_frame frame)                                             = 0;
     virtual void              initialize(const video_format_desc& format_desc, int channel_index) = 0;
 
+    // Called off the channel thread ahead of a switch to another format, while the consumer still takes frames of
+    // the current one. Consumers set up what they can of the new format here, such as buffers, so that the initialize
+    // with it at the switch is quick. Another prepare or none may follow instead of the switch.
+    virtual void prepare(const video_format_desc& format_desc, int channel_index) {}
+
     virtual core::monitor::state state() const
     {
         static const monitor::state empty;
@@ -59,6 +66,35 @@ class frame_consumer
     virtual std::wstring name() const  = 0;
     virtual bool         has_synchronization_clock() const { return false; }
     virtual int          index() const = 0;
+
+    // Consumers with a synchronization clock pace the channel while enabled, otherwise they follow the clock the
+    // channel was given without blocking in send, dropping or repeating frames as the clocks drift apart.
+    virtual void set_synchronization_clock(bool enabled) {}
+
+    // Microseconds on the consumer's own output clock, -1 without one. The channel compares it with the clock it
+    // follows to report the drift of every clocked consumer.
+    virtual std::int64_t clock_time() const { return -1; }
+
+    // Format the consumer wants the mixer to render. Other formats than bgra are available through
+    // const_frame::converted.
+    virtual pixel_format preferred_pixel_format() const { return pixel_format::bgra; }
+
+    // Whether the consumer weaves frames of half height for interlaced formats, each holding the lines of the field
+    // in its pixel_format_desc. The mixer then renders only those lines while all consumers of the channel do.
+    virtual bool accepts_fields() const { return false; }
+
+    // Width of the bgra copy the consumer shows instead of the whole frame, 0 for the whole frame. The mixer renders it
+    // with the aspect ratio of the channel, once for all consumers asking for the same width, and it is available
+    // through const_frame::scaled.
+    virtual int preview_width() const { return 0; }
+
+    // Whether the consumer only uses the audio of frames. Audio only channels take no other consumers, the image of
+    // their frames is a single pixel.
+    virtual bool audio_only() const { return false; }
+
+    // Frames the consumer has accepted that are not out yet, such as those scheduled on a device. They add to the
+    // latency the channel reports.
+    virtual int buffered_frames() const { return 0; }
 };
 
 using consumer_factory_t =
@@ -23,22 +23,110 @@
 #include "frame_consumer.h"
 
 #include "../frame/frame.h"
+#include "../frame/pixel_format.h"
 #include "../monitor/monitor.h"
 #include "../video_format.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/prec_timer.h>
+#include <common/utf.h>
 
-#include <boost/optional.hpp>
-
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <future>
 #include <map>
-#include <thread>
+#include <string>
+#include <vector>
 
 namespace caspar { namespace core {
 
-using time_point_t = decltype(std::chrono::high_resolution_clock::now());
+// Rate of a consumer clock measured against the steady clock since it was first sampled.
+struct clock_drift
+{
+    std::chrono::steady_clock::time_point start;
+    std::int64_t                          start_time = -1;
+    double                                ppm        = 0.0;
+
+    void update(std::chrono::steady_clock::time_point now, std::int64_t time)
+    {
+        if (time < 0 || start_time < 0 || time < start_time) {
+            start      = now;
+            start_time = time;
+            ppm        = 0.0;
+            return;
+        }
+        const auto elapsed = std::chrono::duration<double, std::micro>(now - start).count();
+        if (elapsed > 1e6) {
+            ppm = (static_cast<double>(time - start_time) / elapsed - 1.0) * 1e6;
+        }
+    }
+};
+
+// A consumer's outstanding send. One that misses its deadline is left to finish on its own while the channel moves
+// on, and is skipped until it has.
+struct port_state
+{
+    std::future<bool>                     pending;
+    std::chrono::steady_clock::time_point sent;
+    double                                latency = 0.0;
+    std::int64_t                          dropped = 0;
+    bool                                  late    = false;
+
+    // The send is traced on a track of its own, from sent until it was collected.
+    std::string  track;
+    std::int64_t frame = -1;
+};
+
+// Paces the channel from the system clock. Deadlines are whole ticks of duration / time_scale seconds from a fixed
+// origin, so formats such as 59.94 don't gather rounding errors.
+struct frame_pacer
+{
+    std::chrono::steady_clock::time_point origin;
+    std::int64_t                          ticks  = -1;
+    std::int64_t                          resets = 0;
+    double                                jitter = 0.0;
+
+    static std::chrono::nanoseconds offset(std::int64_t ticks, const video_format_desc& format_desc)
+    {
+        const auto units = ticks * format_desc.duration;
+        const auto whole = units / format_desc.time_scale;
+        const auto part  = units % format_desc.time_scale;
+        return std::chrono::seconds(whole) + std::chrono::nanoseconds(part * 1000000000 / format_desc.time_scale);
+    }
+
+    void reset() { ticks = -1; }
+
+    // Waits for the next tick and returns how late it was woken, in microseconds.
+    double wait(const video_format_desc& format_desc)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (ticks < 0) {
+            origin = now;
+            ticks  = 0;
+            return 0.0;
+        }
+
+        const auto deadline = origin + offset(++ticks, format_desc);
+        if (now > deadline + offset(1, format_desc)) {
+            // More than a tick behind, starts over instead of rushing to catch up.
+            origin = now;
+            ticks  = 0;
+            resets += 1;
+        } else {
+            prec_timer::sleep_until(deadline);
+        }
+
+        const auto late = std::chrono::steady_clock::now() - deadline;
+        const auto us   = std::chrono::duration<double, std::micro>(late).count();
+        jitter          = jitter * 0.95 + std::abs(us) * 0.05;
+        return us;
+    }
+};
 
 struct output::impl
 {
@@ -49,25 +137,52 @@ struct output::impl
 
     std::mutex                                     consumers_mutex_;
     std::map<int, spl::shared_ptr<frame_consumer>> consumers_;
+    std::atomic<int>                               version_{0};
+
+    // The channel thread's copy of consumers_, taken again only after it changed.
+    std::map<int, spl::shared_ptr<frame_consumer>> active_;
+    int                                            active_version_ = -1;
+    std::map<int, port_state>                      ports_;
+
+    frame_pacer pacer_;
 
-    boost::optional<time_point_t> time_;
+    // -1 follows the lowest port with a synchronization clock, -2 nothing, -3 nothing without waiting, 0 the system
+    // clock and anything else that port.
+    const int                  clock_;
+    int                        master_ = -1;
+    std::map<int, clock_drift> drift_;
+
+    const bool audio_only_;
 
   public:
-    impl(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
+    impl(spl::shared_ptr<diagnostics::graph> graph,
+         const video_format_desc&            format_desc,
+         int                                 channel_index,
+         int                                 clock,
+         bool                                audio_only)
         : graph_(std::move(graph))
         , channel_index_(channel_index)
         , format_desc_(format_desc)
+        , clock_(clock)
+        , audio_only_(audio_only)
     {
+        graph_->set_color("tick-jitter", diagnostics::color(0.6f, 0.6f, 1.0f, 0.8f));
     }
 
     void add(int index, spl::shared_ptr<frame_consumer> consumer)
     {
+        if (audio_only_ && !consumer->audio_only()) {
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(consumer->print() + L" needs video, " + print() + L" is audio only."));
+        }
+
         remove(index);
 
         consumer->initialize(format_desc_, channel_index_);
 
         std::lock_guard<std::mutex> lock(consumers_mutex_);
         consumers_.emplace(index, std::move(consumer));
+        ++version_;
     }
 
     void add(const spl::shared_ptr<frame_consumer>& consumer) { add(consumer->index(), consumer); }
@@ -78,6 +193,7 @@ struct output::impl
         auto                        it = consumers_.find(index);
         if (it != consumers_.end()) {
             consumers_.erase(it);
+            ++version_;
             return true;
         }
         return false;
@@ -85,90 +201,327 @@ struct output::impl
 
     bool remove(const spl::shared_ptr<frame_consumer>& consumer) { return remove(consumer->index()); }
 
-    void operator()(const_frame input_frame, const core::video_format_desc& format_desc)
+    bool empty()
     {
-        if (!input_frame) {
-            return;
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+        return consumers_.empty();
+    }
+
+    std::vector<pixel_format> pixel_formats()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        // bgra first, it stays the primary image of the mixed frame whenever any consumer wants it.
+        std::vector<pixel_format> formats;
+        for (auto& p : consumers_) {
+            auto format = p.second->preferred_pixel_format();
+            if (std::find(formats.begin(), formats.end(), format) != formats.end()) {
+                continue;
+            }
+            if (format == pixel_format::bgra) {
+                formats.insert(formats.begin(), format);
+            } else {
+                formats.push_back(format);
+            }
         }
 
-        if (input_frame.size() != format_desc_.size) {
-            CASPAR_LOG(warning) << print() << L" Invalid input frame size.";
-            return;
+        if (formats.empty()) {
+            formats.push_back(pixel_format::bgra);
+        }
+
+        return formats;
+    }
+
+    bool accepts_fields()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        return !consumers_.empty() && std::all_of(consumers_.begin(), consumers_.end(), [](auto& p) {
+                   return p.second->accepts_fields();
+               });
+    }
+
+    std::vector<int> preview_widths()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        std::vector<int> widths;
+        for (auto& p : consumers_) {
+            auto width = p.second->preview_width();
+            if (width > 0 && std::find(widths.begin(), widths.end(), width) == widths.end()) {
+                widths.push_back(width);
+            }
+        }
+        std::sort(widths.begin(), widths.end());
+
+        return widths;
+    }
+
+    std::future<void> prepare(const video_format_desc& format_desc)
+    {
+        std::map<int, spl::shared_ptr<frame_consumer>> consumers;
+        {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            consumers = consumers_;
+        }
+
+        const auto channel_index = channel_index_;
+        return std::async(std::launch::async, [=] {
+            std::vector<std::future<void>> prepared;
+            for (auto& p : consumers) {
+                auto consumer = p.second;
+                prepared.push_back(
+                    std::async(std::launch::async, [=] { consumer->prepare(format_desc, channel_index); }));
+            }
+            for (auto& f : prepared) {
+                try {
+                    f.get();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
+            }
+        });
+    }
+
+    int buffered_frames()
+    {
+        std::lock_guard<std::mutex> lock(consumers_mutex_);
+
+        int frames = 0;
+        for (auto& p : consumers_) {
+            frames = std::max(frames, p.second->buffered_frames());
         }
+        return frames;
+    }
 
-        auto time = std::move(time_);
+    void operator()(const_frame input_frame, const core::video_format_desc& format_desc)
+    {
+        if (!input_frame) {
+            return;
+        }
 
+        // The first frame of another format switches every consumer to it at once and goes out with it. Consumers
+        // that were prepared for the format only swap in what they set up.
         if (format_desc_ != format_desc) {
             std::lock_guard<std::mutex> lock(consumers_mutex_);
-            for (auto it = consumers_.begin(); it != consumers_.end();) {
+
+            std::vector<std::pair<int, std::future<void>>> switches;
+            for (auto& p : consumers_) {
+                auto consumer = p.second;
+                auto switched =
+                    std::async(std::launch::async, [=] { consumer->initialize(format_desc, channel_index_); });
+                switches.emplace_back(p.first, std::move(switched));
+            }
+            for (auto& p : switches) {
                 try {
-                    it->second->initialize(format_desc, it->first);
-                    ++it;
+                    p.second.get();
                 } catch (...) {
                     CASPAR_LOG_CURRENT_EXCEPTION();
-                    it = consumers_.erase(it);
+                    consumers_.erase(p.first);
                 }
             }
+            ++version_;
             format_desc_ = format_desc;
-            time_        = boost::none;
+            pacer_.reset();
+            drift_.clear();
+        }
+
+        const auto is_field = input_frame.pixel_format_desc().field != field_mode::progressive;
+
+        auto bgra_frame = input_frame.converted(pixel_format::bgra);
+        if (bgra_frame && bgra_frame.size() != (is_field ? format_desc_.size / 2 : format_desc_.size)) {
+            CASPAR_LOG_RATE_LIMITED(warning, 1000) << print() << L" Invalid input frame size.";
             return;
         }
 
-        decltype(consumers_) consumers;
-        {
+        if (version_ != active_version_) {
             std::lock_guard<std::mutex> lock(consumers_mutex_);
-            consumers = consumers_;
+            active_         = consumers_;
+            active_version_ = version_;
+            for (auto it = ports_.begin(); it != ports_.end();) {
+                it = active_.count(it->first) ? std::next(it) : ports_.erase(it);
+            }
         }
 
-        std::map<int, std::future<bool>> futures;
+        const auto sent     = std::chrono::steady_clock::now();
+        const auto period   = std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.fps));
+        const auto deadline = sent + period;
 
-        for (auto it = consumers_.begin(); it != consumers_.end();) {
+        std::vector<int> failed;
+
+        for (auto& p : active_) {
+            // Fields are only mixed while every consumer takes them, one added since misses the fields in flight.
+            if (is_field && !p.second->accepts_fields()) {
+                continue;
+            }
+            auto& port = ports_[p.first];
+            if (port.pending.valid()) {
+                if (port.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    if (!port.late) {
+                        CASPAR_LOG(warning) << print() << L" " << p.second->print()
+                                            << L" missed its deadline, frames are dropped until it catches up.";
+                    }
+                    port.late = true;
+                    port.dropped += 1;
+                    continue;
+                }
+                if (!collect(port, period)) {
+                    failed.push_back(p.first);
+                    continue;
+                }
+            }
             try {
-                futures.emplace(it->first, it->second->send(input_frame));
-                ++it;
+                if (port.track.empty()) {
+                    port.track = u8(p.second->name()) + " " + std::to_string(p.first);
+                }
+                caspar::diagnostics::trace::scope scope(
+                    "send-call", caspar::diagnostics::trace::current_frame(), p.first);
+
+                port.pending = p.second->send(input_frame);
+                port.sent    = sent;
+                port.frame   = caspar::diagnostics::trace::current_frame();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
-                it = consumers_.erase(it);
+                failed.push_back(p.first);
             }
         }
 
-        for (auto& p : futures) {
-            try {
-                if (!p.second.get()) {
-                    consumers_.erase(p.first);
+        // Every consumer gets until the next tick, only the one pacing the channel is waited for however long it takes.
+        // Unpaced channels wait for all of them, outputs fed by another channel for none.
+        for (auto& p : active_) {
+            auto& port = ports_[p.first];
+            if (clock_ == -3 || !port.pending.valid() || port.sent != sent) {
+                continue;
+            }
+            {
+                caspar::diagnostics::trace::scope scope("send-wait", port.frame, p.first);
+
+                if (p.first == master_ || clock_ == -2) {
+                    port.pending.wait();
+                } else if (port.pending.wait_until(deadline) != std::future_status::ready) {
+                    continue;
                 }
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                consumers_.erase(p.first);
             }
+            if (!collect(port, period)) {
+                failed.push_back(p.first);
+            }
+        }
+
+        if (!failed.empty()) {
+            std::lock_guard<std::mutex> lock(consumers_mutex_);
+            for (auto index : failed) {
+                auto it = consumers_.find(index);
+                if (it != consumers_.end() && it->second == active_.at(index)) {
+                    consumers_.erase(it);
+                }
+                active_.erase(index);
+                ports_.erase(index);
+            }
+            ++version_;
+        }
+
+        const auto master = select_master();
+        if (master != master_) {
+            if (clock_ <= -2) {
+                CASPAR_LOG(info) << print() << L" Running unpaced.";
+            } else {
+                CASPAR_LOG(info) << print() << L" Following "
+                                 << (master > 0 ? active_.at(master)->print() : std::wstring(L"the system clock"))
+                                 << L".";
+            }
+            master_ = master;
+            drift_.clear();
         }
 
+        const auto now = std::chrono::steady_clock::now();
+
         monitor::state state;
-        for (auto& p : consumers_) {
-            state["port"][p.first] = p.second->state();
+        for (auto& p : active_) {
+            const auto& port                       = ports_[p.first];
+            state["port"][p.first]                 = p.second->state();
+            state["port"][p.first]["consumer"]     = p.second->name();
+            state["port"][p.first]["send-latency"] = port.latency;
+            state["port"][p.first]["late"]         = port.late;
+            state["port"][p.first]["dropped"]      = port.dropped;
+
+            if (!p.second->has_synchronization_clock()) {
+                continue;
+            }
+            p.second->set_synchronization_clock(p.first == master);
+            drift_[p.first].update(now, p.second->clock_time());
+        }
+        for (auto it = drift_.begin(); it != drift_.end();) {
+            it = active_.count(it->first) ? std::next(it) : drift_.erase(it);
+        }
+
+        // Drift against the system clock for the channel clock and against the channel clock for the others.
+        const auto master_ppm       = master > 0 ? drift_[master].ppm : 0.0;
+        state["clock"]["source"]    = master > 0     ? active_.at(master)->name()
+                                      : clock_ <= -2 ? std::wstring(L"none")
+                                                     : std::wstring(L"system");
+        state["clock"]["port"]      = master;
+        state["clock"]["drift-ppm"] = master_ppm;
+        state["clock"]["jitter-us"] = master > 0 ? 0.0 : pacer_.jitter;
+        state["clock"]["resets"]    = pacer_.resets;
+        for (auto& p : drift_) {
+            if (p.first != master) {
+                state["port"][p.first]["clock"]["drift-ppm"] = p.second.ppm - master_ppm;
+            }
         }
         state_ = std::move(state);
 
-        const auto needs_sync = std::all_of(
-            consumers_.begin(), consumers_.end(), [](auto& p) { return !p.second->has_synchronization_clock(); });
+        if (master == 0 && clock_ >= -1) {
+            // A full bar is a millisecond late.
+            graph_->set_value("tick-jitter", std::abs(pacer_.wait(format_desc_)) / 1000.0);
+        } else {
+            pacer_.reset();
+        }
+    }
 
-        if (needs_sync) {
-            if (!time) {
-                time = std::chrono::high_resolution_clock::now();
-            } else {
-                std::this_thread::sleep_until(*time);
+    // Records how long the send took, false once the consumer has failed or asked to be removed.
+    bool collect(port_state& port, std::chrono::microseconds period)
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - port.sent;
+        port.latency       = std::chrono::duration<double, std::milli>(elapsed).count();
+        port.late          = elapsed > period;
+
+        const auto end   = caspar::diagnostics::trace::now();
+        const auto begin = end - std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        caspar::diagnostics::trace::record("send", port.frame, begin, end, port.track.c_str());
+        try {
+            return port.pending.get();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return false;
+        }
+    }
+
+    int select_master() const
+    {
+        if (clock_ == 0 || clock_ <= -2) {
+            return 0;
+        }
+        auto it = active_.find(clock_);
+        if (it != active_.end() && it->second->has_synchronization_clock()) {
+            return clock_;
+        }
+        for (auto& p : active_) {
+            if (p.second->has_synchronization_clock()) {
+                return p.first;
             }
-            time_ = *time + std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.fps));
-        } else {
-            time_.reset();
         }
+        return 0;
     }
 
     std::wstring print() const { return L"output[" + std::to_wstring(channel_index_) + L"]"; }
 };
 
-output::output(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index)
-    : impl_(new impl(std::move(graph), format_desc, channel_index))
+output::output(spl::shared_ptr<diagnostics::graph> graph,
+               const video_format_desc&            format_desc,
+               int                                 channel_index,
+               int                                 clock,
+               bool                                audio_only)
+    : impl_(new impl(std::move(graph), format_desc, channel_index, clock, audio_only))
 {
 }
 output::~output() {}
@@ -176,6 +529,12 @@ void output::add(int index, const spl::shared_ptr<frame_consumer>& consumer) { i
 void output::add(const spl::shared_ptr<frame_consumer>& consumer) { impl_->add(consumer); }
 bool output::remove(int index) { return impl_->remove(index); }
 bool output::remove(const spl::shared_ptr<frame_consumer>& consumer) { return impl_->remove(consumer); }
+bool output::empty() { return impl_->empty(); }
+std::vector<pixel_format> output::pixel_formats() { return impl_->pixel_formats(); }
+bool output::accepts_fields() { return impl_->accepts_fields(); }
+std::vector<int> output::preview_widths() { return impl_->preview_widths(); }
+int output::buffered_frames() { return impl_->buffered_frames(); }
+std::future<void> output::prepare(const video_format_desc& format_desc) { return impl_->prepare(format_desc); }
 void output::operator()(const_frame frame, const video_format_desc& format_desc)
 {
     return (*impl_)(std::move(frame), format_desc);
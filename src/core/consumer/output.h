@@ -21,13 +21,16 @@
 
 #pragma once
 
+#include "../frame/pixel_format.h"
 #include "../fwd.h"
 #include "../monitor/monitor.h"
 
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <future>
 #include <memory>
+#include <vector>
 
 FORWARD2(caspar, diagnostics, class graph);
 
@@ -36,7 +39,16 @@ namespace caspar { namespace core {
 class output final
 {
   public:
-    explicit output(spl::shared_ptr<diagnostics::graph> graph, const video_format_desc& format_desc, int channel_index);
+    // clock is the port of the consumer pacing the channel, 0 for the system clock, -1 for the lowest port with a
+    // synchronization clock or -2 for none. Without a clock frames go out as soon as every consumer has taken the
+    // previous one, none of them is dropped. -3 is for outputs fed by another channel's ticks, see video_channel::iso,
+    // frames then go out at once and consumers still busy with the previous one drop them. An audio only output only
+    // takes consumers that are, see frame_consumer::audio_only.
+    explicit output(spl::shared_ptr<diagnostics::graph> graph,
+                    const video_format_desc&            format_desc,
+                    int                                 channel_index,
+                    int                                 clock      = -1,
+                    bool                                audio_only = false);
 
     output(const output&) = delete;
     output& operator=(const output&) = delete;
@@ -49,6 +61,23 @@ class output final
     bool remove(const spl::shared_ptr<frame_consumer>& consumer);
     bool remove(int index);
 
+    bool empty();
+
+    std::vector<pixel_format> pixel_formats();
+
+    // Whether there are consumers and all of them take the fields of interlaced formats as separate frames.
+    bool accepts_fields();
+
+    // Widths of the reduced copies consumers asked for, each once and in ascending order.
+    std::vector<int> preview_widths();
+
+    // The most frames any consumer holds before they are out, see frame_consumer::buffered_frames.
+    int buffered_frames();
+
+    // Prepares every consumer for a switch to another format in the background, see frame_consumer::prepare. The
+    // switch itself happens with the first frame of that format.
+    std::future<void> prepare(const video_format_desc& format_desc);
+
     core::monitor::state state() const;
 
   private:
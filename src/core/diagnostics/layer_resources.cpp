@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "layer_resources.h"
+
+#include <common/os/thread.h>
+
+#include <map>
+#include <utility>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+std::shared_ptr<layer_resources> layer_resources::find(const call_context& context)
+{
+    if (context.video_channel == -1 || context.layer == -1) {
+        return nullptr;
+    }
+
+    static std::mutex                                                      mutex;
+    static std::map<std::pair<int, int>, std::shared_ptr<layer_resources>> accounts;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto& account = accounts[std::make_pair(context.video_channel, context.layer)];
+    if (!account) {
+        account = std::make_shared<layer_resources>();
+    }
+    return account;
+}
+
+monitor::state layer_resources::state()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sample now;
+    now.cpu_us       = cpu_us;
+    now.upload_bytes = upload_bytes;
+    now.draw_us      = draw_us;
+
+    const auto seconds = std::chrono::duration<double>(now.at - last_.at).count();
+    if (seconds >= 1.0) {
+        cpu_percent_             = (now.cpu_us - last_.cpu_us) / seconds / 1e4;
+        upload_bytes_per_second_ = (now.upload_bytes - last_.upload_bytes) / seconds;
+        draw_ms_per_second_      = (now.draw_us - last_.draw_us) / seconds / 1e3;
+        last_                    = now;
+    }
+
+    monitor::state state;
+    state["cpu-ms"]                  = now.cpu_us / 1000;
+    state["cpu-percent"]             = cpu_percent_;
+    state["texture-bytes"]           = texture_bytes.load();
+    state["upload-bytes"]            = now.upload_bytes;
+    state["upload-bytes-per-second"] = upload_bytes_per_second_;
+    state["draw-ms"]                 = now.draw_us / 1000;
+    state["draw-ms-per-second"]      = draw_ms_per_second_;
+    return state;
+}
+
+scoped_cpu_time::scoped_cpu_time(std::shared_ptr<layer_resources> account)
+    : account_(std::move(account))
+    , begin_(account_ ? thread_cpu_time_us() : 0)
+{
+}
+
+scoped_cpu_time::~scoped_cpu_time()
+{
+    if (account_) {
+        account_->cpu_us += thread_cpu_time_us() - begin_;
+    }
+}
+
+}}} // namespace caspar::core::diagnostics
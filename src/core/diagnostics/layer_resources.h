@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "call_context.h"
+
+#include "../monitor/monitor.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+// What the work done for a layer costs, summed over whichever threads do it. Work is attributed through the
+// call_context of the thread doing it, or the one a frame was created in, so a producer keeps accounting to the layer
+// it was loaded on. Threads that codecs and filters start on their own are not accounted.
+class layer_resources final
+{
+  public:
+    std::atomic<std::int64_t> cpu_us{0};        // Producing frames, decoding and filtering included.
+    std::atomic<std::int64_t> texture_bytes{0}; // Held by uploaded frames.
+    std::atomic<std::int64_t> upload_bytes{0};  // Uploaded to the GPU.
+    std::atomic<std::int64_t> draw_us{0};       // Mixer thread time drawing the frames.
+
+    // The account of the channel and layer of a context, nullptr if it has no layer. Accounts live for as long as the
+    // server, a layer keeps its totals when it is cleared.
+    static std::shared_ptr<layer_resources> find(const call_context& context);
+
+    // Totals and per second rates, the rates taken over the last second or more.
+    monitor::state state();
+
+  private:
+    struct sample
+    {
+        std::chrono::steady_clock::time_point at           = std::chrono::steady_clock::now();
+        std::int64_t                          cpu_us       = 0;
+        std::int64_t                          upload_bytes = 0;
+        std::int64_t                          draw_us      = 0;
+    };
+
+    std::mutex mutex_;
+    sample     last_;
+    double     cpu_percent_             = 0.0;
+    double     upload_bytes_per_second_ = 0.0;
+    double     draw_ms_per_second_      = 0.0;
+};
+
+// Adds the CPU time the calling thread spends in the scope to an account, which may be null.
+class scoped_cpu_time final
+{
+    std::shared_ptr<layer_resources> account_;
+    std::int64_t                     begin_;
+
+    scoped_cpu_time(const scoped_cpu_time&) = delete;
+    scoped_cpu_time& operator=(const scoped_cpu_time&) = delete;
+
+  public:
+    explicit scoped_cpu_time(std::shared_ptr<layer_resources> account);
+    ~scoped_cpu_time();
+};
+
+}}} // namespace caspar::core::diagnostics
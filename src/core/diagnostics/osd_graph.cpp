@@ -124,6 +124,7 @@ class context : public drawable
     {
         if (value) {
             if (!window_) {
+                caspar::diagnostics::spi::set_sink_visible(true);
                 window_.reset(
                     new sf::RenderWindow(sf::VideoMode(RENDERING_WIDTH, RENDERING_WIDTH), "CasparCG Diagnostics"));
                 window_->setPosition(sf::Vector2i(0, 0));
@@ -137,8 +138,17 @@ class context : public drawable
 
                 tick();
             }
-        } else
+        } else {
+            close();
+        }
+    }
+
+    void close()
+    {
+        if (window_) {
             window_.reset();
+            caspar::diagnostics::spi::set_sink_visible(false);
+        }
     }
 
     void tick()
@@ -150,7 +160,7 @@ class context : public drawable
         while (window_->pollEvent(e)) {
             switch (e.type) {
                 case sf::Event::Closed:
-                    window_.reset();
+                    close();
                     return;
                 case sf::Event::Resized:
                     calculate_view_ = true;
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "tick_watchdog.h"
+
+#include "call_context.h"
+
+#include <common/diagnostics/trace.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+namespace trace = caspar::diagnostics::trace;
+
+namespace {
+
+struct as_text : public boost::static_visitor<std::wstring>
+{
+    std::wstring operator()(const std::wstring& value) const { return value; }
+    std::wstring operator()(const std::string& value) const { return u16(value); }
+
+    template <typename T>
+    std::wstring operator()(const T& value) const
+    {
+        return boost::lexical_cast<std::wstring>(value);
+    }
+};
+
+std::wstring find(const monitor::state& state, const std::string& key)
+{
+    for (auto& p : state) {
+        if (p.first == key && !p.second.empty()) {
+            return boost::apply_visitor(as_text(), p.second.front());
+        }
+    }
+    return L"";
+}
+
+} // namespace
+
+struct tick_watchdog::impl
+{
+    const int                                                    index_;
+    const double                                                 budgets_;
+    const spl::shared_ptr<caspar::diagnostics::graph>            graph_;
+    const std::function<std::shared_ptr<const monitor::state>()> channel_state_;
+
+    mutable std::mutex      mutex_;
+    std::condition_variable cond_;
+    bool                    abort_ = false;
+
+    // The running tick, begin is 0 between ticks. Times in microseconds of caspar::diagnostics::trace::now.
+    std::int64_t frame_    = -1;
+    std::int64_t begin_    = 0;
+    std::int64_t budget_   = 0;
+    std::int64_t reported_ = -1;
+
+    int            stalls_ = 0;
+    monitor::state last_;
+
+    std::thread thread_;
+
+    impl(int                                                    index,
+         double                                                 budgets,
+         spl::shared_ptr<caspar::diagnostics::graph>            graph,
+         std::function<std::shared_ptr<const monitor::state>()> channel_state)
+        : index_(index)
+        , budgets_(budgets)
+        , graph_(std::move(graph))
+        , channel_state_(std::move(channel_state))
+    {
+        graph_->set_color("stall", caspar::diagnostics::color(1.0f, 0.1f, 0.1f));
+
+        if (budgets_ > 0.0) {
+            thread_ = std::thread([this] { run(); });
+        }
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    void begin(std::int64_t frame, double fps)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame_  = frame;
+        begin_  = trace::now();
+        budget_ = static_cast<std::int64_t>(1e6 / fps);
+    }
+
+    void end()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (reported_ == frame_ && begin_ != 0) {
+            const auto elapsed = (trace::now() - begin_) / 1000;
+            last_["ms"]        = elapsed;
+            CASPAR_LOG(warning) << print() << L" Stall of frame " << frame_ << L" ended after " << elapsed << L" ms.";
+        }
+        begin_ = 0;
+    }
+
+    monitor::state state() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        monitor::state state;
+        state["budgets"] = budgets_;
+        state["stalls"]  = stalls_;
+        if (stalls_ > 0) {
+            state["last"] = last_;
+        }
+        return state;
+    }
+
+    void run()
+    {
+        set_thread_name(L"channel-watchdog-" + std::to_wstring(index_));
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort_) {
+            // Checked every half frame, so a stall is reported within half a frame of passing the limit.
+            cond_.wait_for(lock, std::chrono::microseconds(budget_ > 0 ? budget_ / 2 : 20000));
+
+            if (abort_ || begin_ == 0 || reported_ == frame_ ||
+                trace::now() - begin_ < static_cast<std::int64_t>(budgets_ * budget_)) {
+                continue;
+            }
+            reported_ = frame_;
+
+            const auto frame  = frame_;
+            const auto begin  = begin_;
+            const auto budget = budget_;
+
+            lock.unlock();
+            auto last = report(frame, begin, budget);
+            graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "stall");
+            lock.lock();
+
+            stalls_ += 1;
+            last_ = std::move(last);
+        }
+    }
+
+    monitor::state report(std::int64_t frame, std::int64_t begin, std::int64_t budget) const
+    {
+        const auto now   = trace::now();
+        const auto state = channel_state_();
+
+        // The innermost scope of each thread, the one that has been open the longest is reported as the cause.
+        std::vector<trace::scope_info>           scopes;
+        std::map<int, std::vector<std::wstring>> threads;
+        std::map<int, std::string>               names;
+        const trace::scope_info*                 cause = nullptr;
+        for (auto& s : trace::running()) {
+            if (s.channel == index_) {
+                scopes.push_back(s);
+            }
+        }
+        for (std::size_t n = 0; n < scopes.size(); ++n) {
+            auto& s = scopes[n];
+            threads[s.thread_id].push_back(describe(s, now, *state));
+            names[s.thread_id] = s.thread;
+
+            auto innermost = n + 1 == scopes.size() || scopes[n + 1].thread_id != s.thread_id;
+            if (innermost && (!cause || s.begin < cause->begin)) {
+                cause = &s;
+            }
+        }
+
+        std::wostringstream out;
+        out << print() << L" Stall: tick of frame " << frame << L" running for " << (now - begin) / 1000
+            << L" ms, more than " << budgets_ << L" frame budgets of " << budget / 1000.0 << L" ms.";
+        if (cause) {
+            out << L" Waiting on " << describe(*cause, now, *state) << L" " << context(*cause).to_string() << L".";
+        }
+        for (auto& p : threads) {
+            out << L"\n    " << u16(names[p.first]) << L": ";
+            for (std::size_t n = 0; n < p.second.size(); ++n) {
+                out << (n > 0 ? L" > " : L"") << p.second[n];
+            }
+        }
+        CASPAR_LOG(warning) << out.str();
+
+        const auto is_send = cause && (cause->name == "send-call" || cause->name == "send-wait");
+
+        monitor::state last;
+        last["frame"] = frame;
+        last["ms"]    = (now - begin) / 1000;
+        last["at"]    = cause ? describe(*cause, now, *state) : std::wstring();
+        last["layer"] = cause ? context(*cause).layer : -1;
+        last["port"]  = is_send ? static_cast<int>(cause->detail) : -1;
+        return last;
+    }
+
+    call_context context(const trace::scope_info& s) const
+    {
+        call_context context;
+        context.video_channel = index_;
+        if (s.name == "layer") {
+            context.layer = static_cast<int>(s.detail);
+        }
+        return context;
+    }
+
+    // E.g. "layer 10 ffmpeg 180 ms", "send-wait port 1 decklink 95 ms" or "render 40 ms".
+    std::wstring describe(const trace::scope_info& s, std::int64_t now, const monitor::state& state) const
+    {
+        auto result = u16(s.name);
+        if (s.name == "layer" && s.detail >= 0) {
+            result += L" " + std::to_wstring(s.detail);
+            auto producer = find(state, "stage/layer/" + std::to_string(s.detail) + "/foreground/producer");
+            if (!producer.empty()) {
+                result += L" " + producer;
+            }
+        } else if ((s.name == "send-call" || s.name == "send-wait") && s.detail >= 0) {
+            result += L" port " + std::to_wstring(s.detail);
+            auto consumer = find(state, "output/port/" + std::to_string(s.detail) + "/consumer");
+            if (!consumer.empty()) {
+                result += L" " + consumer;
+            }
+        }
+        return result + L" " + std::to_wstring((now - s.begin) / 1000) + L" ms";
+    }
+
+    std::wstring print() const { return L"watchdog[" + std::to_wstring(index_) + L"]"; }
+};
+
+tick_watchdog::tick_watchdog(int                                                    channel_index,
+                             double                                                 budgets,
+                             spl::shared_ptr<caspar::diagnostics::graph>            graph,
+                             std::function<std::shared_ptr<const monitor::state>()> channel_state)
+    : impl_(spl::make_unique<impl>(channel_index, budgets, std::move(graph), std::move(channel_state)))
+{
+}
+
+tick_watchdog::~tick_watchdog() {}
+
+void tick_watchdog::begin(std::int64_t frame, double fps) { impl_->begin(frame, fps); }
+
+void tick_watchdog::end() { impl_->end(); }
+
+monitor::state tick_watchdog::state() const { return impl_->state(); }
+
+}}} // namespace caspar::core::diagnostics
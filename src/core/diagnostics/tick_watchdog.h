@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../monitor/monitor.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/memory.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace caspar { namespace core { namespace diagnostics {
+
+// Watches the ticks of a channel from a thread of its own. When a tick has run for more than the given number of frame
+// budgets, it samples the scopes that the threads working for the channel have open, see trace::running, and reports
+// which layer's producer, consumer port or GL dispatch each of them is in. The report goes to the log, to a "stall"
+// tag on the channel's graph and to the watchdog state.
+class tick_watchdog final
+{
+  public:
+    // budgets of 0 disables the watchdog. channel_state returns the last published state of the channel, used to name
+    // the producers of layers and the consumers of ports.
+    tick_watchdog(int                                                    channel_index,
+                  double                                                 budgets,
+                  spl::shared_ptr<caspar::diagnostics::graph>            graph,
+                  std::function<std::shared_ptr<const monitor::state>()> channel_state);
+    ~tick_watchdog();
+
+    // Called by the channel thread around each tick, frame is its sequence number and fps sets the budget.
+    void begin(std::int64_t frame, double fps);
+    void end();
+
+    monitor::state state() const;
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+
+    tick_watchdog(const tick_watchdog&) = delete;
+    tick_watchdog& operator=(const tick_watchdog&) = delete;
+};
+
+}}} // namespace caspar::core::diagnostics
@@ -23,6 +23,7 @@
 #include "frame.h"
 #include "frame_transform.h"
 #include "frame_visitor.h"
+#include "pixel_format.h"
 
 #include <boost/variant.hpp>
 
@@ -43,6 +44,13 @@ struct draw_frame::impl
     {
     }
 
+    // Nodes without a frame, which most default constructed frames stay, share one instance.
+    static const std::shared_ptr<impl>& blank()
+    {
+        static const auto instance = std::make_shared<impl>();
+        return instance;
+    }
+
     void accept(frame_visitor& visitor) const
     {
         struct accept_visitor : public boost::static_visitor<void>
@@ -74,14 +82,12 @@ struct draw_frame::impl
 };
 
 draw_frame::draw_frame()
-    : impl_(new impl())
+    : impl_(impl::blank())
 {
 }
 draw_frame::draw_frame(const draw_frame& other)
-    : impl_(new impl())
+    : impl_(other.impl_)
 {
-    impl_->frame_     = other.impl_->frame_;
-    impl_->transform_ = other.impl_->transform_;
 }
 
 draw_frame::draw_frame(draw_frame&& other)
@@ -89,15 +95,15 @@ draw_frame::draw_frame(draw_frame&& other)
 {
 }
 draw_frame::draw_frame(const_frame frame)
-    : impl_(new impl(std::move(frame)))
+    : impl_(std::make_shared<impl>(std::move(frame)))
 {
 }
 draw_frame::draw_frame(mutable_frame&& frame)
-    : impl_(new impl(std::move(frame)))
+    : impl_(std::make_shared<impl>(const_frame(std::move(frame))))
 {
 }
 draw_frame::draw_frame(std::vector<draw_frame> frames)
-    : impl_(new impl(std::move(frames)))
+    : impl_(std::make_shared<impl>(std::move(frames)))
 {
 }
 draw_frame::~draw_frame() {}
@@ -108,9 +114,18 @@ draw_frame& draw_frame::operator=(draw_frame other)
 }
 void                   draw_frame::swap(draw_frame& other) { impl_.swap(other.impl_); }
 const frame_transform& draw_frame::transform() const { return impl_->transform_; }
-frame_transform&       draw_frame::transform() { return impl_->transform_; }
+frame_transform&       draw_frame::transform()
+{
+    if (impl_.use_count() > 1) {
+        impl_ = std::make_shared<impl>(*impl_);
+    }
+    return impl_->transform_;
+}
 void                   draw_frame::accept(frame_visitor& visitor) const { impl_->accept(visitor); }
-bool draw_frame::operator==(const draw_frame& other) const { return impl_ && *impl_ == *other.impl_; }
+bool draw_frame::operator==(const draw_frame& other) const
+{
+    return impl_ && (impl_ == other.impl_ || *impl_ == *other.impl_);
+}
 bool draw_frame::operator!=(const draw_frame& other) const { return !(*this == other); }
 
 draw_frame draw_frame::over(draw_frame frame1, draw_frame frame2)
@@ -157,7 +172,7 @@ draw_frame draw_frame::push(draw_frame frame, const frame_transform& transform)
 draw_frame draw_frame::pop(const draw_frame& frame)
 {
     draw_frame result;
-    result.impl_->frame_ = frame.impl_->frame_;
+    result.impl_ = std::make_shared<impl>(frame.impl_->frame_);
     return result;
 }
 
@@ -171,4 +186,25 @@ draw_frame draw_frame::empty() { return draw_frame(std::vector<draw_frame>{}); }
 
 draw_frame::operator bool() const { return impl_ && impl_->frame_.which() != 0; }
 
+std::size_t image_bytes(const draw_frame& frame)
+{
+    struct image_counter : public frame_visitor
+    {
+        std::size_t bytes = 0;
+
+        void push(const frame_transform&) override {}
+        void visit(const const_frame& frame) override
+        {
+            for (std::size_t n = 0; n < frame.pixel_format_desc().planes.size(); ++n) {
+                bytes += frame.image_data(n).size();
+            }
+        }
+        void pop() override {}
+    };
+
+    image_counter visitor;
+    frame.accept(visitor);
+    return visitor.bytes;
+}
+
 }} // namespace caspar::core
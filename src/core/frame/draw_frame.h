@@ -20,11 +20,14 @@
  */
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <vector>
 
 namespace caspar { namespace core {
 
+// An immutable, reference counted node of frames and their transform. Copies share the node, which is copied on the
+// first write through transform().
 class draw_frame final
 {
   public:
@@ -61,7 +64,10 @@ class draw_frame final
 
   private:
     struct impl;
-    std::unique_ptr<impl> impl_;
+    std::shared_ptr<impl> impl_;
 };
 
+// Bytes of image data in the frames of a tree, counted for each place a frame appears in it.
+std::size_t image_bytes(const draw_frame& frame);
+
 }} // namespace caspar::core
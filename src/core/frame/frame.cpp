@@ -94,13 +94,17 @@ struct const_frame::impl
     core::pixel_format_desc                desc_     = pixel_format::invalid;
     frame_geometry                         geometry_ = frame_geometry::get_default();
     boost::any                             opaque_;
+    std::vector<const_frame>               conversions_;
+    const void*                            tag_ = nullptr;
 
     impl(std::vector<array<const std::uint8_t>> image_data,
          array<const std::int32_t>              audio_data,
-         const core::pixel_format_desc&         desc)
+         const core::pixel_format_desc&         desc,
+         std::vector<const_frame>               conversions = {})
         : image_data_(std::move(image_data))
         , audio_data_(std::move(audio_data))
         , desc_(desc)
+        , conversions_(std::move(conversions))
     {
         if (desc_.planes.size() != image_data_.size()) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -125,6 +129,7 @@ struct const_frame::impl
         , audio_data_(std::move(other.impl_->audio_data_))
         , desc_(std::move(other.impl_->desc_))
         , geometry_(std::move(other.impl_->geometry_))
+        , tag_(other.impl_->tag_)
     {
         if (desc_.planes.size() != image_data_.size()) {
             CASPAR_THROW_EXCEPTION(invalid_argument());
@@ -150,6 +155,13 @@ const_frame::const_frame(std::vector<array<const std::uint8_t>> image_data,
     : impl_(new impl(std::move(image_data), std::move(audio_data), desc))
 {
 }
+const_frame::const_frame(std::vector<array<const std::uint8_t>> image_data,
+                         array<const std::int32_t>              audio_data,
+                         const core::pixel_format_desc&         desc,
+                         std::vector<const_frame>               conversions)
+    : impl_(new impl(std::move(image_data), std::move(audio_data), desc, std::move(conversions)))
+{
+}
 const_frame::const_frame(mutable_frame&& other)
     : impl_(new impl(std::move(other)))
 {
@@ -176,5 +188,30 @@ std::size_t                      const_frame::height() const { return impl_->hei
 std::size_t                      const_frame::size() const { return impl_->size(); }
 const frame_geometry&            const_frame::geometry() const { return impl_->geometry_; }
 const boost::any&                const_frame::opaque() const { return impl_->opaque_; }
+const void*                      const_frame::stream_tag() const { return impl_ ? impl_->tag_ : nullptr; }
+const_frame                      const_frame::converted(pixel_format format) const
+{
+    if (!impl_ || impl_->desc_.format == format) {
+        return *this;
+    }
+    for (auto& conversion : impl_->conversions_) {
+        if (conversion.pixel_format_desc().format == format && conversion.height() == height()) {
+            return conversion;
+        }
+    }
+    return const_frame{};
+}
+const_frame                      const_frame::scaled(int width) const
+{
+    if (!impl_ || (impl_->desc_.format == pixel_format::bgra && impl_->width() == width)) {
+        return *this;
+    }
+    for (auto& conversion : impl_->conversions_) {
+        if (conversion.pixel_format_desc().format == pixel_format::bgra && conversion.width() == width) {
+            return conversion;
+        }
+    }
+    return const_frame{};
+}
 const_frame::operator bool() const { return impl_ != nullptr && impl_->desc_.format != core::pixel_format::invalid; }
 }} // namespace caspar::core
@@ -12,6 +12,8 @@
 
 namespace caspar { namespace core {
 
+enum class pixel_format;
+
 class mutable_frame final
 {
     friend class const_frame;
@@ -61,6 +63,10 @@ class const_frame final
     explicit const_frame(std::vector<array<const std::uint8_t>> image_data,
                          array<const std::int32_t>              audio_data,
                          const struct pixel_format_desc&        desc);
+    explicit const_frame(std::vector<array<const std::uint8_t>> image_data,
+                         array<const std::int32_t>              audio_data,
+                         const struct pixel_format_desc&        desc,
+                         std::vector<const_frame>               conversions);
     const_frame(const const_frame& other);
     const_frame(mutable_frame&& other);
 
@@ -82,6 +88,16 @@ class const_frame final
 
     const boost::any& opaque() const;
 
+    // The tag of the frame factory user that created the frame, nullptr if unknown.
+    const void* stream_tag() const;
+
+    // The same image in another pixel format, if the mixer rendered one. Returns an empty frame otherwise.
+    const_frame converted(pixel_format format) const;
+
+    // A bgra copy reduced to width pixels, if a consumer asked the mixer for one, see frame_consumer::preview_width.
+    // Returns an empty frame otherwise.
+    const_frame scaled(int width) const;
+
     const class frame_geometry& geometry() const;
 
     bool operator==(const const_frame& other) const;
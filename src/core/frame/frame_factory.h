@@ -21,8 +21,21 @@
 
 #pragma once
 
+#include "frame.h"
+
+#include <vector>
+
 namespace caspar { namespace core {
 
+// A region of an image in pixels.
+struct frame_rect
+{
+    int x      = 0;
+    int y      = 0;
+    int width  = 0;
+    int height = 0;
+};
+
 class frame_factory
 {
   public:
@@ -33,6 +46,24 @@ class frame_factory
     frame_factory(const frame_factory&) = delete;
 
     virtual class mutable_frame create_frame(const void* video_stream_tag, const struct pixel_format_desc& desc) = 0;
+
+    // Copies a BGRA texture another graphics API shares by handle, a D3D11 shared handle on Windows, on the GPU. The
+    // frame is drawn without an upload, it is empty when the factory can't import the handle.
+    virtual const_frame import_shared_texture(const void* video_stream_tag, void* handle, int width, int height)
+    {
+        return const_frame{};
+    }
+
+    // A BGRA frame of the same size as previous with only the regions of image, rows of width pixels, that changed
+    // since uploaded. The rest is copied from previous on the GPU. Empty when previous isn't resident, the caller then
+    // creates a whole frame.
+    virtual const_frame update_frame(const void*                    video_stream_tag,
+                                     const const_frame&             previous,
+                                     const void*                    image,
+                                     const std::vector<frame_rect>& regions)
+    {
+        return const_frame{};
+    }
 };
 
 }} // namespace caspar::core
\ No newline at end of file
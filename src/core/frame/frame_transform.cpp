@@ -90,6 +90,7 @@ image_transform& image_transform::operator*=(const image_transform& other)
     levels.gamma *= other.levels.gamma;
     chroma.enable |= other.chroma.enable;
     chroma.show_mask |= other.chroma.show_mask;
+    chroma.ycbcr |= other.chroma.ycbcr;
     chroma.target_hue     = std::max(other.chroma.target_hue, chroma.target_hue);
     chroma.min_saturation = std::max(other.chroma.min_saturation, chroma.min_saturation);
     chroma.min_brightness = std::max(other.chroma.min_brightness, chroma.min_brightness);
@@ -103,6 +104,12 @@ image_transform& image_transform::operator*=(const image_transform& other)
     is_mix |= other.is_mix;
     blend_mode = std::max(blend_mode, other.blend_mode);
     layer_depth += other.layer_depth;
+    if (other.field != field_mode::progressive) {
+        field = other.field;
+    }
+    if (other.scaling != scale_filter::configured) {
+        scaling = other.scaling;
+    }
 
     return *this;
 }
@@ -117,88 +124,87 @@ double do_tween(double time, double source, double dest, double duration, const
     return tween(time, source, dest - source, duration);
 };
 
-template <typename Rect>
-void do_tween_rectangle(const Rect&    source,
-                        const Rect&    dest,
-                        Rect&          out,
-                        double         time,
-                        double         duration,
-                        const tweener& tweener)
+// The tweens below take each value from tween(source, dest), everything else is picked from source and dest alike.
+template <typename Rect, typename Tween>
+void do_tween_rectangle(const Rect& source, const Rect& dest, Rect& out, const Tween& tween)
 {
-    out.ul[0] = do_tween(time, source.ul[0], dest.ul[0], duration, tweener);
-    out.ul[1] = do_tween(time, source.ul[1], dest.ul[1], duration, tweener);
-    out.lr[0] = do_tween(time, source.lr[0], dest.lr[0], duration, tweener);
-    out.lr[1] = do_tween(time, source.lr[1], dest.lr[1], duration, tweener);
+    out.ul[0] = tween(source.ul[0], dest.ul[0]);
+    out.ul[1] = tween(source.ul[1], dest.ul[1]);
+    out.lr[0] = tween(source.lr[0], dest.lr[0]);
+    out.lr[1] = tween(source.lr[1], dest.lr[1]);
 }
 
-void do_tween_corners(const corners& source,
-                      const corners& dest,
-                      corners&       out,
-                      double         time,
-                      double         duration,
-                      const tweener& tweener)
+template <typename Tween>
+void do_tween_corners(const corners& source, const corners& dest, corners& out, const Tween& tween)
 {
-    do_tween_rectangle(source, dest, out, time, duration, tweener);
+    do_tween_rectangle(source, dest, out, tween);
 
-    out.ur[0] = do_tween(time, source.ur[0], dest.ur[0], duration, tweener);
-    out.ur[1] = do_tween(time, source.ur[1], dest.ur[1], duration, tweener);
-    out.ll[0] = do_tween(time, source.ll[0], dest.ll[0], duration, tweener);
-    out.ll[1] = do_tween(time, source.ll[1], dest.ll[1], duration, tweener);
+    out.ur[0] = tween(source.ur[0], dest.ur[0]);
+    out.ur[1] = tween(source.ur[1], dest.ur[1]);
+    out.ll[0] = tween(source.ll[0], dest.ll[0]);
+    out.ll[1] = tween(source.ll[1], dest.ll[1]);
 };
 
-image_transform image_transform::tween(double                 time,
-                                       const image_transform& source,
-                                       const image_transform& dest,
-                                       double                 duration,
-                                       const tweener&         tween)
+template <typename Tween>
+image_transform do_tween_image(const image_transform& source, const image_transform& dest, const Tween& tween)
 {
     image_transform result;
 
-    result.brightness          = do_tween(time, source.brightness, dest.brightness, duration, tween);
-    result.contrast            = do_tween(time, source.contrast, dest.contrast, duration, tween);
-    result.saturation          = do_tween(time, source.saturation, dest.saturation, duration, tween);
-    result.opacity             = do_tween(time, source.opacity, dest.opacity, duration, tween);
-    result.anchor[0]           = do_tween(time, source.anchor[0], dest.anchor[0], duration, tween);
-    result.anchor[1]           = do_tween(time, source.anchor[1], dest.anchor[1], duration, tween);
-    result.fill_translation[0] = do_tween(time, source.fill_translation[0], dest.fill_translation[0], duration, tween);
-    result.fill_translation[1] = do_tween(time, source.fill_translation[1], dest.fill_translation[1], duration, tween);
-    result.fill_scale[0]       = do_tween(time, source.fill_scale[0], dest.fill_scale[0], duration, tween);
-    result.fill_scale[1]       = do_tween(time, source.fill_scale[1], dest.fill_scale[1], duration, tween);
-    result.clip_translation[0] = do_tween(time, source.clip_translation[0], dest.clip_translation[0], duration, tween);
-    result.clip_translation[1] = do_tween(time, source.clip_translation[1], dest.clip_translation[1], duration, tween);
-    result.clip_scale[0]       = do_tween(time, source.clip_scale[0], dest.clip_scale[0], duration, tween);
-    result.clip_scale[1]       = do_tween(time, source.clip_scale[1], dest.clip_scale[1], duration, tween);
-    result.angle               = do_tween(time, source.angle, dest.angle, duration, tween);
-    result.levels.max_input    = do_tween(time, source.levels.max_input, dest.levels.max_input, duration, tween);
-    result.levels.min_input    = do_tween(time, source.levels.min_input, dest.levels.min_input, duration, tween);
-    result.levels.max_output   = do_tween(time, source.levels.max_output, dest.levels.max_output, duration, tween);
-    result.levels.min_output   = do_tween(time, source.levels.min_output, dest.levels.min_output, duration, tween);
-    result.levels.gamma        = do_tween(time, source.levels.gamma, dest.levels.gamma, duration, tween);
-    result.chroma.target_hue   = do_tween(time, source.chroma.target_hue, dest.chroma.target_hue, duration, tween);
-    result.chroma.hue_width    = do_tween(time, source.chroma.hue_width, dest.chroma.hue_width, duration, tween);
-    result.chroma.min_saturation =
-        do_tween(time, source.chroma.min_saturation, dest.chroma.min_saturation, duration, tween);
-    result.chroma.min_brightness =
-        do_tween(time, source.chroma.min_brightness, dest.chroma.min_brightness, duration, tween);
-    result.chroma.softness = do_tween(time, source.chroma.softness, dest.chroma.softness, duration, tween);
-    result.chroma.spill_suppress =
-        do_tween(time, source.chroma.spill_suppress, dest.chroma.spill_suppress, duration, tween);
+    result.brightness            = tween(source.brightness, dest.brightness);
+    result.contrast              = tween(source.contrast, dest.contrast);
+    result.saturation            = tween(source.saturation, dest.saturation);
+    result.opacity               = tween(source.opacity, dest.opacity);
+    result.anchor[0]             = tween(source.anchor[0], dest.anchor[0]);
+    result.anchor[1]             = tween(source.anchor[1], dest.anchor[1]);
+    result.fill_translation[0]   = tween(source.fill_translation[0], dest.fill_translation[0]);
+    result.fill_translation[1]   = tween(source.fill_translation[1], dest.fill_translation[1]);
+    result.fill_scale[0]         = tween(source.fill_scale[0], dest.fill_scale[0]);
+    result.fill_scale[1]         = tween(source.fill_scale[1], dest.fill_scale[1]);
+    result.clip_translation[0]   = tween(source.clip_translation[0], dest.clip_translation[0]);
+    result.clip_translation[1]   = tween(source.clip_translation[1], dest.clip_translation[1]);
+    result.clip_scale[0]         = tween(source.clip_scale[0], dest.clip_scale[0]);
+    result.clip_scale[1]         = tween(source.clip_scale[1], dest.clip_scale[1]);
+    result.angle                 = tween(source.angle, dest.angle);
+    result.levels.max_input      = tween(source.levels.max_input, dest.levels.max_input);
+    result.levels.min_input      = tween(source.levels.min_input, dest.levels.min_input);
+    result.levels.max_output     = tween(source.levels.max_output, dest.levels.max_output);
+    result.levels.min_output     = tween(source.levels.min_output, dest.levels.min_output);
+    result.levels.gamma          = tween(source.levels.gamma, dest.levels.gamma);
+    result.chroma.target_hue     = tween(source.chroma.target_hue, dest.chroma.target_hue);
+    result.chroma.hue_width      = tween(source.chroma.hue_width, dest.chroma.hue_width);
+    result.chroma.min_saturation = tween(source.chroma.min_saturation, dest.chroma.min_saturation);
+    result.chroma.min_brightness = tween(source.chroma.min_brightness, dest.chroma.min_brightness);
+    result.chroma.softness       = tween(source.chroma.softness, dest.chroma.softness);
+    result.chroma.spill_suppress = tween(source.chroma.spill_suppress, dest.chroma.spill_suppress);
     result.chroma.spill_suppress_saturation =
-        do_tween(time, source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation, duration, tween);
+        tween(source.chroma.spill_suppress_saturation, dest.chroma.spill_suppress_saturation);
     result.chroma.enable    = dest.chroma.enable;
     result.chroma.show_mask = dest.chroma.show_mask;
+    result.chroma.ycbcr     = dest.chroma.ycbcr;
     result.is_key           = source.is_key || dest.is_key;
     result.invert           = source.invert || dest.invert;
     result.is_mix           = source.is_mix || dest.is_mix;
     result.blend_mode       = std::max(source.blend_mode, dest.blend_mode);
     result.layer_depth      = dest.layer_depth;
+    result.field            = dest.field;
+    result.scaling          = dest.scaling;
 
-    do_tween_rectangle(source.crop, dest.crop, result.crop, time, duration, tween);
-    do_tween_corners(source.perspective, dest.perspective, result.perspective, time, duration, tween);
+    do_tween_rectangle(source.crop, dest.crop, result.crop, tween);
+    do_tween_corners(source.perspective, dest.perspective, result.perspective, tween);
 
     return result;
 }
 
+image_transform image_transform::tween(double                 time,
+                                       const image_transform& source,
+                                       const image_transform& dest,
+                                       double                 duration,
+                                       const tweener&         tween)
+{
+    return do_tween_image(
+        source, dest, [&](double from, double to) { return do_tween(time, from, to, duration, tween); });
+}
+
 bool eq(double lhs, double rhs) { return std::abs(lhs - rhs) < 5e-8; };
 
 bool operator==(const corners& lhs, const corners& rhs)
@@ -221,8 +227,9 @@ bool operator==(const image_transform& lhs, const image_transform& rhs)
            boost::range::equal(lhs.clip_translation, rhs.clip_translation, eq) &&
            boost::range::equal(lhs.clip_scale, rhs.clip_scale, eq) && eq(lhs.angle, rhs.angle) &&
            lhs.is_key == rhs.is_key && lhs.invert == rhs.invert && lhs.is_mix == rhs.is_mix &&
-           lhs.blend_mode == rhs.blend_mode && lhs.layer_depth == rhs.layer_depth &&
-           lhs.chroma.enable == rhs.chroma.enable && lhs.chroma.show_mask == rhs.chroma.show_mask &&
+           lhs.blend_mode == rhs.blend_mode && lhs.layer_depth == rhs.layer_depth && lhs.field == rhs.field &&
+           lhs.scaling == rhs.scaling && lhs.chroma.enable == rhs.chroma.enable &&
+           lhs.chroma.show_mask == rhs.chroma.show_mask && lhs.chroma.ycbcr == rhs.chroma.ycbcr &&
            eq(lhs.chroma.target_hue, rhs.chroma.target_hue) && eq(lhs.chroma.hue_width, rhs.chroma.hue_width) &&
            eq(lhs.chroma.min_saturation, rhs.chroma.min_saturation) &&
            eq(lhs.chroma.min_brightness, rhs.chroma.min_brightness) && eq(lhs.chroma.softness, rhs.chroma.softness) &&
@@ -277,18 +284,23 @@ frame_transform frame_transform::operator*(const frame_transform& other) const
     return frame_transform(*this) *= other;
 }
 
+template <typename Tween>
+frame_transform do_tween_frame(const frame_transform& source, const frame_transform& dest, const Tween& tween)
+{
+    frame_transform result;
+    result.image_transform        = do_tween_image(source.image_transform, dest.image_transform, tween);
+    result.audio_transform.volume= tween(source.audio_transform.volume, dest.audio_transform.volume);
+    return result;
+}
+
 frame_transform frame_transform::tween(double                 time,
                                        const frame_transform& source,
                                        const frame_transform& dest,
                                        double                 duration,
                                        const tweener&         tween)
 {
-    frame_transform result;
-    result.image_transform =
-        image_transform::tween(time, source.image_transform, dest.image_transform, duration, tween);
-    result.audio_transform =
-        audio_transform::tween(time, source.audio_transform, dest.audio_transform, duration, tween);
-    return result;
+    return do_tween_frame(
+        source, dest, [&](double from, double to) { return do_tween(time, from, to, duration, tween); });
 }
 
 bool operator==(const frame_transform& lhs, const frame_transform& rhs)
@@ -311,12 +323,23 @@ tweened_transform::tweened_transform(const frame_transform& source,
 
 const frame_transform& tweened_transform::dest() const { return dest_; }
 
+bool tweened_transform::finished() const { return time_ == duration_; }
+
 frame_transform tweened_transform::fetch()
 {
-    return time_ == duration_
-               ? dest_
-               : frame_transform::tween(
-                     static_cast<double>(time_), source_, dest_, static_cast<double>(duration_), tweener_);
+    if (finished()) {
+        return dest_;
+    }
+
+    const auto time     = static_cast<double>(time_);
+    const auto duration = static_cast<double>(duration_);
+    if (!tweener_.affine()) {
+        return frame_transform::tween(time, source_, dest_, duration, tweener_);
+    }
+
+    // The progress is the same for every value, so the tweener is called once instead of for each.
+    const auto progress = tweener_(time, 0.0, 1.0, duration);
+    return do_tween_frame(source_, dest_, [=](double from, double to) { return from + (to - from) * progress; });
 }
 
 void tweened_transform::tick(int num) { time_ = std::min(time_ + num, duration_); }
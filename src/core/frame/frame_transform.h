@@ -23,6 +23,7 @@
 
 #include <common/tweener.h>
 
+#include <core/frame/pixel_format.h>
 #include <core/mixer/image/blend_modes.h>
 
 #include <boost/optional.hpp>
@@ -42,6 +43,7 @@ struct chroma
 
     bool   enable                    = false;
     bool   show_mask                 = false;
+    bool   ycbcr                     = false; // keys in the YCbCr plane of the source instead of in HSV
     double target_hue                = 0.0;
     double hue_width                 = 0.0;
     double min_saturation            = 0.0;
@@ -74,6 +76,16 @@ struct rectangle final
     std::array<double, 2> lr = {1.0, 1.0};
 };
 
+// Filter for images drawn at another size than their source. configured leaves it to ogl/scaling, an image drawn with
+// another filter takes the innermost one that is set.
+enum class scale_filter
+{
+    configured,
+    linear,
+    bicubic,
+    lanczos
+};
+
 struct image_transform final
 {
     double opacity    = 1.0;
@@ -97,6 +109,9 @@ struct image_transform final
     bool             is_mix      = false;
     core::blend_mode blend_mode  = blend_mode::normal;
     int              layer_depth = 0;
+    core::field_mode field       = field_mode::progressive;
+
+    core::scale_filter scaling = scale_filter::configured;
 
     image_transform& operator*=(const image_transform& other);
     image_transform  operator*(const image_transform& other) const;
@@ -163,6 +178,7 @@ class tweened_transform
     tweened_transform(const frame_transform& source, const frame_transform& dest, int duration, const tweener& tween);
 
     const frame_transform& dest() const;
+    bool                   finished() const;
 
     frame_transform fetch();
     void            tick(int num);
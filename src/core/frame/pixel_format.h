@@ -37,10 +37,37 @@ enum class pixel_format
     luma,
     bgr,
     rgb,
+    uyvy,
+    v210,
+    nv12,
+    r210,
+    bc3, // Block compressed, a single plane of width * height bytes.
+    bc7,
+    color,  // A solid colour, one BGRA pixel drawn by the mixer without a texture.
+    p010,   // Semi-planar like nv12 with 16 bit samples, P010, P012 and P016.
+    pgroup, // 4:2:2 10 bit of SMPTE ST 2110-20, Cb Y0 Cr Y1 big endian in 5 bytes per 2 pixels. Output only.
     count,
     invalid,
 };
 
+// YCbCr matrix of a frame, unspecified frames are taken as BT.709 from 720 lines up and BT.601 below.
+enum class color_space
+{
+    unspecified = 0,
+    bt601,
+    bt709,
+    bt2020,
+};
+
+// Field of an interlaced image. An image transform shows one field and the mixer fills in the lines of the other, see
+// shader.frag. A pixel format desc of another mode than progressive holds only the lines of its field.
+enum class field_mode
+{
+    progressive = 0,
+    upper,
+    lower,
+};
+
 struct pixel_format_desc final
 {
     struct plane
@@ -70,8 +97,17 @@ struct pixel_format_desc final
     {
     }
 
-    pixel_format       format = pixel_format::invalid;
+    pixel_format       format      = pixel_format::invalid;
+    core::color_space  color_space = core::color_space::unspecified;
+    core::field_mode   field       = core::field_mode::progressive;
     std::vector<plane> planes;
+
+    // Significant bits of the samples of ycbcr, ycbcra, nv12 and p010. Above 8 the samples take 16 bits, which hold
+    // them in the low bits like ffmpeg's planar formats, except for p010 which holds them in the high bits.
+    int bit_depth = 8;
+
+    // Pixels per line of v210, whose plane holds 4 words per 6 pixels with lines padded to 48 pixels.
+    int packed_width = 0;
 };
 
 }} // namespace caspar::core
\ No newline at end of file
@@ -31,12 +31,14 @@ FORWARD2(caspar, core, class output);
 FORWARD2(caspar, core, class image_mixer);
 FORWARD2(caspar, core, struct video_format_desc);
 FORWARD2(caspar, core, class frame_factory);
+FORWARD2(caspar, core, class frame_geometry);
 FORWARD2(caspar, core, class frame_producer);
 FORWARD2(caspar, core, class frame_consumer);
 FORWARD2(caspar, core, class draw_frame);
 FORWARD2(caspar, core, class mutable_frame);
 FORWARD2(caspar, core, class const_frame);
 FORWARD2(caspar, core, class video_channel);
+FORWARD2(caspar, core, class channel_group);
 FORWARD2(caspar, core, struct pixel_format_desc);
 FORWARD2(caspar, core, class cg_producer_registry);
 FORWARD2(caspar, core, struct frame_transform);
@@ -44,3 +46,4 @@ FORWARD2(caspar, core, struct write_frame_consumer);
 FORWARD2(caspar, core, struct frame_producer_dependencies);
 FORWARD2(caspar, core, struct module_dependencies);
 FORWARD2(caspar, core, class frame_producer_registry);
+FORWARD2(caspar, core, class media_scanner_registry);
@@ -22,6 +22,7 @@
 #include "../../StdAfx.h"
 
 #include "audio_mixer.h"
+#include "loudness_meter.h"
 
 #include <core/frame/frame.h>
 #include <core/frame/frame_transform.h>
@@ -33,16 +34,113 @@
 #include <boost/range/algorithm.hpp>
 
 #include <atomic>
+#include <cmath>
+#include <memory>
 #include <stack>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CASPAR_AUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace caspar { namespace core {
 
 using namespace boost::container;
 
+namespace {
+
+// Largest float below 2^31, anything above would not convert back to int32.
+const float sample_max = 2147483520.0f;
+const float sample_min = -2147483648.0f;
+
+// Accumulates src into dst, the gain starts at volume and grows by step for every sample frame.
+void mix_samples(float* dst, const int32_t* src, std::size_t count, int channels, float volume, float step)
+{
+    std::size_t n = 0;
+#ifdef CASPAR_AUDIO_SSE2
+    if (step == 0.0f) {
+        auto gain = _mm_set1_ps(volume);
+        for (; n + 4 <= count; n += 4) {
+            auto samples = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n)));
+            _mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_mul_ps(samples, gain)));
+        }
+    } else if (channels > 0 && (channels % 4 == 0 || 4 % channels == 0)) {
+        // The sample frame of every lane then advances in a fixed pattern.
+        const int   per   = channels % 4 == 0 ? channels / 4 : 1;
+        const float inc   = channels % 4 == 0 ? 1.0f : 4.0f / channels;
+        auto        frame = channels % 4 == 0 ? _mm_setzero_ps()
+                                              : _mm_setr_ps(0.0f,
+                                                            static_cast<float>(1 / channels),
+                                                            static_cast<float>(2 / channels),
+                                                            static_cast<float>(3 / channels));
+        auto        from  = _mm_set1_ps(volume);
+        auto        delta = _mm_set1_ps(step);
+        for (int k = 0; n + 4 <= count; n += 4) {
+            auto gain    = _mm_add_ps(from, _mm_mul_ps(delta, frame));
+            auto samples = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n)));
+            _mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_mul_ps(samples, gain)));
+            if (++k == per) {
+                k     = 0;
+                frame = _mm_add_ps(frame, _mm_set1_ps(inc));
+            }
+        }
+    }
+#endif
+    for (; n < count; ++n) {
+        auto gain = volume + step * static_cast<float>(n / channels);
+        dst[n] += static_cast<float>(src[n]) * gain;
+    }
+}
+
+// Scales and clips src into dst, peaks receives the largest absolute value per channel before clipping.
+void clip_samples(int32_t* dst, const float* src, std::size_t count, float volume, int channels, float* peaks)
+{
+    std::size_t n = 0;
+#ifdef CASPAR_AUDIO_SSE2
+    // Every lane then always carries the same channel, which lets the peaks be tracked in registers.
+    const int groups = channels % 4 == 0 ? channels / 4 : 1;
+    if (channels > 0 && (channels % 4 == 0 || 4 % channels == 0) && groups <= 16) {
+        __m128 acc[16];
+        for (int g = 0; g < groups; ++g) {
+            acc[g] = _mm_setzero_ps();
+        }
+
+        auto vol  = _mm_set1_ps(volume);
+        auto sign = _mm_set1_ps(-0.0f);
+        auto hi   = _mm_set1_ps(sample_max);
+        auto lo   = _mm_set1_ps(sample_min);
+        for (int g = 0; n + 4 <= count; n += 4, g = g + 1 < groups ? g + 1 : 0) {
+            auto sample = _mm_mul_ps(_mm_loadu_ps(src + n), vol);
+            acc[g]      = _mm_max_ps(acc[g], _mm_andnot_ps(sign, sample));
+            sample      = _mm_min_ps(_mm_max_ps(sample, lo), hi);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_cvttps_epi32(sample));
+        }
+
+        for (int g = 0; g < groups; ++g) {
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, acc[g]);
+            for (int l = 0; l < 4; ++l) {
+                auto& peak = peaks[(g * 4 + l) % channels];
+                peak       = std::max(peak, lanes[l]);
+            }
+        }
+    }
+#endif
+    for (; n < count; ++n) {
+        auto  sample = src[n] * volume;
+        auto& peak   = peaks[n % channels];
+        peak         = std::max(peak, std::abs(sample));
+        dst[n]       = static_cast<int32_t>(std::min(std::max(sample, sample_min), sample_max));
+    }
+}
+
+} // namespace
+
 struct audio_item
 {
     audio_transform      transform;
+    double               previous_volume;
     array<const int32_t> samples;
 };
 
@@ -55,6 +153,16 @@ struct audio_mixer::impl
     std::vector<audio_item>             items_;
     std::atomic<float>                  master_volume_{1.0f};
     spl::shared_ptr<diagnostics::graph> graph_;
+    std::vector<float>                  mixed_;
+    std::vector<float>                  peaks_;
+    std::atomic<int>                    loudness_interval_{0};
+    std::atomic<int>                    loudness_channels_{2};
+    std::unique_ptr<loudness_meter>     loudness_;
+    int                                 loudness_elapsed_ = 0;
+
+    // Volume of every stream in the last mix, one entry per occurrence of the tag, used to ramp volume changes.
+    flat_map<const void*, std::vector<double>> volumes_;
+    flat_map<const void*, std::vector<double>> next_volumes_;
 
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
@@ -74,12 +182,26 @@ struct audio_mixer::impl
 
     void visit(const const_frame& frame)
     {
-        if (transform_stack_.top().volume < 0.002 || !frame.audio_data())
+        auto volume   = transform_stack_.top().volume;
+        auto previous = volume;
+
+        if (auto tag = frame.stream_tag()) {
+            auto& next = next_volumes_[tag];
+            auto  it   = volumes_.find(tag);
+            if (it != volumes_.end() && it->second.size() > next.size()) {
+                previous = it->second[next.size()];
+            }
+            next.push_back(volume);
+        }
+
+        // A stream that was audible in the last mix is kept until it has been ramped down.
+        if ((volume < 0.002 && previous < 0.002) || !frame.audio_data())
             return;
 
         audio_item item;
-        item.transform = transform_stack_.top();
-        item.samples   = frame.audio_data();
+        item.transform       = transform_stack_.top();
+        item.previous_volume = previous;
+        item.samples         = frame.audio_data();
 
         items_.push_back(std::move(item));
     }
@@ -90,50 +212,85 @@ struct audio_mixer::impl
 
     float get_master_volume() { return master_volume_; }
 
+    void set_loudness(int interval_ms, int channels)
+    {
+        loudness_channels_ = channels;
+        loudness_interval_ = interval_ms;
+    }
+
+    void measure_loudness(const video_format_desc& format_desc, int nb_samples)
+    {
+        auto interval = loudness_interval_.load();
+        if (interval <= 0) {
+            loudness_.reset();
+            return;
+        }
+
+        // A new format or channel selection starts the integrated loudness over.
+        auto measured = std::min(loudness_channels_.load(), format_desc.audio_channels);
+        if (!loudness_ || loudness_->sample_rate() != format_desc.audio_sample_rate ||
+            loudness_->channels() != format_desc.audio_channels || loudness_->measured_channels() != measured) {
+            loudness_ =
+                std::make_unique<loudness_meter>(format_desc.audio_sample_rate, format_desc.audio_channels, measured);
+            loudness_elapsed_ = 0;
+        }
+
+        loudness_->update(mixed_.data(), nb_samples, master_volume_.load() / 2147483648.0f);
+
+        loudness_elapsed_ += nb_samples;
+        if (static_cast<std::int64_t>(loudness_elapsed_) * 1000 <
+            static_cast<std::int64_t>(interval) * format_desc.audio_sample_rate) {
+            return;
+        }
+        loudness_elapsed_ = 0;
+
+        auto true_peaks = loudness_->take_true_peaks();
+
+        state_["loudness/momentary"]     = static_cast<float>(loudness_->momentary());
+        state_["loudness/short-term"]    = static_cast<float>(loudness_->short_term());
+        state_["loudness/integrated"]    = static_cast<float>(loudness_->integrated());
+        state_["loudness/true-peak"]     = std::vector<float>(true_peaks.begin(), true_peaks.end());
+        state_["loudness/true-peak-max"] = static_cast<float>(loudness_->true_peak_max());
+    }
+
     array<const int32_t> mix(const video_format_desc& format_desc, int nb_samples)
     {
         auto channels = format_desc.audio_channels;
         auto items    = std::move(items_);
-        auto result   = std::vector<int32_t>(nb_samples * channels, 0);
 
-        auto mixed = std::vector<double>(nb_samples * channels, 0.0f);
+        volumes_.swap(next_volumes_);
+        next_volumes_.clear();
+        auto result   = std::vector<int32_t>(nb_samples * channels, 0);
 
+        // Accumulation buffers are reused between frames, only the result is handed out.
+        mixed_.assign(result.size(), 0.0f);
         for (auto& item : items) {
-            auto ptr  = item.samples.data();
+            // Ramp linearly from the volume of the last mix to avoid clicks on volume changes.
             auto size = std::min(item.samples.size(), result.size());
-            for (auto n = 0; n < size; ++n) {
-                mixed[n] = static_cast<double>(ptr[n]) * item.transform.volume + mixed[n];
-            }
+            auto from = static_cast<float>(item.previous_volume);
+            auto step = nb_samples > 0 ? static_cast<float>(item.transform.volume - item.previous_volume) / nb_samples
+                                       : 0.0f;
+            mix_samples(mixed_.data(), item.samples.data(), size, channels, from, step);
         }
 
-        auto master_volume = master_volume_.load();
-        for (auto n = 0; n < mixed.size(); ++n) {
-            auto sample = mixed[n] * master_volume;
-            if (sample > std::numeric_limits<int32_t>::max()) {
-                result[n] = std::numeric_limits<int32_t>::max();
-            } else if (sample < std::numeric_limits<int32_t>::min()) {
-                result[n] = std::numeric_limits<int32_t>::min();
-            } else {
-                result[n] = static_cast<int32_t>(sample);
-            }
-        }
+        peaks_.assign(channels, 0.0f);
+        clip_samples(result.data(), mixed_.data(), result.size(), master_volume_.load(), channels, peaks_.data());
+        measure_loudness(format_desc, nb_samples);
 
-        auto max = std::vector<int32_t>(channels, std::numeric_limits<int32_t>::min());
-        for (size_t n = 0; n < result.size(); n += channels) {
-            for (int ch = 0; ch < channels; ++ch) {
-                max[ch] = std::max(max[ch], std::abs(result[n + ch]));
-            }
+        auto max = std::vector<int32_t>(channels, 0);
+        for (int ch = 0; ch < channels; ++ch) {
+            max[ch] = peaks_[ch] > sample_max ? std::numeric_limits<int32_t>::max() : static_cast<int32_t>(peaks_[ch]);
         }
 
         if (boost::range::count_if(max, [](auto val) { return val >= std::numeric_limits<int32_t>::max(); }) > 0) {
             graph_->set_tag(diagnostics::tag_severity::WARNING, "audio-clipping");
         }
 
-        state_["volume"] = std::move(max);
-
         graph_->set_value("volume",
                           static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
 
+        state_["volume"] = std::move(max);
+
         return std::move(result);
     }
 };
@@ -152,5 +309,9 @@ array<const int32_t> audio_mixer::operator()(const video_format_desc& format_des
     return impl_->mix(format_desc, nb_samples);
 }
 core::monitor::state audio_mixer::state() const { return impl_->state_; }
+void                 audio_mixer::set_loudness(int interval_ms, int channels)
+{
+    impl_->set_loudness(interval_ms, channels);
+}
 
 }} // namespace caspar::core
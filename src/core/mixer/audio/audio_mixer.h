@@ -48,6 +48,10 @@ class audio_mixer final : public frame_visitor
     float                get_master_volume();
     core::monitor::state state() const;
 
+    // Measures EBU R128 loudness of the first channels channels and true-peak of all channels after the master volume,
+    // published as loudness/ every interval_ms, 0 turns the meter off.
+    void set_loudness(int interval_ms, int channels);
+
     void push(const struct frame_transform& transform) override;
     void visit(const class const_frame& frame) override;
     void pop() override;
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "loudness_meter.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CASPAR_AUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Four channels of one sample frame.
+#ifdef CASPAR_AUDIO_SSE2
+using lanes = __m128;
+
+lanes splat(float v) { return _mm_set1_ps(v); }
+lanes load(const float* src) { return _mm_loadu_ps(src); }
+void  store(float* dst, lanes v) { _mm_storeu_ps(dst, v); }
+lanes add(lanes a, lanes b) { return _mm_add_ps(a, b); }
+lanes sub(lanes a, lanes b) { return _mm_sub_ps(a, b); }
+lanes mul(lanes a, lanes b) { return _mm_mul_ps(a, b); }
+lanes max(lanes a, lanes b) { return _mm_max_ps(a, b); }
+lanes abs(lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+#else
+struct lanes
+{
+    float v[4];
+};
+
+template <typename F>
+lanes apply(lanes a, lanes b, F f)
+{
+    return {{f(a.v[0], b.v[0]), f(a.v[1], b.v[1]), f(a.v[2], b.v[2]), f(a.v[3], b.v[3])}};
+}
+
+lanes splat(float v) { return {{v, v, v, v}}; }
+lanes load(const float* src) { return {{src[0], src[1], src[2], src[3]}}; }
+void  store(float* dst, lanes v) { std::copy(v.v, v.v + 4, dst); }
+lanes add(lanes a, lanes b) { return apply(a, b, [](float x, float y) { return x + y; }); }
+lanes sub(lanes a, lanes b) { return apply(a, b, [](float x, float y) { return x - y; }); }
+lanes mul(lanes a, lanes b) { return apply(a, b, [](float x, float y) { return x * y; }); }
+lanes max(lanes a, lanes b) { return apply(a, b, [](float x, float y) { return std::max(x, y); }); }
+lanes abs(lanes a) { return apply(a, a, [](float x, float) { return std::abs(x); }); }
+#endif
+
+// BS.1770-4 Annex 2, a 48 tap interpolation filter split into 4 phases, phases 2 and 3 mirror 1 and 0.
+const int   tp_taps               = 12;
+const float tp_phases[2][tp_taps] = {
+    {0.0017089843750f,
+     0.0109863281250f,
+     -0.0196533203125f,
+     0.0332031250000f,
+     -0.0594482421875f,
+     0.1373291015625f,
+     0.9721679687500f,
+     -0.1022949218750f,
+     0.0476074218750f,
+     -0.0266113281250f,
+     0.0148925781250f,
+     -0.0083007812500f},
+    {-0.0291748046875f,
+     0.0292968750000f,
+     -0.0517578125000f,
+     0.0891113281250f,
+     -0.1665039062500f,
+     0.4650878906250f,
+     0.7797851562500f,
+     -0.2003173828125f,
+     0.1015625000000f,
+     -0.0582275390625f,
+     0.0330810546875f,
+     -0.0189208984375f},
+};
+
+const int    block_ms       = 100; // Gating blocks of 400 ms advance in steps of 100 ms.
+const int    momentary_n    = 4;
+const int    short_term_n   = 30;
+const double absolute_gate  = -70.0;
+const double relative_gate  = -10.0;
+const int    histogram_bins = 1000; // 0.1 LU from the absolute gate.
+
+double to_lufs(double energy) { return energy > 0.0 ? -0.691 + 10.0 * std::log10(energy) : -HUGE_VAL; }
+
+} // namespace
+
+const double loudness_meter::silence_lufs = -120.0;
+
+struct loudness_meter::impl
+{
+    const int sample_rate_;
+    const int channels_;
+    const int measured_;
+    const int groups_;
+    const int measured_groups_;
+    const int block_size_;
+
+    // K-weighting as a high shelf followed by a high pass, both transposed direct form II.
+    std::array<float, 5> shelf_;
+    std::array<float, 2> high_pass_; // a1 and a2, b is 1 -2 1.
+    std::vector<float>   filter_state_;
+
+    std::vector<float> weights_;
+    std::vector<float> scratch_;
+
+    // Per channel energy of the running 100 ms block, and the weighted sums of the last completed ones.
+    std::vector<double>                block_energy_;
+    int                                block_pos_ = 0;
+    std::array<double, short_term_n>   blocks_{};
+    int                                block_count_ = 0;
+    std::array<int, histogram_bins>    histogram_count_{};
+    std::array<double, histogram_bins> histogram_energy_{};
+    std::int64_t                       gated_count_  = 0;
+    double                             gated_energy_ = 0.0;
+
+    // Newest sample first, every sample is stored twice so the taps can be read without wrapping.
+    std::vector<float> tp_history_;
+    int                tp_pos_ = 0;
+    std::vector<float> tp_peaks_;
+    float              tp_max_ = 0.0f;
+
+    impl(int sample_rate, int channels, int measured)
+        : sample_rate_(std::max(1, sample_rate))
+        , channels_(std::max(1, channels))
+        , measured_(std::min(std::max(1, measured), channels_))
+        , groups_((channels_ + 3) / 4)
+        , measured_groups_((measured_ + 3) / 4)
+        , block_size_(std::max(1, sample_rate_ * block_ms / 1000))
+        , filter_state_(groups_ * 4 * 4, 0.0f)
+        , weights_(groups_ * 4, 0.0f)
+        , block_energy_(measured_, 0.0)
+        , tp_history_(groups_ * tp_taps * 2 * 4, 0.0f)
+        , tp_peaks_(channels_, 0.0f)
+    {
+        const double pi = 3.14159265358979323846;
+        {
+            const double f0 = 1681.974450955533;
+            const double g  = 3.999843853973347;
+            const double q  = 0.7071752369554196;
+            const double k  = std::tan(pi * f0 / sample_rate_);
+            const double vh = std::pow(10.0, g / 20.0);
+            const double vb = std::pow(vh, 0.4996667741545416);
+            const double a0 = 1.0 + k / q + k * k;
+
+            shelf_ = {static_cast<float>((vh + vb * k / q + k * k) / a0),
+                      static_cast<float>(2.0 * (k * k - vh) / a0),
+                      static_cast<float>((vh - vb * k / q + k * k) / a0),
+                      static_cast<float>(2.0 * (k * k - 1.0) / a0),
+                      static_cast<float>((1.0 - k / q + k * k) / a0)};
+        }
+        {
+            const double f0 = 38.13547087602444;
+            const double q  = 0.5003270373238773;
+            const double k  = std::tan(pi * f0 / sample_rate_);
+            const double a0 = 1.0 + k / q + k * k;
+
+            high_pass_ = {static_cast<float>(2.0 * (k * k - 1.0) / a0), static_cast<float>((1.0 - k / q + k * k) / a0)};
+        }
+
+        for (int ch = 0; ch < measured_; ++ch) {
+            weights_[ch] = measured_ >= 6 && ch == 3 ? 0.0f : measured_ >= 6 && (ch == 4 || ch == 5) ? 1.41f : 1.0f;
+        }
+    }
+
+    void update(const float* samples, std::size_t frames, float gain)
+    {
+        // Pads the channels to whole registers.
+        scratch_.assign(frames * groups_ * 4, 0.0f);
+        for (std::size_t n = 0; n < frames; ++n) {
+            auto src = samples + n * channels_;
+            auto dst = scratch_.data() + n * groups_ * 4;
+            for (int ch = 0; ch < channels_; ++ch) {
+                dst[ch] = src[ch] * gain;
+            }
+        }
+
+        for (std::size_t offset = 0; offset < frames;) {
+            auto count = std::min<std::size_t>(frames - offset, block_size_ - block_pos_);
+            for (int g = 0; g < groups_; ++g) {
+                process(g, scratch_.data() + offset * groups_ * 4, count, g < measured_groups_);
+            }
+            tp_pos_ = static_cast<int>((tp_pos_ + tp_taps - count % tp_taps) % tp_taps);
+
+            offset += count;
+            block_pos_ += static_cast<int>(count);
+            if (block_pos_ == block_size_) {
+                end_block();
+            }
+        }
+    }
+
+    void process(int g, const float* src, std::size_t count, bool measured)
+    {
+        const auto stride = groups_ * 4;
+
+        auto state = filter_state_.data() + g * 16;
+        auto s1    = load(state);
+        auto s2    = load(state + 4);
+        auto h1    = load(state + 8);
+        auto h2    = load(state + 12);
+
+        const auto b0 = splat(shelf_[0]);
+        const auto b1 = splat(shelf_[1]);
+        const auto b2 = splat(shelf_[2]);
+        const auto a1 = splat(shelf_[3]);
+        const auto a2 = splat(shelf_[4]);
+        const auto c1 = splat(high_pass_[0]);
+        const auto c2 = splat(high_pass_[1]);
+        const auto m2 = splat(-2.0f);
+
+        lanes phases[2][tp_taps];
+        for (int p = 0; p < 2; ++p) {
+            for (int k = 0; k < tp_taps; ++k) {
+                phases[p][k] = splat(tp_phases[p][k]);
+            }
+        }
+
+        auto history = tp_history_.data() + g * tp_taps * 2 * 4;
+        auto pos     = tp_pos_;
+        auto energy  = splat(0.0f);
+        auto peak    = splat(0.0f);
+
+        for (std::size_t n = 0; n < count; ++n) {
+            auto x = load(src + g * 4 + n * stride);
+
+            if (measured) {
+                auto y = add(mul(b0, x), s1);
+                s1     = sub(add(mul(b1, x), s2), mul(a1, y));
+                s2     = sub(mul(b2, x), mul(a2, y));
+
+                auto z = add(y, h1);
+                h1     = sub(add(mul(m2, y), h2), mul(c1, z));
+                h2     = sub(y, mul(c2, z));
+
+                energy = add(energy, mul(z, z));
+            }
+
+            pos = pos == 0 ? tp_taps - 1 : pos - 1;
+            store(history + pos * 4, x);
+            store(history + (pos + tp_taps) * 4, x);
+
+            auto taps = history + pos * 4;
+            auto p0   = splat(0.0f);
+            auto p1   = splat(0.0f);
+            auto p2   = splat(0.0f);
+            auto p3   = splat(0.0f);
+            for (int k = 0; k < tp_taps; ++k) {
+                auto s = load(taps + k * 4);
+                p0     = add(p0, mul(phases[0][k], s));
+                p1     = add(p1, mul(phases[1][k], s));
+                p2     = add(p2, mul(phases[1][tp_taps - 1 - k], s));
+                p3     = add(p3, mul(phases[0][tp_taps - 1 - k], s));
+            }
+            peak = max(peak, max(max(abs(x), abs(p0)), max(max(abs(p1), abs(p2)), abs(p3))));
+        }
+
+        store(state, s1);
+        store(state + 4, s2);
+        store(state + 8, h1);
+        store(state + 12, h2);
+
+        alignas(16) float values[4];
+        store(values, peak);
+        for (int l = 0; l < 4 && g * 4 + l < channels_; ++l) {
+            auto& tp = tp_peaks_[g * 4 + l];
+            tp       = std::max(tp, values[l]);
+            tp_max_  = std::max(tp_max_, values[l]);
+        }
+
+        if (measured) {
+            store(values, energy);
+            for (int l = 0; l < 4 && g * 4 + l < measured_; ++l) {
+                block_energy_[g * 4 + l] += values[l];
+            }
+        }
+    }
+
+    void end_block()
+    {
+        double sum = 0.0;
+        for (int ch = 0; ch < measured_; ++ch) {
+            sum += weights_[ch] * block_energy_[ch] / block_size_;
+            block_energy_[ch] = 0.0;
+        }
+        block_pos_ = 0;
+
+        std::rotate(blocks_.begin(), blocks_.begin() + 1, blocks_.end());
+        blocks_.back() = sum;
+        block_count_   = std::min(block_count_ + 1, short_term_n);
+
+        if (block_count_ < momentary_n) {
+            return;
+        }
+
+        auto energy = mean(momentary_n);
+        auto lufs   = to_lufs(energy);
+        if (lufs < absolute_gate) {
+            return;
+        }
+
+        auto bin = std::min(static_cast<int>((lufs - absolute_gate) * 10.0), histogram_bins - 1);
+        histogram_count_[bin] += 1;
+        histogram_energy_[bin] += energy;
+        gated_count_ += 1;
+        gated_energy_ += energy;
+    }
+
+    double mean(int n) const
+    {
+        double sum = 0.0;
+        for (int i = short_term_n - n; i < short_term_n; ++i) {
+            sum += blocks_[i];
+        }
+        return sum / n;
+    }
+
+    double momentary() const
+    {
+        return block_count_ < momentary_n ? silence_lufs : std::max(silence_lufs, to_lufs(mean(momentary_n)));
+    }
+
+    double short_term() const
+    {
+        return block_count_ < short_term_n ? silence_lufs : std::max(silence_lufs, to_lufs(mean(short_term_n)));
+    }
+
+    double integrated() const
+    {
+        if (gated_count_ == 0) {
+            return silence_lufs;
+        }
+
+        // Blocks are gated by the 0.1 LU bin they fall into.
+        auto gate  = to_lufs(gated_energy_ / gated_count_) + relative_gate;
+        auto first = std::max(0, static_cast<int>((gate - absolute_gate) * 10.0));
+
+        std::int64_t count  = 0;
+        double       energy = 0.0;
+        for (int bin = first; bin < histogram_bins; ++bin) {
+            count += histogram_count_[bin];
+            energy += histogram_energy_[bin];
+        }
+        return count == 0 ? silence_lufs : std::max(silence_lufs, to_lufs(energy / count));
+    }
+
+    std::vector<double> take_true_peaks()
+    {
+        std::vector<double> result(channels_);
+        for (int ch = 0; ch < channels_; ++ch) {
+            result[ch]    = to_dbtp(tp_peaks_[ch]);
+            tp_peaks_[ch] = 0.0f;
+        }
+        return result;
+    }
+
+    static double to_dbtp(float peak)
+    {
+        return peak > 0.0f ? std::max(silence_lufs, 20.0 * std::log10(static_cast<double>(peak))) : silence_lufs;
+    }
+};
+
+loudness_meter::loudness_meter(int sample_rate, int channels, int measured_channels)
+    : impl_(new impl(sample_rate, channels, measured_channels))
+{
+}
+void                loudness_meter::update(const float* samples, std::size_t frames, float gain)
+{
+    impl_->update(samples, frames, gain);
+}
+double              loudness_meter::momentary() const { return impl_->momentary(); }
+double              loudness_meter::short_term() const { return impl_->short_term(); }
+double              loudness_meter::integrated() const { return impl_->integrated(); }
+std::vector<double> loudness_meter::take_true_peaks() { return impl_->take_true_peaks(); }
+double              loudness_meter::true_peak_max() const { return impl::to_dbtp(impl_->tp_max_); }
+int                 loudness_meter::sample_rate() const { return impl_->sample_rate_; }
+int                 loudness_meter::channels() const { return impl_->channels_; }
+int                 loudness_meter::measured_channels() const { return impl_->measured_; }
+
+}} // namespace caspar::core
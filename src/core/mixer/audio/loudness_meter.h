@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// EBU R128 / ITU-R BS.1770-4 loudness and true-peak of an interleaved stream, four channels per SIMD register.
+// Loudness is measured over the first measured_channels channels, taken as L R C LFE Ls Rs when there are six or more,
+// true-peak over every channel.
+class loudness_meter final
+{
+    loudness_meter(const loudness_meter&);
+    loudness_meter& operator=(const loudness_meter&);
+
+  public:
+    loudness_meter(int sample_rate, int channels, int measured_channels);
+
+    // Samples are scaled by gain to full scale 1.0.
+    void update(const float* samples, std::size_t frames, float gain);
+
+    // LUFS, silence_lufs until there is a block to measure.
+    double momentary() const;
+    double short_term() const;
+    double integrated() const;
+
+    // Per channel dBTP since the last call, and the highest of all channels since the meter was created.
+    std::vector<double> take_true_peaks();
+    double              true_peak_max() const;
+
+    int sample_rate() const;
+    int channels() const;
+    int measured_channels() const;
+
+    static const double silence_lufs;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+};
+
+}} // namespace caspar::core
@@ -24,9 +24,11 @@
 #include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
 #include <core/frame/frame_visitor.h>
+#include <core/monitor/monitor.h>
 
 #include <cstdint>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -45,9 +47,24 @@ class image_mixer
     void visit(const class const_frame& frame) override     = 0;
     void pop() override                                     = 0;
 
-    virtual std::future<array<const uint8_t>> operator()(const struct video_format_desc& format_desc) = 0;
+    // Renders the frame and reads it back once for every desc, returning the planes of all descs in order. Descs of a
+    // field, which all descs share, only get the lines of that field.
+    virtual std::future<std::vector<array<const uint8_t>>>
+    operator()(const struct video_format_desc& format_desc, const std::vector<struct pixel_format_desc>& descs) = 0;
+
+    // Sets up in the background what rendering the format for the descs takes, ahead of a switch to it.
+    virtual void prepare(const struct video_format_desc&              format_desc,
+                         const std::vector<struct pixel_format_desc>& descs)
+    {
+    }
 
     class mutable_frame create_frame(const void* tag, const struct pixel_format_desc& desc) override = 0;
+
+    // Keeps the rendered images referenced by the planes read back from then on, so the mixed frame is drawn from them
+    // when it is routed to another channel on the same device.
+    virtual void keep_output(bool keep) {}
+
+    virtual core::monitor::state state() const { return {}; }
 };
 
 }} // namespace caspar::core
\ No newline at end of file
@@ -35,11 +35,76 @@
 #include <core/frame/pixel_format.h>
 #include <core/video_format.h>
 
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 
 namespace caspar { namespace core {
 
+pixel_format_desc output_pixel_format_desc(pixel_format format, const video_format_desc& format_desc, field_mode field)
+{
+    const auto height = field != field_mode::progressive ? format_desc.height / 2 : format_desc.height;
+
+    auto desc  = pixel_format_desc(format);
+    desc.field = field;
+    switch (format) {
+        case pixel_format::uyvy:
+            desc.planes.push_back(pixel_format_desc::plane(format_desc.width / 2, height, 4));
+            break;
+        case pixel_format::v210:
+            // 6 pixels per 4 words, lines padded to 48 pixels (128 bytes).
+            desc.planes.push_back(pixel_format_desc::plane((format_desc.width + 47) / 48 * 32, height, 4));
+            break;
+        case pixel_format::r210:
+            desc.planes.push_back(pixel_format_desc::plane(format_desc.width, height, 4));
+            break;
+        case pixel_format::pgroup:
+            // The bytes of a line of pgroups in texels of 4, the last one padded.
+            desc.planes.push_back(pixel_format_desc::plane((format_desc.width / 2 * 5 + 3) / 4, height, 4));
+            break;
+        case pixel_format::nv12:
+            desc.planes.push_back(pixel_format_desc::plane(format_desc.width, height, 1));
+            desc.planes.push_back(pixel_format_desc::plane(format_desc.width / 2, height / 2, 2));
+            break;
+        default:
+            desc.format = pixel_format::bgra;
+            desc.planes.push_back(pixel_format_desc::plane(format_desc.width, height, 4));
+            break;
+    }
+    return desc;
+}
+
+pixel_format_desc preview_pixel_format_desc(int width, const video_format_desc& format_desc, field_mode field)
+{
+    const auto height = field != field_mode::progressive ? format_desc.height / 2 : format_desc.height;
+
+    auto desc  = pixel_format_desc(pixel_format::bgra);
+    desc.field = field;
+    desc.planes.push_back(
+        pixel_format_desc::plane(width, std::max(1, (height * width + format_desc.width / 2) / format_desc.width), 4));
+    return desc;
+}
+
+std::vector<pixel_format_desc> output_pixel_format_descs(const video_format_desc&         format_desc,
+                                                         const std::vector<pixel_format>& pixel_formats,
+                                                         field_mode                       field,
+                                                         const std::vector<int>&          preview_widths)
+{
+    std::vector<pixel_format_desc> descs;
+    for (auto format : pixel_formats) {
+        descs.push_back(output_pixel_format_desc(format, format_desc, field));
+    }
+    for (auto width : preview_widths) {
+        if (width < format_desc.width) {
+            descs.push_back(preview_pixel_format_desc(width, format_desc, field));
+        }
+    }
+    return descs;
+}
+
 struct mixer::impl
 {
     monitor::state                       state_;
@@ -47,64 +112,169 @@ struct mixer::impl
     spl::shared_ptr<diagnostics::graph>  graph_;
     audio_mixer                          audio_mixer_{graph_};
     spl::shared_ptr<image_mixer>         image_mixer_;
-    std::queue<std::future<const_frame>> buffer_;
+    const bool                           audio_only_;
+
+    // Fixed ring of the readback_depth - 1 frames in flight between ticks, the next slot holds the oldest.
+    std::vector<std::future<const_frame>> ring_;
+    std::size_t                           ring_index_ = 0;
+
+    // Output layouts, only rebuilt when the format, the requested pixel formats, the field or the previews change.
+    video_format_desc                                     descs_format_;
+    std::vector<pixel_format>                             descs_pixel_formats_;
+    field_mode                                            descs_field_ = field_mode::progressive;
+    std::vector<int>                                      descs_preview_widths_;
+    std::shared_ptr<const std::vector<pixel_format_desc>> descs_;
 
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
 
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
+    impl(int                                 channel_index,
+         spl::shared_ptr<diagnostics::graph> graph,
+         spl::shared_ptr<image_mixer>        image_mixer,
+         int                                 readback_depth,
+         bool                                audio_only)
         : channel_index_(channel_index)
         , graph_(std::move(graph))
         , image_mixer_(std::move(image_mixer))
+        , audio_only_(audio_only)
+        , ring_(audio_only ? 0 : std::max(1, readback_depth) - 1)
     {
+        state_["readback-depth"] = static_cast<int>(ring_.size() + 1);
+        state_["audio-only"]     = audio_only_;
+    }
+
+    const_frame mix_audio(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+    {
+        static const auto desc = [] {
+            auto desc = pixel_format_desc(pixel_format::bgra);
+            desc.planes.push_back(pixel_format_desc::plane(1, 1, 4));
+            return desc;
+        }();
+        static const auto image = array<const uint8_t>(std::vector<uint8_t>(4, 0));
+
+        for (auto& frame : frames) {
+            frame.accept(audio_mixer_);
+        }
+        auto audio = audio_mixer_(format_desc, nb_samples);
+
+        state_["audio"] = audio_mixer_.state();
+
+        return const_frame({image}, std::move(audio), desc);
     }
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+    const_frame operator()(std::vector<draw_frame>          frames,
+                           const video_format_desc&         format_desc,
+                           int                              nb_samples,
+                           const std::vector<pixel_format>& pixel_formats,
+                           field_mode                       field,
+                           const std::vector<int>&          preview_widths)
     {
+        if (audio_only_) {
+            return mix_audio(std::move(frames), format_desc, nb_samples);
+        }
+
         for (auto& frame : frames) {
             frame.accept(audio_mixer_);
             frame.transform().image_transform.layer_depth = 1;
             frame.accept(*image_mixer_);
         }
 
-        auto image = (*image_mixer_)(format_desc);
+        if (!descs_ || format_desc != descs_format_ || pixel_formats != descs_pixel_formats_ || field != descs_field_ ||
+            preview_widths != descs_preview_widths_) {
+            descs_ = std::make_shared<std::vector<pixel_format_desc>>(
+                output_pixel_format_descs(format_desc, pixel_formats, field, preview_widths));
+            descs_format_         = format_desc;
+            descs_pixel_formats_  = pixel_formats;
+            descs_field_          = field;
+            descs_preview_widths_ = preview_widths;
+        }
+
+        auto image = (*image_mixer_)(format_desc, *descs_);
         auto audio = audio_mixer_(format_desc, nb_samples);
 
         state_["audio"] = audio_mixer_.state();
+        state_["image"] = image_mixer_->state();
 
-        buffer_.push(std::async(
+        auto frame = std::async(
             std::launch::deferred,
-            [image = std::move(image), audio = std::move(audio), graph = graph_, format_desc, tag = this]() mutable {
-                auto desc = pixel_format_desc(pixel_format::bgra);
-                desc.planes.push_back(pixel_format_desc::plane(format_desc.width, format_desc.height, 4));
-                std::vector<array<const uint8_t>> image_data;
-                image_data.emplace_back(std::move(image.get()));
-                return const_frame(std::move(image_data), std::move(audio), desc);
-            }));
-
-        if (buffer_.size() < 2) {
-            return const_frame{};
+            [image = std::move(image), audio = std::move(audio), descs = descs_]() mutable {
+                auto planes = image.get();
+                auto plane  = std::make_move_iterator(planes.begin());
+
+                auto take_planes = [&](const pixel_format_desc& desc) {
+                    auto end        = plane + desc.planes.size();
+                    auto image_data = std::vector<array<const uint8_t>>(plane, end);
+                    plane           = end;
+                    return image_data;
+                };
+
+                auto image_data = take_planes((*descs)[0]);
+
+                std::vector<const_frame> conversions;
+                for (std::size_t n = 1; n < descs->size(); ++n) {
+                    conversions.emplace_back(take_planes((*descs)[n]), audio, (*descs)[n]);
+                }
+
+                return const_frame(std::move(image_data), std::move(audio), (*descs)[0], std::move(conversions));
+            });
+
+        if (ring_.empty()) {
+            return frame.get();
         }
 
-        auto frame = std::move(buffer_.front().get());
-        buffer_.pop();
-        return frame;
+        auto& slot  = ring_[ring_index_];
+        ring_index_ = (ring_index_ + 1) % ring_.size();
+
+        auto oldest = std::move(slot);
+        slot        = std::move(frame);
+
+        return oldest.valid() ? oldest.get() : const_frame{};
+    }
+
+    void prepare(const video_format_desc&         format_desc,
+                 const std::vector<pixel_format>& pixel_formats,
+                 field_mode                       field,
+                 const std::vector<int>&          preview_widths)
+    {
+        if (!audio_only_) {
+            image_mixer_->prepare(format_desc,
+                                  output_pixel_format_descs(format_desc, pixel_formats, field, preview_widths));
+        }
     }
 
     void set_master_volume(float volume) { audio_mixer_.set_master_volume(volume); }
 
     float get_master_volume() { return audio_mixer_.get_master_volume(); }
+
+    void set_loudness(int interval_ms, int channels) { audio_mixer_.set_loudness(interval_ms, channels); }
 };
 
-mixer::mixer(int channel_index, spl::shared_ptr<diagnostics::graph> graph, spl::shared_ptr<image_mixer> image_mixer)
-    : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer)))
+mixer::mixer(int                                 channel_index,
+             spl::shared_ptr<diagnostics::graph> graph,
+             spl::shared_ptr<image_mixer>        image_mixer,
+             int                                 readback_depth,
+             bool                                audio_only)
+    : impl_(new impl(channel_index, std::move(graph), std::move(image_mixer), readback_depth, audio_only))
+{
+}
+void mixer::prepare(const video_format_desc&         format_desc,
+                    const std::vector<pixel_format>& pixel_formats,
+                    field_mode                       field,
+                    const std::vector<int>&          preview_widths)
 {
+    impl_->prepare(format_desc, pixel_formats, field, preview_widths);
 }
 void        mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
 float       mixer::get_master_volume() { return impl_->get_master_volume(); }
-const_frame mixer::operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples)
+void        mixer::set_loudness(int interval_ms, int channels) { impl_->set_loudness(interval_ms, channels); }
+const_frame mixer::operator()(std::vector<draw_frame>          frames,
+                              const video_format_desc&         format_desc,
+                              int                              nb_samples,
+                              const std::vector<pixel_format>& pixel_formats,
+                              field_mode                       field,
+                              const std::vector<int>&          preview_widths)
 {
-    return (*impl_)(std::move(frames), format_desc, nb_samples);
+    return (*impl_)(std::move(frames), format_desc, nb_samples, pixel_formats, field, preview_widths);
 }
 mutable_frame mixer::create_frame(const void* tag, const pixel_format_desc& desc)
 {
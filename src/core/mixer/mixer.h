@@ -24,9 +24,12 @@
 #include <common/forward.h>
 #include <common/memory.h>
 
+#include <core/frame/pixel_format.h>
 #include <core/fwd.h>
 #include <core/monitor/monitor.h>
 
+#include <vector>
+
 FORWARD2(caspar, diagnostics, class graph);
 
 namespace caspar { namespace core {
@@ -37,15 +40,35 @@ class mixer final
     mixer& operator=(const mixer&);
 
   public:
+    // readback_depth frames are in flight, a frame is returned readback_depth - 1 ticks after it was mixed. An audio
+    // only mixer mixes just the audio, at once, and returns frames with a single transparent pixel for the image.
     explicit mixer(int                                         channel_index,
                    spl::shared_ptr<caspar::diagnostics::graph> graph,
-                   spl::shared_ptr<image_mixer>                image_mixer);
+                   spl::shared_ptr<image_mixer>                image_mixer,
+                   int                                         readback_depth = 2,
+                   bool                                        audio_only     = false);
+
+    // A field other than progressive renders only its lines of the frame, at half the height. Each preview width
+    // below the width of the format adds a reduced bgra copy of the frame, see const_frame::scaled.
+    const_frame operator()(std::vector<draw_frame>          frames,
+                           const video_format_desc&         format_desc,
+                           int                              nb_samples,
+                           const std::vector<pixel_format>& pixel_formats  = {pixel_format::bgra},
+                           field_mode                       field          = field_mode::progressive,
+                           const std::vector<int>&          preview_widths = {});
 
-    const_frame operator()(std::vector<draw_frame> frames, const video_format_desc& format_desc, int nb_samples);
+    // Sets up in the background what mixing frames of another format takes, ahead of a switch to it.
+    void prepare(const video_format_desc&         format_desc,
+                 const std::vector<pixel_format>& pixel_formats  = {pixel_format::bgra},
+                 field_mode                       field          = field_mode::progressive,
+                 const std::vector<int>&          preview_widths = {});
 
     void  set_master_volume(float volume);
     float get_master_volume();
 
+    // See audio_mixer::set_loudness.
+    void set_loudness(int interval_ms, int channels);
+
     mutable_frame create_frame(const void* tag, const pixel_format_desc& desc);
 
     core::monitor::state state() const;
@@ -26,6 +26,7 @@
 #include "consumer/frame_consumer.h"
 #include "producer/cg_proxy.h"
 #include "producer/frame_producer.h"
+#include "producer/media_scanner.h"
 
 namespace caspar { namespace core {
 
@@ -34,13 +35,16 @@ struct module_dependencies
     const spl::shared_ptr<cg_producer_registry>    cg_registry;
     const spl::shared_ptr<frame_producer_registry> producer_registry;
     const spl::shared_ptr<frame_consumer_registry> consumer_registry;
+    const spl::shared_ptr<media_scanner_registry>  scanner_registry;
 
     module_dependencies(spl::shared_ptr<cg_producer_registry>    cg_registry,
                         spl::shared_ptr<frame_producer_registry> producer_registry,
-                        spl::shared_ptr<frame_consumer_registry> consumer_registry)
+                        spl::shared_ptr<frame_consumer_registry> consumer_registry,
+                        spl::shared_ptr<media_scanner_registry>  scanner_registry)
         : cg_registry(std::move(cg_registry))
         , producer_registry(std::move(producer_registry))
         , consumer_registry(std::move(consumer_registry))
+        , scanner_registry(std::move(scanner_registry))
     {
     }
 };
@@ -25,6 +25,7 @@
 
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/container/flat_map.hpp>
@@ -98,6 +99,10 @@ class state
         : data_(other.data_)
     {
     }
+    state(state&& other)
+        : data_(std::move(other.data_))
+    {
+    }
     state(data_map_t data)
         : data_(std::move(data))
     {
@@ -107,6 +112,11 @@ class state
         data_ = other.data_;
         return *this;
     }
+    state& operator=(state&& other)
+    {
+        data_ = std::move(other.data_);
+        return *this;
+    }
 
     template <typename T>
     state_proxy operator[](const T& key)
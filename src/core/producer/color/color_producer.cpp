@@ -43,6 +43,19 @@ namespace caspar { namespace core {
 draw_frame
 create_color_frame(void* tag, const spl::shared_ptr<frame_factory>& frame_factory, const std::vector<uint32_t>& values)
 {
+    if (values.size() == 1) {
+        // Kept in host memory and drawn as a colour, there is nothing to upload.
+        core::pixel_format_desc desc(pixel_format::color);
+        desc.planes.push_back(core::pixel_format_desc::plane(1, 1, 4));
+
+        array<std::uint8_t> pixel(4);
+        *reinterpret_cast<uint32_t*>(pixel.begin()) = values.at(0);
+
+        std::vector<array<const std::uint8_t>> image_data;
+        image_data.push_back(std::move(pixel));
+        return core::draw_frame(core::const_frame(std::move(image_data), array<const std::int32_t>{}, desc));
+    }
+
     core::pixel_format_desc desc(pixel_format::bgra);
     desc.planes.push_back(core::pixel_format_desc::plane(static_cast<int>(values.size()), 1, 4));
     auto frame = frame_factory->create_frame(tag, desc);
@@ -27,12 +27,13 @@
 #include "../frame/draw_frame.h"
 
 #include "color/color_producer.h"
+#include "multiview/multiview_producer.h"
 #include "route/route_producer.h"
 #include "separated/separated_producer.h"
 
 #include <common/assert.h>
+#include <common/destroyer.h>
 #include <common/except.h>
-#include <common/executor.h>
 #include <common/future.h>
 #include <common/memory.h>
 
@@ -93,13 +94,9 @@ const spl::shared_ptr<frame_producer>& frame_producer::empty()
     return producer;
 }
 
-std::shared_ptr<executor>& producer_destroyer()
+std::shared_ptr<destroyer>& producer_destroyer()
 {
-    static auto destroyer = [] {
-        auto result = std::make_shared<executor>(L"Producer destroyer");
-        result->set_capacity(std::numeric_limits<unsigned int>::max());
-        return result;
-    }();
+    static auto destroyer = std::make_shared<caspar::destroyer>(L"Producer destroyer", 4, std::chrono::seconds(5));
 
     return destroyer;
 }
@@ -114,7 +111,7 @@ std::atomic<bool>& destroy_producers_in_separate_thread()
 void destroy_producers_synchronously()
 {
     destroy_producers_in_separate_thread() = false;
-    // Join destroyer, executing rest of producers in queue synchronously.
+    // Waits for the destroyer to finish the producers already queued.
     producer_destroyer().reset();
 }
 
@@ -139,13 +136,11 @@ class destroy_producer_proxy : public frame_producer
         if (!destroyer)
             return;
 
-        CASPAR_VERIFY(destroyer->size() < 8);
-
+        auto str      = producer_->print();
         auto producer = new spl::shared_ptr<frame_producer>(std::move(producer_));
 
-        destroyer->begin_invoke([=] {
+        destroyer->post(str, [=] {
             std::unique_ptr<spl::shared_ptr<frame_producer>> pointer_guard(producer);
-            auto                                             str = (*producer)->print();
             try {
                 if (!producer->unique())
                     CASPAR_LOG(debug) << str << L" Not destroyed on asynchronous destruction thread: "
@@ -172,6 +167,10 @@ class destroy_producer_proxy : public frame_producer
     {
         return producer_->leading_producer(producer);
     }
+    void                 preload() override { producer_->preload(); }
+    void                 priority(producer_priority priority) override { producer_->priority(priority); }
+    void                 audible(bool audible) override { producer_->audible(audible); }
+    bool                 keyed() const override { return producer_->keyed(); }
     uint32_t             frame_number() const override { return producer_->frame_number(); }
     uint32_t             nb_frames() const override { return producer_->nb_frames(); }
     draw_frame           last_frame() override { return producer_->last_frame(); }
@@ -203,6 +202,11 @@ spl::shared_ptr<core::frame_producer> do_create_producer(const frame_producer_de
         return producer;
     }
 
+    producer = create_multiview_producer(dependencies, params);
+    if (producer != frame_producer::empty()) {
+        return producer;
+    }
+
     if (std::any_of(factories.begin(), factories.end(), [&](const producer_factory_t& factory) -> bool {
             try {
                 producer = factory(dependencies, params);
@@ -229,7 +233,7 @@ frame_producer_registry::create_producer(const frame_producer_dependencies& depe
     auto  producer           = do_create_producer(dependencies, params, producer_factories);
     auto  key_producer       = frame_producer::empty();
 
-    if (!params.empty() && !boost::contains(params.at(0), L"://")) {
+    if (!params.empty() && !boost::contains(params.at(0), L"://") && !producer->keyed()) {
         try // to find a key file.
         {
             auto params_copy = params;
@@ -32,6 +32,7 @@
 
 #include <boost/optional.hpp>
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <future>
@@ -41,6 +42,14 @@
 
 namespace caspar { namespace core {
 
+// How soon a producer is shown, set by its layer. Producers that aren't shown may decode less ahead, or pause.
+enum class producer_priority
+{
+    foreground, // played, or previewed, on the layer
+    next,       // loaded in the background
+    idle,       // stopped
+};
+
 class frame_producer
 {
     frame_producer(const frame_producer&);
@@ -112,8 +121,16 @@ class frame_producer
         return core::draw_frame::still(first_frame_);
     }
     virtual void                            leading_producer(const spl::shared_ptr<frame_producer>&) {}
+    // Called on every tick while the producer is loaded in the background, before it is played.
+    virtual void                            preload() {}
+    virtual void                            priority(producer_priority) {}
+    // Whether the audio of the producer can be heard, false e.g. while its layer is muted. Producers may then skip
+    // decoding audio, as long as they keep delivering frames on time.
+    virtual void                            audible(bool) {}
     virtual spl::shared_ptr<frame_producer> following_producer() const { return core::frame_producer::empty(); }
     virtual boost::optional<int64_t>        auto_play_delta() const { return boost::none; }
+    // Whether the producer already draws the key of a separate key file, which is then not looked up again.
+    virtual bool                            keyed() const { return false; }
 };
 
 class frame_producer_registry;
@@ -126,6 +143,16 @@ struct frame_producer_dependencies
     spl::shared_ptr<const frame_producer_registry> producer_registry;
     spl::shared_ptr<const cg_producer_registry>    cg_registry;
 
+    // Of the channel the producer is created for, producers that buffer take their defaults from it.
+    latency_profile latency = latency_profile::normal;
+
+    // Set for offline channels, see video_channel::offline. Producers wait for their frames instead of underflowing.
+    bool offline = false;
+
+    // When the producer was asked for, e.g. when the AMCP command creating it was received. Producers that report
+    // their load times measure them from it.
+    std::chrono::steady_clock::time_point requested = std::chrono::steady_clock::now();
+
     frame_producer_dependencies(const spl::shared_ptr<core::frame_factory>&           frame_factory,
                                 const std::vector<spl::shared_ptr<video_channel>>&    channels,
                                 const video_format_desc&                              format_desc,
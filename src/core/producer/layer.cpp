@@ -39,6 +39,7 @@ struct layer::impl
 
     bool auto_play_ = false;
     bool paused_    = false;
+    bool audible_   = true;
 
   public:
     void pause() { paused_ = true; }
@@ -50,12 +51,17 @@ struct layer::impl
         background_ = std::move(producer);
         auto_play_  = auto_play;
 
+        background_->priority(producer_priority::next);
+        background_->audible(audible_);
+
         if (auto_play_ && foreground_ == frame_producer::empty()) {
             play();
         } else if (preview) {
             foreground_ = std::move(background_);
             background_ = frame_producer::empty();
             paused_     = true;
+
+            foreground_->priority(producer_priority::foreground);
         }
     }
 
@@ -71,14 +77,26 @@ struct layer::impl
             foreground_ = std::move(background_);
             background_ = frame_producer::empty();
 
+            foreground_->priority(producer_priority::foreground);
+
             auto_play_ = false;
         }
 
         paused_ = false;
     }
 
+    void audible(bool audible)
+    {
+        if (audible != audible_) {
+            audible_ = audible;
+            foreground_->audible(audible);
+            background_->audible(audible);
+        }
+    }
+
     void stop()
     {
+        foreground_->priority(producer_priority::idle);
         foreground_ = frame_producer::empty();
         auto_play_  = false;
     }
@@ -103,6 +121,8 @@ struct layer::impl
                 }
             }
 
+            background_->preload();
+
             auto frame = paused_ ? core::draw_frame{} : foreground_->receive(nb_samples);
             if (!frame) {
                 frame = foreground_->last_frame();
@@ -163,6 +183,7 @@ void       layer::play() { impl_->play(); }
 void       layer::pause() { impl_->pause(); }
 void       layer::resume() { impl_->resume(); }
 void       layer::stop() { impl_->stop(); }
+void       layer::audible(bool audible) { impl_->audible(audible); }
 draw_frame layer::receive(const video_format_desc& format_desc, int nb_samples)
 {
     return impl_->receive(format_desc, nb_samples);
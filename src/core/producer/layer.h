@@ -49,6 +49,9 @@ class layer final
     void resume();
     void stop();
 
+    // Passed on to the producers, see frame_producer::audible.
+    void audible(bool audible);
+
     draw_frame receive(const video_format_desc& format_desc, int nb_samples);
     draw_frame receive_background(const video_format_desc& format_desc, int nb_samples);
 
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "media_scanner.h"
+
+#include <mutex>
+
+namespace caspar { namespace core {
+
+struct media_scanner_registry::impl
+{
+    mutable std::mutex             mutex_;
+    std::shared_ptr<media_scanner> scanner_;
+};
+
+media_scanner_registry::media_scanner_registry()
+    : impl_(new impl)
+{
+}
+
+void media_scanner_registry::register_media_scanner(spl::shared_ptr<media_scanner> scanner)
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    impl_->scanner_ = std::move(scanner);
+}
+
+std::shared_ptr<media_scanner> media_scanner_registry::get_media_scanner() const
+{
+    std::lock_guard<std::mutex> lock(impl_->mutex_);
+    return impl_->scanner_;
+}
+
+}} // namespace caspar::core
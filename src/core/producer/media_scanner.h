@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace core {
+
+// Answers the media library queries of AMCP in process. Every call returns a complete AMCP response, or an empty
+// string when the request should go to the external media-scanner instead.
+class media_scanner
+{
+  public:
+    virtual ~media_scanner() {}
+
+    virtual std::wstring cls()                                        = 0;
+    virtual std::wstring cinf(const std::wstring& name)               = 0;
+    virtual std::wstring thumbnail_list()                             = 0;
+    virtual std::wstring thumbnail_retrieve(const std::wstring& name) = 0;
+    virtual std::wstring thumbnail_generate(const std::wstring& name) = 0;
+    virtual std::wstring thumbnail_generate_all()                     = 0;
+};
+
+class media_scanner_registry
+{
+  public:
+    media_scanner_registry();
+
+    void register_media_scanner(spl::shared_ptr<media_scanner> scanner);
+
+    // nullptr until a module registers a scanner.
+    std::shared_ptr<media_scanner> get_media_scanner() const;
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+
+    media_scanner_registry(const media_scanner_registry&) = delete;
+    media_scanner_registry& operator=(const media_scanner_registry&) = delete;
+};
+
+}} // namespace caspar::core
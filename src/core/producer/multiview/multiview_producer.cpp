@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../../StdAfx.h"
+
+#include "multiview_producer.h"
+
+#include "../route/route_producer.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_channel.h>
+
+#include <common/except.h>
+#include <common/future.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/range/algorithm/find_if.hpp>
+#include <boost/regex.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace caspar { namespace core {
+
+namespace {
+
+enum class tally_t
+{
+    off = 0,
+    preview,
+    program
+};
+
+// Range of the audio meters.
+const double METER_FLOOR_DB = -60.0;
+
+// Peak fall back of the audio meters.
+const double METER_DECAY_DB_PER_SECOND = 20.0;
+
+const int MAX_METERS = 8;
+
+struct glyph
+{
+    char         character;
+    std::uint8_t rows[7];
+};
+
+// 5x7 glyphs for labels, lower case is drawn as upper case and anything else as '?'.
+const glyph GLYPHS[] = {
+    {'#', {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A}},
+    {'(', {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}},
+    {')', {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}},
+    {'-', {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}},
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}},
+    {'/', {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}},
+    {'0', {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}},
+    {'1', {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'2', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}},
+    {'3', {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}},
+    {'4', {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}},
+    {'5', {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}},
+    {'6', {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}},
+    {'7', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}},
+    {'8', {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}},
+    {'9', {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}},
+    {':', {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}},
+    {'?', {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}},
+    {'A', {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},
+    {'B', {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}},
+    {'C', {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}},
+    {'D', {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}},
+    {'E', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}},
+    {'F', {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}},
+    {'G', {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}},
+    {'H', {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}},
+    {'I', {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}},
+    {'J', {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}},
+    {'K', {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}},
+    {'L', {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}},
+    {'M', {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}},
+    {'N', {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}},
+    {'O', {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}},
+    {'P', {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}},
+    {'Q', {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}},
+    {'R', {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}},
+    {'S', {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}},
+    {'T', {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}},
+    {'U', {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}},
+    {'V', {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}},
+    {'W', {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}},
+    {'X', {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}},
+    {'Y', {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}},
+    {'Z', {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}},
+    {'_', {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}},
+};
+
+const glyph& find_glyph(wchar_t c)
+{
+    const auto character = c < 128 ? static_cast<char>(std::toupper(static_cast<int>(c))) : '?';
+    for (auto& g : GLYPHS) {
+        if (g.character == character) {
+            return g;
+        }
+    }
+    return find_glyph(L'?');
+}
+
+int label_width(const std::wstring& text, int scale) { return static_cast<int>(text.size() * 6 + 3) * scale; }
+
+int label_height(int scale) { return 11 * scale; }
+
+// White text on a translucent background, scale pixels per font pixel.
+draw_frame create_label(void*                                 tag,
+                        const spl::shared_ptr<frame_factory>& frame_factory,
+                        const std::wstring&                   text,
+                        int                                   scale)
+{
+    const auto width  = label_width(text, scale);
+    const auto height = label_height(scale);
+
+    pixel_format_desc desc(pixel_format::bgra);
+    desc.planes.push_back(pixel_format_desc::plane(width, height, 4));
+    auto frame = frame_factory->create_frame(tag, desc);
+
+    auto data = reinterpret_cast<std::uint32_t*>(frame.image_data(0).data());
+    std::fill(data, data + width * height, 0xB0000000);
+
+    for (std::size_t n = 0; n < text.size(); ++n) {
+        if (text[n] == L' ') {
+            continue;
+        }
+        const auto& g = find_glyph(text[n]);
+        for (auto y = 0; y < 7 * scale; ++y) {
+            for (auto x = 0; x < 5 * scale; ++x) {
+                if ((g.rows[y / scale] & (0x10 >> (x / scale))) != 0) {
+                    data[(y + 2 * scale) * width + (n * 6 + 2) * scale + x] = 0xFFFFFFFF;
+                }
+            }
+        }
+    }
+
+    return draw_frame(std::move(frame));
+}
+
+draw_frame create_solid(void* tag, const spl::shared_ptr<frame_factory>& frame_factory, std::uint32_t value)
+{
+    pixel_format_desc desc(pixel_format::bgra);
+    desc.planes.push_back(pixel_format_desc::plane(1, 1, 4));
+    auto frame = frame_factory->create_frame(tag, desc);
+    std::memcpy(frame.image_data(0).data(), &value, sizeof(value));
+    return draw_frame(std::move(frame));
+}
+
+// Places frame at x, y with size w, h in normalized coordinates, without its audio.
+draw_frame place(draw_frame frame, double x, double y, double w, double h)
+{
+    frame_transform transform;
+    transform.image_transform.fill_translation = {x, y};
+    transform.image_transform.fill_scale       = {w, h};
+    transform.audio_transform.volume           = 0.0;
+    return draw_frame::push(std::move(frame), transform);
+}
+
+// Mixes the audio of a routed frame as the audio mixer would and takes the peak of every channel.
+class audio_peaks : public frame_visitor
+{
+    const int           channels_;
+    std::vector<double> volumes_{1.0};
+    std::vector<double> mix_;
+
+  public:
+    explicit audio_peaks(int channels)
+        : channels_(channels)
+    {
+    }
+
+    void push(const frame_transform& transform) override
+    {
+        volumes_.push_back(volumes_.back() * transform.audio_transform.volume);
+    }
+
+    void pop() override { volumes_.pop_back(); }
+
+    void visit(const const_frame& frame) override
+    {
+        const auto  volume = volumes_.back();
+        const auto& audio  = frame.audio_data();
+        if (volume < 0.001 || audio.size() == 0) {
+            return;
+        }
+        mix_.resize(std::max(mix_.size(), audio.size()), 0.0);
+        for (std::size_t n = 0; n < audio.size(); ++n) {
+            mix_[n] += static_cast<double>(audio.data()[n]) * volume;
+        }
+    }
+
+    // dBFS of every channel, METER_FLOOR_DB for silence.
+    std::vector<double> peaks() const
+    {
+        std::vector<double> peaks(channels_, 0.0);
+        for (std::size_t n = 0; n < mix_.size(); ++n) {
+            auto& peak = peaks[n % channels_];
+            peak       = std::max(peak, std::abs(mix_[n]) / 2147483648.0);
+        }
+        for (auto& peak : peaks) {
+            peak = peak > 0.0 ? std::max(METER_FLOOR_DB, 20.0 * std::log10(peak)) : METER_FLOOR_DB;
+        }
+        return peaks;
+    }
+};
+
+const wchar_t* const TALLY_NAMES[] = {L"off", L"preview", L"program"};
+
+struct tile
+{
+    std::wstring                    source;
+    spl::shared_ptr<frame_producer> producer;
+    int                             channels;
+    draw_frame                      frame;
+    draw_frame                      label;
+    int                             label_width  = 0;
+    int                             label_height = 0;
+    std::vector<double>             levels;
+
+    tile(std::wstring source, spl::shared_ptr<frame_producer> producer, int channels)
+        : source(std::move(source))
+        , producer(std::move(producer))
+        , channels(channels)
+    {
+    }
+};
+
+} // namespace
+
+class multiview_producer : public frame_producer
+{
+    monitor::state state_;
+
+    const spl::shared_ptr<frame_factory> frame_factory_;
+    const video_format_desc              format_desc_;
+    const int                            columns_;
+    const int                            rows_;
+
+    std::vector<tile>             tiles_;
+    std::vector<std::atomic<int>> tally_;
+
+    draw_frame tally_frames_[3];
+    draw_frame meter_background_;
+    draw_frame meter_frames_[3];
+
+  public:
+    multiview_producer(const frame_producer_dependencies& dependencies,
+                       std::vector<tile>                  tiles,
+                       int                                columns,
+                       const std::vector<std::wstring>&   labels)
+        : frame_factory_(dependencies.frame_factory)
+        , format_desc_(dependencies.format_desc)
+        , columns_(columns)
+        , rows_((static_cast<int>(tiles.size()) + columns - 1) / columns)
+        , tiles_(std::move(tiles))
+        , tally_(tiles_.size())
+    {
+        tally_frames_[static_cast<int>(tally_t::off)]     = create_solid(this, frame_factory_, 0xFF303030);
+        tally_frames_[static_cast<int>(tally_t::preview)] = create_solid(this, frame_factory_, 0xFF00C000);
+        tally_frames_[static_cast<int>(tally_t::program)] = create_solid(this, frame_factory_, 0xFFE00000);
+        meter_background_                                 = create_solid(this, frame_factory_, 0xA0000000);
+        meter_frames_[0]                                  = create_solid(this, frame_factory_, 0xFF00C000);
+        meter_frames_[1]                                  = create_solid(this, frame_factory_, 0xFFE0E000);
+        meter_frames_[2]                                  = create_solid(this, frame_factory_, 0xFFE00000);
+
+        // Labels are rendered once at the pixel size they are shown at.
+        const auto tile_width  = format_desc_.width / columns_ - 4 * border();
+        const auto tile_height = format_desc_.height / rows_ - 4 * border();
+        const auto scale       = std::max(1, tile_height / 14 / 11);
+        const auto max_chars   = std::max(1, (tile_width / scale - 3) / 6);
+        for (std::size_t n = 0; n < tiles_.size(); ++n) {
+            auto text = n < labels.size() ? labels[n] : L"CH " + tiles_[n].source;
+            if (static_cast<int>(text.size()) > max_chars) {
+                text.resize(max_chars);
+            }
+            tiles_[n].label        = create_label(this, frame_factory_, text, scale);
+            tiles_[n].label_width  = label_width(text, scale);
+            tiles_[n].label_height = label_height(scale);
+            tiles_[n].levels = std::vector<double>(std::min(tiles_[n].channels, MAX_METERS), METER_FLOOR_DB);
+        }
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // frame_producer
+
+    draw_frame receive_impl(int nb_samples) override
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        const auto decay = METER_DECAY_DB_PER_SECOND / format_desc_.fps;
+
+        std::vector<draw_frame> frames;
+        for (std::size_t n = 0; n < tiles_.size(); ++n) {
+            auto& tile  = tiles_[n];
+            auto  frame = tile.producer->receive(nb_samples);
+            if (frame) {
+                // Late routes keep showing their last frame.
+                tile.frame = frame;
+
+                audio_peaks visitor(tile.channels);
+                frame.accept(visitor);
+                const auto peaks = visitor.peaks();
+                for (std::size_t c = 0; c < tile.levels.size(); ++c) {
+                    tile.levels[c] = std::max(peaks[c], tile.levels[c] - decay);
+                }
+            }
+            draw_tile(n, frames);
+        }
+        return draw_frame(std::move(frames));
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        if (params.size() < 2 || !boost::iequals(params.at(0), L"TALLY")) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected TALLY tile [OFF|PREVIEW|PROGRAM]"));
+        }
+
+        const auto index = boost::lexical_cast<int>(params.at(1)) - 1;
+        if (index < 0 || index >= static_cast<int>(tally_.size())) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid tile: " + params.at(1)));
+        }
+
+        auto tally = tally_t::off;
+        if (params.size() > 2 && boost::iequals(params.at(2), L"PREVIEW")) {
+            tally = tally_t::preview;
+        } else if (params.size() > 2 && boost::iequals(params.at(2), L"PROGRAM")) {
+            tally = tally_t::program;
+        } else if (params.size() > 2 && !boost::iequals(params.at(2), L"OFF")) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid tally: " + params.at(2)));
+        }
+        tally_[index] = static_cast<int>(tally);
+
+        return make_ready_future<std::wstring>(L"");
+    }
+
+    std::wstring print() const override { return L"multiview[" + std::to_wstring(tiles_.size()) + L"]"; }
+
+    std::wstring name() const override { return L"multiview"; }
+
+    core::monitor::state state() const override { return state_; }
+
+  private:
+    int border() const { return std::max(2, format_desc_.height / 270); }
+
+    void draw_tile(std::size_t n, std::vector<draw_frame>& frames) const
+    {
+        const auto& tile  = tiles_[n];
+        const auto  px    = 1.0 / format_desc_.width;
+        const auto  py    = 1.0 / format_desc_.height;
+        const auto  bx    = border() * px;
+        const auto  by    = border() * py;
+        const auto  x     = static_cast<double>(n % columns_) / columns_;
+        const auto  y     = static_cast<double>(n / columns_) / rows_;
+        const auto  w     = 1.0 / columns_;
+        const auto  h     = 1.0 / rows_;
+        const auto  tally = tally_[n].load();
+
+        frames.push_back(place(tally_frames_[tally], x + bx, y + by, w - 2 * bx, h - 2 * by));
+
+        const auto image_x = x + 2 * bx;
+        const auto image_y = y + 2 * by;
+        const auto image_w = w - 4 * bx;
+        const auto image_h = h - 4 * by;
+        if (tile.frame) {
+            frames.push_back(place(tile.frame, image_x, image_y, image_w, image_h));
+        }
+
+        // One bar per audio channel along the right edge.
+        const auto bar_w    = std::max(2, format_desc_.width / 384) * px;
+        const auto meters_w = tile.levels.size() * (bar_w + px) + px;
+        const auto meters_h = image_h - 2 * by;
+        const auto meters_x = image_x + image_w - bx - meters_w;
+        const auto meters_y = image_y + by;
+        frames.push_back(place(meter_background_, meters_x, meters_y, meters_w, meters_h));
+        for (std::size_t c = 0; c < tile.levels.size(); ++c) {
+            const auto db    = tile.levels[c];
+            const auto level = (db - METER_FLOOR_DB) / -METER_FLOOR_DB;
+            const auto color = db > -6.0 ? 2 : db > -18.0 ? 1 : 0;
+            const auto bar_h = meters_h * std::max(0.0, std::min(1.0, level));
+            const auto bar_x = meters_x + px + c * (bar_w + px);
+            if (bar_h > py) {
+                frames.push_back(place(meter_frames_[color], bar_x, meters_y + meters_h - bar_h, bar_w, bar_h));
+            }
+        }
+
+        const auto label_w = tile.label_width * px;
+        const auto label_h = tile.label_height * py;
+        frames.push_back(
+            place(tile.label, image_x + (image_w - label_w) / 2, image_y + image_h - by - label_h, label_w, label_h));
+    }
+
+    void update_state()
+    {
+        monitor::state state;
+        for (std::size_t n = 0; n < tiles_.size(); ++n) {
+            state["tile"][n + 1]["source"] = tiles_[n].source;
+            state["tile"][n + 1]["tally"]  = TALLY_NAMES[tally_[n].load()];
+        }
+        state_ = std::move(state);
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_multiview_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"MULTIVIEW")) {
+        return core::frame_producer::empty();
+    }
+
+    static boost::wregex expr(L"(?<CHANNEL>\\d+)(?<LAYER>-\\d+)?");
+
+    std::vector<tile> tiles;
+    for (std::size_t n = 1; n < params.size(); ++n) {
+        boost::wsmatch what;
+        if (!boost::regex_match(params.at(n), what, expr)) {
+            break;
+        }
+
+        auto channel    = boost::lexical_cast<int>(what["CHANNEL"].str());
+        auto channel_it = boost::find_if(
+            dependencies.channels, [=](spl::shared_ptr<core::video_channel> ch) { return ch->index() == channel; });
+        if (channel_it == dependencies.channels.end()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(channel)));
+        }
+
+        // Whole channels are shown from their mixed output, layers are composited again.
+        std::vector<std::wstring> route_params{L"route://" + params.at(n)};
+        if (!what["LAYER"].matched) {
+            route_params.push_back(L"MIXED");
+        }
+        tiles.emplace_back(params.at(n),
+                           create_route_producer(dependencies, route_params),
+                           (*channel_it)->video_format_desc().audio_channels);
+    }
+
+    if (tiles.empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"MULTIVIEW needs at least one channel"));
+    }
+
+    const auto count   = static_cast<int>(tiles.size());
+    auto       columns = get_param(L"COLUMNS", params, 0);
+    if (columns < 1) {
+        columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    }
+    columns = std::min(columns, count);
+
+    std::vector<std::wstring> labels;
+    auto                      labels_str = get_param(L"LABELS", params, std::wstring());
+    if (!labels_str.empty()) {
+        boost::split(labels, labels_str, boost::is_any_of(L"|"));
+    }
+
+    return spl::make_shared<multiview_producer>(dependencies, std::move(tiles), columns, labels);
+}
+
+}} // namespace caspar::core
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/producer/frame_producer.h>
+
+#include <string>
+#include <vector>
+
+namespace caspar { namespace core {
+
+// PLAY 1-10 MULTIVIEW 2 3 4-10 [COLUMNS n] [LABELS "name|name|..."] shows routed channels and layers as tiles with
+// labels and audio meters, CALL 1-10 TALLY tile [OFF|PREVIEW|PROGRAM] colours the border of a tile.
+spl::shared_ptr<core::frame_producer> create_multiview_producer(const core::frame_producer_dependencies& dependencies,
+                                                                const std::vector<std::wstring>&         params);
+
+}} // namespace caspar::core
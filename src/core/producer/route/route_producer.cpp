@@ -21,48 +21,139 @@
 #include "route_producer.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/memory.h>
 #include <common/param.h>
+#include <common/scope_exit.h>
 #include <common/timer.h>
 
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/frame_visitor.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/audio/audio_mixer.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 #include <core/video_channel.h>
+#include <core/video_format.h>
 
 #include <boost/range/algorithm/find_if.hpp>
+#include <boost/rational.hpp>
 #include <boost/regex.hpp>
-#include <boost/signals2.hpp>
 
 #include <tbb/concurrent_queue.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
 namespace caspar { namespace core {
 
+using route_clock = std::chrono::steady_clock;
+
+namespace {
+
+// The most samples a frame of a tree carries, those of the tick it was mixed on.
+struct sample_counter : public frame_visitor
+{
+    const int channels;
+    int       samples = 0;
+
+    explicit sample_counter(int channels)
+        : channels(std::max(1, channels))
+    {
+    }
+
+    void push(const frame_transform&) override {}
+    void visit(const const_frame& frame) override
+    {
+        samples = std::max(samples, static_cast<int>(frame.audio_data().size()) / channels);
+    }
+    void pop() override {}
+};
+
+} // namespace
+
 class route_producer : public frame_producer
 {
+    struct routed_frame
+    {
+        core::draw_frame        frame;
+        route_clock::time_point time;
+        std::int64_t            bytes;
+    };
+
+    monitor::state                      state_;
     spl::shared_ptr<diagnostics::graph> graph_;
 
-    tbb::concurrent_bounded_queue<core::draw_frame> buffer_;
+    tbb::concurrent_bounded_queue<routed_frame> buffer_;
+    diagnostics::memory::held_bytes             buffer_held_{"route/buffers"};
 
     caspar::timer produce_timer_;
     caspar::timer consume_timer_;
 
-    std::shared_ptr<route>             route_;
-    boost::signals2::scoped_connection connection_;
+    std::shared_ptr<route> route_;
+
+    // Frames kept buffered in adaptive mode, 0 for a fixed buffer.
+    const int                     target_;
+    bool                          primed_  = false;
+    double                        fill_    = 0.0;
+    double                        latency_ = 0.0;
+    std::atomic<std::int64_t>     dropped_{0};
+    std::int64_t                  late_ = 0;
+    std::atomic<route_clock::rep> last_signal_{0};
+
+    // Source frames per tick of this channel and how far the source is into the next one. Routes between channels of
+    // different rates take the frames due on each tick, repeating or skipping them in a steady cadence, and hand
+    // out their audio at the rate of this channel.
+    const boost::rational<int> rate_;
+    boost::rational<int>       phase_ = 0;
+    audio_mixer                audio_mixer_{graph_};
+    std::vector<std::int32_t>  samples_;
+
+    // Filter the source is drawn with when its size differs from that of this channel.
+    const scale_filter scaling_;
+
+    std::shared_ptr<void> subscription_;
 
     core::draw_frame frame_;
 
   public:
-    route_producer(std::shared_ptr<route> route, int buffer)
+    // buffer is in frames of the source.
+    route_producer(std::shared_ptr<route>   route,
+                   const video_format_desc& format_desc,
+                   int                      buffer,
+                   bool                     adaptive,
+                   scale_filter             scaling)
         : route_(route)
-        , connection_(route_->signal.connect([this](const core::draw_frame& frame) {
-            if (!buffer_.try_push(frame)) {
+        , target_(!adaptive    ? 0
+                  : buffer > 0 ? buffer
+                               : (route->format_desc.field_count + 1) * frames_per_tick(route, format_desc))
+        , rate_(route->format_desc.framerate / format_desc.framerate)
+        , scaling_(route->format_desc.width != format_desc.width || route->format_desc.height != format_desc.height
+                       ? scaling
+                       : scale_filter::configured)
+        , subscription_(route_->subscribe([this](const core::draw_frame& frame) {
+            const auto now   = route_clock::now();
+            const auto bytes = static_cast<std::int64_t>(image_bytes(frame));
+            if (buffer_.try_push(routed_frame{frame, now, bytes})) {
+                buffer_held_.add(bytes);
+            } else {
+                ++dropped_;
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
             }
+            last_signal_ = now.time_since_epoch().count();
             graph_->set_value("produce-time", produce_timer_.elapsed() * route_->format_desc.fps * 0.5);
             produce_timer_.restart();
         }))
     {
-        buffer_.set_capacity(buffer > 0 ? buffer : route->format_desc.field_count);
+        // Adaptive routes have room for bursts and drain the surplus themselves.
+        buffer_.set_capacity(target_ > 0  ? target_ * 2 + 2
+                             : buffer > 0 ? buffer
+                                          : route->format_desc.field_count * frames_per_tick(route, format_desc));
 
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
@@ -72,33 +163,159 @@ class route_producer : public frame_producer
         diagnostics::register_graph(graph_);
 
         CASPAR_LOG(debug) << print() << L" Initialized";
+        if (rate_ != 1 || scaling_ != scale_filter::configured) {
+            CASPAR_LOG(info) << print() << L" Converting " << route->format_desc.name << L" to " << format_desc.name
+                             << L".";
+        }
     }
 
     draw_frame last_frame() override
     {
-        if (!frame_) {
-            buffer_.try_pop(frame_);
+        routed_frame routed;
+        if (!frame_ && try_pop(routed)) {
+            frame_ = scaled(routed.frame);
         }
         return core::draw_frame::still(frame_);
     }
 
     draw_frame receive_impl(int nb_samples) override
     {
-        core::draw_frame frame;
-        if (!buffer_.try_pop(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
-        } else {
-            frame_ = frame;
-        }
+        CASPAR_SCOPE_EXIT { update_state(); };
 
         graph_->set_value("consume-time", consume_timer_.elapsed() * route_->format_desc.fps * 0.5);
         consume_timer_.restart();
-        return frame;
+
+        auto due = 1;
+        if (rate_ != 1) {
+            phase_ += rate_;
+            due = boost::rational_cast<int>(phase_);
+            phase_ -= due;
+        }
+
+        // A slower source repeats its last frame.
+        if (due == 0 && frame_) {
+            return with_audio(core::draw_frame::still(frame_), nb_samples);
+        }
+
+        const auto size = static_cast<int>(buffer_.size());
+
+        if (target_ > 0) {
+            if (!primed_) {
+                if (size < target_) {
+                    return core::draw_frame{};
+                }
+                primed_ = true;
+                fill_   = size;
+            }
+
+            // The surplus is drained a frame at a time once the average stays above the target, bursts are kept.
+            fill_ = fill_ * 0.95 + size * 0.05;
+            routed_frame skipped;
+            if (fill_ > target_ + 1.0 && size > target_ && try_pop(skipped)) {
+                ++dropped_;
+                fill_ -= 1.0;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+        }
+
+        // A faster source skips the frames before the last one due, their audio is kept.
+        routed_frame routed;
+        auto         popped = 0;
+        for (routed_frame next; popped < std::max(1, due) && try_pop(next); ++popped) {
+            if (rate_ != 1) {
+                mix_audio(next.frame);
+            }
+            routed = std::move(next);
+        }
+        if (popped == 0) {
+            ++late_;
+            primed_ = false;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            return core::draw_frame{};
+        }
+
+        const auto age = std::chrono::duration<double>(route_clock::now() - routed.time).count();
+        latency_       = age * route_->format_desc.fps;
+        frame_         = scaled(routed.frame);
+        return rate_ != 1 ? with_audio(core::draw_frame::still(frame_), nb_samples) : frame_;
     }
 
+    core::monitor::state state() const override { return state_; }
+
     std::wstring print() const override { return L"route[" + route_->name + L"]"; }
 
     std::wstring name() const override { return L"route"; }
+
+  private:
+    static int frames_per_tick(const std::shared_ptr<route>& route, const video_format_desc& format_desc)
+    {
+        return std::max(1, static_cast<int>(std::ceil(route->format_desc.fps / format_desc.fps)));
+    }
+
+    draw_frame scaled(draw_frame frame) const
+    {
+        if (frame && scaling_ != scale_filter::configured) {
+            frame.transform().image_transform.scaling = scaling_;
+        }
+        return frame;
+    }
+
+    void mix_audio(const draw_frame& frame)
+    {
+        sample_counter counter(route_->format_desc.audio_channels);
+        frame.accept(counter);
+        frame.accept(audio_mixer_);
+
+        auto mixed = audio_mixer_(route_->format_desc, counter.samples);
+        samples_.insert(samples_.end(), mixed.begin(), mixed.end());
+    }
+
+    // The frame with the samples due on this tick, padded with silence when the source is behind.
+    draw_frame with_audio(draw_frame frame, int nb_samples)
+    {
+        const auto count     = static_cast<std::size_t>(nb_samples * route_->format_desc.audio_channels);
+        const auto available = std::min(count, samples_.size());
+
+        std::vector<std::int32_t> samples(count, 0);
+        std::copy_n(samples_.begin(), available, samples.begin());
+        samples_.erase(samples_.begin(), samples_.begin() + available);
+
+        // More than two ticks ahead is the drift between the clocks of the channels, dropped rather than kept as
+        // latency.
+        if (samples_.size() > count * 2) {
+            samples_.erase(samples_.begin(), samples_.end() - count);
+        }
+
+        auto audio = const_frame(
+            {}, array<const std::int32_t>(std::move(samples)), pixel_format_desc(pixel_format::invalid));
+        return draw_frame(std::vector<draw_frame>{std::move(frame), draw_frame(std::move(audio))});
+    }
+
+    bool try_pop(routed_frame& routed)
+    {
+        if (!buffer_.try_pop(routed)) {
+            return false;
+        }
+        buffer_held_.add(-routed.bytes);
+        return true;
+    }
+
+    void update_state()
+    {
+        // Where in the source frame period this channel ticks, close to 0 or 1 the two keep crossing.
+        const auto since = route_clock::now() - route_clock::time_point(route_clock::duration(last_signal_.load()));
+        const auto phase = std::chrono::duration<double>(since).count() * route_->format_desc.fps;
+
+        monitor::state state;
+        state["route/latency"] = latency_;
+        state["route/phase"]   = phase - std::floor(phase);
+        state["route/buffer"]  = static_cast<int>(buffer_.size());
+        state["route/target"]  = target_;
+        state["route/dropped"] = dropped_.load();
+        state["route/late"]    = late_;
+        state["route/rate"]    = boost::rational_cast<double>(rate_);
+        state_                 = std::move(state);
+    }
 };
 
 spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_producer_dependencies& dependencies,
@@ -120,6 +337,8 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
             mode = core::route_mode::background;
         else if (contains_param(L"NEXT", params))
             mode = core::route_mode::next;
+    } else if (contains_param(L"MIXED", params)) {
+        mode = core::route_mode::mixed;
     }
 
     auto channel_it = boost::find_if(dependencies.channels,
@@ -129,9 +348,22 @@ spl::shared_ptr<core::frame_producer> create_route_producer(const core::frame_pr
         CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No channel with id " + std::to_wstring(channel)));
     }
 
-    auto buffer = get_param(L"BUFFER", params, 0);
+    auto buffer   = get_param(L"BUFFER", params, 0);
+    auto adaptive = contains_param(L"ADAPTIVE", params);
+
+    // Used when the source has another size than this channel.
+    auto scaling_str = get_param(L"SCALING", params, std::wstring(L"BICUBIC"));
+    auto scaling     = scale_filter::bicubic;
+    if (boost::iequals(scaling_str, L"LINEAR")) {
+        scaling = scale_filter::linear;
+    } else if (boost::iequals(scaling_str, L"LANCZOS")) {
+        scaling = scale_filter::lanczos;
+    } else if (!boost::iequals(scaling_str, L"BICUBIC")) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid SCALING " + scaling_str));
+    }
 
-    return spl::make_shared<route_producer>((*channel_it)->route(layer, mode), buffer);
+    return spl::make_shared<route_producer>(
+        (*channel_it)->route(layer, mode), dependencies.format_desc, buffer, adaptive, scaling);
 }
 
 }} // namespace caspar::core
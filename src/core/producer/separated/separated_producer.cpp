@@ -61,6 +61,18 @@ class separated_producer : public frame_producer
         return draw_frame::mask(fill_producer_->first_frame(), key_producer_->first_frame());
     }
 
+    void priority(producer_priority priority) override
+    {
+        fill_producer_->priority(priority);
+        key_producer_->priority(priority);
+    }
+
+    void audible(bool audible) override
+    {
+        fill_producer_->audible(audible);
+        key_producer_->audible(audible);
+    }
+
     draw_frame receive_impl(int nb_samples) override
     {
         CASPAR_SCOPE_EXIT
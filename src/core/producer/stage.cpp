@@ -25,16 +25,24 @@
 
 #include "layer.h"
 
+#include "../channel_arena.h"
+#include "../diagnostics/call_context.h"
+#include "../diagnostics/layer_resources.h"
 #include "../frame/draw_frame.h"
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/executor.h>
 #include <common/future.h>
+#include <common/timer.h>
 
 #include <core/frame/frame_transform.h>
 
-#include <boost/range/adaptors.hpp>
+#include <boost/optional.hpp>
 
+#include <tbb/task_group.h>
+
+#include <algorithm>
 #include <functional>
 #include <future>
 #include <map>
@@ -42,80 +50,267 @@
 
 namespace caspar { namespace core {
 
+struct stage_batch::impl
+{
+    struct changes
+    {
+        std::shared_ptr<stage::impl>       target;
+        std::vector<std::function<void()>> funcs;
+    };
+
+    std::vector<changes> stages;
+    impl*                previous = nullptr;
+
+    std::future<void> defer(std::shared_ptr<stage::impl> target, std::function<void()> func)
+    {
+        auto it = std::find_if(stages.begin(), stages.end(), [&](const changes& c) { return c.target == target; });
+        if (it == stages.end()) {
+            it = stages.insert(stages.end(), changes{std::move(target), {}});
+        }
+
+        auto promise = std::make_shared<std::promise<void>>();
+        it->funcs.push_back([=] {
+            try {
+                func();
+                promise->set_value();
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return promise->get_future();
+    }
+};
+
+namespace {
+
+thread_local stage_batch::impl* current_batch = nullptr;
+
+// Layers below this volume are left out of the audio mix, see audio_mixer.
+const double audible_volume = 0.002;
+
+} // namespace
+
 struct stage::impl : public std::enable_shared_from_this<impl>
 {
-    int                                 channel_index_;
-    spl::shared_ptr<diagnostics::graph> graph_;
-    monitor::state                      state_;
-    std::map<int, layer>                layers_;
-    std::map<int, tweened_transform>    tweens_;
+    struct layer_job
+    {
+        int                                           index;
+        core::layer*                                  layer;
+        std::shared_ptr<diagnostics::layer_resources> resources;
+        frame_transform                               transform;
+        bool                                          fetch_background;
+        layer_frame                                   result;
+        double                                        receive_time;
+    };
+
+    // A layer index with its producers and transform, which are set independently. An index with neither is dropped.
+    struct layer_entry
+    {
+        explicit layer_entry(int index)
+            : index(index)
+        {
+        }
+        layer_entry(layer_entry&&) = default;
+        layer_entry& operator=(layer_entry&&) = default;
+
+        int                          index;
+        boost::optional<core::layer> layer;
+        tweened_transform            tween;
+    };
+
+    int                                         channel_index_;
+    const bool                                  parallel_receive_;
+    spl::shared_ptr<caspar::diagnostics::graph> graph_;
+    monitor::state                              state_;
+    std::vector<layer_entry>                    layers_; // By index.
+    std::int64_t                                frame_ = 0;
+
+    // Changes scheduled by stage_batch::schedule, by the frame they apply at.
+    std::map<std::int64_t, std::vector<std::function<void()>>> scheduled_;
+
+    // Parallel receive runs in the channel's arena, so other channels' decoding cannot take its workers.
+    const std::shared_ptr<tbb::task_arena> arena_ = channel_arena(channel_index_);
 
     executor executor_{L"stage " + std::to_wstring(channel_index_)};
 
   public:
-    impl(int channel_index, spl::shared_ptr<diagnostics::graph> graph)
+    impl(int channel_index, spl::shared_ptr<caspar::diagnostics::graph> graph, bool parallel_receive)
         : channel_index_(channel_index)
+        , parallel_receive_(parallel_receive)
         , graph_(std::move(graph))
     {
     }
 
-    std::map<int, layer_frame>
-    operator()(const video_format_desc& format_desc, int nb_samples, std::vector<int>& fetch_background)
+    layer_frames operator()(const video_format_desc& format_desc,
+                            int                      nb_samples,
+                            const layer_indices&     fetch_background,
+                            arena&                   tick_arena)
     {
-        return executor_.invoke([=] {
-            std::map<int, layer_frame> frames;
+        const auto sequence = caspar::diagnostics::trace::current_frame();
+        const auto channel  = caspar::diagnostics::trace::current_channel();
+
+        return executor_.invoke([&] {
+            caspar::diagnostics::trace::scoped_frame traced(sequence, channel);
+            caspar::diagnostics::trace::scope        scope("stage");
+
+            layer_frames frames(tick_arena);
 
             try {
-                for (auto& t : tweens_)
-                    t.second.tick(1);
-
-                for (auto& p : layers_) {
-                    auto& layer = p.second;
-                    auto& tween = tweens_[p.first];
-
-                    layer_frame res    = {};
-                    res.foreground     = draw_frame::push(layer.receive(format_desc, nb_samples), tween.fetch());
-                    res.has_background = layer.has_background();
-                    if (std::find(fetch_background.begin(), fetch_background.end(), p.first) !=
-                        fetch_background.end()) {
-                        res.background = layer.receive_background(format_desc, nb_samples);
+                while (!scheduled_.empty() && scheduled_.begin()->first <= frame_) {
+                    auto funcs = std::move(scheduled_.begin()->second);
+                    scheduled_.erase(scheduled_.begin());
+                    for (auto& func : funcs) {
+                        func();
+                    }
+                }
+
+                std::vector<layer_job, arena_allocator<layer_job>> jobs(tick_arena);
+                jobs.reserve(layers_.size());
+                for (auto& entry : layers_) {
+                    entry.tween.tick(1);
+                    if (!entry.layer) {
+                        continue;
+                    }
+
+                    layer_job job        = {};
+                    job.index            = entry.index;
+                    job.layer            = &*entry.layer;
+                    job.resources        = resources(entry.index);
+                    job.transform        = entry.tween.fetch();
+                    job.layer->audible(job.transform.audio_transform.volume >= audible_volume);
+                    job.fetch_background = std::find(fetch_background.begin(), fetch_background.end(), entry.index) !=
+                                           fetch_background.end();
+                    jobs.push_back(std::move(job));
+                }
+
+                auto receive = [&](layer_job& job) {
+                    caspar::timer receive_timer;
+
+                    caspar::diagnostics::trace::scoped_frame traced(sequence, channel);
+                    caspar::diagnostics::trace::scope        scope("layer", sequence, job.index);
+
+                    // Frames created while receiving account to the layer, see diagnostics::layer_resources.
+                    diagnostics::scoped_call_context save;
+                    diagnostics::call_context::for_thread().video_channel = channel_index_;
+                    diagnostics::call_context::for_thread().layer         = job.index;
+                    diagnostics::scoped_cpu_time cpu_time(job.resources);
+
+                    job.result.foreground =
+                        draw_frame::push(job.layer->receive(format_desc, nb_samples), job.transform);
+                    job.result.has_background = job.layer->has_background();
+                    if (job.fetch_background) {
+                        job.result.background = job.layer->receive_background(format_desc, nb_samples);
+                    }
+
+                    job.receive_time = receive_timer.elapsed();
+                };
+
+                if (parallel_receive_ && jobs.size() > 1) {
+                    execute_in(arena_, [&] {
+                        tbb::task_group tasks;
+                        for (auto& job : jobs) {
+                            tasks.run([&receive, &job] { receive(job); });
+                        }
+                        tasks.wait();
+                    });
+                } else {
+                    for (auto& job : jobs) {
+                        receive(job);
                     }
-                    frames[p.first] = res;
                 }
 
                 monitor::state state;
-                for (auto& p : layers_) {
-                    state["layer"][p.first] = p.second.state();
+                state["frame"] = frame_;
+                for (auto& job : jobs) {
+                    frames[job.index]                         = std::move(job.result);
+                    state["layer"][job.index]                 = job.layer->state();
+                    state["layer"][job.index]["receive-time"] = job.receive_time;
+                    if (job.resources) {
+                        state["layer"][job.index]["resources"] = job.resources->state();
+                    }
                 }
                 state_ = std::move(state);
             } catch (...) {
-                layers_.clear();
+                clear_layers();
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
 
+            ++frame_;
+
             return frames;
         });
     }
 
+    // Runs a change on the executor, or leaves it to the batch of the calling thread.
+    template <typename Func>
+    std::future<void> change(Func&& func)
+    {
+        if (current_batch) {
+            return current_batch->defer(shared_from_this(), std::forward<Func>(func));
+        }
+        return executor_.begin_invoke(std::forward<Func>(func));
+    }
+
+    std::shared_ptr<diagnostics::layer_resources> resources(int index)
+    {
+        diagnostics::call_context context;
+        context.video_channel = channel_index_;
+        context.layer         = index;
+        return diagnostics::layer_resources::find(context);
+    }
+
+    layer_entry* find_entry(int index)
+    {
+        auto it = std::lower_bound(
+            layers_.begin(), layers_.end(), index, [](const layer_entry& e, int i) { return e.index < i; });
+        return it != layers_.end() && it->index == index ? &*it : nullptr;
+    }
+
+    layer_entry& get_entry(int index)
+    {
+        auto it = std::lower_bound(
+            layers_.begin(), layers_.end(), index, [](const layer_entry& e, int i) { return e.index < i; });
+        if (it == layers_.end() || it->index != index) {
+            it = layers_.insert(it, layer_entry(index));
+        }
+        return *it;
+    }
+
     layer& get_layer(int index)
     {
-        auto it = layers_.find(index);
-        if (it == std::end(layers_)) {
-            it = layers_.emplace(index, layer()).first;
+        auto& entry = get_entry(index);
+        if (!entry.layer) {
+            entry.layer = layer();
+        }
+        return *entry.layer;
+    }
+
+    tweened_transform& get_tween(int index) { return get_entry(index).tween; }
+
+    static bool is_empty(const layer_entry& entry)
+    {
+        return !entry.layer && entry.tween.finished() && entry.tween.dest() == frame_transform();
+    }
+
+    void prune() { layers_.erase(std::remove_if(layers_.begin(), layers_.end(), is_empty), layers_.end()); }
+
+    void clear_layers()
+    {
+        for (auto& entry : layers_) {
+            entry.layer = boost::none;
         }
-        return it->second;
+        prune();
     }
 
     std::future<void>
     apply_transforms(const std::vector<std::tuple<int, stage::transform_func_t, unsigned int, tweener>>& transforms)
     {
-        return executor_.begin_invoke([=] {
+        return change([=] {
             for (auto& transform : transforms) {
-                auto& tween = tweens_[std::get<0>(transform)];
+                auto& tween = get_tween(std::get<0>(transform));
                 auto  src   = tween.fetch();
                 auto  dst   = std::get<1>(transform)(tween.dest());
-                tweens_[std::get<0>(transform)] =
-                    tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
+                tween       = tweened_transform(src, dst, std::get<2>(transform), std::get<3>(transform));
             }
         });
     }
@@ -125,61 +320,80 @@ struct stage::impl : public std::enable_shared_from_this<impl>
                                       unsigned int                   mix_duration,
                                       const tweener&                 tween)
     {
-        return executor_.begin_invoke([=] {
-            auto src       = tweens_[index].fetch();
-            auto dst       = transform(src);
-            tweens_[index] = tweened_transform(src, dst, mix_duration, tween);
+        return change([=] {
+            auto& tweened = get_tween(index);
+            auto  src     = tweened.fetch();
+            auto  dst     = transform(src);
+            tweened       = tweened_transform(src, dst, mix_duration, tween);
         });
     }
 
     std::future<void> clear_transforms(int index)
     {
-        return executor_.begin_invoke([=] { tweens_.erase(index); });
+        return change([=] {
+            if (auto entry = find_entry(index)) {
+                entry->tween = tweened_transform();
+                prune();
+            }
+        });
     }
 
     std::future<void> clear_transforms()
     {
-        return executor_.begin_invoke([=] { tweens_.clear(); });
+        return change([=] {
+            for (auto& entry : layers_) {
+                entry.tween = tweened_transform();
+            }
+            prune();
+        });
     }
 
     std::future<frame_transform> get_current_transform(int index)
     {
-        return executor_.begin_invoke([=] { return tweens_[index].fetch(); });
+        return executor_.begin_invoke([=] {
+            auto entry = find_entry(index);
+            return entry ? entry->tween.fetch() : frame_transform();
+        });
     }
 
     std::future<void> load(int index, const spl::shared_ptr<frame_producer>& producer, bool preview, bool auto_play)
     {
-        return executor_.begin_invoke([=] { get_layer(index).load(producer, preview, auto_play); });
+        return change([=] { get_layer(index).load(producer, preview, auto_play); });
     }
 
     std::future<void> pause(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).pause(); });
+        return change([=] { get_layer(index).pause(); });
     }
 
     std::future<void> resume(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).resume(); });
+        return change([=] { get_layer(index).resume(); });
     }
 
     std::future<void> play(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).play(); });
+        return change([=] { get_layer(index).play(); });
     }
 
     std::future<void> stop(int index)
     {
-        return executor_.begin_invoke([=] { get_layer(index).stop(); });
+        return change([=] { get_layer(index).stop(); });
     }
 
     std::future<void> clear(int index)
     {
-        return executor_.begin_invoke([=] { layers_.erase(index); });
+        return change([=] {
+            if (auto entry = find_entry(index)) {
+                entry->layer = boost::none;
+                prune();
+            }
+        });
     }
 
     std::future<void> clear()
     {
-        return executor_.begin_invoke([=] { layers_.clear(); });
+        return change([=] { clear_layers(); });
     }
 
     std::future<void> swap_layers(stage& other, bool swap_transforms)
@@ -191,13 +405,22 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         }
 
         auto func = [=] {
-            auto layers       = layers_ | boost::adaptors::map_values;
-            auto other_layers = other_impl->layers_ | boost::adaptors::map_values;
-
-            std::swap(layers_, other_impl->layers_);
+            if (swap_transforms) {
+                std::swap(layers_, other_impl->layers_);
+                return;
+            }
 
-            if (swap_transforms)
-                std::swap(tweens_, other_impl->tweens_);
+            // The transforms stay, so the layers are moved over one by one.
+            std::vector<std::pair<int, layer>> layers;
+            std::vector<std::pair<int, layer>> other_layers;
+            take_layers(layers);
+            other_impl->take_layers(other_layers);
+            for (auto& p : other_layers) {
+                get_entry(p.first).layer = std::move(p.second);
+            }
+            for (auto& p : layers) {
+                other_impl->get_entry(p.first).layer = std::move(p.second);
+            }
         };
 
         return invoke_both(other, func);
@@ -205,11 +428,15 @@ struct stage::impl : public std::enable_shared_from_this<impl>
 
     std::future<void> swap_layer(int index, int other_index, bool swap_transforms)
     {
-        return executor_.begin_invoke([=] {
+        return change([=] {
+            // Both are added first, adding one may move the other.
+            get_entry(index);
+            get_entry(other_index);
+
             std::swap(get_layer(index), get_layer(other_index));
 
             if (swap_transforms)
-                std::swap(tweens_[index], tweens_[other_index]);
+                std::swap(get_tween(index), get_tween(other_index));
         });
     }
 
@@ -226,8 +453,8 @@ struct stage::impl : public std::enable_shared_from_this<impl>
             std::swap(my_layer, other_layer);
 
             if (swap_transforms) {
-                auto& my_tween    = tweens_[index];
-                auto& other_tween = other_impl->tweens_[other_index];
+                auto& my_tween    = get_tween(index);
+                auto& other_tween = other_impl->get_tween(other_index);
                 std::swap(my_tween, other_tween);
             }
         };
@@ -235,6 +462,17 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         return invoke_both(other, func);
     }
 
+    void take_layers(std::vector<std::pair<int, layer>>& layers)
+    {
+        for (auto& entry : layers_) {
+            if (entry.layer) {
+                layers.emplace_back(entry.index, std::move(*entry.layer));
+                entry.layer = boost::none;
+            }
+        }
+        prune();
+    }
+
     std::future<void> invoke_both(stage& other, std::function<void()> func)
     {
         auto other_impl = other.impl_;
@@ -246,6 +484,19 @@ struct stage::impl : public std::enable_shared_from_this<impl>
         return executor_.begin_invoke([=] { other_impl->executor_.invoke(func); });
     }
 
+    std::future<void> schedule(std::int64_t frame, bool relative, std::vector<std::function<void()>> funcs)
+    {
+        return executor_.begin_invoke([=] {
+            auto& scheduled = scheduled_[relative ? frame_ + frame : frame];
+            scheduled.insert(scheduled.end(), funcs.begin(), funcs.end());
+        });
+    }
+
+    std::future<void> clear_schedule()
+    {
+        return executor_.begin_invoke([=] { scheduled_.clear(); });
+    }
+
     std::future<std::shared_ptr<frame_producer>> foreground(int index)
     {
         return executor_.begin_invoke(
@@ -264,8 +515,8 @@ struct stage::impl : public std::enable_shared_from_this<impl>
     }
 };
 
-stage::stage(int channel_index, spl::shared_ptr<diagnostics::graph> graph)
-    : impl_(new impl(channel_index, std::move(graph)))
+stage::stage(int channel_index, spl::shared_ptr<caspar::diagnostics::graph> graph, bool parallel_receive)
+    : impl_(new impl(channel_index, std::move(graph), parallel_receive))
 {
 }
 std::future<std::wstring> stage::call(int index, const std::vector<std::wstring>& params)
@@ -308,12 +559,70 @@ std::future<void> stage::swap_layer(int index, int other_index, stage& other, bo
 {
     return impl_->swap_layer(index, other_index, other, swap_transforms);
 }
+std::future<void> stage::clear_schedule() { return impl_->clear_schedule(); }
 std::future<std::shared_ptr<frame_producer>> stage::foreground(int index) { return impl_->foreground(index); }
 std::future<std::shared_ptr<frame_producer>> stage::background(int index) { return impl_->background(index); }
-std::map<int, layer_frame>                   stage::
-                                             operator()(const video_format_desc& format_desc, int nb_samples, std::vector<int>& fetch_background)
+layer_frames stage::operator()(const video_format_desc& format_desc,
+                                int                      nb_samples,
+                                const layer_indices&     fetch_background,
+                                arena&                   tick_arena)
 {
-    return (*impl_)(format_desc, nb_samples, fetch_background);
+    return (*impl_)(format_desc, nb_samples, fetch_background, tick_arena);
 }
 core::monitor::state stage::state() const { return impl_->state_; }
+
+stage_batch::stage_batch()
+    : impl_(spl::make_unique<impl>())
+{
+    impl_->previous = current_batch;
+    current_batch   = impl_.get();
+}
+
+stage_batch::~stage_batch()
+{
+    if (current_batch == impl_.get()) {
+        current_batch = impl_->previous;
+    }
+}
+
+void stage_batch::commit()
+{
+    if (current_batch == impl_.get()) {
+        current_batch = impl_->previous;
+    }
+
+    std::vector<std::future<void>> results;
+    for (auto& c : impl_->stages) {
+        results.push_back(c.target->executor_.begin_invoke([target = c.target, funcs = std::move(c.funcs)] {
+            for (auto& func : funcs) {
+                func();
+            }
+        }));
+    }
+    impl_->stages.clear();
+
+    for (auto& result : results) {
+        result.wait();
+    }
+}
+
+void stage_batch::schedule(std::int64_t frame, bool relative)
+{
+    if (current_batch == impl_.get()) {
+        current_batch = impl_->previous;
+    }
+
+    std::vector<std::future<void>> results;
+    for (auto& c : impl_->stages) {
+        results.push_back(c.target->schedule(frame, relative, std::move(c.funcs)));
+    }
+    impl_->stages.clear();
+
+    for (auto& result : results) {
+        result.wait();
+    }
+}
+
+bool stage_batch::is_active() { return current_batch != nullptr; }
+
 }} // namespace caspar::core
@@ -24,12 +24,14 @@
 #include "../fwd.h"
 #include "../monitor/monitor.h"
 
+#include <common/arena.h>
 #include <common/forward.h>
 #include <common/memory.h>
 #include <common/tweener.h>
 
 #include <core/frame/draw_frame.h>
 
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <map>
@@ -47,6 +49,10 @@ struct layer_frame
     bool       has_background;
 };
 
+// Both live for a single tick and are allocated from the channel's tick arena.
+using layer_frames  = std::map<int, layer_frame, std::less<int>, arena_allocator<std::pair<const int, layer_frame>>>;
+using layer_indices = std::vector<int, arena_allocator<int>>;
+
 class stage final
 {
     stage(const stage&);
@@ -56,10 +62,12 @@ class stage final
     using transform_func_t  = std::function<struct frame_transform(struct frame_transform)>;
     using transform_tuple_t = std::tuple<int, transform_func_t, unsigned int, tweener>;
 
-    explicit stage(int channel_index, spl::shared_ptr<caspar::diagnostics::graph> graph);
+    explicit stage(int channel_index, spl::shared_ptr<caspar::diagnostics::graph> graph, bool parallel_receive = false);
 
-    std::map<int, layer_frame>
-    operator()(const video_format_desc& format_desc, int nb_samples, std::vector<int>& fetch_background);
+    layer_frames operator()(const video_format_desc& format_desc,
+                            int                      nb_samples,
+                            const layer_indices&     fetch_background,
+                            arena&                   tick_arena);
 
     std::future<void> apply_transforms(const std::vector<transform_tuple_t>& transforms);
     std::future<void>
@@ -79,6 +87,7 @@ class stage final
     std::future<void>         swap_layers(stage& other, bool swap_transforms);
     std::future<void>         swap_layer(int index, int other_index, bool swap_transforms);
     std::future<void>         swap_layer(int index, int other_index, stage& other, bool swap_transforms);
+    std::future<void>         clear_schedule();
 
     core::monitor::state state() const;
 
@@ -86,8 +95,37 @@ class stage final
     std::future<std::shared_ptr<frame_producer>> background(int index);
 
   private:
+    friend class stage_batch;
+
     struct impl;
     spl::shared_ptr<impl> impl_;
 };
 
+// Defers the changes made to any stage from the calling thread until commit(), which applies the changes of each
+// stage in a single invocation of its executor, so that they take effect on the same frame. Queries, calls and
+// swaps between two stages are not deferred. Changes that are not committed are dropped.
+class stage_batch final
+{
+    stage_batch(const stage_batch&);
+    stage_batch& operator=(const stage_batch&);
+
+  public:
+    stage_batch();
+    ~stage_batch();
+
+    // Applies the deferred changes and waits until they have been.
+    void commit();
+
+    // Applies the deferred changes at the start of the given frame of each stage, counted from when its channel
+    // started or, if relative, from its current frame. Frames that have passed apply at the next one.
+    void schedule(std::int64_t frame, bool relative);
+
+    static bool is_active();
+
+    struct impl;
+
+  private:
+    spl::unique_ptr<impl> impl_;
+};
+
 }} // namespace caspar::core
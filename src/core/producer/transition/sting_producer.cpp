@@ -31,7 +31,11 @@
 #include <common/param.h>
 #include <common/scope_exit.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <algorithm>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -41,6 +45,9 @@ class sting_producer : public frame_producer
     uint32_t        current_frame_ = 0;
     caspar::tweener audio_tweener_{L"linear"};
 
+    // Audio fade of every frame, filled in once the mask's duration is known.
+    std::vector<double> audio_deltas_;
+
     core::draw_frame dst_;
     core::draw_frame src_;
     core::draw_frame mask_;
@@ -53,6 +60,13 @@ class sting_producer : public frame_producer
     spl::shared_ptr<frame_producer> mask_producer_    = frame_producer::empty();
     spl::shared_ptr<frame_producer> overlay_producer_ = frame_producer::empty();
 
+    // The overlay is the mask's own file, whose frames are then drawn twice instead of decoded twice.
+    const bool shared_overlay_;
+
+    // Whether the first mask and overlay frames were decoded while loaded in the background.
+    bool mask_preloaded_    = false;
+    bool overlay_preloaded_ = false;
+
   public:
     sting_producer(const spl::shared_ptr<frame_producer>& dest,
                    const sting_info&                      info,
@@ -62,6 +76,7 @@ class sting_producer : public frame_producer
         , dst_producer_(dest)
         , mask_producer_(mask)
         , overlay_producer_(overlay)
+        , shared_overlay_(overlay.get() == mask.get())
     {
     }
 
@@ -75,6 +90,44 @@ class sting_producer : public frame_producer
         return duration && current_frame_ >= *duration ? dst_producer_ : core::frame_producer::empty();
     }
 
+    void priority(producer_priority priority) override
+    {
+        dst_producer_->priority(priority);
+        mask_producer_->priority(priority);
+        if (!shared_overlay_) {
+            overlay_producer_->priority(priority);
+        }
+    }
+
+    void audible(bool audible) override
+    {
+        dst_producer_->audible(audible);
+        src_producer_->audible(audible);
+        if (!shared_overlay_) {
+            overlay_producer_->audible(audible);
+        }
+    }
+
+    void preload() override
+    {
+        // The first frames are kept by the producers and returned by their first receive, decoded and uploaded.
+        if (!mask_preloaded_) {
+            mask_preloaded_ = static_cast<bool>(mask_producer_->first_frame());
+        }
+        if (shared_overlay_ || overlay_producer_ == core::frame_producer::empty()) {
+            overlay_preloaded_ = mask_preloaded_;
+        } else if (!overlay_preloaded_) {
+            overlay_preloaded_ = static_cast<bool>(overlay_producer_->first_frame());
+        }
+
+        state_                     = dst_producer_->state();
+        state_["transition/type"]  = std::string("sting");
+        state_["transition/ready"] = ready();
+    }
+
+    // Mask and overlay can start on the trigger without waiting for the decoders.
+    bool ready() const { return mask_preloaded_ && overlay_preloaded_ && auto_play_delta(); }
+
     boost::optional<int64_t> auto_play_delta() const override
     {
         auto duration = static_cast<int64_t>(mask_producer_->nb_frames());
@@ -91,8 +144,9 @@ class sting_producer : public frame_producer
 
         CASPAR_SCOPE_EXIT
         {
-            state_                    = dst_producer_->state();
-            state_["transition/type"] = std::string("sting");
+            state_                     = dst_producer_->state();
+            state_["transition/type"]  = std::string("sting");
+            state_["transition/ready"] = current_frame_ > 0 || ready();
 
             if (duration)
                 state_["transition/frame"] = {static_cast<int>(current_frame_), static_cast<int>(*duration)};
@@ -127,7 +181,9 @@ class sting_producer : public frame_producer
             mask_ = mask_producer_->receive(nb_samples);
         }
         bool expecting_overlay = overlay_producer_ != core::frame_producer::empty();
-        if (expecting_overlay && !overlay_) {
+        if (shared_overlay_) {
+            overlay_ = mask_;
+        } else if (expecting_overlay && !overlay_) {
             overlay_ = overlay_producer_->receive(nb_samples);
         }
 
@@ -145,7 +201,15 @@ class sting_producer : public frame_producer
         if (!mask_and_overlay_valid) {
             // If one is behind, then fetch the last_frame of both
             mask    = mask_producer_->last_frame();
-            overlay = overlay_producer_->last_frame();
+            overlay = shared_overlay_ ? mask : overlay_producer_->last_frame();
+        }
+
+        if (duration && audio_deltas_.size() != static_cast<std::size_t>(*duration) + 1) {
+            audio_deltas_.clear();
+            const auto frames = static_cast<double>(*duration);
+            for (int64_t n = 0; n <= *duration; ++n) {
+                audio_deltas_.push_back(audio_tweener_(static_cast<double>(n), 0.0, 1.0, frames));
+            }
         }
 
         auto res = compose(dst_, src_, mask, overlay);
@@ -184,8 +248,8 @@ class sting_producer : public frame_producer
     draw_frame
     compose(draw_frame dst_frame, draw_frame src_frame, draw_frame mask_frame, draw_frame overlay_frame) const
     {
-        const auto   duration = auto_play_delta();
-        const double delta    = duration ? audio_tweener_(current_frame_, 0.0, 1.0, static_cast<double>(*duration)) : 0;
+        const double delta =
+            audio_deltas_.empty() ? 0 : audio_deltas_[std::min<std::size_t>(current_frame_, audio_deltas_.size() - 1)];
 
         src_frame.transform().audio_transform.volume = 1.0 - delta;
         dst_frame.transform().audio_transform.volume = delta;
@@ -217,7 +281,9 @@ spl::shared_ptr<frame_producer> create_sting_producer(const frame_producer_depen
     auto mask_producer = dependencies.producer_registry->create_producer(dependencies, info.mask_filename);
 
     auto overlay_producer = frame_producer::empty();
-    if (!info.overlay_filename.empty()) {
+    if (boost::iequals(info.overlay_filename, info.mask_filename)) {
+        overlay_producer = mask_producer;
+    } else if (!info.overlay_filename.empty()) {
         // This could be any producer, no requirement for it to be of fixed length
         overlay_producer = dependencies.producer_registry->create_producer(dependencies, info.overlay_filename);
     }
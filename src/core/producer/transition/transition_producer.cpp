@@ -30,7 +30,9 @@
 
 #include <common/scope_exit.h>
 
+#include <algorithm>
 #include <future>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -43,6 +45,7 @@ class transition_producer : public frame_producer
     core::draw_frame src_;
 
     const transition_info info_;
+    std::vector<double>   deltas_;
 
     spl::shared_ptr<frame_producer> dst_producer_ = frame_producer::empty();
     spl::shared_ptr<frame_producer> src_producer_ = frame_producer::empty();
@@ -52,6 +55,10 @@ class transition_producer : public frame_producer
         : info_(info)
         , dst_producer_(dest)
     {
+        // The tween of every frame is known up front.
+        for (int n = 0; n <= std::max(info_.duration, 0); ++n) {
+            deltas_.push_back(info_.tweener(n, 0.0, 1.0, static_cast<double>(info_.duration)));
+        }
         update_state();
     }
 
@@ -69,6 +76,14 @@ class transition_producer : public frame_producer
 
     core::draw_frame first_frame() override { return dst_producer_->first_frame(); }
 
+    void priority(producer_priority priority) override { dst_producer_->priority(priority); }
+
+    void audible(bool audible) override
+    {
+        dst_producer_->audible(audible);
+        src_producer_->audible(audible);
+    }
+
     void leading_producer(const spl::shared_ptr<frame_producer>& producer) override { src_producer_ = producer; }
 
     spl::shared_ptr<frame_producer> following_producer() const override
@@ -149,13 +164,23 @@ class transition_producer : public frame_producer
             return src_frame;
         }
 
-        const double delta = info_.tweener(current_frame_, 0.0, 1.0, static_cast<double>(info_.duration));
+        const double delta = deltas_[std::min(current_frame_, static_cast<int>(deltas_.size()) - 1)];
 
         const double dir = info_.direction == transition_direction::from_left ? 1.0 : -1.0;
 
         src_frame.transform().audio_transform.volume = 1.0 - delta;
         dst_frame.transform().audio_transform.volume = delta;
 
+        // A mix or wipe that is fully on one side only draws that side, the other would be composited for nothing.
+        if (info_.type == transition_type::mix || info_.type == transition_type::wipe) {
+            if (delta <= 0.0) {
+                return src_frame;
+            }
+            if (delta >= 1.0) {
+                return dst_frame;
+            }
+        }
+
         if (info_.type == transition_type::mix) {
             dst_frame.transform().image_transform.opacity = delta;
             dst_frame.transform().image_transform.is_mix  = true;
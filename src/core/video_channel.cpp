@@ -25,6 +25,8 @@
 
 #include "video_format.h"
 
+#include "channel_group.h"
+
 #include "consumer/output.h"
 #include "frame/draw_frame.h"
 #include "frame/frame.h"
@@ -32,13 +34,25 @@
 #include "mixer/mixer.h"
 #include "producer/stage.h"
 
+#include <common/arena.h>
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/trace.h>
 #include <common/executor.h>
 #include <common/timer.h>
 
 #include <core/diagnostics/call_context.h>
+#include <core/diagnostics/tick_watchdog.h>
 #include <core/mixer/image/image_mixer.h>
 
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <future>
+#include <iterator>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -48,15 +62,114 @@ namespace caspar { namespace core {
 
 bool operator<(const route_id& a, const route_id& b) { return a.mode + (a.index << 2) < b.mode + (b.index << 2); }
 
+std::shared_ptr<void> route::subscribe(subscriber func)
+{
+    auto result = std::make_shared<subscriber>(std::move(func));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto subscribers = std::make_shared<std::vector<std::weak_ptr<subscriber>>>();
+    if (auto current = std::atomic_load(&subscribers_)) {
+        std::copy_if(current->begin(), current->end(), std::back_inserter(*subscribers), [](auto& s) {
+            return !s.expired();
+        });
+    }
+    subscribers->push_back(result);
+    std::atomic_store(&subscribers_, std::shared_ptr<const std::vector<std::weak_ptr<subscriber>>>(subscribers));
+
+    return result;
+}
+
+bool route::has_subscribers() const
+{
+    auto subscribers = std::atomic_load(&subscribers_);
+    return subscribers && std::any_of(subscribers->begin(), subscribers->end(), [](auto& s) { return !s.expired(); });
+}
+
+void route::signal(const draw_frame& frame) const
+{
+    auto subscribers = std::atomic_load(&subscribers_);
+    if (!subscribers) {
+        return;
+    }
+    for (auto& s : *subscribers) {
+        if (auto func = s.lock()) {
+            (*func)(frame);
+        }
+    }
+}
+
 struct video_channel::impl final
 {
-    monitor::state state_;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    struct produced_frame
+    {
+        // Declared first so that it outlives everything allocated from it.
+        std::shared_ptr<arena>  tick_arena;
+        core::video_format_desc format_desc;
+        layer_frames            stage_frames;
+        std::int64_t            sequence;
+        time_point              produced_at;
+    };
+
+    struct mixed_frame
+    {
+        core::video_format_desc format_desc;
+        core::const_frame       frame;
+        std::int64_t            sequence;
+        time_point              produced_at;
+    };
+
+    // A layer recorded on its own, with a readback ring of the same depth as the channel.
+    struct iso_tap
+    {
+        spl::shared_ptr<caspar::diagnostics::graph> graph = spl::make_shared<caspar::diagnostics::graph>();
+        core::output                                output;
+        core::mixer                                 mixer;
+
+        iso_tap(int                                 channel_index,
+                const core::video_format_desc&      format_desc,
+                const spl::shared_ptr<image_mixer>& image_mixer,
+                int                                 readback_depth,
+                bool                                audio_only)
+            : output(graph, format_desc, channel_index, -3, audio_only)
+            , mixer(channel_index, graph, image_mixer, readback_depth, audio_only)
+        {
+        }
+    };
+
+    // Published once per tick and never modified afterwards, so that queries can read it from any thread without
+    // waiting for the channel.
+    std::shared_ptr<const monitor::state> state_ = std::make_shared<const monitor::state>();
 
-    const int index_;
+    // The channels this one ticks in lockstep with, if any.
+    std::shared_ptr<channel_group> group_;
+
+    const int             index_;
+    const int             pipeline_depth_;
+    const int             readback_depth_;
+    const latency_profile latency_;
+    const bool            offline_;
+    const bool            audio_only_;
+
+    // Sequence number of the next frame produced, frames are traced under it, see diagnostics::trace.
+    std::int64_t sequence_ = 0;
+
+    // Sequence numbers of the frames still in the readback ring of the mixer and when they were produced, the oldest
+    // first. Only used on the mix stage.
+    std::deque<std::pair<std::int64_t, time_point>> readback_frames_;
+
+    // Milliseconds from producing a frame until its consumers have it out, as of the last consumed frame.
+    std::atomic<double> latency_ms_{0.0};
 
     mutable std::mutex      format_desc_mutex_;
     core::video_format_desc format_desc_;
 
+    // A format switch_format prepares, taken by the first tick after it is ready.
+    core::video_format_desc  pending_format_desc_;
+    std::shared_future<void> pending_;
+
     const spl::shared_ptr<caspar::diagnostics::graph> graph_ = [](int index) {
         core::diagnostics::scoped_call_context save;
         core::diagnostics::call_context::for_thread().video_channel = index;
@@ -68,27 +181,59 @@ struct video_channel::impl final
     caspar::core::mixer          mixer_;
     caspar::core::stage          stage_;
 
+    core::diagnostics::tick_watchdog watchdog_;
+
     std::vector<int> audio_cadence_ = format_desc_.audio_cadence;
+    field_mode       field_         = field_mode::lower;
 
     std::function<void(core::monitor::state)> tick_;
 
-    std::map<route_id, std::weak_ptr<core::route>> routes_;
-    std::mutex                                     routes_mutex_;
+    // Routes by id. The table is replaced under routes_mutex_ when a route is added and read on the channel thread
+    // without the lock.
+    struct route_entry
+    {
+        route_id                   id;
+        std::weak_ptr<core::route> route;
+    };
+    std::shared_ptr<const std::vector<route_entry>> routes_ = std::make_shared<const std::vector<route_entry>>();
+    std::mutex                                      routes_mutex_;
+
+    std::map<int, std::shared_ptr<iso_tap>> isos_;
+    std::mutex                              isos_mutex_;
 
     std::atomic<bool> abort_request_{false};
     std::thread       thread_;
 
+    std::unique_ptr<executor> mix_executor_;
+    std::unique_ptr<executor> consume_executor_;
+
+    // One arena per produced frame still in flight, so at most pipeline depth of them.
+    arena_pool arenas_;
+
   public:
     impl(int                                       index,
          const core::video_format_desc&            format_desc,
          std::unique_ptr<image_mixer>              image_mixer,
-         std::function<void(core::monitor::state)> tick)
+         std::function<void(core::monitor::state)> tick,
+         int                                       pipeline_depth,
+         bool                                      parallel_receive,
+         int                                       readback_depth,
+         int                                       clock,
+         latency_profile                           latency,
+         double                                    watchdog,
+         bool                                      audio_only)
         : index_(index)
+        , pipeline_depth_(std::max(1, std::min(3, pipeline_depth)))
+        , readback_depth_(audio_only ? 1 : std::max(1, readback_depth))
+        , latency_(latency)
+        , offline_(clock == -2)
+        , audio_only_(audio_only)
         , format_desc_(format_desc)
-        , output_(graph_, format_desc, index)
+        , output_(graph_, format_desc, index, clock == -4 ? -2 : clock, audio_only)
         , image_mixer_(std::move(image_mixer))
-        , mixer_(index, graph_, image_mixer_)
-        , stage_(index, graph_)
+        , mixer_(index, graph_, image_mixer_, readback_depth_, audio_only)
+        , stage_(index, graph_, parallel_receive)
+        , watchdog_(index, offline_ ? 0.0 : watchdog, graph_, [this] { return std::atomic_load(&state_); })
         , tick_(std::move(tick))
     {
         graph_->set_color("produce-time", caspar::diagnostics::color(0.0f, 1.0f, 0.0f));
@@ -96,115 +241,335 @@ struct video_channel::impl final
         graph_->set_color("consume-time", caspar::diagnostics::color(1.0f, 0.4f, 0.0f, 0.8f));
         graph_->set_color("frame-time", caspar::diagnostics::color(1.0f, 0.4f, 0.4f, 0.8f));
         graph_->set_color("osc-time", caspar::diagnostics::color(0.3f, 0.4f, 0.0f, 0.8f));
+        graph_->set_color("group-timeout", caspar::diagnostics::color(0.9f, 0.9f, 0.3f));
         graph_->set_text(print());
         caspar::diagnostics::register_graph(graph_);
 
         CASPAR_LOG(info) << print() << " Successfully Initialized.";
 
+        if (audio_only_) {
+            CASPAR_LOG(info) << print() << L" Mixing audio only.";
+        }
+
+        if (pipeline_depth_ > 1) {
+            mix_executor_ = std::make_unique<executor>(L"channel-mix-" + std::to_wstring(index_));
+        }
+        if (pipeline_depth_ > 2) {
+            consume_executor_ = std::make_unique<executor>(L"channel-consume-" + std::to_wstring(index_));
+        }
+
+        if (pipeline_depth_ > 1) {
+            CASPAR_LOG(info) << print() << L" Pipelined mode enabled (depth " << pipeline_depth_ << L", adds "
+                             << pipeline_depth_ - 1 << L" frame(s) of latency).";
+        }
+
         thread_ = std::thread([=] {
 #ifdef WIN32
             SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 #endif
             set_thread_name(L"channel-" + std::to_wstring(index_));
 
+            // Frames in flight between the pipeline stages. For depth 1 nothing is carried over.
+            boost::optional<produced_frame> produced;
+            boost::optional<mixed_frame>    mixed;
+
             while (!abort_request_) {
                 try {
                     core::video_format_desc format_desc;
                     int                     nb_samples;
                     {
                         std::lock_guard<std::mutex> lock(format_desc_mutex_);
+                        if (pending_.valid() &&
+                            pending_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                            set_format(pending_format_desc_, true);
+                            pending_ = {};
+                        }
                         format_desc = format_desc_;
                         boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
                         nb_samples = audio_cadence_.front();
                     }
 
-                    caspar::timer frame_timer;
-
-                    // Determine all layers that need a frame from the background producer
-                    std::vector<int> background_routes = {};
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& r : routes_) {
-                            // Ensure pointer is still valid
-                            if (!r.second.lock())
-                                continue;
-
-                            if (r.first.mode != route_mode::foreground) {
-                                background_routes.push_back(r.first.index);
-                            }
+                    // Members wait for each other for up to a few frames, then go on without the one missing.
+                    if (auto group = std::atomic_load(&group_)) {
+                        const auto timeout = std::chrono::milliseconds(static_cast<int>(4000.0 / format_desc.fps));
+                        if (!group->arrive(timeout)) {
+                            graph_->set_tag(caspar::diagnostics::tag_severity::WARNING, "group-timeout");
                         }
                     }
 
-                    // Produce
-                    caspar::timer produce_timer;
-                    auto          stage_frames = stage_(format_desc, nb_samples, background_routes);
-                    graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.fps * 0.5);
-
-                    // Mix
-                    caspar::timer mix_timer;
-
-                    std::vector<core::draw_frame> frames;
-                    for (auto& p : stage_frames) {
-                        frames.push_back(p.second.foreground);
-                    }
-
-                    auto mixed_frame = mixer_(frames, format_desc, format_desc.audio_cadence[0]);
-                    graph_->set_value("mix-time", mix_timer.elapsed() * format_desc.fps * 0.5);
+                    caspar::timer frame_timer;
+                    watchdog_.begin(sequence_, format_desc.fps);
+
+                    if (pipeline_depth_ == 1) {
+                        consume(mix(produce(format_desc, nb_samples)));
+                    } else {
+                        // Frame N+1 is produced on this thread while frame N is mixed and, for depth 3,
+                        // frame N-1 is consumed on their own executors.
+                        std::future<void>                        consume_future;
+                        std::future<boost::optional<mixed_frame>> mix_future;
+
+                        if (mixed && consume_executor_) {
+                            consume_future = consume_executor_->begin_invoke(
+                                [this, frame = std::move(*mixed)]() mutable { consume(std::move(frame)); });
+                        }
+                        mixed.reset();
+
+                        if (produced) {
+                            mix_future = mix_executor_->begin_invoke(
+                                [this, frame = std::move(*produced)]() mutable -> boost::optional<mixed_frame> {
+                                    auto result = mix(std::move(frame));
+                                    if (!consume_executor_) {
+                                        consume(std::move(result));
+                                        return boost::none;
+                                    }
+                                    return std::move(result);
+                                });
+                        }
+                        produced.reset();
 
-                    // Consume
-                    caspar::timer consume_timer;
-                    output_(std::move(mixed_frame), format_desc);
-                    graph_->set_value("consume-time", consume_timer.elapsed() * format_desc.fps * 0.5);
+                        std::exception_ptr error;
+                        try {
+                            produced = produce(format_desc, nb_samples);
+                        } catch (...) {
+                            error = std::current_exception();
+                        }
 
-                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
+                        // Always join both stages before rethrowing so nothing outlives this tick.
+                        if (mix_future.valid()) {
+                            mix_future.wait();
+                        }
+                        if (consume_future.valid()) {
+                            consume_future.wait();
+                        }
 
-                    {
-                        std::lock_guard<std::mutex> lock(routes_mutex_);
-
-                        for (auto& r : routes_) {
-                            auto route = r.second.lock();
-                            if (!route) {
-                                continue;
-                            }
-
-                            if (r.first.index == -1) {
-                                route->signal(core::draw_frame(std::move(frames)));
-                                continue;
-                            }
-
-                            auto it = stage_frames.find(r.first.index);
-                            if (it == stage_frames.end()) {
-                                // Layer doesnt exist, so send empty frame to avoid freezing on last
-                                route->signal(draw_frame{});
-                            } else {
-                                if (r.first.mode == route_mode::background ||
-                                    (r.first.mode == route_mode::next && it->second.has_background)) {
-                                    route->signal(draw_frame::pop(it->second.background));
-                                } else {
-                                    route->signal(draw_frame::pop(it->second.foreground));
-                                }
-                            }
+                        if (mix_future.valid()) {
+                            mixed = mix_future.get();
+                        }
+                        if (consume_future.valid()) {
+                            consume_future.get();
+                        }
+                        if (error) {
+                            std::rethrow_exception(error);
                         }
                     }
 
+                    graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
+                    watchdog_.end();
+
                     monitor::state state = {};
                     state["stage"]       = stage_.state();
                     state["mixer"]       = mixer_.state();
                     state["output"]      = output_.state();
                     state["framerate"]   = {format_desc_.framerate.numerator(), format_desc_.framerate.denominator()};
-                    state_               = state;
+                    {
+                        std::lock_guard<std::mutex> lock(format_desc_mutex_);
+                        if (pending_.valid()) {
+                            state["format/pending"] = pending_format_desc_.name;
+                        }
+                    }
+                    state["pipeline/depth"]   = pipeline_depth_;
+                    state["pipeline/latency"] = pipeline_depth_ - 1;
+                    state["latency/profile"]  = latency_name(latency_);
+                    state["latency/frames"]   = pipeline_depth_ - 1 + readback_depth_ - 1 + output_.buffered_frames();
+                    state["latency/ms"]       = latency_ms_.load();
+                    state["watchdog"]         = watchdog_.state();
+                    if (auto group = std::atomic_load(&group_)) {
+                        state["group/name"]    = group->name();
+                        state["group/members"] = group->members();
+                    }
+                    std::atomic_store(&state_, std::make_shared<const monitor::state>(state));
 
                     caspar::timer osc_timer;
-                    tick_(state_);
+                    tick_(std::move(state));
                     graph_->set_value("osc-time", osc_timer.elapsed() * format_desc.fps * 0.5);
                 } catch (...) {
+                    watchdog_.end();
+                    produced.reset();
+                    mixed.reset();
                     CASPAR_LOG_CURRENT_EXCEPTION();
                 }
             }
+
+            if (auto group = std::atomic_load(&group_)) {
+                group->leave();
+            }
+        });
+    }
+
+    void group(std::shared_ptr<channel_group> group)
+    {
+        if (group) {
+            group->join();
+            CASPAR_LOG(info) << print() << L" Ticking with group " << group->name() << L".";
+        }
+        if (auto previous = std::atomic_exchange(&group_, std::move(group))) {
+            previous->leave();
+        }
+    }
+
+    produced_frame produce(const core::video_format_desc& format_desc, int nb_samples)
+    {
+        auto tick_arena = arenas_.acquire();
+
+        // Determine all layers that need a frame from the background producer
+        layer_indices background_routes(*tick_arena);
+        for (auto& r : *std::atomic_load(&routes_)) {
+            if ((r.id.mode == route_mode::background || r.id.mode == route_mode::next) && !r.route.expired()) {
+                background_routes.push_back(r.id.index);
+            }
+        }
+
+        caspar::timer produce_timer;
+
+        caspar::diagnostics::trace::scoped_frame traced(sequence_, index_);
+        caspar::diagnostics::trace::scope        scope("produce");
+
+        produced_frame result;
+        result.tick_arena   = tick_arena;
+        result.format_desc  = format_desc;
+        result.stage_frames = stage_(format_desc, nb_samples, background_routes, *tick_arena);
+        result.sequence     = sequence_++;
+        result.produced_at  = std::chrono::steady_clock::now();
+
+        graph_->set_value("produce-time", produce_timer.elapsed() * format_desc.fps * 0.5);
+
+        return result;
+    }
+
+    mixed_frame mix(produced_frame produced)
+    {
+        caspar::timer mix_timer;
+
+        caspar::diagnostics::trace::scoped_frame traced(produced.sequence, index_);
+        caspar::diagnostics::trace::scope        scope("mix");
+
+        std::vector<core::draw_frame> frames;
+        frames.reserve(produced.stage_frames.size());
+        for (auto& p : produced.stage_frames) {
+            frames.push_back(p.second.foreground);
+        }
+
+        const auto mixed_routes = has_mixed_routes();
+        if (!audio_only_) {
+            image_mixer_->keep_output(mixed_routes);
+        }
+
+        std::map<int, std::shared_ptr<iso_tap>> isos;
+        {
+            std::lock_guard<std::mutex> lock(isos_mutex_);
+            isos = isos_;
+        }
+
+        // Ticks of interlaced formats alternate between the fields, which are rendered on their own while every
+        // consumer weaves them, those of the ISO layers included. Routed channels get whole frames.
+        field_ = field_ == field_mode::upper ? field_mode::lower : field_mode::upper;
+        const auto fields = produced.format_desc.field_count == 2 && !mixed_routes && output_.accepts_fields() &&
+                            std::all_of(isos.begin(), isos.end(), [](auto& p) {
+                                return p.second->output.empty() || p.second->output.accepts_fields();
+                            });
+        const auto field  = fields ? field_ : field_mode::progressive;
+
+        // The mixer hands back the frame of readback depth - 1 ticks ago.
+        readback_frames_.emplace_back(produced.sequence, produced.produced_at);
+        while (static_cast<int>(readback_frames_.size()) > readback_depth_) {
+            readback_frames_.pop_front();
+        }
+
+        mixed_frame result;
+        result.format_desc = produced.format_desc;
+        result.sequence    = readback_frames_.front().first;
+        result.produced_at = readback_frames_.front().second;
+        result.frame       = mixer_(frames,
+                              produced.format_desc,
+                              produced.format_desc.audio_cadence[0],
+                              output_.pixel_formats(),
+                              field,
+                              output_.preview_widths());
+
+        // ISO layers queue behind the channel on the device, so the channel is never held up by them.
+        for (auto& p : isos) {
+            std::vector<core::draw_frame> layer;
+            auto                          it = produced.stage_frames.find(p.first);
+            if (it != produced.stage_frames.end()) {
+                layer.push_back(draw_frame::pop(it->second.foreground));
+            }
+            auto& iso = *p.second;
+            iso.output(iso.mixer(std::move(layer),
+                                 produced.format_desc,
+                                 produced.format_desc.audio_cadence[0],
+                                 iso.output.pixel_formats(),
+                                 field,
+                                 iso.output.preview_widths()),
+                       produced.format_desc);
+        }
+
+        graph_->set_value("mix-time", mix_timer.elapsed() * produced.format_desc.fps * 0.5);
+
+        signal_routes(produced.stage_frames, std::move(frames), result.frame);
+
+        return result;
+    }
+
+    void consume(mixed_frame mixed)
+    {
+        caspar::timer consume_timer;
+
+        caspar::diagnostics::trace::scoped_frame traced(mixed.sequence, index_);
+        caspar::diagnostics::trace::scope        scope("consume");
+
+        output_(std::move(mixed.frame), mixed.format_desc);
+        graph_->set_value("consume-time", consume_timer.elapsed() * mixed.format_desc.fps * 0.5);
+
+        // Frames the consumers still hold go out one per tick after this one.
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mixed.produced_at);
+        latency_ms_  = elapsed.count() + output_.buffered_frames() * 1000.0 / mixed.format_desc.fps;
+    }
+
+    bool has_mixed_routes()
+    {
+        auto routes = std::atomic_load(&routes_);
+        return std::any_of(routes->begin(), routes->end(), [](auto& r) {
+            return r.id.mode == route_mode::mixed && !r.route.expired();
         });
     }
 
+    void signal_routes(const layer_frames&           stage_frames,
+                       std::vector<core::draw_frame> frames,
+                       const core::const_frame&      mixed)
+    {
+        auto routes = std::atomic_load(&routes_);
+
+        for (auto& r : *routes) {
+            auto route = r.route.lock();
+            if (!route || !route->has_subscribers()) {
+                continue;
+            }
+
+            if (r.id.mode == route_mode::mixed) {
+                route->signal(mixed ? core::draw_frame(mixed) : draw_frame{});
+                continue;
+            }
+
+            if (r.id.index == -1) {
+                route->signal(core::draw_frame(std::move(frames)));
+                continue;
+            }
+
+            auto it = stage_frames.find(r.id.index);
+            if (it == stage_frames.end()) {
+                // Layer doesnt exist, so send empty frame to avoid freezing on last
+                route->signal(draw_frame{});
+            } else {
+                if (r.id.mode == route_mode::background ||
+                    (r.id.mode == route_mode::next && it->second.has_background)) {
+                    route->signal(draw_frame::pop(it->second.background));
+                } else {
+                    route->signal(draw_frame::pop(it->second.foreground));
+                }
+            }
+        }
+    }
+
     ~impl()
     {
         CASPAR_LOG(info) << print() << " Uninitializing.";
@@ -220,7 +585,10 @@ struct video_channel::impl final
         id.index    = index;
         id.mode     = mode;
 
-        auto route = routes_[id].lock();
+        auto routes = std::atomic_load(&routes_);
+        auto it     = std::find_if(routes->begin(), routes->end(), [&](auto& r) { return id == r.id; });
+
+        auto route = it != routes->end() ? it->route.lock() : nullptr;
         if (!route) {
             route              = std::make_shared<core::route>();
             route->format_desc = format_desc_;
@@ -232,13 +600,49 @@ struct video_channel::impl final
                 route->name += L"/background";
             } else if (mode == route_mode::next) {
                 route->name += L"/next";
+            } else if (mode == route_mode::mixed) {
+                route->name += L"/mixed";
             }
-            routes_[id] = route;
+
+            auto table = std::make_shared<std::vector<route_entry>>();
+            std::copy_if(routes->begin(), routes->end(), std::back_inserter(*table), [&](auto& r) {
+                return !r.route.expired() && !(id == r.id);
+            });
+            auto pos = std::find_if(table->begin(), table->end(), [&](auto& r) { return id < r.id; });
+            table->insert(pos, route_entry{id, route});
+            std::atomic_store(&routes_, std::shared_ptr<const std::vector<route_entry>>(table));
         }
 
         return route;
     }
 
+    void add_iso(int layer, int index, const spl::shared_ptr<frame_consumer>& consumer)
+    {
+        std::lock_guard<std::mutex> lock(isos_mutex_);
+
+        auto& iso = isos_[layer];
+        if (!iso) {
+            iso = std::make_shared<iso_tap>(index_, video_format_desc(), image_mixer_, readback_depth_, audio_only_);
+            iso->graph->set_text(print() + L" iso " + std::to_wstring(layer));
+            caspar::diagnostics::register_graph(iso->graph);
+        }
+        iso->output.add(index, consumer);
+    }
+
+    bool remove_iso(int layer, int index)
+    {
+        std::lock_guard<std::mutex> lock(isos_mutex_);
+
+        auto it = isos_.find(layer);
+        if (it == isos_.end() || !it->second->output.remove(index)) {
+            return false;
+        }
+        if (it->second->output.empty()) {
+            isos_.erase(it);
+        }
+        return true;
+    }
+
     core::video_format_desc video_format_desc() const
     {
         std::lock_guard<std::mutex> lock(format_desc_mutex_);
@@ -248,9 +652,44 @@ struct video_channel::impl final
     void video_format_desc(const core::video_format_desc& format_desc)
     {
         std::lock_guard<std::mutex> lock(format_desc_mutex_);
-        format_desc_   = format_desc;
-        audio_cadence_ = format_desc_.audio_cadence;
-        stage_.clear();
+        pending_ = {};
+        set_format(format_desc, false);
+    }
+
+    void switch_format(const core::video_format_desc& format_desc)
+    {
+        auto desc = format_desc;
+        {
+            std::lock_guard<std::mutex> lock(format_desc_mutex_);
+            desc.audio_channels = format_desc_.audio_channels;
+        }
+
+        // Targets for the first field, the mixer alternates between pools of the same size.
+        const auto field =
+            desc.field_count == 2 && output_.accepts_fields() ? field_mode::upper : field_mode::progressive;
+        mixer_.prepare(desc, output_.pixel_formats(), field, output_.preview_widths());
+        auto prepared = output_.prepare(desc).share();
+
+        std::lock_guard<std::mutex> lock(format_desc_mutex_);
+        pending_format_desc_ = desc;
+        pending_             = std::move(prepared);
+    }
+
+    // Called with format_desc_mutex_ held. Producers keep playing into a format of the same frame rate when the stage
+    // is kept, the mixer fits their frames to the new size.
+    void set_format(const core::video_format_desc& format_desc, bool keep_stage)
+    {
+        const auto same_rate =
+            format_desc.framerate == format_desc_.framerate && format_desc.field_count == format_desc_.field_count;
+
+        // The audio layout is fixed by the channel configuration and outlives video mode changes.
+        auto audio_channels         = format_desc_.audio_channels;
+        format_desc_                = format_desc;
+        format_desc_.audio_channels = audio_channels;
+        audio_cadence_              = format_desc_.audio_cadence;
+        if (!keep_stage || !same_rate) {
+            stage_.clear();
+        }
     }
 
     std::wstring print() const
@@ -259,13 +698,42 @@ struct video_channel::impl final
     }
 
     int index() const { return index_; }
+
+    static std::wstring latency_name(latency_profile latency)
+    {
+        switch (latency) {
+            case latency_profile::low:
+                return L"low";
+            case latency_profile::safe:
+                return L"safe";
+            default:
+                return L"normal";
+        }
+    }
 };
 
 video_channel::video_channel(int                                       index,
                              const core::video_format_desc&            format_desc,
                              std::unique_ptr<image_mixer>              image_mixer,
-                             std::function<void(core::monitor::state)> tick)
-    : impl_(new impl(index, format_desc, std::move(image_mixer), std::move(tick)))
+                             std::function<void(core::monitor::state)> tick,
+                             int                                       pipeline_depth,
+                             bool                                      parallel_receive,
+                             int                                       readback_depth,
+                             int                                       clock,
+                             latency_profile                           latency,
+                             double                                    watchdog,
+                             bool                                      audio_only)
+    : impl_(new impl(index,
+                     format_desc,
+                     std::move(image_mixer),
+                     std::move(tick),
+                     pipeline_depth,
+                     parallel_receive,
+                     readback_depth,
+                     clock,
+                     latency,
+                     watchdog,
+                     audio_only))
 {
 }
 video_channel::~video_channel() {}
@@ -281,9 +749,20 @@ void                           core::video_channel::video_format_desc(const core
 {
     impl_->video_format_desc(format_desc);
 }
+void video_channel::switch_format(const core::video_format_desc& format_desc) { impl_->switch_format(format_desc); }
 int                  video_channel::index() const { return impl_->index(); }
-core::monitor::state video_channel::state() const { return impl_->state_; }
+latency_profile      video_channel::latency() const { return impl_->latency_; }
+bool                 video_channel::offline() const { return impl_->offline_; }
+bool                 video_channel::audio_only() const { return impl_->audio_only_; }
+std::shared_ptr<const core::monitor::state> video_channel::state() const { return std::atomic_load(&impl_->state_); }
 
 std::shared_ptr<route> video_channel::route(int index, route_mode mode) { return impl_->route(index, mode); }
 
+void video_channel::add_iso(int layer, int index, const spl::shared_ptr<frame_consumer>& consumer)
+{
+    impl_->add_iso(layer, index, consumer);
+}
+bool video_channel::remove_iso(int layer, int index) { return impl_->remove_iso(layer, index); }
+void video_channel::group(std::shared_ptr<channel_group> group) { impl_->group(std::move(group)); }
+
 }} // namespace caspar::core
@@ -28,9 +28,10 @@
 
 #include <common/memory.h>
 
-#include <boost/signals2.hpp>
-
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -38,7 +39,8 @@ enum route_mode
 {
     foreground,
     background,
-    next, // background if any, otherwise foreground
+    next,  // background if any, otherwise foreground
+    mixed, // the mixed output of the channel as one frame, drawn without uploading it again on the same device
 };
 
 struct route_id
@@ -51,16 +53,25 @@ struct route_id
 
 struct route
 {
+    using subscriber = std::function<void(const draw_frame&)>;
+
     route()             = default;
     route(const route&) = delete;
-    route(route&&)      = default;
 
     route& operator=(const route&) = delete;
-    route& operator=(route&&) = default;
 
-    boost::signals2::signal<void(class draw_frame)> signal;
-    video_format_desc                               format_desc;
-    std::wstring                                    name;
+    // func is called on the channel thread with every frame until the returned subscription is released. The list of
+    // subscribers is replaced rather than changed, so the channel takes no lock to signal them.
+    std::shared_ptr<void> subscribe(subscriber func);
+    bool                  has_subscribers() const;
+    void                  signal(const draw_frame& frame) const;
+
+    video_format_desc format_desc;
+    std::wstring      name;
+
+  private:
+    std::mutex                                                    mutex_;
+    std::shared_ptr<const std::vector<std::weak_ptr<subscriber>>> subscribers_;
 };
 
 class video_channel final
@@ -72,10 +83,18 @@ class video_channel final
     explicit video_channel(int                                       index,
                            const video_format_desc&                  format_desc,
                            std::unique_ptr<image_mixer>              image_mixer,
-                           std::function<void(core::monitor::state)> on_tick);
+                           std::function<void(core::monitor::state)> on_tick,
+                           int                                       pipeline_depth   = 1,
+                           bool                                      parallel_receive = false,
+                           int                                       readback_depth   = 2,
+                           int                                       clock            = -1,
+                           latency_profile                           latency          = latency_profile::normal,
+                           double                                    watchdog         = 4.0,
+                           bool                                      audio_only       = false);
     ~video_channel();
 
-    core::monitor::state state() const;
+    // The state as of the last tick.
+    std::shared_ptr<const core::monitor::state> state() const;
 
     const core::stage&  stage() const;
     core::stage&        stage();
@@ -87,12 +106,38 @@ class video_channel final
     core::video_format_desc video_format_desc() const;
     void                    video_format_desc(const core::video_format_desc& format_desc);
 
+    // Switches to another format without clearing the stage while the frame rate stays. Consumers and the mixer are
+    // prepared for it in the background, the channel takes it from the first tick after, on a frame boundary. A later
+    // switch replaces one that is still pending.
+    void switch_format(const core::video_format_desc& format_desc);
+
     spl::shared_ptr<core::frame_factory> frame_factory();
 
     int index() const;
 
+    // The profile producers and consumers of the channel take their default buffering from.
+    latency_profile latency() const;
+
+    // Whether the channel runs without a clock, as fast as its consumers take frames. Producers then wait for frames
+    // they don't have yet rather than skip them.
+    bool offline() const;
+
+    // Whether the channel mixes only audio, see mixer. Its image mixer still makes the frames of its producers, but
+    // nothing is drawn or read back and it only takes audio consumers.
+    bool audio_only() const;
+
     std::shared_ptr<core::route> route(int index = -1, route_mode mode = route_mode::foreground);
 
+    // Ticks the channel in lockstep with the other members of group, see channel_group. A member paced by its group
+    // and no clock of its own is created with clock -4.
+    void group(std::shared_ptr<channel_group> group);
+
+    // Consumers of a single layer, for recording it on its own without routing it to another channel. Its frames are
+    // drawn without the layer transform on the image mixer of the channel, after the channel itself, and read back
+    // with it. The index is the port like for output().
+    void add_iso(int layer, int index, const spl::shared_ptr<frame_consumer>& consumer);
+    bool remove_iso(int layer, int index);
+
   private:
     struct impl;
     spl::unique_ptr<impl> impl_;
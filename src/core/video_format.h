@@ -68,6 +68,15 @@ enum class video_format
     count
 };
 
+// How much a channel buffers along its path to the outputs, traded against how late a frame reaches them. Sets the
+// defaults of the mixer readback depth, the producer buffers and the consumer buffers of the channel together.
+enum class latency_profile
+{
+    low,
+    normal,
+    safe
+};
+
 struct video_format_desc final
 {
     video_format format{video_format::invalid};
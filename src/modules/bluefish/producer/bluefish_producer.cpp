@@ -164,6 +164,7 @@ struct bluefish_producer
     unsigned int            mode_;
 
     spl::shared_ptr<core::frame_factory> frame_factory_;
+    frame_cache                          frame_cache_;
 
     tbb::concurrent_bounded_queue<core::draw_frame> frame_buffer_;
     std::exception_ptr                              exception_;
@@ -450,13 +451,15 @@ struct bluefish_producer
                 }
 
                 // pass to caspar
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, src_video, src_audio));
+                auto frame = core::draw_frame(
+                    make_frame(
+                        this, *frame_factory_, frame_cache_, src_video, src_audio, format_desc_.audio_channels));
                 if (!frame_buffer_.try_push(frame)) {
                     core::draw_frame dummy;
                     frame_buffer_.try_pop(dummy);
                     frame_buffer_.try_push(frame);
                     graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-                    CASPAR_LOG(warning) << print() << TEXT(" ERROR dropped frame.");
+                    CASPAR_LOG_RATE_LIMITED(warning, 1000) << print() << TEXT(" ERROR dropped frame.");
                 }
 
                 if (sync_format_ == UPD_FMT_FRAME || (sync_format_ == UPD_FMT_FIELD && !first_frame_))
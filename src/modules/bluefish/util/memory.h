@@ -24,6 +24,8 @@
 
 #include <Windows.h>
 #include <boost/align.hpp>
+
+#include <memory>
 #include <vector>
 
 namespace caspar { namespace bluefish {
@@ -48,6 +50,19 @@ struct blue_dma_buffer
     PBYTE image_data() { return image_buffer_.data(); }
     PBYTE hanc_data() { return hanc_buffer_.data(); }
 
+    // Memory the image is DMA'd from instead of image_data, kept alive by owner until the buffer is released.
+    void set_image_source(const BYTE* source, std::shared_ptr<void> owner)
+    {
+        image_source_ = source;
+        image_owner_  = std::move(owner);
+    }
+    const BYTE* image_source() const { return image_source_ != nullptr ? image_source_ : image_buffer_.data(); }
+    void        release_image_source()
+    {
+        image_source_ = nullptr;
+        image_owner_.reset();
+    }
+
     size_t image_size() const { return image_size_; }
     size_t hanc_size() const { return hanc_size_; }
 
@@ -57,6 +72,8 @@ struct blue_dma_buffer
     size_t                                                           hanc_size_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> image_buffer_;
     std::vector<BYTE, boost::alignment::aligned_allocator<BYTE, 64>> hanc_buffer_;
+    const BYTE*                                                      image_source_ = nullptr;
+    std::shared_ptr<void>                                            image_owner_;
 };
 using blue_dma_buffer_ptr = std::shared_ptr<blue_dma_buffer>;
 
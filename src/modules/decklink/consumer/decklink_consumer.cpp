@@ -24,6 +24,7 @@
 #include "decklink_consumer.h"
 
 #include "../decklink.h"
+#include "../util/frame_ops.h"
 #include "../util/util.h"
 
 #include "../decklink_api.h"
@@ -31,26 +32,30 @@
 #include <core/consumer/frame_consumer.h>
 #include <core/diagnostics/call_context.h>
 #include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
 #include <core/mixer/audio/audio_mixer.h>
+#include <core/video_channel.h>
 
 #include <common/array.h>
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/memory.h>
 #include <common/except.h>
 #include <common/executor.h>
 #include <common/future.h>
-#include <common/memshfl.h>
+#include <common/os/memory.h>
 #include <common/param.h>
 #include <common/timer.h>
 
-#include <tbb/scalable_allocator.h>
-
 #include <boost/circular_buffer.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
 #include <future>
+#include <limits>
 #include <mutex>
 #include <queue>
 
@@ -81,15 +86,91 @@ struct configuration
     bool      key_only          = false;
     int       base_buffer_depth = 3;
 
+    // Whether latency and buffer-depth were given, otherwise they follow the latency profile of the channel.
+    bool latency_configured      = false;
+    bool buffer_depth_configured = false;
+
+    // Starts at buffer_depth() and adds or takes frames as the card runs short of them or has to spare, up to
+    // max_buffer_depth, 0 for buffer_depth() + 4.
+    bool adaptive_buffer  = false;
+    int  max_buffer_depth = 0;
+
+    // bgra, uyvy (8 bit YUV) or v210 (10 bit YUV), converted on the GPU. YUV carries no alpha for the keyers.
+    core::pixel_format pixel_format = core::pixel_format::bgra;
+
+    // Further cards showing the same fill, e.g. backup and confidence outputs.
+    std::vector<int> mirror_devices;
+
     int buffer_depth() const
     {
         return base_buffer_depth + (latency == latency_t::low_latency ? 0 : 1) +
                (embedded_audio ? 1 : 0); // TODO: Do we need this?
     }
 
+    int max_depth() const
+    {
+        return adaptive_buffer ? std::max(buffer_depth(), max_buffer_depth > 0 ? max_buffer_depth : buffer_depth() + 4)
+                               : buffer_depth();
+    }
+
     int key_device_index() const { return key_device_idx == 0 ? device_index + 1 : key_device_idx; }
+
+    // Low enables the low latency output of the card, safe schedules a frame more ahead.
+    configuration with_profile(core::latency_profile profile) const
+    {
+        auto config = *this;
+        if (!latency_configured && profile == core::latency_profile::low) {
+            config.latency = latency_t::low_latency;
+        }
+        if (!buffer_depth_configured && profile == core::latency_profile::safe) {
+            config.base_buffer_depth += 1;
+        }
+        return config;
+    }
+
+    BMDPixelFormat bmd_pixel_format() const
+    {
+        switch (pixel_format) {
+            case core::pixel_format::uyvy:
+                return bmdFormat8BitYUV;
+            case core::pixel_format::v210:
+                return bmdFormat10BitYUV;
+            default:
+                return bmdFormat8BitBGRA;
+        }
+    }
+
+    std::size_t row_bytes(const core::video_format_desc& format_desc) const
+    {
+        switch (pixel_format) {
+            case core::pixel_format::uyvy:
+                return format_desc.width * 2;
+            case core::pixel_format::v210:
+                // 6 pixels per 16 bytes, lines padded to 48 pixels.
+                return (format_desc.width + 47) / 48 * 128;
+            default:
+                return format_desc.width * 4;
+        }
+    }
 };
 
+void set_pixel_format(configuration& config, const std::wstring& name)
+{
+    if (boost::iequals(name, L"uyvy") || boost::iequals(name, L"yuv8")) {
+        config.pixel_format = core::pixel_format::uyvy;
+    } else if (boost::iequals(name, L"v210") || boost::iequals(name, L"yuv10")) {
+        config.pixel_format = core::pixel_format::v210;
+    } else {
+        config.pixel_format = core::pixel_format::bgra;
+    }
+
+    if (config.pixel_format != core::pixel_format::bgra &&
+        (config.key_only || config.keyer == configuration::keyer_t::external_separate_device_keyer)) {
+        CASPAR_LOG(warning) << L"[decklink_consumer] Key output needs alpha, using bgra instead of " << name << L".";
+        config.pixel_format = core::pixel_format::bgra;
+    }
+}
+
 template <typename Configuration>
 void set_latency(const com_iface_ptr<Configuration>& config,
                  configuration::latency_t            latency,
@@ -132,18 +213,76 @@ void set_keyer(const com_iface_ptr<IDeckLinkAttributes>& attributes,
     }
 }
 
+// Frame sized blocks for woven, keyed and copied frames, returned once the card releases the frame using them. The
+// blocks are large buffers, see configuration/memory for huge pages and locking.
+class buffer_pool : public std::enable_shared_from_this<buffer_pool>
+{
+    const std::size_t                  size_;
+    std::mutex                         mutex_;
+    std::vector<std::shared_ptr<void>> buffers_;
+
+  public:
+    buffer_pool(std::size_t size, int count)
+        : size_(size)
+    {
+        for (auto n = 0; n < count; ++n) {
+            buffers_.push_back(alloc_large_buffer(size_));
+        }
+    }
+
+    std::shared_ptr<void> get()
+    {
+        std::shared_ptr<void> buffer;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!buffers_.empty()) {
+                buffer = std::move(buffers_.back());
+                buffers_.pop_back();
+            }
+        }
+        if (!buffer) {
+            buffer = alloc_large_buffer(size_);
+        }
+
+        auto self = shared_from_this();
+        auto ptr  = buffer.get();
+        return std::shared_ptr<void>(ptr, [self, buffer](void*) mutable {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            self->buffers_.push_back(std::move(buffer));
+        });
+    }
+
+    std::size_t size() const { return size_; }
+};
+
+// Blocks for the scheduled frames, the one being built and, with a key, as many key frames.
+std::shared_ptr<buffer_pool> create_buffer_pool(const configuration& config, const core::video_format_desc& format_desc)
+{
+    const auto keyed = config.keyer == configuration::keyer_t::external_separate_device_keyer || config.key_only;
+    return std::make_shared<buffer_pool>(config.row_bytes(format_desc) * format_desc.height,
+                                         (config.buffer_depth() + 2) * (keyed ? 2 : 1));
+}
+
 class decklink_frame : public IDeckLinkVideoFrame
 {
     core::video_format_desc format_desc_;
     std::shared_ptr<void>   data_;
     std::atomic<int>        ref_count_{0};
     int                     nb_samples_;
+    BMDPixelFormat          pixel_format_;
+    std::size_t             row_bytes_;
 
   public:
-    decklink_frame(std::shared_ptr<void> data, const core::video_format_desc& format_desc, int nb_samples)
+    decklink_frame(std::shared_ptr<void>          data,
+                   const core::video_format_desc& format_desc,
+                   int                            nb_samples,
+                   BMDPixelFormat                 pixel_format = bmdFormat8BitBGRA,
+                   std::size_t                    row_bytes    = 0)
         : format_desc_(format_desc)
         , data_(data)
         , nb_samples_(nb_samples)
+        , pixel_format_(pixel_format)
+        , row_bytes_(row_bytes > 0 ? row_bytes : format_desc.width * 4)
     {
     }
 
@@ -168,8 +307,8 @@ class decklink_frame : public IDeckLinkVideoFrame
 
     long STDMETHODCALLTYPE GetWidth() override { return static_cast<long>(format_desc_.width); }
     long STDMETHODCALLTYPE GetHeight() override { return static_cast<long>(format_desc_.height); }
-    long STDMETHODCALLTYPE GetRowBytes() override { return static_cast<long>(format_desc_.width * 4); }
-    BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() override { return bmdFormat8BitBGRA; }
+    long STDMETHODCALLTYPE GetRowBytes() override { return static_cast<long>(row_bytes_); }
+    BMDPixelFormat STDMETHODCALLTYPE GetPixelFormat() override { return pixel_format_; }
     BMDFrameFlags STDMETHODCALLTYPE GetFlags() override { return bmdFrameFlagDefault; }
 
     HRESULT STDMETHODCALLTYPE GetBytes(void** buffer) override
@@ -249,6 +388,81 @@ struct key_video_context : public IDeckLinkVideoOutputCallback
     }
 };
 
+// A card showing the frames converted for the main card, scheduled at the same stream times. Its completions are only
+// counted, the main card keeps the pace and measures how far the mirror's playback drifts from its own.
+struct mirror_output : public IDeckLinkVideoOutputCallback
+{
+    const int                             device_index_;
+    com_ptr<IDeckLink>                    decklink_      = get_device(device_index_);
+    com_iface_ptr<IDeckLinkOutput>        output_        = iface_cast<IDeckLinkOutput>(decklink_);
+    com_iface_ptr<IDeckLinkConfiguration> configuration_ = iface_cast<IDeckLinkConfiguration>(decklink_);
+    const bool                            embedded_audio_;
+
+    std::atomic<std::int64_t> completed_{0};
+    std::atomic<std::int64_t> late_{0};
+    std::atomic<std::int64_t> dropped_{0};
+    std::atomic<double>       drift_ms_{0.0};
+
+    mirror_output(int                            device_index,
+                  const configuration&           config,
+                  BMDDisplayMode                 display_mode,
+                  const core::video_format_desc& format_desc,
+                  const std::wstring&            print)
+        : device_index_(device_index)
+        , embedded_audio_(config.embedded_audio)
+    {
+        set_latency(configuration_, config.latency, print);
+
+        if (FAILED(output_->EnableVideoOutput(display_mode, bmdVideoOutputFlagDefault))) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print + L" Could not enable mirror video output on " +
+                                                                  std::to_wstring(device_index_) + L"."));
+        }
+
+        if (FAILED(output_->SetScheduledFrameCompletionCallback(this))) {
+            CASPAR_THROW_EXCEPTION(caspar_exception()
+                                   << msg_info(print + L" Failed to set mirror playback completion callback.")
+                                   << boost::errinfo_api_function("SetScheduledFrameCompletionCallback"));
+        }
+
+        if (embedded_audio_ && FAILED(output_->EnableAudioOutput(bmdAudioSampleRate48kHz,
+                                                                  bmdAudioSampleType32bitInteger,
+                                                                  format_desc.audio_channels,
+                                                                  bmdAudioOutputStreamTimestamped))) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print + L" Could not enable mirror audio output on " +
+                                                                  std::to_wstring(device_index_) + L"."));
+        }
+    }
+
+    virtual ~mirror_output()
+    {
+        if (output_) {
+            output_->StopScheduledPlayback(0, nullptr, 0);
+            if (embedded_audio_) {
+                output_->DisableAudioOutput();
+            }
+            output_->DisableVideoOutput();
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
+    ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE ScheduledPlaybackHasStopped() override { return S_OK; }
+
+    HRESULT STDMETHODCALLTYPE ScheduledFrameCompleted(IDeckLinkVideoFrame*           completed_frame,
+                                                      BMDOutputFrameCompletionResult result) override
+    {
+        ++completed_;
+        if (result == bmdOutputFrameDisplayedLate) {
+            ++late_;
+        } else if (result == bmdOutputFrameDropped) {
+            ++dropped_;
+        }
+        return S_OK;
+    }
+};
+
 struct decklink_consumer : public IDeckLinkVideoOutputCallback
 {
     const int           channel_index_;
@@ -273,10 +487,24 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
     const int buffer_size_ = config_.buffer_depth(); // Minimum buffer-size 3.
 
+    // Frames prerolled on the card, adjusted at runtime with adaptive_buffer. The card wants at least 3.
+    const int        min_depth_ = std::min(3, buffer_size_);
+    const int        max_depth_ = config_.max_depth();
+    std::atomic<int> depth_{buffer_size_};
+    int              calm_frames_  = 0;
+    int              min_buffered_ = std::numeric_limits<int>::max();
+
+    std::atomic<std::int64_t> late_frames_{0};
+    std::atomic<std::int64_t> dropped_frames_{0};
+
+    // From scheduling a frame until the card shows it, as of the last scheduled frame.
+    std::atomic<double> latency_ms_{0.0};
+
     long long video_scheduled_ = 0;
     long long audio_scheduled_ = 0;
 
-    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(buffer_size_ + 1)};
+    boost::circular_buffer<std::vector<int32_t>> audio_container_{static_cast<unsigned long>(max_depth_ + 1)};
+    diagnostics::memory::held_bytes              audio_held_{"decklink/audio"};
 
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
@@ -284,17 +512,40 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
     std::atomic<int64_t>                scheduled_frames_completed_{0};
     std::unique_ptr<key_video_context>  key_context_;
 
+    std::vector<std::unique_ptr<mirror_output>> mirrors_;
+
     com_ptr<IDeckLinkDisplayMode> mode_ =
-        get_display_mode(output_, format_desc_.format, bmdFormat8BitBGRA, bmdVideoOutputFlagDefault);
+        get_display_mode(output_, format_desc_.format, config_.bmd_pixel_format(), bmdVideoOutputFlagDefault);
     int field_count_ = mode_->GetFieldDominance() != bmdProgressiveFrame ? 2 : 1;
 
+    const std::size_t            row_bytes_  = config_.row_bytes(format_desc_);
+    const std::size_t            frame_size_ = row_bytes_ * format_desc_.height;
+    std::shared_ptr<buffer_pool> buffer_pool_;
+
+    // Without the channel clock frames are dropped or the last ones repeated as the clocks drift apart.
+    std::atomic<bool>              master_;
+    std::vector<core::const_frame> last_frames_;
+    std::atomic<std::int64_t>      dropped_{0};
+    std::atomic<std::int64_t>      repeated_{0};
+
+    // Frames scheduled on the card that are not out yet, for the latency of the channel.
+    std::atomic<int> buffered_video_{0};
+
     std::atomic<bool> abort_request_{false};
 
   public:
-    decklink_consumer(const configuration& config, const core::video_format_desc& format_desc, int channel_index)
+    // A pool prepared for the format is taken over instead of allocating another one.
+    decklink_consumer(const configuration&           config,
+                      const core::video_format_desc& format_desc,
+                      int                            channel_index,
+                      bool                           master,
+                      std::shared_ptr<buffer_pool>   prepared = nullptr)
         : channel_index_(channel_index)
         , config_(config)
         , format_desc_(format_desc)
+        , buffer_pool_(prepared && prepared->size() == frame_size_ ? std::move(prepared)
+                                                                    : create_buffer_pool(config_, format_desc_))
+        , master_(master)
     {
         if (config.keyer == configuration::keyer_t::external_separate_device_keyer) {
             key_context_.reset(new key_video_context(config, print()));
@@ -306,16 +557,26 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         graph_->set_color("flushed-frame", diagnostics::color(0.4f, 0.3f, 0.8f));
         graph_->set_color("buffered-audio", diagnostics::color(0.9f, 0.9f, 0.5f));
         graph_->set_color("buffered-video", diagnostics::color(0.2f, 0.9f, 0.9f));
+        graph_->set_color("slave-dropped", diagnostics::color(0.9f, 0.5f, 0.1f));
+        graph_->set_color("slave-repeated", diagnostics::color(0.5f, 0.1f, 0.9f));
 
         if (key_context_) {
             graph_->set_color("key-offset", diagnostics::color(1.0f, 0.0f, 0.0f));
         }
+        if (!config_.mirror_devices.empty()) {
+            graph_->set_color("mirror-drift", diagnostics::color(0.8f, 0.2f, 0.8f));
+        }
 
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
         enable_video(mode_->GetDisplayMode());
 
+        for (auto device_index : config_.mirror_devices) {
+            mirrors_.emplace_back(
+                new mirror_output(device_index, config_, mode_->GetDisplayMode(), format_desc_, print()));
+        }
+
         if (config.embedded_audio) {
             enable_audio();
         }
@@ -325,6 +586,9 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
         if (config.embedded_audio) {
             output_->BeginAudioPreroll();
+            for (auto& mirror : mirrors_) {
+                mirror->output_->BeginAudioPreroll();
+            }
         }
 
         for (int n = 0; n < buffer_size_; ++n) {
@@ -333,12 +597,15 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
                 schedule_next_audio(std::vector<int32_t>(nb_samples * format_desc_.audio_channels), nb_samples);
             }
 
-            std::shared_ptr<void> image_data(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-            schedule_next_video(image_data, nb_samples);
+            schedule_next_video(
+                buffer_pool_->get(), key_context_ || config_.key_only ? buffer_pool_->get() : nullptr, nb_samples);
         }
 
         if (config.embedded_audio) {
             output_->EndAudioPreroll();
+            for (auto& mirror : mirrors_) {
+                mirror->output_->EndAudioPreroll();
+            }
         }
 
         start_playback();
@@ -396,6 +663,38 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         if (key_context_ && FAILED(key_context_->output_->StartScheduledPlayback(0, format_desc_.time_scale, 1.0))) {
             CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to schedule key playback."));
         }
+
+        for (auto& mirror : mirrors_) {
+            if (FAILED(mirror->output_->StartScheduledPlayback(0, format_desc_.time_scale, 1.0))) {
+                CASPAR_THROW_EXCEPTION(caspar_exception()
+                                       << msg_info(print() + L" Failed to schedule mirror playback on " +
+                                                   std::to_wstring(mirror->device_index_) + L"."));
+            }
+        }
+    }
+
+    // The mirrors' stream time relative to this card's, in milliseconds, positive when a mirror runs ahead.
+    void measure_mirrors()
+    {
+        BMDTimeValue time  = 0;
+        double       speed = 0.0;
+        if (mirrors_.empty() || FAILED(output_->GetScheduledStreamTime(format_desc_.time_scale, &time, &speed))) {
+            return;
+        }
+
+        auto max_drift = 0.0;
+        for (auto& mirror : mirrors_) {
+            BMDTimeValue mirror_time = 0;
+            if (FAILED(mirror->output_->GetScheduledStreamTime(format_desc_.time_scale, &mirror_time, &speed))) {
+                continue;
+            }
+            const auto drift = static_cast<double>(mirror_time - time) * 1000.0 / format_desc_.time_scale;
+            mirror->drift_ms_ = drift;
+            max_drift         = std::max(max_drift, std::abs(drift));
+        }
+
+        // Half way up is a frame apart.
+        graph_->set_value("mirror-drift", max_drift * format_desc_.fps / 1000.0 * 0.5);
     }
 
     HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
@@ -424,6 +723,7 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             tick_timer_.restart();
 
             reference_signal_detector_.detect_change([this]() { return print(); });
+            measure_mirrors();
 
             auto dframe = reinterpret_cast<decklink_frame*>(completed_frame);
             ++scheduled_frames_completed_;
@@ -439,69 +739,138 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
                 video_scheduled_ += format_desc_.duration * field_count_;
                 audio_scheduled_ += dframe->nb_samples();
+                ++late_frames_;
             } else if (result == bmdOutputFrameDropped) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                ++dropped_frames_;
             } else if (result == bmdOutputFrameFlushed) {
                 graph_->set_tag(diagnostics::tag_severity::WARNING, "flushed-frame");
             }
 
+            auto adjust = 0;
             {
                 UINT32 buffered;
                 output_->GetBufferedVideoFrameCount(&buffered);
-                graph_->set_value("buffered-video", static_cast<double>(buffered) / config_.buffer_depth());
+                buffered_video_ = static_cast<int>(buffered);
+                adjust          = adapt(result, static_cast<int>(buffered));
+                graph_->set_value("buffered-video", static_cast<double>(buffered) / depth_);
 
                 if (config_.embedded_audio) {
                     output_->GetBufferedAudioSampleFrameCount(&buffered);
                     graph_->set_value("buffered-audio",
                                       static_cast<double>(buffered) /
-                                          (format_desc_.audio_cadence[0] * field_count_ * config_.buffer_depth()));
+                                          (format_desc_.audio_cadence[0] * field_count_ * depth_));
                 }
             }
 
-            std::shared_ptr<void>     image_data(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-            std::vector<std::int32_t> audio_data;
+            // A frame less is scheduled this time, the channel's frames wait for the next completion.
+            if (adjust < 0) {
+                return S_OK;
+            }
+
+            auto audio_data = next_audio_buffer();
+
+            std::vector<core::const_frame> frames;
+            const auto                     repeat = !master_ && buffered() < field_count_ && !last_frames_.empty();
+            if (repeat) {
+                // The channel clock runs slower than this card, the last frame is shown again without its audio.
+                frames = last_frames_;
+                ++repeated_;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "slave-repeated");
+                audio_data.resize(format_desc_.audio_cadence[0] * field_count_ * format_desc_.audio_channels, 0);
+            } else {
+                for (auto n = 0; n < field_count_; ++n) {
+                    frames.push_back(pop());
+                }
 
-            std::vector<core::const_frame> frames{pop()};
-            if (mode_->GetFieldDominance() != bmdProgressiveFrame) {
-                frames.push_back(pop());
+                // Mixed fields are woven in pairs starting with the dominant one, a lone field is dropped to get back
+                // in step with them.
+                const auto second_field = mode_->GetFieldDominance() != bmdUpperFieldFirst ? core::field_mode::upper
+                                                                                           : core::field_mode::lower;
+                if (field_count_ > 1 && frames[0] && frames[0].pixel_format_desc().field == second_field) {
+                    frames.erase(frames.begin());
+                    frames.push_back(pop());
+                    ++dropped_;
+                }
 
                 if (abort_request_) {
                     return E_FAIL;
                 }
 
-                if (mode_->GetFieldDominance() != bmdUpperFieldFirst) {
+                if (field_count_ > 1 && mode_->GetFieldDominance() != bmdUpperFieldFirst) {
                     std::swap(frames[0], frames[1]);
                 }
 
-                for (auto y = 0; y < format_desc_.height; ++y) {
-                    std::memcpy(reinterpret_cast<char*>(image_data.get()) + y * format_desc_.width * 4,
-                                frames[y % 2].image_data(0).data() + y * format_desc_.width * 4,
-                                format_desc_.width * 4);
+                for (auto& frame : frames) {
+                    audio_data.insert(audio_data.end(), frame.audio_data().begin(), frame.audio_data().end());
                 }
+                last_frames_ = frames;
+            }
 
-                audio_data.insert(audio_data.end(), frames[0].audio_data().begin(), frames[0].audio_data().end());
-                audio_data.insert(audio_data.end(), frames[1].audio_data().begin(), frames[1].audio_data().end());
-            } else {
-                if (abort_request_) {
-                    return E_FAIL;
-                }
+            // While the channel switches between fields and whole frames a pair may hold one of each, the whole frame
+            // then stands in for both.
+            if (field_count_ > 1 && is_field(frames[0]) != is_field(frames[1])) {
+                frames[0] = frames[1] = is_field(frames[0]) ? frames[1] : frames[0];
+            }
 
-                for (auto y = 0; y < format_desc_.height; ++y) {
-                    std::memcpy(reinterpret_cast<char*>(image_data.get()) + y * format_desc_.width * 4,
-                                frames[0].image_data(0).data() + y * format_desc_.width * 4,
-                                format_desc_.width * 4);
-                }
+            std::shared_ptr<void> fill;
+            std::shared_ptr<void> key;
+            if (key_context_ || config_.key_only) {
+                key = buffer_pool_->get();
+            }
+
+            std::vector<const std::uint8_t*> sources;
+            for (auto& frame : frames) {
+                frame = frame.converted(config_.pixel_format);
+                sources.push_back(frame ? frame.image_data(0).data() : nullptr);
+            }
 
-                audio_data.insert(audio_data.end(), frames[0].audio_data().begin(), frames[0].audio_data().end());
+            if (std::find(sources.begin(), sources.end(), nullptr) != sources.end()) {
+                // The mixer renders a newly requested pixel format from the next frame on.
+                fill = buffer_pool_->get();
+                sources.clear();
+            } else if (frames.size() == 1 && frames[0].image_data(0).size() == frame_size_) {
+                // The card reads the readback buffer itself, the frame stays referenced until it is released.
+                auto frame = frames[0];
+                fill       = std::shared_ptr<void>(const_cast<std::uint8_t*>(sources[0]), [frame](void*) {});
+            } else if (frames.size() == 1) {
+                fill = buffer_pool_->get();
+                std::memcpy(fill.get(), sources[0], std::min(frames[0].image_data(0).size(), frame_size_));
+                sources[0] = static_cast<const std::uint8_t*>(fill.get());
+            } else if (!config_.key_only) {
+                fill = buffer_pool_->get();
+            }
+
+            // Weaves fields and extracts the key in one pass, a scheduled source is only read for its key.
+            const auto woven = frames.size() > 1 ? static_cast<std::uint8_t*>(fill.get()) : nullptr;
+            if (!sources.empty() && (woven != nullptr || key)) {
+                weave_fill_key(woven,
+                               static_cast<std::uint8_t*>(key.get()),
+                               sources.data(),
+                               static_cast<int>(sources.size()),
+                               is_field(frames[0]),
+                               row_bytes_,
+                               format_desc_.height);
             }
 
             const auto nb_samples = static_cast<int>(audio_data.size()) / format_desc_.audio_channels;
 
-            schedule_next_video(image_data, nb_samples);
+            schedule_next_video(fill, key, nb_samples);
 
             if (config_.embedded_audio) {
                 schedule_next_audio(std::move(audio_data), nb_samples);
             }
+
+            // A frame more is prerolled by showing this one twice, the second time without audio.
+            if (adjust > 0) {
+                schedule_next_video(fill, key, nb_samples);
+                if (config_.embedded_audio) {
+                    auto silence = std::vector<std::int32_t>(nb_samples * format_desc_.audio_channels);
+                    schedule_next_audio(std::move(silence), nb_samples);
+                }
+            }
+
+            measure_latency();
         } catch (...) {
             std::lock_guard<std::mutex> lock(exception_mutex_);
             exception_ = std::current_exception();
@@ -511,6 +880,56 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         return S_OK;
     }
 
+    // Late or dropped frames, or a card that ran out of frames, add a frame to the preroll. A window of 10 seconds
+    // without them in which the card always had 2 frames to spare takes one away. Returns the frames to add.
+    int adapt(BMDOutputFrameCompletionResult result, int buffered)
+    {
+        if (!config_.adaptive_buffer) {
+            return 0;
+        }
+
+        if (result == bmdOutputFrameDisplayedLate || result == bmdOutputFrameDropped || buffered == 0) {
+            calm_frames_  = 0;
+            min_buffered_ = std::numeric_limits<int>::max();
+            if (depth_ < max_depth_) {
+                ++depth_;
+                CASPAR_LOG(info) << print() << L" Increased buffer depth to " << depth_ << L".";
+                return 1;
+            }
+            return 0;
+        }
+
+        min_buffered_ = std::min(min_buffered_, buffered);
+        if (++calm_frames_ < static_cast<int>(format_desc_.fps / field_count_ * 10.0)) {
+            return 0;
+        }
+
+        const auto spare = min_buffered_;
+        calm_frames_     = 0;
+        min_buffered_    = std::numeric_limits<int>::max();
+        if (spare >= 2 && depth_ > min_depth_) {
+            --depth_;
+            CASPAR_LOG(info) << print() << L" Decreased buffer depth to " << depth_ << L".";
+            return -1;
+        }
+        return 0;
+    }
+
+    void measure_latency()
+    {
+        BMDTimeValue time  = 0;
+        double       speed = 0.0;
+        if (SUCCEEDED(output_->GetScheduledStreamTime(format_desc_.time_scale, &time, &speed))) {
+            const auto shown = video_scheduled_ - format_desc_.duration * field_count_;
+            latency_ms_      = static_cast<double>(shown - time) * 1000.0 / format_desc_.time_scale;
+        }
+    }
+
+    static bool is_field(const core::const_frame& frame)
+    {
+        return frame && frame.pixel_format_desc().field != core::field_mode::progressive;
+    }
+
     core::const_frame pop()
     {
         core::const_frame frame;
@@ -526,11 +945,40 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         return frame;
     }
 
+    std::size_t buffered()
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex_);
+        return buffer_.size();
+    }
+
+    // The oldest scheduled samples, which would be dropped by the next schedule_next_audio anyway, emptied for reuse.
+    std::vector<std::int32_t> next_audio_buffer()
+    {
+        std::vector<std::int32_t> buffer;
+        if (audio_container_.full()) {
+            buffer = std::move(audio_container_.front());
+            audio_container_.pop_front();
+            buffer.clear();
+            account_audio();
+        }
+        return buffer;
+    }
+
+    void account_audio()
+    {
+        std::int64_t bytes = 0;
+        for (auto& samples : audio_container_) {
+            bytes += static_cast<std::int64_t>(samples.capacity() * sizeof(std::int32_t));
+        }
+        audio_held_.set(bytes);
+    }
+
     void schedule_next_audio(std::vector<std::int32_t> audio, int nb_samples)
     {
         // TODO (refactor) does ScheduleAudioSamples copy data?
 
         audio_container_.push_back(std::move(audio));
+        account_audio();
 
         if (FAILED(output_->ScheduleAudioSamples(audio_container_.back().data(),
                                                  nb_samples,
@@ -539,22 +987,24 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
                                                  nullptr))) {
             CASPAR_LOG(error) << print() << L" Failed to schedule audio.";
         }
+        for (auto& mirror : mirrors_) {
+            if (FAILED(mirror->output_->ScheduleAudioSamples(audio_container_.back().data(),
+                                                             nb_samples,
+                                                             audio_scheduled_,
+                                                             format_desc_.audio_sample_rate,
+                                                             nullptr))) {
+                CASPAR_LOG(error) << print() << L" Failed to schedule mirror audio on " << mirror->device_index_
+                                  << L".";
+            }
+        }
 
         audio_scheduled_ += nb_samples;
     }
 
-    void schedule_next_video(std::shared_ptr<void> fill, int nb_samples)
+    void schedule_next_video(std::shared_ptr<void> fill, std::shared_ptr<void> key, int nb_samples)
     {
-        std::shared_ptr<void> key;
-
-        if (key_context_ || config_.key_only) {
-            key = std::shared_ptr<void>(scalable_aligned_malloc(format_desc_.size, 64), scalable_aligned_free);
-
-            aligned_memshfl(key.get(), fill.get(), format_desc_.size, 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
-
-            if (config_.key_only) {
-                fill = key;
-            }
+        if (config_.key_only) {
+            fill = key;
         }
 
         if (key_context_) {
@@ -567,7 +1017,8 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             }
         }
 
-        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(new decklink_frame(fill, format_desc_, nb_samples));
+        auto fill_frame = wrap_raw<com_ptr, IDeckLinkVideoFrame>(
+            new decklink_frame(fill, format_desc_, nb_samples, config_.bmd_pixel_format(), row_bytes_));
         if (FAILED(output_->ScheduleVideoFrame(get_raw(fill_frame),
                                                video_scheduled_,
                                                format_desc_.duration * field_count_,
@@ -575,6 +1026,17 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
             CASPAR_LOG(error) << print() << L" Failed to schedule fill video.";
         }
 
+        // The same frame, and so the same buffer, goes to every mirror at the same stream time.
+        for (auto& mirror : mirrors_) {
+            if (FAILED(mirror->output_->ScheduleVideoFrame(get_raw(fill_frame),
+                                                           video_scheduled_,
+                                                           format_desc_.duration * field_count_,
+                                                           format_desc_.time_scale))) {
+                CASPAR_LOG(error) << print() << L" Failed to schedule mirror video on " << mirror->device_index_
+                                  << L".";
+            }
+        }
+
         video_scheduled_ += format_desc_.duration * field_count_;
     }
 
@@ -593,7 +1055,16 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
 
         {
             std::unique_lock<std::mutex> lock(buffer_mutex_);
-            buffer_cond_.wait(lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
+            if (master_) {
+                buffer_cond_.wait(lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
+            } else if (buffer_.size() >= static_cast<std::size_t>(field_count_ * 2)) {
+                // The channel clock runs faster than this card, a whole frame is dropped to keep the field order.
+                for (auto n = 0; n < field_count_; ++n) {
+                    buffer_.pop();
+                }
+                ++dropped_;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "slave-dropped");
+            }
             buffer_.push(std::move(frame));
         }
         buffer_cond_.notify_all();
@@ -601,28 +1072,73 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback
         return !abort_request_;
     }
 
+    void set_master(bool master)
+    {
+        master_ = master;
+        buffer_cond_.notify_all();
+    }
+
+    std::int64_t clock_time() const
+    {
+        BMDTimeValue time          = 0;
+        BMDTimeValue time_in_frame = 0;
+        BMDTimeValue ticks         = 0;
+        if (FAILED(output_->GetHardwareReferenceClock(1000000, &time, &time_in_frame, &ticks))) {
+            return -1;
+        }
+        return time;
+    }
+
+    core::monitor::state state() const
+    {
+        core::monitor::state state;
+        state["clock"]["master"]    = master_.load();
+        state["clock"]["dropped"]   = dropped_.load();
+        state["clock"]["repeated"]  = repeated_.load();
+        state["buffer"]["depth"]    = depth_.load();
+        state["buffer"]["adaptive"] = config_.adaptive_buffer;
+        state["buffer"]["late"]     = late_frames_.load();
+        state["buffer"]["dropped"]  = dropped_frames_.load();
+        state["latency-ms"]         = latency_ms_.load();
+        for (auto& mirror : mirrors_) {
+            auto output         = state["mirrors"][mirror->device_index_];
+            output["drift-ms"]  = mirror->drift_ms_.load();
+            output["completed"] = mirror->completed_.load();
+            output["late"]      = mirror->late_.load();
+            output["dropped"]   = mirror->dropped_.load();
+        }
+        return state;
+    }
+
     std::wstring print() const
     {
+        auto devices = std::to_wstring(config_.device_index);
         if (config_.keyer == configuration::keyer_t::external_separate_device_keyer) {
-            return model_name_ + L" [" + std::to_wstring(channel_index_) + L"-" +
-                   std::to_wstring(config_.device_index) + L"&&" + std::to_wstring(config_.key_device_index()) + L"|" +
-                   format_desc_.name + L"]";
+            devices += L"&&" + std::to_wstring(config_.key_device_index());
+        }
+        for (auto device_index : config_.mirror_devices) {
+            devices += L"+" + std::to_wstring(device_index);
         }
-        return model_name_ + L" [" + std::to_wstring(channel_index_) + L"-" + std::to_wstring(config_.device_index) +
-               L"|" + format_desc_.name + L"]";
+        return model_name_ + L" [" + std::to_wstring(channel_index_) + L"-" + devices + L"|" + format_desc_.name + L"]";
     }
 };
 
 struct decklink_consumer_proxy : public core::frame_consumer
 {
-    const configuration                config_;
-    std::unique_ptr<decklink_consumer> consumer_;
-    core::video_format_desc            format_desc_;
-    executor                           executor_;
+    const configuration                      config_;
+    const std::vector<core::latency_profile> latencies_; // Of every channel, by index - 1.
+    std::unique_ptr<decklink_consumer>       consumer_;
+    core::video_format_desc                  format_desc_;
+    std::atomic<bool>                        master_{true};
+    std::atomic<bool>                        fields_{false};
+    std::mutex                               prepared_mutex_;
+    std::shared_ptr<buffer_pool>             prepared_;
+    executor                                 executor_;
 
   public:
-    explicit decklink_consumer_proxy(const configuration& config)
+    decklink_consumer_proxy(const configuration& config, std::vector<core::latency_profile> latencies)
         : config_(config)
+        , latencies_(std::move(latencies))
         , executor_(L"decklink_consumer[" + std::to_wstring(config.device_index) + L"]")
     {
         executor_.begin_invoke([=] { com_initialize(); });
@@ -639,15 +1155,42 @@ struct decklink_consumer_proxy : public core::frame_consumer
         });
     }
 
+    configuration channel_config(int channel_index) const
+    {
+        if (channel_index >= 1 && channel_index <= static_cast<int>(latencies_.size())) {
+            return config_.with_profile(latencies_[channel_index - 1]);
+        }
+        return config_;
+    }
+
     void initialize(const core::video_format_desc& format_desc, int channel_index) override
     {
         format_desc_ = format_desc;
+
+        auto                         config = channel_config(channel_index);
+        std::shared_ptr<buffer_pool> prepared;
+        {
+            std::lock_guard<std::mutex> lock(prepared_mutex_);
+            prepared = std::move(prepared_);
+        }
+
         executor_.invoke([=] {
             consumer_.reset();
-            consumer_.reset(new decklink_consumer(config_, format_desc, channel_index));
+            consumer_.reset(new decklink_consumer(config, format_desc, channel_index, master_, prepared));
+            fields_ = consumer_->field_count_ > 1;
         });
     }
 
+    // The card only switches its mode in initialize, the frame buffers of the new format are allocated ahead of it
+    // while the current one plays.
+    void prepare(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        auto pool = create_buffer_pool(channel_config(channel_index), format_desc);
+
+        std::lock_guard<std::mutex> lock(prepared_mutex_);
+        prepared_ = std::move(pool);
+    }
+
     std::future<bool> send(core::const_frame frame) override
     {
         return executor_.begin_invoke([=] { return consumer_->send(frame); });
@@ -660,8 +1203,56 @@ struct decklink_consumer_proxy : public core::frame_consumer
     int index() const override { return 300 + config_.device_index; }
 
     bool has_synchronization_clock() const override { return true; }
+
+    void set_synchronization_clock(bool enabled) override
+    {
+        if (master_.exchange(enabled) != enabled) {
+            executor_.begin_invoke([=] {
+                if (consumer_) {
+                    consumer_->set_master(enabled);
+                }
+            });
+        }
+    }
+
+    std::int64_t clock_time() const override { return consumer_ ? consumer_->clock_time() : -1; }
+
+    core::monitor::state state() const override
+    {
+        static const core::monitor::state empty;
+        return consumer_ ? consumer_->state() : empty;
+    }
+
+    core::pixel_format preferred_pixel_format() const override { return config_.pixel_format; }
+
+    bool accepts_fields() const override { return fields_; }
+
+    int buffered_frames() const override { return consumer_ ? consumer_->buffered_video_.load() : 0; }
 };
 
+void check_mirrors(const configuration& config)
+{
+    for (auto device_index : config.mirror_devices) {
+        if (device_index == config.device_index ||
+            (config.keyer == configuration::keyer_t::external_separate_device_keyer &&
+             device_index == config.key_device_index()) ||
+            std::count(config.mirror_devices.begin(), config.mirror_devices.end(), device_index) > 1) {
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"Decklink mirror device " + std::to_wstring(device_index) +
+                                               L" is already an output of this consumer."));
+        }
+    }
+}
+
+std::vector<core::latency_profile> channel_latencies(const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    std::vector<core::latency_profile> latencies;
+    for (auto& channel : channels) {
+        latencies.push_back(channel->latency());
+    }
+    return latencies;
+}
+
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                  params,
                                                       std::vector<spl::shared_ptr<core::video_channel>> channels)
 {
@@ -685,13 +1276,27 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     }
 
     if (contains_param(L"LOW_LATENCY", params)) {
-        config.latency = configuration::latency_t::low_latency;
+        config.latency            = configuration::latency_t::low_latency;
+        config.latency_configured = true;
     }
 
-    config.embedded_audio = contains_param(L"EMBEDDED_AUDIO", params);
-    config.key_only       = contains_param(L"KEY_ONLY", params);
+    config.embedded_audio  = contains_param(L"EMBEDDED_AUDIO", params);
+    config.key_only        = contains_param(L"KEY_ONLY", params);
+    config.adaptive_buffer = contains_param(L"ADAPTIVE_BUFFER", params);
+
+    set_pixel_format(config, get_param(L"PIXEL_FORMAT", params, std::wstring(L"bgra")));
+
+    // MIRRORS 2,3 shows the same fill on devices 2 and 3.
+    std::vector<std::wstring> mirrors;
+    boost::split(mirrors, get_param(L"MIRRORS", params, std::wstring()), boost::is_any_of(L","));
+    for (auto& mirror : mirrors) {
+        if (!mirror.empty()) {
+            config.mirror_devices.push_back(boost::lexical_cast<int>(mirror));
+        }
+    }
+    check_mirrors(config);
 
-    return spl::make_shared<decklink_consumer_proxy>(config);
+    return spl::make_shared<decklink_consumer_proxy>(config, channel_latencies(channels));
 }
 
 spl::shared_ptr<core::frame_consumer>
@@ -709,7 +1314,8 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
         config.keyer = configuration::keyer_t::external_separate_device_keyer;
     }
 
-    auto latency = ptree.get(L"latency", L"default");
+    auto latency              = ptree.get(L"latency", L"default");
+    config.latency_configured = latency != L"default";
     if (latency == L"low") {
         config.latency = configuration::latency_t::low_latency;
     } else if (latency == L"normal") {
@@ -722,7 +1328,21 @@ create_preconfigured_consumer(const boost::property_tree::wptree&
     config.embedded_audio    = ptree.get(L"embedded-audio", config.embedded_audio);
     config.base_buffer_depth = ptree.get(L"buffer-depth", config.base_buffer_depth);
 
-    return spl::make_shared<decklink_consumer_proxy>(config);
+    config.buffer_depth_configured = static_cast<bool>(ptree.get_optional<int>(L"buffer-depth"));
+    config.adaptive_buffer         = ptree.get(L"adaptive-buffer", config.adaptive_buffer);
+    config.max_buffer_depth        = ptree.get(L"max-buffer-depth", config.max_buffer_depth);
+
+    set_pixel_format(config, ptree.get(L"pixel-format", std::wstring(L"bgra")));
+
+    auto mirrors = ptree.get_child_optional(L"mirrors");
+    if (mirrors) {
+        for (auto& device : *mirrors) {
+            config.mirror_devices.push_back(device.second.get_value<int>());
+        }
+    }
+    check_mirrors(config);
+
+    return spl::make_shared<decklink_consumer_proxy>(config, channel_latencies(channels));
 }
 
 }} // namespace caspar::decklink
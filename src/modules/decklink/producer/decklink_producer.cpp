@@ -25,6 +25,7 @@
 
 #include "../util/util.h"
 
+#include <common/array.h>
 #include <common/diagnostics/graph.h>
 #include <common/except.h>
 #include <common/executor.h>
@@ -38,12 +39,19 @@
 
 #include <core/diagnostics/call_context.h>
 #include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
 #include <core/monitor/monitor.h>
 #include <core/producer/frame_producer.h>
 
 #include <tbb/concurrent_queue.h>
 
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptor/transformed.hpp>
@@ -286,7 +294,165 @@ struct Filter
     }
 };
 
-class decklink_producer : public IDeckLinkInputCallback
+class decklink_producer;
+
+// A captured frame and audio packet, handed to every producer of the device.
+struct capture
+{
+    IDeckLinkVideoInputFrame*     video;
+    IDeckLinkAudioInputPacket*    audio;
+    com_ptr<IDeckLinkDisplayMode> mode;
+    int                           audio_channels;
+    const void*                   tag;
+    core::const_frame             frame;
+
+    // The captured UYVY, or v210, copied into a frame of the first producer that takes it unfiltered. The others get
+    // the same frame, which the channels on one OpenGL device then upload once and share.
+    core::const_frame direct_frame(core::frame_factory& frame_factory)
+    {
+        if (frame) {
+            return frame;
+        }
+
+        void* video_bytes = nullptr;
+        void* audio_bytes = nullptr;
+        if (FAILED(video->GetBytes(&video_bytes)) || !video_bytes || FAILED(audio->GetBytes(&audio_bytes)) ||
+            !audio_bytes) {
+            return core::const_frame{};
+        }
+
+        // Both hold 4 byte texels, a UYVY texel is 2 pixels and 4 v210 texels are 6.
+        const auto v210 = video->GetPixelFormat() == bmdFormat10BitYUV;
+
+        core::pixel_format_desc desc(v210 ? core::pixel_format::v210 : core::pixel_format::uyvy);
+        desc.planes.push_back(core::pixel_format_desc::plane(video->GetRowBytes() / 4, video->GetHeight(), 4));
+        if (v210) {
+            desc.bit_depth    = 10;
+            desc.packed_width = video->GetWidth();
+        }
+        if (mode->GetFlags() & bmdDisplayModeColorspaceRec601) {
+            desc.color_space = core::color_space::bt601;
+        } else if (mode->GetFlags() & bmdDisplayModeColorspaceRec709) {
+            desc.color_space = core::color_space::bt709;
+        }
+
+        auto result = frame_factory.create_frame(tag, desc);
+        std::memcpy(result.image_data(0).data(), video_bytes, result.image_data(0).size());
+
+        const auto samples  = reinterpret_cast<const std::int32_t*>(audio_bytes);
+        const auto count    = static_cast<std::size_t>(audio->GetSampleFrameCount()) * audio_channels;
+        result.audio_data() = std::vector<std::int32_t>(samples, samples + count);
+
+        frame = core::const_frame(std::move(result));
+        return frame;
+    }
+};
+
+// The input of a device, shared by the producers of it on every channel. The first producer sets the input format,
+// audio channels and pixel format and starts the capture, the last one to leave stops it.
+class capture_session final : public IDeckLinkInputCallback
+{
+    const int device_index_;
+
+    com_ptr<IDeckLink>                 decklink_   = get_device(device_index_);
+    com_iface_ptr<IDeckLinkInput>      input_      = iface_cast<IDeckLinkInput>(decklink_);
+    com_iface_ptr<IDeckLinkAttributes> attributes_ = iface_cast<IDeckLinkAttributes>(decklink_);
+
+    const std::wstring model_name_ = get_model_name(decklink_);
+
+    std::mutex                      mutex_;
+    std::vector<decklink_producer*> producers_;
+
+    core::video_format_desc       input_format_;
+    com_ptr<IDeckLinkDisplayMode> mode_;
+    int                           audio_channels_ = 0;
+    BMDPixelFormat                pixel_format_   = bmdFormat8BitYUV;
+
+  public:
+    explicit capture_session(int device_index)
+        : device_index_(device_index)
+    {
+    }
+
+    ~capture_session()
+    {
+        if (input_ != nullptr) {
+            input_->StopStreams();
+            input_->DisableVideoInput();
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
+    ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+    // Frames are passed to the producer from the next one captured. format is the FORMAT it asked for, if any.
+    void subscribe(decklink_producer* producer, const std::wstring& format);
+    void unsubscribe(decklink_producer* producer);
+
+    HRESULT STDMETHODCALLTYPE VideoInputFormatChanged(BMDVideoInputFormatChangedEvents notificationEvents,
+                                                      IDeckLinkDisplayMode*            newDisplayMode,
+                                                      BMDDetectedVideoInputFormatFlags detectedSignalFlags) override;
+    HRESULT STDMETHODCALLTYPE VideoInputFrameArrived(IDeckLinkVideoInputFrame*  video,
+                                                     IDeckLinkAudioInputPacket* audio) override;
+
+    int device_index() const { return device_index_; }
+
+    const std::wstring& model_name() const { return model_name_; }
+
+  private:
+    void start(decklink_producer* producer, const std::wstring& format);
+
+    std::wstring print() const
+    {
+        return model_name_ + L" [" + std::to_wstring(device_index_) + L"|" + input_format_.name + L"]";
+    }
+};
+
+// Open sessions by device index. A session leaves the map only once it has closed the device, so a producer opening
+// the device again waits for the last one to let go of it.
+struct session_registry
+{
+    std::mutex                                    mutex;
+    std::condition_variable                       closed;
+    std::map<int, std::weak_ptr<capture_session>> sessions;
+};
+
+session_registry& registry()
+{
+    static session_registry instance;
+    return instance;
+}
+
+std::shared_ptr<capture_session> open_session(int device_index)
+{
+    auto&                        sessions = registry();
+    std::unique_lock<std::mutex> lock(sessions.mutex);
+
+    for (auto it = sessions.sessions.find(device_index); it != sessions.sessions.end();
+         it      = sessions.sessions.find(device_index)) {
+        if (auto session = it->second.lock()) {
+            return session;
+        }
+        sessions.closed.wait(lock);
+    }
+
+    auto session = std::shared_ptr<capture_session>(new capture_session(device_index), [](capture_session* ptr) {
+        const auto device_index = ptr->device_index();
+        delete ptr;
+
+        auto& sessions = registry();
+        {
+            std::lock_guard<std::mutex> lock(sessions.mutex);
+            sessions.sessions.erase(device_index);
+        }
+        sessions.closed.notify_all();
+    });
+    sessions.sessions[device_index] = session;
+    return session;
+}
+
+class decklink_producer
 {
     const int                           device_index_;
     core::monitor::state                state_;
@@ -294,15 +460,14 @@ class decklink_producer : public IDeckLinkInputCallback
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
 
-    com_ptr<IDeckLink>                 decklink_   = get_device(device_index_);
-    com_iface_ptr<IDeckLinkInput>      input_      = iface_cast<IDeckLinkInput>(decklink_);
-    com_iface_ptr<IDeckLinkAttributes> attributes_ = iface_cast<IDeckLinkAttributes>(decklink_);
+    std::shared_ptr<capture_session> session_ = open_session(device_index_);
 
-    const std::wstring model_name_ = get_model_name(decklink_);
+    const std::wstring model_name_ = session_->model_name();
 
     core::video_format_desc              format_desc_;
     std::vector<int>                     audio_cadence_ = format_desc_.audio_cadence;
     spl::shared_ptr<core::frame_factory> frame_factory_;
+    frame_cache                          frame_cache_;
 
     double in_sync_  = 0.0;
     double out_sync_ = 0.0;
@@ -310,8 +475,22 @@ class decklink_producer : public IDeckLinkInputCallback
     bool freeze_on_lost_;
     bool has_signal_;
 
-    tbb::concurrent_bounded_queue<core::draw_frame> frame_buffer_;
-    core::draw_frame                                last_frame_;
+    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+
+    // Jitter buffer, filled by the capture callback and drained once per channel tick. Video is held at depth_
+    // frames by dropping or repeating a frame when the average fill drifts a frame away. Audio is collected
+    // separately and resampled by the ratio that keeps it at the same latency, which is the clock drift between
+    // the input and the channel.
+    const int                 depth_;
+    core::const_frame         last_frame_;
+    double                    fill_   = 0.0;
+    bool                      primed_ = false;
+    std::vector<std::int32_t> audio_fifo_;
+    double                    audio_pos_     = 0.0;
+    double                    drift_         = 0.0;
+    std::int64_t              dropped_       = 0;
+    std::int64_t              repeated_      = 0;
+    int                       video_waiting_ = 0;
 
     std::exception_ptr exception_;
 
@@ -325,6 +504,11 @@ class decklink_producer : public IDeckLinkInputCallback
     Filter video_filter_;
     Filter audio_filter_;
 
+    // Without filters and with an input already in the channel format, frames hold the captured UYVY, or v210 when
+    // every producer of the device asks for it, and the mixer converts them to RGB on the GPU.
+    bool       direct_ = false;
+    const bool v210_;
+
   public:
     decklink_producer(const core::video_format_desc&              format_desc,
                       int                                         device_index,
@@ -332,7 +516,9 @@ class decklink_producer : public IDeckLinkInputCallback
                       const std::string&                          vfilter,
                       const std::string&                          afilter,
                       const std::wstring&                         format,
-                      bool                                        freeze_on_lost)
+                      bool                                        freeze_on_lost,
+                      int                                         depth,
+                      bool                                        v210)
         : device_index_(device_index)
         , format_desc_(format_desc)
         , frame_factory_(frame_factory)
@@ -340,127 +526,78 @@ class decklink_producer : public IDeckLinkInputCallback
         , input_format(format_desc_)
         , vfilter_(vfilter)
         , afilter_(afilter)
+        , depth_(std::max(1, depth))
+        , v210_(v210)
     {
-        // use user-provided format if available, or choose the channel's output format
-        if (!format.empty()) {
-            input_format = core::video_format_desc(format);
-        }
-
-        mode_         = get_display_mode(input_, input_format.format, bmdFormat8BitYUV, bmdVideoOutputFlagDefault);
-        video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_);
-        audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_);
-
         boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
 
-        frame_buffer_.set_capacity(3);
+        frame_buffer_.set_capacity(depth_ * 2 + 2);
 
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
         graph_->set_color("frame-time", diagnostics::color(1.0f, 0.0f, 0.0f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("repeated-frame", diagnostics::color(0.6f, 0.6f, 0.3f));
         graph_->set_color("output-buffer", diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("in-sync", diagnostics::color(1.0f, 0.2f, 0.0f));
         graph_->set_color("out-sync", diagnostics::color(0.0f, 0.2f, 1.0f));
         graph_->set_text(print());
         diagnostics::register_graph(graph_);
 
-        BOOL status = FALSE;
-        int  flags  = bmdVideoInputEnableFormatDetection;
-
-        if (!format.empty()) {
-            flags = 0;
-        } else if (FAILED(attributes_->GetFlag(BMDDeckLinkSupportsInputFormatDetection, &status)) || !status) {
-            CASPAR_LOG(warning) << L"Decklink producer does not support auto detect input, you can explicitly choose a "
-                                   L"format by appending FORMAT";
-            flags = 0;
-        }
-
-        if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), bmdFormat8BitYUV, flags))) {
-            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
-                                                      << boost::errinfo_api_function("EnableVideoInput"));
-        }
-
-        if (FAILED(input_->EnableAudioInput(bmdAudioSampleRate48kHz,
-                                            bmdAudioSampleType32bitInteger,
-                                            static_cast<int>(format_desc_.audio_channels)))) {
-            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable audio input.")
-                                                      << boost::errinfo_api_function("EnableAudioInput"));
-        }
-
-        if (FAILED(input_->SetCallback(this)) != S_OK) {
-            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to set input callback.")
-                                                      << boost::errinfo_api_function("SetCallback"));
-        }
-
-        if (FAILED(input_->StartStreams())) {
-            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to start input stream.")
-                                                      << boost::errinfo_api_function("StartStreams"));
-        }
+        session_->subscribe(this, format);
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
-    ~decklink_producer()
+    ~decklink_producer() { session_->unsubscribe(this); }
+
+    // Called by the session with its lock held, first when subscribing and then on every change of input format.
+    void configure(const com_ptr<IDeckLinkDisplayMode>& mode, const core::video_format_desc& format)
     {
-        if (input_ != nullptr) {
-            input_->StopStreams();
-            input_->DisableVideoInput();
-        }
+        mode_        = mode;
+        input_format = format;
+        graph_->set_text(print());
+        reset_filters();
     }
 
-    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, LPVOID*) override { return E_NOINTERFACE; }
-    ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
-    ULONG STDMETHODCALLTYPE Release() override { return 1; }
-
-    HRESULT STDMETHODCALLTYPE VideoInputFormatChanged(BMDVideoInputFormatChangedEvents notificationEvents,
-                                                      IDeckLinkDisplayMode*            newDisplayMode,
-                                                      BMDDetectedVideoInputFormatFlags /*detectedSignalFlags*/) override
+    void reset_filters()
     {
-        try {
-            auto newMode = newDisplayMode->GetDisplayMode();
-            auto fmt     = get_caspar_video_format(newMode);
-
-            auto new_fmt = core::video_format_desc(fmt);
-
-            CASPAR_LOG(info) << print() << L" Input format changed from " << input_format.name << L" to "
-                             << new_fmt.name;
-
-            input_->PauseStreams();
-
-            // reinitializing filters because not all filters can handle on-the-fly format changes
-            input_format = new_fmt;
-            mode_        = get_display_mode(input_, newMode, bmdFormat8BitYUV, bmdVideoOutputFlagDefault);
-
-            graph_->set_text(print());
+        direct_ = vfilter_.empty() && afilter_.empty() && input_format.format == format_desc_.format &&
+                  mode_->GetFieldDominance() == bmdProgressiveFrame;
 
+        if (direct_) {
+            video_filter_ = Filter();
+            audio_filter_ = Filter();
+        } else {
             video_filter_ = Filter(vfilter_, AVMEDIA_TYPE_VIDEO, format_desc_, mode_);
             audio_filter_ = Filter(afilter_, AVMEDIA_TYPE_AUDIO, format_desc_, mode_);
+        }
 
-            // reinitializing video input with the new display mode
-            if (FAILED(input_->EnableVideoInput(newMode, bmdFormat8BitYUV, bmdVideoInputEnableFormatDetection))) {
-                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to enable video input.")
-                                                          << boost::errinfo_api_function("EnableVideoInput"));
-            }
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["file/direct"] = direct_;
+    }
 
-            if (FAILED(input_->FlushStreams())) {
-                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to flush input stream.")
-                                                          << boost::errinfo_api_function("FlushStreams"));
-            }
+    bool wants_v210() const { return direct_ && v210_; }
 
-            if (FAILED(input_->StartStreams())) {
-                CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to start input stream.")
-                                                          << boost::errinfo_api_function("StartStreams"));
-            }
-            return S_OK;
-        } catch (...) {
-            exception_ = std::current_exception();
-            return E_FAIL;
+    const core::video_format_desc& channel_format() const { return format_desc_; }
+
+    void fail(std::exception_ptr exception) { exception_ = std::move(exception); }
+
+    void push(core::const_frame frame)
+    {
+        if (!frame_buffer_.try_push(frame)) {
+            core::const_frame dummy;
+            frame_buffer_.try_pop(dummy);
+            frame_buffer_.try_push(frame);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
         }
     }
 
-    HRESULT STDMETHODCALLTYPE VideoInputFrameArrived(IDeckLinkVideoInputFrame*  video,
-                                                     IDeckLinkAudioInputPacket* audio) override
+    void frame_arrived(capture& capture)
     {
+        auto video = capture.video;
+        auto audio = capture.audio;
+
         caspar::timer frame_timer;
 
         CASPAR_SCOPE_EXIT
@@ -479,6 +616,7 @@ class decklink_producer : public IDeckLinkInputCallback
                 if (video) {
                     state_["file/video/width"]  = video->GetWidth();
                     state_["file/video/height"] = video->GetHeight();
+                    state_["file/pixel-format"] = video->GetPixelFormat() == bmdFormat10BitYUV ? "v210" : "uyvy";
                 }
             }
 
@@ -499,14 +637,22 @@ class decklink_producer : public IDeckLinkInputCallback
             // very busy processing all the (unnecessary) packets. Also, because there is
             // no audio, the sync values will be incorrect.
             if (!audio) {
-                return S_OK;
+                return;
             }
 
             if (video) {
                 const auto flags = video->GetFlags();
                 has_signal_      = !(flags & bmdFrameHasNoInputSource);
                 if (freeze_on_lost_ && !has_signal_) {
-                    return S_OK;
+                    return;
+                }
+
+                if (direct_ || video->GetPixelFormat() != bmdFormat8BitYUV) {
+                    auto frame = capture.direct_frame(*frame_factory_);
+                    if (frame) {
+                        push(std::move(frame));
+                    }
+                    return;
                 }
 
                 auto src    = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
@@ -539,6 +685,10 @@ class decklink_producer : public IDeckLinkInputCallback
                 }
             }
 
+            if (direct_) {
+                return;
+            }
+
             if (audio) {
                 auto src      = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
                 src->format   = AV_SAMPLE_FMT_S32;
@@ -568,30 +718,37 @@ class decklink_producer : public IDeckLinkInputCallback
             }
 
             while (true) {
+                auto has_audio = true;
                 {
                     auto av_video = alloc_frame();
                     auto av_audio = alloc_frame();
 
-                    // TODO (fix) this may get stuck if the decklink sends a frame of video or audio
-
                     if (av_buffersink_get_frame_flags(video_filter_.sink, av_video.get(), AV_BUFFERSINK_FLAG_PEEK) <
                         0) {
-                        return S_OK;
+                        video_waiting_ = 0;
+                        return;
                     }
 
+                    // Video that has waited a couple of callbacks for audio goes on without it, the jitter buffer
+                    // fills the gap with silence.
                     audio_filter_.sink->inputs[0]->min_samples = audio_cadence_[0];
                     if (av_buffersink_get_frame_flags(audio_filter_.sink, av_audio.get(), AV_BUFFERSINK_FLAG_PEEK) <
                         0) {
-                        return S_OK;
+                        if (++video_waiting_ < 2) {
+                            return;
+                        }
+                        has_audio = false;
                     }
                 }
                 auto av_video = alloc_frame();
                 auto av_audio = alloc_frame();
 
-                // TODO (fix) auto V/A sync even if decklink is wrong.
-
                 av_buffersink_get_frame(video_filter_.sink, av_video.get());
-                av_buffersink_get_samples(audio_filter_.sink, av_audio.get(), audio_cadence_[0]);
+                if (has_audio) {
+                    av_buffersink_get_samples(audio_filter_.sink, av_audio.get(), audio_cadence_[0]);
+                } else {
+                    av_audio = nullptr;
+                }
 
                 auto video_tb = av_buffersink_get_time_base(video_filter_.sink);
                 auto audio_tb = av_buffersink_get_time_base(audio_filter_.sink);
@@ -600,8 +757,9 @@ class decklink_producer : public IDeckLinkInputCallback
 
                 auto in_sync = static_cast<double>(in_video_pts) / AV_TIME_BASE -
                                static_cast<double>(in_audio_pts) / format_desc_.audio_sample_rate;
-                auto out_sync = static_cast<double>(av_video->pts * video_tb.num) / video_tb.den -
-                                static_cast<double>(av_audio->pts * video_tb.num) / audio_tb.den;
+                auto out_sync = av_audio ? static_cast<double>(av_video->pts * video_tb.num) / video_tb.den -
+                                               static_cast<double>(av_audio->pts * audio_tb.num) / audio_tb.den
+                                         : out_sync_;
 
                 if (std::abs(in_sync - in_sync_) > 0.01) {
                     CASPAR_LOG(warning) << print() << " in-sync changed: " << in_sync;
@@ -616,44 +774,117 @@ class decklink_producer : public IDeckLinkInputCallback
                 graph_->set_value("in-sync", in_sync * 2.0 + 0.5);
                 graph_->set_value("out-sync", out_sync * 2.0 + 0.5);
 
-                auto frame = core::draw_frame(make_frame(this, *frame_factory_, av_video, av_audio));
-                if (!frame_buffer_.try_push(frame)) {
-                    core::draw_frame dummy;
-                    frame_buffer_.try_pop(dummy);
-                    frame_buffer_.try_push(frame);
-                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
-                }
+                push(make_frame(this, *frame_factory_, frame_cache_, av_video, av_audio, format_desc_.audio_channels));
 
                 boost::range::rotate(audio_cadence_, std::end(audio_cadence_) - 1);
             }
         } catch (...) {
             exception_ = std::current_exception();
-            return E_FAIL;
         }
+    }
 
-        return S_OK;
+    void append_audio(const core::const_frame& frame)
+    {
+        audio_fifo_.insert(audio_fifo_.end(), frame.audio_data().begin(), frame.audio_data().end());
+    }
+
+    // nb_samples resampled from the fifo, advancing by the ratio that steers it towards depth_ frames of audio.
+    std::vector<std::int32_t> take_audio(int nb_samples)
+    {
+        const auto channels = format_desc_.audio_channels;
+        const auto target   = static_cast<double>(depth_ * format_desc_.audio_cadence[0]);
+        const auto level    = static_cast<double>(audio_fifo_.size() / channels) - audio_pos_;
+        const auto error    = std::max(-1.0, std::min(1.0, (level - target) / target));
+
+        // Proportional and integral terms, the integral settles at the clock drift.
+        drift_          = std::max(-0.005, std::min(0.005, drift_ + error * 1e-6));
+        const auto step = 1.0 + drift_ + error * 0.002;
+
+        std::vector<std::int32_t> result(static_cast<std::size_t>(nb_samples) * channels);
+
+        const auto available = static_cast<int>(audio_fifo_.size() / channels);
+        for (auto n = 0; n < nb_samples; ++n) {
+            const auto index = static_cast<int>(audio_pos_);
+            if (index + 1 >= available) {
+                break;
+            }
+            const auto frac = audio_pos_ - index;
+            for (auto c = 0; c < channels; ++c) {
+                const auto a             = static_cast<double>(audio_fifo_[index * channels + c]);
+                const auto b             = static_cast<double>(audio_fifo_[(index + 1) * channels + c]);
+                result[n * channels + c] = static_cast<std::int32_t>(a + (b - a) * frac);
+            }
+            audio_pos_ += step;
+        }
+
+        // The last sample stays for the next interpolation.
+        const auto consumed = std::min(static_cast<int>(audio_pos_), std::max(0, available - 1));
+        audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.begin() + consumed * channels);
+        audio_pos_ -= consumed;
+
+        return result;
     }
 
-    core::draw_frame get_frame()
+    core::draw_frame get_frame(int nb_samples)
     {
         if (exception_ != nullptr) {
             std::rethrow_exception(exception_);
         }
 
-        core::draw_frame frame;
+        const auto level = static_cast<double>(frame_buffer_.size());
+        fill_            = fill_ * 0.95 + level * 0.05;
 
-        if (!frame_buffer_.try_pop(frame)) {
-            if (freeze_on_lost_)
-                frame = last_frame_;
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
-        } else {
+        // After an underrun, wait for the buffer to fill up again before playing on.
+        if (!primed_) {
+            primed_ = level >= depth_;
+            fill_   = level;
+        }
+
+        core::const_frame frame;
+        if (primed_ && fill_ > depth_ + 1.0 && frame_buffer_.size() > 1 && frame_buffer_.try_pop(frame)) {
+            // The input runs fast, skip a frame but keep its audio for the resampler.
+            append_audio(frame);
+            fill_ -= 1.0;
+            ++dropped_;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        if (primed_ && fill_ < depth_ - 1.0 && last_frame_) {
+            // The input runs slow, show the last frame once more.
+            frame = last_frame_;
+            fill_ += 1.0;
+            ++repeated_;
+            graph_->set_tag(diagnostics::tag_severity::INFO, "repeated-frame");
+        } else if (primed_ && frame_buffer_.try_pop(frame)) {
+            append_audio(frame);
             last_frame_ = frame;
+        } else {
+            primed_ = false;
+            frame   = freeze_on_lost_ ? last_frame_ : core::const_frame{};
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
         }
 
         graph_->set_value("output-buffer",
                           static_cast<float>(frame_buffer_.size()) / static_cast<float>(frame_buffer_.capacity()));
 
-        return frame;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["buffer/depth"]     = depth_;
+            state_["buffer/drift-ppm"] = drift_ * 1e6;
+            state_["buffer/dropped"]   = dropped_;
+            state_["buffer/repeated"]  = repeated_;
+        }
+
+        auto audio = take_audio(nb_samples);
+        if (!frame) {
+            return core::draw_frame{};
+        }
+
+        std::vector<array<const std::uint8_t>> image_data;
+        for (auto n = 0U; n < frame.pixel_format_desc().planes.size(); ++n) {
+            image_data.push_back(frame.image_data(n));
+        }
+        return core::draw_frame(core::const_frame(std::move(image_data), std::move(audio), frame.pixel_format_desc()));
     }
 
     std::wstring print() const
@@ -670,6 +901,145 @@ class decklink_producer : public IDeckLinkInputCallback
     }
 };
 
+void capture_session::subscribe(decklink_producer* producer, const std::wstring& format)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (producers_.empty()) {
+        start(producer, format);
+        producers_.push_back(producer);
+        return;
+    }
+
+    if (producer->channel_format().audio_channels != audio_channels_) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" is captured with " +
+                                                        std::to_wstring(audio_channels_) + L" audio channels."));
+    }
+    if (!format.empty() && core::video_format_desc(format).format != input_format_.format) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" is captured as " + input_format_.name + L"."));
+    }
+
+    producer->configure(mode_, input_format_);
+    if (pixel_format_ == bmdFormat10BitYUV && !producer->wants_v210()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(print() + L" is captured as unfiltered V210."));
+    }
+    producers_.push_back(producer);
+}
+
+void capture_session::unsubscribe(decklink_producer* producer)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    producers_.erase(std::remove(producers_.begin(), producers_.end(), producer), producers_.end());
+}
+
+void capture_session::start(decklink_producer* producer, const std::wstring& format)
+{
+    // use user-provided format if available, or choose the channel's output format
+    input_format_   = format.empty() ? producer->channel_format() : core::video_format_desc(format);
+    audio_channels_ = producer->channel_format().audio_channels;
+    mode_           = get_display_mode(input_, input_format_.format, bmdFormat8BitYUV, bmdVideoOutputFlagDefault);
+
+    producer->configure(mode_, input_format_);
+    pixel_format_ = producer->wants_v210() ? bmdFormat10BitYUV : bmdFormat8BitYUV;
+
+    BOOL status = FALSE;
+    int  flags  = bmdVideoInputEnableFormatDetection;
+
+    if (!format.empty()) {
+        flags = 0;
+    } else if (FAILED(attributes_->GetFlag(BMDDeckLinkSupportsInputFormatDetection, &status)) || !status) {
+        CASPAR_LOG(warning) << L"Decklink producer does not support auto detect input, you can explicitly choose a "
+                               L"format by appending FORMAT";
+        flags = 0;
+    }
+
+    if (FAILED(input_->EnableVideoInput(mode_->GetDisplayMode(), pixel_format_, flags))) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable video input.")
+                                                  << boost::errinfo_api_function("EnableVideoInput"));
+    }
+
+    if (FAILED(input_->EnableAudioInput(
+            bmdAudioSampleRate48kHz, bmdAudioSampleType32bitInteger, static_cast<int>(audio_channels_)))) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Could not enable audio input.")
+                                                  << boost::errinfo_api_function("EnableAudioInput"));
+    }
+
+    if (FAILED(input_->SetCallback(this)) != S_OK) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to set input callback.")
+                                                  << boost::errinfo_api_function("SetCallback"));
+    }
+
+    if (FAILED(input_->StartStreams())) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to start input stream.")
+                                                  << boost::errinfo_api_function("StartStreams"));
+    }
+}
+
+HRESULT STDMETHODCALLTYPE capture_session::VideoInputFormatChanged(BMDVideoInputFormatChangedEvents /*events*/,
+                                                                   IDeckLinkDisplayMode*            newDisplayMode,
+                                                                   BMDDetectedVideoInputFormatFlags /*flags*/)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    try {
+        auto newMode = newDisplayMode->GetDisplayMode();
+        auto fmt     = get_caspar_video_format(newMode);
+
+        auto new_fmt = core::video_format_desc(fmt);
+
+        CASPAR_LOG(info) << print() << L" Input format changed from " << input_format_.name << L" to "
+                         << new_fmt.name;
+
+        input_->PauseStreams();
+
+        input_format_ = new_fmt;
+        mode_         = get_display_mode(input_, newMode, bmdFormat8BitYUV, bmdVideoOutputFlagDefault);
+
+        // reinitializing filters because not all filters can handle on-the-fly format changes, v210 is kept only
+        // while every producer passes it on unfiltered
+        auto v210 = !producers_.empty();
+        for (auto producer : producers_) {
+            producer->configure(mode_, input_format_);
+            v210 = v210 && producer->wants_v210();
+        }
+        pixel_format_ = v210 ? bmdFormat10BitYUV : bmdFormat8BitYUV;
+
+        // reinitializing video input with the new display mode
+        if (FAILED(input_->EnableVideoInput(newMode, pixel_format_, bmdVideoInputEnableFormatDetection))) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to enable video input.")
+                                                      << boost::errinfo_api_function("EnableVideoInput"));
+        }
+
+        if (FAILED(input_->FlushStreams())) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to flush input stream.")
+                                                      << boost::errinfo_api_function("FlushStreams"));
+        }
+
+        if (FAILED(input_->StartStreams())) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Unable to start input stream.")
+                                                      << boost::errinfo_api_function("StartStreams"));
+        }
+        return S_OK;
+    } catch (...) {
+        for (auto producer : producers_) {
+            producer->fail(std::current_exception());
+        }
+        return E_FAIL;
+    }
+}
+
+HRESULT STDMETHODCALLTYPE capture_session::VideoInputFrameArrived(IDeckLinkVideoInputFrame*  video,
+                                                                  IDeckLinkAudioInputPacket* audio)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    capture capture{video, audio, mode_, audio_channels_, this, core::const_frame{}};
+    for (auto producer : producers_) {
+        producer->frame_arrived(capture);
+    }
+    return S_OK;
+}
+
 class decklink_producer_proxy : public core::frame_producer
 {
     std::unique_ptr<decklink_producer> producer_;
@@ -684,7 +1054,9 @@ class decklink_producer_proxy : public core::frame_producer
                                      const std::string&                          afilter,
                                      uint32_t                                    length,
                                      const std::wstring&                         format,
-                                     bool                                        freeze_on_lost)
+                                     bool                                        freeze_on_lost,
+                                     int                                         depth,
+                                     bool                                        v210)
         : length_(length)
         , executor_(L"decklink_producer[" + std::to_wstring(device_index) + L"]")
     {
@@ -693,7 +1065,7 @@ class decklink_producer_proxy : public core::frame_producer
             core::diagnostics::call_context::for_thread() = ctx;
             com_initialize();
             producer_.reset(new decklink_producer(
-                format_desc, device_index, frame_factory, vfilter, afilter, format, freeze_on_lost));
+                format_desc, device_index, frame_factory, vfilter, afilter, format, freeze_on_lost, depth, v210));
         });
     }
 
@@ -709,7 +1081,7 @@ class decklink_producer_proxy : public core::frame_producer
 
     // frame_producer
 
-    core::draw_frame receive_impl(int nb_samples) override { return producer_->get_frame(); }
+    core::draw_frame receive_impl(int nb_samples) override { return producer_->get_frame(nb_samples); }
 
     core::draw_frame first_frame() override { return receive_impl(0); }
 
@@ -733,6 +1105,14 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
         device_index = boost::lexical_cast<int>(params.at(1));
 
     auto freeze_on_lost = contains_param(L"FREEZE_ON_LOST", params);
+    auto depth          = get_param(L"BUFFER", params, 3);
+
+    // 10 bit capture is only uploaded as is, with FILTER, VF, AF or another input format it falls back to UYVY. A device
+    // is captured once for all of its producers, as v210 only while none of them filters it.
+    auto pixel_format = get_param(L"PIXEL_FORMAT", params, L"UYVY");
+    if (!boost::iequals(pixel_format, L"UYVY") && !boost::iequals(pixel_format, L"V210")) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid PIXEL_FORMAT: " + pixel_format));
+    }
 
     auto format_str = get_param(L"FORMAT", params);
 
@@ -753,7 +1133,9 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
                                                               u8(afilter),
                                                               length,
                                                               format_str,
-                                                              freeze_on_lost);
+                                                              freeze_on_lost,
+                                                              depth,
+                                                              boost::iequals(pixel_format, L"V210"));
     return core::create_destroy_proxy(producer);
 }
 }} // namespace caspar::decklink
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "frame_ops.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
+#ifdef _MSC_VER
+#define CASPAR_TARGET_AVX2
+#else
+#define CASPAR_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace caspar { namespace decklink {
+
+namespace {
+
+bool has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    const auto os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return os_avx && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// Alpha of each pixel in all four bytes.
+const int KEY_MASK[4] = {0x03030303, 0x07070707, 0x0B0B0B0B, 0x0F0F0F0F};
+
+void row_scalar(std::uint8_t* fill, std::uint8_t* key, const std::uint8_t* src, std::size_t begin, std::size_t end)
+{
+    if (fill != nullptr) {
+        std::memcpy(fill + begin, src + begin, end - begin);
+    }
+    if (key != nullptr) {
+        for (auto n = begin; n < end; n += 4) {
+            std::memset(key + n, src[n + 3], 4);
+        }
+    }
+}
+
+void row_ssse3(std::uint8_t* fill, std::uint8_t* key, const std::uint8_t* src, std::size_t row_bytes)
+{
+    const auto mask  = _mm_set_epi32(KEY_MASK[3], KEY_MASK[2], KEY_MASK[1], KEY_MASK[0]);
+    auto       n     = std::size_t{0};
+    const auto count = row_bytes & ~std::size_t{15};
+    for (; n < count; n += 16) {
+        const auto xmm = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+        if (fill != nullptr) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(fill + n), xmm);
+        }
+        if (key != nullptr) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(key + n), _mm_shuffle_epi8(xmm, mask));
+        }
+    }
+    row_scalar(fill, key, src, n, row_bytes);
+}
+
+template <bool Stream>
+CASPAR_TARGET_AVX2 void store_avx2(std::uint8_t* dst, __m256i ymm)
+{
+    if (Stream) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), ymm);
+    } else {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), ymm);
+    }
+}
+
+template <bool Stream>
+CASPAR_TARGET_AVX2 std::size_t
+row_avx2_blocks(std::uint8_t* fill, std::uint8_t* key, const std::uint8_t* src, std::size_t row_bytes)
+{
+    const auto mask  = _mm256_set_epi32(
+        KEY_MASK[3], KEY_MASK[2], KEY_MASK[1], KEY_MASK[0], KEY_MASK[3], KEY_MASK[2], KEY_MASK[1], KEY_MASK[0]);
+    auto       n     = std::size_t{0};
+    const auto count = row_bytes & ~std::size_t{63};
+    for (; n < count; n += 64) {
+        const auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n));
+        const auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + n + 32));
+        if (fill != nullptr) {
+            store_avx2<Stream>(fill + n, ymm0);
+            store_avx2<Stream>(fill + n + 32, ymm1);
+        }
+        if (key != nullptr) {
+            store_avx2<Stream>(key + n, _mm256_shuffle_epi8(ymm0, mask));
+            store_avx2<Stream>(key + n + 32, _mm256_shuffle_epi8(ymm1, mask));
+        }
+    }
+    return n;
+}
+
+CASPAR_TARGET_AVX2 void row_avx2(std::uint8_t* fill, std::uint8_t* key, const std::uint8_t* src, std::size_t row_bytes)
+{
+    // Frames are far larger than the cache, aligned destinations are written around it.
+    const auto aligned = (reinterpret_cast<std::uintptr_t>(fill) | reinterpret_cast<std::uintptr_t>(key)) % 32 == 0;
+    const auto n       = aligned ? row_avx2_blocks<true>(fill, key, src, row_bytes)
+                                 : row_avx2_blocks<false>(fill, key, src, row_bytes);
+    row_ssse3(fill != nullptr ? fill + n : nullptr, key != nullptr ? key + n : nullptr, src + n, row_bytes - n);
+}
+
+} // namespace
+
+void weave_fill_key(std::uint8_t*              fill,
+                    std::uint8_t*              key,
+                    const std::uint8_t* const* sources,
+                    int                        source_count,
+                    bool                       fields,
+                    std::size_t                row_bytes,
+                    int                        height)
+{
+    static const auto row = has_avx2() ? row_avx2 : row_ssse3;
+
+    for (auto y = 0; y < height; ++y) {
+        const auto offset = static_cast<std::size_t>(y) * row_bytes;
+        const auto source = static_cast<std::size_t>(fields ? y / source_count : y) * row_bytes;
+        row(fill != nullptr ? fill + offset : nullptr,
+            key != nullptr ? key + offset : nullptr,
+            sources[y % source_count] + source,
+            row_bytes);
+    }
+    _mm_sfence();
+}
+
+}} // namespace caspar::decklink
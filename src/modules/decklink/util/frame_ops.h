@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace decklink {
+
+// Builds an output frame from BGRA sources in one pass. Row y is taken from sources[y % source_count], so two
+// sources weave fields and one copies. Sources that are fields hold only their own rows, row y is then their row
+// y / source_count. The row goes to fill and its alpha, replicated into all four channels, to key. Either destination
+// may be null, fill is typically null when the source itself is scheduled.
+void weave_fill_key(std::uint8_t*              fill,
+                    std::uint8_t*              key,
+                    const std::uint8_t* const* sources,
+                    int                        source_count,
+                    bool                       fields,
+                    std::size_t                row_bytes,
+                    int                        height);
+
+}} // namespace caspar::decklink
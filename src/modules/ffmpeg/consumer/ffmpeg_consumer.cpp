@@ -21,6 +21,7 @@
 
 #include "ffmpeg_consumer.h"
 
+#include "../producer/av_decoder.h"
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
@@ -29,6 +30,7 @@
 #include <common/executor.h>
 #include <common/future.h>
 #include <common/memory.h>
+#include <common/os/filesystem.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
 
@@ -57,7 +59,9 @@ extern "C" {
 #include <libavfilter/buffersink.h>
 #include <libavfilter/buffersrc.h>
 #include <libavformat/avformat.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
 #include <libswscale/swscale.h>
@@ -68,16 +72,17 @@ extern "C" {
 
 #include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
-#include <tbb/parallel_invoke.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
 #include <memory>
 #include <thread>
 
 namespace caspar { namespace ffmpeg {
 
 // TODO multiple output streams
-// TODO multiple output files
-// TODO run video filter, video encoder, audio filter, audio encoder in separate threads.
 // TODO realtime with smaller buffer?
 
 struct Stream
@@ -87,13 +92,59 @@ struct Stream
     AVFilterContext*               source = nullptr;
 
     std::shared_ptr<AVCodecContext> enc = nullptr;
-    AVStream*                       st  = nullptr;
 
-    tbb::concurrent_bounded_queue<std::shared_ptr<SwsContext>> sws_;
+    // Set for encoders that take frames in GPU memory, the encode stage uploads each filtered frame into this pool.
+    std::shared_ptr<AVBufferRef> hw_frames = nullptr;
 
-    int64_t pts = 0;
+    // The format channel frames are converted to before filtering. Without a filter of its own the stream converts
+    // straight to what the encoder takes, so that the only conversion runs in parallel bands.
+    AVPixelFormat input_format_ = AV_PIX_FMT_YUVA422P;
 
-    Stream(AVFormatContext*                    oc,
+    // Idle scalers by source format and band height.
+    std::mutex                                                              sws_mutex_;
+    std::map<std::pair<int, int>, std::vector<std::shared_ptr<SwsContext>>> sws_;
+
+    // A channel frame, or for a lower rendition the converted image of the rendition above it.
+    struct input_frame
+    {
+        core::const_frame        frame;
+        std::shared_ptr<AVFrame> image;
+        int64_t                  pts = 0;
+    };
+
+    // Filtering and encoding run on threads of their own, so that each media type is a two stage pipeline that does
+    // not wait on the other. An input without frame or image, or a null AVFrame, marks the end of the stream.
+    tbb::concurrent_bounded_queue<input_frame>              input_;
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVFrame>> filtered_;
+    std::thread                                             filter_thread_;
+    std::thread                                             encode_thread_;
+    std::exception_ptr                                      exception_;
+    std::mutex                                              exception_mutex_;
+
+    // In ABR mode each rendition scales the converted image of the one above it rather than the channel frame, so
+    // 1080 -> 720 -> 480 converts the channel frame once and every downscale starts from the nearest size. Key frames
+    // are forced every key_interval frames so that all renditions can be cut into segments at the same points.
+    Stream*                     next_         = nullptr;
+    int64_t                     key_interval_ = 0;
+    std::string                 label_;
+    std::shared_ptr<SwsContext> rendition_sws_;
+    std::shared_ptr<AVFrame>    last_image_;
+
+    // Holds, such as slates and paused graphics, reach the consumer as the same image while the mixer reuses its
+    // output. The last image and its conversion are kept so that a repeat is not converted again. Intra-only codecs
+    // also repeat the last packet instead of encoding the same frame again. The last frame and packet are kept only
+    // while the encoder has nothing else in flight, and holding them keeps their buffers from being reused, so equal
+    // pointers mean equal images.
+    core::const_frame         last_input_;
+    std::shared_ptr<AVFrame>  last_converted_;
+    std::shared_ptr<AVFrame>  last_encoded_;
+    std::shared_ptr<AVPacket> last_packet_;
+    int64_t                   in_flight_  = 0;
+    bool                      intra_only_ = false;
+    std::atomic<int64_t>      reused_conversions_{0};
+    std::atomic<int64_t>      repeated_packets_{0};
+
+    Stream(bool                                global_header,
            std::string                         suffix,
            AVCodecID                           codec_id,
            const core::video_format_desc&      format_desc,
@@ -136,6 +187,47 @@ struct Stream
             FF_RET(AVERROR(EINVAL), "avcodec_find_encoder");
         }
 
+        // Encoders such as h264_vaapi, h264_qsv and h264_nvenc accept hardware frames, which are used unless
+        // -hwaccel:v none asks for system memory input. Frames are filtered to NV12 and uploaded before encoding.
+        std::shared_ptr<AVBufferRef> hw_device;
+        AVPixelFormat                hw_format = AV_PIX_FMT_NONE;
+        AVPixelFormat                sw_format = AV_PIX_FMT_NV12;
+        {
+            auto hwaccel = std::string("auto");
+            {
+                const auto it = stream_options.find("hwaccel");
+                if (it != stream_options.end()) {
+                    hwaccel = std::move(it->second);
+                    stream_options.erase(it);
+                }
+            }
+
+            for (auto n = 0; hwaccel != "none" && codec->type == AVMEDIA_TYPE_VIDEO; ++n) {
+                const auto config = avcodec_get_hw_config(codec, n);
+                if (!config) {
+                    break;
+                }
+                if (!(config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_FRAMES_CTX) ||
+                    (hwaccel != "auto" && config->device_type != av_hwdevice_find_type_by_name(hwaccel.c_str()))) {
+                    continue;
+                }
+                hw_device = get_hw_device(config->device_type);
+                if (!hw_device) {
+                    CASPAR_LOG(warning) << "[ffmpeg_consumer] Failed to create "
+                                        << av_hwdevice_get_type_name(config->device_type) << " device for "
+                                        << codec->name << ".";
+                    continue;
+                }
+                hw_format = config->pix_fmt;
+                break;
+            }
+
+            if (hwaccel != "auto" && hwaccel != "none" && !hw_device) {
+                const auto msg = std::string(codec->name) + " cannot encode " + hwaccel + " frames";
+                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL) << msg_info_t(msg));
+            }
+        }
+
         AVFilterInOut* outputs = nullptr;
         AVFilterInOut* inputs  = nullptr;
 
@@ -156,6 +248,17 @@ struct Stream
         graph->execute    = graph_execute;
 
         if (codec->type == AVMEDIA_TYPE_VIDEO) {
+            static boost::regex format_exp("^format=(pix_fmts=)?(?<FORMAT>\\w+)$");
+            boost::smatch       what;
+            if (boost::regex_match(filter_spec, what, format_exp) &&
+                av_get_pix_fmt(what["FORMAT"].str().c_str()) != AV_PIX_FMT_NONE) {
+                input_format_ = av_get_pix_fmt(what["FORMAT"].str().c_str());
+                filter_spec.clear();
+            } else if (filter_spec.empty() && hw_device) {
+                input_format_ = sw_format;
+            } else if (filter_spec.empty() && codec->pix_fmts) {
+                input_format_ = avcodec_find_best_pix_fmt_of_list(codec->pix_fmts, AV_PIX_FMT_YUVA422P, 1, nullptr);
+            }
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
@@ -163,6 +266,10 @@ struct Stream
             if (filter_spec.empty()) {
                 filter_spec = "anull";
             }
+            // Frames dropped in realtime mode leave a gap in the timestamps, which is filled with silence.
+            if (realtime) {
+                filter_spec = "aresample=async=1," + filter_spec;
+            }
         }
 
         FF(avfilter_graph_parse2(graph.get(), filter_spec.c_str(), &inputs, &outputs));
@@ -180,7 +287,7 @@ struct Stream
                                  boost::rational<int>(format_desc.width, format_desc.height);
 
                 auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:sar=%d/%d:frame_rate=%d/%d") %
-                             format_desc.width % format_desc.height % AV_PIX_FMT_YUVA422P % format_desc.duration %
+                             format_desc.width % format_desc.height % input_format_ % format_desc.duration %
                              format_desc.time_scale % sar.numerator() % sar.denominator() %
                              format_desc.framerate.numerator() % format_desc.framerate.denominator())
                                 .str();
@@ -216,7 +323,12 @@ struct Stream
             // TODO codec->profiles
             // TODO FF(av_opt_set_int_list(sink, "framerates", codec->supported_framerates, { 0, 0 },
             // AV_OPT_SEARCH_CHILDREN));
-            FF(av_opt_set_int_list(sink, "pix_fmts", codec->pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+            if (hw_device) {
+                const AVPixelFormat pix_fmts[] = {sw_format, AV_PIX_FMT_NONE};
+                FF(av_opt_set_int_list(sink, "pix_fmts", pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN));
+            } else {
+                FF(av_opt_set_int_list(sink, "pix_fmts", codec->pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
+            }
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
@@ -257,11 +369,6 @@ struct Stream
 
         FF(avfilter_graph_config(graph.get(), nullptr));
 
-        st = avformat_new_stream(oc, nullptr);
-        if (!st) {
-            FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
-        }
-
         enc = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
 
@@ -270,22 +377,37 @@ struct Stream
         }
 
         if (codec->type == AVMEDIA_TYPE_VIDEO) {
-            st->time_base = av_inv_q(av_buffersink_get_frame_rate(sink));
-
             enc->width               = av_buffersink_get_w(sink);
             enc->height              = av_buffersink_get_h(sink);
             enc->framerate           = av_buffersink_get_frame_rate(sink);
             enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(sink);
-            enc->time_base           = st->time_base;
+            enc->time_base           = av_inv_q(av_buffersink_get_frame_rate(sink));
             enc->pix_fmt             = static_cast<AVPixelFormat>(av_buffersink_get_format(sink));
-        } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
-            st->time_base = {1, av_buffersink_get_sample_rate(sink)};
 
+            if (hw_device) {
+                auto frames_ref = av_hwframe_ctx_alloc(hw_device.get());
+                if (!frames_ref) {
+                    FF_RET(AVERROR(ENOMEM), "av_hwframe_ctx_alloc");
+                }
+                hw_frames = std::shared_ptr<AVBufferRef>(frames_ref, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+
+                auto frames               = reinterpret_cast<AVHWFramesContext*>(hw_frames->data);
+                frames->format            = hw_format;
+                frames->sw_format         = enc->pix_fmt;
+                frames->width             = enc->width;
+                frames->height            = enc->height;
+                frames->initial_pool_size = 16;
+                FF(av_hwframe_ctx_init(hw_frames.get()));
+
+                enc->hw_frames_ctx = av_buffer_ref(hw_frames.get());
+                enc->pix_fmt       = hw_format;
+            }
+        } else if (codec->type == AVMEDIA_TYPE_AUDIO) {
             enc->sample_fmt     = static_cast<AVSampleFormat>(av_buffersink_get_format(sink));
             enc->sample_rate    = av_buffersink_get_sample_rate(sink);
             enc->channels       = av_buffersink_get_channels(sink);
             enc->channel_layout = av_buffersink_get_channel_layout(sink);
-            enc->time_base      = st->time_base;
+            enc->time_base      = {1, av_buffersink_get_sample_rate(sink)};
 
             if (!enc->channels) {
                 enc->channels = av_get_channel_layout_nb_channels(enc->channel_layout);
@@ -300,6 +422,10 @@ struct Stream
             enc->thread_type = FF_THREAD_SLICE;
         }
 
+        if (global_header) {
+            enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+
         auto dict = to_dict(std::move(stream_options));
         CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
         FF(avcodec_open2(enc.get(), codec, &dict));
@@ -307,27 +433,39 @@ struct Stream
             options[p.first] = p.second + suffix;
         }
 
-        FF(avcodec_parameters_from_context(st->codecpar, enc.get()));
-
         if (codec->type == AVMEDIA_TYPE_AUDIO && !(codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE)) {
             av_buffersink_set_frame_size(sink, enc->frame_size);
         }
 
-        if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
-            enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-        }
+        const auto descriptor = avcodec_descriptor_get(codec->id);
+        intra_only_ = codec->type == AVMEDIA_TYPE_VIDEO && !hw_frames && descriptor &&
+                      (descriptor->props & AV_CODEC_PROP_INTRA_ONLY);
     }
 
-    std::shared_ptr<SwsContext> get_sws(int width, int height)
+    std::shared_ptr<SwsContext> get_sws(AVPixelFormat src_format, int width, int height)
     {
+        const auto                  key = std::make_pair(static_cast<int>(src_format), height);
         std::shared_ptr<SwsContext> sws;
 
-        if (sws_.try_pop(sws)) {
-            return sws;
+        {
+            std::lock_guard<std::mutex> lock(sws_mutex_);
+            auto&                       pool = sws_[key];
+            if (!pool.empty()) {
+                sws = std::move(pool.back());
+                pool.pop_back();
+            }
         }
 
-        sws.reset(sws_getContext(
-                      width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUVA422P, 0, nullptr, nullptr, nullptr),
+        auto release = [this, key](std::shared_ptr<SwsContext> sws) {
+            std::lock_guard<std::mutex> lock(sws_mutex_);
+            sws_[key].push_back(std::move(sws));
+        };
+
+        if (sws) {
+            return std::shared_ptr<SwsContext>(sws.get(), [release, sws](SwsContext*) { release(sws); });
+        }
+
+        sws.reset(sws_getContext(width, height, src_format, width, height, input_format_, 0, nullptr, nullptr, nullptr),
                   [](SwsContext* ptr) { sws_freeContext(ptr); });
 
         if (!sws) {
@@ -353,18 +491,208 @@ struct Stream
 
         sws_setColorspaceDetails(sws.get(), inv_table, in_full, table, out_full, brigthness, contrast, saturation);
 
-        return std::shared_ptr<SwsContext>(sws.get(), [this, sws](SwsContext*) { sws_.push(sws); });
+        return std::shared_ptr<SwsContext>(sws.get(), [release, sws](SwsContext*) { release(sws); });
+    }
+
+    ~Stream() { stop(); }
+
+    void start(const core::video_format_desc&                 format_desc,
+               std::function<void(std::shared_ptr<AVPacket>)> cb,
+               spl::shared_ptr<diagnostics::graph>            graph)
+    {
+        const std::string name = (enc->codec_type == AVMEDIA_TYPE_VIDEO ? "video" : "audio") + label_;
+
+        input_.set_capacity(2);
+        filtered_.set_capacity(2);
+
+        filter_thread_ = std::thread([=] {
+            try {
+                while (true) {
+                    input_frame frame;
+                    input_.pop(frame);
+
+                    caspar::timer filter_timer;
+                    const auto    more = filter(frame, format_desc);
+                    graph->set_value(name + "-filter", filter_timer.elapsed() * format_desc.fps * 0.5);
+
+                    if (!more) {
+                        break;
+                    }
+                }
+            } catch (tbb::user_abort&) {
+            } catch (...) {
+                fail();
+            }
+        });
+
+        encode_thread_ = std::thread([=] {
+            try {
+                while (true) {
+                    std::shared_ptr<AVFrame> frame;
+                    filtered_.pop(frame);
+
+                    caspar::timer encode_timer;
+                    encode(frame, cb);
+                    graph->set_value(name + "-encode", encode_timer.elapsed() * format_desc.fps * 0.5);
+
+                    if (!frame) {
+                        break;
+                    }
+                }
+            } catch (tbb::user_abort&) {
+            } catch (...) {
+                fail();
+            }
+        });
     }
 
-    void send(core::const_frame&                             in_frame,
-              const core::video_format_desc&                 format_desc,
-              std::function<void(std::shared_ptr<AVPacket>)> cb)
+    // pts is in frames for video and in samples for audio.
+    void push(core::const_frame frame, int64_t pts) { push(input_frame{std::move(frame), nullptr, pts}); }
+
+    void push(input_frame frame)
+    {
+        try {
+            input_.push(std::move(frame));
+        } catch (tbb::user_abort&) {
+            rethrow();
+        }
+    }
+
+    // Waits for the end of the stream to be written.
+    void join()
     {
-        std::shared_ptr<AVFrame>  frame;
-        std::shared_ptr<AVPacket> pkt;
+        if (filter_thread_.joinable()) {
+            filter_thread_.join();
+        }
+        if (encode_thread_.joinable()) {
+            encode_thread_.join();
+        }
+        rethrow();
+    }
+
+    void stop()
+    {
+        input_.abort();
+        filtered_.abort();
+        if (filter_thread_.joinable()) {
+            filter_thread_.join();
+        }
+        if (encode_thread_.joinable()) {
+            encode_thread_.join();
+        }
+    }
+
+    void fail()
+    {
+        {
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            if (!exception_) {
+                exception_ = std::current_exception();
+            }
+        }
+        input_.abort();
+        filtered_.abort();
+    }
 
-        if (in_frame) {
-            if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
+    void rethrow()
+    {
+        std::lock_guard<std::mutex> lock(exception_mutex_);
+        if (exception_) {
+            std::rethrow_exception(exception_);
+        }
+    }
+
+    int64_t reused_conversions() const { return reused_conversions_; }
+    int64_t repeated_packets() const { return repeated_packets_; }
+
+    static bool same_image(const core::const_frame& a, const core::const_frame& b)
+    {
+        if (!a || !b || a.pixel_format_desc().format != b.pixel_format_desc().format ||
+            a.pixel_format_desc().planes.size() != b.pixel_format_desc().planes.size()) {
+            return false;
+        }
+        for (std::size_t n = 0; n < a.pixel_format_desc().planes.size(); ++n) {
+            if (a.image_data(n).data() != b.image_data(n).data() || a.image_data(n).size() != b.image_data(n).size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool same_image(const AVFrame* a, const AVFrame* b)
+    {
+        if (!a || !b || a->format != b->format || a->width != b->width || a->height != b->height) {
+            return false;
+        }
+        for (auto n = 0; n < AV_NUM_DATA_POINTERS; ++n) {
+            if (a->data[n] != b->data[n] || a->linesize[n] != b->linesize[n]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Scales the image of the rendition above into this rendition's size.
+    std::shared_ptr<AVFrame> scale_rendition(const std::shared_ptr<AVFrame>& image,
+                                             const core::video_format_desc& format_desc)
+    {
+        if (!rendition_sws_) {
+            rendition_sws_.reset(sws_getContext(image->width,
+                                                image->height,
+                                                static_cast<AVPixelFormat>(image->format),
+                                                format_desc.width,
+                                                format_desc.height,
+                                                input_format_,
+                                                SWS_BICUBIC,
+                                                nullptr,
+                                                nullptr,
+                                                nullptr),
+                                 [](SwsContext* ptr) { sws_freeContext(ptr); });
+            if (!rendition_sws_) {
+                CASPAR_THROW_EXCEPTION(caspar_exception());
+            }
+        }
+
+        auto frame                 = alloc_frame();
+        frame->sample_aspect_ratio = av_mul_q(image->sample_aspect_ratio,
+                                              av_make_q(image->width * format_desc.height,
+                                                        format_desc.width * image->height));
+        frame->width               = format_desc.width;
+        frame->height              = format_desc.height;
+        frame->format              = input_format_;
+        frame->colorspace          = image->colorspace;
+        frame->color_primaries     = image->color_primaries;
+        frame->color_range         = image->color_range;
+        frame->color_trc           = image->color_trc;
+        alloc_video_buffer(frame.get(), 64);
+
+        sws_scale(rendition_sws_.get(), image->data, image->linesize, 0, image->height, frame->data, frame->linesize);
+
+        return frame;
+    }
+
+    // Returns false once the filter graph is drained.
+    bool filter(const input_frame& in, const core::video_format_desc& format_desc)
+    {
+        const auto& in_frame = in.frame;
+        const auto  pts      = in.pts;
+
+        std::shared_ptr<AVFrame> frame;
+
+        if (in_frame || in.image) {
+            const auto held = last_converted_ && (in.image ? same_image(in.image.get(), last_image_.get())
+                                                            : same_image(in_frame, last_input_));
+            if (enc->codec_type == AVMEDIA_TYPE_VIDEO && held) {
+                frame = alloc_frame();
+                FF(av_frame_ref(frame.get(), last_converted_.get()));
+                frame->pts = pts;
+                ++reused_conversions_;
+            } else if (enc->codec_type == AVMEDIA_TYPE_VIDEO && in.image) {
+                frame           = scale_rendition(in.image, format_desc);
+                frame->pts      = pts;
+                last_image_     = in.image;
+                last_converted_ = frame;
+            } else if (enc->codec_type == AVMEDIA_TYPE_VIDEO) {
                 frame = make_av_video_frame(in_frame, format_desc);
 
                 {
@@ -372,79 +700,512 @@ struct Stream
                     frame2->sample_aspect_ratio = frame->sample_aspect_ratio;
                     frame2->width               = frame->width;
                     frame2->height              = frame->height;
-                    frame2->format              = AV_PIX_FMT_YUVA422P;
+                    frame2->format              = input_format_;
                     frame2->colorspace          = AVCOL_SPC_BT709;
                     frame2->color_primaries     = AVCOL_PRI_BT709;
                     frame2->color_range         = AVCOL_RANGE_MPEG;
                     frame2->color_trc           = AVCOL_TRC_BT709;
-                    av_frame_get_buffer(frame2.get(), 64);
-
-                    int h = frame->height / 8;
-                    tbb::parallel_for(0, 8, [&](int i) {
-                        auto sws = get_sws(frame->width, h);
-
-                        uint8_t* src[4] = {};
-                        src[0]          = frame->data[0] + frame->linesize[0] * (i * h);
+                    alloc_video_buffer(frame2.get(), 64);
+
+                    // Horizontal bands scaled on the TBB workers, each as an image of its own. Band heights are kept
+                    // a multiple of the vertical chroma subsampling so that no chroma row is split.
+                    const auto src_format = static_cast<AVPixelFormat>(frame->format);
+                    const auto src_desc   = av_pix_fmt_desc_get(src_format);
+                    const auto dst_desc   = av_pix_fmt_desc_get(input_format_);
+                    const auto align      = 1 << std::max(src_desc->log2_chroma_h, dst_desc->log2_chroma_h);
+                    const auto threads    = static_cast<int>(std::thread::hardware_concurrency());
+                    const auto bands      = std::max(1, std::min(16, threads));
+                    const auto band_h     = std::max(align, (frame->height / bands + align - 1) / align * align);
+
+                    // Chroma planes are subsampled vertically, luma and alpha are not.
+                    auto plane_row = [](const AVPixFmtDescriptor* desc, int plane, int y) {
+                        return plane == 1 || plane == 2 ? y >> desc->log2_chroma_h : y;
+                    };
+
+                    tbb::parallel_for(0, (frame->height + band_h - 1) / band_h, [&](int i) {
+                        const auto y   = i * band_h;
+                        const auto h   = std::min(band_h, frame->height - y);
+                        auto       sws = get_sws(src_format, frame->width, h);
+
+                        const uint8_t* src[4] = {};
+                        for (auto n = 0; n < 4 && frame->data[n]; ++n) {
+                            src[n] = frame->data[n] + frame->linesize[n] * plane_row(src_desc, n, y);
+                        }
 
                         uint8_t* dst[4] = {};
-                        dst[0]          = frame2->data[0] + frame2->linesize[0] * (i * h);
-                        dst[1]          = frame2->data[1] + frame2->linesize[1] * (i * h);
-                        dst[2]          = frame2->data[2] + frame2->linesize[2] * (i * h);
-                        dst[3]          = frame2->data[3] + frame2->linesize[3] * (i * h);
+                        for (auto n = 0; n < 4 && frame2->data[n]; ++n) {
+                            dst[n] = frame2->data[n] + frame2->linesize[n] * plane_row(dst_desc, n, y);
+                        }
 
                         sws_scale(sws.get(), src, frame->linesize, 0, h, dst, frame2->linesize);
                     });
 
-                    int i = frame->height - h;
-                    if (i > 0) {
-                        // TODO
-                    }
-
                     frame = std::move(frame2);
                 }
 
-                frame->pts = pts;
-                pts += 1;
+                frame->pts      = pts;
+                last_input_     = in_frame;
+                last_converted_ = frame;
             } else if (enc->codec_type == AVMEDIA_TYPE_AUDIO) {
                 frame      = make_av_audio_frame(in_frame, format_desc);
                 frame->pts = pts;
-                pts += frame->nb_samples;
             } else {
                 // TODO
             }
             FF(av_buffersrc_write_frame(source, frame.get()));
+            if (next_) {
+                next_->push(input_frame{core::const_frame{}, frame, pts});
+            }
         } else {
             FF(av_buffersrc_close(source, pts, 0));
+            if (next_) {
+                next_->push(input_frame{core::const_frame{}, nullptr, pts});
+            }
         }
 
         while (true) {
-            pkt     = alloc_packet();
-            int ret = avcodec_receive_packet(enc.get(), pkt.get());
-
+            frame   = alloc_frame();
+            int ret = av_buffersink_get_frame(sink, frame.get());
             if (ret == AVERROR(EAGAIN)) {
-                frame = alloc_frame();
-                ret   = av_buffersink_get_frame(sink, frame.get());
-                if (ret == AVERROR(EAGAIN)) {
-                    return;
+                return true;
+            }
+            if (ret == AVERROR_EOF) {
+                filtered_.push(nullptr);
+                return false;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+            filtered_.push(std::move(frame));
+        }
+    }
+
+    void encode(const std::shared_ptr<AVFrame>& frame, const std::function<void(std::shared_ptr<AVPacket>)>& cb)
+    {
+        if (intra_only_ && in_flight_ == 0 && last_packet_ && same_image(frame.get(), last_encoded_.get())) {
+            auto pkt = alloc_packet();
+            FF(av_packet_ref(pkt.get(), last_packet_.get()));
+            pkt->pts = frame->pts;
+            pkt->dts = frame->pts;
+            ++repeated_packets_;
+            cb(std::move(pkt));
+            return;
+        }
+
+        if (frame && key_interval_ > 0) {
+            frame->pict_type = frame->pts % key_interval_ == 0 ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        }
+
+        if (frame) {
+            ++in_flight_;
+            last_encoded_ = intra_only_ ? frame : nullptr;
+            last_packet_  = nullptr;
+        }
+
+        if (frame && hw_frames) {
+            auto hw_frame = alloc_frame();
+            FF(av_hwframe_get_buffer(hw_frames.get(), hw_frame.get(), 0));
+            FF(av_hwframe_transfer_data(hw_frame.get(), frame.get(), 0));
+            FF(av_frame_copy_props(hw_frame.get(), frame.get()));
+            FF(avcodec_send_frame(enc.get(), hw_frame.get()));
+        } else {
+            FF(avcodec_send_frame(enc.get(), frame.get()));
+        }
+
+        while (true) {
+            auto pkt = alloc_packet();
+            int  ret = avcodec_receive_packet(enc.get(), pkt.get());
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                return;
+            }
+            FF_RET(ret, "avcodec_receive_packet");
+            --in_flight_;
+            if (intra_only_ && in_flight_ == 0) {
+                last_packet_ = alloc_packet();
+                FF(av_packet_ref(last_packet_.get(), pkt.get()));
+            }
+            cb(std::move(pkt));
+        }
+    }
+};
+
+// One muxer fed by the shared encoders. Every output writes on its own thread, an output that fails is closed and
+// logged while the others keep going.
+//
+// With -segment_time <seconds> a recording rolls over to a new file at the first video key frame after that long,
+// named after the path's %d pattern or with -0001, -0002... before the extension. Finished files are closed and
+// flushed to disk on a thread of their own, so rolling over never waits on the disk.
+struct Output
+{
+    std::string                      path;
+    std::shared_ptr<AVFormatContext> oc;
+    std::vector<AVMediaType>         types;
+    std::vector<AVRational>          time_bases;
+    bool                             realtime  = false;
+    bool                             has_video = false;
+    int                              rendition = 0;
+    std::atomic<bool>                resync{false};
+
+    std::map<std::string, std::string> muxer_options;
+    int64_t                            segment_time  = 0;
+    int64_t                            segment_start = AV_NOPTS_VALUE;
+    int64_t                            segment_ts    = 0;
+    int                                segment_index = 0;
+    std::string                        file;
+
+    tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> buffer;
+    std::thread                                              thread;
+    std::atomic<bool>                                        failed{false};
+    executor                                                 closer{L"ffmpeg_consumer closer"};
+
+    Output(std::string spec, std::string format, bool realtime)
+        : realtime(realtime)
+    {
+        static boost::regex spec_exp("^\\[f=(?<FORMAT>[^\\]]+)\\](?<PATH>.*)$");
+        boost::smatch       what;
+        if (boost::regex_match(spec, what, spec_exp)) {
+            format = what["FORMAT"].str();
+            spec   = what["PATH"].str();
+        }
+        path = std::move(spec);
+
+        AVFormatContext* ctx = nullptr;
+        FF(avformat_alloc_output_context2(&ctx, nullptr, !format.empty() ? format.c_str() : nullptr, path.c_str()));
+        oc = std::shared_ptr<AVFormatContext>(ctx, [](AVFormatContext* ptr) { avformat_free_context(ptr); });
+    }
+
+    ~Output()
+    {
+        if (thread.joinable()) {
+            buffer.abort();
+            thread.join();
+        }
+    }
+
+    bool is_local() const
+    {
+        static boost::regex prot_exp("^.+:.*");
+        return !boost::regex_match(path, prot_exp) && !(oc->oformat->flags & AVFMT_NOFILE);
+    }
+
+    std::string segment_path(int index) const
+    {
+        char name[1024];
+        if (av_get_frame_filename(name, sizeof(name), path.c_str(), index) == 0) {
+            return name;
+        }
+        const auto p = boost::filesystem::path(path);
+        return (p.parent_path() / (p.stem().string() + (boost::format("-%04d") % index).str() + p.extension().string()))
+            .string();
+    }
+
+    void open(const std::vector<Stream*>& encoders, std::map<std::string, std::string>& options)
+    {
+        for (auto encoder : encoders) {
+            auto st = avformat_new_stream(oc.get(), nullptr);
+            if (!st) {
+                FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+            }
+            st->time_base = encoder->enc->time_base;
+            FF(avcodec_parameters_from_context(st->codecpar, encoder->enc.get()));
+            has_video |= st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
+            types.push_back(st->codecpar->codec_type);
+            time_bases.push_back(encoder->enc->time_base);
+        }
+
+        // Muxers that segment by themselves take the option as their own.
+        const auto it = options.find("segment_time");
+        if (it != options.end() && is_local() &&
+            !(oc->oformat->priv_class &&
+              av_opt_find(const_cast<const AVClass**>(&oc->oformat->priv_class),
+                          "segment_time",
+                          nullptr,
+                          0,
+                          AV_OPT_SEARCH_FAKE_OBJ))) {
+            segment_time = static_cast<int64_t>(std::stod(it->second) * AV_TIME_BASE);
+            options.erase(it);
+        }
+
+        muxer_options = options;
+        open_file(segment_time > 0 ? segment_path(++segment_index) : path, options);
+
+        // A realtime output that falls behind skips ahead rather than holding up the others.
+        buffer.set_capacity(realtime ? 64 : 128);
+        thread = std::thread([this] { run(); });
+    }
+
+    void open_file(const std::string& name, std::map<std::string, std::string>& options)
+    {
+        boost::filesystem::path full_path = name;
+
+        static boost::regex prot_exp("^.+:.*");
+        if (!boost::regex_match(name, prot_exp)) {
+            if (!full_path.is_complete()) {
+                full_path = u8(env::media_folder()) + name;
+            }
+
+            // TODO -y?
+            if (boost::filesystem::exists(full_path)) {
+                boost::filesystem::remove(full_path);
+            }
+
+            boost::filesystem::create_directories(full_path.parent_path());
+        }
+        file = full_path.string();
+
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+            // TODO (fix) interrupt_cb
+            auto dict = to_dict(std::move(options));
+            CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+            FF(avio_open2(&oc->pb, file.c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
+            options = to_map(&dict);
+        }
+
+        try {
+            auto dict = to_dict(std::move(options));
+            CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
+            FF(avformat_write_header(oc.get(), &dict));
+            options = to_map(&dict);
+        } catch (...) {
+            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+                avio_closep(&oc->pb);
+            }
+            throw;
+        }
+    }
+
+    // Hands the current file to the closer thread, with its trailer written if every stream got packets.
+    void finish_file(std::map<int, int64_t>& count)
+    {
+        auto done = std::move(oc);
+        oc        = nullptr;
+
+        std::exception_ptr error;
+        if (count.size() == types.size()) {
+            try {
+                FF(av_write_trailer(done.get()));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        count.clear();
+
+        closer.begin_invoke([done, name = file, sync = segment_time > 0] {
+            if (!(done->oformat->flags & AVFMT_NOFILE)) {
+                FF(avio_closep(&done->pb));
+            }
+            if (sync && !sync_file(u16(name))) {
+                CASPAR_LOG(warning) << "[ffmpeg_consumer] Failed to flush " << name << " to disk.";
+            }
+        });
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void next_segment(std::map<int, int64_t>& count)
+    {
+        const auto previous = oc;
+        auto       name     = segment_path(++segment_index);
+
+        AVFormatContext* ctx = nullptr;
+        FF(avformat_alloc_output_context2(&ctx, previous->oformat, nullptr, name.c_str()));
+        auto next = std::shared_ptr<AVFormatContext>(ctx, [](AVFormatContext* ptr) { avformat_free_context(ptr); });
+
+        for (auto n = 0U; n < previous->nb_streams; ++n) {
+            auto st = avformat_new_stream(next.get(), nullptr);
+            if (!st) {
+                FF_RET(AVERROR(ENOMEM), "avformat_new_stream");
+            }
+            st->time_base = time_bases[n];
+            FF(avcodec_parameters_copy(st->codecpar, previous->streams[n]->codecpar));
+        }
+
+        finish_file(count);
+
+        oc           = std::move(next);
+        auto options = muxer_options;
+        open_file(name, options);
+    }
+
+    void run()
+    {
+        try {
+            std::map<int, int64_t> count;
+
+            CASPAR_SCOPE_EXIT
+            {
+                if (oc) {
+                    finish_file(count);
                 }
-                if (ret == AVERROR_EOF) {
-                    FF(avcodec_send_frame(enc.get(), nullptr));
-                } else {
-                    FF_RET(ret, "av_buffersink_get_frame");
-                    FF(avcodec_send_frame(enc.get(), frame.get()));
+            };
+
+            std::shared_ptr<AVPacket> pkt;
+            while (true) {
+                buffer.pop(pkt);
+                if (!pkt) {
+                    break;
                 }
-            } else if (ret == AVERROR_EOF) {
-                return;
-            } else {
-                FF_RET(ret, "avcodec_receive_packet");
-                pkt->stream_index = st->index;
-                av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
-                cb(std::move(pkt));
+
+                const auto index = pkt->stream_index;
+
+                if (segment_time > 0 && (pkt->flags & AV_PKT_FLAG_KEY) &&
+                    (!has_video || types[index] == AVMEDIA_TYPE_VIDEO) && pkt->pts != AV_NOPTS_VALUE) {
+                    const auto ts = av_rescale_q(pkt->pts, time_bases[index], AV_TIME_BASE_Q);
+                    if (segment_start == AV_NOPTS_VALUE) {
+                        segment_start = ts;
+                    } else if (ts - segment_start >= segment_time) {
+                        next_segment(count);
+                        segment_start = ts;
+                        segment_ts    = ts;
+                    }
+                }
+
+                // Every segment starts at zero.
+                const auto offset = av_rescale_q(segment_ts, AV_TIME_BASE_Q, time_bases[index]);
+                if (pkt->pts != AV_NOPTS_VALUE) {
+                    pkt->pts -= offset;
+                }
+                if (pkt->dts != AV_NOPTS_VALUE) {
+                    pkt->dts -= offset;
+                }
+                av_packet_rescale_ts(pkt.get(), time_bases[index], oc->streams[index]->time_base);
+
+                count[index] += 1;
+                FF(av_interleaved_write_frame(oc.get(), pkt.get()));
+            }
+        } catch (tbb::user_abort&) {
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << "[ffmpeg_consumer] Output " << path << " failed.";
+            failed = true;
+            buffer.abort();
+        }
+    }
+
+    // Returns false once the output has failed.
+    bool push(const std::shared_ptr<AVPacket>& pkt, int index)
+    {
+        if (failed) {
+            return false;
+        }
+
+        if (resync) {
+            if (!(pkt->flags & AV_PKT_FLAG_KEY) || (has_video && types[index] != AVMEDIA_TYPE_VIDEO)) {
+                return true;
             }
+            resync = false;
+        }
+
+        auto copy = std::shared_ptr<AVPacket>(av_packet_clone(pkt.get()), [](AVPacket* ptr) { av_packet_free(&ptr); });
+        if (!copy) {
+            FF_RET(AVERROR(ENOMEM), "av_packet_clone");
+        }
+        copy->stream_index = index;
+
+        try {
+            if (!realtime) {
+                buffer.push(std::move(copy));
+            } else if (!buffer.try_push(std::move(copy))) {
+                CASPAR_LOG(warning) << "[ffmpeg_consumer] Output " << path << " is lagging, skipping to a key frame.";
+                resync = true;
+            }
+        } catch (tbb::user_abort&) {
+        }
+        return !failed;
+    }
+
+    void close()
+    {
+        if (!failed) {
+            try {
+                buffer.push(nullptr);
+            } catch (tbb::user_abort&) {
+            }
+        }
+        if (thread.joinable()) {
+            thread.join();
         }
     }
 };
 
+// Whether the first output gets no video stream, because of -vn or because its muxer has no video codec.
+bool audio_only_output(const std::string& path, const std::string& args)
+{
+    static const boost::regex vn_exp("(^|\\s)-vn(\\s|$)");
+    static const boost::regex format_exp("(^|\\s)-format\\s+(?<FORMAT>[^\\s]+)");
+    static const boost::regex spec_exp("^\\[f=(?<FORMAT>[^\\]]+)\\](?<PATH>.*)$");
+
+    if (boost::regex_search(args, vn_exp)) {
+        return true;
+    }
+
+    std::string   format;
+    boost::smatch what;
+    if (boost::regex_search(args, what, format_exp)) {
+        format = what["FORMAT"].str();
+    }
+
+    auto spec = path.substr(0, path.find('|'));
+    boost::trim(spec);
+    if (boost::regex_match(spec, what, spec_exp)) {
+        format = what["FORMAT"].str();
+        spec   = what["PATH"].str();
+    }
+
+    const auto oformat = av_guess_format(!format.empty() ? format.c_str() : nullptr, spec.c_str(), nullptr);
+    return oformat && oformat->video_codec == AV_CODEC_ID_NONE;
+}
+
+// The sizes of -renditions 1280x720,854x480 or 720,480, the latter keeping the channel's display aspect ratio. Each
+// must fit inside the one before it, the first inside the channel.
+std::vector<std::pair<int, int>> parse_renditions(const std::string& spec, const core::video_format_desc& format_desc)
+{
+    static const boost::regex size_exp("^((?<WIDTH>\\d+)x)?(?<HEIGHT>\\d+)p?$");
+
+    std::vector<std::pair<int, int>> result;
+    std::vector<std::string>         sizes;
+    boost::split(sizes, spec, boost::is_any_of(","));
+    for (auto size : sizes) {
+        boost::trim(size);
+        boost::smatch what;
+        if (!boost::regex_match(size, what, size_exp)) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                    << msg_info_t("invalid rendition size " + size));
+        }
+        const auto height = std::stoi(what["HEIGHT"].str());
+        const auto width  = what["WIDTH"].matched
+                               ? std::stoi(what["WIDTH"].str())
+                               : (height * format_desc.square_width / format_desc.square_height + 1) / 2 * 2;
+
+        const auto above = result.empty() ? std::make_pair(format_desc.width, format_desc.height) : result.back();
+        if (width < 2 || height < 2 || width > above.first || height > above.second) {
+            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                    << msg_info_t("rendition " + size + " does not fit below " +
+                                                                  std::to_string(above.first) + "x" +
+                                                                  std::to_string(above.second)));
+        }
+        result.emplace_back(width, height);
+    }
+    return result;
+}
+
+// The output path of a rendition, with %v replaced by its height or, without %v, _<height>p before the extension
+// of every rendition but the first.
+std::string rendition_path(const std::string& spec, int height, bool first)
+{
+    const auto name = std::to_string(height) + "p";
+    if (spec.find("%v") != std::string::npos) {
+        return boost::replace_all_copy(spec, "%v", name);
+    }
+    if (first) {
+        return spec;
+    }
+    const auto slash = spec.find_last_of('/');
+    const auto dot   = spec.find_last_of('.');
+    const auto pos   = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? dot : spec.size();
+    return spec.substr(0, pos) + "_" + name + spec.substr(pos);
+}
+
 struct ffmpeg_consumer : public core::frame_consumer
 {
     core::monitor::state    state_;
@@ -457,12 +1218,25 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     std::string path_;
     std::string args_;
+    const bool  audio_only_;
 
     std::exception_ptr exception_;
     std::mutex         exception_mutex_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
-    std::thread                                      frame_thread_;
+    // Frames with the video and audio pts they start at. Realtime mode drops frames rather than holding up the
+    // channel, the timestamps are counted on so that the output keeps time.
+    struct queued_frame
+    {
+        core::const_frame frame;
+        int64_t           video_pts = 0;
+        int64_t           audio_pts = 0;
+    };
+
+    tbb::concurrent_bounded_queue<queued_frame> frame_buffer_;
+    std::thread                                 frame_thread_;
+    int64_t                                     video_pts_ = 0;
+    int64_t                                     audio_pts_ = 0;
+    std::int64_t                                dropped_   = 0;
 
   public:
     ffmpeg_consumer(std::string path, std::string args, bool realtime)
@@ -474,8 +1248,10 @@ struct ffmpeg_consumer : public core::frame_consumer
         , realtime_(realtime)
         , path_(std::move(path))
         , args_(std::move(args))
+        , audio_only_(audio_only_output(path_, args_))
     {
-        state_["file/path"] = u8(path_);
+        state_["file/path"]    = u8(path_);
+        state_["file/dropped"] = std::int64_t{0};
 
         frame_buffer_.set_capacity(realtime_ ? 1 : 64);
 
@@ -483,12 +1259,20 @@ struct ffmpeg_consumer : public core::frame_consumer
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+        graph_->set_color("video-filter", diagnostics::color(0.2f, 0.8f, 0.8f));
+        graph_->set_color("video-encode", diagnostics::color(0.2f, 0.5f, 1.0f));
+        graph_->set_color("audio-filter", diagnostics::color(0.8f, 0.8f, 0.2f));
+        graph_->set_color("audio-encode", diagnostics::color(1.0f, 0.6f, 0.2f));
+        graph_->set_color("output-failed", diagnostics::color(0.9f, 0.3f, 0.3f));
     }
 
     ~ffmpeg_consumer()
     {
         if (frame_thread_.joinable()) {
-            frame_buffer_.push(core::const_frame{});
+            try {
+                frame_buffer_.push(queued_frame{core::const_frame{}, video_pts_, audio_pts_});
+            } catch (tbb::user_abort&) {
+            }
             frame_thread_.join();
         }
     }
@@ -510,7 +1294,8 @@ struct ffmpeg_consumer : public core::frame_consumer
             try {
                 std::map<std::string, std::string> options;
                 {
-                    static boost::regex opt_exp("-(?<NAME>[^-\\s]+)(\\s+(?<VALUE>[^\\s]+))?");
+                    // Flags such as -vn take no value, the option after them is not taken for one.
+                    static boost::regex opt_exp("-(?<NAME>[^-\\s]+)(\\s+(?<VALUE>(?!-[a-zA-Z])[^\\s]+))?");
                     for (auto it = boost::sregex_iterator(args_.begin(), args_.end(), opt_exp);
                          it != boost::sregex_iterator();
                          ++it) {
@@ -519,46 +1304,124 @@ struct ffmpeg_consumer : public core::frame_consumer
                     }
                 }
 
-                boost::filesystem::path full_path = path_;
-
-                static boost::regex prot_exp("^.+:.*");
-                if (!boost::regex_match(path_, prot_exp)) {
-                    if (!full_path.is_complete()) {
-                        full_path = u8(env::media_folder()) + path_;
-                    }
-
-                    // TODO -y?
-                    if (boost::filesystem::exists(full_path)) {
-                        boost::filesystem::remove(full_path);
+                std::string format;
+                {
+                    const auto format_it = options.find("format");
+                    if (format_it != options.end()) {
+                        format = std::move(format_it->second);
+                        options.erase(format_it);
                     }
+                }
 
-                    boost::filesystem::create_directories(full_path.parent_path());
+                // ABR mode, -renditions 720,480 adds lower renditions to the one at the channel's size. Each gets
+                // its own outputs and video encoder, options with :v:<n> apply to rendition n only, as -b:v:1 2M.
+                // The audio is encoded once for all of them.
+                std::vector<std::pair<int, int>> renditions;
+                if (options.count("renditions") && !audio_only_) {
+                    renditions = parse_renditions(options["renditions"], format_desc);
                 }
+                options.erase("renditions");
+                renditions.insert(renditions.begin(), std::make_pair(format_desc.width, format_desc.height));
 
-                AVFormatContext* oc = nullptr;
+                std::map<int, std::map<std::string, std::string>> rendition_options;
+                {
+                    static const boost::regex index_exp("^(?<NAME>.+:v):(?<INDEX>\\d+)$");
+                    for (auto it = options.begin(); it != options.end();) {
+                        boost::smatch what;
+                        if (!boost::regex_match(it->first, what, index_exp)) {
+                            ++it;
+                            continue;
+                        }
+                        const auto index = std::stoi(what["INDEX"].str());
+                        if (index >= static_cast<int>(renditions.size())) {
+                            CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                                    << msg_info_t("no rendition for " + it->first));
+                        }
+                        rendition_options[index][what["NAME"].str()] = it->second;
+                        it                                           = options.erase(it);
+                    }
+                }
+                for (auto& p : rendition_options[0]) {
+                    options[p.first] = p.second;
+                }
 
+                // Outputs are separated by | as with ffmpeg's tee muxer, each may pick its own muxer with [f=name].
+                // The encoders are set up for the first one.
+                std::vector<std::shared_ptr<Output>> outputs;
                 {
-                    std::string format;
-                    {
-                        const auto format_it = options.find("format");
-                        if (format_it != options.end()) {
-                            format = std::move(format_it->second);
-                            options.erase(format_it);
+                    std::vector<std::string> specs;
+                    boost::split(specs, path_, boost::is_any_of("|"));
+                    for (auto n = 0; n < static_cast<int>(renditions.size()); ++n) {
+                        for (auto spec : specs) {
+                            boost::trim(spec);
+                            if (!spec.empty()) {
+                                outputs.push_back(std::make_shared<Output>(
+                                    rendition_path(spec, renditions[n].second, n == 0), format, realtime_));
+                                outputs.back()->rendition = n;
+                            }
                         }
                     }
+                }
 
-                    FF(avformat_alloc_output_context2(
-                        &oc, nullptr, !format.empty() ? format.c_str() : nullptr, path_.c_str()));
+                if (outputs.empty()) {
+                    CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL)
+                                                            << msg_info_t("no output path"));
                 }
 
-                CASPAR_SCOPE_EXIT { avformat_free_context(oc); };
+                const auto oformat       = outputs.front()->oc->oformat;
+                const auto global_header = std::any_of(outputs.begin(), outputs.end(), [](auto& output) {
+                    return (output->oc->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+                });
+
+                const auto no_video = options.erase("vn") > 0;
 
-                boost::optional<Stream> video_stream;
-                if (oc->oformat->video_codec != AV_CODEC_ID_NONE) {
-                    if (oc->oformat->video_codec == AV_CODEC_ID_H264 && options.find("preset:v") == options.end()) {
+                boost::optional<Stream>              video_stream;
+                std::vector<std::unique_ptr<Stream>> lower_streams;
+                if (oformat->video_codec != AV_CODEC_ID_NONE && !no_video) {
+                    if (oformat->video_codec == AV_CODEC_ID_H264 && options.find("codec:v") == options.end() &&
+                        options.find("preset:v") == options.end()) {
                         options["preset:v"] = "veryfast";
                     }
-                    video_stream.emplace(oc, ":v", oc->oformat->video_codec, format_desc, realtime_, options);
+
+                    // Renditions share a fixed GOP, two seconds unless -g:v is given, with scene cut key frames
+                    // turned off so that they all have key frames on the same frames.
+                    int64_t key_interval = 0;
+                    if (renditions.size() > 1) {
+                        if (!options.count("g:v")) {
+                            options["g:v"] = std::to_string(static_cast<int>(std::lround(format_desc.fps * 2.0)));
+                        }
+                        if (!options.count("sc_threshold:v")) {
+                            options["sc_threshold:v"] = "0";
+                        }
+                        key_interval = std::max<int64_t>(1, std::stoll(options["g:v"]));
+                    }
+                    const auto shared_options = options;
+
+                    video_stream.emplace(global_header, ":v", oformat->video_codec, format_desc, realtime_, options);
+                    video_stream->key_interval_ = key_interval;
+
+                    auto above = &*video_stream;
+                    for (auto n = 1; n < static_cast<int>(renditions.size()); ++n) {
+                        auto rendition_desc   = format_desc;
+                        rendition_desc.width  = renditions[n].first;
+                        rendition_desc.height = renditions[n].second;
+
+                        auto stream_options = shared_options;
+                        for (auto& p : rendition_options[n]) {
+                            stream_options[p.first] = p.second;
+                        }
+                        lower_streams.push_back(std::make_unique<Stream>(
+                            global_header, ":v", oformat->video_codec, rendition_desc, realtime_, stream_options));
+
+                        auto stream           = lower_streams.back().get();
+                        stream->key_interval_ = key_interval;
+                        stream->label_        = "-" + std::to_string(renditions[n].second) + "p";
+                        above->next_          = stream;
+                        above                 = stream;
+
+                        graph_->set_color("video" + stream->label_ + "-filter", diagnostics::color(0.2f, 0.7f, 0.7f));
+                        graph_->set_color("video" + stream->label_ + "-encode", diagnostics::color(0.2f, 0.4f, 0.9f));
+                    }
 
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
@@ -567,115 +1430,186 @@ struct ffmpeg_consumer : public core::frame_consumer
                 }
 
                 boost::optional<Stream> audio_stream;
-                if (oc->oformat->audio_codec != AV_CODEC_ID_NONE) {
-                    audio_stream.emplace(oc, ":a", oc->oformat->audio_codec, format_desc, realtime_, options);
+                if (oformat->audio_codec != AV_CODEC_ID_NONE) {
+                    audio_stream.emplace(global_header, ":a", oformat->audio_codec, format_desc, realtime_, options);
                 }
 
-                if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                    // TODO (fix) interrupt_cb
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avio_open2(&oc->pb, full_path.string().c_str(), AVIO_FLAG_WRITE, nullptr, &dict));
-                    options = to_map(&dict);
+                // The encoders of each rendition, the video of that rendition and the shared audio.
+                auto encoders = [&](int rendition) {
+                    std::vector<Stream*> result;
+                    if (video_stream) {
+                        result.push_back(rendition == 0 ? &*video_stream : lower_streams.at(rendition - 1).get());
+                    }
+                    if (audio_stream) {
+                        result.push_back(&*audio_stream);
+                    }
+                    return result;
+                };
+
+                // Only options no output consumed are reported.
+                boost::optional<std::map<std::string, std::string>> unused;
+                {
+                    auto opened = std::vector<std::shared_ptr<Output>>{};
+                    for (auto& output : outputs) {
+                        auto output_options = options;
+                        try {
+                            output->open(encoders(output->rendition), output_options);
+                            opened.push_back(output);
+                        } catch (...) {
+                            CASPAR_LOG_CURRENT_EXCEPTION();
+                            CASPAR_LOG(error) << print() << " Failed to open " << output->path << ".";
+                            if (outputs.size() == 1) {
+                                throw;
+                            }
+                            continue;
+                        }
+
+                        if (!unused) {
+                            unused = std::move(output_options);
+                        } else {
+                            for (auto it = unused->begin(); it != unused->end();) {
+                                it = output_options.count(it->first) ? std::next(it) : unused->erase(it);
+                            }
+                        }
+                    }
+                    outputs = std::move(opened);
+                }
+
+                if (outputs.empty()) {
+                    CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EIO)
+                                                            << msg_info_t("no output could be opened"));
+                }
+
+                for (auto& p : *unused) {
+                    CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
                 }
 
                 {
-                    auto dict = to_dict(std::move(options));
-                    CASPAR_SCOPE_EXIT { av_dict_free(&dict); };
-                    FF(avformat_write_header(oc, &dict));
-                    options = to_map(&dict);
+                    std::lock_guard<std::mutex> lock(state_mutex_);
+                    state_["file/outputs"]    = static_cast<int>(outputs.size());
+                    state_["file/renditions"] = static_cast<int>(video_stream ? renditions.size() : 0);
                 }
 
+                CASPAR_SCOPE_EXIT
                 {
-                    for (auto& p : options) {
-                        CASPAR_LOG(warning) << print() << " Unused option " << p.first << "=" << p.second;
+                    for (auto& output : outputs) {
+                        output->close();
                     }
-                }
+                };
 
-                tbb::concurrent_bounded_queue<std::shared_ptr<AVPacket>> packet_buffer;
-                packet_buffer.set_capacity(realtime_ ? 1 : 128);
-                auto packet_thread = std::thread([&] {
-                    try {
-                        CASPAR_SCOPE_EXIT
+                std::mutex output_mutex;
+                // Packets of a video encoder go to the outputs of its rendition, a rendition of -1 sends them to
+                // all outputs.
+                auto       packet_cb = [&](int index, int rendition) {
+                    return [&, index, rendition](std::shared_ptr<AVPacket>&& pkt) {
+                        auto live = std::vector<std::shared_ptr<Output>>{};
                         {
-                            if (!(oc->oformat->flags & AVFMT_NOFILE)) {
-                                FF(avio_closep(&oc->pb));
-                            }
-                        };
-
-                        std::map<int, int64_t> count;
+                            std::lock_guard<std::mutex> lock(output_mutex);
+                            live = outputs;
+                        }
 
-                        std::shared_ptr<AVPacket> pkt;
-                        while (true) {
-                            packet_buffer.pop(pkt);
-                            if (!pkt) {
-                                break;
+                        auto failed = false;
+                        for (auto& output : live) {
+                            if (rendition < 0 || output->rendition == rendition) {
+                                failed |= !output->push(pkt, index);
                             }
-                            count[pkt->stream_index] += 1;
-                            FF(av_interleaved_write_frame(oc, pkt.get()));
                         }
 
-                        auto video_st = video_stream ? video_stream->st : nullptr;
-                        auto audio_st = audio_stream ? audio_stream->st : nullptr;
-
-                        if ((!video_st || count[video_st->index]) && (!audio_st || count[audio_st->index])) {
-                            FF(av_write_trailer(oc));
+                        if (failed) {
+                            std::lock_guard<std::mutex> lock(output_mutex);
+                            outputs.erase(std::remove_if(outputs.begin(),
+                                                         outputs.end(),
+                                                         [](auto& output) { return output->failed.load(); }),
+                                          outputs.end());
+                            graph_->set_tag(diagnostics::tag_severity::WARNING, "output-failed");
+                            {
+                                std::lock_guard<std::mutex> state_lock(state_mutex_);
+                                state_["file/outputs"] = static_cast<int>(outputs.size());
+                            }
+                            if (outputs.empty()) {
+                                CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EIO)
+                                                                        << msg_info_t("all outputs failed"));
+                            }
                         }
+                    };
+                };
+                const auto audio_cb = packet_cb(video_stream ? 1 : 0, -1);
 
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                        // TODO
-                        packet_buffer.abort();
-                    }
-                });
+                // The encoders hand packets to the outputs until they are stopped, before the outputs close. Lower
+                // renditions stop first, so that the ones above never wait on them.
                 CASPAR_SCOPE_EXIT
                 {
-                    if (packet_thread.joinable()) {
-                        // TODO Is nullptr needed?
-                        packet_buffer.push(nullptr);
-                        packet_buffer.abort();
-                        packet_thread.join();
+                    for (auto it = lower_streams.rbegin(); it != lower_streams.rend(); ++it) {
+                        (*it)->stop();
+                    }
+                    if (video_stream) {
+                        video_stream->stop();
+                    }
+                    if (audio_stream) {
+                        audio_stream->stop();
                     }
                 };
 
-                auto packet_cb = [&](std::shared_ptr<AVPacket>&& pkt) { packet_buffer.push(std::move(pkt)); };
+                if (video_stream) {
+                    video_stream->start(format_desc, packet_cb(0, 0), graph_);
+                }
+                for (auto n = 1; n <= static_cast<int>(lower_streams.size()); ++n) {
+                    auto rendition_desc   = format_desc;
+                    rendition_desc.width  = renditions[n].first;
+                    rendition_desc.height = renditions[n].second;
+                    lower_streams[n - 1]->start(rendition_desc, packet_cb(0, n), graph_);
+                }
+                if (audio_stream) {
+                    audio_stream->start(format_desc, audio_cb, graph_);
+                }
 
                 std::int32_t frame_number = 0;
                 while (true) {
                     {
                         std::lock_guard<std::mutex> lock(state_mutex_);
                         state_["file/frame"] = frame_number++;
+                        if (video_stream) {
+                            state_["file/video/reused-conversions"] = video_stream->reused_conversions();
+                            state_["file/video/repeated-packets"]   = video_stream->repeated_packets();
+                        }
                     }
 
-                    core::const_frame frame;
-                    frame_buffer_.pop(frame);
+                    queued_frame queued;
+                    frame_buffer_.pop(queued);
                     graph_->set_value("input",
                                       static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
+                    const auto& frame = queued.frame;
+
                     caspar::timer frame_timer;
-                    tbb::parallel_invoke(
-                        [&] {
-                            if (video_stream) {
-                                video_stream->send(frame, format_desc, packet_cb);
-                            }
-                        },
-                        [&] {
-                            if (audio_stream) {
-                                audio_stream->send(frame, format_desc, packet_cb);
-                            }
-                        });
+                    if (video_stream) {
+                        video_stream->push(frame, queued.video_pts);
+                    }
+                    if (audio_stream) {
+                        audio_stream->push(frame, queued.audio_pts);
+                    }
                     graph_->set_value("frame-time", frame_timer.elapsed() * format_desc.fps * 0.5);
 
                     if (!frame) {
-                        packet_buffer.push(nullptr);
                         break;
                     }
                 }
 
-                packet_thread.join();
+                if (video_stream) {
+                    video_stream->join();
+                }
+                for (auto& stream : lower_streams) {
+                    stream->join();
+                }
+                if (audio_stream) {
+                    audio_stream->join();
+                }
             } catch (...) {
-                std::lock_guard<std::mutex> lock(exception_mutex_);
-                exception_ = std::current_exception();
+                {
+                    std::lock_guard<std::mutex> lock(exception_mutex_);
+                    exception_ = std::current_exception();
+                }
+                frame_buffer_.abort();
             }
         });
     }
@@ -689,8 +1623,24 @@ struct ffmpeg_consumer : public core::frame_consumer
             }
         }
 
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        const auto samples = static_cast<int64_t>(frame.audio_data().size()) / std::max(1, format_desc_.audio_channels);
+        const auto queued  = queued_frame{std::move(frame), video_pts_, audio_pts_};
+        video_pts_ += 1;
+        audio_pts_ += samples;
+
+        // Recording is lossless and holds up the channel while the encoders catch up, streaming drops.
+        try {
+            if (!realtime_) {
+                frame_buffer_.push(queued);
+            } else if (!frame_buffer_.try_push(queued)) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                state_["file/dropped"] = ++dropped_;
+            }
+        } catch (tbb::user_abort&) {
+            std::lock_guard<std::mutex> lock(exception_mutex_);
+            std::rethrow_exception(exception_);
         }
         graph_->set_value("input", static_cast<double>(frame_buffer_.size() + 0.001) / frame_buffer_.capacity());
 
@@ -703,6 +1653,8 @@ struct ffmpeg_consumer : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    bool audio_only() const override { return audio_only_; }
+
     int index() const override { return 100000 + channel_index_; }
 
     core::monitor::state state() const override
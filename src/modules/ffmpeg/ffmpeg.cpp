@@ -24,12 +24,18 @@
 #include "ffmpeg.h"
 
 #include "consumer/ffmpeg_consumer.h"
+#include "producer/av_scanner.h"
 #include "producer/ffmpeg_producer.h"
 
+#include <common/env.h>
 #include <common/log.h>
+#include <common/preload.h>
 
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_scanner.h>
+
+#include <boost/property_tree/ptree.hpp>
 
 #include <mutex>
 
@@ -152,6 +158,12 @@ void init(core::module_dependencies dependencies)
     dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ffmpeg", create_preconfigured_consumer);
 
     dependencies.producer_registry->register_producer_factory(L"FFmpeg Producer", create_producer);
+
+    preload::set_resolver(resolve_preload);
+
+    if (env::properties().get(L"configuration.ffmpeg.scanner.enabled", true)) {
+        dependencies.scanner_registry->register_media_scanner(spl::make_shared<AVScanner>());
+    }
 }
 
 void uninit()
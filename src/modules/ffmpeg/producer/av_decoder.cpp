@@ -0,0 +1,313 @@
+#include "av_decoder.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <map>
+#include <mutex>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+std::shared_ptr<AVBufferRef> get_hw_device(AVHWDeviceType type)
+{
+    static std::mutex                                            mutex;
+    static std::map<AVHWDeviceType, std::weak_ptr<AVBufferRef>> devices;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto device = devices[type].lock();
+    if (!device) {
+        AVBufferRef* ref = nullptr;
+        if (av_hwdevice_ctx_create(&ref, type, nullptr, nullptr, 0) < 0) {
+            return nullptr;
+        }
+        device        = std::shared_ptr<AVBufferRef>(ref, [](AVBufferRef* ptr) { av_buffer_unref(&ptr); });
+        devices[type] = device;
+    }
+    return device;
+}
+
+namespace {
+
+// Frame threads decode several frames at once and scale best for codecs that predict between frames, but hold back a
+// frame per thread. Slice threads split each frame without adding delay, but only scale with the slices in a stream.
+// Intra only codecs, live sources and hardware decoding use slices, others frames, unless
+// ffmpeg/producer/thread-type/<codec> says otherwise.
+int thread_type(const AVCodec* codec, bool live)
+{
+    const auto frame = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) ? FF_THREAD_FRAME : 0;
+    const auto slice = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) ? FF_THREAD_SLICE : 0;
+
+    const auto type = env::properties().get<std::wstring>(L"ffmpeg.producer.thread-type." + u16(codec->name), L"auto");
+    if (type == L"frame") {
+        return frame;
+    }
+    if (type == L"slice") {
+        return slice;
+    }
+    if (type == L"both") {
+        return frame | slice;
+    }
+
+    const auto desc = avcodec_descriptor_get(codec->id);
+    if (live || !frame || (desc && (desc->props & AV_CODEC_PROP_INTRA_ONLY))) {
+        return slice;
+    }
+    return frame;
+}
+
+} // namespace
+
+Decoder::Decoder(AVStream*            stream,
+                 AVHWDeviceType       hwaccel,
+                 core::frame_factory* frame_factory,
+                 const void*          tag,
+                 bool                 live)
+    : st(stream)
+{
+    const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        FF_RET(AVERROR_DECODER_NOT_FOUND, "avcodec_find_decoder");
+    }
+
+    ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                          [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+
+    if (!ctx) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+
+    FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO && hwaccel != AV_HWDEVICE_TYPE_NONE) {
+        setup_hwaccel(codec, hwaccel);
+    }
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO && hw_format == AV_PIX_FMT_NONE && frame_factory) {
+        buffers = use_frame_buffers(ctx.get(), *frame_factory, tag);
+    }
+
+    FF(av_opt_set_int(ctx.get(), "refcounted_frames", 1, 0));
+
+    // 0 lets ffmpeg pick a thread count from the number of cores.
+    FF(av_opt_set_int(ctx.get(), "threads", env::properties().get(L"ffmpeg.producer.threads", 0), 0));
+    // FF(av_opt_set_int(ctx.get(), "enable_er", 1, 0));
+
+    ctx->pkt_timebase = stream->time_base;
+
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        ctx->framerate           = av_guess_frame_rate(nullptr, stream, nullptr);
+        ctx->sample_aspect_ratio = av_guess_sample_aspect_ratio(nullptr, stream, nullptr);
+    } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (!ctx->channel_layout && ctx->channels) {
+            ctx->channel_layout = av_get_default_channel_layout(ctx->channels);
+        }
+        if (!ctx->channels && ctx->channel_layout) {
+            ctx->channels = av_get_channel_layout_nb_channels(ctx->channel_layout);
+        }
+    }
+
+    ctx->thread_type = thread_type(codec, live || hw_format != AV_PIX_FMT_NONE);
+
+    FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+    // Slices run on the TBB pool, shared with the rest of the server, rather than on the codec's own threads. Frame
+    // threads keep theirs, each of them decodes with a copy of the context made on open.
+    if (ctx->active_thread_type == FF_THREAD_SLICE) {
+        ctx->execute  = codec_execute;
+        ctx->execute2 = codec_execute2;
+    }
+}
+
+void Decoder::setup_hwaccel(const AVCodec* codec, AVHWDeviceType type)
+{
+    // Surfaces are downloaded as NV12 or P010, which only carry 4:2:0.
+    const auto desc = av_pix_fmt_desc_get(ctx->pix_fmt);
+    if (!desc || desc->log2_chroma_w != 1 || desc->log2_chroma_h != 1) {
+        return;
+    }
+
+    for (int n = 0; hw_format == AV_PIX_FMT_NONE; ++n) {
+        const auto config = avcodec_get_hw_config(codec, n);
+        if (!config) {
+            CASPAR_LOG(warning) << "[ffmpeg] " << codec->name << " does not support "
+                                << av_hwdevice_get_type_name(type) << ", decoding in software.";
+            return;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) && config->device_type == type) {
+            hw_format = config->pix_fmt;
+        }
+    }
+
+    hw_device = get_hw_device(type);
+    if (!hw_device) {
+        CASPAR_LOG(warning) << "[ffmpeg] Failed to create " << av_hwdevice_get_type_name(type)
+                            << " device, decoding in software.";
+        hw_format = AV_PIX_FMT_NONE;
+        return;
+    }
+
+    sw_format          = desc->comp[0].depth > 8 ? AV_PIX_FMT_P010 : AV_PIX_FMT_NV12;
+    ctx->hw_device_ctx = av_buffer_ref(hw_device.get());
+    ctx->opaque        = reinterpret_cast<void*>(static_cast<intptr_t>(hw_format));
+    ctx->get_format    = [](AVCodecContext* ctx, const AVPixelFormat* fmts) {
+        const auto hw_format = static_cast<AVPixelFormat>(reinterpret_cast<intptr_t>(ctx->opaque));
+        for (auto fmt = fmts; *fmt != AV_PIX_FMT_NONE; ++fmt) {
+            if (*fmt == hw_format) {
+                return *fmt;
+            }
+        }
+        return avcodec_default_get_format(ctx, fmts);
+    };
+}
+
+void Decoder::flush()
+{
+    avcodec_flush_buffers(ctx.get());
+    input           = std::queue<std::shared_ptr<AVPacket>>();
+    input_bytes     = 0;
+    frame           = nullptr;
+    eof             = false;
+    next_pts        = AV_NOPTS_VALUE;
+    skip_until      = AV_NOPTS_VALUE;
+    ctx->skip_frame = AVDISCARD_DEFAULT;
+}
+
+void Decoder::push(std::shared_ptr<AVPacket> packet)
+{
+    input_bytes += packet ? packet->size : 0;
+    input.push(std::move(packet));
+}
+
+void Decoder::pop()
+{
+    input_bytes -= input.front() ? input.front()->size : 0;
+    input.pop();
+}
+
+AVPixelFormat Decoder::pix_fmt() const { return hw_format != AV_PIX_FMT_NONE ? sw_format : ctx->pix_fmt; }
+
+std::shared_ptr<AVFrame> Decoder::download(const std::shared_ptr<AVFrame>& src)
+{
+    auto dst    = alloc_frame();
+    dst->format = sw_format;
+
+    if (src->format == hw_format) {
+        FF(av_hwframe_transfer_data(dst.get(), src.get(), 0));
+    } else {
+        // The hardware declined the stream, convert software frames to the format the filter graph expects.
+        if (!sws) {
+            sws = std::shared_ptr<SwsContext>(sws_getContext(src->width,
+                                                             src->height,
+                                                             static_cast<AVPixelFormat>(src->format),
+                                                             src->width,
+                                                             src->height,
+                                                             sw_format,
+                                                             SWS_POINT,
+                                                             nullptr,
+                                                             nullptr,
+                                                             nullptr),
+                                              sws_freeContext);
+            if (!sws) {
+                FF_RET(AVERROR(EINVAL), "sws_getContext");
+            }
+        }
+        dst->width  = src->width;
+        dst->height = src->height;
+        alloc_video_buffer(dst.get(), 0);
+        sws_scale(sws.get(), src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    }
+
+    FF(av_frame_copy_props(dst.get(), src.get()));
+    return dst;
+}
+
+bool Decoder::operator()()
+{
+    if (frame || eof || !st) {
+        return false;
+    }
+
+    auto av_frame = alloc_frame();
+    auto ret      = avcodec_receive_frame(ctx.get(), av_frame.get());
+
+    if (ret == AVERROR(EAGAIN)) {
+        if (input.empty()) {
+            return false;
+        }
+        const auto& packet = input.front();
+        if (skip_until != AV_NOPTS_VALUE) {
+            ctx->skip_frame = packet && packet->pts != AV_NOPTS_VALUE && packet->pts < skip_until
+                                  ? AVDISCARD_NONREF
+                                  : AVDISCARD_DEFAULT;
+        }
+        FF(avcodec_send_packet(ctx.get(), packet.get()));
+        pop();
+    } else if (ret == AVERROR_EOF) {
+        avcodec_flush_buffers(ctx.get());
+        av_frame->pts = next_pts;
+        eof           = true;
+        next_pts      = AV_NOPTS_VALUE;
+        frame         = std::move(av_frame);
+    } else {
+        FF_RET(ret, "avcodec_receive_frame");
+
+        if (hw_format != AV_PIX_FMT_NONE && av_frame->format != sw_format) {
+            av_frame = download(av_frame);
+        }
+
+        // NOTE This is a workaround for DVCPRO HD.
+        if (av_frame->width > 1024 && av_frame->interlaced_frame) {
+            av_frame->top_field_first = 1;
+        }
+
+        // TODO (fix) is this always best?
+        av_frame->pts = av_frame->best_effort_timestamp;
+
+        auto duration_pts = av_frame->pkt_duration;
+        if (duration_pts <= 0) {
+            if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                const auto ticks =
+                    av_stream_get_parser(st) ? av_stream_get_parser(st)->repeat_pict + 1 : ctx->ticks_per_frame;
+                duration_pts = static_cast<int64_t>(AV_TIME_BASE) * ctx->framerate.den * ticks /
+                               ctx->framerate.num / ctx->ticks_per_frame;
+                duration_pts = av_rescale_q(duration_pts, {1, AV_TIME_BASE}, st->time_base);
+            } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+                duration_pts = av_rescale_q(av_frame->nb_samples, {1, ctx->sample_rate}, st->time_base);
+            }
+        }
+
+        if (duration_pts > 0) {
+            next_pts = av_frame->pts + duration_pts;
+        } else {
+            next_pts = AV_NOPTS_VALUE;
+        }
+
+        frame = std::move(av_frame);
+    }
+
+    return true;
+}
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <core/frame/frame_factory.h>
+
+#include <cstdint>
+#include <memory>
+#include <queue>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavutil/avutil.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/pixfmt.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+struct AVCodec;
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct SwsContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Decoders using the same kind of hardware share one device while any of them is alive.
+std::shared_ptr<AVBufferRef> get_hw_device(AVHWDeviceType type);
+
+// TODO (fix) Handle ts discontinuities.
+// TODO (feat) Forward options.
+
+struct Decoder
+{
+    AVStream*                             st = nullptr;
+    std::shared_ptr<void>                 buffers;
+    std::shared_ptr<AVCodecContext>       ctx;
+    int64_t                               next_pts = AV_NOPTS_VALUE;
+    std::queue<std::shared_ptr<AVPacket>> input;
+    int64_t                               input_bytes = 0;
+    std::shared_ptr<AVFrame>              frame;
+    bool                                  eof = false;
+
+    // Frames nobody references are not decoded before this pts after a seek, it is never output anyway.
+    int64_t skip_until = AV_NOPTS_VALUE;
+
+    std::shared_ptr<AVBufferRef> hw_device;
+    AVPixelFormat                hw_format = AV_PIX_FMT_NONE;
+    AVPixelFormat                sw_format = AV_PIX_FMT_NONE;
+    std::shared_ptr<SwsContext>  sws;
+
+    Decoder() = default;
+
+    // Live decoders do not use frame threads, which hold back a frame per thread.
+    explicit Decoder(AVStream*            stream,
+                     AVHWDeviceType       hwaccel       = AV_HWDEVICE_TYPE_NONE,
+                     core::frame_factory* frame_factory = nullptr,
+                     const void*          tag           = nullptr,
+                     bool                 live          = false);
+
+    void setup_hwaccel(const AVCodec* codec, AVHWDeviceType type);
+
+    // Drops buffered input and output so the decoder can be fed again after a seek.
+    void flush();
+
+    void push(std::shared_ptr<AVPacket> packet);
+    void pop();
+
+    // The pixel format frames are delivered to the filter graph in.
+    AVPixelFormat pix_fmt() const;
+
+    std::shared_ptr<AVFrame> download(const std::shared_ptr<AVFrame>& src);
+
+    // Receives a frame, or sends the next queued packet when the codec wants more input. Returns whether it did
+    // either.
+    bool operator()();
+};
+
+}} // namespace caspar::ffmpeg
@@ -0,0 +1,220 @@
+#include "av_index.h"
+
+#include "../util/av_util.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const char INDEX_MAGIC[4] = {'K', 'F', 'I', '1'};
+
+struct index_header
+{
+    char    magic[4];
+    int32_t stream_index;
+    int64_t file_size;
+    int64_t file_time;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    int64_t count;
+};
+
+std::mutex            building_mutex;
+std::set<std::string> building;
+
+// Empty when indexing is off or filename is not a local file.
+std::string index_path(const std::string& filename)
+{
+    static const auto location =
+        u8(env::properties().get(L"configuration.ffmpeg.producer.keyframe-index", std::wstring(L"none")));
+
+    if (location == "none" || boost::contains(filename, "://")) {
+        return "";
+    }
+
+    if (location == "media") {
+        return filename + ".kfi";
+    }
+
+    std::ostringstream name;
+    name << std::hex << std::hash<std::string>()(filename) << ".kfi";
+    return (boost::filesystem::path(location) / name.str()).string();
+}
+
+void build(const std::string& filename, const std::string& path, int64_t file_size, int64_t file_time)
+{
+    AVFormatContext* ic = nullptr;
+    if (avformat_open_input(&ic, filename.c_str(), nullptr, nullptr) < 0) {
+        return;
+    }
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+    if (avformat_find_stream_info(ic, nullptr) < 0) {
+        return;
+    }
+
+    const auto stream_index = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0) {
+        return;
+    }
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        if (static_cast<int>(n) != stream_index) {
+            ic->streams[n]->discard = AVDISCARD_ALL;
+        }
+    }
+
+    std::vector<KeyframeIndex::Entry> entries;
+
+    auto packet = alloc_packet();
+    while (av_read_frame(ic, packet.get()) >= 0) {
+        if (packet->stream_index == stream_index && (packet->flags & AV_PKT_FLAG_KEY)) {
+            const auto pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (pts != AV_NOPTS_VALUE) {
+                entries.push_back(KeyframeIndex::Entry{pts, packet->pos});
+            }
+        }
+        av_packet_unref(packet.get());
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const auto& lhs, const auto& rhs) { return lhs.pts < rhs.pts; });
+
+    const auto time_base = ic->streams[stream_index]->time_base;
+
+    index_header header;
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.stream_index  = stream_index;
+    header.file_size     = file_size;
+    header.file_time     = file_time;
+    header.time_base_num = time_base.num;
+    header.time_base_den = time_base.den;
+    header.count         = static_cast<int64_t>(entries.size());
+
+    // Written aside and renamed, so a reader never sees a partial index.
+    const auto tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(KeyframeIndex::Entry));
+        if (!file) {
+            CASPAR_LOG(warning) << L"[ffmpeg] Failed to write keyframe index " << u16(path);
+            return;
+        }
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        boost::filesystem::remove(tmp, ec);
+        return;
+    }
+
+    CASPAR_LOG(info) << L"[ffmpeg] Indexed " << entries.size() << L" keyframes of " << u16(filename);
+}
+
+} // namespace
+
+std::shared_ptr<const KeyframeIndex> KeyframeIndex::get(const std::string& filename)
+{
+    const auto path = index_path(filename);
+    if (path.empty()) {
+        return nullptr;
+    }
+
+    boost::system::error_code ec;
+    const auto                file_size = static_cast<int64_t>(boost::filesystem::file_size(filename, ec));
+    const auto                file_time = static_cast<int64_t>(boost::filesystem::last_write_time(filename, ec));
+    if (ec || !boost::filesystem::is_regular_file(filename, ec)) {
+        return nullptr;
+    }
+
+    {
+        std::ifstream file(path, std::ios::binary);
+        index_header  header;
+        if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 && header.file_size == file_size &&
+            header.file_time == file_time && header.count >= 0) {
+            auto index            = std::make_shared<KeyframeIndex>();
+            index->stream_index_  = header.stream_index;
+            index->time_base_num_ = header.time_base_num;
+            index->time_base_den_ = header.time_base_den;
+            index->entries_.resize(static_cast<size_t>(header.count));
+            if (file.read(reinterpret_cast<char*>(index->entries_.data()), header.count * sizeof(Entry))) {
+                return index;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(building_mutex);
+        if (!building.insert(path).second) {
+            return nullptr;
+        }
+    }
+
+    std::thread([=] {
+        set_thread_name(L"[ffmpeg::av_producer::KeyframeIndex]");
+        try {
+            build(filename, path, file_size, file_time);
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        std::lock_guard<std::mutex> lock(building_mutex);
+        building.erase(path);
+    }).detach();
+
+    return nullptr;
+}
+
+bool KeyframeIndex::seek(AVFormatContext* ic, int64_t ts) const
+{
+    if (stream_index_ < 0 || stream_index_ >= static_cast<int>(ic->nb_streams)) {
+        return false;
+    }
+
+    const auto target = av_rescale_q(ts, AVRational{1, AV_TIME_BASE}, AVRational{time_base_num_, time_base_den_});
+    auto       it     = std::upper_bound(
+        entries_.begin(), entries_.end(), target, [](int64_t pts, const Entry& entry) { return pts < entry.pts; });
+    if (it == entries_.begin()) {
+        return false;
+    }
+    --it;
+
+    // Transport and program streams seek by timestamp only approximately, they are sent to the byte position instead.
+    // Other demuxers land exactly on a known keyframe timestamp.
+    if ((ic->iformat->flags & AVFMT_TS_DISCONT) && !(ic->iformat->flags & AVFMT_NO_BYTE_SEEK) && it->pos >= 0) {
+        return av_seek_frame(ic, -1, it->pos, AVSEEK_FLAG_BYTE) >= 0;
+    }
+    return avformat_seek_file(ic, stream_index_, INT64_MIN, it->pts, it->pts, 0) >= 0;
+}
+
+}} // namespace caspar::ffmpeg
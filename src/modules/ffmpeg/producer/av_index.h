@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+
+namespace caspar { namespace ffmpeg {
+
+// Keyframe positions of the video stream of a local file, for direct seeks in long-GOP media. An index is built once
+// in the background and stored next to the media or in a cache directory, see ffmpeg/producer/keyframe-index.
+class KeyframeIndex
+{
+  public:
+    struct Entry
+    {
+        int64_t pts;
+        int64_t pos;
+    };
+
+    // The stored index of filename, nullptr while it does not exist. Starts building it when missing or stale.
+    static std::shared_ptr<const KeyframeIndex> get(const std::string& filename);
+
+    // Seeks ic to the last keyframe at or before ts, in AV_TIME_BASE units. False if the index does not help.
+    bool seek(AVFormatContext* ic, int64_t ts) const;
+
+  private:
+    int                stream_index_  = -1;
+    int                time_base_num_ = 0;
+    int                time_base_den_ = 1;
+    std::vector<Entry> entries_;
+};
+
+}} // namespace caspar::ffmpeg
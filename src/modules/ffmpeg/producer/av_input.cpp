@@ -1,14 +1,43 @@
 #include "av_input.h"
+#include "av_index.h"
+#include "av_probe.h"
 
 #include "../util/av_assert.h"
 #include "../util/av_util.h"
 
+#include <common/diagnostics/memory.h>
+#include <common/env.h>
 #include <common/except.h>
+#include <common/os/memory.h>
 #include <common/os/thread.h>
 #include <common/param.h>
+#include <common/preload.h>
 #include <common/scope_exit.h>
-
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/align/aligned_alloc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
 #include <set>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -23,68 +52,653 @@ extern "C" {
 
 namespace caspar { namespace ffmpeg {
 
-Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph)
-    : filename_(filename)
-    , graph_(graph)
+namespace {
+
+int64_t packet_bytes(const std::shared_ptr<AVPacket>& packet) { return packet ? packet->size : 0; }
+
+// Packets queued by all inputs count towards the memory budget and are reported as ffmpeg/input-packets.
+void account_packets(int64_t bytes)
 {
-    graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
-    graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+    static auto& held = diagnostics::memory::get("ffmpeg/input-packets");
+    held.add(bytes);
+    memory_budget_add(bytes);
+}
+
+// Reads packets for every open Input on a few shared threads instead of one thread per input. Workers serve the ready
+// input that was served least recently, playing inputs first, one packet at a time so no input starves the others.
+// Posted tasks, e.g. file read-ahead, run before any input.
+class io_pool
+{
+    struct entry
+    {
+        Input* input;
+        bool   busy;
+    };
+
+    std::mutex                        mutex_;
+    std::condition_variable           cond_;
+    std::list<entry>                  entries_;
+    std::deque<std::function<void()>> tasks_;
+    bool                              abort_request_ = false;
+    std::vector<std::thread>          threads_;
+
+  public:
+    io_pool()
+    {
+        const auto count = std::max(1, env::properties().get(L"configuration.ffmpeg.producer.io-threads", 8));
+        for (auto n = 0; n < count; ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"[ffmpeg::av_producer::Input]");
+                run();
+            });
+        }
+    }
 
-    thread_ = std::thread([=] {
-        try {
-            set_thread_name(L"[ffmpeg::av_producer::Input]");
+    ~io_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
 
-            while (true) {
-                {
-                    std::unique_lock<std::mutex> lock(mutex_);
-                    cond_.wait(lock,
-                               [&] { return (ic_ && (!eof_ && output_.size() < output_capacity_)) || abort_request_; });
-                }
+    void add(Input* input)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            entries_.push_back(entry{input, false});
+        }
+        cond_.notify_all();
+    }
+
+    // Waits for a read in progress, which the caller should have interrupted.
+    void remove(Input* input)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = std::find_if(entries_.begin(), entries_.end(), [&](const entry& e) { return e.input == input; });
+        cond_.wait(lock, [&] { return !it->busy; });
+        entries_.erase(it);
+    }
+
+    void notify() { cond_.notify_all(); }
 
-                if (abort_request_) {
-                    break;
+    void post(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cond_.notify_one();
+    }
+
+  private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!abort_request_) {
+            if (!tasks_.empty()) {
+                auto task = std::move(tasks_.front());
+                tasks_.pop_front();
+                lock.unlock();
+                try {
+                    task();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
                 }
+                lock.lock();
+                continue;
+            }
 
-                std::lock_guard<std::mutex> format_lock(ic_mutex_);
+            auto it = next();
+            if (it == entries_.end()) {
+                // Polled, inputs become ready as their consumers drain them and as the memory budget is released.
+                cond_.wait_for(lock, std::chrono::milliseconds(20));
+                continue;
+            }
 
-                auto packet = alloc_packet();
+            // Served inputs go to the back of the queue.
+            entries_.splice(entries_.end(), entries_, it);
+            it->busy = true;
+            lock.unlock();
 
-                // TODO (perf) Non blocking av_read_frame when possible.
-                auto ret = av_read_frame(ic_.get(), packet.get());
+            try {
+                it->input->read();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+                it->input->abort();
+            }
 
-                {
-                    std::lock_guard<std::mutex> lock(mutex_);
+            lock.lock();
+            it->busy = false;
+            cond_.notify_all();
+        }
+    }
 
-                    if (ret == AVERROR_EXIT) {
-                        break;
-                    }
-                    if (ret == AVERROR_EOF) {
-                        eof_   = true;
-                        packet = nullptr;
-                    } else {
-                        FF_RET(ret, "av_read_frame");
-                    }
+    std::list<entry>::iterator next()
+    {
+        auto result = entries_.end();
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->busy || !it->input->ready()) {
+                continue;
+            }
+            if (it->input->priority()) {
+                return it;
+            }
+            if (result == entries_.end()) {
+                result = it;
+            }
+        }
+        return result;
+    }
+};
+
+io_pool& get_io_pool()
+{
+    static io_pool pool;
+    return pool;
+}
+
+const int64_t file_alignment = 64 * 1024;
+
+// Reads a local file for libavformat in large aligned chunks. The chunk after the one being read is fetched ahead on
+// the I/O pool, sequential access is hinted to the OS and direct I/O optionally bypasses the page cache. The start of
+// a file held in RAM by PRELOAD is copied from there.
+class file_reader : public std::enable_shared_from_this<file_reader>
+{
+    enum class status
+    {
+        empty,
+        queued,
+        reading,
+        ready
+    };
+
+    struct chunk
+    {
+        int64_t                  offset = -1;
+        int64_t                  size   = 0;
+        int                      error  = 0;
+        status                   state  = status::empty;
+        std::shared_ptr<uint8_t> data;
+    };
+
+    std::shared_ptr<diagnostics::graph> graph_;
+    const int64_t                       chunk_size_;
+    const int64_t                       margin_;
+    int64_t                             file_size_ = 0;
+#ifdef WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+    int file_ = -1;
+#endif
+
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    std::array<chunk, 2>    chunks_;
+    int64_t                 pos_ = 0;
+    preload::cached         preloaded_;
+
+  public:
+    // The last margin bytes of a growing file are not read, they may belong to a packet that is only partly written.
+    file_reader(int64_t chunk_size, int64_t margin, std::shared_ptr<diagnostics::graph> graph)
+        : graph_(std::move(graph))
+        , chunk_size_(std::max(file_alignment, (chunk_size + file_alignment - 1) / file_alignment * file_alignment))
+        , margin_(std::max<int64_t>(0, margin))
+    {
+        for (auto& c : chunks_) {
+            // Large buffers are page mapped and so aligned for direct io.
+            if (chunk_size_ >= static_cast<int64_t>(large_buffer_threshold)) {
+                c.data = std::static_pointer_cast<uint8_t>(alloc_large_buffer(chunk_size_));
+            } else {
+                c.data = std::shared_ptr<uint8_t>(
+                    static_cast<uint8_t*>(boost::alignment::aligned_alloc(file_alignment, chunk_size_)),
+                    boost::alignment::aligned_free);
+            }
+            if (!c.data) {
+                CASPAR_THROW_EXCEPTION(std::bad_alloc());
+            }
+        }
+        graph_->set_color("read-time", diagnostics::color(0.3f, 0.6f, 1.0f));
+        graph_->set_color("read-rate", diagnostics::color(0.7f, 0.7f, 1.0f));
+    }
+
+    ~file_reader()
+    {
+#ifdef WIN32
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+#else
+        if (file_ >= 0) {
+            ::close(file_);
+        }
+#endif
+    }
+
+    bool open(const std::string& filename, bool direct, bool growing)
+    {
+        // A preloaded file is read from the page cache, which direct I/O would bypass.
+        preloaded_ = growing ? preload::cached{} : preload::find(u16(filename));
+        direct     = direct && !preloaded_.preloaded;
+
+#ifdef WIN32
+        const auto flags = FILE_FLAG_SEQUENTIAL_SCAN | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+        file_            = CreateFileW(u16(filename).c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            nullptr,
+                            OPEN_EXISTING,
+                            flags,
+                            nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+#else
+#ifdef O_DIRECT
+        if (direct) {
+            file_ = ::open(filename.c_str(), O_RDONLY | O_DIRECT);
+        }
+#endif
+        // Not every file system supports direct I/O.
+        if (file_ < 0) {
+            file_ = ::open(filename.c_str(), O_RDONLY);
+        }
+        struct stat st;
+        if (file_ < 0 || ::fstat(file_, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(file_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+        return refresh(growing) >= 0;
+    }
+
+    // Returns the size written so far, -1 on failure. The readable size only ever grows, chunks read short of its old
+    // end are read again.
+    int64_t refresh(bool growing)
+    {
+#ifdef WIN32
+        LARGE_INTEGER st;
+        if (!GetFileSizeEx(file_, &st)) {
+            return -1;
+        }
+        const int64_t size = st.QuadPart;
+#else
+        struct stat st;
+        if (::fstat(file_, &st) != 0) {
+            return -1;
+        }
+        const int64_t size = st.st_size;
+#endif
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        file_size_ = std::max(file_size_, growing ? size - margin_ : size);
+        for (auto& c : chunks_) {
+            if (c.state == status::ready && c.size < chunk_size_) {
+                c.state = status::empty;
+            }
+        }
+        return size;
+    }
+
+    static int read_packet(void* opaque, uint8_t* buf, int size)
+    {
+        return static_cast<file_reader*>(opaque)->read(buf, size);
+    }
+
+    static int64_t seek_packet(void* opaque, int64_t offset, int whence)
+    {
+        return static_cast<file_reader*>(opaque)->seek(offset, whence);
+    }
+
+    int read(uint8_t* buf, int size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (pos_ >= file_size_) {
+            return AVERROR_EOF;
+        }
+
+        const auto offset = pos_ - pos_ % chunk_size_;
+        auto&      c      = acquire(lock, offset);
+        if (c.error != 0) {
+            return c.error;
+        }
+
+        prefetch(offset + chunk_size_);
+
+        const auto begin = pos_ - offset;
+        if (begin >= c.size) {
+            return AVERROR_EOF;
+        }
+        const auto count = std::min(static_cast<int64_t>(size), c.size - begin);
+        std::memcpy(buf, c.data.get() + begin, static_cast<size_t>(count));
+        pos_ += count;
+
+        return static_cast<int>(count);
+    }
+
+    int64_t seek(int64_t offset, int whence)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        switch (whence & ~AVSEEK_FORCE) {
+            case AVSEEK_SIZE:
+                return file_size_;
+            case SEEK_SET:
+                pos_ = offset;
+                break;
+            case SEEK_CUR:
+                pos_ += offset;
+                break;
+            case SEEK_END:
+                pos_ = file_size_ + offset;
+                break;
+            default:
+                return AVERROR(EINVAL);
+        }
+        return pos_;
+    }
 
-                    output_.push(std::move(packet));
-                    graph_->set_value(
-                        "input", static_cast<double>(output_.size() + 0.001) / static_cast<double>(output_capacity_));
+  private:
+    // Returns the ready chunk at offset, reading it here unless another thread already is.
+    chunk& acquire(std::unique_lock<std::mutex>& lock, int64_t offset)
+    {
+        while (true) {
+            auto it = std::find_if(chunks_.begin(), chunks_.end(), [&](const chunk& c) {
+                return c.offset == offset && c.state != status::empty;
+            });
+
+            if (it == chunks_.end()) {
+                it = std::find_if(
+                    chunks_.begin(), chunks_.end(), [](const chunk& c) { return c.state != status::reading; });
+                if (it == chunks_.end()) {
+                    cond_.wait(lock);
+                    continue;
                 }
-                cond_.notify_all();
+                it->offset = offset;
+                it->state  = status::queued;
+            }
+
+            if (it->state == status::ready) {
+                return *it;
+            }
+
+            if (it->state == status::queued) {
+                it->state = status::reading;
+                lock.unlock();
+                fill(*it);
+                lock.lock();
+            } else {
+                cond_.wait(lock);
+            }
+        }
+    }
+
+    void prefetch(int64_t offset)
+    {
+        if (offset >= file_size_) {
+            return;
+        }
+
+        for (auto& c : chunks_) {
+            if (c.offset == offset && c.state != status::empty) {
+                return;
             }
-        } catch (...) {
-            CASPAR_LOG_CURRENT_EXCEPTION();
         }
+
+        // The other chunk, unless it is still being read.
+        auto it = std::find_if(chunks_.begin(), chunks_.end(), [&](const chunk& c) {
+            return c.offset != offset - chunk_size_ && c.state != status::reading;
+        });
+        if (it == chunks_.end()) {
+            return;
+        }
+        it->offset = offset;
+        it->state  = status::queued;
+
+        auto self = shared_from_this();
+        get_io_pool().post([self, offset] {
+            std::unique_lock<std::mutex> lock(self->mutex_);
+            for (auto& c : self->chunks_) {
+                if (c.offset == offset && c.state == status::queued) {
+                    c.state = status::reading;
+                    lock.unlock();
+                    self->fill(c);
+                    return;
+                }
+            }
+        });
+    }
+
+    // Called for a chunk marked reading, without mutex_ held.
+    void fill(chunk& c)
+    {
+        caspar::timer timer;
+
+        int64_t size  = 0;
+        int     error = 0;
+        while (size < chunk_size_ && c.offset + size < file_size_) {
+            const auto ret = read_at(c.offset + size, c.data.get() + size, chunk_size_ - size);
+            if (ret < 0) {
+                error = static_cast<int>(ret);
+                break;
+            }
+            if (ret == 0) {
+                break;
+            }
+            size += ret;
+        }
+
+        const auto elapsed = timer.elapsed();
+        graph_->set_value("read-time", elapsed * 10.0);
+        graph_->set_value("read-rate", elapsed > 0.0 ? static_cast<double>(size) / elapsed / 1e9 : 1.0);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            c.size  = size;
+            c.error = error;
+            c.state = status::ready;
+        }
+        cond_.notify_all();
+    }
+
+    int64_t read_at(int64_t offset, uint8_t* data, int64_t size)
+    {
+        if (offset < preloaded_.size) {
+            const auto count = std::min(size, preloaded_.size - offset);
+            std::memcpy(data, preloaded_.data.get() + offset, static_cast<size_t>(count));
+            return count;
+        }
+
+#ifdef WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset     = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD count           = 0;
+        if (!ReadFile(file_, data, static_cast<DWORD>(size), &count, &overlapped)) {
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : AVERROR(EIO);
+        }
+        return count;
+#else
+        const auto ret = ::pread(file_, data, static_cast<size_t>(size), static_cast<off_t>(offset));
+        return ret >= 0 ? ret : AVERROR(errno);
+#endif
+    }
+};
+
+// libavformat reads local files through a file_reader unless ffmpeg/producer/read-ahead is 0, nullptr when the path
+// is not a regular file. file_size is set to refresh the size of the file, see Input::follow.
+std::shared_ptr<AVIOContext> open_file_io(const std::string&                  filename,
+                                          std::shared_ptr<diagnostics::graph> graph,
+                                          bool                                growing,
+                                          std::function<int64_t(bool)>&       file_size)
+{
+    static const int64_t read_ahead =
+        env::properties().get(L"configuration.ffmpeg.producer.read-ahead", static_cast<int64_t>(4096)) * 1024;
+    static const bool    direct = env::properties().get(L"configuration.ffmpeg.producer.direct-io", false);
+    static const int64_t margin =
+        env::properties().get(L"configuration.ffmpeg.producer.growing-margin", static_cast<int64_t>(1024)) * 1024;
+
+    if (read_ahead <= 0) {
+        return nullptr;
+    }
+
+    auto reader = std::make_shared<file_reader>(read_ahead, margin, std::move(graph));
+    if (!reader->open(filename, direct, growing)) {
+        return nullptr;
+    }
+    file_size = [reader](bool still_growing) { return reader->refresh(still_growing); };
+
+    const auto buffer_size = 64 * 1024;
+    auto       buffer      = static_cast<uint8_t*>(av_malloc(buffer_size));
+    if (!buffer) {
+        FF_RET(AVERROR(ENOMEM), "av_malloc");
+    }
+
+    auto pb = avio_alloc_context(
+        buffer, buffer_size, 0, reader.get(), &file_reader::read_packet, nullptr, &file_reader::seek_packet);
+    if (!pb) {
+        av_free(buffer);
+        FF_RET(AVERROR(ENOMEM), "avio_alloc_context");
+    }
+
+    return std::shared_ptr<AVIOContext>(pb, [reader](AVIOContext* pb) {
+        av_freep(&pb->buffer);
+        avio_context_free(&pb);
     });
 }
 
+void discard_streams(AVFormatContext* ic, const std::set<int>& streams)
+{
+    if (!ic || streams.empty()) {
+        return;
+    }
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        ic->streams[n]->discard = streams.count(static_cast<int>(n)) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    }
+}
+
+} // namespace
+
+Input::Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph, bool live, bool growing)
+    : filename_(filename)
+    , graph_(graph)
+    , live_(live)
+    , growing_(growing && !live)
+{
+    graph_->set_color("seek", diagnostics::color(1.0f, 0.5f, 0.0f));
+    graph_->set_color("input", diagnostics::color(0.7f, 0.4f, 0.4f));
+
+    get_io_pool().add(this);
+}
+
 Input::~Input()
 {
-    graph_         = spl::shared_ptr<diagnostics::graph>();
     abort_request_ = true;
-    cond_.notify_all();
-    thread_.join();
+    get_io_pool().remove(this);
+    graph_ = spl::shared_ptr<diagnostics::graph>();
+    account_packets(-output_bytes_);
+}
+
+bool Input::ready() const
+{
+    // A few packets are always queued so decoding never stalls on the memory budget alone.
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto full = output_.size() >= output_capacity_ || (output_.size() >= 32 && memory_budget_exceeded());
+    return ic_ && !eof_ && !full && !abort_request_ && std::chrono::steady_clock::now() >= poll_time_;
+}
+
+void Input::read()
+{
+    std::lock_guard<std::mutex> format_lock(ic_mutex_);
+
+    auto packet = alloc_packet();
+
+    // TODO (perf) Non blocking av_read_frame when possible.
+    auto ret = av_read_frame(ic_.get(), packet.get());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (ret == AVERROR_EXIT) {
+        return;
+    }
+    if (ret == AVERROR_EOF && growing_) {
+        follow();
+        return;
+    }
+    if (ret == AVERROR_EOF) {
+        eof_   = true;
+        packet = nullptr;
+    } else {
+        FF_RET(ret, "av_read_frame");
+    }
+
+    output_bytes_ += packet_bytes(packet);
+    account_packets(packet_bytes(packet));
+    output_.push(std::move(packet));
+    graph_->set_value("input", static_cast<double>(output_.size() + 0.001) / static_cast<double>(output_capacity_));
+
+    if (on_read_) {
+        on_read_();
+    }
+}
+
+// Called at the end of a growing file with both mutexes held. Reading is retried after a poll interval that doubles
+// while the file does not grow.
+void Input::follow()
+{
+    static const auto timeout = std::chrono::milliseconds(static_cast<int64_t>(
+        env::properties().get(L"configuration.ffmpeg.producer.growing-timeout", 10.0) * 1000.0));
+    static const auto min_interval = std::chrono::milliseconds(10);
+    static const auto max_interval = std::chrono::milliseconds(500);
+
+    const auto now  = std::chrono::steady_clock::now();
+    const auto size = file_size_ ? file_size_(true) : -1;
+    if (size > growing_size_) {
+        growing_size_  = size;
+        growing_since_ = now;
+        poll_interval_ = min_interval;
+    } else if (now - growing_since_ >= timeout) {
+        // Done, what was held back from the write head is read right away.
+        growing_ = false;
+        if (file_size_) {
+            file_size_(false);
+        }
+        poll_interval_ = std::chrono::milliseconds(0);
+        CASPAR_LOG(info) << "av_input[" + filename_ + "]"
+                         << " Stopped growing at " << std::max<int64_t>(0, size) << " bytes.";
+    } else {
+        poll_interval_ = std::min(poll_interval_ * 2, max_interval);
+    }
+    poll_time_ = now + poll_interval_;
+
+    // The demuxer goes on where it stopped, the container is not reopened.
+    if (ic_->pb) {
+        ic_->pb->eof_reached = 0;
+    }
 }
 
+void Input::on_read(std::function<void()> callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_read_ = std::move(callback);
+}
+
+void Input::priority(bool value)
+{
+    priority_ = value;
+    get_io_pool().notify();
+}
+
+bool Input::priority() const { return priority_; }
+
 void Input::abort() { abort_request_ = true; }
 
 int Input::interrupt_cb(void* ctx)
@@ -97,12 +711,19 @@ void Input::operator()(std::function<bool(std::shared_ptr<AVPacket>&)> fn)
 {
     {
         std::unique_lock<std::mutex> lock(mutex_);
-        while (!output_.empty() && fn(output_.front())) {
+        while (!output_.empty()) {
+            // fn may take the packet.
+            const auto bytes = packet_bytes(output_.front());
+            if (!fn(output_.front())) {
+                break;
+            }
+            output_bytes_ -= bytes;
+            account_packets(-bytes);
             output_.pop();
         }
         graph_->set_value("input", static_cast<double>(output_.size() + 0.001) / static_cast<double>(output_capacity_));
     }
-    cond_.notify_all();
+    get_io_pool().notify();
 }
 
 AVFormatContext* Input::operator->() { return ic_.get(); }
@@ -110,6 +731,8 @@ AVFormatContext* const Input::operator->() const { return ic_.get(); }
 
 void Input::reset()
 {
+    caspar::timer open_timer;
+
     AVDictionary* options = nullptr;
     CASPAR_SCOPE_EXIT { av_dict_free(&options); };
 
@@ -127,14 +750,47 @@ void Input::reset()
         filename_    = u8(url_parts.second);
     }
 
-    if (input_format == nullptr) {
+    // Only local files can grow.
+    growing_ = growing_ && url_parts.first.empty();
+
+    std::shared_ptr<AVIOContext> pb;
+    file_size_ = nullptr;
+    if (input_format == nullptr && url_parts.first.empty()) {
+        pb = open_file_io(filename_, graph_, growing_, file_size_);
+    }
+    if (growing_ && !file_size_) {
+        // Read by libavformat, without a margin from the write head.
+        file_size_ = [filename = filename_](bool) {
+            boost::system::error_code ec;
+            const auto                size = boost::filesystem::file_size(filename, ec);
+            return ec ? static_cast<int64_t>(-1) : static_cast<int64_t>(size);
+        };
+    }
+
+    if (input_format == nullptr && !pb) {
         // TODO (fix) timeout?
         FF(av_dict_set(&options, "rw_timeout", "60000000", 0)); // 60 second IO timeout
     }
 
-    AVFormatContext* ic = nullptr;
+    if (live_) {
+        FF(av_dict_set(&options, "fflags", "nobuffer", 0));
+        FF(av_dict_set(&options, "probesize", "65536", 0));
+        FF(av_dict_set(&options, "analyzeduration", "200000", 0)); // 200 ms
+    }
+
+    if (input_format == nullptr && url_parts.first.empty()) {
+        input_format = probed_input_format(filename_);
+    }
+
+    AVFormatContext* ic = avformat_alloc_context();
+    if (!ic) {
+        FF_RET(AVERROR(ENOMEM), "avformat_alloc_context");
+    }
+    ic->pb = pb.get();
     FF(avformat_open_input(&ic, filename_.c_str(), input_format, &options));
-    ic_ = std::shared_ptr<AVFormatContext>(ic, [](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+    ic_ = std::shared_ptr<AVFormatContext>(ic, [pb](AVFormatContext* ctx) { avformat_close_input(&ctx); });
+
+    open_time_ = open_timer.elapsed();
 
     for (auto& p : to_map(&options)) {
         CASPAR_LOG(warning) << "av_input[" + filename_ + "]"
@@ -144,17 +800,35 @@ void Input::reset()
     ic_->interrupt_callback.callback = Input::interrupt_cb;
     ic_->interrupt_callback.opaque   = this;
 
-    FF(avformat_find_stream_info(ic_.get(), nullptr));
+    caspar::timer probe_timer;
+    find_stream_info(ic_.get(), filename_);
+    probe_time_ = probe_timer.elapsed();
+
+    discard_streams(ic_.get(), selected_);
 }
 
 bool Input::eof() const { return eof_; }
 
+void Input::select(std::set<int> streams)
+{
+    std::lock_guard<std::mutex> lock(ic_mutex_);
+
+    selected_ = std::move(streams);
+    discard_streams(ic_.get(), selected_);
+}
+
 void Input::seek(int64_t ts, bool flush)
 {
     std::lock_guard<std::mutex> lock(ic_mutex_);
 
     if (ts != ic_->start_time && ts != AV_NOPTS_VALUE) {
-        FF(avformat_seek_file(ic_.get(), -1, INT64_MIN, ts, ts, 0));
+        // The index of a growing file would only cover what had been written.
+        if (!index_ && !growing_) {
+            index_ = KeyframeIndex::get(filename_);
+        }
+        if (!index_ || !index_->seek(ic_.get(), ts)) {
+            FF(avformat_seek_file(ic_.get(), -1, INT64_MIN, ts, ts, 0));
+        }
     } else {
         reset();
     }
@@ -162,12 +836,15 @@ void Input::seek(int64_t ts, bool flush)
     {
         std::lock_guard<std::mutex> output_lock(mutex_);
 
+        poll_time_ = std::chrono::steady_clock::time_point();
         while (flush && !output_.empty()) {
+            output_bytes_ -= packet_bytes(output_.front());
+            account_packets(-packet_bytes(output_.front()));
             output_.pop();
         }
     }
     eof_ = false;
-    cond_.notify_all();
+    get_io_pool().notify();
 
     graph_->set_tag(diagnostics::tag_severity::INFO, "seek");
 }
@@ -3,24 +3,31 @@
 #include <common/diagnostics/graph.h>
 
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <set>
 #include <string>
-#include <thread>
 
 struct AVPacket;
 struct AVFormatContext;
 
 namespace caspar { namespace ffmpeg {
 
+class KeyframeIndex;
+
 class Input
 {
   public:
-    Input(const std::string& filename, std::shared_ptr<diagnostics::graph> graph);
+    // Live inputs are opened with minimal probing and without demuxer buffering. Growing inputs are local files that
+    // are still being written, see growing().
+    Input(const std::string&                  filename,
+          std::shared_ptr<diagnostics::graph> graph,
+          bool                                live    = false,
+          bool                                growing = false);
     ~Input();
 
     static int interrupt_cb(void* ctx);
@@ -33,26 +40,70 @@ class Input
 
     void reset();
     bool eof() const;
+
+    // Seconds the last reset took to open the input and to find its stream info, see av_probe.h.
+    double open_time() const { return open_time_; }
+    double probe_time() const { return probe_time_; }
+
     void abort();
 
     void seek(int64_t ts, bool flush = true);
 
+    bool live() const { return live_; }
+
+    // Whether the file is still being written. Reading waits at its end for more data, polled with a backoff, and
+    // stays ffmpeg/producer/growing-margin bytes behind the write head. Once it has not grown for
+    // ffmpeg/producer/growing-timeout seconds the rest is read and the end of file is reached as usual.
+    bool growing() const { return growing_; }
+
+    // The demuxer drops packets of streams outside the selection, an empty selection reads every stream.
+    void select(std::set<int> streams);
+
+    // Playing inputs are read before inputs that are only preloading.
+    void priority(bool value);
+    bool priority() const;
+
+    // Called on the I/O pool after each packet or end of file is queued, clear it before the callee goes away.
+    void on_read(std::function<void()> callback);
+
+    // Called by the shared I/O pool, read() reads one packet and is never called concurrently for an input.
+    bool ready() const;
+    void read();
+
   private:
+    void follow();
+
     std::string                         filename_;
     std::shared_ptr<diagnostics::graph> graph_;
+    const bool                          live_;
 
     mutable std::mutex               ic_mutex_;
     std::shared_ptr<AVFormatContext> ic_;
 
+    std::shared_ptr<const KeyframeIndex> index_;
+    std::set<int>                        selected_;
+
+    double open_time_  = 0.0;
+    double probe_time_ = 0.0;
+
     mutable std::mutex                    mutex_;
-    std::condition_variable               cond_;
     std::size_t                           output_capacity_ = 256;
     std::queue<std::shared_ptr<AVPacket>> output_;
+    int64_t                               output_bytes_ = 0;
+    std::function<void()>                 on_read_;
+
+    // Refreshes the size of a growing file and returns how much of it has been written, see follow().
+    std::function<int64_t(bool)>          file_size_;
+    std::atomic<bool>                     growing_;
+    int64_t                               growing_size_ = -1;
+    std::chrono::steady_clock::time_point growing_since_;
+    std::chrono::steady_clock::time_point poll_time_;
+    std::chrono::milliseconds             poll_interval_{0};
 
     std::atomic<bool> eof_{false};
+    std::atomic<bool> priority_{false};
 
     std::atomic<bool> abort_request_{false};
-    std::thread       thread_;
 };
 
 }} // namespace caspar::ffmpeg
@@ -0,0 +1,224 @@
+#include "av_probe.h"
+
+#include "../util/av_assert.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+// Beyond this many files the cache starts over, it only has to cover what is loaded repeatedly.
+const std::size_t MAX_PROBES = 16384;
+
+// Modification times have a resolution of up to a couple of seconds, a directory changed more recently than this may
+// change again unnoticed and is not cached.
+const std::time_t SETTLE_TIME = 2;
+
+struct directory_info
+{
+    std::time_t                          time = 0;
+    std::vector<boost::filesystem::path> entries;
+};
+
+struct stream_info
+{
+    std::shared_ptr<AVCodecParameters> codecpar;
+    AVRational                         time_base;
+    AVRational                         avg_frame_rate;
+    AVRational                         r_frame_rate;
+    AVRational                         sample_aspect_ratio;
+    int64_t                            start_time;
+    int64_t                            duration;
+};
+
+struct probe_info
+{
+    int64_t                  size       = -1;
+    std::time_t              time       = 0;
+    const AVInputFormat*     format     = nullptr;
+    int64_t                  start_time = AV_NOPTS_VALUE;
+    int64_t                  duration   = AV_NOPTS_VALUE;
+    int64_t                  bit_rate   = 0;
+    std::vector<stream_info> streams;
+};
+
+std::mutex                                        directory_mutex;
+std::map<boost::filesystem::path, directory_info> directories;
+
+std::mutex                        probe_mutex;
+std::map<std::string, probe_info> probes;
+
+// False for anything but local files.
+bool stat_file(const std::string& filename, int64_t& size, std::time_t& time)
+{
+    if (boost::contains(filename, "://")) {
+        return false;
+    }
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_regular_file(filename, ec)) {
+        return false;
+    }
+    size = static_cast<int64_t>(boost::filesystem::file_size(filename, ec));
+    time = boost::filesystem::last_write_time(filename, ec);
+    return !ec;
+}
+
+bool rational_equal(AVRational lhs, AVRational rhs) { return av_cmp_q(lhs, rhs) == 0; }
+
+bool restore(AVFormatContext* ic, const probe_info& info)
+{
+    if (ic->nb_streams != info.streams.size()) {
+        return false;
+    }
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        const auto  st     = ic->streams[n];
+        const auto& cached = info.streams[n];
+        if (st->codecpar->codec_type != cached.codecpar->codec_type ||
+            st->codecpar->codec_id != cached.codecpar->codec_id || !rational_equal(st->time_base, cached.time_base)) {
+            return false;
+        }
+    }
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        const auto  st     = ic->streams[n];
+        const auto& cached = info.streams[n];
+        FF(avcodec_parameters_copy(st->codecpar, cached.codecpar.get()));
+        st->avg_frame_rate      = cached.avg_frame_rate;
+        st->r_frame_rate        = cached.r_frame_rate;
+        st->sample_aspect_ratio = cached.sample_aspect_ratio;
+        st->start_time          = cached.start_time;
+        st->duration            = cached.duration;
+    }
+    ic->start_time = info.start_time;
+    ic->duration   = info.duration;
+    ic->bit_rate   = info.bit_rate;
+    return true;
+}
+
+probe_info snapshot(const AVFormatContext* ic, int64_t size, std::time_t time)
+{
+    probe_info info;
+    info.size       = size;
+    info.time       = time;
+    info.format     = ic->iformat;
+    info.start_time = ic->start_time;
+    info.duration   = ic->duration;
+    info.bit_rate   = ic->bit_rate;
+
+    for (auto n = 0U; n < ic->nb_streams; ++n) {
+        const auto st = ic->streams[n];
+
+        stream_info stream;
+        stream.codecpar = std::shared_ptr<AVCodecParameters>(
+            avcodec_parameters_alloc(), [](AVCodecParameters* ptr) { avcodec_parameters_free(&ptr); });
+        if (!stream.codecpar) {
+            FF_RET(AVERROR(ENOMEM), "avcodec_parameters_alloc");
+        }
+        FF(avcodec_parameters_copy(stream.codecpar.get(), st->codecpar));
+        stream.time_base           = st->time_base;
+        stream.avg_frame_rate      = st->avg_frame_rate;
+        stream.r_frame_rate        = st->r_frame_rate;
+        stream.sample_aspect_ratio = st->sample_aspect_ratio;
+        stream.start_time          = st->start_time;
+        stream.duration            = st->duration;
+        info.streams.push_back(std::move(stream));
+    }
+    return info;
+}
+
+} // namespace
+
+std::vector<boost::filesystem::path> list_directory(const boost::filesystem::path& dir)
+{
+    boost::system::error_code ec;
+    const auto                time = boost::filesystem::last_write_time(dir, ec);
+    if (ec) {
+        return {};
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(directory_mutex);
+        auto                        it = directories.find(dir);
+        if (it != directories.end() && it->second.time == time) {
+            return it->second.entries;
+        }
+    }
+
+    directory_info info;
+    info.time = time;
+    for (boost::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        info.entries.push_back(it->path());
+    }
+
+    std::lock_guard<std::mutex> lock(directory_mutex);
+    if (ec || std::time(nullptr) - time < SETTLE_TIME) {
+        directories.erase(dir);
+    } else {
+        directories[dir] = info;
+    }
+    return info.entries;
+}
+
+AVInputFormat* probed_input_format(const std::string& filename)
+{
+    int64_t     size = 0;
+    std::time_t time = 0;
+    if (!stat_file(filename, size, time)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(probe_mutex);
+    auto                        it = probes.find(filename);
+    if (it == probes.end() || it->second.size != size || it->second.time != time) {
+        return nullptr;
+    }
+    return const_cast<AVInputFormat*>(it->second.format);
+}
+
+void find_stream_info(AVFormatContext* ic, const std::string& filename)
+{
+    int64_t     size  = 0;
+    std::time_t time  = 0;
+    const auto  local = stat_file(filename, size, time) && std::time(nullptr) - time >= SETTLE_TIME;
+
+    if (local) {
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        auto                        it = probes.find(filename);
+        if (it != probes.end() && it->second.size == size && it->second.time == time &&
+            it->second.format == ic->iformat && restore(ic, it->second)) {
+            return;
+        }
+    }
+
+    FF(avformat_find_stream_info(ic, nullptr));
+
+    if (local) {
+        auto                        info = snapshot(ic, size, time);
+        std::lock_guard<std::mutex> lock(probe_mutex);
+        if (probes.size() >= MAX_PROBES) {
+            probes.clear();
+        }
+        probes[filename] = std::move(info);
+    }
+}
+
+}} // namespace caspar::ffmpeg
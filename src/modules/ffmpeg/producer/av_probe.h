@@ -0,0 +1,26 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include <string>
+#include <vector>
+
+struct AVFormatContext;
+struct AVInputFormat;
+
+namespace caspar { namespace ffmpeg {
+
+// Discovery and probing results of local media, kept until the file or directory changes so that loading a clip
+// again skips listing its folder and analysing its streams.
+
+// The entries of dir, listed again only after the directory was modified.
+std::vector<boost::filesystem::path> list_directory(const boost::filesystem::path& dir);
+
+// The demuxer filename was last opened with, nullptr if it was not probed since it changed.
+AVInputFormat* probed_input_format(const std::string& filename);
+
+// avformat_find_stream_info, or the stream parameters it found for this unchanged file last time. They are only
+// reused when the demuxer reports the same streams, formats that discover streams while reading are always probed.
+void find_stream_info(AVFormatContext* ic, const std::string& filename);
+
+}} // namespace caspar::ffmpeg
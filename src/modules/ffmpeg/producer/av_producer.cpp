@@ -1,5 +1,6 @@
 #include "av_producer.h"
 
+#include "av_decoder.h"
 #include "av_input.h"
 
 #include "../util/av_assert.h"
@@ -15,14 +16,21 @@
 #include <boost/thread/mutex.hpp>
 
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/memory.h>
+#include <common/diagnostics/trace.h>
 #include <common/env.h>
 #include <common/except.h>
 #include <common/os/thread.h>
+#include <common/param.h>
 #include <common/scope_exit.h>
 #include <common/timer.h>
 
+#include <core/channel_arena.h>
+#include <core/diagnostics/call_context.h>
+#include <core/diagnostics/layer_resources.h>
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
 #include <core/monitor/monitor.h>
 
 #ifdef _MSC_VER
@@ -37,9 +45,12 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavutil/error.h>
+#include <libavutil/hwcontext.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 #include <libavutil/samplefmt.h>
+#include <libswscale/swscale.h>
 }
 #ifdef _MSC_VER
 #pragma warning(pop)
@@ -50,10 +61,15 @@ extern "C" {
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstring>
 #include <deque>
 #include <iomanip>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <set>
 #include <sstream>
 #include <string>
 
@@ -61,6 +77,21 @@ namespace caspar { namespace ffmpeg {
 
 const AVRational TIME_BASE_Q = {1, AV_TIME_BASE};
 
+// Runs a step of the decode loop and traces it under name if it did any work, polls that find nothing to do are not.
+// The CPU time of the step accounts to resources either way.
+template <typename F>
+bool traced(const char* name, const std::shared_ptr<core::diagnostics::layer_resources>& resources, F&& step)
+{
+    core::diagnostics::scoped_cpu_time cpu_time(resources);
+
+    const auto begin  = diagnostics::trace::now();
+    const auto result = step();
+    if (result) {
+        diagnostics::trace::record(name, diagnostics::trace::current_frame(), begin, diagnostics::trace::now());
+    }
+    return result;
+}
+
 struct Frame
 {
     std::shared_ptr<AVFrame> video;
@@ -69,123 +100,59 @@ struct Frame
     int64_t                  start_time = AV_NOPTS_VALUE;
     int64_t                  pts        = AV_NOPTS_VALUE;
     int64_t                  duration   = 0;
+
+    std::chrono::steady_clock::time_point decoded;
 };
 
-// TODO (fix) Handle ts discontinuities.
-// TODO (feat) Forward options.
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4245)
+#endif
+const AVPixelFormat SINK_PIX_FMTS[] = {AV_PIX_FMT_RGB24,
+                                       AV_PIX_FMT_BGR24,
+                                       AV_PIX_FMT_BGRA,
+                                       AV_PIX_FMT_ARGB,
+                                       AV_PIX_FMT_RGBA,
+                                       AV_PIX_FMT_ABGR,
+                                       AV_PIX_FMT_YUV444P,
+                                       AV_PIX_FMT_YUV422P,
+                                       AV_PIX_FMT_YUV420P,
+                                       AV_PIX_FMT_YUV410P,
+                                       AV_PIX_FMT_YUVA444P,
+                                       AV_PIX_FMT_YUVA422P,
+                                       AV_PIX_FMT_YUVA420P,
+                                       AV_PIX_FMT_YUV444P10,
+                                       AV_PIX_FMT_YUV422P10,
+                                       AV_PIX_FMT_YUV420P10,
+                                       AV_PIX_FMT_YUV444P12,
+                                       AV_PIX_FMT_YUV422P12,
+                                       AV_PIX_FMT_YUV420P12,
+                                       AV_PIX_FMT_YUVA444P10,
+                                       AV_PIX_FMT_YUVA422P10,
+                                       AV_PIX_FMT_YUVA420P10,
+                                       AV_PIX_FMT_NV12,
+                                       AV_PIX_FMT_P010,
+                                       AV_PIX_FMT_P016,
+                                       AV_PIX_FMT_NONE};
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
 
-struct Decoder
+// Escapes an option value for a filter graph description, once for the option parser and once for the graph parser.
+std::string escape_filter_arg(const std::string& value)
 {
-    AVStream*                             st = nullptr;
-    std::shared_ptr<AVCodecContext>       ctx;
-    int64_t                               next_pts = AV_NOPTS_VALUE;
-    std::queue<std::shared_ptr<AVPacket>> input;
-    std::shared_ptr<AVFrame>              frame;
-    bool                                  eof = false;
-
-    Decoder() = default;
-
-    explicit Decoder(AVStream* stream)
-        : st(stream)
-    {
-        const auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
-        if (!codec) {
-            FF_RET(AVERROR_DECODER_NOT_FOUND, "avcodec_find_decoder");
-        }
-
-        ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
-                                              [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
-
-        if (!ctx) {
-            FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
-        }
-
-        FF(avcodec_parameters_to_context(ctx.get(), stream->codecpar));
-
-        FF(av_opt_set_int(ctx.get(), "refcounted_frames", 1, 0));
-
-        // TODO (fix): Remove limit.
-        FF(av_opt_set_int(ctx.get(), "threads", env::properties().get(L"ffmpeg.producer.threads", 4), 0));
-        // FF(av_opt_set_int(ctx.get(), "enable_er", 1, 0));
-
-        ctx->pkt_timebase = stream->time_base;
-
-        if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-            ctx->framerate           = av_guess_frame_rate(nullptr, stream, nullptr);
-            ctx->sample_aspect_ratio = av_guess_sample_aspect_ratio(nullptr, stream, nullptr);
-        } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-            if (!ctx->channel_layout && ctx->channels) {
-                ctx->channel_layout = av_get_default_channel_layout(ctx->channels);
-            }
-            if (!ctx->channels && ctx->channel_layout) {
-                ctx->channels = av_get_channel_layout_nb_channels(ctx->channel_layout);
+    auto escape = [](const std::string& str, const char* special) {
+        std::string result;
+        for (auto c : str) {
+            if (std::strchr(special, c)) {
+                result += '\\';
             }
+            result += c;
         }
-
-        if (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) {
-            ctx->thread_type = FF_THREAD_SLICE;
-        }
-
-        FF(avcodec_open2(ctx.get(), codec, nullptr));
-    }
-
-    bool operator()()
-    {
-        if (frame || eof || !st) {
-            return false;
-        }
-
-        auto av_frame = alloc_frame();
-        auto ret      = avcodec_receive_frame(ctx.get(), av_frame.get());
-
-        if (ret == AVERROR(EAGAIN)) {
-            if (input.empty()) {
-                return false;
-            }
-            FF(avcodec_send_packet(ctx.get(), input.front().get()));
-            input.pop();
-        } else if (ret == AVERROR_EOF) {
-            avcodec_flush_buffers(ctx.get());
-            av_frame->pts = next_pts;
-            eof           = true;
-            next_pts      = AV_NOPTS_VALUE;
-            frame         = std::move(av_frame);
-        } else {
-            FF_RET(ret, "avcodec_receive_frame");
-
-            // NOTE This is a workaround for DVCPRO HD.
-            if (av_frame->width > 1024 && av_frame->interlaced_frame) {
-                av_frame->top_field_first = 1;
-            }
-
-            // TODO (fix) is this always best?
-            av_frame->pts = av_frame->best_effort_timestamp;
-
-            auto duration_pts = av_frame->pkt_duration;
-            if (duration_pts <= 0) {
-                if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
-                    const auto ticks =
-                        av_stream_get_parser(st) ? av_stream_get_parser(st)->repeat_pict + 1 : ctx->ticks_per_frame;
-                    duration_pts = static_cast<int64_t>(AV_TIME_BASE) * ctx->framerate.den * ticks /
-                                   ctx->framerate.num / ctx->ticks_per_frame;
-                    duration_pts = av_rescale_q(duration_pts, {1, AV_TIME_BASE}, st->time_base);
-                } else if (ctx->codec_type == AVMEDIA_TYPE_AUDIO) {
-                    duration_pts = av_rescale_q(av_frame->nb_samples, {1, ctx->sample_rate}, st->time_base);
-                }
-            }
-
-            if (duration_pts > 0) {
-                next_pts = av_frame->pts + duration_pts;
-            } else {
-                next_pts = AV_NOPTS_VALUE;
-            }
-
-            frame = std::move(av_frame);
-        }
-
-        return true;
-    }
-};
+        return result;
+    };
+    return escape(escape(value, "\\':"), "\\'[],;");
+}
 
 struct Filter
 {
@@ -195,6 +162,31 @@ struct Filter
     std::shared_ptr<AVFrame>        frame;
     bool                            eof = false;
 
+    // Seconds spent opening the decoders this filter created, out of the time it took to construct.
+    double decoder_time = 0.0;
+
+    // Set when video needs no filtering. Decoded frames are then sent directly, with a nullptr source, and only paced
+    // by their pts.
+    bool                     direct = false;
+    AVRational               direct_tb{0, 1};
+    AVRational               direct_rate{0, 1};
+    int64_t                  direct_next = AV_NOPTS_VALUE;
+    std::shared_ptr<AVFrame> direct_input;
+    bool                     direct_eof = false;
+
+    // Set for other speeds than 1 and for blending, fps is then left out and each channel frame is picked by its time
+    // in the source, see pace(). Frames blended with the next have it in blend, blend_weight being its share.
+    bool                     paced = false;
+    bool                     blend = false;
+    AVRational               pace_rate{0, 1};
+    int64_t                  pace_start = AV_NOPTS_VALUE;
+    int64_t                  pace_time  = AV_NOPTS_VALUE;
+    std::shared_ptr<AVFrame> pace_prev;
+    std::shared_ptr<AVFrame> pace_next;
+    bool                     pace_eof = false;
+    std::shared_ptr<AVFrame> blend_frame;
+    double                   blend_weight = 0.0;
+
     Filter() = default;
 
     Filter(std::string                    filter_spec,
@@ -202,22 +194,38 @@ struct Filter
            std::map<int, Decoder>&        streams,
            int64_t                        start_time,
            AVMediaType                    media_type,
-           const core::video_format_desc& format_desc)
+           const core::video_format_desc& format_desc,
+           AVHWDeviceType                 hwaccel,
+           core::frame_factory*           frame_factory,
+           const void*                    tag,
+           const std::string&             key_path = "",
+           double                         speed    = 1.0,
+           bool                           blend    = false)
     {
+        const auto unfiltered = filter_spec.empty();
+        const auto deint = u8(env::properties().get<std::wstring>(L"ffmpeg.producer.auto-deinterlace", L"interlaced"));
+
         if (media_type == AVMEDIA_TYPE_VIDEO) {
             if (filter_spec.empty()) {
                 filter_spec = "null";
             }
 
-            auto deint = u8(env::properties().get<std::wstring>(L"ffmpeg.producer.auto-deinterlace", L"interlaced"));
-
-            if (deint != "none") {
+            // With gpu both fields are sent to the mixer, see AVProducer::Impl::field_source_.
+            if (deint != "none" && deint != "gpu") {
                 filter_spec += (boost::format(",bwdif=mode=send_field:parity=auto:deint=%s") % deint).str();
             }
 
-            filter_spec += (boost::format(",fps=fps=%d/%d:start_time=%f") % format_desc.framerate.numerator() %
-                            format_desc.framerate.denominator() % (static_cast<double>(start_time) / AV_TIME_BASE))
-                               .str();
+            const AVRational channel_rate{format_desc.framerate.numerator(), format_desc.framerate.denominator()};
+            if (speed != 1.0 || blend) {
+                paced       = true;
+                this->blend = blend;
+                pace_rate   = av_div_q(channel_rate, av_d2q(speed, 1 << 16));
+                pace_start  = start_time;
+            } else {
+                filter_spec += (boost::format(",fps=fps=%d/%d:start_time=%f") % channel_rate.num % channel_rate.den %
+                                (static_cast<double>(start_time) / AV_TIME_BASE))
+                                   .str();
+            }
         } else if (media_type == AVMEDIA_TYPE_AUDIO) {
             if (filter_spec.empty()) {
                 filter_spec = "anull";
@@ -302,12 +310,53 @@ struct Filter
                 return s->codecpar->codec_type == AVMEDIA_TYPE_VIDEO;
             });
 
+            // A separate key file is decoded by the graph itself and merged as alpha, so fill and key are aligned by
+            // their timestamps on a single decode thread and buffer.
             // TODO (fix) Use some form of stream meta data to do this.
             // https://github.com/CasparCG/server/issues/832
-            if (video_av_streams.size() >= 2 &&
-                video_av_streams[0]->codecpar->height == video_av_streams[1]->codecpar->height) {
+            if (media_type == AVMEDIA_TYPE_VIDEO && !key_path.empty()) {
+                const auto seek_point =
+                    static_cast<double>(start_time - (input->start_time != AV_NOPTS_VALUE ? input->start_time : 0)) /
+                    AV_TIME_BASE;
+                filter_spec = (boost::format("movie=filename=%s:seek_point=%f[key];[fill][key]alphamerge,") %
+                               escape_filter_arg(key_path) % std::max(0.0, seek_point))
+                                  .str() +
+                              filter_spec;
+            } else if (video_av_streams.size() >= 2 &&
+                       video_av_streams[0]->codecpar->height == video_av_streams[1]->codecpar->height) {
                 filter_spec = "alphamerge," + filter_spec;
             }
+
+            // Progressive video at the channel frame rate in a format the mixer takes needs neither bwdif, fps nor
+            // format conversion, e.g. ProRes or DNxHR masters made for the channel.
+            const AVRational channel_rate{format_desc.framerate.numerator(), format_desc.framerate.denominator()};
+            if (media_type == AVMEDIA_TYPE_VIDEO && unfiltered && !paced && key_path.empty() &&
+                video_av_streams.size() == 1) {
+                const auto st = video_av_streams[0];
+                if ((deint == "none" || deint == "gpu" || st->codecpar->field_order == AV_FIELD_PROGRESSIVE) &&
+                    av_cmp_q(av_guess_frame_rate(nullptr, st, nullptr), channel_rate) == 0) {
+                    auto it = streams.find(st->index);
+                    if (it == streams.end()) {
+                        caspar::timer decoder_timer;
+                        it = streams.emplace(std::piecewise_construct,
+                                             std::forward_as_tuple(st->index),
+                                             std::forward_as_tuple(st, hwaccel, frame_factory, tag, input.live()))
+                                 .first;
+                        decoder_time += decoder_timer.elapsed();
+                    }
+                    const auto pix_fmt = it->second.pix_fmt();
+                    if (pix_fmt != AV_PIX_FMT_NONE &&
+                        std::find(std::begin(SINK_PIX_FMTS), std::end(SINK_PIX_FMTS), pix_fmt) !=
+                            std::end(SINK_PIX_FMTS)) {
+                        direct      = true;
+                        direct_tb   = st->time_base;
+                        direct_rate = channel_rate;
+                        direct_next = av_rescale_q(start_time, TIME_BASE_Q, direct_tb);
+                        sources.emplace(st->index, nullptr);
+                        return;
+                    }
+                }
+            }
         }
 
         graph = std::shared_ptr<AVFilterGraph>(avfilter_graph_alloc(),
@@ -350,14 +399,20 @@ struct Filter
 
                 auto it = streams.find(index);
                 if (it == streams.end()) {
-                    it = streams.emplace(index, input->streams[index]).first;
+                    caspar::timer decoder_timer;
+                    it = streams.emplace(std::piecewise_construct,
+                                         std::forward_as_tuple(index),
+                                         std::forward_as_tuple(
+                                             input->streams[index], hwaccel, frame_factory, tag, input.live()))
+                             .first;
+                    decoder_time += decoder_timer.elapsed();
                 }
 
                 auto st = it->second.ctx;
 
                 if (st->codec_type == AVMEDIA_TYPE_VIDEO) {
                     auto args = (boost::format("video_size=%dx%d:pix_fmt=%d:time_base=%d/%d") % st->width % st->height %
-                                 st->pix_fmt % st->pkt_timebase.num % st->pkt_timebase.den)
+                                 it->second.pix_fmt() % st->pkt_timebase.num % st->pkt_timebase.den)
                                     .str();
                     auto name = (boost::format("in_%d") % index).str();
 
@@ -399,28 +454,7 @@ struct Filter
             FF(avfilter_graph_create_filter(
                 &sink, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, graph.get()));
 
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4245)
-#endif
-            const AVPixelFormat pix_fmts[] = {AV_PIX_FMT_RGB24,
-                                              AV_PIX_FMT_BGR24,
-                                              AV_PIX_FMT_BGRA,
-                                              AV_PIX_FMT_ARGB,
-                                              AV_PIX_FMT_RGBA,
-                                              AV_PIX_FMT_ABGR,
-                                              AV_PIX_FMT_YUV444P,
-                                              AV_PIX_FMT_YUV422P,
-                                              AV_PIX_FMT_YUV420P,
-                                              AV_PIX_FMT_YUV410P,
-                                              AV_PIX_FMT_YUVA444P,
-                                              AV_PIX_FMT_YUVA422P,
-                                              AV_PIX_FMT_YUVA420P,
-                                              AV_PIX_FMT_NONE};
-            FF(av_opt_set_int_list(sink, "pix_fmts", pix_fmts, -1, AV_OPT_SEARCH_CHILDREN));
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+            FF(av_opt_set_int_list(sink, "pix_fmts", SINK_PIX_FMTS, -1, AV_OPT_SEARCH_CHILDREN));
         } else if (media_type == AVMEDIA_TYPE_AUDIO) {
             FF(avfilter_graph_create_filter(
                 &sink, avfilter_get_by_name("abuffersink"), "out", nullptr, nullptr, graph.get()));
@@ -431,8 +465,6 @@ struct Filter
             const AVSampleFormat sample_fmts[] = {AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_NONE};
             FF(av_opt_set_int_list(sink, "sample_fmts", sample_fmts, -1, AV_OPT_SEARCH_CHILDREN));
 
-            // TODO Always output 8 channels and remove hack in make_frame.
-
             const int sample_rates[] = {format_desc.audio_sample_rate, -1};
             FF(av_opt_set_int_list(sink, "sample_rates", sample_rates, -1, AV_OPT_SEARCH_CHILDREN));
 #ifdef _MSC_VER
@@ -463,18 +495,56 @@ struct Filter
         FF(avfilter_graph_config(graph.get(), nullptr));
     }
 
+    void send(std::shared_ptr<AVFrame> av_frame)
+    {
+        if (!av_frame->data[0]) {
+            direct_eof = true;
+        } else {
+            direct_input = std::move(av_frame);
+        }
+    }
+
+    AVRational time_base() const { return direct ? direct_tb : av_buffersink_get_time_base(sink); }
+    AVRational frame_rate() const
+    {
+        return direct ? direct_rate : paced ? pace_rate : av_buffersink_get_frame_rate(sink);
+    }
+
     bool operator()(int nb_samples = -1)
     {
         if (frame || eof) {
             return false;
         }
 
+        if (direct) {
+            if (!direct_input) {
+                eof = direct_eof;
+                return eof;
+            }
+
+            auto       av_frame = std::move(direct_input);
+            const auto duration = av_rescale_q(1, av_inv_q(direct_rate), direct_tb);
+            if (av_frame->pts == AV_NOPTS_VALUE) {
+                av_frame->pts = direct_next;
+            } else if (av_frame->pts < direct_next - duration / 2) {
+                // Before the start time or a repeated timestamp, like fps would drop it.
+                return true;
+            }
+            direct_next = av_frame->pts + duration;
+            frame       = std::move(av_frame);
+            return true;
+        }
+
         if (!sink || sources.empty()) {
             eof   = true;
             frame = nullptr;
             return true;
         }
 
+        if (paced) {
+            return pace();
+        }
+
         auto av_frame = alloc_frame();
         auto ret      = nb_samples >= 0 ? av_buffersink_get_samples(sink, av_frame.get(), nb_samples)
                                    : av_buffersink_get_frame(sink, av_frame.get());
@@ -491,6 +561,77 @@ struct Filter
         frame = std::move(av_frame);
         return true;
     }
+
+    // Frames leave the graph at the source rate. Each channel frame shows the last source frame at or before its time,
+    // which advances by speed source frames per channel frame, so frames are skipped or repeated by their timestamps.
+    // With blend the next source frame is mixed in by how close the time is to it.
+    bool pace()
+    {
+        blend_frame = nullptr;
+
+        const auto tb   = av_buffersink_get_time_base(sink);
+        const auto step = av_rescale_q(1, av_inv_q(pace_rate), tb);
+        if (pace_time == AV_NOPTS_VALUE) {
+            pace_time = av_rescale_q(pace_start, TIME_BASE_Q, tb);
+        }
+
+        auto result = false;
+        while (!pace_eof && (!pace_next || pace_next->pts <= pace_time)) {
+            auto       av_frame = alloc_frame();
+            const auto ret      = av_buffersink_get_frame(sink, av_frame.get());
+            if (ret == AVERROR(EAGAIN)) {
+                return result;
+            }
+            if (ret == AVERROR_EOF) {
+                pace_eof = true;
+                break;
+            }
+            FF_RET(ret, "av_buffersink_get_frame");
+            result = true;
+
+            if (av_frame->pts == AV_NOPTS_VALUE) {
+                av_frame->pts = pace_next ? pace_next->pts + step : pace_time;
+            }
+            if (pace_next) {
+                pace_prev = std::move(pace_next);
+            }
+            pace_next = std::move(av_frame);
+        }
+
+        // Before the first frame it is shown, after the last one it is held for as long as the one before it was.
+        std::shared_ptr<AVFrame> current;
+        std::shared_ptr<AVFrame> next;
+        if (pace_next && pace_next->pts <= pace_time) {
+            current             = pace_next;
+            const auto interval = pace_prev ? pace_next->pts - pace_prev->pts : step;
+            if (pace_time >= pace_next->pts + std::max<int64_t>(interval, 1)) {
+                current = nullptr;
+            }
+        } else {
+            current = pace_prev ? pace_prev : pace_next;
+            next    = pace_prev ? pace_next : nullptr;
+        }
+
+        if (!current) {
+            eof   = true;
+            frame = nullptr;
+            return true;
+        }
+
+        frame.reset(av_frame_clone(current.get()), [](AVFrame* ptr) { av_frame_free(&ptr); });
+        frame->pts = pace_time;
+
+        if (blend && next && next->pts > current->pts) {
+            const auto weight = static_cast<double>(pace_time - current->pts) / (next->pts - current->pts);
+            if (weight > 0.01) {
+                blend_frame  = next;
+                blend_weight = weight;
+            }
+        }
+
+        pace_time += step;
+        return true;
+    }
 };
 
 struct AVProducer::Impl
@@ -505,22 +646,42 @@ struct AVProducer::Impl
     const AVRational                           format_tb_;
     const std::string                          name_;
     const std::string                          path_;
+    const std::string                          key_path_;
+
+    // When the producer was requested, the load times under load/ in the state are set once each, see load_time.
+    const std::chrono::steady_clock::time_point requested_;
+    bool                                        loaded_        = false;
+    bool                                        first_decoded_ = false;
+    bool                                        first_pushed_  = false;
+    std::atomic<bool>                           first_drawn_{false};
+
+    // Network sources are played with a jitter buffer of live_frames_ instead of buffering ahead, see next_frame.
+    const bool           live_;
+    const int            live_frames_;
+    int                  live_drift_ = 0;
+    std::atomic<int64_t> live_latency_{0};
 
     Input                  input_;
     std::map<int, Decoder> decoders_;
     Filter                 video_filter_;
     Filter                 audio_filter_;
+    frame_cache            frame_cache_;
 
     std::map<int, std::vector<AVFilterContext*>> sources_;
 
     std::atomic<int64_t> start_{AV_NOPTS_VALUE};
     std::atomic<int64_t> duration_{AV_NOPTS_VALUE};
     std::atomic<int64_t> input_duration_{AV_NOPTS_VALUE};
+
+    // The duration of a growing file follows the packets read until it stops growing, see schedule().
+    std::atomic<bool> growing_duration_{false};
+
     std::atomic<int64_t> seek_{AV_NOPTS_VALUE};
     std::atomic<bool>    loop_{false};
 
-    std::string afilter_;
-    std::string vfilter_;
+    std::string    afilter_;
+    std::string    vfilter_;
+    AVHWDeviceType hwaccel_;
 
     int64_t          frame_count_    = 0;
     bool             frame_flush_    = true;
@@ -529,49 +690,165 @@ struct AVProducer::Impl
     int64_t          frame_duration_ = AV_NOPTS_VALUE;
     core::draw_frame frame_;
 
-    std::deque<Frame>         buffer_;
-    mutable boost::mutex      buffer_mutex_;
-    boost::condition_variable buffer_cond_;
-    std::atomic<bool>         buffer_eof_{false};
-    int                       buffer_capacity_ = static_cast<int>(format_desc_.fps) / 2;
+    std::deque<Frame>               buffer_;
+    mutable boost::mutex            buffer_mutex_;
+    boost::condition_variable       buffer_cond_;
+    std::atomic<bool>               buffer_eof_{false};
+    const int                       buffer_min_;
+    const int                       buffer_max_;
+    std::atomic<int>                buffer_capacity_;
+    int                             buffer_headroom_ = 0;
+    std::atomic<int64_t>            buffer_bytes_{0};
+    diagnostics::memory::held_bytes buffer_held_{"ffmpeg/producer-buffers"};
+    std::atomic<bool>               active_{false};
+    std::atomic<int>                prefetch_{4};
+
+    // Whether next_frame waits for frames that have not been decoded yet, see pull().
+    std::atomic<bool> pull_{false};
+
+    // Whether audio can be heard, and whether run() currently decodes it, see audible().
+    std::atomic<bool> audible_{true};
+    bool              audio_ = true;
 
     int latency_ = 0;
 
+    // Interlaced frames are deinterlaced by the mixer with auto-deinterlace=gpu. fps repeats a frame for its second
+    // field, which is told apart by the unchanged source timestamp.
+    const bool gpu_deinterlace_ =
+        env::properties().get<std::wstring>(L"ffmpeg.producer.auto-deinterlace", L"interlaced") == L"gpu";
+    int64_t field_source_ = AV_NOPTS_VALUE;
+
+    timer      seek_timer_;
+    bool       seek_pending_ = false;
+    const bool seek_skip_    = env::properties().get(L"configuration.ffmpeg.producer.seek-skip", false);
+
+    const int     decoder_packets_ = env::properties().get(L"configuration.ffmpeg.producer.decoder-packets", 1024);
+    const int64_t decoder_bytes_ =
+        env::properties().get(L"configuration.ffmpeg.producer.decoder-queue-size", 64LL) * 1024 * 1024;
+
+    // Frames from the start of the clip kept while looping. They are replayed on wrap-around while decoding resumes
+    // right after them, which hides the seek and refill.
+    const int          loop_head_size_ =
+        env::properties().get(L"configuration.ffmpeg.producer.loop-preroll", static_cast<int>(format_desc_.fps) / 2);
+    std::vector<Frame> loop_head_;
+    int64_t            loop_head_start_   = AV_NOPTS_VALUE;
+    bool               loop_head_capture_ = false;
+
+    // Reverse playback decodes a GOP at a time, from a keyframe up to where the frames played so far begin, and plays
+    // it backwards without audio. The GOPs decoded last are kept for going back and forth. Keyframes are learned from
+    // the packets read, decoding then starts at one when it can. Forward speeds other than 1 pick frames by their time,
+    // see Filter::pace, also without audio.
+    std::atomic<double>                   speed_{1.0};
+    int                                   direction_    = 1;
+    double                                rate_         = 1.0;
+    const bool                            blend_;
+    bool                                  gop_decoding_ = false;
+    int64_t                               gop_start_    = AV_NOPTS_VALUE;
+    int64_t                               gop_end_      = AV_NOPTS_VALUE;
+    int64_t                               gop_back_     = 1;
+    std::vector<Frame>                    gop_;
+    std::map<int64_t, std::vector<Frame>> gops_;
+    diagnostics::memory::held_bytes       gops_held_{"ffmpeg/reverse-gops"};
+
+    const int         gop_cache_size_ = env::properties().get(L"configuration.ffmpeg.producer.reverse-gops", 4);
+    std::set<int64_t> keyframes_;
+    int64_t           gop_duration_ = AV_TIME_BASE;
+
+    // Scrub targets that follow each other within the scrub latency show the keyframe before them, once the target
+    // has been still for that long its own frame is decoded.
+    std::atomic<bool>                     scrub_{false};
+    std::atomic<bool>                     scrubbing_{false};
+    std::atomic<int>                      scrub_latency_{100};
+    int64_t                               scrub_target_ = AV_NOPTS_VALUE;
+    bool                                  scrub_hold_   = false;
+    std::chrono::steady_clock::time_point scrub_last_;
+
+    // The worker sleeps here when it can make no progress, until a packet is read or playback is changed.
+    boost::mutex              wake_mutex_;
+    boost::condition_variable wake_cond_;
+    bool                      wake_ = false;
+
+    // The channel and layer the producer was created for, which the worker thread takes on.
+    const core::diagnostics::call_context context_ = core::diagnostics::call_context::for_thread();
+
+    // Decoding and filtering run in the arena of the channel the producer was created on, if it has one.
+    const std::shared_ptr<tbb::task_arena> arena_ = core::channel_arena(context_.video_channel);
+
+    // Decoding, filtering and making frames account to the layer, see core::diagnostics::layer_resources.
+    const std::shared_ptr<core::diagnostics::layer_resources> resources_ =
+        core::diagnostics::layer_resources::find(context_);
+
     boost::thread     thread_;
     std::atomic<bool> abort_request_{false};
 
-    Impl(std::shared_ptr<core::frame_factory> frame_factory,
-         core::video_format_desc              format_desc,
-         std::string                          name,
-         std::string                          path,
-         std::string                          vfilter,
-         std::string                          afilter,
-         boost::optional<int64_t>             start,
-         boost::optional<int64_t>             duration,
-         bool                                 loop)
+    Impl(std::shared_ptr<core::frame_factory>  frame_factory,
+         core::video_format_desc               format_desc,
+         std::string                           name,
+         std::string                           path,
+         std::string                           vfilter,
+         std::string                           afilter,
+         boost::optional<int64_t>              start,
+         boost::optional<int64_t>              duration,
+         bool                                  loop,
+         std::string                           hwaccel,
+         int                                   buffer_min,
+         int                                   buffer_max,
+         int                                   latency,
+         std::string                           key_path,
+         double                                speed,
+         bool                                  blend,
+         bool                                  growing,
+         std::chrono::steady_clock::time_point requested)
         : frame_factory_(frame_factory)
         , format_desc_(format_desc)
         , format_tb_({format_desc.duration, format_desc.time_scale})
         , name_(name)
         , path_(path)
-        , input_(path, graph_)
+        , key_path_(key_path)
+        , requested_(requested)
+        , live_(latency > 0 && is_live(path))
+        , live_frames_(std::max(1, static_cast<int>(latency * format_desc.fps / 1000.0 + 0.5)))
+        , input_(path, graph_, live_, growing)
         , start_(start ? av_rescale_q(*start, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , duration_(duration ? av_rescale_q(*duration, format_tb_, TIME_BASE_Q) : AV_NOPTS_VALUE)
         , loop_(loop)
         , afilter_(afilter)
         , vfilter_(vfilter)
+        , hwaccel_(av_hwdevice_find_type_by_name(hwaccel.c_str()))
+        , buffer_min_(live_ ? live_frames_ * 2
+                            : std::max(1, buffer_min > 0 ? buffer_min : static_cast<int>(format_desc_.fps) / 2))
+        , buffer_max_(live_ ? buffer_min_ : std::max(buffer_min_, buffer_max))
+        , buffer_capacity_(buffer_min_)
+        , speed_(speed)
+        , blend_(blend)
     {
+        if (hwaccel_ == AV_HWDEVICE_TYPE_NONE && !hwaccel.empty() && hwaccel != "none") {
+            CASPAR_LOG(warning) << print() << " Unknown hwaccel " << hwaccel << ", decoding in software.";
+        }
+
         diagnostics::register_graph(graph_);
         graph_->set_color("underflow", diagnostics::color(0.6f, 0.3f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.0f, 1.0f, 0.0f));
         graph_->set_color("buffer", diagnostics::color(1.0f, 1.0f, 0.0f));
+        graph_->set_color("seek-time", diagnostics::color(1.0f, 0.2f, 0.2f));
 
-        state_["file/name"] = u8(name_);
-        state_["file/path"] = u8(path_);
-        state_["loop"]      = loop;
+        state_["file/name"]  = u8(name_);
+        state_["file/path"]  = u8(path_);
+        if (!key_path_.empty()) {
+            state_["file/key"] = u8(key_path_);
+        }
+        state_["loop"]       = loop;
+        state_["hwaccel"]    = hwaccel_ != AV_HWDEVICE_TYPE_NONE ? hwaccel : "none";
+        state_["buffer/min"] = buffer_min_;
+        state_["buffer/max"] = buffer_max_;
+        state_["live"]       = live_;
+        state_["blend"]      = blend_;
         update_state();
 
+        input_.on_read([this] { wake(); });
+
         thread_ = boost::thread([=] {
+            core::diagnostics::call_context::for_thread() = context_;
             try {
                 run();
             } catch (boost::thread_interrupted&) {
@@ -587,7 +864,10 @@ struct AVProducer::Impl
         input_.abort();
         abort_request_ = true;
         buffer_cond_.notify_all();
+        wake();
         thread_.join();
+        input_.on_read(nullptr);
+        memory_budget_add(-buffer_bytes_);
     }
 
     void run()
@@ -596,6 +876,9 @@ struct AVProducer::Impl
 
         input_.reset();
 
+        load_time("open", input_.open_time() * 1000.0);
+        load_time("probe", input_.probe_time() * 1000.0);
+
         for (auto n = 0UL; n < input_->nb_streams; ++n) {
             auto st                                              = input_->streams[n];
             auto framerate                                       = av_guess_frame_rate(nullptr, st, nullptr);
@@ -607,9 +890,14 @@ struct AVProducer::Impl
         }
 
         if (duration_ == AV_NOPTS_VALUE) {
-            duration_ = input_->duration;
+            growing_duration_ = input_.growing();
+            duration_         = input_.growing() ? AV_NOPTS_VALUE : input_->duration;
         }
 
+        direction_ = speed_ < 0 ? -1 : 1;
+        rate_      = direction_ > 0 ? speed_.load() : 1.0;
+        audio_     = decode_audio();
+
         {
             const auto start = start_.load();
             if (start != AV_NOPTS_VALUE) {
@@ -617,6 +905,7 @@ struct AVProducer::Impl
             } else {
                 reset(input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
             }
+            capture_loop_head(start != AV_NOPTS_VALUE ? start : 0);
         }
 
         timer frame_timer;
@@ -634,13 +923,76 @@ struct AVProducer::Impl
                 const auto seek = seek_.exchange(AV_NOPTS_VALUE);
 
                 if (seek != AV_NOPTS_VALUE) {
-                    seek_internal(seek);
+                    direction_ = speed_ < 0 ? -1 : 1;
+                    rate_      = direction_ > 0 ? speed_.load() : 1.0;
+                    audio_     = decode_audio();
+                    if (scrub_.exchange(false)) {
+                        scrub_internal(seek);
+                    } else if (direction_ < 0) {
+                        scrub_target_ = AV_NOPTS_VALUE;
+                        reverse_from(seek);
+                    } else {
+                        scrub_target_ = AV_NOPTS_VALUE;
+                        seek_internal(seek);
+                    }
+                    frame              = Frame{};
+                    loop_head_capture_ = false;
+                    continue;
+                }
+            }
+
+            if (scrub_target_ != AV_NOPTS_VALUE) {
+                // The keyframe shown while scrubbing is held until the target moves or has been still long enough.
+                const auto settle = scrub_last_ + std::chrono::milliseconds(scrub_latency_.load());
+                const auto now    = std::chrono::steady_clock::now();
+                if (now < settle) {
+                    if (scrub_hold_) {
+                        wait(boost::chrono::milliseconds(
+                            std::chrono::duration_cast<std::chrono::milliseconds>(settle - now).count() + 1));
+                        continue;
+                    }
+                } else {
+                    const auto target = scrub_target_;
+                    scrub_target_     = AV_NOPTS_VALUE;
+                    scrub_hold_       = false;
+                    clear_buffer();
+                    seek_internal(target);
                     frame = Frame{};
                     continue;
                 }
             }
 
-            {
+            if (direction_ < 0) {
+                const auto time = frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration : AV_NOPTS_VALUE;
+                if (!gop_decoding_) {
+                    if (!reverse_step()) {
+                        wait();
+                    }
+                    frame = Frame{};
+                    continue;
+                }
+                if ((video_filter_.eof && audio_filter_.eof) || (time != AV_NOPTS_VALUE && time >= gop_end_)) {
+                    finish_gop();
+                    frame = Frame{};
+                    continue;
+                }
+            }
+
+            if (direction_ > 0 && decode_audio() != audio_) {
+                audio_           = decode_audio();
+                const auto start = start_.load();
+                seek_internal(frame.pts != AV_NOPTS_VALUE ? frame.pts + frame.duration
+                                                          : (start != AV_NOPTS_VALUE ? start : 0),
+                              false);
+                frame.audio = nullptr;
+
+                // The loop head is captured again, with or without audio.
+                loop_head_.clear();
+                loop_head_capture_ = false;
+                continue;
+            }
+
+            if (direction_ > 0) {
                 // TODO (perf) seek as soon as input is past duration or eof.
 
                 auto start    = start_.load();
@@ -656,25 +1008,43 @@ struct AVProducer::Impl
                 if (buffer_eof_) {
                     if (loop_ && frame_count_ > 2) {
                         frame = Frame{};
-                        seek_internal(start);
+                        if (!loop_head_.empty() && loop_head_start_ == start) {
+                            loop_head_capture_ = false;
+                            for (auto& head : loop_head_) {
+                                push(head);
+                            }
+                            seek_internal(loop_head_.back().pts + loop_head_.back().duration);
+                            frame_count_ = static_cast<int64_t>(loop_head_.size());
+                        } else {
+                            seek_internal(start);
+                            capture_loop_head(start);
+                        }
                     } else {
-                        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+                        wait();
                     }
-                    // TODO (fix) Limit live polling due to bugs.
                     continue;
                 }
             }
 
             std::atomic<int> progress{schedule()};
 
-            tbb::parallel_invoke(
-                [&] { tbb::parallel_for_each(decoders_, [&](auto& p) { progress.fetch_or(p.second()); }); },
-                [&] { progress.fetch_or(video_filter_()); },
-                [&] { progress.fetch_or(audio_filter_(audio_cadence[0])); });
+            core::execute_in(arena_, [&] {
+                tbb::parallel_invoke(
+                    [&] {
+                        tbb::parallel_for_each(decoders_, [&](auto& p) {
+                            progress.fetch_or(traced("decode", resources_, [&] { return p.second(); }));
+                        });
+                    },
+                    [&] { progress.fetch_or(traced("filter", resources_, [&] { return video_filter_(); })); },
+                    [&] {
+                        progress.fetch_or(
+                            traced("filter", resources_, [&] { return audio_filter_(audio_cadence[0]); }));
+                    });
+            });
 
             if ((!video_filter_.frame && !video_filter_.eof) || (!audio_filter_.frame && !audio_filter_.eof)) {
-                if (!progress) {
-                    if (warning_debounce++ % 500 == 100) {
+                if (!progress && !wait(boost::chrono::seconds(1))) {
+                    if (warning_debounce++ % 5 == 1) {
                         if (!video_filter_.frame && !video_filter_.eof) {
                             CASPAR_LOG(warning) << print() << " Waiting for video frame...";
                         } else if (!audio_filter_.frame && !audio_filter_.eof) {
@@ -683,8 +1053,6 @@ struct AVProducer::Impl
                             CASPAR_LOG(warning) << print() << " Waiting for frame...";
                         }
                     }
-
-                    boost::this_thread::sleep_for(boost::chrono::milliseconds(warning_debounce > 25 ? 10 : 1));
                     frame_timer.restart();
                 }
                 continue;
@@ -692,6 +1060,11 @@ struct AVProducer::Impl
 
             warning_debounce = 0;
 
+            if (!first_decoded_) {
+                first_decoded_ = true;
+                load_time("first-decode", since_requested());
+            }
+
             // TODO (fix)
             // if (start_ != AV_NOPTS_VALUE && frame.pts < start_) {
             //    seek_internal(start_);
@@ -702,8 +1075,8 @@ struct AVProducer::Impl
 
             if (video_filter_.frame) {
                 frame.video      = std::move(video_filter_.frame);
-                const auto tb    = av_buffersink_get_time_base(video_filter_.sink);
-                const auto fr    = av_buffersink_get_frame_rate(video_filter_.sink);
+                const auto tb    = video_filter_.time_base();
+                const auto fr    = video_filter_.frame_rate();
                 frame.start_time = start_time;
                 frame.pts        = av_rescale_q(frame.video->pts, tb, TIME_BASE_Q) - start_time;
                 frame.duration   = av_rescale_q(1, av_inv_q(fr), TIME_BASE_Q);
@@ -718,33 +1091,183 @@ struct AVProducer::Impl
                 frame.duration   = av_rescale_q(frame.audio->nb_samples, {1, sr}, TIME_BASE_Q);
             }
 
-            frame.frame = core::draw_frame(make_frame(this, *frame_factory_, frame.video, frame.audio));
+            {
+                diagnostics::trace::scope          scope("make-frame");
+                core::diagnostics::scoped_cpu_time cpu_time(resources_);
+                frame.frame = core::draw_frame(make_frame(
+                    this, *frame_factory_, frame_cache_, frame.video, frame.audio, format_desc_.audio_channels));
+
+                // The mixer blends the next source frame over this one, by its share of the time between them.
+                if (video_filter_.blend_frame) {
+                    auto next = core::draw_frame(make_frame(this,
+                                                            *frame_factory_,
+                                                            frame_cache_,
+                                                            std::move(video_filter_.blend_frame),
+                                                            nullptr,
+                                                            format_desc_.audio_channels));
+                    next.transform().image_transform.opacity = video_filter_.blend_weight;
+                    frame.frame = core::draw_frame::over(std::move(frame.frame), std::move(next));
+                }
+            }
+            frame.decoded = std::chrono::steady_clock::now();
+
+            if (gpu_deinterlace_ && frame.video && frame.video->interlaced_frame) {
+                const auto source = frame.video->best_effort_timestamp;
+                const auto second = source != AV_NOPTS_VALUE && source == field_source_;
+                const auto upper  = (frame.video->top_field_first != 0) != second;
+                frame.frame.transform().image_transform.field =
+                    upper ? core::field_mode::upper : core::field_mode::lower;
+                field_source_ = source;
+            }
+
+            if (seek_pending_) {
+                seek_pending_ = false;
+                graph_->set_value("seek-time", seek_timer_.elapsed() * format_desc_.fps * 0.5);
+                boost::lock_guard<boost::mutex> lock(state_mutex_);
+                state_["seek/latency"] = seek_timer_.elapsed() * 1000.0;
+            }
 
             graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
             frame_timer.restart();
 
-            {
-                boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
-                buffer_cond_.wait(buffer_lock, [&] { return buffer_.size() < buffer_capacity_ || abort_request_; });
-                if (seek_ == AV_NOPTS_VALUE) {
-                    buffer_.push_back(frame);
+            if (direction_ < 0) {
+                if (frame.pts < gop_end_) {
+                    auto decoded  = frame;
+                    decoded.video = nullptr;
+                    decoded.audio = nullptr;
+                    gop_.push_back(std::move(decoded));
                 }
+                continue;
+            }
+
+            push(frame);
+
+            if (scrub_target_ != AV_NOPTS_VALUE) {
+                scrub_hold_ = true;
+            } else if (scrubbing_) {
+                scrubbing_ = false;
+            }
+
+            if (!first_pushed_) {
+                first_pushed_ = true;
+                load_time("first-frame", since_requested());
+            }
+
+            if (loop_head_capture_) {
+                // Only the mixer frame is replayed, the decoded AVFrames would pin ffmpeg buffers.
+                auto head  = frame;
+                head.video = nullptr;
+                head.audio = nullptr;
+                loop_head_.push_back(std::move(head));
+                loop_head_capture_ = static_cast<int>(loop_head_.size()) < loop_head_size_;
             }
 
             frame_count_ += 1;
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
 
             boost::range::rotate(audio_cadence, std::end(audio_cadence) - 1);
         }
     }
 
+    void wake()
+    {
+        boost::lock_guard<boost::mutex> lock(wake_mutex_);
+        wake_ = true;
+        wake_cond_.notify_all();
+    }
+
+    void wait()
+    {
+        boost::unique_lock<boost::mutex> lock(wake_mutex_);
+        wake_cond_.wait(lock, [&] { return wake_ || abort_request_; });
+        wake_ = false;
+    }
+
+    // Returns false if nothing happened within timeout.
+    bool wait(boost::chrono::milliseconds timeout)
+    {
+        boost::unique_lock<boost::mutex> lock(wake_mutex_);
+        const auto woken = wake_cond_.wait_for(lock, timeout, [&] { return wake_ || abort_request_; });
+        wake_            = false;
+        return woken;
+    }
+
+    void push(const Frame& frame)
+    {
+        {
+            boost::unique_lock<boost::mutex> buffer_lock(buffer_mutex_);
+            // Live sources can't be held back, the oldest frame gives way instead.
+            while (live_ && !buffer_.empty() && static_cast<int>(buffer_.size()) >= buffer_capacity_) {
+                account(-frame_bytes(buffer_.front()));
+                buffer_.pop_front();
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            }
+            // Only the memory budget is polled, it is released by other producers.
+            while (!live_ && !abort_request_ && buffer_full()) {
+                if (buffer_budget_bound()) {
+                    buffer_cond_.wait_for(buffer_lock, boost::chrono::milliseconds(20));
+                } else {
+                    buffer_cond_.wait(buffer_lock);
+                }
+            }
+            if (seek_ == AV_NOPTS_VALUE) {
+                buffer_.push_back(frame);
+                account(frame_bytes(frame));
+                if (pull_) {
+                    buffer_cond_.notify_all();
+                }
+            }
+        }
+        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+    }
+
+    // Producers that have not played yet only prefetch what is needed to start, playing producers fill their buffer
+    // unless the memory budget is exceeded. Called with buffer_mutex_ held.
+    bool buffer_full() const
+    {
+        const auto size     = static_cast<int>(buffer_.size());
+        const auto prefetch = std::min(prefetch_.load(), buffer_capacity_.load());
+        return size >= buffer_capacity_ || (size >= prefetch && (!active_ || memory_budget_exceeded()));
+    }
+
+    // Whether buffer_full() holds only because of the memory budget. Called with buffer_mutex_ held.
+    bool buffer_budget_bound() const
+    {
+        const auto size = static_cast<int>(buffer_.size());
+        return size < buffer_capacity_ && active_;
+    }
+
+    void account(int64_t bytes)
+    {
+        buffer_bytes_ += bytes;
+        buffer_held_.add(bytes);
+        memory_budget_add(bytes);
+    }
+
+    static int64_t frame_bytes(const Frame& frame)
+    {
+        return ffmpeg::frame_bytes(frame.video.get()) + ffmpeg::frame_bytes(frame.audio.get());
+    }
+
+    void capture_loop_head(int64_t start)
+    {
+        loop_head_.clear();
+        loop_head_start_   = start;
+        loop_head_capture_ = loop_ && loop_head_size_ > 0;
+    }
+
     void update_state()
     {
         graph_->set_text(u16(print()));
         boost::lock_guard<boost::mutex> lock(state_mutex_);
-        state_["file/clip"] = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
-        state_["file/time"] = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
-        state_["loop"]      = loop_;
+        state_["file/clip"]       = {start().value_or(0) / format_desc_.fps, duration().value_or(0) / format_desc_.fps};
+        state_["file/time"]       = {time() / format_desc_.fps, file_duration().value_or(0) / format_desc_.fps};
+        state_["loop"]            = loop_;
+        state_["buffer/capacity"] = buffer_capacity_.load();
+        state_["buffer/memory"]   = buffer_bytes_.load();
+        if (live_) {
+            state_["live/latency"] = live_latency_.load();
+            state_["live/buffer"]  = live_frames_;
+        }
     }
 
     core::draw_frame prev_frame()
@@ -766,19 +1289,75 @@ struct AVProducer::Impl
         return core::draw_frame::still(frame_);
     }
 
+    // Inactive producers are read after active ones and stop decoding once prefetch frames are buffered.
+    void active(bool active)
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        if (active_.exchange(active) != active) {
+            input_.priority(active);
+            buffer_cond_.notify_all();
+        }
+    }
+
+    // Switching restarts decoding from where it is, like looping does, so that audio stays in sync with video. Live
+    // sources can not be restarted and are always decoded with audio.
+    void audible(bool audible)
+    {
+        if (!live_ && audible_.exchange(audible) != audible) {
+            wake();
+        }
+    }
+
+    void pull(bool pull)
+    {
+        pull_ = pull;
+        buffer_cond_.notify_all();
+    }
+
+    void prefetch(int frames)
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        prefetch_ = std::max(1, frames);
+        buffer_cond_.notify_all();
+    }
+
     core::draw_frame next_frame()
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
-        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        boost::unique_lock<boost::mutex> lock(buffer_mutex_);
 
-        if (buffer_.empty() || (frame_flush_ && buffer_.size() < 4)) {
+        if (!active_.exchange(true)) {
+            input_.priority(true);
+            buffer_cond_.notify_all();
+        }
+
+        // A scrubbed frame is shown as soon as it is decoded, the one before it until then.
+        const auto start_level = live_ ? live_frames_ : scrubbing_ ? 1 : std::min(4, buffer_capacity_.load());
+        if (pull_ && !live_) {
+            // Frames are pushed with a notification, the end of the file is only polled for.
+            while (!abort_request_ && !buffer_eof_ &&
+                   (buffer_.empty() || (frame_flush_ && static_cast<int>(buffer_.size()) < start_level))) {
+                buffer_cond_.wait_for(lock, boost::chrono::milliseconds(20));
+            }
+        }
+        if (buffer_.empty() || (frame_flush_ && static_cast<int>(buffer_.size()) < start_level)) {
             if (buffer_eof_) {
                 frame_eof_ = true;
                 return core::draw_frame::still(frame_);
             }
+            if (live_ && !frame_flush_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "duplicate-frame");
+                return core::draw_frame::still(frame_);
+            }
+            if (scrubbing_ && frame_) {
+                return core::draw_frame::still(frame_);
+            }
             graph_->set_tag(diagnostics::tag_severity::WARNING, "underflow");
             latency_ += 1;
+            if (!frame_flush_) {
+                grow_buffer();
+            }
             return core::draw_frame{};
         }
 
@@ -787,34 +1366,138 @@ struct AVProducer::Impl
             latency_ = -1;
         }
 
+        if (live_ && !frame_flush_ && !compensate_drift()) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "duplicate-frame");
+            return core::draw_frame::still(frame_);
+        }
+
         frame_          = buffer_[0].frame;
         frame_time_     = buffer_[0].pts;
         frame_duration_ = buffer_[0].duration;
         frame_flush_    = false;
         frame_eof_      = false;
 
+        if (live_) {
+            live_latency_ = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                                  buffer_[0].decoded)
+                                .count();
+        }
+
+        account(-frame_bytes(buffer_[0]));
         buffer_.pop_front();
         buffer_cond_.notify_all();
 
+        shrink_buffer();
+
         graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
 
+        if (!first_drawn_.exchange(true)) {
+            load_time("first-upload", since_requested());
+        }
+
         return frame_;
     }
 
+    // The source and channel clocks drift apart, which slowly fills or drains the jitter buffer. Once it has stayed
+    // outside a quarter of its level around live_frames_ for a second, a frame is dropped or shown twice. Returns
+    // false when the current frame should be repeated. Called with buffer_mutex_ held.
+    bool compensate_drift()
+    {
+        const auto size   = static_cast<int>(buffer_.size());
+        const auto margin = std::max(1, live_frames_ / 4);
+        if (size > live_frames_ + margin) {
+            live_drift_ = std::max(0, live_drift_) + 1;
+        } else if (size < live_frames_ - margin) {
+            live_drift_ = std::min(0, live_drift_) - 1;
+        } else {
+            live_drift_ = 0;
+        }
+
+        if (live_drift_ >= static_cast<int>(format_desc_.fps) && size > 1) {
+            live_drift_ = 0;
+            account(-frame_bytes(buffer_[0]));
+            buffer_.pop_front();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        } else if (live_drift_ <= -static_cast<int>(format_desc_.fps) && frame_) {
+            live_drift_ = 0;
+            return false;
+        }
+        return true;
+    }
+
+    // Adaptive policy, used when buffer_max_ > buffer_min_. Playback underflows grow the buffer by half, while a
+    // buffer that stays more than half full for 10 seconds gives back one frame at a time. Called with buffer_mutex_
+    // held.
+    void grow_buffer()
+    {
+        buffer_headroom_ = 0;
+        if (buffer_capacity_ < buffer_max_) {
+            buffer_capacity_ = std::min(buffer_max_, buffer_capacity_ + std::max(1, buffer_capacity_ / 2));
+            buffer_cond_.notify_all();
+        }
+    }
+
+    void shrink_buffer()
+    {
+        if (buffer_capacity_ <= buffer_min_) {
+            return;
+        }
+
+        buffer_headroom_ = static_cast<int>(buffer_.size()) > buffer_capacity_ / 2 ? buffer_headroom_ + 1 : 0;
+        if (buffer_headroom_ >= static_cast<int>(format_desc_.fps * 10)) {
+            buffer_capacity_ -= 1;
+            buffer_headroom_ = 0;
+        }
+    }
+
     void seek(int64_t time)
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
-        seek_ = av_rescale_q(time, format_tb_, TIME_BASE_Q);
+        scrub_     = false;
+        scrubbing_ = false;
+        seek_      = av_rescale_q(time, format_tb_, TIME_BASE_Q);
 
-        {
-            boost::lock_guard<boost::mutex> lock(buffer_mutex_);
-            buffer_.clear();
-            buffer_cond_.notify_all();
-            graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+        clear_buffer();
+        wake();
+    }
+
+    void scrub(int64_t time, int latency)
+    {
+        CASPAR_SCOPE_EXIT { update_state(); };
+
+        speed_         = 1.0;
+        scrub_latency_ = std::max(0, latency);
+        scrubbing_     = true;
+        scrub_         = true;
+        seek_          = av_rescale_q(time, format_tb_, TIME_BASE_Q);
+
+        clear_buffer();
+        wake();
+    }
+
+    // Changing speed restarts decoding at the frame shown.
+    void speed(double speed)
+    {
+        if (speed_.exchange(speed) != speed) {
+            seek(time());
         }
     }
 
+    double speed() const { return speed_; }
+
+    // Audio is only decoded when it can be heard and plays forward at normal speed.
+    bool decode_audio() const { return audible_ && direction_ > 0 && rate_ == 1.0; }
+
+    void clear_buffer()
+    {
+        boost::lock_guard<boost::mutex> lock(buffer_mutex_);
+        account(-buffer_bytes_);
+        buffer_.clear();
+        buffer_cond_.notify_all();
+        graph_->set_value("buffer", static_cast<double>(buffer_.size()) / static_cast<double>(buffer_capacity_));
+    }
+
     int64_t time() const
     {
         if (frame_time_ == AV_NOPTS_VALUE) {
@@ -824,7 +1507,7 @@ struct AVProducer::Impl
 
         auto frame_time = frame_time_;
 
-        if (frame_eof_ && frame_duration_ != AV_NOPTS_VALUE) {
+        if (frame_eof_ && frame_duration_ != AV_NOPTS_VALUE && speed_ > 0) {
             frame_time += frame_duration_;
         }
 
@@ -836,6 +1519,7 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         loop_ = loop;
+        wake();
     }
 
     bool loop() const { return loop_; }
@@ -845,6 +1529,7 @@ struct AVProducer::Impl
         CASPAR_SCOPE_EXIT { update_state(); };
 
         start_ = av_rescale_q(start, format_tb_, TIME_BASE_Q);
+        wake();
     }
 
     boost::optional<int64_t> start() const
@@ -857,7 +1542,9 @@ struct AVProducer::Impl
     {
         CASPAR_SCOPE_EXIT { update_state(); };
 
-        duration_ = av_rescale_q(duration, format_tb_, TIME_BASE_Q);
+        growing_duration_ = false;
+        duration_         = av_rescale_q(duration, format_tb_, TIME_BASE_Q);
+        wake();
     }
 
     boost::optional<int64_t> duration() const
@@ -896,9 +1583,12 @@ struct AVProducer::Impl
             if (!packet) {
                 for (auto& p : decoders_) {
                     if (!p.second.eof) {
-                        p.second.input.push(nullptr);
+                        p.second.push(nullptr);
                     }
                 }
+                if (growing_duration_.exchange(false)) {
+                    duration_ = input_duration_.load();
+                }
                 result = true;
             } else if (sources_.find(packet->stream_index) != sources_.end()) {
                 auto it = decoders_.find(packet->stream_index);
@@ -906,16 +1596,47 @@ struct AVProducer::Impl
                     return true;
                 }
 
-                // TODO (fix): limit it->second.input.size()?
+                // Badly interleaved files run one queue far ahead of the others. A full queue holds back reading
+                // until a decoder runs dry, then its packets are dropped rather than stalling playback.
+                auto& decoder = it->second;
+                if (static_cast<int>(decoder.input.size()) >= decoder_packets_ ||
+                    decoder.input_bytes >= decoder_bytes_) {
+                    const auto starving = std::any_of(decoders_.begin(), decoders_.end(), [](const auto& p) {
+                        return !p.second.eof && !p.second.frame && p.second.input.empty();
+                    });
+                    if (!starving) {
+                        return false;
+                    }
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-packet");
+                    return true;
+                }
 
                 result = true;
 
-                it->second.input.push(std::move(packet));
+                if (decoder.ctx->codec_type == AVMEDIA_TYPE_VIDEO && (packet->flags & AV_PKT_FLAG_KEY)) {
+                    learn_keyframe(packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts, decoder.st->time_base);
+                }
+
+                if (growing_duration_ && packet->pts != AV_NOPTS_VALUE) {
+                    const auto start = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
+                    const auto end =
+                        av_rescale_q(packet->pts + packet->duration, decoder.st->time_base, TIME_BASE_Q) - start;
+                    if (end > input_duration_) {
+                        input_duration_ = end;
+                    }
+                }
+
+                decoder.push(std::move(packet));
             }
 
             return true;
         });
 
+        for (auto& p : decoders_) {
+            graph_->set_value("packets-" + std::to_string(p.first),
+                              static_cast<double>(p.second.input.size()) / static_cast<double>(decoder_packets_));
+        }
+
         std::vector<int> eof;
 
         for (auto& p : sources_) {
@@ -926,7 +1647,9 @@ struct AVProducer::Impl
 
             auto nb_requests = 0U;
             for (auto source : p.second) {
-                nb_requests = std::max(nb_requests, av_buffersrc_get_nb_failed_requests(source));
+                nb_requests = std::max(nb_requests,
+                                       source ? av_buffersrc_get_nb_failed_requests(source)
+                                              : video_filter_.direct_input ? 0U : 1U);
             }
 
             if (nb_requests == 0) {
@@ -936,7 +1659,9 @@ struct AVProducer::Impl
             auto frame = std::move(it->second.frame);
 
             for (auto& source : p.second) {
-                if (frame && !frame->data[0]) {
+                if (!source) {
+                    video_filter_.send(frame);
+                } else if (frame && !frame->data[0]) {
                     FF(av_buffersrc_close(source, frame->pts, 0));
                 } else {
                     // TODO (fix) Guard against overflow?
@@ -958,26 +1683,231 @@ struct AVProducer::Impl
         return result;
     }
 
-    void seek_internal(int64_t time)
+    // Scrub targets within the latency of the previous one seek to the keyframe before them if it is known and close,
+    // only that keyframe is then decoded until the target moves or settles, see run().
+    void scrub_internal(int64_t target)
+    {
+        const auto now  = std::chrono::steady_clock::now();
+        const auto fast = now - scrub_last_ < std::chrono::milliseconds(scrub_latency_.load());
+        scrub_last_     = now;
+        scrub_hold_     = false;
+        scrub_target_   = AV_NOPTS_VALUE;
+
+        auto key = keyframes_.upper_bound(target);
+        if (fast && key != keyframes_.begin() && *std::prev(key) != target &&
+            target - *std::prev(key) <= gop_duration_ * 2) {
+            scrub_target_ = target;
+            seek_internal(*std::prev(key));
+        } else {
+            seek_internal(target);
+        }
+    }
+
+    void reverse_from(int64_t end)
+    {
+        gop_.clear();
+        gop_decoding_ = false;
+        gop_end_      = end;
+        gop_back_     = 1;
+        buffer_eof_   = false;
+        frame_flush_  = true;
+        seek_timer_.restart();
+        seek_pending_ = true;
+    }
+
+    // Plays the GOP before gop_end_ from the cache or starts decoding it. Returns false at the start of the clip.
+    bool reverse_step()
+    {
+        const auto start = start_ != AV_NOPTS_VALUE ? start_.load() : 0;
+        if (gop_end_ <= start) {
+            const auto duration = duration_.load();
+            if (!loop_ || duration == AV_NOPTS_VALUE) {
+                buffer_eof_ = true;
+                return false;
+            }
+            gop_end_ = start + duration;
+        }
+        buffer_eof_ = false;
+
+        auto cached = gops_.lower_bound(gop_end_);
+        if (cached != gops_.begin()) {
+            auto& frames = std::prev(cached)->second;
+            if (frames.back().pts + frames.back().duration >= gop_end_) {
+                play_reversed(frames);
+                return true;
+            }
+        }
+
+        // Without a keyframe known close before the end, a GOP's length is guessed and doubled until it finds frames.
+        const auto guess = gop_end_ - gop_duration_ * gop_back_;
+        auto       key   = keyframes_.lower_bound(gop_end_);
+        gop_start_       = key != keyframes_.begin() && *std::prev(key) >= guess ? *std::prev(key) : guess;
+        gop_start_       = std::max(gop_start_, start);
+
+        gop_.clear();
+        gop_decoding_ = true;
+        seek_internal(gop_start_, false);
+        return true;
+    }
+
+    void finish_gop()
+    {
+        gop_decoding_ = false;
+
+        if (gop_.empty()) {
+            const auto start = start_ != AV_NOPTS_VALUE ? start_.load() : 0;
+            if (gop_start_ <= start) {
+                gop_end_ = start;
+            } else {
+                gop_back_ *= 2;
+            }
+            return;
+        }
+        gop_back_ = 1;
+
+        const auto key = gop_.front().pts;
+        for (auto& frame : gop_) {
+            gops_held_.add(static_cast<int64_t>(core::image_bytes(frame.frame)));
+        }
+        for (auto& frame : gops_[key]) {
+            gops_held_.add(-static_cast<int64_t>(core::image_bytes(frame.frame)));
+        }
+        gops_[key] = std::move(gop_);
+        gop_.clear();
+
+        // The GOPs furthest from where playback is are dropped first, never the one just decoded.
+        while (static_cast<int>(gops_.size()) > std::max(1, gop_cache_size_)) {
+            auto first = gops_.begin();
+            auto last  = std::prev(gops_.end());
+            auto it    = first->first != key && (last->first == key || gop_end_ - first->first > last->first - gop_end_)
+                             ? first
+                             : last;
+            for (auto& frame : it->second) {
+                gops_held_.add(-static_cast<int64_t>(core::image_bytes(frame.frame)));
+            }
+            gops_.erase(it);
+        }
+
+        play_reversed(gops_[key]);
+    }
+
+    // Pushes the frames before gop_end_ last first, then moves gop_end_ to the first of them.
+    void play_reversed(const std::vector<Frame>& frames)
+    {
+        for (auto it = frames.rbegin(); it != frames.rend() && !abort_request_; ++it) {
+            if (seek_ != AV_NOPTS_VALUE) {
+                return;
+            }
+            if (it->pts >= gop_end_) {
+                continue;
+            }
+            push(*it);
+            gop_end_ = it->pts;
+        }
+        gop_end_ = std::min(gop_end_, frames.front().pts);
+
+        if (seek_pending_) {
+            seek_pending_ = false;
+            graph_->set_value("seek-time", seek_timer_.elapsed() * format_desc_.fps * 0.5);
+            boost::lock_guard<boost::mutex> lock(state_mutex_);
+            state_["seek/latency"] = seek_timer_.elapsed() * 1000.0;
+        }
+    }
+
+    void learn_keyframe(int64_t ts, AVRational time_base)
+    {
+        if (ts == AV_NOPTS_VALUE) {
+            return;
+        }
+
+        const auto start_time = input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0;
+        const auto pts        = av_rescale_q(ts, time_base, TIME_BASE_Q) - start_time;
+
+        auto it = keyframes_.insert(pts).first;
+        if (it != keyframes_.begin() && pts - *std::prev(it) < 10 * AV_TIME_BASE) {
+            gop_duration_ = std::max<int64_t>(1, pts - *std::prev(it));
+        }
+    }
+
+    // Without flush the frames buffered so far are played before those from time, for restarting where decoding is.
+    void seek_internal(int64_t time, bool flush = true)
     {
         time = time != AV_NOPTS_VALUE ? time : 0;
         time = time + (input_->start_time != AV_NOPTS_VALUE ? input_->start_time : 0);
 
+        if (flush) {
+            seek_timer_.restart();
+            seek_pending_ = true;
+            frame_flush_  = true;
+        }
+
         // TODO (fix) Dont seek if time is close future.
         input_.seek(time);
-        frame_flush_ = true;
         frame_count_ = 0;
         buffer_eof_  = false;
 
-        decoders_.clear();
+        // Reopening decoders dominates the cost of looping short clips, keep them while their stream is unchanged.
+        for (auto it = decoders_.begin(); it != decoders_.end();) {
+            auto st = it->first < static_cast<int>(input_->nb_streams) ? input_->streams[it->first] : nullptr;
+            if (st && st == it->second.st && st->codecpar->codec_id == it->second.ctx->codec_id) {
+                it->second.flush();
+                ++it;
+            } else {
+                it = decoders_.erase(it);
+            }
+        }
 
+        // The filter graphs are rebuilt, they carry the start time and end of stream state of the previous run.
         reset(time);
+
+        if (seek_skip_) {
+            for (auto& p : decoders_) {
+                if (p.second.ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                    p.second.skip_until = av_rescale_q(time, TIME_BASE_Q, p.second.st->time_base);
+                }
+            }
+        }
     }
 
     void reset(int64_t start_time)
     {
-        video_filter_ = Filter(vfilter_, input_, decoders_, start_time, AVMEDIA_TYPE_VIDEO, format_desc_);
-        audio_filter_ = Filter(afilter_, input_, decoders_, start_time, AVMEDIA_TYPE_AUDIO, format_desc_);
+        caspar::timer filter_timer;
+
+        video_filter_ = Filter(vfilter_,
+                               input_,
+                               decoders_,
+                               start_time,
+                               AVMEDIA_TYPE_VIDEO,
+                               format_desc_,
+                               hwaccel_,
+                               frame_factory_.get(),
+                               this,
+                               key_path_,
+                               rate_,
+                               blend_);
+        // Without a graph the audio filter is at its end right away, its streams are then neither read nor decoded.
+        audio_filter_ = audio_ ? Filter(afilter_,
+                                        input_,
+                                        decoders_,
+                                        start_time,
+                                        AVMEDIA_TYPE_AUDIO,
+                                        format_desc_,
+                                        hwaccel_,
+                                        frame_factory_.get(),
+                                        this)
+                               : Filter();
+
+        if (!loaded_) {
+            loaded_                 = true;
+            const auto decoder_time = video_filter_.decoder_time + audio_filter_.decoder_time;
+            load_time("decoders", decoder_time * 1000.0);
+            load_time("filters", (filter_timer.elapsed() - decoder_time) * 1000.0);
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(state_mutex_);
+            state_["video/unfiltered"] = video_filter_.direct;
+        }
 
         sources_.clear();
         for (auto& p : video_filter_.sources) {
@@ -998,6 +1928,52 @@ struct AVProducer::Impl
         for (auto& key : keys) {
             decoders_.erase(key);
         }
+
+        // Streams no filter graph maps are not worth reading, e.g. the unused mono tracks of an MXF.
+        std::set<int> active;
+        for (auto& p : sources_) {
+            active.insert(p.first);
+        }
+        input_.select(active);
+
+        {
+            boost::lock_guard<boost::mutex> lock(state_mutex_);
+            for (auto n = 0U; n < input_->nb_streams; ++n) {
+                state_["file/streams/" + std::to_string(n) + "/active"] = active.count(static_cast<int>(n)) > 0;
+            }
+            for (auto& p : decoders_) {
+                const auto& ctx    = p.second.ctx;
+                const auto  prefix = "file/streams/" + std::to_string(p.first);
+                const auto  type   = ctx->active_thread_type == FF_THREAD_FRAME   ? "frame"
+                                     : ctx->active_thread_type == FF_THREAD_SLICE ? "slice"
+                                                                                  : "none";
+
+                state_[prefix + "/codec"]   = std::string(ctx->codec ? ctx->codec->name : "unknown");
+                state_[prefix + "/threads"] = {ctx->thread_count, std::string(type)};
+                if (ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+                    state_[prefix + "/size"] = {ctx->width, ctx->height};
+                }
+            }
+        }
+    }
+
+    double since_requested() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requested_).count();
+    }
+
+    // Milliseconds of a load phase, or until a first, see AVProducer::state.
+    void load_time(const std::string& name, double ms)
+    {
+        boost::lock_guard<boost::mutex> lock(state_mutex_);
+        state_["load/" + name] = ms;
+    }
+
+    static bool is_live(const std::string& path)
+    {
+        static const std::set<std::wstring> LIVE_PROTOCOLS = {
+            L"srt", L"udp", L"rtp", L"rtmp", L"rtmps", L"rtsp", L"tcp"};
+        return LIVE_PROTOCOLS.find(protocol_split(u16(path)).first) != LIVE_PROTOCOLS.end();
     }
 
     std::string print() const
@@ -1010,15 +1986,24 @@ struct AVProducer::Impl
     }
 };
 
-AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
-                       core::video_format_desc              format_desc,
-                       std::string                          name,
-                       std::string                          path,
-                       boost::optional<std::string>         vfilter,
-                       boost::optional<std::string>         afilter,
-                       boost::optional<int64_t>             start,
-                       boost::optional<int64_t>             duration,
-                       boost::optional<bool>                loop)
+AVProducer::AVProducer(std::shared_ptr<core::frame_factory>  frame_factory,
+                       core::video_format_desc               format_desc,
+                       std::string                           name,
+                       std::string                           path,
+                       boost::optional<std::string>          vfilter,
+                       boost::optional<std::string>          afilter,
+                       boost::optional<int64_t>              start,
+                       boost::optional<int64_t>              duration,
+                       boost::optional<bool>                 loop,
+                       boost::optional<std::string>          hwaccel,
+                       boost::optional<int>                  buffer_min,
+                       boost::optional<int>                  buffer_max,
+                       boost::optional<int>                  latency,
+                       boost::optional<std::string>          key_path,
+                       boost::optional<double>               speed,
+                       boost::optional<bool>                 blend,
+                       boost::optional<bool>                 growing,
+                       std::chrono::steady_clock::time_point requested)
     : impl_(new Impl(std::move(frame_factory),
                      std::move(format_desc),
                      std::move(name),
@@ -1027,7 +2012,16 @@ AVProducer::AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
                      std::move(afilter.get_value_or("")),
                      std::move(start),
                      std::move(duration),
-                     std::move(loop.get_value_or(false))))
+                     std::move(loop.get_value_or(false)),
+                     std::move(hwaccel.get_value_or("")),
+                     buffer_min.get_value_or(0),
+                     buffer_max.get_value_or(0),
+                     latency.get_value_or(0),
+                     std::move(key_path.get_value_or("")),
+                     speed.get_value_or(1.0),
+                     blend.get_value_or(false),
+                     growing.get_value_or(false),
+                     requested))
 {
 }
 
@@ -1041,6 +2035,44 @@ AVProducer& AVProducer::seek(int64_t time)
     return *this;
 }
 
+AVProducer& AVProducer::active(bool active)
+{
+    impl_->active(active);
+    return *this;
+}
+
+AVProducer& AVProducer::prefetch(int frames)
+{
+    impl_->prefetch(frames);
+    return *this;
+}
+
+AVProducer& AVProducer::pull(bool pull)
+{
+    impl_->pull(pull);
+    return *this;
+}
+
+AVProducer& AVProducer::audible(bool audible)
+{
+    impl_->audible(audible);
+    return *this;
+}
+
+AVProducer& AVProducer::speed(double speed)
+{
+    impl_->speed(speed);
+    return *this;
+}
+
+double AVProducer::speed() const { return impl_->speed(); }
+
+AVProducer& AVProducer::scrub(int64_t time, int latency)
+{
+    impl_->scrub(time, latency);
+    return *this;
+}
+
 AVProducer& AVProducer::loop(bool loop)
 {
     impl_->loop(loop);
@@ -6,6 +6,7 @@
 
 #include <boost/optional.hpp>
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -14,22 +15,51 @@ namespace caspar { namespace ffmpeg {
 class AVProducer
 {
   public:
-    AVProducer(std::shared_ptr<core::frame_factory> frame_factory,
-               core::video_format_desc              format_desc,
-               std::string                          name,
-               std::string                          path,
-               boost::optional<std::string>         vfilter,
-               boost::optional<std::string>         afilter,
-               boost::optional<int64_t>             start,
-               boost::optional<int64_t>             duration,
-               boost::optional<bool>                loop);
+    AVProducer(std::shared_ptr<core::frame_factory>  frame_factory,
+               core::video_format_desc               format_desc,
+               std::string                           name,
+               std::string                           path,
+               boost::optional<std::string>          vfilter,
+               boost::optional<std::string>          afilter,
+               boost::optional<int64_t>              start,
+               boost::optional<int64_t>              duration,
+               boost::optional<bool>                 loop,
+               boost::optional<std::string>          hwaccel    = boost::none,
+               boost::optional<int>                  buffer_min = boost::none,
+               boost::optional<int>                  buffer_max = boost::none,
+               boost::optional<int>                  latency    = boost::none,
+               boost::optional<std::string>          key_path   = boost::none,
+               boost::optional<double>               speed      = boost::none,
+               boost::optional<bool>                 blend      = boost::none,
+               boost::optional<bool>                 growing    = boost::none,
+               std::chrono::steady_clock::time_point requested  = std::chrono::steady_clock::now());
 
     core::draw_frame prev_frame();
     core::draw_frame next_frame();
 
+    // A producer becomes active on its first next_frame, inactive ones only decode prefetch frames ahead.
+    AVProducer& active(bool active);
+    AVProducer& prefetch(int frames);
+
+    // next_frame waits for frames that have not been decoded yet instead of underflowing, for channels that render
+    // offline. Live sources are not waited for.
+    AVProducer& pull(bool pull);
+
+    // Audio is not decoded while the producer cannot be heard. Frames are then delivered without audio.
+    AVProducer& audible(bool audible);
+
     AVProducer& seek(int64_t time);
     int64_t     time() const;
 
+    // 1 plays forward, -1 backwards a GOP at a time and without audio. Other positive speeds pick the source frame for
+    // each channel frame by its time, also without audio. With blend the frame after it is mixed in by the mixer.
+    AVProducer& speed(double speed);
+    double      speed() const;
+
+    // Seeks to time for scrubbing. While targets follow each other within latency milliseconds only the keyframe
+    // before each is decoded, the target itself once it has been still for that long. Playback then goes on forward.
+    AVProducer& scrub(int64_t time, int latency);
+
     AVProducer& loop(bool loop);
     bool        loop() const;
 
@@ -39,6 +69,9 @@ class AVProducer
     AVProducer& duration(int64_t duration);
     int64_t     duration() const;
 
+    // Load times in milliseconds are under load/: open, probe, decoders and filters are the phases of opening the file,
+    // first-decode, first-frame and first-upload the time from requested until the first frame was decoded, buffered
+    // and handed to the channel, whose mixer uploads it as it draws it.
     caspar::core::monitor::state state() const;
 
   private:
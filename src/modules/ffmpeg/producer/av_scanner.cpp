@@ -0,0 +1,604 @@
+#include "av_scanner.h"
+
+#include "av_decoder.h"
+#include "av_input.h"
+#include "av_probe.h"
+#include "ffmpeg_producer.h"
+
+#include "../util/av_assert.h"
+#include "../util/av_util.h"
+
+#include <common/base64.h>
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/filesystem.h>
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+#include <common/scope_exit.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4244)
+#endif
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+namespace caspar { namespace ffmpeg {
+
+namespace {
+
+const std::set<std::wstring> STILL_EXTENSIONS = {
+    L".png", L".tga", L".bmp", L".jpg", L".jpeg", L".gif", L".tiff", L".tif"};
+
+// Files taking longer than this to deliver a first frame get no thumbnail.
+const auto THUMBNAIL_TIMEOUT = std::chrono::seconds(30);
+
+struct media_info
+{
+    int64_t      size = -1;
+    int64_t      time = -1;
+    std::wstring line; // Empty when the file could not be probed.
+};
+
+bool is_still(const boost::filesystem::path& path)
+{
+    return STILL_EXTENSIONS.count(boost::to_lower_copy(path.extension().wstring())) > 0;
+}
+
+bool is_media(const boost::filesystem::path& path)
+{
+    return is_still(path) || is_valid_file(path.wstring());
+}
+
+std::wstring format_time(int64_t time, const wchar_t* format)
+{
+    const auto t = static_cast<std::time_t>(time);
+    std::tm    tm{};
+#ifdef _MSC_VER
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    wchar_t buf[32] = {};
+    std::wcsftime(buf, sizeof(buf) / sizeof(buf[0]), format, &tm);
+    return buf;
+}
+
+// Media names are relative to their folder, without extension, upper case with forward slashes.
+std::wstring media_name(const boost::filesystem::path& path, const boost::filesystem::path& folder)
+{
+    auto name = get_relative_without_extension(path, folder).generic_wstring();
+    if (!name.empty() && (name[0] == L'\\' || name[0] == L'/')) {
+        name = name.substr(1);
+    }
+    return boost::to_upper_copy(name);
+}
+
+boost::filesystem::path thumbnail_folder()
+{
+    auto folder =
+        boost::filesystem::path(env::properties().get(L"configuration.paths.thumbnail-path", L"thumbnail/"));
+    if (folder.is_relative()) {
+        folder = boost::filesystem::path(env::initial_folder()) / folder;
+    }
+    return folder;
+}
+
+std::vector<boost::filesystem::path> list_media()
+{
+    std::vector<boost::filesystem::path> result;
+
+    boost::system::error_code ec;
+    for (boost::filesystem::recursive_directory_iterator it(env::media_folder(), ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (boost::filesystem::is_regular_file(it->path(), ec) && is_media(it->path())) {
+            result.push_back(it->path());
+        }
+    }
+    return result;
+}
+
+boost::filesystem::path find_media(const std::wstring& name)
+{
+    const auto stem   = boost::filesystem::path(env::media_folder() + L"/" + name);
+    const auto parent = find_case_insensitive(stem.parent_path().wstring());
+    if (!parent) {
+        return boost::filesystem::path();
+    }
+
+    for (auto& entry : list_directory(*parent)) {
+        if (boost::iequals(entry.stem().wstring(), stem.filename().wstring()) && is_media(entry)) {
+            return entry;
+        }
+    }
+    return boost::filesystem::path();
+}
+
+std::shared_ptr<Input> open_input(const boost::filesystem::path& path)
+{
+    auto input = std::make_shared<Input>(u8(path.wstring()), spl::shared_ptr<diagnostics::graph>());
+    input->reset();
+    return input;
+}
+
+// The CINF line, "NAME" TYPE size yyyyMMddHHmmss frames timebase.
+std::wstring probe(Input& input, const boost::filesystem::path& path, const std::wstring& name, const media_info& info)
+{
+    const auto video = av_find_best_stream(input.operator->(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    const auto audio = av_find_best_stream(input.operator->(), AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+
+    const auto has_video = video >= 0 && !(input->streams[video]->disposition & AV_DISPOSITION_ATTACHED_PIC);
+
+    std::wstring type;
+    AVRational   rate     = {25, 1};
+    int64_t      duration = input->duration != AV_NOPTS_VALUE ? input->duration : 0;
+    if (is_still(path)) {
+        type     = L"STILL";
+        rate     = {0, 1};
+        duration = 0;
+    } else if (has_video) {
+        type               = L"MOVIE";
+        const auto guessed = av_guess_frame_rate(input.operator->(), input->streams[video], nullptr);
+        rate               = guessed.num > 0 && guessed.den > 0 ? guessed : rate;
+    } else if (audio >= 0) {
+        type = L"AUDIO";
+    } else {
+        return L"";
+    }
+
+    const auto frames =
+        rate.num > 0 ? av_rescale(duration, rate.num, static_cast<int64_t>(rate.den) * AV_TIME_BASE) : 0;
+
+    std::wostringstream line;
+    line << L"\"" << name << L"\" " << type << L" " << info.size << L" " << format_time(info.time, L"%Y%m%d%H%M%S")
+         << L" " << frames << L" " << (rate.num > 0 ? rate.den : 0) << L"/" << std::max(rate.num, 1);
+    return line.str();
+}
+
+// Decodes the first picture of the best video stream, nullptr if there is none.
+std::shared_ptr<AVFrame> first_frame(Input& input, AVHWDeviceType hwaccel, const std::atomic<bool>& abort)
+{
+    const auto index = av_find_best_stream(input.operator->(), AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (index < 0) {
+        return nullptr;
+    }
+    input.select({index});
+
+    Decoder decoder(input->streams[index], hwaccel);
+
+    std::mutex              mutex;
+    std::condition_variable cond;
+    bool                    ready = false;
+
+    input.on_read([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready = true;
+        cond.notify_all();
+    });
+    CASPAR_SCOPE_EXIT { input.on_read(nullptr); };
+
+    const auto deadline = std::chrono::steady_clock::now() + THUMBNAIL_TIMEOUT;
+    while (!abort && std::chrono::steady_clock::now() < deadline) {
+        input([&](std::shared_ptr<AVPacket>& packet) {
+            if (decoder.input_bytes > 16 * 1024 * 1024) {
+                return false;
+            }
+            if (!packet || packet->stream_index == index) {
+                decoder.push(std::move(packet));
+            }
+            return true;
+        });
+
+        while (decoder()) {
+            if (decoder.frame) {
+                // The end of file marker carries no picture.
+                return decoder.eof ? nullptr : decoder.frame;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait_for(lock, std::chrono::milliseconds(100), [&] { return ready; });
+        ready = false;
+    }
+    return nullptr;
+}
+
+// Scales frame to width, keeping its display aspect, and encodes it as PNG.
+std::vector<char> encode_png(const std::shared_ptr<AVFrame>& frame, int width)
+{
+    auto aspect = frame->sample_aspect_ratio.num > 0 ? av_q2d(frame->sample_aspect_ratio) : 1.0;
+    width       = std::max(2, std::min(width, static_cast<int>(frame->width * aspect + 0.5)));
+    auto height = std::max(2, static_cast<int>(width * frame->height / (frame->width * aspect) + 0.5));
+
+    auto sws = std::shared_ptr<SwsContext>(sws_getContext(frame->width,
+                                                          frame->height,
+                                                          static_cast<AVPixelFormat>(frame->format),
+                                                          width,
+                                                          height,
+                                                          AV_PIX_FMT_RGB24,
+                                                          SWS_BICUBIC,
+                                                          nullptr,
+                                                          nullptr,
+                                                          nullptr),
+                                           [](SwsContext* ptr) { sws_freeContext(ptr); });
+    if (!sws) {
+        CASPAR_THROW_EXCEPTION(ffmpeg_error_t() << boost::errinfo_errno(EINVAL) << msg_info_t("sws_getContext failed"));
+    }
+
+    auto rgb    = alloc_frame();
+    rgb->format = AV_PIX_FMT_RGB24;
+    rgb->width  = width;
+    rgb->height = height;
+    FF(av_frame_get_buffer(rgb.get(), 0));
+    sws_scale(sws.get(), frame->data, frame->linesize, 0, frame->height, rgb->data, rgb->linesize);
+
+    const auto codec = avcodec_find_encoder(AV_CODEC_ID_PNG);
+    if (!codec) {
+        FF_RET(AVERROR_ENCODER_NOT_FOUND, "avcodec_find_encoder");
+    }
+
+    auto ctx = std::shared_ptr<AVCodecContext>(avcodec_alloc_context3(codec),
+                                               [](AVCodecContext* ptr) { avcodec_free_context(&ptr); });
+    if (!ctx) {
+        FF_RET(AVERROR(ENOMEM), "avcodec_alloc_context3");
+    }
+    ctx->width     = width;
+    ctx->height    = height;
+    ctx->pix_fmt   = AV_PIX_FMT_RGB24;
+    ctx->time_base = {1, 25};
+    FF(avcodec_open2(ctx.get(), codec, nullptr));
+
+    FF(avcodec_send_frame(ctx.get(), rgb.get()));
+    auto packet = alloc_packet();
+    FF(avcodec_receive_packet(ctx.get(), packet.get()));
+
+    return std::vector<char>(packet->data, packet->data + packet->size);
+}
+
+bool write_file(const boost::filesystem::path& path, const std::vector<char>& data)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(path.parent_path(), ec);
+
+    // Written aside and renamed, so THUMBNAIL RETRIEVE never sees a partial image.
+    auto tmp = path;
+    tmp += L".tmp";
+    {
+        boost::filesystem::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        if (!file) {
+            return false;
+        }
+    }
+    boost::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        boost::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+struct AVScanner::Impl
+{
+    const boost::filesystem::path media_folder_     = env::media_folder();
+    const boost::filesystem::path thumbnail_folder_ = thumbnail_folder();
+    const int                     thumbnail_width_;
+    const AVHWDeviceType          hwaccel_;
+
+    std::mutex                         cache_mutex_;
+    std::map<std::wstring, media_info> cache_;
+
+    std::mutex                        mutex_;
+    std::condition_variable           cond_;
+    std::deque<std::function<void()>> tasks_;
+    std::set<std::wstring>            pending_thumbnails_;
+    std::atomic<bool>                 abort_request_{false};
+    std::vector<std::thread>          threads_;
+
+    Impl()
+        : thumbnail_width_(env::properties().get(L"configuration.ffmpeg.scanner.thumbnail-width", 256))
+        , hwaccel_(av_hwdevice_find_type_by_name(u8(hwaccel_name()).c_str()))
+    {
+        const auto count = std::max(1, env::properties().get(L"configuration.ffmpeg.scanner.threads", 2));
+        for (auto n = 0; n < count; ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"[ffmpeg::av_scanner]");
+                set_thread_low_priority();
+                run();
+            });
+        }
+    }
+
+    static std::wstring hwaccel_name()
+    {
+        const auto producer = env::properties().get(L"configuration.ffmpeg.producer.hwaccel", std::wstring(L"none"));
+        return env::properties().get(L"configuration.ffmpeg.scanner.hwaccel", producer);
+    }
+
+    ~Impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+            tasks_.clear();
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void run()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_request_ || !tasks_.empty(); });
+                if (abort_request_) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            try {
+                task();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    // Requests somebody waits for jump ahead of queued background work.
+    template <typename Func>
+    auto post(Func&& func, bool urgent)
+    {
+        using result_type = decltype(func());
+
+        auto task   = std::make_shared<std::packaged_task<result_type()>>(std::forward<Func>(func));
+        auto future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (urgent) {
+                tasks_.push_front([task] { (*task)(); });
+            } else {
+                tasks_.push_back([task] { (*task)(); });
+            }
+        }
+        cond_.notify_one();
+        return future;
+    }
+
+    static media_info stat(const boost::filesystem::path& path)
+    {
+        media_info                info;
+        boost::system::error_code ec;
+        info.size = static_cast<int64_t>(boost::filesystem::file_size(path, ec));
+        info.time = static_cast<int64_t>(boost::filesystem::last_write_time(path, ec));
+        if (ec) {
+            info.size = -1;
+        }
+        return info;
+    }
+
+    // Fills in the cached line of path, false if it was not probed since it last changed.
+    bool cached(const boost::filesystem::path& path, media_info& info)
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        auto                        it = cache_.find(path.wstring());
+        if (it == cache_.end() || it->second.size != info.size || it->second.time != info.time) {
+            return false;
+        }
+        info = it->second;
+        return true;
+    }
+
+    media_info info(const boost::filesystem::path& path)
+    {
+        auto info = stat(path);
+        if (info.size < 0 || cached(path, info)) {
+            return info;
+        }
+
+        try {
+            auto input = open_input(path);
+            info.line  = probe(*input, path, media_name(path, media_folder_), info);
+        } catch (...) {
+            CASPAR_LOG(debug) << L"[ffmpeg::av_scanner] Failed to probe " << path.wstring();
+        }
+
+        // Files that fail are remembered too, so they are only retried once they change.
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        cache_[path.wstring()] = info;
+        return info;
+    }
+
+    boost::filesystem::path thumbnail_path(const boost::filesystem::path& path) const
+    {
+        auto result = thumbnail_folder_ / get_relative_without_extension(path, media_folder_);
+        result += L".png";
+        return result;
+    }
+
+    bool thumbnail(const boost::filesystem::path& path)
+    {
+        const auto                dst = thumbnail_path(path);
+        boost::system::error_code ec;
+        const auto                src_time = boost::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return false;
+        }
+        const auto dst_time = boost::filesystem::last_write_time(dst, ec);
+        if (!ec && dst_time >= src_time) {
+            return true;
+        }
+
+        try {
+            auto input = open_input(path);
+            auto frame = first_frame(*input, hwaccel_, abort_request_);
+            if (!frame) {
+                return false;
+            }
+            return write_file(dst, encode_png(frame, thumbnail_width_));
+        } catch (...) {
+            CASPAR_LOG(debug) << L"[ffmpeg::av_scanner] Failed to generate thumbnail of " << path.wstring();
+            return false;
+        }
+    }
+
+    std::wstring cls()
+    {
+        std::vector<std::future<media_info>> infos;
+        for (auto& path : list_media()) {
+            infos.push_back(post([=] { return info(path); }, true));
+        }
+
+        std::wostringstream result;
+        result << L"200 CLS OK\r\n";
+        for (auto& info : infos) {
+            const auto line = info.get().line;
+            if (!line.empty()) {
+                result << line << L"\r\n";
+            }
+        }
+        result << L"\r\n";
+        return result.str();
+    }
+
+    std::wstring cinf(const std::wstring& name)
+    {
+        const auto path = find_media(name);
+        if (path.empty()) {
+            return L"404 CINF ERROR\r\n";
+        }
+        const auto line = post([=] { return info(path); }, true).get().line;
+        if (line.empty()) {
+            return L"";
+        }
+        return L"201 CINF OK\r\n" + line + L"\r\n";
+    }
+
+    std::wstring thumbnail_list()
+    {
+        std::wostringstream result;
+        result << L"200 THUMBNAIL LIST OK\r\n";
+
+        boost::system::error_code ec;
+        for (boost::filesystem::recursive_directory_iterator it(thumbnail_folder_, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            if (!boost::filesystem::is_regular_file(it->path(), ec) ||
+                !boost::iequals(it->path().extension().wstring(), L".png")) {
+                continue;
+            }
+            const auto info = stat(it->path());
+            result << L"\"" << media_name(it->path(), thumbnail_folder_) << L"\" "
+                   << format_time(info.time, L"%Y%m%dT%H%M%S") << L" " << info.size << L"\r\n";
+        }
+        result << L"\r\n";
+        return result.str();
+    }
+
+    std::wstring thumbnail_retrieve(const std::wstring& name)
+    {
+        const auto path = find_media(name);
+        if (path.empty()) {
+            return L"404 THUMBNAIL RETRIEVE ERROR\r\n";
+        }
+
+        boost::filesystem::ifstream file(thumbnail_path(path), std::ios::binary);
+        const std::vector<char>     data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (data.empty()) {
+            return L"404 THUMBNAIL RETRIEVE ERROR\r\n";
+        }
+        return L"201 THUMBNAIL RETRIEVE OK\r\n" + u16(to_base64(data.data(), data.size())) + L"\r\n";
+    }
+
+    std::wstring thumbnail_generate(const std::wstring& name)
+    {
+        const auto path = find_media(name);
+        if (path.empty()) {
+            return L"404 THUMBNAIL GENERATE ERROR\r\n";
+        }
+        if (!post([=] { return thumbnail(path); }, true).get()) {
+            return L"501 THUMBNAIL GENERATE FAILED\r\n";
+        }
+        return L"202 THUMBNAIL GENERATE OK\r\n";
+    }
+
+    std::wstring thumbnail_generate_all()
+    {
+        for (auto& path : list_media()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!pending_thumbnails_.insert(path.wstring()).second) {
+                    continue;
+                }
+            }
+            post(
+                [=] {
+                    CASPAR_SCOPE_EXIT
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        pending_thumbnails_.erase(path.wstring());
+                    };
+                    return thumbnail(path);
+                },
+                false);
+        }
+        return L"202 THUMBNAIL GENERATE_ALL OK\r\n";
+    }
+};
+
+AVScanner::AVScanner()
+    : impl_(new Impl())
+{
+}
+
+AVScanner::~AVScanner() {}
+
+std::wstring AVScanner::cls() { return impl_->cls(); }
+
+std::wstring AVScanner::cinf(const std::wstring& name) { return impl_->cinf(name); }
+
+std::wstring AVScanner::thumbnail_list() { return impl_->thumbnail_list(); }
+
+std::wstring AVScanner::thumbnail_retrieve(const std::wstring& name) { return impl_->thumbnail_retrieve(name); }
+
+std::wstring AVScanner::thumbnail_generate(const std::wstring& name) { return impl_->thumbnail_generate(name); }
+
+std::wstring AVScanner::thumbnail_generate_all() { return impl_->thumbnail_generate_all(); }
+
+}} // namespace caspar::ffmpeg
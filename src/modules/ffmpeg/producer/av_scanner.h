@@ -0,0 +1,30 @@
+#pragma once
+
+#include <core/producer/media_scanner.h>
+
+#include <memory>
+#include <string>
+
+namespace caspar { namespace ffmpeg {
+
+// Probes media and renders thumbnails on a pool of low priority threads, see ffmpeg/scanner. Files are opened through
+// the shared I/O pool after playing producers, and results are kept until the file changes.
+class AVScanner : public core::media_scanner
+{
+  public:
+    AVScanner();
+    ~AVScanner() override;
+
+    std::wstring cls() override;
+    std::wstring cinf(const std::wstring& name) override;
+    std::wstring thumbnail_list() override;
+    std::wstring thumbnail_retrieve(const std::wstring& name) override;
+    std::wstring thumbnail_generate(const std::wstring& name) override;
+    std::wstring thumbnail_generate_all() override;
+
+  private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+}} // namespace caspar::ffmpeg
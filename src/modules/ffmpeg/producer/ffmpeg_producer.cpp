@@ -23,11 +23,16 @@
 
 #include "ffmpeg_producer.h"
 
+#include "av_probe.h"
 #include "av_producer.h"
 
+#include "../util/av_assert.h"
+
 #include <common/env.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
+#include <common/scope_exit.h>
+#include <common/timer.h>
 
 #include <core/frame/draw_frame.h>
 #include <core/frame/frame_factory.h>
@@ -37,8 +42,16 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/logic/tribool.hpp>
+#include <boost/property_tree/ptree.hpp>
 
+#include <chrono>
 #include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #pragma warning(push, 1)
 
@@ -54,40 +67,33 @@ namespace caspar { namespace ffmpeg {
 
 using namespace std::chrono_literals;
 
-struct ffmpeg_producer : public core::frame_producer
+// Decodes a clip once for every producer playing it from the same position, e.g. a background loop on several
+// channels. A producer that changes the timeline or falls out of the shared history continues on its own session.
+class decode_session
 {
-    const std::wstring                   filename_;
-    spl::shared_ptr<core::frame_factory> frame_factory_;
-    core::video_format_desc              format_desc_;
+    struct entry
+    {
+        core::draw_frame frame;
+        int64_t          time;
+    };
 
+    mutable std::mutex          mutex_;
     std::shared_ptr<AVProducer> producer_;
+    const std::size_t           history_size_;
+    std::deque<entry>           history_;
+    int64_t                     first_ = 0;
 
   public:
-    explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory> frame_factory,
-                             core::video_format_desc              format_desc,
-                             std::wstring                         path,
-                             std::wstring                         filename,
-                             std::wstring                         vfilter,
-                             std::wstring                         afilter,
-                             boost::optional<int64_t>             start,
-                             boost::optional<int64_t>             duration,
-                             boost::optional<bool>                loop)
-        : filename_(filename)
-        , frame_factory_(frame_factory)
-        , format_desc_(format_desc)
-        , producer_(new AVProducer(frame_factory_,
-                                   format_desc_,
-                                   u8(path),
-                                   u8(filename),
-                                   u8(vfilter),
-                                   u8(afilter),
-                                   start,
-                                   duration,
-                                   loop))
+    const std::wstring key;
+
+    decode_session(std::shared_ptr<AVProducer> producer, std::size_t history_size, std::wstring key)
+        : producer_(std::move(producer))
+        , history_size_(std::max<std::size_t>(history_size, 2))
+        , key(std::move(key))
     {
     }
 
-    ~ffmpeg_producer()
+    ~decode_session()
     {
         std::thread([producer = std::move(producer_)]() mutable {
             try {
@@ -99,67 +105,306 @@ struct ffmpeg_producer : public core::frame_producer
             .detach();
     }
 
+    // Returns false once cursor has fallen behind the history. An empty frame means the decoder underflowed.
+    bool next(int64_t& cursor, core::draw_frame& frame, int64_t& time)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (cursor < first_) {
+            return false;
+        }
+
+        while (cursor >= first_ + static_cast<int64_t>(history_.size())) {
+            auto next = producer_->next_frame();
+            if (!next) {
+                frame = core::draw_frame{};
+                return true;
+            }
+            history_.push_back(entry{std::move(next), producer_->time()});
+            if (history_.size() > history_size_) {
+                history_.pop_front();
+                first_ += 1;
+            }
+        }
+
+        const auto& entry = history_[cursor - first_];
+        frame             = entry.frame;
+        time              = entry.time;
+        cursor += 1;
+        return true;
+    }
+
+    // New producers only join while the first frame is still in the history, so they start on the same timeline.
+    bool joinable() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return first_ == 0;
+    }
+
+    AVProducer& producer() const { return *producer_; }
+};
+
+std::mutex                                            sessions_mutex;
+std::map<std::wstring, std::weak_ptr<decode_session>> sessions;
+
+std::shared_ptr<decode_session> join_session(const std::wstring&                                 key,
+                                             std::size_t                                         history_size,
+                                             const std::function<std::shared_ptr<AVProducer>()>& factory)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        it = it->second.expired() ? sessions.erase(it) : std::next(it);
+    }
+
+    auto session = sessions[key].lock();
+    if (!session || !session->joinable()) {
+        session       = std::make_shared<decode_session>(factory(), history_size, key);
+        sessions[key] = session;
+    }
+    return session;
+}
+
+// Unregisters session if the caller is its only user, which then may change its timeline.
+bool release_session(const std::shared_ptr<decode_session>& session)
+{
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+
+    if (session.use_count() > 1) {
+        return false;
+    }
+
+    auto it = sessions.find(session->key);
+    if (it != sessions.end() && it->second.lock() == session) {
+        sessions.erase(it);
+    }
+    return true;
+}
+
+struct ffmpeg_producer : public core::frame_producer
+{
+    const std::wstring                   filename_;
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::video_format_desc              format_desc_;
+    const std::wstring                   path_;
+    const std::wstring                   vfilter_;
+    const std::wstring                   afilter_;
+    const boost::optional<int64_t>       start_;
+    const boost::optional<int64_t>       duration_;
+    const boost::optional<bool>          loop_;
+    const std::wstring                   hwaccel_;
+    const int                            buffer_min_;
+    const int                            buffer_max_;
+    const int                            latency_;
+    const std::wstring                   key_path_;
+    const double                         speed_;
+    const bool                           blend_;
+    const bool                           growing_;
+    const bool                           pull_;
+
+    // Milliseconds spent finding the file and its key and until the producer was created, from when it was requested.
+    const double                                resolve_ms_;
+    const std::chrono::steady_clock::time_point requested_;
+    double                                      create_ms_ = 0.0;
+
+    mutable std::mutex              mutex_;
+    std::shared_ptr<decode_session> session_;
+    bool                            shared_  = true;
+    bool                            audible_ = true;
+    int64_t                         cursor_  = 0;
+    int64_t                         time_    = 0;
+    core::draw_frame                last_;
+
+  public:
+    explicit ffmpeg_producer(spl::shared_ptr<core::frame_factory>  frame_factory,
+                             core::video_format_desc               format_desc,
+                             std::wstring                          path,
+                             std::wstring                          filename,
+                             std::wstring                          vfilter,
+                             std::wstring                          afilter,
+                             boost::optional<int64_t>              start,
+                             boost::optional<int64_t>              duration,
+                             boost::optional<bool>                 loop,
+                             std::wstring                          hwaccel,
+                             int                                   buffer_min,
+                             int                                   buffer_max,
+                             int                                   latency,
+                             std::wstring                          key_path,
+                             double                                speed,
+                             bool                                  blend,
+                             bool                                  growing,
+                             bool                                  pull,
+                             double                                resolve_ms,
+                             std::chrono::steady_clock::time_point requested)
+        : filename_(filename)
+        , frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , path_(path)
+        , vfilter_(vfilter)
+        , afilter_(afilter)
+        , start_(start)
+        , duration_(duration)
+        , loop_(loop)
+        , hwaccel_(hwaccel)
+        , buffer_min_(buffer_min)
+        , buffer_max_(buffer_max)
+        , latency_(latency)
+        , key_path_(key_path)
+        , speed_(speed)
+        , blend_(blend)
+        , growing_(growing)
+        , pull_(pull)
+        , resolve_ms_(resolve_ms)
+        , requested_(requested)
+    {
+        auto key = path_ + L"|" + vfilter_ + L"|" + afilter_ + L"|" + (start_ ? std::to_wstring(*start_) : L"") +
+                   L"|" + (duration_ ? std::to_wstring(*duration_) : L"") + L"|" +
+                   std::to_wstring(loop_.get_value_or(false)) + L"|" + hwaccel_ + L"|" + format_desc_.name + L"|" +
+                   std::to_wstring(format_desc_.audio_channels) + L"|" + std::to_wstring(latency_) + L"|" + key_path_ +
+                   L"|" + std::to_wstring(speed_) + L"|" + std::to_wstring(blend_) + L"|" + std::to_wstring(growing_) +
+                   L"|" + std::to_wstring(pull_);
+
+        session_ = join_session(
+            key, static_cast<std::size_t>(format_desc_.fps), [this] { return make_producer(requested_); });
+
+        create_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requested_).count();
+    }
+
+    std::shared_ptr<AVProducer> make_producer(std::chrono::steady_clock::time_point requested) const
+    {
+        auto producer = std::make_shared<AVProducer>(frame_factory_,
+                                                     format_desc_,
+                                                     u8(path_),
+                                                     u8(filename_),
+                                                     u8(vfilter_),
+                                                     u8(afilter_),
+                                                     start_,
+                                                     duration_,
+                                                     loop_,
+                                                     u8(hwaccel_),
+                                                     buffer_min_,
+                                                     buffer_max_,
+                                                     latency_,
+                                                     u8(key_path_),
+                                                     speed_,
+                                                     blend_,
+                                                     growing_,
+                                                     requested);
+        producer->pull(pull_);
+        return producer;
+    }
+
+    // Continues on a session of its own from the current position. Must be called with mutex_ held.
+    void detach()
+    {
+        if (!shared_) {
+            return;
+        }
+        shared_ = false;
+
+        if (release_session(session_)) {
+            return;
+        }
+
+        auto producer = make_producer(std::chrono::steady_clock::now());
+        if (cursor_ > 0) {
+            producer->seek(time_ + 1);
+        }
+        producer->audible(audible_);
+        session_ = std::make_shared<decode_session>(producer, 2, L"");
+        cursor_  = 0;
+    }
+
+    AVProducer& producer() const { return session_->producer(); }
+
     // frame_producer
 
-    core::draw_frame last_frame() override { return producer_->prev_frame(); }
+    core::draw_frame last_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_ ? core::draw_frame::still(last_) : producer().prev_frame();
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
 
-    core::draw_frame receive_impl(int nb_samples) override { return producer_->next_frame(); }
+        core::draw_frame frame;
+        if (!session_->next(cursor_, frame, time_)) {
+            detach();
+            session_->next(cursor_, frame, time_);
+        }
+        if (frame) {
+            last_ = frame;
+        }
+        return frame;
+    }
 
     std::uint32_t frame_number() const override
     {
-        return static_cast<std::uint32_t>(producer_->time() - producer_->start());
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto time = cursor_ > 0 ? time_ : producer().time();
+        return static_cast<std::uint32_t>(time - producer().start());
     }
 
     std::uint32_t nb_frames() const override
     {
-        return producer_->loop() ? std::numeric_limits<std::uint32_t>::max()
-                                 : static_cast<std::uint32_t>(producer_->duration());
+        std::lock_guard<std::mutex> lock(mutex_);
+        return producer().loop() ? std::numeric_limits<std::uint32_t>::max()
+                                 : static_cast<std::uint32_t>(producer().duration());
     }
 
     std::future<std::wstring> call(const std::vector<std::wstring>& params) override
     {
         std::wstring result;
 
+        std::lock_guard<std::mutex> lock(mutex_);
+
         std::wstring cmd = params.at(0);
         std::wstring value;
         if (params.size() > 1) {
             value = params.at(1);
         }
 
+        // Changing the timeline affects every producer on a shared session.
+        if (params.size() > 1) {
+            detach();
+        }
+
         if (boost::iequals(cmd, L"loop")) {
             if (!value.empty()) {
-                producer_->loop(boost::lexical_cast<bool>(value));
+                producer().loop(boost::lexical_cast<bool>(value));
             }
 
-            result = std::to_wstring(producer_->loop());
+            result = std::to_wstring(producer().loop());
         } else if (boost::iequals(cmd, L"in") || boost::iequals(cmd, L"start")) {
             if (!value.empty()) {
-                producer_->start(boost::lexical_cast<int64_t>(value));
+                producer().start(boost::lexical_cast<int64_t>(value));
             }
 
-            result = std::to_wstring(producer_->start());
+            result = std::to_wstring(producer().start());
         } else if (boost::iequals(cmd, L"out")) {
             if (!value.empty()) {
-                producer_->duration(boost::lexical_cast<int64_t>(value) - producer_->start());
+                producer().duration(boost::lexical_cast<int64_t>(value) - producer().start());
             }
 
-            result = std::to_wstring(producer_->start() + producer_->duration());
+            result = std::to_wstring(producer().start() + producer().duration());
         } else if (boost::iequals(cmd, L"length")) {
             if (!value.empty()) {
-                producer_->duration(boost::lexical_cast<std::int64_t>(value));
+                producer().duration(boost::lexical_cast<std::int64_t>(value));
             }
 
-            result = std::to_wstring(producer_->duration());
+            result = std::to_wstring(producer().duration());
         } else if (boost::iequals(cmd, L"seek") && !value.empty()) {
             int64_t seek;
             if (boost::iequals(value, L"rel")) {
-                seek = producer_->time();
+                seek = producer().time();
             } else if (boost::iequals(value, L"in")) {
-                seek = producer_->start();
+                seek = producer().start();
             } else if (boost::iequals(value, L"out")) {
-                seek = producer_->start() + producer_->duration();
+                seek = producer().start() + producer().duration();
             } else if (boost::iequals(value, L"end")) {
-                seek = producer_->duration();
+                seek = producer().duration();
             } else {
                 seek = boost::lexical_cast<int64_t>(value);
             }
@@ -168,9 +413,28 @@ struct ffmpeg_producer : public core::frame_producer
                 seek += boost::lexical_cast<int64_t>(params.at(2));
             }
 
-            producer_->seek(seek);
+            producer().seek(seek);
 
             result = std::to_wstring(seek);
+        } else if (boost::iequals(cmd, L"speed")) {
+            if (!value.empty()) {
+                const auto speed = boost::lexical_cast<double>(value);
+                if (speed != -1.0 && !(speed > 0.0)) {
+                    CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info(L"Speed must be positive or -1"));
+                }
+                producer().speed(speed);
+            }
+
+            result = boost::lexical_cast<std::wstring>(producer().speed());
+        } else if (boost::iequals(cmd, L"scrub") && !value.empty()) {
+            const auto scrub   = boost::lexical_cast<int64_t>(value);
+            const auto latency = params.size() > 2
+                                     ? boost::lexical_cast<int>(params.at(2))
+                                     : env::properties().get(L"configuration.ffmpeg.producer.scrub-latency", 100);
+
+            producer().scrub(scrub, latency);
+
+            result = std::to_wstring(scrub);
         } else {
             CASPAR_THROW_EXCEPTION(invalid_argument());
         }
@@ -182,13 +446,46 @@ struct ffmpeg_producer : public core::frame_producer
 
     std::wstring print() const override
     {
-        return L"ffmpeg[" + filename_ + L"|" + std::to_wstring(producer_->time()) + L"/" +
-               std::to_wstring(producer_->duration()) + L"]";
+        std::lock_guard<std::mutex> lock(mutex_);
+        return L"ffmpeg[" + filename_ + L"|" + std::to_wstring(producer().time()) + L"/" +
+               std::to_wstring(producer().duration()) + L"]";
     }
 
     std::wstring name() const override { return L"ffmpeg"; }
 
-    core::monitor::state state() const override { return producer_->state(); }
+    void priority(core::producer_priority priority) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // A session shared with other producers decodes for them too, it is only ever raised.
+        if (priority == core::producer_priority::foreground) {
+            producer().active(true);
+        } else if (session_.use_count() == 1) {
+            producer().active(false).prefetch(priority == core::producer_priority::next ? 4 : 1);
+        }
+    }
+
+    void audible(bool audible) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // A session shared with other producers decodes for them too, its audio is only skipped when it is not.
+        audible_ = audible;
+        if (audible || session_.use_count() == 1) {
+            producer().audible(audible);
+        }
+    }
+
+    bool keyed() const override { return !key_path_.empty(); }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto state            = producer().state();
+        state["load/resolve"] = resolve_ms_;
+        state["load/create"]  = create_ms_;
+        return state;
+    }
 };
 
 boost::tribool has_valid_extension(const std::wstring& filename)
@@ -236,16 +533,9 @@ boost::tribool has_valid_extension(const std::wstring& filename)
     }
     return boost::tribool(boost::indeterminate);
 }
-bool is_valid_file(const std::wstring& filename)
+// Recognises filename by its contents.
+bool probe_file(const std::wstring& filename)
 {
-    const auto valid_ext = has_valid_extension(filename);
-    if (valid_ext) {
-        return true;
-    }
-    if (!valid_ext) {
-        return false;
-    }
-
     auto u8filename = u8(filename);
 
     int         score = 0;
@@ -275,6 +565,39 @@ bool is_valid_file(const std::wstring& filename)
     return av_probe_input_format2(&pb, true, &score) != nullptr;
 }
 
+bool is_valid_file(const std::wstring& filename)
+{
+    const auto valid_ext = has_valid_extension(filename);
+    if (valid_ext) {
+        return true;
+    }
+    if (!valid_ext) {
+        return false;
+    }
+
+    // Probing reads the file, the verdict is kept while it is unchanged.
+    static std::mutex                                            mutex;
+    static std::map<std::wstring, std::pair<std::time_t, bool>> verdicts;
+
+    boost::system::error_code ec;
+    const auto                time = boost::filesystem::last_write_time(filename, ec);
+    if (ec) {
+        return probe_file(filename);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto                        it = verdicts.find(filename);
+        if (it != verdicts.end() && it->second.first == time) {
+            return it->second.second;
+        }
+    }
+    const auto valid = probe_file(filename);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    verdicts[filename] = std::make_pair(time, valid);
+    return valid;
+}
+
 std::wstring probe_stem(const std::wstring& stem)
 {
     auto stem2  = boost::filesystem::path(stem);
@@ -285,17 +608,45 @@ std::wstring probe_stem(const std::wstring& stem)
 
     auto dir = boost::filesystem::path(*parent);
 
-    for (auto it = boost::filesystem::directory_iterator(dir); it != boost::filesystem::directory_iterator(); ++it) {
-        if (boost::iequals(it->path().stem().wstring(), stem2.filename().wstring()) &&
-            is_valid_file(it->path().wstring()))
-            return it->path().wstring();
+    for (auto& entry : list_directory(dir)) {
+        if (boost::iequals(entry.stem().wstring(), stem2.filename().wstring()) && is_valid_file(entry.wstring()))
+            return entry.wstring();
     }
     return L"";
 }
 
+preload::target resolve_preload(const std::wstring& clip, double seconds)
+{
+    preload::target result;
+    result.path = probe_stem(env::media_folder() + L"/" + clip);
+    if (result.path.empty()) {
+        CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(clip));
+    }
+    if (seconds <= 0.0) {
+        return result;
+    }
+
+    const auto       filename = u8(result.path);
+    AVFormatContext* ic       = nullptr;
+    FF(avformat_open_input(&ic, filename.c_str(), nullptr, nullptr));
+    CASPAR_SCOPE_EXIT { avformat_close_input(&ic); };
+
+    if (ic->duration == AV_NOPTS_VALUE) {
+        find_stream_info(ic, filename);
+    }
+    if (ic->duration > 0) {
+        const auto size = static_cast<double>(boost::filesystem::file_size(result.path));
+        result.bytes    = static_cast<std::int64_t>(size * seconds * AV_TIME_BASE / static_cast<double>(ic->duration));
+        result.bytes    = std::max<std::int64_t>(1, result.bytes);
+    }
+    return result;
+}
+
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params)
 {
+    caspar::timer resolve_timer;
+
     auto name = params.at(0);
     auto path = name;
 
@@ -343,9 +694,74 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
     auto vfilter = boost::to_lower_copy(get_param(L"VF", params, filter_str));
     auto afilter = boost::to_lower_copy(get_param(L"AF", params, get_param(L"FILTER", params, L"")));
 
+    auto hwaccel = boost::to_lower_copy(
+        get_param(L"HWACCEL", params, env::properties().get(L"configuration.ffmpeg.producer.hwaccel", L"none")));
+
+    // Without a configured value the latency profile of the channel picks the buffers, a quarter, half or a whole
+    // second ahead and 40, 100 or 250 ms of jitter buffer.
+    const auto low  = dependencies.latency == core::latency_profile::low;
+    const auto safe = dependencies.latency == core::latency_profile::safe;
+
+    // Decoded frames buffered ahead, the buffer adapts between min and max.
+    auto buffer_min =
+        get_param(L"BUFFER_MIN", params, env::properties().get(L"configuration.ffmpeg.producer.buffer-min", 0));
+    if (buffer_min == 0) {
+        buffer_min = static_cast<int>(dependencies.format_desc.fps * (low ? 0.25 : safe ? 1.0 : 0.5));
+    }
+    auto buffer_max =
+        get_param(L"BUFFER_MAX", params, env::properties().get(L"configuration.ffmpeg.producer.buffer-max", 0));
+
+    // Milliseconds of jitter buffer for network streams, zero buffers them like files.
+    auto latency = get_param(
+        L"LATENCY",
+        params,
+        env::properties().get(L"configuration.ffmpeg.producer.live-latency", low ? 40 : safe ? 250 : 100));
+
+    // A fill with a NAME_A or NAME_ALPHA key file decodes the key along with it, see AVProducer.
+    std::wstring key_path;
+    if (!boost::contains(params.at(0), L"://") &&
+        env::properties().get(L"configuration.ffmpeg.producer.key-pair", true)) {
+        key_path = probe_stem(env::media_folder() + L"/" + params.at(0) + L"_A");
+        if (key_path.empty()) {
+            key_path = probe_stem(env::media_folder() + L"/" + params.at(0) + L"_ALPHA");
+        }
+        key_path = key_path.empty() ? key_path : boost::filesystem::path(key_path).generic_wstring();
+    }
+
+    // Source frames per channel frame, picked by their time. BLEND mixes each with the next instead of repeating or
+    // dropping whole frames, also when the frame rates differ. Reverse playback is started with CALL SPEED -1.
+    auto speed = get_param(L"SPEED", params, 1.0);
+    if (!(speed > 0.0)) {
+        CASPAR_LOG(warning) << L"[ffmpeg] Ignoring invalid speed " << speed << L".";
+        speed = 1.0;
+    }
+    auto blend = contains_param(L"BLEND", params) ||
+                 env::properties().get(L"configuration.ffmpeg.producer.blend-frames", false);
+
+    // GROWING plays a file that is still being written, e.g. by an ingest, up to where it has got to, see Input.
+    auto growing = contains_param(L"GROWING", params);
+
     try {
-        auto producer = spl::make_shared<ffmpeg_producer>(
-            dependencies.frame_factory, dependencies.format_desc, name, path, vfilter, afilter, start, duration, loop);
+        auto producer = spl::make_shared<ffmpeg_producer>(dependencies.frame_factory,
+                                                          dependencies.format_desc,
+                                                          name,
+                                                          path,
+                                                          vfilter,
+                                                          afilter,
+                                                          start,
+                                                          duration,
+                                                          loop,
+                                                          hwaccel,
+                                                          buffer_min,
+                                                          buffer_max,
+                                                          latency,
+                                                          key_path,
+                                                          speed,
+                                                          blend,
+                                                          growing,
+                                                          dependencies.offline,
+                                                          resolve_timer.elapsed() * 1000.0,
+                                                          dependencies.requested);
         return core::create_destroy_proxy(std::move(producer));
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <common/memory.h>
+#include <common/preload.h>
 
 #include <core/fwd.h>
 
@@ -33,4 +34,10 @@ namespace caspar { namespace ffmpeg {
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
                                                       const std::vector<std::wstring>&         params);
 
+// Whether filename has a known media extension, or ffmpeg recognises its contents.
+bool is_valid_file(const std::wstring& filename);
+
+// The file of a clip given to PRELOAD, and for a number of seconds the bytes they take at the file's average bitrate.
+preload::target resolve_preload(const std::wstring& clip, double seconds);
+
 }} // namespace caspar::ffmpeg
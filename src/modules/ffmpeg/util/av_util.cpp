@@ -10,16 +10,185 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavfilter/avfilter.h>
 #include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libavutil/pixfmt.h>
 }
 #if defined(_MSC_VER)
 #pragma warning(pop)
 #endif
 
+#include <common/env.h>
+#include <common/os/memory.h>
+
+#include <boost/property_tree/ptree.hpp>
+
 #include <tbb/parallel_for.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
 namespace caspar { namespace ffmpeg {
 
+namespace {
+
+// A frame factory frame a decoder writes into. It is committed the first time make_frame hands it over, every frame
+// made from it after that shares its buffers and uploaded textures.
+struct frame_buffer
+{
+    core::mutable_frame frame;
+    core::const_frame   committed;
+
+    const std::uint8_t* data(int index) const
+    {
+        return committed ? committed.image_data(index).data() : frame.image_data(index).data();
+    }
+};
+
+struct frame_buffer_allocator
+{
+    core::frame_factory& frame_factory;
+    const void*          tag;
+};
+
+std::mutex                        frame_buffers_mutex;
+std::unordered_set<frame_buffer*> frame_buffers;
+
+void free_frame_buffer(void* opaque, uint8_t* data)
+{
+    auto buffer = static_cast<frame_buffer*>(opaque);
+    {
+        std::lock_guard<std::mutex> lock(frame_buffers_mutex);
+        frame_buffers.erase(buffer);
+    }
+    delete buffer;
+}
+
+int get_frame_buffer(AVCodecContext* ctx, AVFrame* frame, int flags)
+{
+    auto allocator = static_cast<frame_buffer_allocator*>(ctx->opaque);
+    auto format    = static_cast<AVPixelFormat>(frame->format);
+
+    // Upload memory is mapped write only, frames the decoder reads back as references stay in its own buffers.
+    if (!allocator || (flags & AV_GET_BUFFER_FLAG_REF) || ctx->width <= 0 || ctx->height <= 0) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    auto desc = pixel_format_desc(format, ctx->width, ctx->height, ctx->colorspace);
+    if (desc.format == core::pixel_format::invalid) {
+        return avcodec_default_get_buffer2(ctx, frame, flags);
+    }
+
+    int width  = frame->width;
+    int height = frame->height;
+    int align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &width, &height, align);
+
+    // The decoder writes the padded picture, which fits as long as the padding leaves the line sizes alone.
+    auto padded = pixel_format_desc(format, width, height);
+    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+        if (padded.planes[n].linesize != desc.planes[n].linesize || desc.planes[n].linesize % align[n] != 0) {
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+        desc.planes[n].size = padded.planes[n].size + 64;
+    }
+
+    auto buffer = std::unique_ptr<frame_buffer>(
+        new frame_buffer{allocator->frame_factory.create_frame(allocator->tag, desc), core::const_frame{}});
+    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+        auto data = buffer->frame.image_data(n).data();
+        if (reinterpret_cast<std::uintptr_t>(data) % 64 != 0) {
+            return avcodec_default_get_buffer2(ctx, frame, flags);
+        }
+        frame->data[n]     = data;
+        frame->linesize[n] = desc.planes[n].linesize;
+    }
+
+    frame->buf[0] = av_buffer_create(frame->data[0], desc.planes[0].size, free_frame_buffer, buffer.get(), 0);
+    if (!frame->buf[0]) {
+        return AVERROR(ENOMEM);
+    }
+
+    std::lock_guard<std::mutex> lock(frame_buffers_mutex);
+    frame_buffers.insert(buffer.release());
+    return 0;
+}
+
+// Returns the frame buffer holding every plane of video, if video was decoded straight into one.
+frame_buffer* find_frame_buffer(const AVFrame* video, const core::pixel_format_desc& desc)
+{
+    if (!video->buf[0] || video->buf[1]) {
+        return nullptr;
+    }
+
+    auto buffer = static_cast<frame_buffer*>(av_buffer_get_opaque(video->buf[0]));
+    {
+        std::lock_guard<std::mutex> lock(frame_buffers_mutex);
+        if (frame_buffers.find(buffer) == frame_buffers.end()) {
+            return nullptr;
+        }
+    }
+
+    const auto& buffer_desc = buffer->committed ? buffer->committed.pixel_format_desc()
+                                                : buffer->frame.pixel_format_desc();
+    if (buffer_desc.format != desc.format || buffer_desc.planes.size() != desc.planes.size()) {
+        return nullptr;
+    }
+    for (int n = 0; n < static_cast<int>(desc.planes.size()); ++n) {
+        if (video->data[n] != buffer->data(n) || buffer_desc.planes[n].linesize != desc.planes[n].linesize ||
+            buffer_desc.planes[n].height != desc.planes[n].height) {
+            return nullptr;
+        }
+    }
+    return buffer;
+}
+
+// Audio is laid out in the channel width, extra source channels are dropped and missing ones are silent.
+array<std::int32_t> make_audio_data(frame_cache& cache, const std::shared_ptr<AVFrame>& audio, int audio_channels)
+{
+    auto src  = reinterpret_cast<int32_t*>(audio->data[0]);
+    auto size = static_cast<std::size_t>(audio->nb_samples) * audio_channels;
+    if (audio->channels == audio_channels) {
+        auto result = cache.audio_buffer(size, false);
+        std::memcpy(result.data(), src, size * sizeof(int32_t));
+        return result;
+    }
+
+    auto result   = cache.audio_buffer(size, true);
+    auto dst      = result.data();
+    auto channels = std::min(audio_channels, audio->channels);
+    tbb::parallel_for(0, audio->nb_samples, [&](int i) {
+        for (auto j = 0; j < channels; ++j) {
+            dst[i * audio_channels + j] = src[i * audio->channels + j];
+        }
+    });
+    return result;
+}
+
+// Lends data owned by frame to ffmpeg, frame is kept alive until the last reference to the buffer is released.
+AVBufferRef* wrap_frame_data(const core::const_frame& frame, const void* data, std::size_t size)
+{
+    auto owner = new core::const_frame(frame);
+    auto buf   = av_buffer_create(const_cast<uint8_t*>(static_cast<const uint8_t*>(data)),
+                                static_cast<int>(size),
+                                [](void* opaque, uint8_t*) { delete static_cast<core::const_frame*>(opaque); },
+                                owner,
+                                AV_BUFFER_FLAG_READONLY);
+    if (!buf) {
+        delete owner;
+        FF_RET(AVERROR(ENOMEM), "av_buffer_create");
+    }
+    return buf;
+}
+
+} // namespace
+
 std::shared_ptr<AVFrame> alloc_frame()
 {
     const auto frame = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
@@ -36,14 +205,148 @@ std::shared_ptr<AVPacket> alloc_packet()
     return packet;
 }
 
-core::mutable_frame make_frame(void*                    tag,
-                               core::frame_factory&     frame_factory,
-                               std::shared_ptr<AVFrame> video,
-                               std::shared_ptr<AVFrame> audio)
+void alloc_video_buffer(AVFrame* frame, int align)
 {
-    const auto pix_desc =
-        video ? pixel_format_desc(static_cast<AVPixelFormat>(video->format), video->width, video->height)
-              : core::pixel_format_desc(core::pixel_format::invalid);
+    if (align <= 0) {
+        align = 64; // av_frame_get_buffer picks one for 0, the image functions do not.
+    }
+
+    const auto format = static_cast<AVPixelFormat>(frame->format);
+    const auto size   = av_image_get_buffer_size(format, frame->width, frame->height, align);
+    if (size < 0) {
+        FF_RET(size, "av_image_get_buffer_size");
+    }
+    if (static_cast<std::size_t>(size) < large_buffer_threshold) {
+        FF(av_frame_get_buffer(frame, align));
+        return;
+    }
+
+    auto storage = new std::shared_ptr<void>(alloc_large_buffer(size));
+
+    frame->buf[0] = av_buffer_create(static_cast<uint8_t*>(storage->get()),
+                                     size,
+                                     [](void* opaque, uint8_t*) { delete static_cast<std::shared_ptr<void>*>(opaque); },
+                                     storage,
+                                     0);
+    if (!frame->buf[0]) {
+        delete storage;
+        FF_RET(AVERROR(ENOMEM), "av_buffer_create");
+    }
+    FF(av_image_fill_arrays(
+        frame->data, frame->linesize, frame->buf[0]->data, format, frame->width, frame->height, align));
+    frame->extended_data = frame->data;
+}
+
+std::shared_ptr<void> use_frame_buffers(AVCodecContext* ctx, core::frame_factory& frame_factory, const void* tag)
+{
+    if (ctx->codec_type != AVMEDIA_TYPE_VIDEO || !ctx->codec || !(ctx->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        return nullptr;
+    }
+
+    auto allocator = std::make_shared<frame_buffer_allocator>(frame_buffer_allocator{frame_factory, tag});
+
+    ctx->opaque                = allocator.get();
+    ctx->get_buffer2           = get_frame_buffer;
+    ctx->thread_safe_callbacks = 1;
+
+    return allocator;
+}
+
+struct frame_cache::impl
+{
+    AVPixelFormat           format     = AV_PIX_FMT_NONE;
+    int                     width      = 0;
+    int                     height     = 0;
+    AVColorSpace            colorspace = AVCOL_SPC_UNSPECIFIED;
+    core::pixel_format_desc layout     = core::pixel_format_desc(core::pixel_format::invalid);
+
+    // A few frames' worth, enough for the ones queued between the producer and the mixer.
+    static const std::size_t max_audio_buffers = 16;
+
+    std::mutex                                              audio_mutex;
+    std::vector<std::unique_ptr<std::vector<std::int32_t>>> audio_buffers;
+};
+
+frame_cache::frame_cache()
+    : impl_(std::make_shared<impl>())
+{
+}
+
+const core::pixel_format_desc& frame_cache::layout(const AVFrame* video)
+{
+    auto&      self   = *impl_;
+    const auto format = static_cast<AVPixelFormat>(video->format);
+    if (format != self.format || video->width != self.width || video->height != self.height ||
+        video->colorspace != self.colorspace) {
+        self.layout     = pixel_format_desc(format, video->width, video->height, video->colorspace);
+        self.format     = format;
+        self.width      = video->width;
+        self.height     = video->height;
+        self.colorspace = video->colorspace;
+    }
+    return self.layout;
+}
+
+array<std::int32_t> frame_cache::audio_buffer(std::size_t samples, bool clear)
+{
+    std::unique_ptr<std::vector<std::int32_t>> buffer;
+    {
+        std::lock_guard<std::mutex> lock(impl_->audio_mutex);
+        if (!impl_->audio_buffers.empty()) {
+            buffer = std::move(impl_->audio_buffers.back());
+            impl_->audio_buffers.pop_back();
+        }
+    }
+    if (!buffer) {
+        buffer.reset(new std::vector<std::int32_t>());
+    }
+    if (clear) {
+        buffer->assign(samples, 0);
+    } else {
+        buffer->resize(samples);
+    }
+
+    // Frames are released on the mixer threads, the buffer goes back to the cache if it is still around.
+    auto data    = buffer->data();
+    auto weak    = std::weak_ptr<impl>(impl_);
+    auto storage = std::shared_ptr<std::vector<std::int32_t>>(buffer.release(), [weak](std::vector<std::int32_t>* ptr) {
+        auto owned = std::unique_ptr<std::vector<std::int32_t>>(ptr);
+        if (auto self = weak.lock()) {
+            std::lock_guard<std::mutex> lock(self->audio_mutex);
+            if (self->audio_buffers.size() < impl::max_audio_buffers) {
+                self->audio_buffers.push_back(std::move(owned));
+            }
+        }
+    });
+    return array<std::int32_t>(data, samples, std::move(storage));
+}
+
+core::const_frame make_frame(void*                    tag,
+                             core::frame_factory&     frame_factory,
+                             frame_cache&             cache,
+                             std::shared_ptr<AVFrame> video,
+                             std::shared_ptr<AVFrame> audio,
+                             int                      audio_channels)
+{
+    static const auto no_video = core::pixel_format_desc(core::pixel_format::invalid);
+
+    const auto& pix_desc   = video ? cache.layout(video.get()) : no_video;
+    auto        audio_data = audio ? make_audio_data(cache, audio, audio_channels) : array<std::int32_t>();
+
+    if (video) {
+        if (auto buffer = find_frame_buffer(video.get(), pix_desc)) {
+            if (!buffer->committed) {
+                buffer->committed = core::const_frame(std::move(buffer->frame));
+            }
+
+            std::vector<array<const std::uint8_t>> image_data;
+            for (int n = 0; n < static_cast<int>(pix_desc.planes.size()); ++n) {
+                image_data.push_back(buffer->committed.image_data(n));
+            }
+            return core::const_frame(
+                std::move(image_data), std::move(audio_data), buffer->committed.pixel_format_desc());
+        }
+    }
 
     auto frame = frame_factory.create_frame(tag, pix_desc);
 
@@ -58,18 +361,10 @@ core::mutable_frame make_frame(void*                    tag,
     }
 
     if (audio) {
-        // TODO This is a bit of a hack
-        frame.audio_data() = std::vector<int32_t>(audio->nb_samples * 8, 0);
-        auto dst           = frame.audio_data().data();
-        auto src           = reinterpret_cast<int32_t*>(audio->data[0]);
-        tbb::parallel_for(0, audio->nb_samples, [&](int i) {
-            for (auto j = 0; j < std::min(8, audio->channels); ++j) {
-                dst[i * 8 + j] = src[i * audio->channels + j];
-            }
-        });
+        frame.audio_data() = std::move(audio_data);
     }
 
-    return frame;
+    return core::const_frame(std::move(frame));
 }
 
 core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
@@ -90,33 +385,64 @@ core::pixel_format get_pixel_format(AVPixelFormat pix_fmt)
         case AV_PIX_FMT_ABGR:
             return core::pixel_format::abgr;
         case AV_PIX_FMT_YUV444P:
-            return core::pixel_format::ycbcr;
         case AV_PIX_FMT_YUV422P:
-            return core::pixel_format::ycbcr;
         case AV_PIX_FMT_YUV420P:
-            return core::pixel_format::ycbcr;
         case AV_PIX_FMT_YUV411P:
-            return core::pixel_format::ycbcr;
         case AV_PIX_FMT_YUV410P:
+        case AV_PIX_FMT_YUV444P10:
+        case AV_PIX_FMT_YUV422P10:
+        case AV_PIX_FMT_YUV420P10:
+        case AV_PIX_FMT_YUV444P12:
+        case AV_PIX_FMT_YUV422P12:
+        case AV_PIX_FMT_YUV420P12:
             return core::pixel_format::ycbcr;
         case AV_PIX_FMT_YUVA420P:
-            return core::pixel_format::ycbcra;
         case AV_PIX_FMT_YUVA422P:
-            return core::pixel_format::ycbcra;
         case AV_PIX_FMT_YUVA444P:
+        case AV_PIX_FMT_YUVA420P10:
+        case AV_PIX_FMT_YUVA422P10:
+        case AV_PIX_FMT_YUVA444P10:
             return core::pixel_format::ycbcra;
+        case AV_PIX_FMT_NV12:
+            return core::pixel_format::nv12;
+        case AV_PIX_FMT_P010:
+        case AV_PIX_FMT_P016:
+            return core::pixel_format::p010;
         default:
             return core::pixel_format::invalid;
     }
 }
 
-core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int height)
+core::color_space get_color_space(AVColorSpace colorspace)
+{
+    switch (colorspace) {
+        case AVCOL_SPC_BT470BG:
+        case AVCOL_SPC_SMPTE170M:
+        case AVCOL_SPC_FCC:
+            return core::color_space::bt601;
+        case AVCOL_SPC_BT709:
+            return core::color_space::bt709;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            return core::color_space::bt2020;
+        default:
+            return core::color_space::unspecified;
+    }
+}
+
+core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int height, AVColorSpace colorspace)
 {
     // Get linesizes
     AVPicture dummy_pict;
     avpicture_fill(&dummy_pict, nullptr, pix_fmt, width, height);
 
     core::pixel_format_desc desc = get_pixel_format(pix_fmt);
+    desc.color_space             = get_color_space(colorspace);
+
+    // Samples of more than 8 bits take 2 bytes, they are uploaded as decoded.
+    const auto av_desc = av_pix_fmt_desc_get(pix_fmt);
+    desc.bit_depth     = av_desc ? av_desc->comp[0].depth : 8;
+    const auto bytes   = desc.bit_depth > 8 ? 2 : 1;
 
     switch (desc.format) {
         case core::pixel_format::gray:
@@ -142,12 +468,22 @@ core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int
             auto size2 = static_cast<int>(dummy_pict.data[2] - dummy_pict.data[1]);
             auto h2    = size2 / dummy_pict.linesize[1];
 
-            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0], height, 1));
-            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[1], h2, 1));
-            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[2], h2, 1));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0] / bytes, height, bytes));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[1] / bytes, h2, bytes));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[2] / bytes, h2, bytes));
 
             if (desc.format == core::pixel_format::ycbcra)
-                desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[3], height, 1));
+                desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[3] / bytes, height, bytes));
+
+            return desc;
+        }
+        case core::pixel_format::nv12:
+        case core::pixel_format::p010: {
+            // Cb and Cr interleaved in the second plane, at half the width and height.
+            auto h2 = (height + 1) / 2;
+
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[0] / bytes, height, bytes));
+            desc.planes.push_back(core::pixel_format_desc::plane(dummy_pict.linesize[1] / (bytes * 2), h2, bytes * 2));
 
             return desc;
         }
@@ -202,37 +538,56 @@ std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, con
             int c_w = planes[1].width;
             int c_h = planes[1].height;
 
+            // 8, 10 and 12 bits.
+            const auto depth = pix_desc.bit_depth > 10 ? 2 : pix_desc.bit_depth > 8 ? 1 : 0;
+
+            const AVPixelFormat yuv444[] = {AV_PIX_FMT_YUV444P, AV_PIX_FMT_YUV444P10, AV_PIX_FMT_YUV444P12};
+            const AVPixelFormat yuv422[] = {AV_PIX_FMT_YUV422P, AV_PIX_FMT_YUV422P10, AV_PIX_FMT_YUV422P12};
+            const AVPixelFormat yuv420[] = {AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P10, AV_PIX_FMT_YUV420P12};
+
             if (c_h == y_h && c_w == y_w)
-                av_frame->format = AVPixelFormat::AV_PIX_FMT_YUV444P;
+                av_frame->format = yuv444[depth];
             else if (c_h == y_h && c_w * 2 == y_w)
-                av_frame->format = AVPixelFormat::AV_PIX_FMT_YUV422P;
+                av_frame->format = yuv422[depth];
             else if (c_h == y_h && c_w * 4 == y_w)
                 av_frame->format = AVPixelFormat::AV_PIX_FMT_YUV411P;
             else if (c_h * 2 == y_h && c_w * 2 == y_w)
-                av_frame->format = AVPixelFormat::AV_PIX_FMT_YUV420P;
+                av_frame->format = yuv420[depth];
             else if (c_h * 2 == y_h && c_w * 4 == y_w)
                 av_frame->format = AVPixelFormat::AV_PIX_FMT_YUV410P;
 
             break;
         }
         case core::pixel_format::ycbcra:
-            av_frame->format = AVPixelFormat::AV_PIX_FMT_YUVA420P;
+            av_frame->format =
+                pix_desc.bit_depth > 8 ? AVPixelFormat::AV_PIX_FMT_YUVA420P10 : AVPixelFormat::AV_PIX_FMT_YUVA420P;
+            break;
+        case core::pixel_format::uyvy:
+            av_frame->format = AVPixelFormat::AV_PIX_FMT_UYVY422;
+            break;
+        case core::pixel_format::nv12:
+            av_frame->format = AVPixelFormat::AV_PIX_FMT_NV12;
+            break;
+        case core::pixel_format::p010:
+            av_frame->format =
+                pix_desc.bit_depth > 10 ? AVPixelFormat::AV_PIX_FMT_P016 : AVPixelFormat::AV_PIX_FMT_P010;
             break;
+        case core::pixel_format::v210:
+        case core::pixel_format::r210:
+        case core::pixel_format::pgroup:
         case core::pixel_format::count:
         case core::pixel_format::invalid:
             break;
     }
 
-    FF(av_frame_get_buffer(av_frame.get(), 32));
-
-    // TODO (perf) Avoid extra memcpy.
+    // The planes are referenced rather than copied, they are read only like the frame itself.
     for (int n = 0; n < planes.size(); ++n) {
-        for (int y = 0; y < av_frame->height; ++y) {
-            std::memcpy(av_frame->data[n] + y * av_frame->linesize[n],
-                        frame.image_data(n).data() + y * planes[n].linesize,
-                        planes[n].linesize);
-        }
+        const auto& data      = frame.image_data(n);
+        av_frame->buf[n]      = wrap_frame_data(frame, data.data(), data.size());
+        av_frame->data[n]     = av_frame->buf[n]->data;
+        av_frame->linesize[n] = planes[n].linesize;
     }
+    av_frame->extended_data = av_frame->data;
 
     return av_frame;
 }
@@ -249,8 +604,10 @@ std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, con
     av_frame->sample_rate    = format_desc.audio_sample_rate;
     av_frame->format         = AV_SAMPLE_FMT_S32;
     av_frame->nb_samples     = static_cast<int>(buffer.size() / av_frame->channels);
-    FF(av_frame_get_buffer(av_frame.get(), 32));
-    std::memcpy(av_frame->data[0], buffer.data(), buffer.size() * sizeof(buffer.data()[0]));
+    av_frame->buf[0]         = wrap_frame_data(frame, buffer.data(), buffer.size() * sizeof(buffer.data()[0]));
+    av_frame->data[0]        = av_frame->buf[0]->data;
+    av_frame->linesize[0]    = static_cast<int>(av_frame->buf[0]->size);
+    av_frame->extended_data  = av_frame->data;
 
     return av_frame;
 }
@@ -294,13 +651,19 @@ int codec_execute2(AVCodecContext* c,
                    int*  ret,
                    int   count)
 {
-    std::array<std::vector<int>, 128> jobs;
+    if (count == 0) {
+        return 0;
+    }
+
+    // Codecs keep state per thread number, so each runs its share of the jobs in order, like ffmpeg's own threads.
+    const auto threads = std::max(1, std::min(c->thread_count, count));
 
+    std::vector<std::vector<int>> jobs(threads);
     for (int jobnr = 0; jobnr < count; ++jobnr) {
-        jobs[jobnr * c->thread_count / count].push_back(jobnr);
+        jobs[jobnr * threads / count].push_back(jobnr);
     }
 
-    tbb::parallel_for<int>(0, c->thread_count, [&](int threadnr) {
+    tbb::parallel_for<int>(0, threads, [&](int threadnr) {
         for (auto jobnr : jobs[threadnr]) {
             int r = func(c, arg2, jobnr, threadnr);
             if (ret) {
@@ -312,6 +675,41 @@ int codec_execute2(AVCodecContext* c,
     return 0;
 }
 
+int64_t frame_bytes(const AVFrame* frame)
+{
+    int64_t bytes = 0;
+    if (frame) {
+        for (auto buf : frame->buf) {
+            bytes += buf ? buf->size : 0;
+        }
+        for (auto n = 0; n < frame->nb_extended_buf; ++n) {
+            bytes += frame->extended_buf[n]->size;
+        }
+    }
+    return bytes;
+}
+
+namespace {
+
+std::atomic<int64_t> memory_budget_used{0};
+
+int64_t memory_budget_limit()
+{
+    static const int64_t limit =
+        env::properties().get(L"configuration.ffmpeg.producer.memory-budget", static_cast<int64_t>(0)) * 1024 * 1024;
+    return limit;
+}
+
+} // namespace
+
+void memory_budget_add(int64_t bytes) { memory_budget_used += bytes; }
+
+bool memory_budget_exceeded()
+{
+    const auto limit = memory_budget_limit();
+    return limit > 0 && memory_budget_used.load() > limit;
+}
+
 AVDictionary* to_dict(std::map<std::string, std::string>&& map)
 {
     AVDictionary* dict = nullptr;
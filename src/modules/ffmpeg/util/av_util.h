@@ -1,8 +1,12 @@
 #include <libavutil/pixfmt.h>
 
+#include <common/array.h>
+
 #include <core/frame/frame.h>
 #include <core/frame/pixel_format.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
 struct AVFrame;
@@ -16,16 +20,55 @@ namespace caspar { namespace ffmpeg {
 std::shared_ptr<AVFrame>  alloc_frame();
 std::shared_ptr<AVPacket> alloc_packet();
 
+// Like av_frame_get_buffer for a video frame with format, width and height set, frame sized images as large buffers.
+void alloc_video_buffer(AVFrame* frame, int align);
+
 core::pixel_format      get_pixel_format(AVPixelFormat pix_fmt);
-core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt, int width, int height);
-core::mutable_frame     make_frame(void*                    tag,
-                                   core::frame_factory&     frame_factory,
-                                   std::shared_ptr<AVFrame> video,
-                                   std::shared_ptr<AVFrame> audio);
+core::color_space       get_color_space(AVColorSpace colorspace);
+core::pixel_format_desc pixel_format_desc(AVPixelFormat pix_fmt,
+                                          int           width,
+                                          int           height,
+                                          AVColorSpace  colorspace = AVCOL_SPC_UNSPECIFIED);
+
+// What make_frame keeps between the frames of a stream: the layout of the current video format, recomputed when the
+// format changes, and the audio buffers of released frames, which are handed out again instead of allocated.
+class frame_cache final
+{
+    frame_cache(const frame_cache&);
+    frame_cache& operator=(const frame_cache&);
+
+  public:
+    frame_cache();
+
+    const core::pixel_format_desc& layout(const AVFrame* video);
+    array<std::int32_t>            audio_buffer(std::size_t samples, bool clear);
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+core::const_frame make_frame(void*                    tag,
+                             core::frame_factory&     frame_factory,
+                             frame_cache&             cache,
+                             std::shared_ptr<AVFrame> video,
+                             std::shared_ptr<AVFrame> audio,
+                             int                      audio_channels);
+
+// Lets a video decoder write straight into frame factory buffers, which make_frame then hands over without a copy.
+// The returned allocator must outlive the codec context, nullptr if the decoder does not support custom buffers.
+std::shared_ptr<void> use_frame_buffers(AVCodecContext* ctx, core::frame_factory& frame_factory, const void* tag);
 
 std::shared_ptr<AVFrame> make_av_video_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 std::shared_ptr<AVFrame> make_av_audio_frame(const core::const_frame& frame, const core::video_format_desc& format_des);
 
+int64_t frame_bytes(const AVFrame* frame);
+
+// Process wide budget for the decoded frames and packets ffmpeg producers keep queued, set in MB by
+// ffmpeg/producer/memory-budget. Holders account their queues and stop reading ahead while it is exceeded.
+void memory_budget_add(int64_t bytes);
+bool memory_budget_exceeded();
+
 int graph_execute(AVFilterContext* c,
                   int (*func)(AVFilterContext* ctx, void* arg, int jobnr, int nb_jobs),
                   void* arg,
@@ -41,7 +84,7 @@ int codec_execute2(AVCodecContext* c,
                    int (*func)(AVCodecContext* c2, void* arg, int jobnr, int threadnr),
                    void* arg2,
                    int*  ret,
-                   int   coun);
+                   int   count);
 
 AVDictionary*                      to_dict(std::map<std::string, std::string>&& map);
 std::map<std::string, std::string> to_map(AVDictionary** dict);
@@ -51,6 +51,12 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <thread>
+#include <vector>
+
 namespace caspar { namespace flash {
 
 class bitmap
@@ -328,6 +334,49 @@ class flash_renderer
     }
 };
 
+// Lock-free handoff from the renderer thread, the only writer, to the channel, the only reader.
+class frame_ring
+{
+    std::vector<core::draw_frame> slots_;
+    std::atomic<std::size_t>      write_{0};
+    std::atomic<std::size_t>      read_{0};
+
+  public:
+    explicit frame_ring(std::size_t capacity)
+        : slots_(capacity)
+    {
+    }
+
+    std::size_t capacity() const { return slots_.size(); }
+
+    std::size_t size() const { return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire); }
+
+    bool try_push(core::draw_frame frame)
+    {
+        const auto write = write_.load(std::memory_order_relaxed);
+        if (write - read_.load(std::memory_order_acquire) >= slots_.size()) {
+            return false;
+        }
+        slots_[write % slots_.size()] = std::move(frame);
+        write_.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(core::draw_frame& frame)
+    {
+        const auto read = read_.load(std::memory_order_relaxed);
+        if (read == write_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        // Moving out releases the frame's buffers to the pool on this side.
+        frame = std::move(slots_[read % slots_.size()]);
+        read_.store(read + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// The renderer runs on its own thread at the movie's frame rate and keeps a ring buffer_size_ deep, the channel only
+// takes frames from it. Calls are run on the renderer thread between frames.
 struct flash_producer : public core::frame_producer
 {
     core::monitor::state                       state_;
@@ -343,13 +392,15 @@ struct flash_producer : public core::frame_producer
 
     spl::shared_ptr<diagnostics::graph> graph_;
 
-    std::queue<core::draw_frame>                    frame_buffer_;
-    tbb::concurrent_bounded_queue<core::draw_frame> output_buffer_;
+    std::queue<core::draw_frame> frame_buffer_;
+    frame_ring                   output_buffer_{static_cast<std::size_t>(std::max(1, buffer_size_))};
 
     core::draw_frame last_frame_;
 
     std::unique_ptr<flash_renderer> renderer_;
     std::atomic<bool>               has_renderer_;
+    std::atomic<bool>               running_{true};
+    bool                            rendering_ = false;
 
     executor executor_ = L"flash_producer";
 
@@ -379,6 +430,7 @@ struct flash_producer : public core::frame_producer
 
     ~flash_producer()
     {
+        running_ = false;
         executor_.invoke([this] { renderer_.reset(); });
     }
 
@@ -401,16 +453,14 @@ struct flash_producer : public core::frame_producer
 
         if (output_buffer_.try_pop(frame))
             last_frame_ = frame;
-        else
+        else if (has_renderer_)
             graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
 
-        fill_buffer();
-
         state_["host/path"]   = filename_;
         state_["host/width"]  = width_;
         state_["host/height"] = height_;
         state_["host/fps"]    = fps_;
-        state_["buffer"]      = output_buffer_.size() % buffer_size_;
+        state_["buffer"]      = static_cast<int>(output_buffer_.size());
 
         return frame;
     }
@@ -435,7 +485,11 @@ struct flash_producer : public core::frame_producer
                 std::wstring result = param == L"start_rendering" ? L"" : renderer_->call(param);
 
                 if (initialize_renderer) {
-                    do_fill_buffer(true);
+                    do_fill_buffer();
+                    if (!rendering_) {
+                        rendering_ = true;
+                        executor_.begin_invoke([this] { render(); });
+                    }
                 }
 
                 return result;
@@ -460,30 +514,43 @@ struct flash_producer : public core::frame_producer
 
     // flash_producer
 
-    void fill_buffer()
+    // Renders one frame and queues the next call, on the renderer thread.
+    void render()
     {
-        if (executor_.size() > 0)
+        if (!running_) {
             return;
+        }
 
-        executor_.begin_invoke([this] { do_fill_buffer(false); });
+        if (output_buffer_.size() >= output_buffer_.capacity()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        } else if (!renderer_) {
+            // The movie ended, the channel is left with an empty frame.
+            if (frame_buffer_.empty()) {
+                output_buffer_.try_push(core::draw_frame{});
+                rendering_ = false;
+                return;
+            }
+            output_buffer_.try_push(std::move(frame_buffer_.front()));
+            frame_buffer_.pop();
+        } else if (!next(true)) {
+            // Flash player not ready with the next frame, sleep to not busy-loop.
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        log_buffered();
+
+        executor_.begin_invoke([this] { render(); });
     }
 
-    void do_fill_buffer(bool initial_buffer_fill)
+    void do_fill_buffer()
     {
         int       nothing_rendered             = 0;
         const int MAX_NOTHING_RENDERED_RETRIES = 4;
 
-        auto to_render              = buffer_size_ - output_buffer_.size();
-        bool allow_faster_rendering = !initial_buffer_fill;
-        int  rendered               = 0;
-
-        while (rendered < to_render) {
-            bool was_rendered = next(allow_faster_rendering);
+        while (renderer_ && output_buffer_.size() < output_buffer_.capacity()) {
+            bool was_rendered = next(false);
             log_buffered();
 
-            if (was_rendered) {
-                ++rendered;
-            } else {
+            if (!was_rendered) {
                 if (nothing_rendered++ < MAX_NOTHING_RENDERED_RETRIES) {
                     // Flash player not ready with first frame, sleep to not busy-loop;
                     std::this_thread::sleep_for(std::chrono::milliseconds(10));
@@ -491,16 +558,11 @@ struct flash_producer : public core::frame_producer
                 } else
                     return;
             }
-
-            // TODO yield
         }
     }
 
     bool next(bool allow_faster_rendering)
     {
-        if (!renderer_)
-            frame_buffer_.push(core::draw_frame{});
-
         if (frame_buffer_.empty()) {
             if (abs(renderer_->fps() - format_desc_.fps / 2.0) < 2.0) // format == 2 * flash -> duplicate
             {
@@ -526,10 +588,9 @@ struct flash_producer : public core::frame_producer
             }
         }
 
-        if (frame_buffer_.empty()) {
+        if (frame_buffer_.empty() || !output_buffer_.try_push(frame_buffer_.front())) {
             return false;
         }
-        output_buffer_.push(std::move(frame_buffer_.front()));
         frame_buffer_.pop();
         return true;
     }
@@ -539,8 +600,9 @@ struct flash_producer : public core::frame_producer
         double sync;
 
         if (allow_faster_rendering) {
-            double ratio = std::min(
-                1.0, static_cast<double>(output_buffer_.size()) / static_cast<double>(std::max(1, buffer_size_ - 1)));
+            double ratio = std::min(1.0,
+                                    static_cast<double>(output_buffer_.size()) /
+                                        static_cast<double>(std::max<std::size_t>(1, output_buffer_.capacity() - 1)));
             sync = 2 * ratio - ratio * ratio;
         } else {
             sync = 1.0;
@@ -29,6 +29,7 @@
 #include <common/future.h>
 
 #include <core/producer/cg_proxy.h>
+#include <core/video_format.h>
 
 #include <boost/asio.hpp>
 #include <boost/log/trivial.hpp>
@@ -136,9 +137,9 @@ class renderer_application
 				delete requestedAnimationFrames[animationFrameId];
 			}
 
-			function tickAnimations() {
+			function tickAnimations(time) {
 				var requestedFrames = requestedAnimationFrames;
-				var timestamp = performance.now();
+				var timestamp = time !== undefined ? time : performance.now();
 				requestedAnimationFrames = {};
 
 				for (var animationFrameId in requestedFrames)
@@ -199,10 +200,35 @@ class renderer_application
                                   CefRefPtr<CefProcessMessage> message) override
     {
         if (message->GetName().ToString() == TICK_MESSAGE_NAME) {
+            // Offline channels pass the time of the frame, animation frames then follow the channel.
+            auto args = message->GetArgumentList();
+            auto call = args->GetSize() > 0 ? "tickAnimations(" + std::to_string(args->GetDouble(0)) + ")"
+                                            : std::string("tickAnimations()");
             for (auto& context : contexts_) {
                 CefRefPtr<CefV8Value>     ret;
                 CefRefPtr<CefV8Exception> exception;
-                context->Eval("tickAnimations()", CefString(), 1, ret, exception);
+                context->Eval(call, CefString(), 1, ret, exception);
+            }
+
+            return true;
+        }
+        if (message->GetName().ToString() == UPDATE_MESSAGE_NAME) {
+            // The data of CG UPDATE as UTF-8, passed to the page's update function without building and parsing a
+            // script.
+            auto        binary = message->GetArgumentList()->GetBinary(0);
+            std::string data(binary->GetSize(), '\0');
+            if (!data.empty()) {
+                binary->GetData(&data[0], data.size(), 0);
+            }
+            for (auto& context : contexts_) {
+                if (!context->GetFrame()->IsMain() || !context->Enter()) {
+                    continue;
+                }
+                auto update = context->GetGlobal()->GetValue("update");
+                if (update != nullptr && update->IsFunction()) {
+                    update->ExecuteFunction(nullptr, {CefV8Value::CreateString(data)});
+                }
+                context->Exit();
             }
 
             return true;
@@ -252,6 +278,16 @@ void init(core::module_dependencies dependencies)
         },
         false);
 
+    html::prewarm_browsers(env::properties().get(L"configuration.html.prewarm", 1));
+    if (auto channels = env::properties().get_child_optional(L"configuration.channels")) {
+        for (auto& channel : *channels) {
+            core::video_format_desc format_desc(channel.second.get(L"video-mode", L""));
+            if (format_desc.format != core::video_format::invalid) {
+                html::prewarm_browsers(format_desc);
+            }
+        }
+    }
+
     auto cef_version_major = std::to_wstring(cef_version_info(0));
     auto cef_revision      = std::to_wstring(cef_version_info(1));
     auto chrome_major      = std::to_wstring(cef_version_info(2));
@@ -262,6 +298,7 @@ void init(core::module_dependencies dependencies)
 
 void uninit()
 {
+    close_warm_browsers();
     invoke([] { CefQuitMessageLoop(); });
     g_cef_executor->begin_invoke([&] { CefShutdown(); });
     g_cef_executor.reset();
@@ -32,6 +32,7 @@ namespace caspar { namespace html {
 const std::string TICK_MESSAGE_NAME   = "CasparCGTick";
 const std::string REMOVE_MESSAGE_NAME = "CasparCGRemove";
 const std::string LOG_MESSAGE_NAME    = "CasparCGLog";
+const std::string UPDATE_MESSAGE_NAME = "CasparCGUpdate";
 
 bool              intercept_command_line(int argc, char** argv);
 void              init(core::module_dependencies dependencies);
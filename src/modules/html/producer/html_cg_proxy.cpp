@@ -25,9 +25,7 @@
 #include <future>
 
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/trim.hpp>
-#include <boost/format.hpp>
 
 namespace caspar { namespace html {
 
@@ -65,10 +63,7 @@ void html_cg_proxy::next(int layer) { impl_->producer->call({L"next()"}); }
 
 void html_cg_proxy::update(int layer, const std::wstring& data)
 {
-    impl_->producer->call({(boost::wformat(L"update(\"%1%\")") %
-                            boost::algorithm::replace_all_copy(
-                                boost::algorithm::trim_copy_if(data, boost::is_any_of(" \"")), "\"", "\\\""))
-                               .str()});
+    impl_->producer->call({L"update", boost::algorithm::trim_copy_if(data, boost::is_any_of(" \""))});
 }
 
 std::wstring html_cg_proxy::invoke(int layer, const std::wstring& label)
@@ -33,6 +33,7 @@
 
 #include <common/assert.h>
 #include <common/diagnostics/graph.h>
+#include <common/diagnostics/memory.h>
 #include <common/env.h>
 #include <common/executor.h>
 #include <common/future.h>
@@ -40,15 +41,21 @@
 #include <common/timer.h>
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/log/trivial.hpp>
+#include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/regex.hpp>
 
 #include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <mutex>
 
 #pragma warning(push)
@@ -56,10 +63,23 @@
 #include <include/cef_app.h>
 #include <include/cef_client.h>
 #include <include/cef_render_handler.h>
+#include <include/cef_version.h>
 #pragma warning(pop)
 
+#if defined(WIN32) && CHROME_VERSION_MAJOR >= 71
+#define CASPAR_HTML_SHARED_TEXTURES
+#endif
+
+#if CHROME_VERSION_MAJOR >= 71
+#define CASPAR_HTML_EXTERNAL_BEGIN_FRAME
+#endif
+
+#include <algorithm>
+#include <map>
 #include <queue>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include "../html.h"
 
@@ -75,43 +95,59 @@ class html_client
     , public CefLoadHandler
     , public CefDisplayHandler
 {
-    std::wstring                        url_;
+    std::wstring                        url_ = L"about:blank";
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
     caspar::timer                       frame_timer_;
     caspar::timer                       paint_timer_;
+    caspar::timer                       load_timer_;
 
-    spl::shared_ptr<core::frame_factory> frame_factory_;
+    // Null while the browser waits in the pool.
+    std::shared_ptr<core::frame_factory> frame_factory_;
     core::video_format_desc              format_desc_;
     tbb::concurrent_queue<std::wstring>  javascript_before_load_;
     std::atomic<bool>                    loaded_;
+    const bool                           coalesce_updates_;
+    boost::optional<std::wstring>        pending_update_;
+    std::mutex                           pending_update_mutex_;
     std::queue<core::draw_frame>         frames_;
+    diagnostics::memory::held_bytes      frames_held_{"html/frames"};
     mutable std::mutex                   frames_mutex_;
+    std::condition_variable              frames_cond_;
+
+    // Offline channels render each frame when it is received, animation frames then run on the channel's time.
+    std::atomic<bool> pull_{false};
+    std::int64_t      ticks_ = 0;
 
     core::draw_frame   last_frame_;
     mutable std::mutex last_frame_mutex_;
 
+    bool import_failed_ = false;
+    bool navigate_      = false;
+    bool hidden_        = false;
+
+    // Set once the bound page starts loading, earlier paints are of about:blank.
+    bool started_ = false;
+
+    std::atomic<double> first_frame_latency_{-1.0};
+
+    // The last software paint, later ones only upload what changed from it.
+    core::const_frame last_paint_;
+
     CefRefPtr<CefBrowser> browser_;
 
     executor executor_;
 
   public:
-    html_client(spl::shared_ptr<core::frame_factory>       frame_factory,
-                const spl::shared_ptr<diagnostics::graph>& graph,
-                core::video_format_desc                    format_desc,
-                std::wstring                               url)
-        : url_(std::move(url))
-        , graph_(graph)
-        , frame_factory_(std::move(frame_factory))
-        , format_desc_(std::move(format_desc))
+    explicit html_client(core::video_format_desc format_desc)
+        : format_desc_(std::move(format_desc))
+        , coalesce_updates_(env::properties().get(L"configuration.html.coalesce-updates", true))
         , executor_(L"html_producer")
     {
         graph_->set_color("browser-tick-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
         graph_->set_color("late-frame", diagnostics::color(0.6f, 0.1f, 0.1f));
-        graph_->set_text(print());
-        diagnostics::register_graph(graph_);
 
         loaded_ = false;
         executor_.begin_invoke([&] {
@@ -124,6 +160,44 @@ class html_client
         });
     }
 
+    // Hands the browser to a producer on the UI thread. A warm one navigates away from about:blank, a cold one was
+    // created with the url.
+    void bind(std::shared_ptr<core::frame_factory> frame_factory, std::wstring url, bool navigate, bool pull)
+    {
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        frame_factory_ = std::move(frame_factory);
+        url_           = std::move(url);
+        pull_          = pull;
+        load_timer_.restart();
+
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        if (!navigate) {
+            return;
+        }
+        if (browser_ != nullptr) {
+            browser_->GetMainFrame()->LoadURL(url_);
+        } else {
+            navigate_ = true;
+        }
+    }
+
+    // Hidden browsers neither paint nor run their animation frames, e.g. those of stopped producers.
+    void hide(bool hidden)
+    {
+        html::begin_invoke([self = CefRefPtr<html_client>(this), hidden] {
+            self->hidden_ = hidden;
+            if (self->browser_ != nullptr) {
+                self->browser_->GetHost()->WasHidden(hidden);
+            }
+        });
+    }
+
+    // Milliseconds from bind to the first painted frame, negative until then.
+    double first_frame_latency() const { return first_frame_latency_; }
+
     void close()
     {
         html::invoke([=] {
@@ -135,6 +209,24 @@ class html_client
 
     core::draw_frame receive()
     {
+        if (pull_) {
+            // A page that has nothing new to paint is given a frame's time, the previous frame is then repeated.
+            const auto period = std::chrono::microseconds(static_cast<int>(1e6 / format_desc_.fps));
+            executor_.invoke([&] {
+                invoke_requested_animation_frames();
+                {
+                    std::unique_lock<std::mutex> lock(frames_mutex_);
+                    frames_cond_.wait_for(lock, period, [&] { return !frames_.empty(); });
+                }
+                core::draw_frame frame;
+                if (try_pop(frame)) {
+                    std::lock_guard<std::mutex> lock(last_frame_mutex_);
+                    last_frame_ = frame;
+                }
+            });
+            return last_frame();
+        }
+
         auto frame = last_frame();
         executor_.begin_invoke([&] { update(); });
         return frame;
@@ -152,10 +244,30 @@ class html_client
             javascript_before_load_.push(javascript);
         } else {
             execute_queued_javascript();
+            deliver_update();
             do_execute_javascript(javascript);
         }
     }
 
+    // Updates of a loaded page wait for the next frame, one that arrives before it replaces the one waiting. They are
+    // delivered before any later script, so update still runs before a following play.
+    void cg_update(std::wstring data)
+    {
+        if (!loaded_) {
+            boost::replace_all(data, L"\"", L"\\\"");
+            javascript_before_load_.push(L"update(\"" + data + L"\")");
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pending_update_mutex_);
+            pending_update_ = std::move(data);
+        }
+        if (!coalesce_updates_) {
+            deliver_update();
+        }
+    }
+
     bool OnBeforePopup(CefRefPtr<CefBrowser>   browser,
                        CefRefPtr<CefFrame>     frame,
                        const CefString&        target_url,
@@ -200,27 +312,102 @@ class html_client
         paint_timer_.restart();
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
 
-        if (type != PET_VIEW)
+        if (type != PET_VIEW || !started_)
             return;
 
-        core::pixel_format_desc pixel_desc;
-        pixel_desc.format = core::pixel_format::bgra;
-        pixel_desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+        core::const_frame frame;
+
+        if (last_paint_ && static_cast<int>(last_paint_.width()) == width &&
+            static_cast<int>(last_paint_.height()) == height) {
+            std::vector<core::frame_rect> regions;
+            auto                          area = 0LL;
+            for (auto& rect : dirtyRects) {
+                core::frame_rect region;
+                region.x      = std::max(rect.x, 0);
+                region.y      = std::max(rect.y, 0);
+                region.width  = std::min(rect.x + rect.width, width) - region.x;
+                region.height = std::min(rect.y + rect.height, height) - region.y;
+                if (region.width > 0 && region.height > 0) {
+                    regions.push_back(region);
+                    area += static_cast<long long>(region.width) * region.height;
+                }
+            }
+
+            // Mostly repainted pages are uploaded whole and asynchronously instead.
+            if (area * 2 < static_cast<long long>(width) * height) {
+                frame = frame_factory_->update_frame(this, last_paint_, buffer, regions);
+            }
+        }
 
-        auto frame = frame_factory_->create_frame(this, pixel_desc);
-        auto src   = (char*)buffer;
-        auto dst   = reinterpret_cast<char*>(frame.image_data(0).begin());
-        std::memcpy(dst, src, width * height * 4);
+        if (!frame) {
+            core::pixel_format_desc pixel_desc;
+            pixel_desc.format = core::pixel_format::bgra;
+            pixel_desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
 
-        {
-            std::lock_guard<std::mutex> lock(frames_mutex_);
+            auto whole = frame_factory_->create_frame(this, pixel_desc);
+            auto src   = (char*)buffer;
+            auto dst   = reinterpret_cast<char*>(whole.image_data(0).begin());
+            std::memcpy(dst, src, width * height * 4);
+            frame = core::const_frame(std::move(whole));
+        }
+
+        last_paint_ = frame;
+        push(core::draw_frame(std::move(frame)));
+    }
+
+#ifdef CASPAR_HTML_SHARED_TEXTURES
+    void OnAcceleratedPaint(CefRefPtr<CefBrowser> browser,
+                            PaintElementType      type,
+                            const RectList&       dirtyRects,
+                            void*                 shared_handle) override
+    {
+        graph_->set_value("browser-tick-time", paint_timer_.elapsed() * format_desc_.fps * 0.5);
+        paint_timer_.restart();
+        CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
+
+        if (type != PET_VIEW || !started_)
+            return;
 
-            frames_.push(core::draw_frame(std::move(frame)));
-            while (frames_.size() > 8) {
-                frames_.pop();
-                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        // Copied on the GPU before returning, the browser draws a later frame into the same texture.
+        auto frame = frame_factory_->import_shared_texture(
+            this, shared_handle, format_desc_.square_width, format_desc_.square_height);
+        if (!frame) {
+            if (!import_failed_) {
+                CASPAR_LOG(warning) << print() << L" Could not import the shared texture, disable html/enable-gpu.";
             }
+            import_failed_ = true;
+            return;
         }
+
+        push(core::draw_frame(std::move(frame)));
+    }
+#endif
+
+    void push(core::draw_frame frame)
+    {
+        if (first_frame_latency_ < 0.0) {
+            first_frame_latency_ = load_timer_.elapsed() * 1000.0;
+            CASPAR_LOG(debug) << print() << L" First frame after " << static_cast<int>(first_frame_latency_)
+                              << L" ms.";
+        }
+
+        std::lock_guard<std::mutex> lock(frames_mutex_);
+
+#ifdef CASPAR_HTML_EXTERNAL_BEGIN_FRAME
+        // Each channel tick renders at most one frame, this only absorbs a paint landing after the next tick.
+        const std::size_t max_frames = 2;
+#else
+        const std::size_t max_frames = 8;
+#endif
+
+        frames_held_.add(static_cast<std::int64_t>(core::image_bytes(frame)));
+        frames_.push(std::move(frame));
+        while (frames_.size() > max_frames) {
+            frames_held_.add(-static_cast<std::int64_t>(core::image_bytes(frames_.front())));
+            frames_.pop();
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+        frames_cond_.notify_all();
     }
 
     void OnAfterCreated(CefRefPtr<CefBrowser> browser) override
@@ -228,6 +415,15 @@ class html_client
         CASPAR_ASSERT(CefCurrentlyOn(TID_UI));
 
         browser_ = std::move(browser);
+
+        if (hidden_) {
+            browser_->GetHost()->WasHidden(true);
+        }
+
+        if (navigate_) {
+            navigate_ = false;
+            browser_->GetMainFrame()->LoadURL(url_);
+        }
     }
 
     void OnBeforeClose(CefRefPtr<CefBrowser> browser) override
@@ -261,8 +457,18 @@ class html_client
 
     CefRefPtr<CefDisplayHandler> GetDisplayHandler() override { return this; }
 
+    void OnLoadStart(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, TransitionType transition_type) override
+    {
+        if (frame_factory_ && frame->IsMain() && frame->GetURL() != "about:blank")
+            started_ = true;
+    }
+
     void OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode) override
     {
+        // A warm browser finishes about:blank first, possibly after it was bound.
+        if (!frame_factory_ || frame->GetURL() == "about:blank")
+            return;
+
         loaded_ = true;
         execute_queued_javascript();
     }
@@ -291,8 +497,23 @@ class html_client
 
     void invoke_requested_animation_frames()
     {
-        if (browser_ != nullptr)
-            browser_->SendProcessMessage(CefProcessId::PID_RENDERER, CefProcessMessage::Create(TICK_MESSAGE_NAME));
+        deliver_update();
+
+        if (browser_ != nullptr) {
+            auto message = CefProcessMessage::Create(TICK_MESSAGE_NAME);
+            if (pull_) {
+                message->GetArgumentList()->SetDouble(0, static_cast<double>(ticks_++) * 1000.0 / format_desc_.fps);
+            }
+            browser_->SendProcessMessage(CefProcessId::PID_RENDERER, message);
+        }
+
+#ifdef CASPAR_HTML_EXTERNAL_BEGIN_FRAME
+        // Renders the frame for the next tick, the browser has no timer of its own.
+        html::begin_invoke([self = CefRefPtr<html_client>(this)] {
+            if (self->browser_ != nullptr)
+                self->browser_->GetHost()->SendExternalBeginFrame();
+        });
+#endif
 
         graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
         tick_timer_.restart();
@@ -305,6 +526,7 @@ class html_client
         if (!frames_.empty()) {
             result = std::move(frames_.front());
             frames_.pop();
+            frames_held_.add(-static_cast<std::int64_t>(core::image_bytes(result)));
 
             return true;
         }
@@ -334,6 +556,26 @@ class html_client
         });
     }
 
+    void deliver_update()
+    {
+        boost::optional<std::wstring> data;
+        {
+            std::lock_guard<std::mutex> lock(pending_update_mutex_);
+            data.swap(pending_update_);
+        }
+        if (!data) {
+            return;
+        }
+
+        html::begin_invoke([=, bytes = u8(*data)] {
+            if (browser_ != nullptr) {
+                auto message = CefProcessMessage::Create(UPDATE_MESSAGE_NAME);
+                message->GetArgumentList()->SetBinary(0, CefBinaryValue::Create(bytes.data(), bytes.size()));
+                browser_->SendProcessMessage(CefProcessId::PID_RENDERER, message);
+            }
+        });
+    }
+
     void execute_queued_javascript()
     {
         std::wstring javascript;
@@ -351,38 +593,103 @@ class html_client
     IMPLEMENT_REFCOUNTING(html_client);
 };
 
+namespace {
+
+void create_browser(const CefRefPtr<html_client>&  client,
+                    const core::video_format_desc& format_desc,
+                    const std::wstring&            url)
+{
+    CefWindowInfo window_info;
+    window_info.width                        = format_desc.square_width;
+    window_info.height                       = format_desc.square_height;
+    window_info.windowless_rendering_enabled = true;
+
+    const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+
+#ifdef CASPAR_HTML_SHARED_TEXTURES
+    // Frames composited on the GPU are handed over as textures instead of being read back for OnPaint.
+    window_info.shared_texture_enabled = enable_gpu;
+#endif
+
+    CefBrowserSettings browser_settings;
+    browser_settings.web_security          = cef_state_t::STATE_DISABLED;
+    browser_settings.webgl                 = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
+    double fps                             = format_desc.fps;
+    browser_settings.windowless_frame_rate = int(ceil(fps));
+
+#ifdef CASPAR_HTML_EXTERNAL_BEGIN_FRAME
+    // Frames are rendered on the channel ticks, see invoke_requested_animation_frames.
+    window_info.external_begin_frame_enabled = true;
+#endif
+    CefBrowserHost::CreateBrowser(window_info, client.get(), url, browser_settings, nullptr);
+}
+
+// Idle browsers on about:blank by size and frame rate, only touched on the UI thread.
+using browser_key = std::tuple<int, int, int>;
+
+int                                                        g_prewarm_count = 0;
+std::map<browser_key, std::vector<CefRefPtr<html_client>>> g_warm_browsers;
+
+browser_key key_of(const core::video_format_desc& format_desc)
+{
+    return browser_key(format_desc.square_width, format_desc.square_height, static_cast<int>(ceil(format_desc.fps)));
+}
+
+void open_warm_browsers(const core::video_format_desc& format_desc)
+{
+    auto& idle = g_warm_browsers[key_of(format_desc)];
+    while (static_cast<int>(idle.size()) < g_prewarm_count) {
+        CefRefPtr<html_client> client = new html_client(format_desc);
+        create_browser(client, format_desc, L"about:blank");
+        idle.push_back(client);
+    }
+}
+
+CefRefPtr<html_client> take_warm_browser(const core::video_format_desc& format_desc)
+{
+    CefRefPtr<html_client> client;
+
+    auto& idle = g_warm_browsers[key_of(format_desc)];
+    if (!idle.empty()) {
+        client = idle.front();
+        idle.erase(idle.begin());
+    }
+
+    // Browsers start asynchronously, the replacement doesn't hold up this one.
+    open_warm_browsers(format_desc);
+    return client;
+}
+
+} // namespace
+
 class html_producer : public core::frame_producer
 {
-    core::video_format_desc             format_desc_;
-    core::monitor::state                state_;
-    const std::wstring                  url_;
-    spl::shared_ptr<diagnostics::graph> graph_;
+    core::video_format_desc format_desc_;
+    core::monitor::state    state_;
+    const std::wstring      url_;
 
     CefRefPtr<html_client> client_;
 
   public:
     html_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
                   const core::video_format_desc&              format_desc,
-                  const std::wstring&                         url)
+                  const std::wstring&                         url,
+                  bool                                        pull)
         : format_desc_(format_desc)
         , url_(url)
     {
         html::invoke([&] {
-            client_ = new html_client(frame_factory, graph_, format_desc, url_);
-
-            CefWindowInfo window_info;
-            window_info.width                        = format_desc.square_width;
-            window_info.height                       = format_desc.square_height;
-            window_info.windowless_rendering_enabled = true;
-
-            const bool enable_gpu = env::properties().get(L"configuration.html.enable-gpu", false);
+            client_ = take_warm_browser(format_desc);
+            if (client_ != nullptr) {
+                client_->bind(frame_factory, url_, true, pull);
+                state_["html/warm"] = true;
+                return;
+            }
 
-            CefBrowserSettings browser_settings;
-            browser_settings.web_security = cef_state_t::STATE_DISABLED;
-            browser_settings.webgl        = enable_gpu ? cef_state_t::STATE_ENABLED : cef_state_t::STATE_DISABLED;
-            double fps                    = format_desc.fps;
-            browser_settings.windowless_frame_rate = int(ceil(fps));
-            CefBrowserHost::CreateBrowser(window_info, client_.get(), url, browser_settings, nullptr);
+            client_ = new html_client(format_desc);
+            client_->bind(frame_factory, url_, false, pull);
+            create_browser(client_, format_desc, url_);
+            state_["html/warm"] = false;
         });
         state_["file/path"] = u8(url_);
     }
@@ -408,11 +715,24 @@ class html_producer : public core::frame_producer
 
     core::draw_frame first_frame() override { return receive_impl(0); }
 
+    // Only stopped producers hide their browser, one loaded in the background still paints its first frame.
+    void priority(core::producer_priority priority) override
+    {
+        if (client_ != nullptr) {
+            client_->hide(priority == core::producer_priority::idle);
+        }
+    }
+
     std::future<std::wstring> call(const std::vector<std::wstring>& params) override
     {
         if (client_ == nullptr)
             return make_ready_future(std::wstring());
 
+        if (params.size() == 2 && params.at(0) == L"update") {
+            client_->cg_update(params.at(1));
+            return make_ready_future(std::wstring());
+        }
+
         auto javascript = params.at(0);
 
         client_->execute_javascript(javascript);
@@ -422,7 +742,14 @@ class html_producer : public core::frame_producer
 
     std::wstring print() const override { return L"html[" + url_ + L"]"; }
 
-    core::monitor::state state() const override { return state_; }
+    core::monitor::state state() const override
+    {
+        auto state = state_;
+        if (client_ != nullptr) {
+            state["html/first-frame-latency"] = client_->first_frame_latency();
+        }
+        return state;
+    }
 };
 
 spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
@@ -463,7 +790,30 @@ spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_produ
         format_desc.square_height = *height;
     }
 
-    return core::create_destroy_proxy(spl::make_shared<html_producer>(dependencies.frame_factory, format_desc, url));
+    return core::create_destroy_proxy(
+        spl::make_shared<html_producer>(dependencies.frame_factory, format_desc, url, dependencies.offline));
+}
+
+void prewarm_browsers(int count)
+{
+    html::invoke([=] { g_prewarm_count = std::max(count, 0); });
+}
+
+void prewarm_browsers(const core::video_format_desc& format_desc)
+{
+    html::invoke([=] { open_warm_browsers(format_desc); });
+}
+
+void close_warm_browsers()
+{
+    html::invoke([] {
+        for (auto& browsers : g_warm_browsers) {
+            for (auto& client : browsers.second) {
+                client->close();
+            }
+        }
+        g_warm_browsers.clear();
+    });
 }
 
 spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
@@ -35,4 +35,11 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 spl::shared_ptr<core::frame_producer> create_cg_producer(const core::frame_producer_dependencies& dependencies,
                                                          const std::vector<std::wstring>&         params);
 
+// Keeps count idle browsers on about:blank for each size and frame rate templates are loaded at, taken by the next
+// template instead of starting a browser for it.
+void prewarm_browsers(int count);
+// Opens the idle browsers for a format ahead of the first template.
+void prewarm_browsers(const core::video_format_desc& format_desc);
+void close_warm_browsers();
+
 }} // namespace caspar::html
\ No newline at end of file
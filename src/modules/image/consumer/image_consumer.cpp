@@ -33,6 +33,9 @@
 #include <common/except.h>
 #include <common/future.h>
 #include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
 #include <common/utf.h>
 
 #include <core/consumer/frame_consumer.h>
@@ -40,77 +43,223 @@
 #include <core/video_format.h>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/crc.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
-
-#include <tbb/concurrent_queue.h>
+#include <boost/filesystem.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "../util/image_view.h"
+#include "../util/image_writer.h"
 #include "image/util/image_algorithms.h"
 
 namespace caspar { namespace image {
 
-struct image_consumer : public core::frame_consumer
+namespace {
+
+// Encoder threads shared by all image consumers. Snapshots beyond what they keep up with are dropped rather than
+// queued, each one holds on to a channel frame until it is written.
+class encoder_pool
 {
-    std::wstring filename_;
+    const std::size_t                 capacity_;
+    std::mutex                        mutex_;
+    std::condition_variable           cond_;
+    std::deque<std::function<void()>> tasks_;
+    bool                              abort_request_ = false;
+    std::vector<std::thread>          threads_;
 
   public:
-    // frame_consumer
+    encoder_pool()
+        : capacity_(std::max(1, env::properties().get(L"configuration.image.encoder-queue", 8)))
+    {
+        const auto count = std::max(1, env::properties().get(L"configuration.image.encoder-threads", 2));
+        for (auto n = 0; n < count; ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"[image::encoder]");
+                set_thread_low_priority();
+                run();
+            });
+        }
+    }
 
-    explicit image_consumer(std::wstring filename)
-        : filename_(std::move(filename))
+    ~encoder_pool()
     {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_request_ = true;
+            tasks_.clear();
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
     }
 
-    void initialize(const core::video_format_desc& /*format_desc*/, int /*channel_index*/) override {}
+    static encoder_pool& instance()
+    {
+        static encoder_pool pool;
+        return pool;
+    }
 
-    std::future<bool> send(core::const_frame frame) override
+    // False if the queue is full.
+    bool post(std::function<void()> task)
     {
-        auto filename = filename_;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (tasks_.size() >= capacity_) {
+                return false;
+            }
+            tasks_.push_back(std::move(task));
+        }
+        cond_.notify_one();
+        return true;
+    }
 
-        std::thread async([frame, filename] {
+  private:
+    void run()
+    {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [&] { return abort_request_ || !tasks_.empty(); });
+                if (abort_request_) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
             try {
-                auto filename2 = filename;
-
-                if (filename2.empty())
-                    filename2 = env::media_folder() +
-                                boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time()) +
-                                L".png";
-                else
-                    filename2 = env::media_folder() + filename2 + L".png";
-
-                auto bitmap = std::shared_ptr<FIBITMAP>(
-                    FreeImage_Allocate(static_cast<int>(frame.width()), static_cast<int>(frame.height()), 32),
-                    FreeImage_Unload);
-                std::memcpy(FreeImage_GetBits(bitmap.get()), frame.image_data(0).begin(), frame.image_data(0).size());
-
-                image_view<bgra_pixel> original_view(
-                    FreeImage_GetBits(bitmap.get()), static_cast<int>(frame.width()), static_cast<int>(frame.height()));
-                unmultiply(original_view);
-
-                FreeImage_FlipVertical(bitmap.get());
-#ifdef WIN32
-                FreeImage_SaveU(FIF_PNG, bitmap.get(), filename2.c_str(), 0);
-#else
-                FreeImage_Save(FIF_PNG, bitmap.get(), u8(filename2).c_str(), 0);
-#endif
+                task();
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
             }
-        });
-        async.detach();
+        }
+    }
+};
+
+void encode(const core::const_frame& frame, const std::wstring& filename, image_format format, int quality)
+{
+    const auto width  = static_cast<int>(frame.width());
+    const auto height = static_cast<int>(frame.height());
+
+    // Copies and flips the top-down frame into the bottom-up bitmap in one pass.
+    auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertFromRawBits(const_cast<BYTE*>(frame.image_data(0).begin()),
+                                                                         width,
+                                                                         height,
+                                                                         width * 4,
+                                                                         32,
+                                                                         FI_RGBA_RED_MASK,
+                                                                         FI_RGBA_GREEN_MASK,
+                                                                         FI_RGBA_BLUE_MASK,
+                                                                         TRUE),
+                                            FreeImage_Unload);
+    if (!bitmap) {
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Failed to allocate bitmap for " + filename));
+    }
+
+    image_view<bgra_pixel> original_view(FreeImage_GetBits(bitmap.get()), width, height);
+    unmultiply(original_view);
+
+    // Written aside and renamed, so whatever polls the file never sees a partial image.
+    const auto tmp = filename + L".tmp";
+    write_image(bitmap.get(), tmp, format, quality);
+    boost::filesystem::rename(tmp, filename);
+}
+
+} // namespace
+
+struct image_consumer : public core::frame_consumer
+{
+    const std::wstring                 filename_;
+    const image_format                 format_;
+    const int                          quality_;
+    const int                          interval_;
+    const int                          width_;
+    int                                format_width_ = 0;
+    std::int64_t                       frame_number_ = 0;
+    std::shared_ptr<std::atomic<bool>> busy_         = std::make_shared<std::atomic<bool>>(false);
+
+  public:
+    // frame_consumer
+
+    image_consumer(std::wstring filename, image_format format, int quality, int interval, int width)
+        : filename_(std::move(filename))
+        , format_(format)
+        , quality_(quality)
+        , interval_(interval)
+        , width_(width)
+    {
+    }
+
+    void initialize(const core::video_format_desc& format_desc, int /*channel_index*/) override
+    {
+        format_width_ = format_desc.width;
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        if (width_ > 0 && width_ < format_width_) {
+            frame = frame.scaled(width_);
+            if (!frame) {
+                // The mixer renders the reduced copy from a later frame on.
+                return make_ready_future(true);
+            }
+        }
+
+        // A single snapshot removes the consumer, with an interval every nth frame replaces the previous file.
+        if (interval_ > 0 && frame_number_++ % interval_ != 0) {
+            return make_ready_future(true);
+        }
+
+        // A consumer whose last snapshot is still being written skips this one instead of queueing behind it.
+        if (busy_->exchange(true)) {
+            return make_ready_future(interval_ > 0);
+        }
+
+        auto filename = env::media_folder() +
+                        (filename_.empty()
+                             ? boost::posix_time::to_iso_wstring(boost::posix_time::second_clock::local_time())
+                             : filename_) +
+                        extension(format_);
 
-        return make_ready_future(false);
+        auto busy    = busy_;
+        auto format  = format_;
+        auto quality = quality_;
+        if (!encoder_pool::instance().post([=] {
+                CASPAR_SCOPE_EXIT { *busy = false; };
+                encode(frame, filename, format, quality);
+            })) {
+            *busy_ = false;
+            CASPAR_LOG(warning) << print() << L" Encoders busy, skipped " << filename;
+        }
+
+        return make_ready_future(interval_ > 0);
     }
 
-    std::wstring print() const override { return L"image[]"; }
+    std::wstring print() const override { return L"image[" + filename_ + L"]"; }
 
     std::wstring name() const override { return L"image"; }
 
-    int index() const override { return 100; }
+    int preview_width() const override { return width_; }
+
+    int index() const override
+    {
+        if (interval_ == 0) {
+            return 100;
+        }
+        boost::crc_16_type result;
+        result.process_bytes(filename_.data(), filename_.length() * sizeof(wchar_t));
+        return 220000 + result.checksum();
+    }
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
@@ -121,10 +270,29 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
 
     std::wstring filename;
 
-    if (params.size() > 1)
+    if (params.size() > 1 && !boost::iequals(params.at(1), L"FORMAT") && !boost::iequals(params.at(1), L"QUALITY") &&
+        !boost::iequals(params.at(1), L"EVERY") && !boost::iequals(params.at(1), L"WIDTH"))
         filename = params.at(1);
 
-    return spl::make_shared<image_consumer>(filename);
+    const auto format  = parse_image_format(get_param(L"FORMAT", params, std::wstring(L"PNG")));
+    const auto quality = get_param(L"QUALITY", params, format == image_format::jpeg ? 90 : 1);
+    const auto every   = std::max(0, get_param(L"EVERY", params, 0));
+    const auto width   = std::max(0, get_param(L"WIDTH", params, 0));
+
+    return spl::make_shared<image_consumer>(filename, format, quality, every, width);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    const auto format  = parse_image_format(ptree.get(L"format", std::wstring(L"PNG")));
+    const auto quality = ptree.get(L"quality", format == image_format::jpeg ? 90 : 1);
+    const auto every   = std::max(1, ptree.get(L"every", 25));
+    const auto width   = std::max(0, ptree.get(L"width", 0));
+
+    return spl::make_shared<image_consumer>(
+        ptree.get(L"filename", std::wstring(L"snapshot")), format, quality, every, width);
 }
 
 }} // namespace caspar::image
@@ -35,4 +35,8 @@ spl::shared_ptr<core::frame_consumer>
 create_consumer(const std::vector<std::wstring>&                         params,
                 const std::vector<spl::shared_ptr<core::video_channel>>& channels);
 
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels);
+
 }} // namespace caspar::image
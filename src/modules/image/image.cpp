@@ -26,6 +26,7 @@
 
 #include "consumer/image_consumer.h"
 #include "producer/image_producer.h"
+#include "producer/image_sequence_producer.h"
 
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
@@ -43,7 +44,9 @@ void init(core::module_dependencies dependencies)
 {
     FreeImage_Initialise();
     dependencies.producer_registry->register_producer_factory(L"Image Producer", create_producer);
+    dependencies.producer_registry->register_producer_factory(L"Image Sequence Producer", create_sequence_producer);
     dependencies.consumer_registry->register_consumer_factory(L"Image Consumer", create_consumer);
+    dependencies.consumer_registry->register_preconfigured_consumer_factory(L"image", create_preconfigured_consumer);
 }
 
 void uninit() { FreeImage_DeInitialise(); }
@@ -28,6 +28,7 @@
 #endif
 #include <FreeImage.h>
 
+#include "../util/decoder_pool.h"
 #include "../util/image_loader.h"
 
 #include <core/video_format.h>
@@ -44,31 +45,172 @@
 #include <common/log.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
+#include <common/timer.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <algorithm>
+#include <ctime>
+#include <functional>
+#include <list>
+#include <mutex>
 #include <set>
 #include <utility>
+#include <vector>
 
 namespace caspar { namespace image {
 
+namespace {
+
+struct file_stamp
+{
+    std::time_t    time = 0;
+    std::uintmax_t size = 0;
+
+    bool operator==(const file_stamp& other) const { return time == other.time && size == other.size; }
+};
+
+bool stamp_file(const std::wstring& filename, file_stamp& stamp)
+{
+    boost::system::error_code ec;
+    stamp.time = boost::filesystem::last_write_time(filename, ec);
+    if (!ec) {
+        stamp.size = boost::filesystem::file_size(filename, ec);
+    }
+    return !ec;
+}
+
+// Decoded images by path and modification time while within image/cache-size. Producers of the same file share one
+// frame, and with it the texture each device keeps from its first upload.
+class image_cache
+{
+    struct entry
+    {
+        std::wstring      filename;
+        file_stamp        stamp;
+        core::const_frame frame;
+    };
+
+    const std::size_t budget_;
+    std::mutex        mutex_;
+    std::list<entry>  entries_; // Most recently used first.
+    std::size_t       bytes_ = 0;
+
+  public:
+    image_cache()
+        : budget_(static_cast<std::size_t>(std::max(0, env::properties().get(L"configuration.image.cache-size", 256)))
+                  << 20)
+    {
+    }
+
+    static image_cache& instance()
+    {
+        static image_cache cache;
+        return cache;
+    }
+
+    core::const_frame find(const std::wstring& filename, const file_stamp& stamp)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->filename == filename && it->stamp == stamp) {
+                entries_.splice(entries_.begin(), entries_, it);
+                return it->frame;
+            }
+        }
+        return core::const_frame{};
+    }
+
+    void insert(const std::wstring& filename, const file_stamp& stamp, const core::const_frame& frame)
+    {
+        if (frame.size() > budget_) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (it->filename == filename) {
+                bytes_ -= it->frame.size();
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        entries_.push_front(entry{filename, stamp, frame});
+        bytes_ += frame.size();
+
+        // Evicted frames stay alive for the producers still drawing them.
+        while (bytes_ > budget_) {
+            bytes_ -= entries_.back().frame.size();
+            entries_.pop_back();
+        }
+    }
+};
+
+} // namespace
+
+// Files are decoded on the decoder pool, the producer is empty until the image is ready unless it was cached.
 struct image_producer : public core::frame_producer
 {
+    // Shared with the decode, which may finish after the producer is gone.
+    struct loaded_image
+    {
+        std::mutex       mutex;
+        core::draw_frame frame;
+        bool             ready = false;
+    };
+
     core::monitor::state                       state_;
     const std::wstring                         description_;
     const spl::shared_ptr<core::frame_factory> frame_factory_;
     const uint32_t                             length_ = 0;
-    core::draw_frame                           frame_;
+    const std::shared_ptr<loaded_image>        image_  = std::make_shared<loaded_image>();
 
     image_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, std::wstring description, uint32_t length)
         : description_(std::move(description))
         , frame_factory_(frame_factory)
         , length_(length)
     {
-        load(load_image(description_));
+        file_stamp stamp;
+        const auto cacheable = stamp_file(description_, stamp);
+        if (cacheable) {
+            auto cached = image_cache::instance().find(description_, stamp);
+            if (cached) {
+                image_->frame          = core::draw_frame(std::move(cached));
+                image_->ready          = true;
+                state_["image/cached"] = true;
+                CASPAR_LOG(info) << print() << L" Initialized from cache";
+                return;
+            }
+        }
+        state_["image/cached"] = false;
+
+        decoder_pool::instance().post(
+            [=, image = image_, frame_factory = frame_factory_, filename = description_, tag = this, name = print()] {
+                caspar::timer timer;
+
+                core::draw_frame frame;
+                try {
+                    auto decoded = load_frame(*frame_factory, tag, filename);
+                    if (cacheable) {
+                        image_cache::instance().insert(filename, stamp, decoded);
+                    }
+                    frame = core::draw_frame(std::move(decoded));
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                    CASPAR_LOG(error) << name << L" Failed to load.";
+                }
+
+                std::lock_guard<std::mutex> lock(image->mutex);
+                image->frame = std::move(frame);
+                image->ready = true;
+
+                CASPAR_LOG(debug) << name << L" Decoded in " << static_cast<int>(timer.elapsed() * 1000.0) << L" ms.";
+            },
+            image_.get());
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
@@ -81,34 +223,39 @@ struct image_producer : public core::frame_producer
         , frame_factory_(frame_factory)
         , length_(length)
     {
-        load(load_png_from_memory(png_data, size));
+        // The caller owns the memory, it is decoded before returning.
+        image_->frame = core::draw_frame(load_png_frame(*frame_factory_, this, png_data, size));
+        image_->ready = true;
 
         CASPAR_LOG(info) << print() << L" Initialized";
     }
 
-    void load(const std::shared_ptr<FIBITMAP>& bitmap)
+    core::draw_frame frame() const
     {
-        FreeImage_FlipVertical(bitmap.get());
-        core::pixel_format_desc desc;
-        desc.format = core::pixel_format::bgra;
-        desc.planes.push_back(
-            core::pixel_format_desc::plane(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4));
-        auto frame = frame_factory_->create_frame(this, desc);
-
-        std::copy_n(FreeImage_GetBits(bitmap.get()), frame.image_data(0).size(), frame.image_data(0).begin());
-        frame_ = core::draw_frame(std::move(frame));
+        std::lock_guard<std::mutex> lock(image_->mutex);
+        return image_->frame;
     }
 
     // frame_producer
 
-    core::draw_frame last_frame() override { return frame_; }
+    core::draw_frame last_frame() override { return frame(); }
+
+    core::draw_frame first_frame() override { return frame(); }
 
-    core::draw_frame first_frame() override { return frame_; }
+    // A played image is decoded before those only loaded.
+    void priority(core::producer_priority priority) override
+    {
+        if (priority == core::producer_priority::foreground) {
+            decoder_pool::instance().promote(image_.get());
+        }
+    }
 
     core::draw_frame receive_impl(int nb_samples) override
     {
-        state_["file/path"] = description_;
-        return frame_;
+        std::lock_guard<std::mutex> lock(image_->mutex);
+        state_["file/path"]    = description_;
+        state_["image/loaded"] = image_->ready;
+        return image_->frame;
     }
 
     uint32_t nb_frames() const override { return length_; }
@@ -138,55 +285,6 @@ spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer
 {
     auto length = get_param(L"LENGTH", params, std::numeric_limits<uint32_t>::max());
 
-    // if (boost::iequals(params.at(0), L"[IMG_SEQUENCE]"))
-    //{
-    //	if (params.size() != 2)
-    //		return core::frame_producer::empty();
-
-    //	auto dir = boost::filesystem::path(env::media_folder() + params.at(1)).parent_path();
-    //	auto basename = boost::filesystem::basename(params.at(1));
-    //	std::set<std::wstring> files;
-    //	boost::filesystem::directory_iterator end;
-
-    //	for (boost::filesystem::directory_iterator it(dir); it != end; ++it)
-    //	{
-    //		auto name = it->path().filename().wstring();
-
-    //		if (!boost::algorithm::istarts_with(name, basename))
-    //			continue;
-
-    //		auto extension = it->path().extension().wstring();
-
-    //		if (std::find_if(supported_extensions().begin(), supported_extensions().end(), ieq(extension)) ==
-    // supported_extensions().end()) 			continue;
-
-    //		files.insert(it->path().wstring());
-    //	}
-
-    //	if (files.empty())
-    //		return core::frame_producer::empty();
-
-    //	int width = -1;
-    //	int height = -1;
-    //	std::vector<core::draw_frame> frames;
-    //	frames.reserve(files.size());
-
-    //	for (auto& file : files)
-    //	{
-    //		auto frame = load_image(dependencies.frame_factory, file);
-
-    //		if (width == -1)
-    //		{
-    //			width = static_cast<int>(frame.second.width.get());
-    //			height = static_cast<int>(frame.second.height.get());
-    //		}
-
-    //		frames.push_back(std::move(frame.first));
-    //	}
-
-    //	return core::create_const_producer(std::move(frames), width, height);
-    //}
-    // else
     // if (boost::iequals(params.at(0), L"[PNG_BASE64]")) {
     //    if (params.size() < 2)
     //        return core::frame_producer::empty();
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_sequence_producer.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include "../util/decoder_pool.h"
+#include "../util/image_loader.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+// A decode in flight or done, shared with the decoder thread.
+struct sequence_slot
+{
+    std::mutex       mutex;
+    core::draw_frame frame;
+    bool             ready = false;
+};
+
+} // namespace
+
+// Each image is shown for one frame of the channel. The next images are decoded in parallel on the decoder pool up to
+// the buffer depth ahead of the playhead, wrapping around when looping, and a late image holds the previous one.
+struct image_sequence_producer : public core::frame_producer
+{
+    const std::vector<std::wstring>            files_;
+    const std::wstring                         description_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const int                                  field_count_;
+    const uint32_t                             depth_;
+    spl::shared_ptr<diagnostics::graph>        graph_;
+
+    mutable std::mutex                                 mutex_;
+    core::monitor::state                               state_;
+    bool                                               loop_;
+    uint32_t                                           length_;
+    uint32_t                                           position_ = 0;
+    int                                                field_    = 0;
+    std::map<uint32_t, std::shared_ptr<sequence_slot>> window_;
+    core::draw_frame                                   frame_;
+
+    image_sequence_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                            const core::video_format_desc&              format_desc,
+                            std::vector<std::wstring>                   files,
+                            std::wstring                                description,
+                            bool                                        loop,
+                            uint32_t                                    seek,
+                            uint32_t                                    length,
+                            uint32_t                                    depth)
+        : files_(std::move(files))
+        , description_(std::move(description))
+        , frame_factory_(frame_factory)
+        , field_count_(std::max(1, format_desc.field_count))
+        , depth_(std::max(1u, std::min(depth, static_cast<uint32_t>(files_.size()))))
+        , loop_(loop)
+        , length_(length)
+        , position_(std::min(seek, static_cast<uint32_t>(files_.size() - 1)))
+    {
+        graph_->set_color("buffered", diagnostics::color(1.0f, 1.0f, 0.0f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.9f));
+        graph_->set_text(print());
+        diagnostics::register_graph(graph_);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        prefetch();
+
+        CASPAR_LOG(info) << print() << L" Initialized with " << files_.size() << L" images";
+    }
+
+    // Keeps the images from the playhead to the buffer depth decoding and drops those behind it.
+    void prefetch()
+    {
+        std::map<uint32_t, std::shared_ptr<sequence_slot>> window;
+
+        auto index = position_;
+        for (uint32_t n = 0; n < depth_; ++n) {
+            auto it = window_.find(index);
+            if (it != window_.end()) {
+                window.insert(*it);
+            } else {
+                auto slot = std::make_shared<sequence_slot>();
+                decoder_pool::instance().post([slot,
+                                               frame_factory = frame_factory_,
+                                               filename      = files_[index],
+                                               tag           = static_cast<const void*>(this)] {
+                    core::draw_frame frame;
+                    try {
+                        frame = core::draw_frame(load_frame(*frame_factory, tag, filename));
+                    } catch (...) {
+                        CASPAR_LOG_CURRENT_EXCEPTION();
+                        CASPAR_LOG(warning) << L"[image_sequence_producer] Skipping " << filename;
+                    }
+
+                    std::lock_guard<std::mutex> lock(slot->mutex);
+                    slot->frame = std::move(frame);
+                    slot->ready = true;
+                });
+                window.emplace(index, std::move(slot));
+            }
+
+            if (++index >= files_.size()) {
+                if (!loop_) {
+                    break;
+                }
+                index = 0;
+            }
+        }
+
+        window_ = std::move(window);
+    }
+
+    uint32_t buffered() const
+    {
+        uint32_t count = 0;
+        for (auto& slot : window_) {
+            std::lock_guard<std::mutex> lock(slot.second->mutex);
+            count += slot.second->ready ? 1 : 0;
+        }
+        return count;
+    }
+
+    void seek(uint32_t position)
+    {
+        position_ = std::min(position, static_cast<uint32_t>(files_.size() - 1));
+        field_    = 0;
+        prefetch();
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        graph_->set_value("buffered", static_cast<double>(buffered()) / depth_);
+
+        state_["file/path"]         = description_;
+        state_["file/frame"]        = static_cast<int64_t>(position_);
+        state_["file/frames"]       = static_cast<int64_t>(files_.size());
+        state_["image/loop"]        = loop_;
+        state_["image/buffered"]    = static_cast<int64_t>(buffered());
+        state_["image/buffer-size"] = static_cast<int64_t>(depth_);
+
+        // Progressive images span all fields of an interlaced channel frame.
+        if (field_ > 0) {
+            field_ = (field_ + 1) % field_count_;
+            return frame_;
+        }
+
+        auto it = window_.find(position_);
+        if (it == window_.end()) {
+            return frame_;
+        }
+
+        {
+            std::lock_guard<std::mutex> slot_lock(it->second->mutex);
+            if (!it->second->ready) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+                return frame_;
+            }
+            if (it->second->frame) {
+                frame_ = it->second->frame;
+            }
+        }
+
+        field_ = 1 % field_count_;
+        if (position_ + 1 < files_.size()) {
+            ++position_;
+        } else if (loop_) {
+            position_ = 0;
+        } else {
+            // The last image is held.
+            return frame_;
+        }
+        prefetch();
+
+        return frame_;
+    }
+
+    core::draw_frame first_frame() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return frame_;
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        const auto cmd   = params.at(0);
+        const auto value = params.size() > 1 ? params.at(1) : L"";
+
+        if (boost::iequals(cmd, L"loop")) {
+            if (!value.empty()) {
+                loop_ = boost::lexical_cast<bool>(value);
+                prefetch();
+            }
+            return make_ready_future(std::to_wstring(loop_));
+        }
+        if (boost::iequals(cmd, L"seek") && !value.empty()) {
+            seek(boost::lexical_cast<uint32_t>(value));
+            return make_ready_future(std::to_wstring(position_));
+        }
+        if (boost::iequals(cmd, L"length")) {
+            if (!value.empty()) {
+                length_ = boost::lexical_cast<uint32_t>(value);
+            }
+            return make_ready_future(std::to_wstring(length_));
+        }
+
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid command: " + cmd));
+    }
+
+    uint32_t nb_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return loop_ ? std::numeric_limits<uint32_t>::max() : length_;
+    }
+
+    std::wstring print() const override { return L"image_sequence_producer[" + description_ + L"]"; }
+
+    std::wstring name() const override { return L"image-sequence"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_sequence_producer(const core::frame_producer_dependencies& dependencies,
+                                                               const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"[IMG_SEQUENCE]")) {
+        return core::frame_producer::empty();
+    }
+
+    const auto path = boost::filesystem::path(env::media_folder() + params.at(1));
+    const auto all  = boost::ends_with(params.at(1), L"/") || boost::ends_with(params.at(1), L"\\");
+    const auto dir  = all ? path : path.parent_path();
+    const auto base = all ? std::wstring() : path.filename().wstring();
+
+    boost::system::error_code ec;
+    if (!boost::filesystem::is_directory(dir, ec)) {
+        return core::frame_producer::empty();
+    }
+
+    std::vector<std::wstring> files;
+    for (boost::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const auto name      = it->path().filename().wstring();
+        const auto extension = boost::to_lower_copy(it->path().extension().wstring());
+        if (boost::istarts_with(name, base) && supported_extensions().count(extension) > 0) {
+            files.push_back(it->path().wstring());
+        }
+    }
+
+    if (files.empty()) {
+        return core::frame_producer::empty();
+    }
+    std::sort(files.begin(), files.end());
+
+    // Enough images ahead to keep every decoder thread busy through a slow one.
+    const auto default_depth = static_cast<uint32_t>(decoder_pool::instance().thread_count() * 4);
+
+    const auto loop   = contains_param(L"LOOP", params);
+    const auto seek   = get_param(L"SEEK", params, static_cast<uint32_t>(0));
+    const auto length = get_param(L"LENGTH", params, static_cast<uint32_t>(files.size()));
+    const auto depth  = get_param(L"BUFFER", params, default_depth);
+
+    return spl::make_shared<image_sequence_producer>(dependencies.frame_factory,
+                                                     dependencies.format_desc,
+                                                     std::move(files),
+                                                     params.at(1),
+                                                     loop,
+                                                     seek,
+                                                     length,
+                                                     depth);
+}
+
+}} // namespace caspar::image
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "decoder_pool.h"
+
+#include <common/env.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+
+namespace caspar { namespace image {
+
+decoder_pool::decoder_pool()
+{
+    const auto count = std::max(1, env::properties().get(L"configuration.image.decoder-threads", 2));
+    for (auto n = 0; n < count; ++n) {
+        threads_.emplace_back([this] {
+            set_thread_name(L"[image::decoder]");
+            run();
+        });
+    }
+}
+
+decoder_pool::~decoder_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        abort_request_ = true;
+        tasks_.clear();
+    }
+    cond_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+decoder_pool& decoder_pool::instance()
+{
+    static decoder_pool pool;
+    return pool;
+}
+
+int decoder_pool::thread_count() const { return static_cast<int>(threads_.size()); }
+
+void decoder_pool::post(std::function<void()> func, const void* owner)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(task{owner, std::move(func)});
+    }
+    cond_.notify_one();
+}
+
+void decoder_pool::promote(const void* owner)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::stable_partition(tasks_.begin(), tasks_.end(), [&](const task& t) { return t.owner == owner; });
+}
+
+void decoder_pool::run()
+{
+    while (true) {
+        std::function<void()> func;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return abort_request_ || !tasks_.empty(); });
+            if (abort_request_) {
+                return;
+            }
+            func = std::move(tasks_.front().func);
+            tasks_.pop_front();
+        }
+        try {
+            func();
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+    }
+}
+
+}} // namespace caspar::image
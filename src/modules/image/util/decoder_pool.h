@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace image {
+
+// Decoder threads shared by all image producers, so that neither LOAD nor playback waits for an image to decode.
+class decoder_pool
+{
+    struct task
+    {
+        const void*           owner;
+        std::function<void()> func;
+    };
+
+    std::mutex               mutex_;
+    std::condition_variable  cond_;
+    std::deque<task>         tasks_;
+    bool                     abort_request_ = false;
+    std::vector<std::thread> threads_;
+
+  public:
+    decoder_pool();
+    ~decoder_pool();
+
+    decoder_pool(const decoder_pool&) = delete;
+    decoder_pool& operator=(const decoder_pool&) = delete;
+
+    static decoder_pool& instance();
+
+    int  thread_count() const;
+    void post(std::function<void()> func, const void* owner = nullptr);
+
+    // Moves the pending tasks of owner ahead of all others, e.g. those of a producer that is played.
+    void promote(const void* owner);
+
+  private:
+    void run();
+};
+
+}} // namespace caspar::image
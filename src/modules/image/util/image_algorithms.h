@@ -24,6 +24,7 @@
 #include <common/tweener.h>
 
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
 
 namespace caspar { namespace image {
@@ -196,6 +197,18 @@ void premultiply(SrcDstView& view_to_modify)
     });
 }
 
+/**
+ * Premultiply BGRA pixels with their alpha while copying them, giving the same
+ * result as premultiply() on an image view. Large images are split over the
+ * task scheduler, and each part uses AVX2 when the CPU has it.
+ *
+ * @param dst    The destination of the premultiplied pixels. May be src to
+ *               premultiply in place.
+ * @param src    The pixels with straight alpha.
+ * @param pixels The number of pixels.
+ */
+void premultiply(std::uint8_t* dst, const std::uint8_t* src, std::size_t pixels);
+
 /**
  * Un-multiply with alpha for each pixel in an ImageView. The modifications is
  * done in place. The pixel type of the ImageView must model the RGBAPixel
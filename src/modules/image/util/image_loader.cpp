@@ -20,6 +20,7 @@
  */
 
 #include "image_loader.h"
+#include "texture_loader.h"
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
@@ -31,6 +32,11 @@
 #include <common/except.h>
 #include <common/utf.h>
 
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+
 #if defined(_MSC_VER)
 #pragma warning(disable : 4714) // marked as __forceinline not inlined
 #endif
@@ -39,11 +45,83 @@
 #include <boost/filesystem.hpp>
 
 #include "image_algorithms.h"
-#include "image_view.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
 
 namespace caspar { namespace image {
 
-std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
+namespace {
+
+// OpenEXR and other float images hold premultiplied linear light, encoded here to 8 bit sRGB.
+std::shared_ptr<FIBITMAP> float_to_bgra(FIBITMAP* src)
+{
+    static const auto encode = [] {
+        std::array<BYTE, 4096> table;
+        for (auto n = 0; n < static_cast<int>(table.size()); ++n) {
+            const auto v = static_cast<double>(n) / (table.size() - 1);
+            const auto e = v <= 0.0031308 ? v * 12.92 : 1.055 * std::pow(v, 1.0 / 2.4) - 0.055;
+            table[n]     = static_cast<BYTE>(e * 255.0 + 0.5);
+        }
+        return table;
+    }();
+    const auto to_byte = [](float v, bool linear) -> BYTE {
+        const auto c = std::min(std::max(v, 0.0f), 1.0f);
+        return linear ? static_cast<BYTE>(c * 255.0f + 0.5f) : encode[static_cast<int>(c * (encode.size() - 1))];
+    };
+
+    const auto type     = FreeImage_GetImageType(src);
+    const auto channels = type == FIT_RGBAF ? 4u : type == FIT_RGBF ? 3u : 1u;
+    const auto width    = FreeImage_GetWidth(src);
+    const auto height   = FreeImage_GetHeight(src);
+
+    auto dst = std::shared_ptr<FIBITMAP>(
+        FreeImage_Allocate(width, height, 32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK),
+        FreeImage_Unload);
+    if (!dst)
+        CASPAR_THROW_EXCEPTION(bad_alloc());
+
+    for (unsigned y = 0; y < height; ++y) {
+        auto in  = reinterpret_cast<const float*>(FreeImage_GetScanLine(src, y));
+        auto out = FreeImage_GetScanLine(dst.get(), y);
+        for (unsigned x = 0; x < width; ++x) {
+            const auto px = in + x * channels;
+            const auto r  = px[0];
+            const auto g  = channels > 1 ? px[1] : r;
+            const auto b  = channels > 1 ? px[2] : r;
+
+            out[x * 4 + FI_RGBA_RED]   = to_byte(r, false);
+            out[x * 4 + FI_RGBA_GREEN] = to_byte(g, false);
+            out[x * 4 + FI_RGBA_BLUE]  = to_byte(b, false);
+            out[x * 4 + FI_RGBA_ALPHA] = channels == 4 ? to_byte(px[3], true) : 255;
+        }
+    }
+    return dst;
+}
+
+} // namespace
+
+// FreeImage bitmaps are stored bottom-up, they are drawn upside down instead of being flipped in memory.
+const core::frame_geometry& bottom_up_geometry()
+{
+    static std::vector<core::frame_geometry::coord> data = {
+        //    vertex    texture
+        {0.0, 0.0, 0.0, 1.0}, // upper left
+        {1.0, 0.0, 1.0, 1.0}, // upper right
+        {1.0, 1.0, 1.0, 0.0}, // lower right
+        {0.0, 1.0, 0.0, 0.0}  // lower left
+    };
+    static const core::frame_geometry g(core::frame_geometry::geometry_type::quad, data);
+
+    return g;
+}
+
+namespace {
+
+// PNG images come with straight alpha, they are premultiplied when copied into a frame.
+std::shared_ptr<FIBITMAP> decode_image(const std::wstring& filename, bool& straight_alpha)
 {
     if (!boost::filesystem::exists(filename))
         CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
@@ -70,23 +148,23 @@ std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
     auto bitmap = std::shared_ptr<FIBITMAP>(FreeImage_Load(fif, u8(filename).c_str(), 0), FreeImage_Unload);
 #endif
 
-    if (FreeImage_GetBPP(bitmap.get()) != 32) {
+    if (!bitmap)
+        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Could not decode image."));
+
+    const auto type = FreeImage_GetImageType(bitmap.get());
+    if (type == FIT_FLOAT || type == FIT_RGBF || type == FIT_RGBAF) {
+        bitmap = float_to_bgra(bitmap.get());
+    } else if (FreeImage_GetBPP(bitmap.get()) != 32) {
         bitmap = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo32Bits(bitmap.get()), FreeImage_Unload);
         if (!bitmap)
             CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
     }
 
-    // PNG-images need to be premultiplied with their alpha
-    if (fif == FIF_PNG) {
-        image_view<bgra_pixel> original_view(
-            FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-        premultiply(original_view);
-    }
-
+    straight_alpha = fif == FIF_PNG;
     return bitmap;
 }
 
-std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size_t size)
+std::shared_ptr<FIBITMAP> decode_png(const void* memory_location, size_t size)
 {
     FREE_IMAGE_FORMAT fif = FIF_PNG;
 
@@ -102,19 +180,83 @@ std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size
             CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Unsupported image format."));
     }
 
-    // PNG-images need to be premultiplied with their alpha
-    image_view<bgra_pixel> original_view(
-        FreeImage_GetBits(bitmap.get()), FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()));
-    premultiply(original_view);
     return bitmap;
 }
 
+std::size_t pixels(const std::shared_ptr<FIBITMAP>& bitmap)
+{
+    return static_cast<std::size_t>(FreeImage_GetWidth(bitmap.get())) * FreeImage_GetHeight(bitmap.get());
+}
+
+core::const_frame copy_frame(core::frame_factory&             frame_factory,
+                             const void*                       tag,
+                             const std::shared_ptr<FIBITMAP>& bitmap,
+                             bool                              straight_alpha)
+{
+    core::pixel_format_desc desc;
+    desc.format = core::pixel_format::bgra;
+    desc.planes.push_back(
+        core::pixel_format_desc::plane(FreeImage_GetWidth(bitmap.get()), FreeImage_GetHeight(bitmap.get()), 4));
+    auto frame = frame_factory.create_frame(tag, desc);
+
+    if (straight_alpha) {
+        premultiply(frame.image_data(0).data(), FreeImage_GetBits(bitmap.get()), pixels(bitmap));
+    } else {
+        std::copy_n(FreeImage_GetBits(bitmap.get()), frame.image_data(0).size(), frame.image_data(0).begin());
+    }
+    frame.geometry() = bottom_up_geometry();
+    return core::const_frame(std::move(frame));
+}
+
+} // namespace
+
+std::shared_ptr<FIBITMAP> load_image(const std::wstring& filename)
+{
+    auto straight_alpha = false;
+    auto bitmap         = decode_image(filename, straight_alpha);
+    if (straight_alpha) {
+        premultiply(FreeImage_GetBits(bitmap.get()), FreeImage_GetBits(bitmap.get()), pixels(bitmap));
+    }
+    return bitmap;
+}
+
+std::shared_ptr<FIBITMAP> load_png_from_memory(const void* memory_location, size_t size)
+{
+    auto bitmap = decode_png(memory_location, size);
+    premultiply(FreeImage_GetBits(bitmap.get()), FreeImage_GetBits(bitmap.get()), pixels(bitmap));
+    return bitmap;
+}
+
+
 const std::set<std::wstring>& supported_extensions()
 {
     static const std::set<std::wstring> extensions = {
-        L".png", L".tga", L".bmp", L".jpg", L".jpeg", L".gif", L".tiff", L".tif", L".jp2", L".jpx", L".j2k", L".j2c"};
+        L".png", L".tga", L".bmp", L".jpg", L".jpeg", L".gif", L".tiff", L".tif", L".jp2", L".jpx", L".j2k", L".j2c",
+        L".exr", L".dds", L".ktx"};
 
     return extensions;
 }
 
+core::const_frame
+load_frame(core::frame_factory& frame_factory, const void* tag, const std::shared_ptr<FIBITMAP>& bitmap)
+{
+    return copy_frame(frame_factory, tag, bitmap, false);
+}
+
+core::const_frame load_frame(core::frame_factory& frame_factory, const void* tag, const std::wstring& filename)
+{
+    if (is_compressed_texture(filename)) {
+        return load_compressed_texture(frame_factory, tag, filename);
+    }
+
+    auto straight_alpha = false;
+    auto bitmap         = decode_image(filename, straight_alpha);
+    return copy_frame(frame_factory, tag, bitmap, straight_alpha);
+}
+
+core::const_frame load_png_frame(core::frame_factory& frame_factory, const void* tag, const void* memory, size_t size)
+{
+    return copy_frame(frame_factory, tag, decode_png(memory, size), true);
+}
+
 }} // namespace caspar::image
@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include <core/fwd.h>
+
 #include <memory>
 #include <set>
 #include <string>
@@ -33,4 +35,17 @@ std::shared_ptr<FIBITMAP>     load_image(const std::wstring& filename);
 std::shared_ptr<FIBITMAP>     load_png_from_memory(const void* memory_location, size_t size);
 const std::set<std::wstring>& supported_extensions();
 
+// FreeImage bitmaps are stored bottom-up, they are drawn upside down instead of being flipped in memory.
+const core::frame_geometry& bottom_up_geometry();
+
+// Copies a loaded bitmap into an upload buffer of the frame factory. The rows stay bottom-up, the frame's geometry
+// draws them the right way up.
+core::const_frame
+load_frame(core::frame_factory& frame_factory, const void* tag, const std::shared_ptr<FIBITMAP>& bitmap);
+
+// Loads any of the supported extensions, compressed textures are uploaded without being decoded. PNG images are
+// premultiplied as they are copied into the frame, rather than in the bitmap first.
+core::const_frame load_frame(core::frame_factory& frame_factory, const void* tag, const std::wstring& filename);
+core::const_frame load_png_frame(core::frame_factory& frame_factory, const void* tag, const void* memory, size_t size);
+
 }} // namespace caspar::image
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "image_writer.h"
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#if defined(_MSC_VER)
+#include <windows.h>
+#endif
+#include <FreeImage.h>
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// https://qoiformat.org/qoi-specification.pdf
+void write_qoi(FIBITMAP* bitmap, const std::wstring& filename)
+{
+    struct pixel
+    {
+        uint8_t r, g, b, a;
+
+        bool operator==(const pixel& other) const
+        {
+            return r == other.r && g == other.g && b == other.b && a == other.a;
+        }
+    };
+
+    const auto width  = FreeImage_GetWidth(bitmap);
+    const auto height = FreeImage_GetHeight(bitmap);
+
+    std::vector<uint8_t> out;
+    out.reserve(static_cast<size_t>(width) * height * 2 + 22);
+    out.insert(out.end(), {'q', 'o', 'i', 'f'});
+    put_u32(out, width);
+    put_u32(out, height);
+    out.push_back(4);
+    out.push_back(0);
+
+    pixel index[64] = {};
+    pixel prev      = {0, 0, 0, 255};
+    int   run       = 0;
+
+    for (auto y = 0U; y < height; ++y) {
+        // FreeImage bitmaps are stored bottom-up.
+        const auto line = FreeImage_GetScanLine(bitmap, static_cast<int>(height - 1 - y));
+        for (auto x = 0U; x < width; ++x) {
+            const auto src = line + x * 4;
+            const auto px  = pixel{src[FI_RGBA_RED], src[FI_RGBA_GREEN], src[FI_RGBA_BLUE], src[FI_RGBA_ALPHA]};
+
+            if (px == prev) {
+                if (++run == 62) {
+                    out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+
+            if (run > 0) {
+                out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+                run = 0;
+            }
+
+            const auto hash = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+            if (index[hash] == px) {
+                out.push_back(static_cast<uint8_t>(hash));
+            } else if (px.a == prev.a) {
+                index[hash] = px;
+
+                const auto vr   = static_cast<int8_t>(px.r - prev.r);
+                const auto vg   = static_cast<int8_t>(px.g - prev.g);
+                const auto vb   = static_cast<int8_t>(px.b - prev.b);
+                const auto vg_r = vr - vg;
+                const auto vg_b = vb - vg;
+
+                if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                    out.push_back(static_cast<uint8_t>(0x40 | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2)));
+                } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+                    out.push_back(static_cast<uint8_t>(0x80 | (vg + 32)));
+                    out.push_back(static_cast<uint8_t>((vg_r + 8) << 4 | (vg_b + 8)));
+                } else {
+                    out.insert(out.end(), {0xfe, px.r, px.g, px.b});
+                }
+            } else {
+                index[hash] = px;
+                out.insert(out.end(), {0xff, px.r, px.g, px.b, px.a});
+            }
+            prev = px;
+        }
+    }
+    if (run > 0) {
+        out.push_back(static_cast<uint8_t>(0xc0 | (run - 1)));
+    }
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+
+    boost::filesystem::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    if (!file) {
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to write " + filename));
+    }
+}
+
+bool save(FREE_IMAGE_FORMAT fif, FIBITMAP* bitmap, const std::wstring& filename, int flags)
+{
+#ifdef WIN32
+    return FreeImage_SaveU(fif, bitmap, filename.c_str(), flags) != 0;
+#else
+    return FreeImage_Save(fif, bitmap, u8(filename).c_str(), flags) != 0;
+#endif
+}
+
+} // namespace
+
+image_format parse_image_format(const std::wstring& name)
+{
+    if (boost::iequals(name, L"JPEG") || boost::iequals(name, L"JPG")) {
+        return image_format::jpeg;
+    }
+    if (boost::iequals(name, L"QOI")) {
+        return image_format::qoi;
+    }
+    return image_format::png;
+}
+
+const wchar_t* extension(image_format format)
+{
+    switch (format) {
+        case image_format::jpeg:
+            return L".jpg";
+        case image_format::qoi:
+            return L".qoi";
+        default:
+            return L".png";
+    }
+}
+
+void write_image(FIBITMAP* bitmap, const std::wstring& filename, image_format format, int quality)
+{
+    auto result = true;
+
+    switch (format) {
+        case image_format::qoi:
+            write_qoi(bitmap, filename);
+            break;
+        case image_format::jpeg: {
+            // JPEG has no alpha.
+            auto rgb = std::shared_ptr<FIBITMAP>(FreeImage_ConvertTo24Bits(bitmap), FreeImage_Unload);
+            result   = rgb && save(FIF_JPEG, rgb.get(), filename, std::max(1, std::min(quality, 100)));
+            break;
+        }
+        default:
+            result = save(FIF_PNG, bitmap, filename, std::max(1, std::min(quality, 9)));
+            break;
+    }
+
+    if (!result) {
+        CASPAR_THROW_EXCEPTION(file_write_error() << msg_info(L"Failed to save " + filename));
+    }
+}
+
+}} // namespace caspar::image
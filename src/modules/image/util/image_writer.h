@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+
+struct FIBITMAP;
+
+namespace caspar { namespace image {
+
+enum class image_format
+{
+    png,
+    jpeg,
+    qoi
+};
+
+// PNG, JPEG or QOI from the name, png for anything else.
+image_format parse_image_format(const std::wstring& name);
+
+const wchar_t* extension(image_format format);
+
+// Saves a straight alpha 32 bit bitmap. Quality is the zlib level for PNG, 0-100 for JPEG and unused for QOI, which
+// is lossless and several times faster to encode than PNG at any level.
+void write_image(FIBITMAP* bitmap, const std::wstring& filename, image_format format, int quality);
+
+}} // namespace caspar::image
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "texture_loader.h"
+#include "image_loader.h"
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/geometry.h>
+#include <core/frame/pixel_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace image {
+
+namespace {
+
+struct texture_header
+{
+    core::pixel_format format    = core::pixel_format::invalid;
+    int                width     = 0;
+    int                height    = 0;
+    bool               bottom_up = false;
+};
+
+std::uint32_t read_u32(const char* data)
+{
+    std::uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+void read_exactly(std::istream& stream, char* data, std::size_t size, const std::wstring& filename)
+{
+    stream.read(data, static_cast<std::streamsize>(size));
+    if (static_cast<std::size_t>(stream.gcount()) != size) {
+        CASPAR_THROW_EXCEPTION(file_read_error()
+                               << msg_info("Truncated texture file.") << boost::errinfo_file_name(u8(filename)));
+    }
+}
+
+texture_header read_dds(std::istream& stream, const std::wstring& filename)
+{
+    // Magic and DDS_HEADER.
+    char header[128];
+    read_exactly(stream, header, sizeof(header), filename);
+    if (std::memcmp(header, "DDS ", 4) != 0 || read_u32(header + 4) != 124) {
+        CASPAR_THROW_EXCEPTION(invalid_argument()
+                               << msg_info("Not a DDS file.") << boost::errinfo_file_name(u8(filename)));
+    }
+
+    texture_header result;
+    result.height = static_cast<int>(read_u32(header + 12));
+    result.width  = static_cast<int>(read_u32(header + 16));
+
+    const auto four_cc = header + 84;
+    if (std::memcmp(four_cc, "DXT5", 4) == 0) {
+        result.format = core::pixel_format::bc3;
+    } else if (std::memcmp(four_cc, "DX10", 4) == 0) {
+        char dx10[20];
+        read_exactly(stream, dx10, sizeof(dx10), filename);
+        switch (read_u32(dx10)) {
+            case 76: // DXGI_FORMAT_BC3_TYPELESS
+            case 77: // DXGI_FORMAT_BC3_UNORM
+            case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+                result.format = core::pixel_format::bc3;
+                break;
+            case 97: // DXGI_FORMAT_BC7_TYPELESS
+            case 98: // DXGI_FORMAT_BC7_UNORM
+            case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+                result.format = core::pixel_format::bc7;
+                break;
+        }
+    }
+    return result;
+}
+
+texture_header read_ktx(std::istream& stream, const std::wstring& filename)
+{
+    static const unsigned char identifier[] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+    char header[64];
+    read_exactly(stream, header, sizeof(header), filename);
+    if (std::memcmp(header, identifier, sizeof(identifier)) != 0) {
+        CASPAR_THROW_EXCEPTION(invalid_argument()
+                               << msg_info("Not a KTX 1 file.") << boost::errinfo_file_name(u8(filename)));
+    }
+    if (read_u32(header + 12) != 0x04030201) {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Big endian KTX files are not supported.")
+                                               << boost::errinfo_file_name(u8(filename)));
+    }
+
+    texture_header result;
+    switch (read_u32(header + 28)) {
+        case 0x83F3: // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+            result.format = core::pixel_format::bc3;
+            break;
+        case 0x8E8C: // GL_COMPRESSED_RGBA_BPTC_UNORM
+        case 0x8E8D: // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+            result.format = core::pixel_format::bc7;
+            break;
+    }
+    result.width  = static_cast<int>(read_u32(header + 36));
+    result.height = static_cast<int>(read_u32(header + 40));
+
+    // Rows are taken as top-down unless the orientation says otherwise.
+    std::vector<char> key_values(read_u32(header + 60));
+    read_exactly(stream, key_values.data(), key_values.size(), filename);
+    for (std::size_t offset = 0; offset + 4 <= key_values.size();) {
+        const auto size  = read_u32(key_values.data() + offset);
+        const auto begin = key_values.data() + offset + 4;
+        if (size > key_values.size() - offset - 4) {
+            break;
+        }
+        const auto pair = std::string(begin, std::find(begin, begin + size, '\0'));
+        if (pair == "KTXorientation") {
+            result.bottom_up = std::string(begin, begin + size).find("T=u") != std::string::npos;
+        }
+        offset += 4 + (size + 3) / 4 * 4;
+    }
+
+    // imageSize of the first mip level.
+    char image_size[4];
+    read_exactly(stream, image_size, sizeof(image_size), filename);
+    return result;
+}
+
+} // namespace
+
+bool is_compressed_texture(const std::wstring& filename)
+{
+    const auto extension = boost::to_lower_copy(boost::filesystem::path(filename).extension().wstring());
+    return extension == L".dds" || extension == L".ktx";
+}
+
+core::const_frame
+load_compressed_texture(core::frame_factory& frame_factory, const void* tag, const std::wstring& filename)
+{
+    if (!boost::filesystem::exists(filename))
+        CASPAR_THROW_EXCEPTION(file_not_found() << boost::errinfo_file_name(u8(filename)));
+
+    boost::filesystem::ifstream stream(boost::filesystem::path(filename), std::ios::binary);
+    if (!stream) {
+        CASPAR_THROW_EXCEPTION(file_read_error() << boost::errinfo_file_name(u8(filename)));
+    }
+
+    const auto extension = boost::to_lower_copy(boost::filesystem::path(filename).extension().wstring());
+    const auto header    = extension == L".ktx" ? read_ktx(stream, filename) : read_dds(stream, filename);
+
+    if (header.format == core::pixel_format::invalid) {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Only BC3 (DXT5) and BC7 textures are supported.")
+                                               << boost::errinfo_file_name(u8(filename)));
+    }
+    // A row of blocks covers 4 lines, the texture is as large as its blocks.
+    if (header.width <= 0 || header.height <= 0 || header.width % 4 != 0 || header.height % 4 != 0) {
+        CASPAR_THROW_EXCEPTION(not_supported() << msg_info("Compressed textures must be a multiple of 4 in size.")
+                                               << boost::errinfo_file_name(u8(filename)));
+    }
+
+    // BC3 and BC7 both store 16 bytes per 4x4 block, a byte per pixel.
+    core::pixel_format_desc desc(header.format);
+    desc.planes.push_back(core::pixel_format_desc::plane(header.width, header.height, 1));
+    auto frame = frame_factory.create_frame(tag, desc);
+
+    read_exactly(stream, reinterpret_cast<char*>(frame.image_data(0).begin()), frame.image_data(0).size(), filename);
+    if (header.bottom_up) {
+        frame.geometry() = bottom_up_geometry();
+    }
+    return core::const_frame(std::move(frame));
+}
+
+}} // namespace caspar::image
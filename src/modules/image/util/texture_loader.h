@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <core/fwd.h>
+
+#include <string>
+
+namespace caspar { namespace image {
+
+// DDS and KTX files holding BC3 (DXT5) or BC7 blocks, which are uploaded as stored and stay compressed on the GPU.
+bool is_compressed_texture(const std::wstring& filename);
+
+// Reads the first mip level straight into an upload buffer of the frame factory. The blocks hold straight alpha, the
+// image shader premultiplies it.
+core::const_frame
+load_compressed_texture(core::frame_factory& frame_factory, const void* tag, const std::wstring& filename);
+
+}} // namespace caspar::image
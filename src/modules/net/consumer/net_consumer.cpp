@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net_consumer.h"
+
+#include "../util/frame_header.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+namespace caspar { namespace net {
+
+namespace {
+
+// A client on the receiving side. At most one frame waits behind the one being written, a newer frame replaces it.
+class connection : public std::enable_shared_from_this<connection>
+{
+    tcp::socket       socket_;
+    frame_header      header_;
+    core::const_frame frame_;
+    frame_header      pending_header_;
+    core::const_frame pending_;
+    bool              writing_ = false;
+    bool              closed_  = false;
+
+  public:
+    explicit connection(tcp::socket socket)
+        : socket_(std::move(socket))
+    {
+    }
+
+    bool closed() const { return closed_; }
+
+    // False when a frame the client had not received yet was replaced.
+    bool send(const frame_header& header, const core::const_frame& frame)
+    {
+        if (!writing_) {
+            write(header, frame);
+            return true;
+        }
+
+        auto replaced   = static_cast<bool>(pending_);
+        pending_header_ = header;
+        pending_        = frame;
+        return !replaced;
+    }
+
+  private:
+    void write(const frame_header& header, const core::const_frame& frame)
+    {
+        writing_ = true;
+        header_  = header;
+        frame_   = frame;
+
+        // Written straight from the frame, which is kept alive until the write completes.
+        std::array<boost::asio::const_buffer, 3> buffers = {
+            {boost::asio::buffer(&header_, sizeof(header_)),
+             boost::asio::buffer(frame_.image_data(0).begin(), static_cast<std::size_t>(header_.image_size)),
+             boost::asio::buffer(frame_.audio_data().begin(),
+                                 static_cast<std::size_t>(header_.samples) * sizeof(std::int32_t))}};
+
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, buffers, [self](const boost::system::error_code& ec, std::size_t) {
+            self->writing_ = false;
+            self->frame_   = core::const_frame{};
+            if (ec) {
+                self->closed_  = true;
+                self->pending_ = core::const_frame{};
+                return;
+            }
+            if (self->pending_) {
+                auto frame     = std::move(self->pending_);
+                self->pending_ = core::const_frame{};
+                self->write(self->pending_header_, frame);
+            }
+        });
+    }
+};
+
+} // namespace
+
+// Serves every channel frame to the net producers of other servers connected to the port, uncompressed. A client
+// that falls behind skips frames instead of holding up the channel or the other clients.
+struct net_consumer : public core::frame_consumer
+{
+    core::monitor::state                state_;
+    mutable std::mutex                  state_mutex_;
+    const unsigned short                port_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    core::video_format_desc             format_desc_;
+    std::int64_t                        number_  = 0;
+    std::int64_t                        dropped_ = 0;
+
+    boost::asio::io_context                                                  service_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    tcp::acceptor                                                            acceptor_;
+    std::list<std::shared_ptr<connection>>                                   connections_;
+    std::thread                                                              thread_;
+
+  public:
+    explicit net_consumer(unsigned short port)
+        : port_(port)
+        , work_(boost::asio::make_work_guard(service_))
+        , acceptor_(service_, tcp::endpoint(tcp::v4(), port))
+    {
+        diagnostics::register_graph(graph_);
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_text(print());
+
+        accept();
+        thread_ = std::thread([this] {
+            set_thread_name(L"net_consumer");
+            service_.run();
+        });
+    }
+
+    ~net_consumer() override
+    {
+        service_.stop();
+        thread_.join();
+    }
+
+    void accept()
+    {
+        acceptor_.async_accept([this](const boost::system::error_code& ec, tcp::socket socket) {
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            if (!ec) {
+                boost::system::error_code option_ec;
+                socket.set_option(tcp::no_delay(true), option_ec);
+                socket.set_option(boost::asio::socket_base::send_buffer_size(16 * 1024 * 1024), option_ec);
+
+                CASPAR_LOG(info) << print() << L" Client connected from "
+                                 << socket.remote_endpoint(option_ec).address().to_string().c_str() << L".";
+                connections_.push_back(std::make_shared<connection>(std::move(socket)));
+            }
+            accept();
+        });
+    }
+
+    void update_state()
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["net/port"]    = port_;
+        state_["net/clients"] = static_cast<int>(connections_.size());
+        state_["net/dropped"] = dropped_;
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        boost::asio::post(service_, [=] {
+            format_desc_ = format_desc;
+            update_state();
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        boost::asio::post(service_, [=] {
+            auto header = make_frame_header(static_cast<std::uint32_t>(frame.width()),
+                                            static_cast<std::uint32_t>(frame.height()),
+                                            static_cast<std::uint32_t>(format_desc_.audio_channels),
+                                            number_++,
+                                            frame.audio_data().size());
+            if (frame.image_data(0).size() != header.image_size) {
+                return;
+            }
+
+            for (auto it = connections_.begin(); it != connections_.end();) {
+                if ((*it)->closed()) {
+                    CASPAR_LOG(info) << print() << L" Client disconnected.";
+                    it = connections_.erase(it);
+                    continue;
+                }
+                if (!(*it)->send(header, frame)) {
+                    graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+                    ++dropped_;
+                }
+                ++it;
+            }
+            update_state();
+        });
+
+        return make_ready_future(true);
+    }
+
+    std::wstring print() const override { return L"net[" + std::to_wstring(port_) + L"]"; }
+
+    std::wstring name() const override { return L"net"; }
+
+    int index() const override { return 220000 + port_; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.empty() || !boost::iequals(params.at(0), L"NET")) {
+        return core::frame_consumer::empty();
+    }
+
+    auto port = params.size() > 1 ? boost::lexical_cast<unsigned short>(params.at(1)) : 5270;
+    return spl::make_shared<net_consumer>(port);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    return spl::make_shared<net_consumer>(ptree.get<unsigned short>(L"port", 5270));
+}
+
+}} // namespace caspar::net
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "net_producer.h"
+
+#include "../util/frame_header.h"
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using boost::asio::ip::tcp;
+
+namespace caspar { namespace net {
+
+// Shows the frames a net consumer on another server sends. Each image is read from the socket straight into a frame
+// from the frame factory. Up to buffer frames are kept to ride out network jitter, older ones are skipped. The
+// connection is retried every second while the sender is away, the last frame is held meanwhile.
+struct net_producer : public core::frame_producer
+{
+    core::monitor::state                       state_;
+    mutable std::mutex                         mutex_;
+    const std::wstring                         host_;
+    const std::wstring                         port_;
+    const std::size_t                          buffer_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    std::deque<core::draw_frame>               frames_;
+    core::draw_frame                           frame_;
+    bool                                       connected_ = false;
+    std::int64_t                               number_    = -1;
+    std::int64_t                               skipped_   = 0;
+
+    // Only used on the network thread.
+    core::pixel_format_desc   desc_;
+    frame_header              header_;
+    std::vector<std::int32_t> audio_;
+
+    boost::asio::io_context                                                  service_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    tcp::resolver                                                            resolver_;
+    tcp::socket                                                              socket_;
+    boost::asio::steady_timer                                                timer_;
+    std::thread                                                              thread_;
+
+    net_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                 std::wstring                                host,
+                 std::wstring                                port,
+                 std::size_t                                 buffer)
+        : host_(std::move(host))
+        , port_(std::move(port))
+        , buffer_(std::max<std::size_t>(1, buffer))
+        , frame_factory_(frame_factory)
+        , desc_(core::pixel_format::bgra)
+        , work_(boost::asio::make_work_guard(service_))
+        , resolver_(service_)
+        , socket_(service_)
+        , timer_(service_)
+    {
+        connect();
+        thread_ = std::thread([this] {
+            set_thread_name(L"net_producer");
+            service_.run();
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~net_producer() override
+    {
+        service_.stop();
+        thread_.join();
+    }
+
+    void connect()
+    {
+        resolver_.async_resolve(
+            u8(host_), u8(port_), [this](const boost::system::error_code& ec, tcp::resolver::results_type results) {
+                if (ec) {
+                    retry(ec);
+                    return;
+                }
+                boost::asio::async_connect(
+                    socket_, results, [this](const boost::system::error_code& ec, const tcp::endpoint&) {
+                        if (ec) {
+                            retry(ec);
+                            return;
+                        }
+
+                        boost::system::error_code option_ec;
+                        socket_.set_option(tcp::no_delay(true), option_ec);
+                        socket_.set_option(boost::asio::socket_base::receive_buffer_size(16 * 1024 * 1024), option_ec);
+
+                        CASPAR_LOG(info) << print() << L" Connected.";
+                        set_connected(true);
+                        read_header();
+                    });
+            });
+    }
+
+    void retry(const boost::system::error_code& ec)
+    {
+        if (ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+
+        bool was_connected;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            was_connected = connected_;
+        }
+        if (was_connected) {
+            CASPAR_LOG(warning) << print() << L" Disconnected: " << ec.message().c_str();
+            set_connected(false);
+        }
+
+        boost::system::error_code close_ec;
+        socket_.close(close_ec);
+
+        timer_.expires_after(std::chrono::seconds(1));
+        timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (!ec) {
+                connect();
+            }
+        });
+    }
+
+    void set_connected(bool connected)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connected_ = connected;
+    }
+
+    void read_header()
+    {
+        auto buffer = boost::asio::buffer(&header_, sizeof(header_));
+        boost::asio::async_read(socket_, buffer, [this](const boost::system::error_code& ec, std::size_t) {
+            if (ec) {
+                retry(ec);
+                return;
+            }
+            if (!is_valid(header_)) {
+                retry(boost::asio::error::invalid_argument);
+                return;
+            }
+
+            if (desc_.planes.empty() || desc_.planes[0].width != static_cast<int>(header_.width) ||
+                desc_.planes[0].height != static_cast<int>(header_.height)) {
+                desc_.planes.clear();
+                desc_.planes.push_back(core::pixel_format_desc::plane(header_.width, header_.height, 4));
+            }
+            read_frame();
+        });
+    }
+
+    void read_frame()
+    {
+        auto frame = std::make_shared<core::mutable_frame>(frame_factory_->create_frame(this, desc_));
+        audio_.resize(static_cast<std::size_t>(header_.samples));
+
+        std::array<boost::asio::mutable_buffer, 2> buffers = {
+            {boost::asio::buffer(frame->image_data(0).begin(), static_cast<std::size_t>(header_.image_size)),
+             boost::asio::buffer(audio_)}};
+
+        boost::asio::async_read(socket_, buffers, [this, frame](const boost::system::error_code& ec, std::size_t) {
+            if (ec) {
+                retry(ec);
+                return;
+            }
+
+            frame->audio_data() = std::move(audio_);
+            push(header_.number, core::draw_frame(std::move(*frame)));
+            read_header();
+        });
+    }
+
+    void push(std::int64_t number, core::draw_frame frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Frames the sender dropped for this client and those this side had no room for.
+        if (number_ >= 0 && number > number_ + 1) {
+            skipped_ += number - number_ - 1;
+        }
+        number_ = number;
+
+        frames_.push_back(std::move(frame));
+        while (frames_.size() > buffer_) {
+            frames_.pop_front();
+            skipped_ += 1;
+        }
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!frames_.empty()) {
+            frame_ = std::move(frames_.front());
+            frames_.pop_front();
+        }
+
+        state_["net/host"]      = u8(host_ + L":" + port_);
+        state_["net/connected"] = connected_;
+        state_["net/frame"]     = number_;
+        state_["net/buffered"]  = static_cast<int>(frames_.size());
+        state_["net/skipped"]   = skipped_;
+
+        return frame_;
+    }
+
+    std::wstring print() const override { return L"net_producer[" + host_ + L":" + port_ + L"]"; }
+
+    std::wstring name() const override { return L"net"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"NET")) {
+        return core::frame_producer::empty();
+    }
+
+    auto address = params.at(1);
+    auto colon   = address.rfind(L':');
+    if (colon == std::wstring::npos || colon == 0 || colon + 1 == address.size()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"NET expects host:port, got " + address + L"."));
+    }
+
+    return spl::make_shared<net_producer>(dependencies.frame_factory,
+                                          address.substr(0, colon),
+                                          address.substr(colon + 1),
+                                          get_param(L"BUFFER", params, 2));
+}
+
+}} // namespace caspar::net
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace caspar { namespace net {
+
+// Sent ahead of every frame, followed by image_size bytes of BGRA and samples interleaved 32 bit samples. Fields are
+// in host byte order, nodes of a cluster are expected to share an architecture.
+struct frame_header
+{
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t audio_channels;
+    std::int64_t  number;
+    std::uint64_t image_size;
+    std::uint64_t samples;
+};
+
+const char          FRAME_MAGIC[8] = {'C', 'A', 'S', 'P', 'N', 'E', 'T', '1'};
+const std::uint32_t FRAME_VERSION  = 1;
+
+static_assert(sizeof(frame_header) == 48, "frame_header is sent as is");
+
+inline frame_header make_frame_header(std::uint32_t width,
+                                      std::uint32_t height,
+                                      std::uint32_t audio_channels,
+                                      std::int64_t  number,
+                                      std::uint64_t samples)
+{
+    frame_header header;
+    std::memcpy(header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC));
+    header.version        = FRAME_VERSION;
+    header.width          = width;
+    header.height         = height;
+    header.audio_channels = audio_channels;
+    header.number         = number;
+    header.image_size     = static_cast<std::uint64_t>(width) * height * 4;
+    header.samples        = samples;
+    return header;
+}
+
+// Whether a received header is one of ours and describes a frame of sane size.
+inline bool is_valid(const frame_header& header)
+{
+    return std::memcmp(header.magic, FRAME_MAGIC, sizeof(FRAME_MAGIC)) == 0 && header.version == FRAME_VERSION &&
+           header.width > 0 && header.width <= 16384 && header.height > 0 && header.height <= 16384 &&
+           header.image_size == static_cast<std::uint64_t>(header.width) * header.height * 4 &&
+           header.audio_channels <= 64 && header.samples <= header.audio_channels * 48000ULL;
+}
+
+}} // namespace caspar::net
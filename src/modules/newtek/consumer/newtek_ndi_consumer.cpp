@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "newtek_ndi_consumer.h"
+
+#include "../util/ndi.h"
+
+#include <core/consumer/frame_consumer.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/future.h>
+#include <common/param.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/crc.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <mutex>
+
+namespace caspar { namespace newtek {
+
+// Sends the channel as an NDI source. Frames are handed to the runtime asynchronously, it compresses them on its own
+// threads while the channel moves on, and each frame is kept until the next one has replaced it.
+struct newtek_ndi_consumer : public core::frame_consumer
+{
+    const std::wstring                  name_;
+    const bool                          alpha_;
+    const int                           index_;
+    const NDIlib_v4*                    ndi_;
+    core::video_format_desc             format_desc_;
+    std::shared_ptr<void>               instance_;
+    core::const_frame                   sending_;
+    core::monitor::state                state_;
+    mutable std::mutex                  state_mutex_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    timer                               tick_timer_;
+
+  public:
+    newtek_ndi_consumer(std::wstring name, bool alpha)
+        : name_(std::move(name))
+        , alpha_(alpha)
+        , index_([&] {
+            boost::crc_16_type result;
+            result.process_bytes(name_.data(), name_.length() * sizeof(wchar_t));
+            return 900000 + result.checksum();
+        }())
+        , ndi_(ndi::load_library())
+    {
+        if (!ndi_) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info(ndi::dll_name() + L" not available"));
+        }
+
+        graph_->set_text(print());
+        graph_->set_color("frame-time", diagnostics::color(0.5f, 1.0f, 0.2f));
+        graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        diagnostics::register_graph(graph_);
+    }
+
+    ~newtek_ndi_consumer()
+    {
+        // Waits for the runtime to let go of the last frame.
+        if (instance_) {
+            ndi_->send_send_video_async_v2(instance_.get(), nullptr);
+        }
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        format_desc_ = format_desc;
+
+        const auto name = u8(name_);
+
+        NDIlib_send_create_t desc;
+        desc.p_ndi_name  = name.c_str();
+        desc.p_groups    = nullptr;
+        desc.clock_video = false;
+        desc.clock_audio = false;
+
+        auto ndi  = ndi_;
+        instance_ = std::shared_ptr<void>(ndi_->send_create(&desc), [ndi](void* ptr) {
+            if (ptr) {
+                ndi->send_destroy(static_cast<NDIlib_send_instance_t>(ptr));
+            }
+        });
+
+        if (!instance_.get()) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to create sender."));
+        }
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        graph_->set_value("tick-time", tick_timer_.elapsed() * format_desc_.fps * 0.5);
+        tick_timer_.restart();
+
+        caspar::timer frame_timer;
+
+        // Converted by the mixer, bgra when alpha is wanted or the mixer had no uyvy to give.
+        auto image = alpha_ ? core::const_frame{} : frame.converted(core::pixel_format::uyvy);
+        if (!image) {
+            image = frame;
+        }
+        const auto uyvy = image.pixel_format_desc().format == core::pixel_format::uyvy;
+
+        const auto instance = static_cast<NDIlib_send_instance_t>(instance_.get());
+
+        NDIlib_audio_frame_interleaved_32s_t audio;
+        audio.sample_rate     = format_desc_.audio_sample_rate;
+        audio.no_channels     = format_desc_.audio_channels;
+        audio.no_samples      = static_cast<int>(frame.audio_data().size()) / format_desc_.audio_channels;
+        audio.timecode        = NDIlib_send_timecode_synthesize;
+        audio.reference_level = 0;
+        audio.p_data          = const_cast<std::int32_t*>(frame.audio_data().data());
+        if (audio.no_samples > 0) {
+            ndi_->util_send_send_audio_interleaved_32s(instance, &audio);
+        }
+
+        const auto field_type =
+            format_desc_.field_count == 2 ? NDIlib_frame_format_type_interleaved : NDIlib_frame_format_type_progressive;
+
+        NDIlib_video_frame_v2_t video;
+        video.xres                 = format_desc_.width;
+        video.yres                 = format_desc_.height;
+        video.FourCC               = uyvy ? NDIlib_FourCC_type_UYVY : NDIlib_FourCC_type_BGRA;
+        video.frame_rate_N         = format_desc_.framerate.numerator();
+        video.frame_rate_D         = format_desc_.framerate.denominator();
+        video.picture_aspect_ratio = static_cast<float>(format_desc_.square_width) / format_desc_.square_height;
+        video.frame_format_type    = field_type;
+        video.timecode             = NDIlib_send_timecode_synthesize;
+        video.p_data               = const_cast<std::uint8_t*>(image.image_data(0).data());
+        video.line_stride_in_bytes = format_desc_.width * (uyvy ? 2 : 4);
+        video.p_metadata           = nullptr;
+
+        // Returns once the previous frame is no longer used, this one is read until the next call.
+        ndi_->send_send_video_async_v2(instance, &video);
+        sending_ = image;
+
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["ndi/name"]        = u8(name_);
+            state_["ndi/format"]      = uyvy ? "uyvy" : "bgra";
+            state_["ndi/connections"] = ndi_->send_get_no_connections(instance, 0);
+        }
+
+        return make_ready_future(true);
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
+    core::pixel_format preferred_pixel_format() const override
+    {
+        return alpha_ ? core::pixel_format::bgra : core::pixel_format::uyvy;
+    }
+
+    std::wstring print() const override { return L"ndi[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"ndi"; }
+
+    int index() const override { return index_; }
+
+    bool has_synchronization_clock() const override { return false; }
+};
+
+spl::shared_ptr<core::frame_consumer> create_ndi_consumer(const std::vector<std::wstring>&                  params,
+                                                          std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    if (params.size() < 1 || !boost::iequals(params.at(0), L"NDI")) {
+        return core::frame_consumer::empty();
+    }
+
+    auto name  = get_param(L"NAME", params, std::wstring(L"casparcg"));
+    auto alpha = contains_param(L"ALPHA", params);
+
+    return spl::make_shared<newtek_ndi_consumer>(name, alpha);
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_ndi_consumer(const boost::property_tree::wptree&               ptree,
+                                  std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    auto name  = ptree.get(L"name", std::wstring(L"casparcg"));
+    auto alpha = ptree.get(L"alpha", false);
+
+    return spl::make_shared<newtek_ndi_consumer>(name, alpha);
+}
+
+}} // namespace caspar::newtek
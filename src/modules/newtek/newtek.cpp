@@ -22,8 +22,11 @@
 #include "newtek.h"
 
 #include "consumer/newtek_ivga_consumer.h"
+#include "consumer/newtek_ndi_consumer.h"
+#include "producer/newtek_ndi_producer.h"
 
 #include <core/consumer/frame_consumer.h>
+#include <core/producer/frame_producer.h>
 
 namespace caspar { namespace newtek {
 
@@ -33,6 +36,10 @@ void init(core::module_dependencies dependencies)
         dependencies.consumer_registry->register_consumer_factory(L"iVGA Consumer", create_ivga_consumer);
         dependencies.consumer_registry->register_preconfigured_consumer_factory(L"newtek-ivga",
                                                                                 create_preconfigured_ivga_consumer);
+        dependencies.consumer_registry->register_consumer_factory(L"NDI Consumer", create_ndi_consumer);
+        dependencies.consumer_registry->register_preconfigured_consumer_factory(L"ndi",
+                                                                                create_preconfigured_ndi_consumer);
+        dependencies.producer_registry->register_producer_factory(L"NDI Producer", create_ndi_producer);
     } catch (...) {
     }
 }
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "newtek_ndi_producer.h"
+
+#include "../util/ndi.h"
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/frame_producer.h>
+#include <core/video_format.h>
+
+#include <common/diagnostics/graph.h>
+#include <common/param.h>
+#include <common/scope_exit.h>
+#include <common/timer.h>
+#include <common/utf.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <tbb/blocked_range.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+namespace caspar { namespace newtek {
+
+// Milliseconds each capture waits for the source, bounds how long closing the producer takes.
+const int CAPTURE_TIMEOUT = 200;
+
+// Shows an NDI source. The runtime decompresses on its own threads, the capture thread copies each frame into an
+// upload buffer from the frame factory with the rows split across the worker pool and queues it for the channel.
+struct newtek_ndi_producer : public core::frame_producer
+{
+    const std::wstring                         source_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const core::video_format_desc              format_desc_;
+    const NDIlib_v4*                           ndi_;
+    spl::shared_ptr<diagnostics::graph>        graph_;
+    std::shared_ptr<void>                      instance_;
+
+    tbb::concurrent_bounded_queue<core::draw_frame> buffer_;
+    std::vector<std::int32_t>                       audio_;
+    core::draw_frame                                frame_;
+
+    core::monitor::state state_;
+    mutable std::mutex   state_mutex_;
+
+    std::atomic<bool> abort_{false};
+    std::thread       thread_;
+
+  public:
+    newtek_ndi_producer(const spl::shared_ptr<core::frame_factory>& frame_factory,
+                        const core::video_format_desc&              format_desc,
+                        std::wstring                                source,
+                        int                                         buffer)
+        : source_(std::move(source))
+        , frame_factory_(frame_factory)
+        , format_desc_(format_desc)
+        , ndi_(ndi::load_library())
+    {
+        if (!ndi_) {
+            CASPAR_THROW_EXCEPTION(not_supported() << msg_info(ndi::dll_name() + L" not available"));
+        }
+
+        const auto name = u8(source_);
+
+        NDIlib_recv_create_v3_t desc;
+        desc.source_to_connect_to.p_ndi_name = name.c_str();
+        desc.color_format                    = NDIlib_recv_color_format_UYVY_BGRA;
+        desc.bandwidth                       = NDIlib_recv_bandwidth_highest;
+        desc.allow_video_fields              = false;
+        desc.p_ndi_recv_name                 = "casparcg";
+
+        auto ndi  = ndi_;
+        instance_ = std::shared_ptr<void>(ndi_->recv_create_v3(&desc), [ndi](void* ptr) {
+            if (ptr) {
+                ndi->recv_destroy(static_cast<NDIlib_recv_instance_t>(ptr));
+            }
+        });
+
+        if (!instance_.get()) {
+            CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(print() + L" Failed to create receiver."));
+        }
+
+        buffer_.set_capacity(buffer > 0 ? buffer : 2);
+
+        graph_->set_text(print());
+        graph_->set_color("frame-time", diagnostics::color(0.0f, 0.6f, 0.9f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        diagnostics::register_graph(graph_);
+
+        thread_ = std::thread([this] { run(); });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    ~newtek_ndi_producer()
+    {
+        abort_ = true;
+        thread_.join();
+    }
+
+    void run()
+    {
+        const auto instance = static_cast<NDIlib_recv_instance_t>(instance_.get());
+
+        while (!abort_) {
+            try {
+                NDIlib_video_frame_v2_t video;
+                NDIlib_audio_frame_v2_t audio;
+                switch (ndi_->recv_capture_v2(instance, &video, &audio, nullptr, CAPTURE_TIMEOUT)) {
+                    case NDIlib_frame_type_video: {
+                        CASPAR_SCOPE_EXIT { ndi_->recv_free_video_v2(instance, &video); };
+                        push(video);
+                        break;
+                    }
+                    case NDIlib_frame_type_audio: {
+                        CASPAR_SCOPE_EXIT { ndi_->recv_free_audio_v2(instance, &audio); };
+                        add_audio(audio);
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
+        }
+    }
+
+    void add_audio(const NDIlib_audio_frame_v2_t& audio)
+    {
+        std::vector<std::int32_t> samples(static_cast<std::size_t>(audio.no_samples) * audio.no_channels);
+
+        NDIlib_audio_frame_interleaved_32s_t interleaved;
+        interleaved.reference_level = 0;
+        interleaved.p_data          = samples.data();
+        ndi_->util_audio_to_interleaved_32s_v2(&audio, &interleaved);
+
+        const auto channels = format_desc_.audio_channels;
+        for (auto s = 0; s < audio.no_samples; ++s) {
+            for (auto c = 0; c < channels; ++c) {
+                audio_.push_back(c < audio.no_channels ? samples[s * audio.no_channels + c] : 0);
+            }
+        }
+
+        // Without video nothing takes the audio, a second of it is kept.
+        const auto max_size = static_cast<std::size_t>(format_desc_.audio_sample_rate) * channels;
+        if (audio_.size() > max_size) {
+            audio_.erase(audio_.begin(), audio_.end() - max_size);
+        }
+    }
+
+    void push(const NDIlib_video_frame_v2_t& video)
+    {
+        caspar::timer frame_timer;
+
+        const auto uyvy = video.FourCC == NDIlib_FourCC_type_UYVY || video.FourCC == NDIlib_FourCC_type_UYVA;
+        if (!uyvy && video.FourCC != NDIlib_FourCC_type_BGRA && video.FourCC != NDIlib_FourCC_type_BGRX) {
+            return;
+        }
+
+        core::pixel_format_desc desc(uyvy ? core::pixel_format::uyvy : core::pixel_format::bgra);
+        desc.planes.push_back(core::pixel_format_desc::plane(uyvy ? video.xres / 2 : video.xres, video.yres, 4));
+
+        auto frame = frame_factory_->create_frame(this, desc);
+
+        const auto row_bytes = static_cast<std::size_t>(desc.planes[0].linesize);
+        const auto stride    = static_cast<std::size_t>(video.line_stride_in_bytes);
+        const auto src       = video.p_data;
+        const auto dst       = frame.image_data(0).begin();
+        tbb::parallel_for(tbb::blocked_range<int>(0, video.yres), [&](const tbb::blocked_range<int>& r) {
+            for (auto y = r.begin(); y != r.end(); ++y) {
+                std::memcpy(dst + y * row_bytes, src + y * stride, row_bytes);
+            }
+        });
+
+        frame.audio_data() = std::move(audio_);
+        audio_.clear();
+
+        auto draw_frame = core::draw_frame(std::move(frame));
+        if (!buffer_.try_push(draw_frame)) {
+            core::draw_frame dummy;
+            buffer_.try_pop(dummy);
+            buffer_.try_push(draw_frame);
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+
+        graph_->set_value("frame-time", frame_timer.elapsed() * format_desc_.fps * 0.5);
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["ndi/source"]    = u8(source_);
+        state_["ndi/width"]     = video.xres;
+        state_["ndi/height"]    = video.yres;
+        state_["ndi/framerate"] = static_cast<double>(video.frame_rate_N) / std::max(video.frame_rate_D, 1);
+        state_["ndi/format"]    = uyvy ? "uyvy" : "bgra";
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        core::draw_frame frame;
+        if (!buffer_.try_pop(frame)) {
+            if (frame_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            }
+            return core::draw_frame::still(frame_);
+        }
+        frame_ = frame;
+        return frame;
+    }
+
+    core::draw_frame last_frame() override { return core::draw_frame::still(frame_); }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+
+    std::wstring print() const override { return L"ndi[" + source_ + L"]"; }
+
+    std::wstring name() const override { return L"ndi"; }
+};
+
+spl::shared_ptr<core::frame_producer> create_ndi_producer(const core::frame_producer_dependencies& dependencies,
+                                                          const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"NDI")) {
+        return core::frame_producer::empty();
+    }
+
+    auto buffer = get_param(L"BUFFER", params, 0);
+
+    return spl::make_shared<newtek_ndi_producer>(
+        dependencies.frame_factory, dependencies.format_desc, params.at(1), buffer);
+}
+
+}} // namespace caspar::newtek
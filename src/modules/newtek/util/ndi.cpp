@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "ndi.h"
+
+#include <common/utf.h>
+
+#include <cstdlib>
+
+#include <Windows.h>
+
+namespace caspar { namespace newtek { namespace ndi {
+
+const std::wstring& dll_name()
+{
+    static std::wstring name = u16(NDILIB_LIBRARY_NAME);
+
+    return name;
+}
+
+const NDIlib_v4* load_library()
+{
+    static const NDIlib_v4* functions = [] {
+        // The runtime is installed separately, its folder is in the environment.
+        const auto dir  = std::getenv(NDILIB_REDIST_FOLDER);
+        const auto path = dir ? std::string(dir) + "\\" + NDILIB_LIBRARY_NAME : std::string(NDILIB_LIBRARY_NAME);
+
+        auto module = LoadLibraryA(path.c_str());
+        if (!module) {
+            CASPAR_LOG(warning) << L"Could not load " << u16(path) << L", see " << u16(NDILIB_REDIST_URL);
+            return static_cast<const NDIlib_v4*>(nullptr);
+        }
+
+        const auto load = reinterpret_cast<const NDIlib_v4* (*)()>(GetProcAddress(module, "NDIlib_v4_load"));
+        const auto lib  = load ? load() : nullptr;
+        if (!lib || !lib->initialize()) {
+            CASPAR_LOG(warning) << L"Could not initialize " << u16(path);
+            FreeLibrary(module);
+            return static_cast<const NDIlib_v4*>(nullptr);
+        }
+
+        CASPAR_LOG(info) << L"Loaded " << u16(path) << L" " << u16(lib->version());
+
+        // Senders and receivers may outlive any owner of the library, it stays loaded.
+        return lib;
+    }();
+
+    return functions;
+}
+
+}}} // namespace caspar::newtek::ndi
@@ -24,21 +24,20 @@
 #include <common/diagnostics/graph.h>
 #include <common/env.h>
 #include <common/except.h>
-#include <common/executor.h>
 #include <common/future.h>
 #include <common/log.h>
 #include <common/param.h>
+#include <common/scope_exit.h>
 #include <common/timer.h>
 
 #include <core/consumer/frame_consumer.h>
 #include <core/frame/frame.h>
 #include <core/mixer/audio/audio_mixer.h>
+#include <core/monitor/monitor.h>
 #include <core/video_format.h>
 
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
 #if defined(_MSC_VER)
 #pragma warning(push)
 #pragma warning(disable : 4244)
@@ -47,6 +46,7 @@ extern "C" {
 #define __STDC_CONSTANT_MACROS
 #define __STDC_LIMIT_MACROS
 #include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
 #include <libavutil/samplefmt.h>
 #include <libswresample/swresample.h>
 }
@@ -54,7 +54,13 @@ extern "C" {
 #pragma warning(pop)
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include <AL/al.h>
@@ -106,25 +112,92 @@ void init_device()
     std::call_once(f, [] { instance = std::make_unique<device>(); });
 }
 
+// Single producer, single consumer ring of interleaved samples, the channel writes and the streaming thread reads
+// without locking.
+class audio_ring
+{
+    std::vector<std::int32_t> data_;
+    std::size_t               mask_ = 0;
+    std::atomic<std::size_t>  write_{0};
+    std::atomic<std::size_t>  read_{0};
+
+  public:
+    explicit audio_ring(std::size_t capacity)
+    {
+        auto size = std::size_t{1};
+        while (size < capacity) {
+            size <<= 1;
+        }
+        data_.resize(size);
+        mask_ = size - 1;
+    }
+
+    std::size_t size() const { return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire); }
+
+    bool push(const std::int32_t* src, std::size_t count)
+    {
+        const auto write = write_.load(std::memory_order_relaxed);
+        if (data_.size() - (write - read_.load(std::memory_order_acquire)) < count) {
+            return false;
+        }
+        const auto offset = write & mask_;
+        const auto first  = std::min(count, data_.size() - offset);
+        std::memcpy(data_.data() + offset, src, first * sizeof(std::int32_t));
+        std::memcpy(data_.data(), src + first, (count - first) * sizeof(std::int32_t));
+        write_.store(write + count, std::memory_order_release);
+        return true;
+    }
+
+    std::size_t pop(std::int32_t* dst, std::size_t count)
+    {
+        const auto read = read_.load(std::memory_order_relaxed);
+        count           = std::min(count, write_.load(std::memory_order_acquire) - read);
+        const auto offset = read & mask_;
+        const auto first  = std::min(count, data_.size() - offset);
+        std::memcpy(dst, data_.data() + offset, first * sizeof(std::int32_t));
+        std::memcpy(dst + first, data_.data(), (count - first) * sizeof(std::int32_t));
+        read_.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    void skip(std::size_t count)
+    {
+        const auto read = read_.load(std::memory_order_relaxed);
+        count           = std::min(count, write_.load(std::memory_order_acquire) - read);
+        read_.store(read + count, std::memory_order_release);
+    }
+};
+
+// Frames are queued to a ring and a streaming thread keeps a few short OpenAL buffers filled from it. The depth of
+// the ring and the queued buffers is held at the latency target by resampling, so the output follows the channel
+// clock instead of drifting with the sound card.
 struct oal_consumer : public core::frame_consumer
 {
+    // Buffers of 10 ms are queued on the source.
+    static const int PERIODS_PER_SECOND = 100;
+
+    // Resampling corrects at most this fraction of the rate, 0.5% is not heard on monitoring.
+    static constexpr double MAX_COMPENSATION = 0.005;
+
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       perf_timer_;
     int                                 channel_index_ = -1;
+    const int                           latency_;
 
     core::video_format_desc format_desc_;
 
-    ALuint              source_ = 0;
-    std::vector<ALuint> buffers_;
-    bool                started_  = false;
-    int                 duration_ = 1920;
-
+    std::unique_ptr<audio_ring> ring_;
+    ALuint                      source_ = 0;
     std::shared_ptr<SwrContext> swr_;
+    std::atomic<bool>           abort_{false};
+    std::thread                 thread_;
 
-    executor executor_{L"oal_consumer"};
+    core::monitor::state state_;
+    mutable std::mutex   state_mutex_;
 
   public:
-    oal_consumer()
+    explicit oal_consumer(int latency)
+        : latency_(latency)
     {
         init_device();
 
@@ -136,17 +209,10 @@ struct oal_consumer : public core::frame_consumer
 
     ~oal_consumer() override
     {
-        executor_.invoke([=] {
-            if (source_ != 0u) {
-                alSourceStop(source_);
-                alDeleteSources(1, &source_);
-            }
-
-            for (auto& buffer : buffers_) {
-                if (buffer != 0u)
-                    alDeleteBuffers(1, &buffer);
-            }
-        });
+        abort_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
     }
 
     // frame consumer
@@ -157,145 +223,164 @@ struct oal_consumer : public core::frame_consumer
         channel_index_ = channel_index;
         graph_->set_text(print());
 
-        executor_.begin_invoke([=] {
-            duration_ = format_desc_.audio_cadence[0];
-            buffers_.resize(8);
-            alGenBuffers(static_cast<ALsizei>(buffers_.size()), buffers_.data());
-            alGenSources(1, &source_);
+        const auto target   = static_cast<std::size_t>(format_desc_.audio_sample_rate) * latency_ / 1000;
+        const auto capacity = target * 2 + format_desc_.audio_sample_rate;
+        ring_               = std::make_unique<audio_ring>(capacity * format_desc_.audio_channels);
 
-            alSourcei(source_, AL_LOOPING, AL_FALSE);
+        thread_ = std::thread([this] {
+            try {
+                run();
+            } catch (...) {
+                CASPAR_LOG_CURRENT_EXCEPTION();
+            }
         });
     }
 
     std::future<bool> send(core::const_frame frame) override
     {
-        executor_.begin_invoke([=] {
-            auto dst            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            dst->format         = AV_SAMPLE_FMT_S16;
-            dst->sample_rate    = format_desc_.audio_sample_rate;
-            dst->channels       = 2;
-            dst->channel_layout = av_get_default_channel_layout(dst->channels);
-            dst->nb_samples     = duration_;
-            if (av_frame_get_buffer(dst.get(), 32) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
-            }
-            std::memset(dst->extended_data[0], 0, dst->linesize[0]);
-
-            if (!started_) {
-                for (ALuint& buffer : buffers_) {
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                }
+        const auto& audio = frame.audio_data();
+        if (!ring_->push(audio.data(), audio.size())) {
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
 
-                alSourcePlay(source_);
-                started_ = true;
+        graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
+        perf_timer_.restart();
+
+        return make_ready_future(true);
+    }
 
-                return;
+    void run()
+    {
+        const auto rate     = format_desc_.audio_sample_rate;
+        const auto channels = format_desc_.audio_channels;
+        const auto period   = rate / PERIODS_PER_SECOND;
+        const auto target   = static_cast<double>(rate) * latency_ / 1000;
+
+        swr_.reset(swr_alloc_set_opts(nullptr,
+                                      AV_CH_LAYOUT_STEREO,
+                                      AV_SAMPLE_FMT_S16,
+                                      rate,
+                                      av_get_default_channel_layout(channels),
+                                      AV_SAMPLE_FMT_S32,
+                                      rate,
+                                      0,
+                                      nullptr),
+                   [](SwrContext* ptr) { swr_free(&ptr); });
+        if (!swr_) {
+            CASPAR_THROW_EXCEPTION(bad_alloc());
+        }
+        // Resampling from the start, compensation doesn't have to reinitialize the context.
+        av_opt_set_int(swr_.get(), "flags", SWR_FLAG_RESAMPLE, 0);
+        if (swr_init(swr_.get()) < 0) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Failed to initialize resampler."));
+        }
+
+        // Most of the latency stays in the ring where it can be measured, the source only queues a few periods.
+        std::vector<ALuint> buffers(std::max(2, std::min(8, static_cast<int>(target) / period / 2)));
+        alGenBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
+        alGenSources(1, &source_);
+        alSourcei(source_, AL_LOOPING, AL_FALSE);
+
+        CASPAR_SCOPE_EXIT
+        {
+            alSourceStop(source_);
+            alDeleteSources(1, &source_);
+            alDeleteBuffers(static_cast<ALsizei>(buffers.size()), buffers.data());
+        };
+
+        std::vector<ALuint>       free_buffers(buffers);
+        std::vector<std::int32_t> input(static_cast<std::size_t>(period) * channels);
+        std::vector<std::int16_t> output(static_cast<std::size_t>(period) * 2 * 2);
+
+        auto playing    = false;
+        auto depth      = target;
+        auto correction = 0;
+
+        while (!abort_) {
+            ALint processed = 0;
+            alGetSourcei(source_, AL_BUFFERS_PROCESSED, &processed);
+            for (; processed > 0; --processed) {
+                ALuint buffer = 0;
+                alSourceUnqueueBuffers(source_, 1, &buffer);
+                free_buffers.push_back(buffer);
             }
 
-            auto src            = std::shared_ptr<AVFrame>(av_frame_alloc(), [](AVFrame* ptr) { av_frame_free(&ptr); });
-            src->format         = AV_SAMPLE_FMT_S32;
-            src->sample_rate    = format_desc_.audio_sample_rate;
-            src->channels       = format_desc_.audio_channels;
-            src->channel_layout = av_get_default_channel_layout(src->channels);
-            src->nb_samples     = static_cast<int>(frame.audio_data().size() / src->channels);
-            src->extended_data[0] = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(frame.audio_data().data()));
-            src->linesize[0]      = static_cast<int>(frame.audio_data().size() * sizeof(int32_t));
-
-            if (av_frame_get_buffer(dst.get(), 0) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
+            const auto queued = static_cast<int>(buffers.size() - free_buffers.size());
+            const auto frames = static_cast<double>(ring_->size() / channels) + static_cast<double>(queued) * period +
+                                static_cast<double>(swr_get_delay(swr_.get(), rate));
+
+            ALint state = 0;
+            alGetSourcei(source_, AL_SOURCE_STATE, &state);
+            if (playing && state != AL_PLAYING && queued == 0) {
+                // Ran dry, refilled to the target before playing again.
+                playing = false;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
             }
 
-            if (!swr_) {
-                swr_.reset(swr_alloc(), [](SwrContext* ptr) { swr_free(&ptr); });
-                if (!swr_) {
-                    CASPAR_THROW_EXCEPTION(bad_alloc());
-                }
-                if (swr_config_frame(swr_.get(), dst.get(), src.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
-                if (swr_init(swr_.get()) < 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
+            if (!playing) {
+                if (frames < target) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1000 / PERIODS_PER_SECOND / 2));
+                    continue;
                 }
+                depth = frames;
             }
 
-            if (swr_convert_frame(swr_.get(), nullptr, src.get()) < 0) {
-                // TODO FF error
-                CASPAR_THROW_EXCEPTION(invalid_argument());
+            // Far too much queued after a stall, dropped back to the target instead of resampling for minutes.
+            if (frames > target * 2 + rate / 10) {
+                ring_->skip(static_cast<std::size_t>(frames - target) * channels);
+                depth = target;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
             }
 
-            ALint processed = 0;
-            alGetSourceiv(source_, AL_BUFFERS_PROCESSED, &processed);
-
-            auto in_duration  = swr_get_delay(swr_.get(), 48000);
-            auto out_duration = static_cast<int64_t>(processed) * duration_;
-            auto delta        = static_cast<int>(out_duration - in_duration);
-
-            ALenum state;
-            alGetSourcei(source_, AL_SOURCE_STATE, &state);
-            if (state != AL_PLAYING) {
-                while (delta > duration_) {
-                    ALuint buffer = 0;
-                    alSourceUnqueueBuffers(source_, 1, &buffer);
-                    if (buffer == 0u) {
-                        break;
+            while (!free_buffers.empty() && ring_->size() >= input.size()) {
+                // Frames arrive in bursts, the average over about a second is compared to the target.
+                depth = depth * 0.99 + frames * 0.01;
+
+                const auto max_correction = static_cast<int>(rate * MAX_COMPENSATION);
+                const auto error          = static_cast<int>(target - depth);
+                const auto next =
+                    std::abs(error) < period ? 0 : std::max(-max_correction, std::min(max_correction, error));
+                if (next != correction) {
+                    if (swr_set_compensation(swr_.get(), next, next != 0 ? rate : 0) < 0) {
+                        CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Failed to set compensation."));
                     }
-                    alBufferData(buffer,
-                                 AL_FORMAT_STEREO16,
-                                 dst->extended_data[0],
-                                 static_cast<ALsizei>(dst->linesize[0]),
-                                 dst->sample_rate);
-                    alSourceQueueBuffers(source_, 1, &buffer);
-                    delta -= duration_;
+                    correction = next;
                 }
 
-                alSourcePlay(source_);
-            }
-
-            // TODO (fix)
-            // if (std::abs(delta) > duration_ && swr_set_compensation(swr_.get(), delta, 2000) < 0) {
-            //    // TODO FF error
-            //    CASPAR_THROW_EXCEPTION(invalid_argument());
-            //}
-
-            for (auto n = 0; n < processed; ++n) {
-                if (swr_get_delay(swr_.get(), 48000) < dst->nb_samples) {
-                    break;
+                const auto count = static_cast<int>(ring_->pop(input.data(), input.size()) / channels);
+                auto       in    = reinterpret_cast<const std::uint8_t*>(input.data());
+                auto       out   = reinterpret_cast<std::uint8_t*>(output.data());
+                const auto size  = swr_convert(swr_.get(), &out, static_cast<int>(output.size() / 2), &in, count);
+                if (size <= 0) {
+                    continue;
                 }
 
-                ALuint buffer = 0;
-                alSourceUnqueueBuffers(source_, 1, &buffer);
-                if (buffer == 0u) {
-                    // TODO error
-                    break;
-                }
+                const auto buffer = free_buffers.back();
+                free_buffers.pop_back();
+                alBufferData(buffer, AL_FORMAT_STEREO16, output.data(), size * 2 * sizeof(std::int16_t), rate);
+                alSourceQueueBuffers(source_, 1, &buffer);
+            }
 
-                if (swr_convert_frame(swr_.get(), dst.get(), nullptr) != 0) {
-                    // TODO FF error
-                    CASPAR_THROW_EXCEPTION(invalid_argument());
-                }
+            if ((!playing || state != AL_PLAYING) && free_buffers.size() < buffers.size()) {
+                alSourcePlay(source_);
+                playing = true;
+            }
 
-                alBufferData(buffer,
-                             AL_FORMAT_STEREO16,
-                             dst->extended_data[0],
-                             static_cast<ALsizei>(dst->linesize[0]),
-                             dst->sample_rate);
-                alSourceQueueBuffers(source_, 1, &buffer);
+            {
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                state_["oal/latency"]      = depth * 1000 / rate;
+                state_["oal/target"]       = latency_;
+                state_["oal/compensation"] = correction * 1000000.0 / rate;
             }
 
-            graph_->set_value("tick-time", perf_timer_.elapsed() * format_desc_.fps * 0.5);
-            perf_timer_.restart();
-        });
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000 / PERIODS_PER_SECOND / 2));
+        }
+    }
 
-        return make_ready_future(true);
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
     }
 
     std::wstring print() const override
@@ -307,7 +392,10 @@ struct oal_consumer : public core::frame_consumer
 
     bool has_synchronization_clock() const override { return false; }
 
+    bool audio_only() const override { return true; }
+
     int index() const override { return 500; }
+
 };
 
 spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
@@ -316,14 +404,14 @@ spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wst
     if (params.empty() || !boost::iequals(params.at(0), L"AUDIO"))
         return core::frame_consumer::empty();
 
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(get_param(L"LATENCY", params, 200));
 }
 
 spl::shared_ptr<core::frame_consumer>
 create_preconfigured_consumer(const boost::property_tree::wptree&                      ptree,
                               const std::vector<spl::shared_ptr<core::video_channel>>& channels)
 {
-    return spl::make_shared<oal_consumer>();
+    return spl::make_shared<oal_consumer>(ptree.get(L"latency", 200));
 }
 
 }} // namespace caspar::oal
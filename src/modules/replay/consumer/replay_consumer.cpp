@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_consumer.h"
+
+#include "../util/ring_file.h"
+
+#include <common/env.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace replay {
+
+std::wstring ring_path(const std::wstring& name)
+{
+    auto path = boost::filesystem::path(env::media_folder() + name);
+    if (!path.has_extension()) {
+        path += L".ring";
+    }
+    return path.wstring();
+}
+
+// Copies every channel frame into a ring file holding the last seconds of output, see the replay producer.
+struct replay_consumer : public core::frame_consumer
+{
+    core::monitor::state       state_;
+    mutable std::mutex         state_mutex_;
+    const std::wstring         name_;
+    const double               seconds_;
+    const int                  index_;
+    std::unique_ptr<ring_file> ring_;
+    executor                   executor_{L"replay_consumer"};
+
+  public:
+    replay_consumer(std::wstring name, double seconds)
+        : name_(std::move(name))
+        , seconds_(seconds)
+        , index_([&] {
+            boost::crc_16_type result;
+            result.process_bytes(name_.data(), name_.length() * sizeof(wchar_t));
+            return 200000 + result.checksum();
+        }())
+    {
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        executor_.invoke([&] {
+            ring_file::format_t format;
+            format.width             = format_desc.width;
+            format.height            = format_desc.height;
+            format.framerate_num     = format_desc.framerate.numerator();
+            format.framerate_den     = format_desc.framerate.denominator();
+            format.audio_channels    = format_desc.audio_channels;
+            format.audio_sample_rate = format_desc.audio_sample_rate;
+            format.max_samples       = format_desc.audio_cadence.empty()
+                                     ? 0
+                                     : *std::max_element(format_desc.audio_cadence.begin(),
+                                                         format_desc.audio_cadence.end());
+            format.capacity = static_cast<std::uint32_t>(std::max(2.0, std::ceil(seconds_ * format_desc.fps)));
+
+            ring_.reset();
+            ring_ = std::make_unique<ring_file>(ring_path(name_), format);
+
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["file/path"]       = u8(ring_path(name_));
+            state_["replay/capacity"] = static_cast<std::int64_t>(format.capacity);
+        });
+
+        CASPAR_LOG(info) << print() << L" Recording " << seconds_ << L" seconds.";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        return executor_.begin_invoke([=] {
+            if (!ring_ || frame.image_data(0).size() != ring_->image_size()) {
+                return true;
+            }
+
+            ring_->write(frame.image_data(0).begin(), frame.audio_data().begin(), frame.audio_data().size());
+
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["replay/frame"] = ring_->last();
+            return true;
+        });
+    }
+
+    std::wstring print() const override { return L"replay[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+    int index() const override { return index_; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_consumer::empty();
+    }
+
+    return spl::make_shared<replay_consumer>(params.at(1), get_param(L"SECONDS", params, 10.0));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    return spl::make_shared<replay_consumer>(ptree.get<std::wstring>(L"file", L"replay"),
+                                             ptree.get(L"seconds", 10.0));
+}
+
+}} // namespace caspar::replay
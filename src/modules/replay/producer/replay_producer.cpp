@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replay_producer.h"
+
+#include "../consumer/replay_consumer.h"
+#include "../util/ring_file.h"
+
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+namespace caspar { namespace replay {
+
+// Plays a ring file written by the replay consumer, at one frame per channel frame. The position holds on the newest
+// frame when playback catches up with recording, and moves to the oldest one when recording overtakes it.
+struct replay_producer : public core::frame_producer
+{
+    core::monitor::state                       state_;
+    mutable std::mutex                         mutex_;
+    const std::wstring                         path_;
+    const spl::shared_ptr<core::frame_factory> frame_factory_;
+    const ring_file                            ring_;
+    core::pixel_format_desc                    desc_;
+    std::int64_t                               position_ = 0;
+    std::vector<std::int32_t>                  audio_;
+    core::draw_frame                           frame_;
+
+    replay_producer(const spl::shared_ptr<core::frame_factory>& frame_factory, std::wstring path, std::int64_t seek)
+        : path_(std::move(path))
+        , frame_factory_(frame_factory)
+        , ring_(path_)
+        , desc_(core::pixel_format::bgra)
+    {
+        desc_.planes.push_back(core::pixel_format_desc::plane(ring_.format().width, ring_.format().height, 4));
+        position_ = to_position(seek);
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // Non-negative offsets count from the oldest frame, negative ones back from the newest.
+    std::int64_t to_position(std::int64_t offset) const
+    {
+        return offset < 0 ? std::max(ring_.first(), ring_.last() + offset) : ring_.first() + offset;
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto retry = 0; retry < 2; ++retry) {
+            position_ = std::max(position_, ring_.first());
+            if (position_ >= ring_.last()) {
+                break;
+            }
+
+            auto frame = frame_factory_->create_frame(this, desc_);
+            if (ring_.read(position_, frame.image_data(0).begin(), audio_)) {
+                frame.audio_data() = std::move(audio_);
+                frame_             = core::draw_frame(std::move(frame));
+                position_ += 1;
+                break;
+            }
+        }
+
+        state_["file/path"]        = u8(path_);
+        state_["replay/position"]  = position_ - ring_.first();
+        state_["replay/available"] = ring_.last() - ring_.first();
+
+        return frame_;
+    }
+
+    std::future<std::wstring> call(const std::vector<std::wstring>& params) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (params.size() > 1 && boost::iequals(params.at(0), L"seek")) {
+            if (boost::iequals(params.at(1), L"live")) {
+                position_ = std::max(ring_.first(), ring_.last() - 1);
+            } else {
+                position_ = to_position(boost::lexical_cast<std::int64_t>(params.at(1)));
+            }
+        } else if (!params.empty() && !boost::iequals(params.at(0), L"seek")) {
+            CASPAR_THROW_EXCEPTION(invalid_argument());
+        }
+
+        return make_ready_future(std::to_wstring(position_ - ring_.first()));
+    }
+
+    std::wstring print() const override { return L"replay_producer[" + path_ + L"]"; }
+
+    std::wstring name() const override { return L"replay"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"REPLAY")) {
+        return core::frame_producer::empty();
+    }
+
+    const auto path = ring_path(params.at(1));
+    if (!boost::filesystem::exists(path)) {
+        return core::frame_producer::empty();
+    }
+
+    return spl::make_shared<replay_producer>(
+        dependencies.frame_factory, path, get_param(L"SEEK", params, static_cast<std::int64_t>(0)));
+}
+
+}} // namespace caspar::replay
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ring_file.h"
+
+#include <common/except.h>
+#include <common/utf.h>
+
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+
+namespace caspar { namespace replay {
+
+namespace {
+
+const char          MAGIC[8]  = {'C', 'A', 'S', 'P', 'R', 'I', 'N', 'G'};
+const std::uint32_t VERSION   = 1;
+const std::size_t   PAGE_SIZE = 4096;
+
+struct file_header
+{
+    char                      magic[8];
+    std::uint32_t             version;
+    std::uint32_t             reserved;
+    ring_file::format_t       format;
+    std::uint64_t             slot_size;
+    std::atomic<std::int64_t> written;
+};
+
+// Readers check number before and after copying a slot, the writer sets it to -1 while the slot changes.
+struct slot_header
+{
+    std::atomic<std::int64_t> number;
+    std::uint64_t             samples;
+};
+
+const std::size_t SLOT_HEADER_SIZE = 64;
+
+static_assert(sizeof(file_header) <= PAGE_SIZE, "file_header does not fit its page");
+static_assert(sizeof(slot_header) <= SLOT_HEADER_SIZE, "slot_header does not fit its space");
+
+std::size_t align(std::size_t size, std::size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+} // namespace
+
+struct ring_file::impl
+{
+    boost::interprocess::file_mapping  mapping_;
+    boost::interprocess::mapped_region region_;
+    file_header*                       header_ = nullptr;
+    std::uint8_t*                      slots_  = nullptr;
+    std::size_t                        image_size_;
+
+    impl(const std::wstring& path, const format_t& format)
+    {
+        if (format.capacity == 0) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Replay ring needs room for at least one frame."));
+        }
+
+        const auto image_size = static_cast<std::size_t>(format.width) * format.height * 4;
+        const auto audio_size = static_cast<std::size_t>(format.max_samples) * format.audio_channels * 4;
+        const auto slot_size  = align(SLOT_HEADER_SIZE + image_size + audio_size, PAGE_SIZE);
+
+        boost::filesystem::create_directories(boost::filesystem::path(path).parent_path());
+        {
+            std::ofstream file(boost::filesystem::path(path).string(), std::ios::binary | std::ios::trunc);
+            if (!file) {
+                CASPAR_THROW_EXCEPTION(file_write_error() << msg_info("Could not create replay ring.")
+                                                          << boost::errinfo_file_name(u8(path)));
+            }
+        }
+        boost::filesystem::resize_file(path, PAGE_SIZE + slot_size * format.capacity);
+
+        map(path, boost::interprocess::read_write);
+
+        std::memcpy(header_->magic, MAGIC, sizeof(MAGIC));
+        header_->version   = VERSION;
+        header_->format    = format;
+        header_->slot_size = slot_size;
+        header_->written.store(0);
+        for (auto n = 0U; n < format.capacity; ++n) {
+            slot(n)->number.store(-1);
+        }
+
+        image_size_ = image_size;
+    }
+
+    explicit impl(const std::wstring& path)
+    {
+        map(path, boost::interprocess::read_only);
+
+        if (region_.get_size() < PAGE_SIZE || std::memcmp(header_->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header_->version != VERSION ||
+            region_.get_size() < PAGE_SIZE + header_->slot_size * header_->format.capacity) {
+            CASPAR_THROW_EXCEPTION(file_read_error() << msg_info("Not a replay ring.")
+                                                     << boost::errinfo_file_name(u8(path)));
+        }
+
+        image_size_ = static_cast<std::size_t>(header_->format.width) * header_->format.height * 4;
+    }
+
+    void map(const std::wstring& path, boost::interprocess::mode_t mode)
+    {
+        mapping_ = boost::interprocess::file_mapping(boost::filesystem::path(path).string().c_str(), mode);
+        region_  = boost::interprocess::mapped_region(mapping_, mode);
+        header_  = static_cast<file_header*>(region_.get_address());
+        slots_   = static_cast<std::uint8_t*>(region_.get_address()) + PAGE_SIZE;
+    }
+
+    slot_header* slot(std::int64_t number) const
+    {
+        return reinterpret_cast<slot_header*>(slots_ + (number % header_->format.capacity) * header_->slot_size);
+    }
+
+    std::uint8_t* image(std::int64_t number) const
+    {
+        return reinterpret_cast<std::uint8_t*>(slot(number)) + SLOT_HEADER_SIZE;
+    }
+
+    std::int32_t* audio(std::int64_t number) const
+    {
+        return reinterpret_cast<std::int32_t*>(image(number) + image_size_);
+    }
+
+    std::int64_t last() const { return header_->written.load(std::memory_order_acquire); }
+
+    std::int64_t first() const
+    {
+        // The oldest slot is the next one to be overwritten, it is left out.
+        return std::max<std::int64_t>(0, last() - header_->format.capacity + 1);
+    }
+
+    void write(const std::uint8_t* image_data, const std::int32_t* audio_data, std::size_t samples)
+    {
+        const auto number = last();
+        const auto header = slot(number);
+        const auto max    = static_cast<std::size_t>(header_->format.max_samples) * header_->format.audio_channels;
+
+        samples = std::min(samples, max);
+
+        header->number.store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(image(number), image_data, image_size_);
+        if (samples > 0) {
+            std::memcpy(audio(number), audio_data, samples * sizeof(std::int32_t));
+        }
+        header->samples = samples;
+
+        header->number.store(number, std::memory_order_release);
+        header_->written.store(number + 1, std::memory_order_release);
+    }
+
+    bool read(std::int64_t number, std::uint8_t* image_data, std::vector<std::int32_t>& audio_data) const
+    {
+        if (number < first() || number >= last()) {
+            return false;
+        }
+
+        const auto header = slot(number);
+        if (header->number.load(std::memory_order_acquire) != number) {
+            return false;
+        }
+
+        const auto max     = static_cast<std::size_t>(header_->format.max_samples) * header_->format.audio_channels;
+        const auto samples = std::min<std::size_t>(header->samples, max);
+
+        std::memcpy(image_data, image(number), image_size_);
+        audio_data.assign(audio(number), audio(number) + samples);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header->number.load(std::memory_order_relaxed) == number;
+    }
+};
+
+ring_file::ring_file(const std::wstring& path, const format_t& format)
+    : impl_(new impl(path, format))
+{
+}
+
+ring_file::ring_file(const std::wstring& path)
+    : impl_(new impl(path))
+{
+}
+
+ring_file::~ring_file() {}
+
+const ring_file::format_t& ring_file::format() const { return impl_->header_->format; }
+
+std::size_t ring_file::image_size() const { return impl_->image_size_; }
+
+std::int64_t ring_file::first() const { return impl_->first(); }
+
+std::int64_t ring_file::last() const { return impl_->last(); }
+
+void ring_file::write(const std::uint8_t* image, const std::int32_t* audio, std::size_t samples)
+{
+    impl_->write(image, audio, samples);
+}
+
+bool ring_file::read(std::int64_t number, std::uint8_t* image, std::vector<std::int32_t>& audio) const
+{
+    return impl_->read(number, image, audio);
+}
+
+}} // namespace caspar::replay
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace replay {
+
+// The last frames of a channel in a preallocated, memory mapped file. One writer appends uncompressed BGRA images
+// and their audio, any number of readers copy frames out by number while it keeps writing.
+class ring_file
+{
+  public:
+    struct format_t
+    {
+        std::uint32_t width             = 0;
+        std::uint32_t height            = 0;
+        std::uint32_t framerate_num     = 0;
+        std::uint32_t framerate_den     = 1;
+        std::uint32_t audio_channels    = 0;
+        std::uint32_t audio_sample_rate = 0;
+        std::uint32_t max_samples       = 0; // per channel and frame
+        std::uint32_t capacity          = 0; // frames
+    };
+
+    // Creates the file for writing, replacing any existing one.
+    ring_file(const std::wstring& path, const format_t& format);
+
+    // Opens an existing file for reading.
+    explicit ring_file(const std::wstring& path);
+
+    ~ring_file();
+
+    const format_t& format() const;
+
+    std::size_t image_size() const;
+
+    // Frames from first() up to, but not including, last() can be read.
+    std::int64_t first() const;
+    std::int64_t last() const;
+
+    // samples counts the interleaved samples of all channels, anything beyond max_samples is dropped.
+    void write(const std::uint8_t* image, const std::int32_t* audio, std::size_t samples);
+
+    // False if the frame is not written yet or was overwritten while it was copied.
+    bool read(std::int64_t number, std::uint8_t* image, std::vector<std::int32_t>& audio) const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::replay
@@ -44,9 +44,10 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <tbb/concurrent_queue.h>
-
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -113,6 +114,9 @@ struct configuration
     colour_spaces   colour_space  = colour_spaces::RGB;
 };
 
+// Longest time window events wait for while the consumer waits for frames or uploads.
+const auto EVENT_INTERVAL = std::chrono::milliseconds(5);
+
 struct frame
 {
     GLuint pbo   = 0;
@@ -143,7 +147,9 @@ struct screen_consumer
     spl::shared_ptr<diagnostics::graph> graph_;
     caspar::timer                       tick_timer_;
 
-    tbb::concurrent_bounded_queue<core::const_frame> frame_buffer_;
+    std::mutex              frame_mutex_;
+    std::condition_variable frame_cond_;
+    core::const_frame       pending_frame_;
 
     std::unique_ptr<accelerator::ogl::shader> shader_;
     GLuint                                    vao_;
@@ -172,8 +178,6 @@ struct screen_consumer
             }
         }
 
-        frame_buffer_.set_capacity(1);
-
         graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f));
         graph_->set_color("frame-time", diagnostics::color(0.1f, 1.0f, 0.1f));
         graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
@@ -272,7 +276,8 @@ struct screen_consumer
                 shader_->set("background", 0);
                 shader_->set("window_width", screen_width_);
 
-                for (int n = 0; n < 2; ++n) {
+                // One frame uploading, one displayed and one still read by the previous draw.
+                for (int n = 0; n < 3; ++n) {
                     screen::frame frame;
                     auto          flags = GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | GL_MAP_WRITE_BIT;
                     GL(glCreateBuffers(1, &frame.pbo));
@@ -324,13 +329,14 @@ struct screen_consumer
                 while (is_running_) {
                     tick();
                 }
-            } catch (tbb::user_abort&) {
-                // Do nothing
             } catch (...) {
                 CASPAR_LOG_CURRENT_EXCEPTION();
                 is_running_ = false;
             }
             for (auto frame : frames_) {
+                if (frame.fence != nullptr) {
+                    glDeleteSync(frame.fence);
+                }
                 GL(glUnmapNamedBuffer(frame.pbo));
                 glDeleteBuffers(1, &frame.pbo);
                 glDeleteTextures(1, &frame.tex);
@@ -347,7 +353,7 @@ struct screen_consumer
     ~screen_consumer()
     {
         is_running_ = false;
-        frame_buffer_.abort();
+        frame_cond_.notify_all();
         thread_.join();
     }
 
@@ -370,10 +376,14 @@ struct screen_consumer
     {
         core::const_frame in_frame;
 
-        while (!frame_buffer_.try_pop(in_frame) && is_running_) {
-            // TODO (fix)
-            if (!poll()) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        // A new frame ends the wait at once, window events are handled in between.
+        while (is_running_) {
+            poll();
+            std::unique_lock<std::mutex> lock(frame_mutex_);
+            if (frame_cond_.wait_for(lock, EVENT_INTERVAL, [&] { return pending_frame_ || !is_running_; })) {
+                in_frame       = std::move(pending_frame_);
+                pending_frame_ = core::const_frame();
+                break;
             }
         }
 
@@ -385,16 +395,16 @@ struct screen_consumer
         {
             auto& frame = frames_.front();
 
+            // Uploaded two frames ago, the fence has normally been signalled long before.
             while (frame.fence != nullptr) {
-                auto wait = glClientWaitSync(frame.fence, 0, 0);
-                if (wait == GL_ALREADY_SIGNALED || wait == GL_CONDITION_SATISFIED) {
+                const auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(EVENT_INTERVAL).count();
+                const auto wait    = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+                if (wait == GL_TIMEOUT_EXPIRED) {
+                    poll();
+                } else {
                     glDeleteSync(frame.fence);
                     frame.fence = nullptr;
                 }
-                if (!poll()) {
-                    // TODO (fix)
-                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
-                }
             }
 
             std::memcpy(frame.ptr, in_frame.image_data(0).begin(), format_desc_.size);
@@ -465,9 +475,15 @@ struct screen_consumer
 
     std::future<bool> send(const core::const_frame& frame)
     {
-        if (!frame_buffer_.try_push(frame)) {
-            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        {
+            std::lock_guard<std::mutex> lock(frame_mutex_);
+            if (pending_frame_) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+            } else {
+                pending_frame_ = frame;
+            }
         }
+        frame_cond_.notify_one();
         return make_ready_future(is_running_.load());
     }
 
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_consumer.h"
+
+#include "../util/shm_ring.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/param.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/crc.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace caspar { namespace shm {
+
+// Publishes every channel frame to other processes, see shm_ring.
+struct shm_consumer : public core::frame_consumer
+{
+    core::monitor::state                state_;
+    mutable std::mutex                  state_mutex_;
+    const std::wstring                  name_;
+    const int                           slots_;
+    const int                           index_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    std::unique_ptr<shm_ring>           ring_;
+    std::int64_t                        dropped_ = 0;
+    executor                            executor_{L"shm_consumer"};
+
+  public:
+    shm_consumer(std::wstring name, int slots)
+        : name_(std::move(name))
+        , slots_(slots)
+        , index_([&] {
+            boost::crc_16_type result;
+            result.process_bytes(name_.data(), name_.length() * sizeof(wchar_t));
+            return 210000 + result.checksum();
+        }())
+    {
+        diagnostics::register_graph(graph_);
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_text(print());
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        executor_.invoke([&] {
+            shm_ring::format_t format;
+            format.width             = format_desc.width;
+            format.height            = format_desc.height;
+            format.framerate_num     = format_desc.framerate.numerator();
+            format.framerate_den     = format_desc.framerate.denominator();
+            format.audio_channels    = format_desc.audio_channels;
+            format.audio_sample_rate = format_desc.audio_sample_rate;
+            format.max_samples       = format_desc.audio_cadence.empty()
+                                     ? 0
+                                     : *std::max_element(format_desc.audio_cadence.begin(),
+                                                         format_desc.audio_cadence.end());
+            format.slots = static_cast<std::uint32_t>(std::max(2, slots_));
+
+            ring_.reset();
+            ring_ = std::make_unique<shm_ring>(u8(name_), format);
+
+            std::lock_guard<std::mutex> lock(state_mutex_);
+            state_["shm/name"]    = u8(name_);
+            state_["shm/dropped"] = dropped_;
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        return executor_.begin_invoke([=] {
+            if (!ring_ || frame.image_data(0).size() != ring_->image_size()) {
+                return true;
+            }
+
+            // Readers holding every slot must not hold up the channel.
+            if (!ring_->write(frame.image_data(0).begin(), frame.audio_data().begin(), frame.audio_data().size())) {
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+
+                std::lock_guard<std::mutex> lock(state_mutex_);
+                state_["shm/dropped"] = ++dropped_;
+            }
+            return true;
+        });
+    }
+
+    std::wstring print() const override { return L"shm[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"shm"; }
+
+    int index() const override { return index_; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"SHM")) {
+        return core::frame_consumer::empty();
+    }
+
+    return spl::make_shared<shm_consumer>(params.at(1), get_param(L"SLOTS", params, 4));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    return spl::make_shared<shm_consumer>(ptree.get<std::wstring>(L"name", L"casparcg"), ptree.get(L"slots", 4));
+}
+
+}} // namespace caspar::shm
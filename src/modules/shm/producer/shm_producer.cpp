@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_producer.h"
+
+#include "../util/shm_ring.h"
+
+#include <common/array.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/algorithm/string.hpp>
+
+#include <mutex>
+
+namespace caspar { namespace shm {
+
+// Shows the latest frame another process published. Frames reference the leased slot instead of being copied, the
+// slot is released when the mixer is done with the frame.
+struct shm_producer : public core::frame_producer
+{
+    core::monitor::state    state_;
+    mutable std::mutex      state_mutex_;
+    const std::wstring      name_;
+    const shm_ring          ring_;
+    core::pixel_format_desc desc_;
+    std::int64_t            number_  = -1;
+    std::int64_t            skipped_ = 0;
+    core::draw_frame        frame_;
+
+    explicit shm_producer(std::wstring name)
+        : name_(std::move(name))
+        , ring_(u8(name_))
+        , desc_(core::pixel_format::bgra)
+    {
+        desc_.planes.push_back(core::pixel_format_desc::plane(ring_.format().width, ring_.format().height, 4));
+
+        CASPAR_LOG(info) << print() << L" Initialized";
+    }
+
+    // frame_producer
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        if (auto lease = ring_.read(number_)) {
+            const auto& info = lease->info();
+            if (number_ >= 0) {
+                skipped_ += info.number - number_ - 1;
+            }
+            number_ = info.number;
+
+            std::vector<array<const std::uint8_t>> image_data;
+            image_data.emplace_back(lease->image(), ring_.image_size(), lease);
+            auto audio_data = array<const std::int32_t>(lease->audio(), static_cast<std::size_t>(info.samples), lease);
+
+            frame_ = core::draw_frame(core::const_frame(std::move(image_data), std::move(audio_data), desc_));
+        }
+
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["shm/name"]    = u8(name_);
+        state_["shm/frame"]   = number_;
+        state_["shm/skipped"] = skipped_;
+
+        return frame_;
+    }
+
+    std::wstring print() const override { return L"shm_producer[" + name_ + L"]"; }
+
+    std::wstring name() const override { return L"shm"; }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_producer> create_producer(const core::frame_producer_dependencies& dependencies,
+                                                      const std::vector<std::wstring>&         params)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"SHM")) {
+        return core::frame_producer::empty();
+    }
+
+    return spl::make_shared<shm_producer>(params.at(1));
+}
+
+}} // namespace caspar::shm
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_ring.h"
+
+#include <common/except.h>
+
+#ifdef _WIN32
+#include <boost/interprocess/windows_shared_memory.hpp>
+#else
+#include <boost/interprocess/shared_memory_object.hpp>
+#endif
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+namespace caspar { namespace shm {
+
+namespace {
+
+const char          MAGIC[8]  = {'C', 'A', 'S', 'P', 'S', 'H', 'M', '1'};
+const std::uint32_t VERSION   = 1;
+const std::size_t   PAGE_SIZE = 4096;
+
+struct ring_header
+{
+    char                      magic[8];
+    std::uint32_t             version;
+    std::uint32_t             reserved;
+    shm_ring::format_t        format;
+    std::uint64_t             slot_size;
+    std::atomic<std::int32_t> latest; // slot, -1 before the first frame
+};
+
+struct slot_header
+{
+    std::atomic<std::int32_t> readers; // -1 while the writer fills the slot
+    std::uint32_t             reserved;
+    shm_ring::frame_info      info;
+};
+
+const std::size_t SLOT_HEADER_SIZE = 64;
+
+static_assert(sizeof(ring_header) <= PAGE_SIZE, "ring_header does not fit its page");
+static_assert(sizeof(slot_header) <= SLOT_HEADER_SIZE, "slot_header does not fit its space");
+
+std::size_t align(std::size_t size, std::size_t alignment) { return (size + alignment - 1) / alignment * alignment; }
+
+} // namespace
+
+struct shm_ring::impl : std::enable_shared_from_this<impl>
+{
+    const std::string name_;
+    const bool        owner_;
+#ifdef _WIN32
+    boost::interprocess::windows_shared_memory shm_;
+#else
+    boost::interprocess::shared_memory_object shm_;
+#endif
+    boost::interprocess::mapped_region region_;
+    ring_header*                       header_ = nullptr;
+    std::uint8_t*                      slots_  = nullptr;
+    std::size_t                        image_size_;
+    std::uint32_t                      last_slot_ = 0;
+    std::int64_t                       number_    = 0;
+
+    impl(const std::string& name, const format_t& format)
+        : name_(name)
+        , owner_(true)
+    {
+        if (format.slots < 2) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Shared memory ring needs at least two slots."));
+        }
+
+        image_size_           = static_cast<std::size_t>(format.width) * format.height * 4;
+        const auto audio_size = static_cast<std::size_t>(format.max_samples) * format.audio_channels * 4;
+        const auto slot_size  = align(SLOT_HEADER_SIZE + image_size_ + audio_size, PAGE_SIZE);
+        const auto size       = PAGE_SIZE + slot_size * format.slots;
+
+#ifdef _WIN32
+        shm_ = boost::interprocess::windows_shared_memory(
+            boost::interprocess::create_only, name.c_str(), boost::interprocess::read_write, size);
+#else
+        boost::interprocess::shared_memory_object::remove(name.c_str());
+        shm_ = boost::interprocess::shared_memory_object(
+            boost::interprocess::create_only, name.c_str(), boost::interprocess::read_write);
+        shm_.truncate(static_cast<boost::interprocess::offset_t>(size));
+#endif
+        map();
+
+        std::memcpy(header_->magic, MAGIC, sizeof(MAGIC));
+        header_->version   = VERSION;
+        header_->format    = format;
+        header_->slot_size = slot_size;
+        for (auto n = 0U; n < format.slots; ++n) {
+            slot(n)->readers.store(0);
+            slot(n)->info = frame_info{};
+        }
+        header_->latest.store(-1, std::memory_order_release);
+    }
+
+    explicit impl(const std::string& name)
+        : name_(name)
+        , owner_(false)
+    {
+#ifdef _WIN32
+        shm_ = boost::interprocess::windows_shared_memory(
+            boost::interprocess::open_only, name.c_str(), boost::interprocess::read_write);
+#else
+        shm_ = boost::interprocess::shared_memory_object(
+            boost::interprocess::open_only, name.c_str(), boost::interprocess::read_write);
+#endif
+        map();
+
+        if (region_.get_size() < PAGE_SIZE || std::memcmp(header_->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            header_->version != VERSION ||
+            region_.get_size() < PAGE_SIZE + header_->slot_size * header_->format.slots) {
+            CASPAR_THROW_EXCEPTION(invalid_argument() << msg_info("Not a frame ring: " + name));
+        }
+
+        image_size_ = static_cast<std::size_t>(header_->format.width) * header_->format.height * 4;
+    }
+
+    ~impl()
+    {
+#ifndef _WIN32
+        if (owner_) {
+            boost::interprocess::shared_memory_object::remove(name_.c_str());
+        }
+#endif
+    }
+
+    void map()
+    {
+        region_ = boost::interprocess::mapped_region(shm_, boost::interprocess::read_write);
+        header_ = static_cast<ring_header*>(region_.get_address());
+        slots_  = static_cast<std::uint8_t*>(region_.get_address()) + PAGE_SIZE;
+    }
+
+    slot_header* slot(std::uint32_t index) const
+    {
+        return reinterpret_cast<slot_header*>(slots_ + index * header_->slot_size);
+    }
+
+    bool write(const std::uint8_t* image, const std::int32_t* audio, std::size_t samples)
+    {
+        const auto slots = header_->format.slots;
+        const auto max   = static_cast<std::size_t>(header_->format.max_samples) * header_->format.audio_channels;
+
+        // The latest slot is left for readers that have not leased it yet.
+        for (auto n = 1U; n < slots; ++n) {
+            const auto index    = (last_slot_ + n) % slots;
+            const auto header   = slot(index);
+            auto       expected = 0;
+            if (!header->readers.compare_exchange_strong(expected, -1, std::memory_order_acquire)) {
+                continue;
+            }
+
+            const auto data = reinterpret_cast<std::uint8_t*>(header) + SLOT_HEADER_SIZE;
+            samples         = std::min(samples, max);
+            std::memcpy(data, image, image_size_);
+            if (samples > 0) {
+                std::memcpy(data + image_size_, audio, samples * sizeof(std::int32_t));
+            }
+
+            const auto now = std::chrono::system_clock::now().time_since_epoch();
+
+            header->info.number  = number_++;
+            header->info.time    = std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+            header->info.samples = samples;
+            header->readers.store(0, std::memory_order_release);
+
+            header_->latest.store(static_cast<std::int32_t>(index), std::memory_order_release);
+            last_slot_ = index;
+            return true;
+        }
+        return false;
+    }
+
+    struct slot_lease : public lease
+    {
+        std::shared_ptr<const impl> ring;
+        slot_header*                header;
+
+        slot_lease(std::shared_ptr<const impl> ring, slot_header* header)
+            : ring(std::move(ring))
+            , header(header)
+        {
+        }
+
+        ~slot_lease() override { header->readers.fetch_sub(1, std::memory_order_release); }
+
+        const frame_info& info() const override { return header->info; }
+
+        const std::uint8_t* image() const override
+        {
+            return reinterpret_cast<const std::uint8_t*>(header) + SLOT_HEADER_SIZE;
+        }
+
+        const std::int32_t* audio() const override
+        {
+            return reinterpret_cast<const std::int32_t*>(image() + ring->image_size_);
+        }
+    };
+
+    std::shared_ptr<const lease> read(std::int64_t after) const
+    {
+        // A slot taken by the writer between reading latest and leasing it is retried, it becomes the next latest.
+        for (auto retry = 0; retry < 4; ++retry) {
+            const auto index = header_->latest.load(std::memory_order_acquire);
+            if (index < 0 || static_cast<std::uint32_t>(index) >= header_->format.slots) {
+                return nullptr;
+            }
+
+            const auto header  = slot(static_cast<std::uint32_t>(index));
+            auto       readers = header->readers.load(std::memory_order_relaxed);
+            while (readers >= 0 &&
+                   !header->readers.compare_exchange_weak(readers, readers + 1, std::memory_order_acquire)) {
+            }
+            if (readers < 0) {
+                continue;
+            }
+
+            auto result = std::make_shared<slot_lease>(shared_from_this(), header);
+            return result->info().number > after ? result : nullptr;
+        }
+        return nullptr;
+    }
+};
+
+shm_ring::shm_ring(const std::string& name, const format_t& format)
+    : impl_(std::make_shared<impl>(name, format))
+{
+}
+
+shm_ring::shm_ring(const std::string& name)
+    : impl_(std::make_shared<impl>(name))
+{
+}
+
+shm_ring::~shm_ring() {}
+
+const shm_ring::format_t& shm_ring::format() const { return impl_->header_->format; }
+
+std::size_t shm_ring::image_size() const { return impl_->image_size_; }
+
+bool shm_ring::write(const std::uint8_t* image, const std::int32_t* audio, std::size_t samples)
+{
+    return impl_->write(image, audio, samples);
+}
+
+std::shared_ptr<const shm_ring::lease> shm_ring::read(std::int64_t after) const { return impl_->read(after); }
+
+}} // namespace caspar::shm
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace shm {
+
+// Frames published through named shared memory to other processes: POSIX shm on Linux, a file mapping on Windows.
+// The writer fills one of a few slots and advertises it as the latest. Readers lease a slot and use its memory in
+// place, the writer skips leased slots and drops a frame when all of them are taken.
+class shm_ring
+{
+  public:
+    struct format_t
+    {
+        std::uint32_t width             = 0;
+        std::uint32_t height            = 0;
+        std::uint32_t framerate_num     = 0;
+        std::uint32_t framerate_den     = 1;
+        std::uint32_t audio_channels    = 0;
+        std::uint32_t audio_sample_rate = 0;
+        std::uint32_t max_samples       = 0; // per channel and frame
+        std::uint32_t slots             = 0;
+    };
+
+    // The metadata published with every frame.
+    struct frame_info
+    {
+        std::int64_t  number  = -1;
+        std::int64_t  time    = 0; // microseconds since the epoch, when it was published
+        std::uint64_t samples = 0; // interleaved samples of all channels
+    };
+
+    // A slot kept from being overwritten while it is alive.
+    class lease
+    {
+      public:
+        virtual ~lease() = default;
+
+        virtual const frame_info&   info() const  = 0;
+        virtual const std::uint8_t* image() const = 0;
+        virtual const std::int32_t* audio() const = 0;
+    };
+
+    // Creates the segment for writing, replacing a stale one of the same name.
+    shm_ring(const std::string& name, const format_t& format);
+
+    // Opens the segment of a running writer.
+    explicit shm_ring(const std::string& name);
+
+    ~shm_ring();
+
+    const format_t& format() const;
+
+    std::size_t image_size() const;
+
+    // False when every slot is leased and the frame was dropped.
+    bool write(const std::uint8_t* image, const std::int32_t* audio, std::size_t samples);
+
+    // The latest frame if it is newer than after, otherwise nullptr.
+    std::shared_ptr<const lease> read(std::int64_t after) const;
+
+  private:
+    struct impl;
+    std::shared_ptr<impl> impl_;
+};
+
+}} // namespace caspar::shm
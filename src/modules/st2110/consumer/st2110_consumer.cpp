@@ -0,0 +1,608 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "st2110_consumer.h"
+
+#include "../util/rtp.h"
+#include "../util/udp_sender.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/except.h>
+#include <common/executor.h>
+#include <common/log.h>
+#include <common/os/thread.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+const int          VIDEO_PAYLOAD_TYPE = 96;
+const int          AUDIO_PAYLOAD_TYPE = 97;
+const int          VIDEO_HEADER_SIZE  = RTP_HEADER_SIZE + 2 + 6; // Extended sequence number and one row header.
+const int          MAX_AUDIO_PAYLOAD  = 1440;
+const std::size_t  DEPTH              = 2;       // Frames waiting for their period.
+const std::int64_t TAKE_LEAD          = 2000000; // Frames are taken this long before their period starts.
+const std::int64_t TXTIME_LEAD        = 500000;  // Packets with a launch time are handed over this long before it.
+
+struct destination
+{
+    std::string    address;
+    unsigned short port = 20000;
+
+    std::string print() const { return address + ":" + std::to_string(port); }
+};
+
+destination parse_destination(const std::wstring& spec)
+{
+    destination result;
+    auto        text  = u8(spec);
+    auto        colon = text.rfind(':');
+    result.address    = text.substr(0, colon);
+    if (colon != std::string::npos) {
+        result.port = boost::lexical_cast<unsigned short>(text.substr(colon + 1));
+    }
+    return result;
+}
+
+struct configuration
+{
+    destination video;
+    destination audio; // Without an address the audio is not sent.
+    std::string interface_address;
+    int         ttl            = 16;
+    int         video_dscp     = 34;
+    int         audio_dscp     = 46;
+    int         payload_size   = 1200; // Bytes of pgroups per video packet at most.
+    int         batch          = 32;   // Video packets per system call.
+    int         packet_time_us = 1000; // Of audio, 1000 or 125.
+    bool        txtime         = false;
+
+    void validate() const
+    {
+        if (video.address.empty()) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"ST 2110 needs a video address"));
+        }
+        if (payload_size < 5 || payload_size > 1440 || batch < 1) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid ST 2110 payload size or batch"));
+        }
+        if (packet_time_us != 1000 && packet_time_us != 125) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"ST 2110 audio packet time is 1000 or 125 us"));
+        }
+    }
+};
+
+// Share of a tick that video packets are spread over, leaving the vertical blanking of the raster free the way
+// ST 2110-21 gapped senders do.
+double active_ratio(int height)
+{
+    switch (height) {
+        case 2160:
+            return 2160.0 / 2250.0;
+        case 1080:
+            return 1080.0 / 1125.0;
+        case 720:
+            return 720.0 / 750.0;
+        case 576:
+            return 576.0 / 625.0;
+        case 486:
+        case 480:
+            return height / 525.0;
+        default:
+            return 1.0;
+    }
+}
+
+std::string rate_text(const boost::rational<int>& rate)
+{
+    return rate.denominator() == 1 ? std::to_string(rate.numerator())
+                                   : std::to_string(rate.numerator()) + "/" + std::to_string(rate.denominator());
+}
+
+} // namespace
+
+// Sends the channel as SMPTE ST 2110-20 video of 4:2:2 10 bit pgroups and ST 2110-30 audio, AES67 L24, through the
+// host's network stack. Each tick goes out in its own period of PTP time with the packets spread over it, and the
+// GPU renders the pgroups so the sender only puts headers in front of lines of the frame. The consumer is a clock
+// for the channel, which then runs in PTP time; otherwise frames are dropped or repeated as the clocks drift.
+struct st2110_consumer : public core::frame_consumer
+{
+    const configuration                 config_;
+    core::monitor::state                state_;
+    mutable std::mutex                  state_mutex_;
+    spl::shared_ptr<diagnostics::graph> graph_;
+    core::video_format_desc             format_desc_;
+    frame_clock                         clock_;
+    std::unique_ptr<udp_sender>         video_;
+    std::unique_ptr<udp_sender>         audio_;
+    std::uint32_t                       video_ssrc_;
+    std::uint32_t                       audio_ssrc_;
+    int                                 audio_channels_ = 0; // Those of the channel that fit a packet.
+    int                                 audio_samples_  = 0; // Per packet.
+    std::string                         sdp_;
+
+    mutable std::mutex            mutex_;
+    std::condition_variable       cond_;
+    std::deque<core::const_frame> frames_;
+    bool                          abort_ = false;
+    std::atomic<bool>             master_{true};
+    std::atomic<std::int64_t>     sent_{0};
+    std::atomic<std::int64_t>     dropped_{0};
+    std::atomic<std::int64_t>     repeated_{0};
+    std::atomic<std::int64_t>     late_{0};
+    std::thread                   thread_;
+    executor                      executor_;
+
+    // Of the sender thread.
+    std::uint32_t                   video_sequence_ = 0;
+    std::uint16_t                   audio_sequence_ = 0;
+    std::vector<std::uint8_t>       video_headers_;
+    std::vector<std::uint8_t>       audio_buffers_;
+    std::vector<udp_sender::packet> video_packets_;
+    std::vector<udp_sender::packet> audio_packets_;
+    std::vector<std::int32_t>       audio_fifo_;
+    std::int64_t                    audio_start_  = -1;
+    std::int64_t                    audio_packet_ = 0;
+
+  public:
+    explicit st2110_consumer(configuration config)
+        : config_(std::move(config))
+        , executor_(L"st2110_consumer[" + u16(config_.video.print()) + L"]")
+    {
+        config_.validate();
+
+        std::random_device random;
+        video_ssrc_ = random();
+        audio_ssrc_ = random();
+
+        video_ = std::make_unique<udp_sender>(config_.video.address,
+                                              config_.video.port,
+                                              config_.interface_address,
+                                              config_.ttl,
+                                              config_.video_dscp,
+                                              config_.txtime);
+        if (!config_.audio.address.empty()) {
+            audio_ = std::make_unique<udp_sender>(config_.audio.address,
+                                                  config_.audio.port,
+                                                  config_.interface_address,
+                                                  config_.ttl,
+                                                  config_.audio_dscp,
+                                                  config_.txtime);
+        }
+
+        diagnostics::register_graph(graph_);
+        graph_->set_color("dropped-frame", diagnostics::color(0.3f, 0.6f, 0.3f));
+        graph_->set_color("repeated-frame", diagnostics::color(0.6f, 0.3f, 0.3f));
+        graph_->set_color("late-frame", diagnostics::color(0.6f, 0.3f, 0.9f));
+        graph_->set_text(print());
+    }
+
+    ~st2110_consumer() override { stop(); }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            abort_ = true;
+            frames_.clear();
+        }
+        cond_.notify_all();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    // Returns false once the consumer is stopping. A master waits for room, otherwise the oldest frame is dropped.
+    bool push(core::const_frame frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (master_) {
+            cond_.wait(lock, [&] { return frames_.size() < DEPTH || abort_; });
+        } else if (frames_.size() >= DEPTH) {
+            frames_.pop_front();
+            ++dropped_;
+            graph_->set_tag(diagnostics::tag_severity::WARNING, "dropped-frame");
+        }
+        if (abort_) {
+            return false;
+        }
+        frames_.push_back(std::move(frame));
+        return true;
+    }
+
+    void run()
+    {
+        set_thread_name(L"st2110");
+
+        std::int64_t      next = -1;
+        core::const_frame last;
+        while (true) {
+            auto period = std::max(next, clock_.next_period(tai_now() + TAKE_LEAD));
+            if (next >= 0 && period > next) {
+                late_ += period - next;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "late-frame");
+            }
+            sleep_until(clock_.start(period) - TAKE_LEAD);
+
+            core::const_frame frame;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (abort_) {
+                    return;
+                }
+                if (!frames_.empty()) {
+                    frame = std::move(frames_.front());
+                    frames_.pop_front();
+                }
+            }
+            cond_.notify_all();
+
+            const auto repeat = !frame;
+            if (repeat && last) {
+                frame = last;
+                ++repeated_;
+                graph_->set_tag(diagnostics::tag_severity::WARNING, "repeated-frame");
+            }
+            if (frame) {
+                send_period(period, frame, repeat);
+                last = frame;
+            }
+            next = period + 1;
+            update_state();
+        }
+    }
+
+    void send_period(std::int64_t period, const core::const_frame& frame, bool repeat)
+    {
+        const auto start = clock_.start(period);
+        build_video(period, start, frame);
+        build_audio(start, repeat ? core::const_frame{} : frame);
+
+        // Audio is sent a packet at a time in between batches of video, in the order of their times.
+        std::size_t v = 0;
+        std::size_t a = 0;
+        while (v < video_packets_.size() || a < audio_packets_.size()) {
+            const auto audio = a < audio_packets_.size() &&
+                               (v == video_packets_.size() || audio_packets_[a].time <= video_packets_[v].time);
+            auto&       sender = audio ? *audio_ : *video_;
+            const auto& packet = audio ? audio_packets_[a] : video_packets_[v];
+            const auto  count =
+                audio ? 1 : std::min(static_cast<std::size_t>(config_.batch), video_packets_.size() - v);
+
+            const auto due = packet.time - (sender.txtime() ? TXTIME_LEAD : 0);
+            if (due > tai_now()) {
+                sleep_until(due);
+            }
+            sender.send(&packet, count);
+            (audio ? a : v) += count;
+        }
+        ++sent_;
+    }
+
+    // Rows of pgroups cut into packets of equal size, one row header each. A whole frame of an interlaced format
+    // sends the lines of the field of the tick.
+    void build_video(std::int64_t period, std::int64_t start, const core::const_frame& frame)
+    {
+        video_packets_.clear();
+
+        const auto image = frame.pixel_format_desc().format == core::pixel_format::pgroup
+                               ? frame
+                               : frame.converted(core::pixel_format::pgroup);
+        if (!image) {
+            return;
+        }
+
+        const auto& desc     = image.pixel_format_desc();
+        const auto& plane    = desc.planes.at(0);
+        const auto  woven    = format_desc_.field_count == 2 && desc.field == core::field_mode::progressive;
+        const auto  second   = woven ? period % 2 == 1 : desc.field == core::field_mode::lower;
+        const auto  lines    = woven ? plane.height / 2 : plane.height;
+        const auto  pgroups  = format_desc_.width / 2;
+        const auto  per_line = (pgroups * 5 + config_.payload_size - 1) / config_.payload_size;
+        const auto  count    = lines * per_line;
+        const auto  spread   = static_cast<std::int64_t>(clock_.length() * active_ratio(format_desc_.height));
+        const auto  data     = image.image_data(0).data();
+        const auto  ts       = clock_.video_timestamp(period);
+
+        video_headers_.resize(static_cast<std::size_t>(count) * VIDEO_HEADER_SIZE);
+        auto header = video_headers_.data();
+        for (int line = 0; line < lines; ++line) {
+            const auto y   = woven ? line * 2 + (second ? 1 : 0) : line;
+            const auto row = data + static_cast<std::size_t>(y) * plane.linesize;
+            for (int n = 0; n < per_line; ++n, header += VIDEO_HEADER_SIZE) {
+                const auto first = pgroups * n / per_line;
+                const auto size  = (pgroups * (n + 1) / per_line - first) * 5;
+                const auto index = line * per_line + n;
+
+                write_rtp_header(header,
+                                 VIDEO_PAYLOAD_TYPE,
+                                 index == count - 1,
+                                 static_cast<std::uint16_t>(video_sequence_),
+                                 ts,
+                                 video_ssrc_);
+                put_be16(header + 12, video_sequence_ >> 16);
+                put_be16(header + 14, static_cast<std::uint32_t>(size));
+                put_be16(header + 16, (second ? 0x8000 : 0) | line);
+                put_be16(header + 18, static_cast<std::uint32_t>(first * 2));
+                ++video_sequence_;
+
+                udp_sender::packet packet;
+                packet.header       = header;
+                packet.header_size  = VIDEO_HEADER_SIZE;
+                packet.payload      = row + first * 5;
+                packet.payload_size = static_cast<std::size_t>(size);
+                packet.time         = start + spread * index / count;
+                video_packets_.push_back(packet);
+            }
+        }
+    }
+
+    // Packets on a timeline of their own, continued from tick to tick. The samples of a frame wait in a fifo for the
+    // packets that are due, silence fills in for missing frames and the oldest samples are dropped if the channel
+    // runs ahead.
+    void build_audio(std::int64_t start, const core::const_frame& frame)
+    {
+        audio_packets_.clear();
+        if (!audio_) {
+            return;
+        }
+
+        const auto rate     = static_cast<std::int64_t>(format_desc_.audio_sample_rate);
+        const auto length   = clock_.length();
+        const auto end      = start + length;
+        const auto channels = format_desc_.audio_channels;
+        const auto at       = [&](std::int64_t packet) {
+            return audio_start_ + scale(packet * audio_samples_, NS_PER_SECOND, rate);
+        };
+
+        if (audio_start_ < 0 || at(audio_packet_) < start - length) {
+            if (audio_start_ >= 0) {
+                audio_fifo_.clear();
+            }
+            audio_start_  = start;
+            audio_packet_ = 0;
+        }
+
+        if (frame) {
+            const auto& samples = frame.audio_data();
+            for (std::size_t n = 0; n + channels <= samples.size(); n += channels) {
+                audio_fifo_.insert(audio_fifo_.end(), samples.begin() + n, samples.begin() + n + audio_channels_);
+            }
+        }
+        const auto limit = static_cast<std::size_t>(scale(length * 2, rate, NS_PER_SECOND)) * audio_channels_;
+        if (audio_fifo_.size() > limit) {
+            audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.end() - limit);
+        }
+
+        const auto payload = static_cast<std::size_t>(audio_samples_) * audio_channels_ * 3;
+        const auto size    = RTP_HEADER_SIZE + payload;
+        auto       packets = 0;
+        while (at(audio_packet_ + packets) < end) {
+            ++packets;
+        }
+        audio_buffers_.resize(size * packets);
+
+        std::size_t used = 0;
+        auto        dst  = audio_buffers_.data();
+        for (int n = 0; n < packets; ++n, ++audio_packet_, dst += size) {
+            const auto ts = static_cast<std::uint32_t>(scale(audio_start_, rate, NS_PER_SECOND) +
+                                                       audio_packet_ * audio_samples_);
+            write_rtp_header(dst, AUDIO_PAYLOAD_TYPE, false, audio_sequence_++, ts, audio_ssrc_);
+
+            auto out = dst + RTP_HEADER_SIZE;
+            for (std::size_t s = 0; s < payload / 3; ++s, ++used, out += 3) {
+                const auto sample = used < audio_fifo_.size() ? audio_fifo_[used] : 0;
+                out[0]            = static_cast<std::uint8_t>(sample >> 24);
+                out[1]            = static_cast<std::uint8_t>(sample >> 16);
+                out[2]            = static_cast<std::uint8_t>(sample >> 8);
+            }
+
+            udp_sender::packet packet;
+            packet.header      = dst;
+            packet.header_size = size;
+            packet.time        = at(audio_packet_);
+            audio_packets_.push_back(packet);
+        }
+        audio_fifo_.erase(audio_fifo_.begin(), audio_fifo_.begin() + std::min(used, audio_fifo_.size()));
+    }
+
+    std::string make_sdp() const
+    {
+        const auto source  = video_->source_address();
+        const auto session = std::to_string(video_ssrc_);
+
+        std::ostringstream sdp;
+        sdp << "v=0\r\n";
+        sdp << "o=- " << session << " 0 IN IP4 " << source << "\r\n";
+        sdp << "s=" << u8(print()) << "\r\n";
+        sdp << "t=0 0\r\n";
+
+        const auto media = [&](const destination& dest) {
+            sdp << "c=IN IP4 " << dest.address << "/" << config_.ttl << "\r\n";
+            sdp << "a=source-filter: incl IN IP4 " << dest.address << " " << source << "\r\n";
+            sdp << "a=ts-refclk:ptp=IEEE1588-2008:traceable\r\n";
+            sdp << "a=mediaclk:direct=0\r\n";
+        };
+
+        sdp << "m=video " << config_.video.port << " RTP/AVP " << VIDEO_PAYLOAD_TYPE << "\r\n";
+        media(config_.video);
+        sdp << "a=rtpmap:" << VIDEO_PAYLOAD_TYPE << " raw/90000\r\n";
+        sdp << "a=fmtp:" << VIDEO_PAYLOAD_TYPE << " sampling=YCbCr-4:2:2; width=" << format_desc_.width
+            << "; height=" << format_desc_.height
+            << "; exactframerate=" << rate_text(format_desc_.framerate / format_desc_.field_count)
+            << "; depth=10; TCS=SDR; colorimetry=" << (format_desc_.height > 700 ? "BT709" : "BT601")
+            << "; PM=2110GPM; SSN=ST2110-20:2017; TP=2110TPW;" << (format_desc_.field_count == 2 ? " interlace;" : "")
+            << "\r\n";
+
+        if (audio_) {
+            sdp << "m=audio " << config_.audio.port << " RTP/AVP " << AUDIO_PAYLOAD_TYPE << "\r\n";
+            media(config_.audio);
+            sdp << "a=rtpmap:" << AUDIO_PAYLOAD_TYPE << " L24/" << format_desc_.audio_sample_rate << "/"
+                << audio_channels_ << "\r\n";
+            sdp << "a=ptime:" << (config_.packet_time_us == 1000 ? "1" : "0.125") << "\r\n";
+        }
+        return sdp.str();
+    }
+
+    void update_state()
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        state_["st2110/video/address"] = config_.video.print();
+        if (audio_) {
+            state_["st2110/audio/address"]  = config_.audio.print();
+            state_["st2110/audio/channels"] = audio_channels_;
+        }
+        state_["st2110/txtime"]          = video_->txtime();
+        state_["st2110/sent"]            = sent_.load();
+        state_["st2110/dropped"]         = dropped_.load();
+        state_["st2110/repeated"]        = repeated_.load();
+        state_["st2110/late"]            = late_.load();
+        state_["st2110/dropped-packets"] = video_->dropped() + (audio_ ? audio_->dropped() : 0);
+        state_["st2110/sdp"]             = sdp_;
+    }
+
+    // frame_consumer
+
+    void initialize(const core::video_format_desc& format_desc, int channel_index) override
+    {
+        executor_.invoke([=] {
+            stop();
+
+            format_desc_      = format_desc;
+            clock_.time_scale = format_desc.time_scale;
+            clock_.duration   = format_desc.duration;
+
+            audio_samples_  = format_desc.audio_sample_rate * config_.packet_time_us / 1000000;
+            audio_channels_ = std::min(format_desc.audio_channels, MAX_AUDIO_PAYLOAD / (audio_samples_ * 3));
+            if (audio_ && audio_channels_ < format_desc.audio_channels) {
+                CASPAR_LOG(warning) << print() << L" Sending the first " << audio_channels_ << L" of "
+                                    << format_desc.audio_channels << L" audio channels, as many as fit a packet.";
+            }
+            audio_fifo_.clear();
+            audio_start_ = -1;
+
+            sdp_ = make_sdp();
+            update_state();
+
+            abort_  = false;
+            thread_ = std::thread([this] { run(); });
+        });
+
+        CASPAR_LOG(info) << print() << L" Initialized.\n" << u16(sdp_);
+    }
+
+    std::future<bool> send(core::const_frame frame) override
+    {
+        return executor_.begin_invoke([=] { return push(frame); });
+    }
+
+    std::wstring print() const override { return L"st2110[" + u16(config_.video.print()) + L"]"; }
+
+    std::wstring name() const override { return L"st2110"; }
+
+    int index() const override { return 230000 + config_.video.port; }
+
+    bool has_synchronization_clock() const override { return true; }
+
+    void set_synchronization_clock(bool enabled) override { master_ = enabled; }
+
+    std::int64_t clock_time() const override { return tai_now() / 1000; }
+
+    core::pixel_format preferred_pixel_format() const override { return core::pixel_format::pgroup; }
+
+    bool accepts_fields() const override { return true; }
+
+    int buffered_frames() const override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<int>(frames_.size());
+    }
+
+    core::monitor::state state() const override
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        return state_;
+    }
+};
+
+spl::shared_ptr<core::frame_consumer> create_consumer(const std::vector<std::wstring>&                         params,
+                                                      const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    if (params.size() < 2 || !boost::iequals(params.at(0), L"ST2110")) {
+        return core::frame_consumer::empty();
+    }
+
+    configuration config;
+    config.video = parse_destination(params.at(1));
+    for (std::size_t n = 2; n + 1 < params.size(); n += 2) {
+        const auto& name  = params.at(n);
+        const auto& value = params.at(n + 1);
+        if (boost::iequals(name, L"AUDIO")) {
+            config.audio = parse_destination(value);
+        } else if (boost::iequals(name, L"INTERFACE")) {
+            config.interface_address = u8(value);
+        } else if (boost::iequals(name, L"TTL")) {
+            config.ttl = boost::lexical_cast<int>(value);
+        } else if (boost::iequals(name, L"TXTIME")) {
+            config.txtime = boost::iequals(value, L"1") || boost::iequals(value, L"TRUE");
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown ST 2110 option " + name));
+        }
+    }
+    return spl::make_shared<st2110_consumer>(std::move(config));
+}
+
+spl::shared_ptr<core::frame_consumer>
+create_preconfigured_consumer(const boost::property_tree::wptree&               ptree,
+                              std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    configuration config;
+    config.video             = parse_destination(ptree.get(L"video", L""));
+    config.audio             = parse_destination(ptree.get(L"audio", L""));
+    config.interface_address = u8(ptree.get(L"interface", L""));
+    config.ttl               = ptree.get(L"ttl", config.ttl);
+    config.video_dscp        = ptree.get(L"video-dscp", config.video_dscp);
+    config.audio_dscp        = ptree.get(L"audio-dscp", config.audio_dscp);
+    config.payload_size      = ptree.get(L"payload-size", config.payload_size);
+    config.batch             = ptree.get(L"batch", config.batch);
+    config.packet_time_us    = ptree.get(L"audio-packet-time", config.packet_time_us);
+    config.txtime            = ptree.get(L"txtime", config.txtime);
+    return spl::make_shared<st2110_consumer>(std::move(config));
+}
+
+}} // namespace caspar::st2110
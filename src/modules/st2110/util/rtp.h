@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
+
+namespace caspar { namespace st2110 {
+
+const std::int64_t NS_PER_SECOND = 1000000000;
+
+// Nanoseconds of CLOCK_TAI. ST 2110 takes its timestamps from PTP time, which is TAI, so the host clock is expected
+// to follow the grandmaster through ptp4l and phc2sys with the kernel's UTC offset set.
+inline std::int64_t tai_now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_TAI, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * NS_PER_SECOND + ts.tv_nsec;
+}
+
+inline void sleep_until(std::int64_t tai)
+{
+    timespec ts;
+    ts.tv_sec  = static_cast<time_t>(tai / NS_PER_SECOND);
+    ts.tv_nsec = static_cast<long>(tai % NS_PER_SECOND);
+    while (clock_nanosleep(CLOCK_TAI, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+// value * num / den rounded down, without overflowing for nanoseconds since the TAI epoch.
+inline std::int64_t scale(std::int64_t value, std::int64_t num, std::int64_t den)
+{
+    return value / den * num + value % den * num / den;
+}
+
+// Channel ticks of time_scale / duration per second, the fields of interlaced formats, counted from the TAI epoch,
+// which is where ST 2110-10 aligns them.
+struct frame_clock
+{
+    std::int64_t time_scale = 1;
+    std::int64_t duration   = 1;
+
+    // The first period starting at or after a time.
+    std::int64_t next_period(std::int64_t tai) const
+    {
+        const auto whole = tai / NS_PER_SECOND * time_scale;
+        const auto part  = (tai % NS_PER_SECOND * time_scale + NS_PER_SECOND - 1) / NS_PER_SECOND;
+        return (whole + part + duration - 1) / duration;
+    }
+
+    std::int64_t start(std::int64_t period) const { return scale(period * duration, NS_PER_SECOND, time_scale); }
+
+    std::int64_t length() const { return scale(duration, NS_PER_SECOND, time_scale); }
+
+    std::uint32_t video_timestamp(std::int64_t period) const
+    {
+        return static_cast<std::uint32_t>(scale(period * duration, 90000, time_scale));
+    }
+};
+
+inline void put_be16(std::uint8_t* dst, std::uint32_t value)
+{
+    dst[0] = static_cast<std::uint8_t>(value >> 8);
+    dst[1] = static_cast<std::uint8_t>(value);
+}
+
+inline void put_be32(std::uint8_t* dst, std::uint32_t value)
+{
+    put_be16(dst, value >> 16);
+    put_be16(dst + 2, value);
+}
+
+const int RTP_HEADER_SIZE = 12;
+
+// Version 2 without padding, extension or contributing sources.
+inline void write_rtp_header(std::uint8_t* dst,
+                             int           payload_type,
+                             bool          marker,
+                             std::uint16_t sequence,
+                             std::uint32_t timestamp,
+                             std::uint32_t ssrc)
+{
+    dst[0] = 0x80;
+    dst[1] = static_cast<std::uint8_t>((marker ? 0x80 : 0x00) | (payload_type & 0x7f));
+    put_be16(dst + 2, sequence);
+    put_be32(dst + 4, timestamp);
+    put_be32(dst + 8, ssrc);
+}
+
+}} // namespace caspar::st2110
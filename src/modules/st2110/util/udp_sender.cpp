@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "udp_sender.h"
+
+#include <common/except.h>
+#include <common/log.h>
+
+#include <arpa/inet.h>
+#include <linux/net_tstamp.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+namespace caspar { namespace st2110 {
+
+namespace {
+
+const std::size_t MAX_BATCH   = 64;
+const std::size_t CMSG_BYTES  = CMSG_SPACE(sizeof(std::uint64_t));
+const int         SEND_BUFFER = 8 * 1024 * 1024;
+
+in_addr parse_address(const std::string& address)
+{
+    in_addr result{};
+    if (inet_pton(AF_INET, address.c_str(), &result) != 1) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info("Invalid IPv4 address: " + address));
+    }
+    return result;
+}
+
+void check(int result, const std::string& what)
+{
+    if (result < 0) {
+        CASPAR_THROW_EXCEPTION(io_error() << msg_info(what + " failed: " + std::strerror(errno)));
+    }
+}
+
+template <typename T>
+void set_option(int socket, int level, int name, const T& value, const std::string& what)
+{
+    check(setsockopt(socket, level, name, &value, sizeof(value)), what);
+}
+
+} // namespace
+
+struct udp_sender::impl
+{
+    int                       socket_ = -1;
+    bool                      txtime_ = false;
+    std::atomic<std::int64_t> dropped_{0};
+    std::vector<mmsghdr>      messages_;
+    std::vector<iovec>        iovecs_;
+    std::vector<char>         controls_;
+
+    impl(const std::string& address,
+         unsigned short     port,
+         const std::string& interface_address,
+         int                ttl,
+         int                dscp,
+         bool               txtime)
+        : messages_(MAX_BATCH)
+        , iovecs_(MAX_BATCH * 2)
+        , controls_(MAX_BATCH * CMSG_BYTES)
+    {
+        sockaddr_in destination{};
+        destination.sin_family = AF_INET;
+        destination.sin_port   = htons(port);
+        destination.sin_addr   = parse_address(address);
+
+        socket_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        check(socket_, "socket");
+
+        try {
+            if (!interface_address.empty()) {
+                sockaddr_in local{};
+                local.sin_family = AF_INET;
+                local.sin_addr   = parse_address(interface_address);
+                check(bind(socket_, reinterpret_cast<const sockaddr*>(&local), sizeof(local)), "bind");
+                if (IN_MULTICAST(ntohl(destination.sin_addr.s_addr))) {
+                    set_option(socket_, IPPROTO_IP, IP_MULTICAST_IF, local.sin_addr, "IP_MULTICAST_IF");
+                }
+            }
+            if (IN_MULTICAST(ntohl(destination.sin_addr.s_addr))) {
+                set_option(socket_, IPPROTO_IP, IP_MULTICAST_TTL, ttl, "IP_MULTICAST_TTL");
+            } else {
+                set_option(socket_, IPPROTO_IP, IP_TTL, ttl, "IP_TTL");
+            }
+            set_option(socket_, IPPROTO_IP, IP_TOS, dscp << 2, "IP_TOS");
+            set_option(socket_, SOL_SOCKET, SO_SNDBUF, SEND_BUFFER, "SO_SNDBUF");
+
+            if (txtime) {
+                sock_txtime config{};
+                config.clockid = CLOCK_TAI;
+                if (setsockopt(socket_, SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) == 0) {
+                    txtime_ = true;
+                } else {
+                    CASPAR_LOG(warning) << L"[st2110] SO_TXTIME is not available, packets are paced in software.";
+                }
+            }
+
+            check(connect(socket_, reinterpret_cast<const sockaddr*>(&destination), sizeof(destination)), "connect");
+        } catch (...) {
+            ::close(socket_);
+            throw;
+        }
+    }
+
+    ~impl() { ::close(socket_); }
+
+    void send(const packet* packets, std::size_t count)
+    {
+        while (count > 0) {
+            const auto batch = std::min(count, MAX_BATCH);
+            for (std::size_t n = 0; n < batch; ++n) {
+                iovecs_[n * 2]     = iovec{const_cast<std::uint8_t*>(packets[n].header), packets[n].header_size};
+                iovecs_[n * 2 + 1] = iovec{const_cast<std::uint8_t*>(packets[n].payload), packets[n].payload_size};
+
+                auto& message      = messages_[n].msg_hdr;
+                message            = msghdr{};
+                message.msg_iov    = &iovecs_[n * 2];
+                message.msg_iovlen = packets[n].payload_size > 0 ? 2 : 1;
+                if (txtime_) {
+                    message.msg_control    = &controls_[n * CMSG_BYTES];
+                    message.msg_controllen = CMSG_BYTES;
+                    auto cmsg              = CMSG_FIRSTHDR(&message);
+                    cmsg->cmsg_level       = SOL_SOCKET;
+                    cmsg->cmsg_type        = SCM_TXTIME;
+                    cmsg->cmsg_len         = CMSG_LEN(sizeof(std::uint64_t));
+                    const auto time        = static_cast<std::uint64_t>(packets[n].time);
+                    std::memcpy(CMSG_DATA(cmsg), &time, sizeof(time));
+                }
+            }
+
+            // A packet the kernel refuses is dropped and the rest of the batch is sent after it.
+            std::size_t sent = 0;
+            while (sent < batch) {
+                auto result = sendmmsg(socket_, &messages_[sent], static_cast<unsigned int>(batch - sent), 0);
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    ++dropped_;
+                    ++sent;
+                } else {
+                    sent += static_cast<std::size_t>(result);
+                }
+            }
+
+            packets += batch;
+            count -= batch;
+        }
+    }
+
+    std::string source_address() const
+    {
+        sockaddr_in local{};
+        socklen_t   size                  = sizeof(local);
+        char        text[INET_ADDRSTRLEN] = {};
+        if (getsockname(socket_, reinterpret_cast<sockaddr*>(&local), &size) < 0 ||
+            !inet_ntop(AF_INET, &local.sin_addr, text, sizeof(text))) {
+            return "0.0.0.0";
+        }
+        return text;
+    }
+};
+
+udp_sender::udp_sender(const std::string& address,
+                       unsigned short     port,
+                       const std::string& interface_address,
+                       int                ttl,
+                       int                dscp,
+                       bool               txtime)
+    : impl_(new impl(address, port, interface_address, ttl, dscp, txtime))
+{
+}
+udp_sender::~udp_sender() {}
+void         udp_sender::send(const packet* packets, std::size_t count) { impl_->send(packets, count); }
+std::string  udp_sender::source_address() const { return impl_->source_address(); }
+bool         udp_sender::txtime() const { return impl_->txtime_; }
+std::int64_t udp_sender::dropped() const { return impl_->dropped_; }
+
+}} // namespace caspar::st2110
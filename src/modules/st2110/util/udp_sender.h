@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace caspar { namespace st2110 {
+
+// A UDP socket sending to one address, multicast or not, through the interface with a local address. Packets are
+// handed to the kernel in batches with sendmmsg. With txtime each carries its launch time and the kernel releases it
+// then, which takes an etf qdisc on CLOCK_TAI on the interface; without, packets leave as they are sent.
+class udp_sender final
+{
+  public:
+    struct packet
+    {
+        const std::uint8_t* header       = nullptr;
+        std::size_t         header_size  = 0;
+        const std::uint8_t* payload      = nullptr;
+        std::size_t         payload_size = 0;
+        std::int64_t        time         = 0; // TAI nanoseconds.
+    };
+
+    udp_sender(const std::string& address,
+               unsigned short     port,
+               const std::string& interface_address,
+               int                ttl,
+               int                dscp,
+               bool               txtime);
+    ~udp_sender();
+
+    udp_sender(const udp_sender&) = delete;
+    udp_sender& operator=(const udp_sender&) = delete;
+
+    void send(const packet* packets, std::size_t count);
+
+    // The local address packets are sent from, for the source filter of an SDP.
+    std::string source_address() const;
+
+    // Whether launch times are used, false if the kernel refused them.
+    bool txtime() const;
+
+    // Packets the kernel did not take.
+    std::int64_t dropped() const;
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+}} // namespace caspar::st2110
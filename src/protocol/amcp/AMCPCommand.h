@@ -25,9 +25,12 @@
 #include "amcp_shared.h"
 #include <core/consumer/frame_consumer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_scanner.h>
 
 #include <boost/algorithm/string.hpp>
 
+#include <chrono>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 struct command_context
@@ -40,11 +43,16 @@ struct command_context
     spl::shared_ptr<core::cg_producer_registry>          cg_registry;
     spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
+    spl::shared_ptr<const core::media_scanner_registry>  scanner_registry;
     std::function<void(bool)>                            shutdown_server_now;
+    std::shared_ptr<amcp::channel_manager>               channel_manager;
     std::vector<std::wstring>                            parameters;
     std::string                                          proxy_host;
     std::string                                          proxy_port;
 
+    // Set when the command is parsed, before it waits in its queue.
+    std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now();
+
     int layer_index(int default_ = 0) const { return layer_id == -1 ? default_ : layer_id; }
 
     command_context(IO::ClientInfoPtr                                    client,
@@ -55,7 +63,9 @@ struct command_context
                     spl::shared_ptr<core::cg_producer_registry>          cg_registry,
                     spl::shared_ptr<const core::frame_producer_registry> producer_registry,
                     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry,
+                    spl::shared_ptr<const core::media_scanner_registry>  scanner_registry,
                     std::function<void(bool)>                            shutdown_server_now,
+                    std::shared_ptr<amcp::channel_manager>               channel_manager,
                     std::string                                          proxy_host,
                     std::string                                          proxy_port)
         : client(std::move(client))
@@ -66,7 +76,9 @@ struct command_context
         , cg_registry(std::move(cg_registry))
         , producer_registry(std::move(producer_registry))
         , consumer_registry(std::move(consumer_registry))
+        , scanner_registry(std::move(scanner_registry))
         , shutdown_server_now(shutdown_server_now)
+        , channel_manager(std::move(channel_manager))
         , proxy_host(std::move(proxy_host))
         , proxy_port(std::move(proxy_port))
     {
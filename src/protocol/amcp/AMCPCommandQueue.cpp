@@ -22,8 +22,12 @@
 #include "../StdAfx.h"
 
 #include "AMCPCommandQueue.h"
+#include "amcp_command_stats.h"
 
 #include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include <common/except.h>
 #include <common/timer.h>
 
@@ -47,9 +51,71 @@ std::map<std::wstring, AMCPCommandQueue*>& get_instances()
 
 } // namespace
 
+void execute_command(const AMCPCommand::ptr_type& command, double wait_time)
+{
+    // Commands that wait and execute for longer than this, in seconds, are logged as warnings.
+    static const double slow_command = env::properties().get(L"configuration.amcp.slow-command", 1000) / 1000.0;
+
+    try {
+        caspar::timer timer;
+
+        auto print  = command->print();
+        auto params = boost::join(command->parameters(), L" ");
+
+        try {
+            CASPAR_LOG(debug) << "Executing command (queued " << wait_time << "s): " << print;
+
+            if (command->Execute())
+                CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << print;
+            else
+                CASPAR_LOG(warning) << "Failed to execute command: " << print;
+        } catch (file_not_found&) {
+            CASPAR_LOG(error) << " Turn on log level debug for stacktrace.";
+            command->SetReplyString(L"404 " + command->print() + L" FAILED\r\n");
+        } catch (expected_user_error&) {
+            command->SetReplyString(L"403 " + command->print() + L" FAILED\r\n");
+        } catch (user_error&) {
+            CASPAR_LOG(error) << " Check syntax. Turn on log level debug for stacktrace.";
+            command->SetReplyString(L"403 " + command->print() + L" FAILED\r\n");
+        } catch (std::out_of_range&) {
+            CASPAR_LOG(error) << L"Missing parameter. Check syntax. Turn on log level debug for stacktrace.";
+            command->SetReplyString(L"402 " + command->print() + L" FAILED\r\n");
+        } catch (boost::bad_lexical_cast&) {
+            CASPAR_LOG(error) << L"Invalid parameter. Check syntax. Turn on log level debug for stacktrace.";
+            command->SetReplyString(L"403 " + command->print() + L" FAILED\r\n");
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            CASPAR_LOG(error) << "Failed to execute command: " << command->print();
+            command->SetReplyString(L"501 " + command->print() + L" FAILED\r\n");
+        }
+
+        command->SendReply();
+
+        const auto execute_time = timer.elapsed();
+        const auto client       = command->client() ? command->client()->address() : std::wstring();
+
+        record_command_times(print, client, wait_time, execute_time);
+
+        if (slow_command > 0.0 && wait_time + execute_time >= slow_command) {
+            CASPAR_LOG(warning) << L"Slow command from " << client << L" (queued " << wait_time << L"s, executed "
+                                << execute_time << L"s): " << print << L" " << params;
+        }
+
+        CASPAR_LOG(trace) << "Ready for a new command";
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+    }
+}
+
 AMCPCommandQueue::AMCPCommandQueue(const std::wstring& name)
-    : executor_(L"AMCPCommandQueue " + name)
+    : limit_(std::max(1, env::properties().get(L"configuration.amcp.queue-limit", 256)))
+    , graph_(spl::make_shared<caspar::diagnostics::graph>())
+    , executor_(L"AMCPCommandQueue " + name)
 {
+    // Not registered, so it is not drawn on the diagnostics window, but the queue wait and execute time in seconds are
+    // still exported by other graph sinks.
+    graph_->set_text(L"AMCP " + name);
+
     std::lock_guard<std::mutex> lock(get_global_mutex());
 
     get_instances().insert(std::make_pair(name, this));
@@ -67,7 +133,7 @@ void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
     if (!pCurrentCommand)
         return;
 
-    if (executor_.size() > 128) {
+    if (!push(pCurrentCommand->client(), [=](double wait_time) { execute_command(pCurrentCommand, wait_time); })) {
         try {
             CASPAR_LOG(error) << "AMCP Command Queue Overflow.";
             CASPAR_LOG(error) << "Failed to execute command:" << pCurrentCommand->print();
@@ -76,50 +142,79 @@ void AMCPCommandQueue::AddCommand(AMCPCommand::ptr_type pCurrentCommand)
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
         }
-        return;
     }
+}
 
-    executor_.begin_invoke([=] {
+void AMCPCommandQueue::AddCommands(std::vector<AMCPCommand::ptr_type>      commands,
+                                   std::function<void(core::stage_batch&)> apply,
+                                   IO::ClientInfoPtr                       client,
+                                   std::wstring                            reply)
+{
+    auto run = [=](double wait_time) {
         try {
-            try {
-                caspar::timer timer;
-
-                auto print  = pCurrentCommand->print();
-                auto params = boost::join(pCurrentCommand->parameters(), L" ");
-
-                CASPAR_LOG(debug) << "Executing command: " << print;
-
-                if (pCurrentCommand->Execute())
-                    CASPAR_LOG(debug) << "Executed command (" << timer.elapsed() << "s): " << print;
-                else
-                    CASPAR_LOG(warning) << "Failed to execute command: " << print;
-            } catch (file_not_found&) {
-                CASPAR_LOG(error) << " Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"404 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (expected_user_error&) {
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (user_error&) {
-                CASPAR_LOG(error) << " Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (std::out_of_range&) {
-                CASPAR_LOG(error) << L"Missing parameter. Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"402 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (boost::bad_lexical_cast&) {
-                CASPAR_LOG(error) << L"Invalid parameter. Check syntax. Turn on log level debug for stacktrace.";
-                pCurrentCommand->SetReplyString(L"403 " + pCurrentCommand->print() + L" FAILED\r\n");
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
-                CASPAR_LOG(error) << "Failed to execute command: " << pCurrentCommand->print();
-                pCurrentCommand->SetReplyString(L"501 " + pCurrentCommand->print() + L" FAILED\r\n");
-            }
+            core::stage_batch batch;
 
-            pCurrentCommand->SendReply();
+            for (auto& command : commands)
+                execute_command(command, wait_time);
+
+            apply(batch);
 
-            CASPAR_LOG(trace) << "Ready for a new command";
+            client->send(std::wstring(reply));
         } catch (...) {
             CASPAR_LOG_CURRENT_EXCEPTION();
         }
-    });
+    };
+
+    if (!push(client, std::move(run))) {
+        CASPAR_LOG(error) << "AMCP Command Queue Overflow.";
+        client->send(L"504 QUEUE OVERFLOW\r\n");
+    }
+}
+
+bool AMCPCommandQueue::push(const IO::ClientInfoPtr& client, std::function<void(double wait_time)> run)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto& commands = pending_[client.get()];
+        if (commands.size() >= limit_)
+            return false;
+
+        commands.push_back(pending_command{std::move(run), caspar::timer()});
+    }
+
+    // One task per command, each running whichever command is next in turn.
+    executor_.begin_invoke([this] { run_next(); });
+    return true;
+}
+
+void AMCPCommandQueue::run_next()
+{
+    pending_command command;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (pending_.empty())
+            return;
+
+        auto it = pending_.upper_bound(last_client_);
+        if (it == pending_.end())
+            it = pending_.begin();
+
+        last_client_ = it->first;
+        command      = std::move(it->second.front());
+        it->second.pop_front();
+
+        if (it->second.empty())
+            pending_.erase(it);
+    }
+
+    auto wait_time = command.queued.elapsed();
+    graph_->set_value("queue-wait", wait_time);
+
+    caspar::timer execute_timer;
+    command.run(wait_time);
+    graph_->set_value("execute-time", execute_timer.elapsed());
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -24,10 +24,25 @@
 #include "AMCPCommand.h"
 
 #include <common/executor.h>
+#include <common/forward.h>
 #include <common/memory.h>
+#include <common/timer.h>
+
+#include <core/producer/stage.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+FORWARD2(caspar, diagnostics, class graph);
 
 namespace caspar { namespace protocol { namespace amcp {
 
+// Executes the command on the calling thread and sends its reply, replying with an error if it fails.
+void execute_command(const AMCPCommand::ptr_type& command, double wait_time = 0.0);
+
 class AMCPCommandQueue
 {
     AMCPCommandQueue(const AMCPCommandQueue&);
@@ -41,7 +56,32 @@ class AMCPCommandQueue
 
     void AddCommand(AMCPCommand::ptr_type pCommand);
 
+    // Executes the commands in order, deferring their changes to the stages until apply is called with the batch
+    // holding them, and then replies to the client.
+    void AddCommands(std::vector<AMCPCommand::ptr_type>      commands,
+                     std::function<void(core::stage_batch&)> apply,
+                     IO::ClientInfoPtr                       client,
+                     std::wstring                            reply);
+
   private:
+    struct pending_command
+    {
+        std::function<void(double wait_time)> run;
+        caspar::timer                         queued;
+    };
+
+    bool push(const IO::ClientInfoPtr& client, std::function<void(double wait_time)> run);
+    void run_next();
+
+    const std::size_t                           limit_;
+    spl::shared_ptr<caspar::diagnostics::graph> graph_;
+
+    // Commands waiting for each client connection, taken one client at a time in turn, so that a client sending a
+    // flood of commands only delays its own.
+    std::mutex                                         mutex_;
+    std::map<const void*, std::deque<pending_command>> pending_;
+    const void*                                        last_client_ = nullptr;
+
     executor executor_;
 };
 
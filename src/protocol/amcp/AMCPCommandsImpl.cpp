@@ -30,14 +30,19 @@
 #include "../util/http_request.h"
 #include "AMCPCommandQueue.h"
 #include "amcp_command_repository.h"
+#include "amcp_command_stats.h"
+#include "amcp_data_cache.h"
 
 #include <common/env.h>
 
 #include <common/base64.h>
+#include <common/diagnostics/memory.h>
+#include <common/diagnostics/trace.h>
 #include <common/filesystem.h>
 #include <common/log.h>
 #include <common/os/filesystem.h>
 #include <common/param.h>
+#include <common/preload.h>
 
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
@@ -46,6 +51,7 @@
 #include <core/mixer/mixer.h>
 #include <core/producer/cg_proxy.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_scanner.h>
 #include <core/producer/stage.h>
 #include <core/producer/transition/sting_producer.h>
 #include <core/producer/transition/transition_producer.h>
@@ -182,6 +188,12 @@ std::wstring read_file(const boost::filesystem::path& file)
     return read_latin1_file(file);
 }
 
+data_cache& datasets()
+{
+    static data_cache cache(env::data_folder(), read_file);
+    return cache;
+}
+
 std::wstring get_sub_directory(const std::wstring& base_folder, const std::wstring& sub_directory)
 {
     if (sub_directory.empty())
@@ -207,11 +219,15 @@ std::vector<spl::shared_ptr<core::video_channel>> get_channels(const command_con
 core::frame_producer_dependencies get_producer_dependencies(const std::shared_ptr<core::video_channel>& channel,
                                                             const command_context&                      ctx)
 {
-    return core::frame_producer_dependencies(channel->frame_factory(),
-                                             get_channels(ctx),
-                                             channel->video_format_desc(),
-                                             ctx.producer_registry,
-                                             ctx.cg_registry);
+    core::frame_producer_dependencies dependencies(channel->frame_factory(),
+                                                   get_channels(ctx),
+                                                   channel->video_format_desc(),
+                                                   ctx.producer_registry,
+                                                   ctx.cg_registry);
+    dependencies.latency   = channel->latency();
+    dependencies.offline   = channel->offline();
+    dependencies.requested = ctx.received;
+    return dependencies;
 }
 
 // Basic Commands
@@ -348,6 +364,18 @@ std::wstring swap_command(command_context& ctx)
     return L"202 SWAP OK\r\n";
 }
 
+// ADD 1 ISO 10 FILE ... and REMOVE 1 ISO 10 ... address the consumers of layer 10 on its own, see
+// video_channel::add_iso. Returns the layer, -1 without ISO.
+int take_iso_layer(command_context& ctx)
+{
+    if (ctx.parameters.size() < 2 || !boost::iequals(ctx.parameters.at(0), L"ISO")) {
+        return -1;
+    }
+    const auto layer = boost::lexical_cast<int>(ctx.parameters.at(1));
+    ctx.parameters.erase(ctx.parameters.begin(), ctx.parameters.begin() + 2);
+    return layer;
+}
+
 std::wstring add_command(command_context& ctx)
 {
     replace_placeholders(L"<CLIENT_IP_ADDRESS>", ctx.client->address(), ctx.parameters);
@@ -355,15 +383,25 @@ std::wstring add_command(command_context& ctx)
     core::diagnostics::scoped_call_context save;
     core::diagnostics::call_context::for_thread().video_channel = ctx.channel_index + 1;
 
+    const auto iso = take_iso_layer(ctx);
+    if (iso != -1 && ctx.parameters.empty()) {
+        return L"402 ADD FAILED\r\n";
+    }
+
     auto consumer = ctx.consumer_registry->create_consumer(ctx.parameters, get_channels(ctx));
-    ctx.channel.channel->output().add(ctx.layer_index(consumer->index()), consumer);
+    if (iso != -1) {
+        ctx.channel.channel->add_iso(iso, ctx.layer_index(consumer->index()), consumer);
+    } else {
+        ctx.channel.channel->output().add(ctx.layer_index(consumer->index()), consumer);
+    }
 
     return L"202 ADD OK\r\n";
 }
 
 std::wstring remove_command(command_context& ctx)
 {
-    auto index = ctx.layer_index(std::numeric_limits<int>::min());
+    const auto iso   = take_iso_layer(ctx);
+    auto       index = ctx.layer_index(std::numeric_limits<int>::min());
 
     if (index == std::numeric_limits<int>::min()) {
         replace_placeholders(L"<CLIENT_IP_ADDRESS>", ctx.client->address(), ctx.parameters);
@@ -375,7 +413,7 @@ std::wstring remove_command(command_context& ctx)
         index = ctx.consumer_registry->create_consumer(ctx.parameters, get_channels(ctx))->index();
     }
 
-    if (!ctx.channel.channel->output().remove(index)) {
+    if (!(iso != -1 ? ctx.channel.channel->remove_iso(iso, index) : ctx.channel.channel->output().remove(index))) {
         return L"404 REMOVE FAILED\r\n";
     }
 
@@ -413,7 +451,12 @@ std::wstring set_command(command_context& ctx)
     if (name == L"MODE") {
         auto format_desc = core::video_format_desc(value);
         if (format_desc.format != core::video_format::invalid) {
-            ctx.channel.channel->video_format_desc(format_desc);
+            // SEAMLESS prepares the switch in the background and keeps the layers while the frame rate stays.
+            if (ctx.parameters.size() > 2 && boost::iequals(ctx.parameters.at(2), L"SEAMLESS")) {
+                ctx.channel.channel->switch_format(format_desc);
+            } else {
+                ctx.channel.channel->video_format_desc(format_desc);
+            }
             return L"202 SET MODE OK\r\n";
         }
 
@@ -425,31 +468,7 @@ std::wstring set_command(command_context& ctx)
 
 std::wstring data_store_command(command_context& ctx)
 {
-    std::wstring filename = env::data_folder();
-    filename.append(ctx.parameters[0]);
-    filename.append(L".ftd");
-
-    auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
-    auto found_data_path = find_case_insensitive(data_path);
-
-    if (found_data_path)
-        data_path = *found_data_path;
-
-    if (!boost::filesystem::exists(data_path))
-        boost::filesystem::create_directories(data_path);
-
-    auto found_filename = find_case_insensitive(filename);
-
-    if (found_filename)
-        filename = *found_filename; // Overwrite case insensitive.
-
-    boost::filesystem::wofstream datafile(filename);
-    if (!datafile)
-        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not open file " + filename));
-
-    datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
-    datafile << ctx.parameters[1] << std::flush;
-    datafile.close();
+    datasets().store(ctx.parameters[0], ctx.parameters[1]);
 
     return L"202 DATA STORE OK\r\n";
 }
@@ -460,12 +479,7 @@ std::wstring data_retrieve_command(command_context& ctx)
     filename.append(ctx.parameters[0]);
     filename.append(L".ftd");
 
-    std::wstring file_contents;
-
-    auto found_file = find_case_insensitive(filename);
-
-    if (found_file)
-        file_contents = read_file(boost::filesystem::path(*found_file));
+    auto file_contents = datasets().retrieve(ctx.parameters[0]);
 
     if (file_contents.empty())
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
@@ -497,6 +511,8 @@ std::wstring data_list_command(command_context& ctx)
     if (!ctx.parameters.empty())
         sub_directory = ctx.parameters.at(0);
 
+    datasets().flush();
+
     std::wstringstream replyString;
     replyString << L"200 DATA LIST OK\r\n";
 
@@ -528,6 +544,8 @@ std::wstring data_remove_command(command_context& ctx)
     filename.append(ctx.parameters[0]);
     filename.append(L".ftd");
 
+    datasets().forget(ctx.parameters[0]);
+
     if (!boost::filesystem::exists(filename))
         CASPAR_THROW_EXCEPTION(file_not_found() << msg_info(filename + L" not found"));
 
@@ -566,17 +584,9 @@ std::wstring cg_add_command(command_context& ctx)
         if (dataString.at(0) == L'<' || dataString.at(0) == L'{') // the data is XML or Json
             pDataString = dataString.c_str();
         else {
-            // The data is not an XML-string, it must be a filename
-            std::wstring filename = env::data_folder();
-            filename.append(dataString);
-            filename.append(L".ftd");
-
-            auto found_file = find_case_insensitive(filename);
-
-            if (found_file) {
-                dataFromFile = read_file(boost::filesystem::path(*found_file));
-                pDataString  = dataFromFile.c_str();
-            }
+            // The data is not an XML-string, it must be the name of a dataset
+            dataFromFile = datasets().retrieve(dataString);
+            pDataString  = dataFromFile.c_str();
         }
     }
 
@@ -652,12 +662,8 @@ std::wstring cg_update_command(command_context& ctx)
 
     std::wstring dataString = ctx.parameters.at(1);
     if (dataString.at(0) != L'<' && dataString.at(0) != L'{') {
-        // The data is not XML or Json, it must be a filename
-        std::wstring filename = env::data_folder();
-        filename.append(dataString);
-        filename.append(L".ftd");
-
-        dataString = read_file(boost::filesystem::path(filename));
+        // The data is not XML or Json, it must be the name of a dataset
+        dataString = datasets().retrieve(dataString);
     }
 
     get_expected_cg_proxy(ctx)->update(layer, dataString);
@@ -714,8 +720,12 @@ class transforms_applier
     void commit_deferred()
     {
         auto& transforms = deferred_transforms_[ctx_.channel_index];
-        ctx_.channel.channel->stage().apply_transforms(transforms).get();
+        auto  applied    = ctx_.channel.channel->stage().apply_transforms(transforms);
         transforms.clear();
+
+        // Within a batch the transforms are applied when the batch is committed.
+        if (!core::stage_batch::is_active())
+            applied.get();
     }
 
     void apply()
@@ -777,12 +787,22 @@ std::wstring mixer_chroma_command(command_context& ctx)
                L" " + std::to_wstring(chroma.hue_width) + L" " + std::to_wstring(chroma.min_saturation) + L" " +
                std::to_wstring(chroma.min_brightness) + L" " + std::to_wstring(chroma.softness) + L" " +
                std::to_wstring(chroma.spill_suppress) + L" " + std::to_wstring(chroma.spill_suppress_saturation) +
-               L" " + std::wstring(chroma.show_mask ? L"1" : L"0") + L"\r\n";
+               L" " + std::wstring(chroma.show_mask ? L"1" : L"0") + std::wstring(chroma.ycbcr ? L" YCBCR" : L"") +
+               L"\r\n";
     }
 
     transforms_applier transforms(ctx);
     core::chroma       chroma;
 
+    // YCBCR anywhere among the parameters keys in the YCbCr plane of the source instead of in HSV.
+    auto ycbcr = std::find_if(ctx.parameters.begin(), ctx.parameters.end(), [](const std::wstring& param) {
+        return boost::iequals(param, L"YCBCR");
+    });
+    if (ycbcr != ctx.parameters.end()) {
+        chroma.ycbcr = true;
+        ctx.parameters.erase(ycbcr);
+    }
+
     int          duration;
     std::wstring tween;
 
@@ -1213,7 +1233,8 @@ std::wstring channel_grid_command(command_context& ctx)
         if (channel.channel != self.channel) {
             core::diagnostics::call_context::for_thread().layer = index;
             auto producer                                       = ctx.producer_registry->create_producer(
-                get_producer_dependencies(self.channel, ctx), L"route://" + std::to_wstring(channel.channel->index()));
+                get_producer_dependencies(self.channel, ctx),
+                std::vector<std::wstring>{L"route://" + std::to_wstring(channel.channel->index()), L"MIXED"});
             self.channel->stage().load(index, producer, false);
             self.channel->stage().play(index);
             index++;
@@ -1236,7 +1257,7 @@ std::wstring channel_grid_command(command_context& ctx)
 
 std::wstring make_request(command_context& ctx, const std::string& path, const std::wstring& default_response)
 {
-    auto res = http::request(ctx.proxy_host, ctx.proxy_port, path);
+    auto res = http::request_async(ctx.proxy_host, ctx.proxy_port, path).get();
     if (res.status_code >= 500 || res.body.size() == 0) {
         CASPAR_LOG(error) << "Failed to connect to media-scanner. Is it running? \nReason: " << res.status_message;
         return default_response;
@@ -1244,36 +1265,68 @@ std::wstring make_request(command_context& ctx, const std::string& path, const s
     return u16(res.body);
 }
 
+// Served by the in-process scanner when a module registered one, otherwise by the external media-scanner.
+std::wstring scan_request(command_context&                                         ctx,
+                          const std::function<std::wstring(core::media_scanner&)>& fn,
+                          const std::string&                                       path,
+                          const std::wstring&                                      default_response)
+{
+    if (auto scanner = ctx.scanner_registry->get_media_scanner()) {
+        auto res = fn(*scanner);
+        if (!res.empty()) {
+            return res;
+        }
+    }
+    return make_request(ctx, path, default_response);
+}
+
 std::wstring thumbnail_list_command(command_context& ctx)
 {
-    return make_request(ctx, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
+    return scan_request(
+        ctx, [](auto& scanner) { return scanner.thumbnail_list(); }, "/thumbnail", L"501 THUMBNAIL LIST FAILED\r\n");
 }
 
 std::wstring thumbnail_retrieve_command(command_context& ctx)
 {
-    return make_request(
-        ctx, "/thumbnail/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL RETRIEVE FAILED\r\n");
+    const auto name = ctx.parameters.at(0);
+    return scan_request(ctx,
+                        [&](auto& scanner) { return scanner.thumbnail_retrieve(name); },
+                        "/thumbnail/" + http::url_encode(u8(name)),
+                        L"501 THUMBNAIL RETRIEVE FAILED\r\n");
 }
 
 std::wstring thumbnail_generate_command(command_context& ctx)
 {
-    return make_request(
-        ctx, "/thumbnail/generate/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 THUMBNAIL GENERATE FAILED\r\n");
+    const auto name = ctx.parameters.at(0);
+    return scan_request(ctx,
+                        [&](auto& scanner) { return scanner.thumbnail_generate(name); },
+                        "/thumbnail/generate/" + http::url_encode(u8(name)),
+                        L"501 THUMBNAIL GENERATE FAILED\r\n");
 }
 
 std::wstring thumbnail_generateall_command(command_context& ctx)
 {
-    return make_request(ctx, "/thumbnail/generate", L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
+    return scan_request(ctx,
+                        [](auto& scanner) { return scanner.thumbnail_generate_all(); },
+                        "/thumbnail/generate",
+                        L"501 THUMBNAIL GENERATE_ALL FAILED\r\n");
 }
 
 // Query Commands
 
 std::wstring cinf_command(command_context& ctx)
 {
-    return make_request(ctx, "/cinf/" + http::url_encode(u8(ctx.parameters.at(0))), L"501 CINF FAILED\r\n");
+    const auto name = ctx.parameters.at(0);
+    return scan_request(ctx,
+                        [&](auto& scanner) { return scanner.cinf(name); },
+                        "/cinf/" + http::url_encode(u8(name)),
+                        L"501 CINF FAILED\r\n");
 }
 
-std::wstring cls_command(command_context& ctx) { return make_request(ctx, "/cls", L"501 CLS FAILED\r\n"); }
+std::wstring cls_command(command_context& ctx)
+{
+    return scan_request(ctx, [](auto& scanner) { return scanner.cls(); }, "/cls", L"501 CLS FAILED\r\n");
+}
 
 std::wstring fls_command(command_context& ctx) { return make_request(ctx, "/fls", L"501 FLS FAILED\r\n"); }
 
@@ -1318,7 +1371,7 @@ std::wstring info_channel_command(command_context& ctx)
     pt::wptree channel_info;
 
     auto state = ctx.channel.channel->state();
-    for (const auto& p : state) {
+    for (const auto& p : *state) {
         const auto replaced = boost::algorithm::replace_all_copy(p.first, "/", ".");
         // avoid digit-only nodes in XML
         const auto path = boost::algorithm::replace_all_regex_copy(
@@ -1391,6 +1444,53 @@ std::wstring info_paths_command(command_context& ctx)
 }
 
 
+std::wstring info_preload_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"201 INFO PRELOAD OK\r\n";
+
+    pt::xml_writer_settings<std::wstring> w(' ', 3);
+    pt::xml_parser::write_xml(replyString, preload::info(), w);
+
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
+// Reads clips ahead of air time on a background thread, all of each unless SECONDS n limits the read to their start:
+// PRELOAD AMB GO1080p25 [SECONDS 10]. The clips are listed by INFO PRELOAD.
+std::wstring preload_command(command_context& ctx)
+{
+    auto                      seconds = 0.0;
+    std::vector<std::wstring> clips;
+    for (size_t n = 0; n < ctx.parameters.size(); ++n) {
+        if (boost::iequals(ctx.parameters.at(n), L"SECONDS") && n + 1 < ctx.parameters.size()) {
+            seconds = boost::lexical_cast<double>(ctx.parameters.at(++n));
+        } else {
+            clips.push_back(ctx.parameters.at(n));
+        }
+    }
+    if (clips.empty() || seconds < 0.0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected clips and a positive number of seconds."));
+    }
+
+    for (auto& clip : clips) {
+        preload::add(clip, seconds);
+    }
+    return L"202 PRELOAD OK\r\n";
+}
+
+// Drops the listed clips, or all of them, and the memory they hold.
+std::wstring preload_clear_command(command_context& ctx)
+{
+    if (ctx.parameters.empty()) {
+        preload::remove();
+    }
+    for (auto& clip : ctx.parameters) {
+        preload::remove(clip);
+    }
+    return L"202 PRELOAD CLEAR OK\r\n";
+}
+
 std::wstring diag_command(command_context& ctx)
 {
     core::diagnostics::osd::show_graphs(true);
@@ -1398,6 +1498,118 @@ std::wstring diag_command(command_context& ctx)
     return L"202 DIAG OK\r\n";
 }
 
+// Writes the frame events of the last seconds, 10 by default, to the log folder for chrome://tracing or Perfetto.
+std::wstring diag_trace_command(command_context& ctx)
+{
+    auto seconds = 10.0;
+    if (!ctx.parameters.empty()) {
+        try {
+            seconds = boost::lexical_cast<double>(ctx.parameters.at(0));
+        } catch (const boost::bad_lexical_cast&) {
+            seconds = 0.0;
+        }
+        if (seconds <= 0.0) {
+            return L"403 DIAG TRACE FAILED\r\n";
+        }
+    }
+
+    auto filename = env::log_folder() + L"trace-" +
+                    u16(boost::posix_time::to_iso_string(boost::posix_time::second_clock::local_time())) + L".json";
+
+    boost::filesystem::ofstream file(boost::filesystem::path(filename), std::ios::binary);
+    file << caspar::diagnostics::trace::export_json(seconds);
+    if (!file)
+        CASPAR_THROW_EXCEPTION(caspar_exception() << msg_info(L"Could not write " + filename));
+
+    return L"201 DIAG TRACE OK\r\n" + filename + L"\r\n";
+}
+
+// Lists the bytes each subsystem holds and its peak since startup, one "name current peak" line per subsystem.
+std::wstring diag_memory_command(command_context& ctx)
+{
+    std::wstringstream replyString;
+    replyString << L"200 DIAG MEMORY OK\r\n";
+
+    for (auto& usage : caspar::diagnostics::memory::snapshot()) {
+        replyString << u16(usage.name) << L" " << usage.current << L" " << usage.peak << L"\r\n";
+    }
+    replyString << L"\r\n";
+    return replyString.str();
+}
+
+// Lists how long each command waited in its queue and took to execute, by client: "command client count wait-avg
+// wait-max execute-avg execute-max" with times in milliseconds.
+std::wstring diag_commands_command(command_context& ctx)
+{
+    return L"200 DIAG COMMANDS OK\r\n" + print_command_times() + L"\r\n";
+}
+
+// A <channel> element as in casparcg.config, or only its video-mode when allowed.
+pt::wptree channel_parameter(const std::wstring& param, bool allow_video_mode)
+{
+    pt::wptree channel;
+    if (param.empty() || param.at(0) != L'<') {
+        if (!allow_video_mode)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected a <channel> element."));
+
+        channel.put(L"video-mode", param);
+        return channel;
+    }
+
+    pt::wptree         xml;
+    std::wstringstream stream(param);
+    try {
+        pt::read_xml(stream, xml, pt::xml_parser::trim_whitespace | pt::xml_parser::no_comments);
+    } catch (const pt::xml_parser_error& e) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channel XML: " + u16(e.what())));
+    }
+
+    auto element = xml.get_child_optional(L"channel");
+    if (!element)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Expected a <channel> element."));
+    return *element;
+}
+
+channel_manager& get_channel_manager(const command_context& ctx)
+{
+    if (!ctx.channel_manager)
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Channels cannot be changed at runtime."));
+    return *ctx.channel_manager;
+}
+
+std::wstring channel_add_command(command_context& ctx)
+{
+    // CHANNEL ADD [video-mode|<channel>...</channel>]
+    auto channel = channel_parameter(ctx.parameters.empty() ? L"PAL" : ctx.parameters.at(0), true);
+    auto index   = get_channel_manager(ctx).add(channel);
+
+    return L"201 CHANNEL ADD OK\r\n" + std::to_wstring(index) + L"\r\n";
+}
+
+std::wstring channel_remove_command(command_context& ctx)
+{
+    // CHANNEL REMOVE [channel], the last one
+    auto index = ctx.parameters.empty() ? static_cast<int>(ctx.channels.size())
+                                        : boost::lexical_cast<int>(ctx.parameters.at(0));
+    get_channel_manager(ctx).remove(index);
+
+    return L"202 CHANNEL REMOVE OK\r\n";
+}
+
+std::wstring channel_reconfigure_command(command_context& ctx)
+{
+    // CHANNEL RECONFIGURE [channel] [<channel>...</channel>]
+    auto index   = boost::lexical_cast<int>(ctx.parameters.at(0));
+    auto channel = channel_parameter(ctx.parameters.at(1), false);
+
+    return L"201 CHANNEL RECONFIGURE OK\r\n" + get_channel_manager(ctx).reconfigure(index, channel) + L"\r\n";
+}
+
+std::wstring channel_reload_command(command_context& ctx)
+{
+    return L"201 CHANNEL RELOAD OK\r\n" + get_channel_manager(ctx).reload() + L"\r\n";
+}
+
 std::wstring bye_command(command_context& ctx)
 {
     ctx.client->disconnect();
@@ -1459,6 +1671,8 @@ std::wstring lock_command(command_context& ctx)
 void register_commands(amcp_command_repository& repo)
 {
     repo.register_channel_command(L"Basic Commands", L"LOADBG", loadbg_command, 1);
+    repo.register_command(L"Basic Commands", L"PRELOAD", preload_command, 1);
+    repo.register_command(L"Basic Commands", L"PRELOAD CLEAR", preload_clear_command, 0);
     repo.register_channel_command(L"Basic Commands", L"LOAD", load_command, 1);
     repo.register_channel_command(L"Basic Commands", L"PLAY", play_command, 0);
     repo.register_channel_command(L"Basic Commands", L"PAUSE", pause_command, 0);
@@ -1510,24 +1724,33 @@ void register_commands(amcp_command_repository& repo)
     repo.register_channel_command(L"Mixer Commands", L"MIXER CLEAR", mixer_clear_command, 0);
     repo.register_command(L"Mixer Commands", L"CHANNEL_GRID", channel_grid_command, 0);
 
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL LIST", thumbnail_list_command, 0);
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL RETRIEVE", thumbnail_retrieve_command, 1);
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE", thumbnail_generate_command, 1);
-    repo.register_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", thumbnail_generateall_command, 0);
+    repo.register_query_command(L"Thumbnail Commands", L"THUMBNAIL LIST", thumbnail_list_command, 0);
+    repo.register_query_command(L"Thumbnail Commands", L"THUMBNAIL RETRIEVE", thumbnail_retrieve_command, 1);
+    repo.register_query_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE", thumbnail_generate_command, 1);
+    repo.register_query_command(L"Thumbnail Commands", L"THUMBNAIL GENERATE_ALL", thumbnail_generateall_command, 0);
 
-    repo.register_command(L"Query Commands", L"CINF", cinf_command, 1);
-    repo.register_command(L"Query Commands", L"CLS", cls_command, 0);
-    repo.register_command(L"Query Commands", L"FLS", fls_command, 0);
-    repo.register_command(L"Query Commands", L"TLS", tls_command, 0);
-    repo.register_command(L"Query Commands", L"VERSION", version_command, 0);
+    repo.register_query_command(L"Query Commands", L"CINF", cinf_command, 1);
+    repo.register_query_command(L"Query Commands", L"CLS", cls_command, 0);
+    repo.register_query_command(L"Query Commands", L"FLS", fls_command, 0);
+    repo.register_query_command(L"Query Commands", L"TLS", tls_command, 0);
+    repo.register_immediate_command(L"Query Commands", L"VERSION", version_command, 0);
     repo.register_command(L"Query Commands", L"DIAG", diag_command, 0);
+    repo.register_command(L"Query Commands", L"DIAG TRACE", diag_trace_command, 0);
+    repo.register_command(L"Query Commands", L"DIAG MEMORY", diag_memory_command, 0);
+    repo.register_command(L"Query Commands", L"DIAG COMMANDS", diag_commands_command, 0);
     repo.register_command(L"Query Commands", L"BYE", bye_command, 0);
     repo.register_command(L"Query Commands", L"KILL", kill_command, 0);
     repo.register_command(L"Query Commands", L"RESTART", restart_command, 0);
-    repo.register_channel_command(L"Query Commands", L"INFO", info_channel_command, 0);
-    repo.register_command(L"Query Commands", L"INFO", info_command, 0);
-    repo.register_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
-    repo.register_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo.register_immediate_channel_command(L"Query Commands", L"INFO", info_channel_command, 0);
+    repo.register_immediate_command(L"Query Commands", L"INFO", info_command, 0);
+    repo.register_immediate_command(L"Query Commands", L"INFO CONFIG", info_config_command, 0);
+    repo.register_immediate_command(L"Query Commands", L"INFO PATHS", info_paths_command, 0);
+    repo.register_immediate_command(L"Query Commands", L"INFO PRELOAD", info_preload_command, 0);
+
+    repo.register_command(L"Channel Commands", L"CHANNEL ADD", channel_add_command, 0);
+    repo.register_command(L"Channel Commands", L"CHANNEL REMOVE", channel_remove_command, 0);
+    repo.register_command(L"Channel Commands", L"CHANNEL RECONFIGURE", channel_reconfigure_command, 2);
+    repo.register_command(L"Channel Commands", L"CHANNEL RELOAD", channel_reload_command, 0);
 }
 
 }}} // namespace caspar::protocol::amcp
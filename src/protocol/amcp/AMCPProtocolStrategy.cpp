@@ -27,11 +27,23 @@
 #include "amcp_command_repository.h"
 #include "amcp_shared.h"
 
+#include <common/env.h>
+#include <common/utf.h>
+
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cwctype>
+#include <iterator>
+#include <mutex>
 
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
 
 #if defined(_MSC_VER)
 #pragma warning(push, 1) // TODO: Legacy code, just disable warnings
@@ -53,15 +65,86 @@ bool try_lexical_cast(const In& input, Out& result)
     return success;
 }
 
+// Commands received between BEGIN and COMMIT, bound to the client connection.
+struct command_batch
+{
+    std::vector<AMCPCommand::ptr_type> commands;
+    bool                               failed = false;
+};
+
+const std::wstring command_batch_key = L"amcp_batch";
+
+// Appends every message received from any client to the file set as amcp.record, for casparcg-replay. Each line holds
+// the milliseconds since recording started, a number for the connection, the client address and the message, separated
+// by tabs. Relative paths are in the log folder.
+class command_recorder
+{
+    std::mutex                            mutex_;
+    boost::filesystem::ofstream           file_;
+    std::chrono::steady_clock::time_point start_       = std::chrono::steady_clock::now();
+    int                                   connections_ = 0;
+
+    explicit command_recorder(const boost::filesystem::path& path)
+        : file_(path, std::ios::binary | std::ios::app)
+    {
+        if (!file_) {
+            CASPAR_LOG(error) << L"[amcp] Could not open " << path.wstring() << L" to record commands.";
+        } else {
+            CASPAR_LOG(info) << L"[amcp] Recording commands to " << path.wstring() << L".";
+        }
+    }
+
+  public:
+    // Null unless amcp.record is set.
+    static command_recorder* get()
+    {
+        static const std::unique_ptr<command_recorder> instance = []() -> std::unique_ptr<command_recorder> {
+            auto path = boost::filesystem::path(env::properties().get(L"configuration.amcp.record", L""));
+            if (path.empty()) {
+                return nullptr;
+            }
+            if (path.is_relative()) {
+                path = boost::filesystem::path(env::log_folder()) / path;
+            }
+            return std::unique_ptr<command_recorder>(new command_recorder(path));
+        }();
+        return instance.get();
+    }
+
+    void record(const std::wstring& message, const ClientInfoPtr& client)
+    {
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // The connection keeps its number for as long as it is open.
+        const std::wstring connection_key = L"amcp_record";
+        auto connection = std::static_pointer_cast<int>(client->remove_lifecycle_bound_object(connection_key));
+        if (!connection) {
+            connection = std::make_shared<int>(++connections_);
+        }
+        client->add_lifecycle_bound_object(connection_key, connection);
+
+        file_ << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << '\t' << *connection << '\t'
+              << u8(client->address()) << '\t' << u8(message) << '\n';
+        file_.flush();
+    }
+};
+
 struct AMCPProtocolStrategy::impl
 {
   private:
+    const std::wstring                       name_;
+    std::mutex                               queues_mutex_;
     std::vector<AMCPCommandQueue::ptr_type>  commandQueues_;
+    AMCPCommandQueue::ptr_type               queryQueue_;
     spl::shared_ptr<amcp_command_repository> repo_;
 
   public:
     impl(const std::wstring& name, const spl::shared_ptr<amcp_command_repository>& repo)
-        : repo_(repo)
+        : name_(name)
+        , queryQueue_(spl::make_shared<AMCPCommandQueue>(L"Query Queue for " + name))
+        , repo_(repo)
     {
         commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(L"General Queue for " + name));
 
@@ -73,6 +156,17 @@ struct AMCPProtocolStrategy::impl
 
     ~impl() {}
 
+    // Channels added while the server runs get their queue with their first command.
+    AMCPCommandQueue::ptr_type channel_queue(int channel_index)
+    {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        while (commandQueues_.size() < static_cast<std::size_t>(channel_index) + 2) {
+            commandQueues_.push_back(spl::make_shared<AMCPCommandQueue>(
+                L"Channel " + std::to_wstring(commandQueues_.size()) + L" for " + name_));
+        }
+        return commandQueues_.at(channel_index + 1);
+    }
+
     enum class error_state
     {
         no_error = 0,
@@ -88,6 +182,7 @@ struct AMCPProtocolStrategy::impl
         std::shared_ptr<caspar::IO::lock_container> lock;
         std::wstring                                request_id;
         std::wstring                                command_name;
+        int                                         channel_index = -1;
         AMCPCommand::ptr_type                       command;
         error_state                                 error = error_state::no_error;
         std::shared_ptr<AMCPCommandQueue>           queue;
@@ -97,6 +192,10 @@ struct AMCPProtocolStrategy::impl
     // Thesefore the AMCPProtocolStrategy should be decorated with a delimiter_based_chunking_strategy
     void Parse(const std::wstring& message, ClientInfoPtr client)
     {
+        if (auto recorder = command_recorder::get()) {
+            recorder->record(message, client);
+        }
+
         std::list<std::wstring> tokens;
         tokenize(message, tokens);
 
@@ -115,14 +214,34 @@ struct AMCPProtocolStrategy::impl
 
         CASPAR_LOG(info) << L"Received message from " << client->address() << ": " << message << L"\\r\\n";
 
+        if (tokens.size() > 1 && boost::iequals(tokens.front(), L"SCHEDULE")) {
+            parse_schedule_command(std::move(tokens), client);
+            return;
+        }
+
+        auto batch = std::static_pointer_cast<command_batch>(client->remove_lifecycle_bound_object(command_batch_key));
+
+        if (tokens.size() == 1 && parse_batch_command(tokens.front(), batch, client))
+            return;
+
         command_interpreter_result result;
         if (interpret_command_string(tokens, result, client)) {
             if (result.lock && !result.lock->check_access(client))
                 result.error = error_state::access_error;
+            else if (batch)
+                batch->commands.push_back(result.command);
+            else if (repo_->is_immediate_command(result.command->print(), result.channel_index != -1))
+                execute_command(result.command);
             else
                 result.queue->AddCommand(result.command);
         }
 
+        if (batch) {
+            // A batch with an invalid command is not committed, so that it is applied either completely or not at all.
+            batch->failed |= result.error != error_state::no_error;
+            client->add_lifecycle_bound_object(command_batch_key, batch);
+        }
+
         if (result.error != error_state::no_error) {
             std::wstringstream answer;
 
@@ -155,6 +274,119 @@ struct AMCPProtocolStrategy::impl
     }
 
   private:
+    // BEGIN starts collecting commands, which COMMIT then executes together so that their changes to the channels
+    // take effect on the same frame, and DISCARD drops.
+    bool parse_batch_command(const std::wstring& name, std::shared_ptr<command_batch> batch, ClientInfoPtr client)
+    {
+        if (boost::iequals(name, L"BEGIN")) {
+            if (batch) {
+                client->add_lifecycle_bound_object(command_batch_key, batch);
+                client->send(L"403 BEGIN FAILED\r\n");
+            } else {
+                client->add_lifecycle_bound_object(command_batch_key, std::make_shared<command_batch>());
+                client->send(L"202 BEGIN OK\r\n");
+            }
+            return true;
+        }
+
+        if (boost::iequals(name, L"COMMIT")) {
+            if (!batch || batch->failed)
+                client->send(L"403 COMMIT FAILED\r\n");
+            else
+                commandQueues_.at(0)->AddCommands(std::move(batch->commands),
+                                                  [](core::stage_batch& stage_batch) { stage_batch.commit(); },
+                                                  client,
+                                                  L"202 COMMIT OK\r\n");
+            return true;
+        }
+
+        if (boost::iequals(name, L"DISCARD")) {
+            client->send(batch ? L"202 DISCARD OK\r\n" : L"403 DISCARD FAILED\r\n");
+            return true;
+        }
+
+        return false;
+    }
+
+    // SCHEDULE SET <frame|+frames|hh:mm:ss:ff> <command> executes a channel command at once but holds back its changes
+    // to the channel until the start of the given frame, counted from when the channel started or, with +, from its
+    // current frame. SCHEDULE CLEAR <channel> drops the changes scheduled on a channel.
+    void parse_schedule_command(std::list<std::wstring> tokens, ClientInfoPtr client)
+    {
+        tokens.pop_front();
+        auto subcommand = boost::to_upper_copy(tokens.front());
+        tokens.pop_front();
+
+        if (subcommand == L"CLEAR" && tokens.size() == 1) {
+            int channel_index = -1;
+            if (!try_lexical_cast(tokens.front(), channel_index) || channel_index < 1 ||
+                channel_index > static_cast<int>(repo_->channels().size())) {
+                client->send(L"401 SCHEDULE CLEAR ERROR\r\n");
+                return;
+            }
+            repo_->channels().at(channel_index - 1).channel->stage().clear_schedule();
+            client->send(L"202 SCHEDULE CLEAR OK\r\n");
+            return;
+        }
+
+        if (subcommand != L"SET" || tokens.size() < 2) {
+            client->send(L"402 SCHEDULE ERROR\r\n");
+            return;
+        }
+
+        auto when = tokens.front();
+        tokens.pop_front();
+
+        command_interpreter_result result;
+        if (!interpret_command_string(tokens, result, client) || result.channel_index == -1) {
+            client->send(L"403 SCHEDULE SET FAILED\r\n");
+            return;
+        }
+
+        if (result.lock && !result.lock->check_access(client)) {
+            client->send(L"503 SCHEDULE SET FAILED\r\n");
+            return;
+        }
+
+        std::int64_t frame       = 0;
+        bool         relative    = false;
+        auto         format_desc = repo_->channels().at(result.channel_index).channel->video_format_desc();
+        if (!parse_frame(when, format_desc, frame, relative)) {
+            client->send(L"403 SCHEDULE SET FAILED\r\n");
+            return;
+        }
+
+        result.queue->AddCommands({result.command},
+                                  [=](core::stage_batch& stage_batch) { stage_batch.schedule(frame, relative); },
+                                  client,
+                                  L"202 SCHEDULE SET OK\r\n");
+    }
+
+    static bool parse_frame(const std::wstring&            str,
+                            const core::video_format_desc& format_desc,
+                            std::int64_t&                  frame,
+                            bool&                          relative)
+    {
+        relative = !str.empty() && str.front() == L'+';
+
+        std::vector<std::wstring> parts;
+        boost::split(parts, relative ? str.substr(1) : str, boost::is_any_of(L":;"));
+
+        if (parts.size() == 1)
+            return try_lexical_cast(parts[0], frame) && frame >= 0;
+
+        int hours = 0, minutes = 0, seconds = 0, frames = 0;
+        if (parts.size() != 4 || !try_lexical_cast(parts[0], hours) || !try_lexical_cast(parts[1], minutes) ||
+            !try_lexical_cast(parts[2], seconds) || !try_lexical_cast(parts[3], frames))
+            return false;
+
+        // Timecode counts frames, interlaced channels tick once per field.
+        auto ticks_per_second =
+            static_cast<std::int64_t>(std::lround(boost::rational_cast<double>(format_desc.framerate)));
+        frame = ((hours * 60LL + minutes) * 60LL + seconds) * ticks_per_second + frames * format_desc.field_count;
+        return frame >= 0;
+    }
+
     bool
     interpret_command_string(std::list<std::wstring> tokens, command_interpreter_result& result, ClientInfoPtr client)
     {
@@ -190,22 +422,12 @@ struct AMCPProtocolStrategy::impl
             int          layer_index   = -1;
             std::wstring channel_spec;
 
-            if (!tokens.empty()) {
-                channel_spec                            = tokens.front();
-                std::wstring              channelid_str = boost::trim_copy(channel_spec);
-                std::vector<std::wstring> split;
-                boost::split(split, channelid_str, boost::is_any_of("-"));
-
-                // Use non_throwing lexical cast to not hit exception break point all the time.
-                if (try_lexical_cast(split[0], channel_index)) {
-                    --channel_index;
-
-                    if (split.size() > 1)
-                        try_lexical_cast(split[1], layer_index);
+            if (!tokens.empty() && parse_channel_spec(tokens.front(), channel_index, layer_index)) {
+                --channel_index;
 
-                    // Consume channel-spec
-                    tokens.pop_front();
-                }
+                // Consume channel-spec, kept in case it turns out not to be one.
+                channel_spec = std::move(tokens.front());
+                tokens.pop_front();
             }
 
             bool is_channel_command = channel_index != -1;
@@ -216,12 +438,13 @@ struct AMCPProtocolStrategy::impl
                     repo_->create_channel_command(result.command_name, client, channel_index, layer_index, tokens);
 
                 if (result.command) {
-                    result.lock  = repo_->channels().at(channel_index).lock;
-                    result.queue = commandQueues_.at(channel_index + 1);
+                    result.channel_index = channel_index;
+                    result.lock          = repo_->channels().at(channel_index).lock;
+                    result.queue         = channel_queue(channel_index);
                 } else // Might be a non channel command, although the first argument is numeric
                 {
                     // Restore backed up channel spec string.
-                    tokens.push_front(channel_spec);
+                    tokens.push_front(std::move(channel_spec));
                     result.command = repo_->create_command(result.command_name, client, tokens);
 
                     if (result.command)
@@ -237,7 +460,8 @@ struct AMCPProtocolStrategy::impl
             if (!result.command)
                 result.error = error_state::command_error;
             else {
-                std::vector<std::wstring> parameters(tokens.begin(), tokens.end());
+                std::vector<std::wstring> parameters(std::make_move_iterator(tokens.begin()),
+                                                     std::make_move_iterator(tokens.end()));
 
                 result.command->parameters() = std::move(parameters);
 
@@ -245,6 +469,9 @@ struct AMCPProtocolStrategy::impl
                     result.error = error_state::parameters_error;
             }
 
+            if (result.command && repo_->is_query_command(result.command->print()))
+                result.queue = queryQueue_;
+
             if (result.command)
                 result.command->set_request_id(result.request_id);
         } catch (std::out_of_range&) {
@@ -258,6 +485,34 @@ struct AMCPProtocolStrategy::impl
         return result.error == error_state::no_error;
     }
 
+    // Parses "channel" or "channel-layer" in place. Uses non throwing conversion to not hit exception break point
+    // all the time.
+    static bool parse_channel_spec(const std::wstring& spec, int& channel_index, int& layer_index)
+    {
+        auto begin = std::find_if_not(spec.begin(), spec.end(), [](wchar_t c) { return std::iswspace(c); });
+        auto end   = std::find_if_not(spec.rbegin(), spec.rend(), [](wchar_t c) { return std::iswspace(c); }).base();
+        if (begin >= end)
+            return false;
+
+        auto chars = [&](std::wstring::const_iterator it) { return spec.data() + (it - spec.begin()); };
+
+        auto dash    = std::find(begin, end, L'-');
+        int  channel = 0;
+        if (!boost::conversion::try_lexical_convert(chars(begin), dash - begin, channel))
+            return false;
+        channel_index = channel;
+
+        if (dash != end) {
+            auto layer_begin = dash + 1;
+            auto layer_end   = std::find(layer_begin, end, L'-');
+            int  layer       = 0;
+            if (boost::conversion::try_lexical_convert(chars(layer_begin), layer_end - layer_begin, layer))
+                layer_index = layer;
+        }
+
+        return true;
+    }
+
     template <typename C>
     std::size_t tokenize(const std::wstring& message, C& pTokenVector)
     {
@@ -267,57 +522,59 @@ struct AMCPProtocolStrategy::impl
 
         std::wstring currentToken;
 
-        bool inQuote        = false;
-        bool getSpecialCode = false;
-
-        for (unsigned int charIndex = 0; charIndex < message.size(); ++charIndex) {
-            if (getSpecialCode) {
-                // insert code-handling here
-                switch (message[charIndex]) {
-                    case L'\\':
-                        currentToken += L"\\";
-                        break;
-                    case L'\"':
-                        currentToken += L"\"";
-                        break;
-                    case L'n':
-                        currentToken += L"\n";
-                        break;
-                    default:
-                        break;
-                }
-                getSpecialCode = false;
-                continue;
-            }
-
-            if (message[charIndex] == L'\\') {
-                getSpecialCode = true;
-                continue;
-            }
-
-            if (message[charIndex] == L' ' && inQuote == false) {
-                if (!currentToken.empty()) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
-                }
-                continue;
-            }
-
-            if (message[charIndex] == L'\"') {
-                inQuote = !inQuote;
+        bool inQuote = false;
+
+        auto it  = message.begin();
+        auto end = message.end();
+
+        while (it != end) {
+            // Plain characters are appended a run at a time.
+            auto run = std::find_if(
+                it, end, [&](wchar_t c) { return c == L'\\' || c == L'\"' || (c == L' ' && !inQuote); });
+            currentToken.append(it, run);
+            it = run;
+
+            if (it == end)
+                break;
+
+            switch (*it++) {
+                case L'\\':
+                    // insert code-handling here
+                    if (it != end) {
+                        switch (*it++) {
+                            case L'\\':
+                                currentToken += L'\\';
+                                break;
+                            case L'\"':
+                                currentToken += L'\"';
+                                break;
+                            case L'n':
+                                currentToken += L'\n';
+                                break;
+                            default:
+                                break;
+                        }
+                    }
+                    break;
+                case L'\"':
+                    inQuote = !inQuote;
 
-                if (!currentToken.empty() || !inQuote) {
-                    pTokenVector.push_back(currentToken);
-                    currentToken.clear();
-                }
-                continue;
+                    if (!currentToken.empty() || !inQuote) {
+                        pTokenVector.push_back(std::move(currentToken));
+                        currentToken.clear();
+                    }
+                    break;
+                default: // space
+                    if (!currentToken.empty()) {
+                        pTokenVector.push_back(std::move(currentToken));
+                        currentToken.clear();
+                    }
+                    break;
             }
-
-            currentToken += message[charIndex];
         }
 
         if (!currentToken.empty()) {
-            pTokenVector.push_back(currentToken);
+            pTokenVector.push_back(std::move(currentToken));
             currentToken.clear();
         }
 
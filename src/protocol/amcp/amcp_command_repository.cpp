@@ -25,72 +25,157 @@
 
 #include <common/env.h>
 
+#include <boost/optional.hpp>
 #include <boost/property_tree/ptree.hpp>
 
-#include <map>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace caspar { namespace protocol { namespace amcp {
 
-AMCPCommand::ptr_type find_command(const std::map<std::wstring, std::pair<amcp_command_func, int>>& commands,
-                                   const std::wstring&                                              str,
-                                   const command_context&                                           ctx,
-                                   std::list<std::wstring>&                                         tokens)
+namespace {
+
+wchar_t to_upper(wchar_t c) { return c >= L'a' && c <= L'z' ? static_cast<wchar_t>(c - L'a' + L'A') : c; }
+
+// Command names are ASCII and matched regardless of case, so that tokens can be looked up without an upper case copy.
+struct command_name_hash
+{
+    std::size_t operator()(const std::wstring& name) const
+    {
+        std::size_t hash = 2166136261u;
+        for (auto c : name)
+            hash = (hash ^ static_cast<std::size_t>(to_upper(c))) * 16777619u;
+        return hash;
+    }
+};
+
+struct command_name_equal
+{
+    bool operator()(const std::wstring& lhs, const std::wstring& rhs) const
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](wchar_t l, wchar_t r) {
+                   return to_upper(l) == to_upper(r);
+               });
+    }
+};
+
+struct command_entry
+{
+    std::wstring      name;
+    amcp_command_func func;
+    int               min_num_params;
+};
+
+// Commands by their first word, with those taking a subcommand, e.g. MIXER FILL, grouped under it.
+struct command_group
 {
-    std::wstring subcommand;
+    boost::optional<command_entry>                                                          command;
+    std::unordered_map<std::wstring, command_entry, command_name_hash, command_name_equal> subcommands;
+};
 
-    if (!tokens.empty())
-        subcommand = boost::to_upper_copy(tokens.front());
+using command_table = std::unordered_map<std::wstring, command_group, command_name_hash, command_name_equal>;
+
+void add_command(command_table& commands, std::wstring name, amcp_command_func func, int min_num_params)
+{
+    auto  space = name.find(L' ');
+    auto& group = commands[name.substr(0, space)];
+
+    if (space == std::wstring::npos)
+        group.command = command_entry{std::move(name), std::move(func), min_num_params};
+    else
+        group.subcommands.emplace(name.substr(space + 1),
+                                  command_entry{std::move(name), std::move(func), min_num_params});
+}
+
+AMCPCommand::ptr_type find_command(const command_table&     commands,
+                                   const std::wstring&      str,
+                                   const command_context&   ctx,
+                                   std::list<std::wstring>& tokens)
+{
+    auto group = commands.find(str);
+
+    if (group == commands.end())
+        return nullptr;
 
     // Start with subcommand syntax like MIXER CLEAR etc
-    if (!subcommand.empty()) {
-        auto s      = str + L" " + subcommand;
-        auto subcmd = commands.find(s);
+    if (!tokens.empty()) {
+        auto subcmd = group->second.subcommands.find(tokens.front());
 
-        if (subcmd != commands.end()) {
+        if (subcmd != group->second.subcommands.end()) {
             tokens.pop_front();
-            return std::make_shared<AMCPCommand>(ctx, subcmd->second.first, subcmd->second.second, s);
+            auto& entry = subcmd->second;
+            return std::make_shared<AMCPCommand>(ctx, entry.func, entry.min_num_params, entry.name);
         }
     }
 
     // Resort to ordinary command
-    auto s       = str;
-    auto command = commands.find(s);
+    auto& command = group->second.command;
 
-    if (command != commands.end())
-        return std::make_shared<AMCPCommand>(ctx, command->second.first, command->second.second, s);
+    if (command)
+        return std::make_shared<AMCPCommand>(ctx, command->func, command->min_num_params, command->name);
 
     return nullptr;
 }
 
+} // namespace
+
 struct amcp_command_repository::impl
 {
+    mutable std::mutex                                   channels_mutex;
     std::vector<channel_context>                         channels;
     spl::shared_ptr<core::cg_producer_registry>          cg_registry;
     spl::shared_ptr<const core::frame_producer_registry> producer_registry;
     spl::shared_ptr<const core::frame_consumer_registry> consumer_registry;
+    spl::shared_ptr<const core::media_scanner_registry>  scanner_registry;
     std::function<void(bool)>                            shutdown_server_now;
+    std::shared_ptr<amcp::channel_manager>               channel_manager;
     std::string proxy_host = u8(caspar::env::properties().get(L"configuration.amcp.media-server.host", L"127.0.0.1"));
     std::string proxy_port = u8(caspar::env::properties().get(L"configuration.amcp.media-server.port", L"8000"));
 
-    std::map<std::wstring, std::pair<amcp_command_func, int>> commands;
-    std::map<std::wstring, std::pair<amcp_command_func, int>> channel_commands;
+    command_table                                                           commands;
+    command_table                                                           channel_commands;
+    std::unordered_set<std::wstring, command_name_hash, command_name_equal> query_commands;
+    std::unordered_set<std::wstring, command_name_hash, command_name_equal> immediate_commands;
+    std::unordered_set<std::wstring, command_name_hash, command_name_equal> immediate_channel_commands;
 
     impl(const std::vector<spl::shared_ptr<core::video_channel>>&    channels,
          const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
          const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
          const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
-         std::function<void(bool)>                                   shutdown_server_now)
+         const spl::shared_ptr<const core::media_scanner_registry>&  scanner_registry,
+         std::function<void(bool)>                                   shutdown_server_now,
+         std::shared_ptr<amcp::channel_manager>                      channel_manager)
         : cg_registry(cg_registry)
         , producer_registry(producer_registry)
         , consumer_registry(consumer_registry)
+        , scanner_registry(scanner_registry)
         , shutdown_server_now(shutdown_server_now)
+        , channel_manager(std::move(channel_manager))
     {
-        int index = 0;
-        for (const auto& channel : channels) {
-            std::wstring lifecycle_key = L"lock" + std::to_wstring(index);
-            this->channels.push_back(channel_context(channel, lifecycle_key));
-            ++index;
+        set_channels(channels);
+    }
+
+    void set_channels(const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex);
+
+        std::vector<channel_context> contexts;
+        for (std::size_t index = 0; index < channels.size(); ++index) {
+            if (index < this->channels.size() && this->channels[index].channel == channels[index]) {
+                contexts.push_back(this->channels[index]);
+            } else {
+                contexts.push_back(channel_context(channels[index], L"lock" + std::to_wstring(index)));
+            }
         }
+        this->channels = std::move(contexts);
+    }
+
+    std::vector<channel_context> get_channels() const
+    {
+        std::lock_guard<std::mutex> lock(channels_mutex);
+        return channels;
     }
 };
 
@@ -99,8 +184,16 @@ amcp_command_repository::amcp_command_repository(
     const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
     const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
     const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
-    std::function<void(bool)>                                   shutdown_server_now)
-    : impl_(new impl(channels, cg_registry, producer_registry, consumer_registry, shutdown_server_now))
+    const spl::shared_ptr<const core::media_scanner_registry>&  scanner_registry,
+    std::function<void(bool)>                                   shutdown_server_now,
+    std::shared_ptr<channel_manager>                            channel_manager)
+    : impl_(new impl(channels,
+                     cg_registry,
+                     producer_registry,
+                     consumer_registry,
+                     scanner_registry,
+                     shutdown_server_now,
+                     std::move(channel_manager)))
 {
 }
 
@@ -114,11 +207,13 @@ AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring
                         channel_context(),
                         -1,
                         -1,
-                        self.channels,
+                        self.get_channels(),
                         self.cg_registry,
                         self.producer_registry,
                         self.consumer_registry,
+                        self.scanner_registry,
                         self.shutdown_server_now,
+                        self.channel_manager,
                         self.proxy_host,
                         self.proxy_port);
 
@@ -130,7 +225,12 @@ AMCPCommand::ptr_type amcp_command_repository::create_command(const std::wstring
     return nullptr;
 }
 
-const std::vector<channel_context>& amcp_command_repository::channels() const { return impl_->channels; }
+std::vector<channel_context> amcp_command_repository::channels() const { return impl_->get_channels(); }
+
+void amcp_command_repository::set_channels(const std::vector<spl::shared_ptr<core::video_channel>>& channels)
+{
+    impl_->set_channels(channels);
+}
 
 AMCPCommand::ptr_type amcp_command_repository::create_channel_command(const std::wstring&      s,
                                                                       IO::ClientInfoPtr        client,
@@ -140,17 +240,20 @@ AMCPCommand::ptr_type amcp_command_repository::create_channel_command(const std:
 {
     auto& self = *impl_;
 
-    auto channel = self.channels.at(channel_index);
+    auto channels = self.get_channels();
+    auto channel  = channels.at(channel_index);
 
     command_context ctx(std::move(client),
                         channel,
                         channel_index,
                         layer_index,
-                        self.channels,
+                        std::move(channels),
                         self.cg_registry,
                         self.producer_registry,
                         self.consumer_registry,
+                        self.scanner_registry,
                         self.shutdown_server_now,
+                        self.channel_manager,
                         self.proxy_host,
                         self.proxy_port);
 
@@ -168,7 +271,7 @@ void amcp_command_repository::register_command(std::wstring      category,
                                                int               min_num_params)
 {
     auto& self = *impl_;
-    self.commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    add_command(self.commands, std::move(name), std::move(command), min_num_params);
 }
 
 void amcp_command_repository::register_channel_command(std::wstring      category,
@@ -177,7 +280,48 @@ void amcp_command_repository::register_channel_command(std::wstring      categor
                                                        int               min_num_params)
 {
     auto& self = *impl_;
-    self.channel_commands.insert(std::make_pair(std::move(name), std::make_pair(std::move(command), min_num_params)));
+    add_command(self.channel_commands, std::move(name), std::move(command), min_num_params);
+}
+
+void amcp_command_repository::register_query_command(std::wstring      category,
+                                                     std::wstring      name,
+                                                     amcp_command_func command,
+                                                     int               min_num_params)
+{
+    auto& self = *impl_;
+    self.query_commands.insert(name);
+    add_command(self.commands, std::move(name), std::move(command), min_num_params);
+}
+
+bool amcp_command_repository::is_query_command(const std::wstring& name) const
+{
+    return impl_->query_commands.count(name) > 0;
+}
+
+void amcp_command_repository::register_immediate_command(std::wstring      category,
+                                                         std::wstring      name,
+                                                         amcp_command_func command,
+                                                         int               min_num_params)
+{
+    auto& self = *impl_;
+    self.immediate_commands.insert(name);
+    add_command(self.commands, std::move(name), std::move(command), min_num_params);
+}
+
+void amcp_command_repository::register_immediate_channel_command(std::wstring      category,
+                                                                 std::wstring      name,
+                                                                 amcp_command_func command,
+                                                                 int               min_num_params)
+{
+    auto& self = *impl_;
+    self.immediate_channel_commands.insert(name);
+    add_command(self.channel_commands, std::move(name), std::move(command), min_num_params);
+}
+
+bool amcp_command_repository::is_immediate_command(const std::wstring& name, bool channel_command) const
+{
+    auto& commands = channel_command ? impl_->immediate_channel_commands : impl_->immediate_commands;
+    return commands.count(name) > 0;
 }
 
 }}} // namespace caspar::protocol::amcp
@@ -39,7 +39,9 @@ class amcp_command_repository
                             const spl::shared_ptr<core::cg_producer_registry>&          cg_registry,
                             const spl::shared_ptr<const core::frame_producer_registry>& producer_registry,
                             const spl::shared_ptr<const core::frame_consumer_registry>& consumer_registry,
-                            std::function<void(bool)>                                   shutdown_server_now);
+                            const spl::shared_ptr<const core::media_scanner_registry>&  scanner_registry,
+                            std::function<void(bool)>                                   shutdown_server_now,
+                            std::shared_ptr<channel_manager>                            channel_manager);
 
     AMCPCommand::ptr_type
                           create_command(const std::wstring& s, IO::ClientInfoPtr client, std::list<std::wstring>& tokens) const;
@@ -49,12 +51,31 @@ class amcp_command_repository
                                                  int                      layer_index,
                                                  std::list<std::wstring>& tokens) const;
 
-    const std::vector<channel_context>& channels() const;
+    // The channels as they are now, they change when channels are added, removed or recreated at runtime.
+    std::vector<channel_context> channels() const;
+
+    // Channels that are still there keep their context, and with it their locks.
+    void set_channels(const std::vector<spl::shared_ptr<core::video_channel>>& channels);
 
     void register_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
     void
     register_channel_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
 
+    // Query commands wait on the media-scanner, they run on a queue of their own so other commands are not held up.
+    void
+    register_query_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
+    bool is_query_command(const std::wstring& name) const;
+
+    // Immediate commands only read state that is safe to access from any thread, e.g. the channel state snapshot.
+    // They are executed as soon as they are received instead of waiting in a command queue.
+    void
+    register_immediate_command(std::wstring category, std::wstring name, amcp_command_func command, int min_num_params);
+    void register_immediate_channel_command(std::wstring      category,
+                                            std::wstring      name,
+                                            amcp_command_func command,
+                                            int               min_num_params);
+    bool is_immediate_command(const std::wstring& name, bool channel_command) const;
+
   private:
     struct impl;
     spl::shared_ptr<impl> impl_;
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "amcp_command_stats.h"
+
+#include <common/utf.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+const std::array<double, 12> buckets = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0};
+
+struct histogram
+{
+    std::array<std::uint64_t, buckets.size()> counts{};
+    std::uint64_t                             count = 0;
+    double                                    sum   = 0.0;
+    double                                    max   = 0.0;
+
+    void observe(double value)
+    {
+        for (std::size_t n = 0; n < buckets.size(); ++n) {
+            if (value <= buckets[n]) {
+                ++counts[n];
+            }
+        }
+        ++count;
+        sum += value;
+        max = std::max(max, value);
+    }
+};
+
+struct command_times
+{
+    histogram wait;
+    histogram execute;
+};
+
+std::mutex                                                     mutex;
+std::map<std::pair<std::wstring, std::wstring>, command_times> times;
+
+std::string escape(const std::string& value)
+{
+    std::string result;
+    for (auto c : value) {
+        if (c == '\\' || c == '"') {
+            result += '\\';
+        }
+        if (c != '\n') {
+            result += c;
+        }
+    }
+    return result;
+}
+
+void write(std::ostringstream& out, const char* metric, const std::string& labels, const histogram& h)
+{
+    for (std::size_t n = 0; n < buckets.size(); ++n) {
+        out << metric << "_bucket{" << labels << ",le=\"" << buckets[n] << "\"} " << h.counts[n] << "\n";
+    }
+    out << metric << "_bucket{" << labels << ",le=\"+Inf\"} " << h.count << "\n";
+    out << metric << "_sum{" << labels << "} " << h.sum << "\n";
+    out << metric << "_count{" << labels << "} " << h.count << "\n";
+}
+
+} // namespace
+
+void record_command_times(const std::wstring& command,
+                          const std::wstring& client,
+                          double              wait_time,
+                          double              execute_time)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto& entry = times[std::make_pair(command, client)];
+    entry.wait.observe(wait_time);
+    entry.execute.observe(execute_time);
+}
+
+std::wstring print_command_times()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::wostringstream out;
+    out << std::fixed << std::setprecision(1);
+    for (auto& p : times) {
+        auto& t = p.second;
+        out << p.first.first << L" " << p.first.second << L" " << t.execute.count << L" "
+            << t.wait.sum / t.wait.count * 1000.0 << L" " << t.wait.max * 1000.0 << L" "
+            << t.execute.sum / t.execute.count * 1000.0 << L" " << t.execute.max * 1000.0 << L"\r\n";
+    }
+    return out.str();
+}
+
+std::string export_command_times()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::ostringstream out;
+
+    out << "# HELP caspar_amcp_queue_wait_seconds Time AMCP commands waited in their queue.\n";
+    out << "# TYPE caspar_amcp_queue_wait_seconds histogram\n";
+    for (auto& p : times) {
+        auto labels = "command=\"" + escape(u8(p.first.first)) + "\",client=\"" + escape(u8(p.first.second)) + "\"";
+        write(out, "caspar_amcp_queue_wait_seconds", labels, p.second.wait);
+    }
+
+    out << "# HELP caspar_amcp_execute_seconds Time AMCP commands took to execute.\n";
+    out << "# TYPE caspar_amcp_execute_seconds histogram\n";
+    for (auto& p : times) {
+        auto labels = "command=\"" + escape(u8(p.first.first)) + "\",client=\"" + escape(u8(p.first.second)) + "\"";
+        write(out, "caspar_amcp_execute_seconds", labels, p.second.execute);
+    }
+
+    return out.str();
+}
+
+}}} // namespace caspar::protocol::amcp
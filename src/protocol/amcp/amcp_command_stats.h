@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// Histograms of how long AMCP commands wait in their queue and take to execute, by command and client address.
+
+void record_command_times(const std::wstring& command,
+                          const std::wstring& client,
+                          double              wait_time,
+                          double              execute_time);
+
+// One line per command and client: command, client, count, then average and maximum wait and execute time in
+// milliseconds.
+std::wstring print_command_times();
+
+// The histograms in the Prometheus text format, as caspar_amcp_queue_wait_seconds and caspar_amcp_execute_seconds.
+std::string export_command_times();
+
+}}} // namespace caspar::protocol::amcp
@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "amcp_data_cache.h"
+
+#include <common/log.h>
+#include <common/os/filesystem.h>
+#include <common/os/thread.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+namespace {
+
+const std::chrono::seconds check_interval(2);
+
+std::wstring key_of(const std::wstring& name)
+{
+    auto key = boost::to_lower_copy(name);
+    boost::replace_all(key, L"\\", L"/");
+    return key;
+}
+
+std::time_t write_time(const boost::filesystem::path& path)
+{
+    boost::system::error_code ec;
+    auto                      time = boost::filesystem::last_write_time(path, ec);
+    return ec ? -1 : time;
+}
+
+// The name is as last stored, for naming a new file. The path is empty until the file has been found or written, the
+// time is that of the file when it was last read or written.
+struct dataset
+{
+    std::wstring            name;
+    std::wstring            data;
+    boost::filesystem::path path;
+    std::time_t             time    = -1;
+    bool                    pending = false;
+};
+
+} // namespace
+
+struct data_cache::impl
+{
+    const std::wstring              folder_;
+    const reader                    read_;
+    std::mutex                      mutex_;
+    std::condition_variable         cond_;
+    std::map<std::wstring, dataset> datasets_;
+    std::deque<std::wstring>        writes_; // Keys of datasets to write, each at most once.
+    bool                            writing_ = false;
+    bool                            stop_    = false;
+    std::thread                     thread_;
+
+    impl(std::wstring folder, reader read)
+        : folder_(std::move(folder))
+        , read_(std::move(read))
+    {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    ~impl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        thread_.join();
+    }
+
+    std::wstring retrieve(const std::wstring& name)
+    {
+        auto key = key_of(name);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = datasets_.find(key);
+            if (it != datasets_.end()) {
+                return it->second.data;
+            }
+        }
+
+        auto path = find_case_insensitive(folder_ + name + L".ftd");
+        if (!path) {
+            return L"";
+        }
+
+        dataset loaded;
+        loaded.name = name;
+        loaded.path = *path;
+        loaded.time = write_time(loaded.path);
+        loaded.data = read_(loaded.path);
+        if (loaded.data.empty()) {
+            return L"";
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // A dataset stored while the file was read is newer.
+        return datasets_.emplace(key, std::move(loaded)).first->second.data;
+    }
+
+    void store(const std::wstring& name, std::wstring data)
+    {
+        auto key = key_of(name);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto& entry = datasets_[key];
+            entry.name  = name;
+            entry.data  = std::move(data);
+            if (!entry.pending) {
+                entry.pending = true;
+                writes_.push_back(key);
+            }
+        }
+        cond_.notify_all();
+    }
+
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return writes_.empty() && !writing_; });
+    }
+
+    void forget(const std::wstring& name)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&] { return writes_.empty() && !writing_; });
+        datasets_.erase(key_of(name));
+    }
+
+    void run()
+    {
+        set_thread_name(L"data-cache");
+
+        auto next_check = std::chrono::steady_clock::now() + check_interval;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cond_.wait_until(lock, next_check, [&] { return stop_ || !writes_.empty(); });
+
+            while (!writes_.empty()) {
+                auto& entry = datasets_[writes_.front()];
+                writes_.pop_front();
+
+                entry.pending = false;
+                auto name     = entry.name;
+                auto data     = entry.data;
+                auto path     = entry.path;
+
+                writing_ = true;
+                lock.unlock();
+                path      = write(name, data, path);
+                auto time = write_time(path);
+                lock.lock();
+                writing_ = false;
+
+                auto it = datasets_.find(key_of(name));
+                if (it != datasets_.end() && !path.empty()) {
+                    it->second.path = path;
+                    it->second.time = time;
+                }
+                cond_.notify_all();
+            }
+
+            if (stop_) {
+                break;
+            }
+
+            if (std::chrono::steady_clock::now() >= next_check) {
+                check(lock);
+                next_check = std::chrono::steady_clock::now() + check_interval;
+            }
+        }
+    }
+
+    // Drops datasets whose files have been changed or removed since they were read or written.
+    void check(std::unique_lock<std::mutex>& lock)
+    {
+        std::vector<std::tuple<std::wstring, boost::filesystem::path, std::time_t>> files;
+        for (auto& p : datasets_) {
+            if (!p.second.pending && !p.second.path.empty()) {
+                files.emplace_back(p.first, p.second.path, p.second.time);
+            }
+        }
+
+        lock.unlock();
+        std::vector<std::wstring> changed;
+        for (auto& file : files) {
+            if (write_time(std::get<1>(file)) != std::get<2>(file)) {
+                changed.push_back(std::get<0>(file));
+            }
+        }
+        lock.lock();
+
+        for (auto& key : changed) {
+            auto it = datasets_.find(key);
+            if (it != datasets_.end() && !it->second.pending) {
+                datasets_.erase(it);
+            }
+        }
+    }
+
+    // Returns the file written, empty if it could not be.
+    boost::filesystem::path write(const std::wstring& name, const std::wstring& data, boost::filesystem::path path)
+    {
+        try {
+            if (path.empty()) {
+                std::wstring filename = folder_ + name + L".ftd";
+
+                auto data_path       = boost::filesystem::path(filename).parent_path().wstring();
+                auto found_data_path = find_case_insensitive(data_path);
+
+                if (found_data_path)
+                    data_path = *found_data_path;
+
+                if (!boost::filesystem::exists(data_path))
+                    boost::filesystem::create_directories(data_path);
+
+                auto found_filename = find_case_insensitive(filename);
+
+                path = found_filename ? *found_filename : filename; // Overwrite case insensitive.
+            }
+
+            boost::filesystem::wofstream datafile(path);
+            if (!datafile) {
+                CASPAR_LOG(error) << L"[data] Could not open file " << path.wstring();
+                return {};
+            }
+
+            datafile << static_cast<wchar_t>(65279); // UTF-8 BOM character
+            datafile << data << std::flush;
+            return path;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+            return {};
+        }
+    }
+};
+
+data_cache::data_cache(std::wstring folder, reader read)
+    : impl_(spl::make_unique<impl>(std::move(folder), std::move(read)))
+{
+}
+
+data_cache::~data_cache() {}
+
+std::wstring data_cache::retrieve(const std::wstring& name) { return impl_->retrieve(name); }
+
+void data_cache::store(const std::wstring& name, std::wstring data) { impl_->store(name, std::move(data)); }
+
+void data_cache::flush() { impl_->flush(); }
+
+void data_cache::forget(const std::wstring& name) { impl_->forget(name); }
+
+}}} // namespace caspar::protocol::amcp
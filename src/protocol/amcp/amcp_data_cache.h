@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <boost/filesystem/path.hpp>
+
+#include <functional>
+#include <string>
+
+namespace caspar { namespace protocol { namespace amcp {
+
+// Datasets of the data folder by their case insensitive name, so that DATA RETRIEVE and the CG commands neither scan
+// the folder nor read the file each time. Stored datasets are kept in memory at once and written to the folder on a
+// background thread in the order they were stored. The thread also checks the files of cached datasets every few
+// seconds, datasets changed or removed by others are read again when next asked for.
+class data_cache
+{
+  public:
+    // Returns the contents of a dataset file, empty if it could not be read.
+    using reader = std::function<std::wstring(const boost::filesystem::path&)>;
+
+    data_cache(std::wstring folder, reader read);
+    ~data_cache(); // Writes what is still pending.
+
+    // Empty if there is no such dataset.
+    std::wstring retrieve(const std::wstring& name);
+
+    void store(const std::wstring& name, std::wstring data);
+
+    // Waits for pending writes, so that the folder holds every stored dataset.
+    void flush();
+
+    // Drops a dataset from memory once pending writes are done, before its file is removed.
+    void forget(const std::wstring& name);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+
+    data_cache(const data_cache&) = delete;
+    data_cache& operator=(const data_cache&) = delete;
+};
+
+}}} // namespace caspar::protocol::amcp
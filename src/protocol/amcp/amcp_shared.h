@@ -3,6 +3,10 @@
 #include "../util/lock_container.h"
 #include <core/video_channel.h>
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <string>
+
 namespace caspar { namespace protocol { namespace amcp {
 
 class channel_context
@@ -18,4 +22,25 @@ class channel_context
     std::shared_ptr<caspar::IO::lock_container> lock;
 };
 
+// Changes the channels of the running server, implemented by the shell. Channels are numbered from 1 and keep their
+// numbers, so channels are added after the last one and only the last one can be removed. Errors are thrown as
+// user_error.
+class channel_manager
+{
+  public:
+    virtual ~channel_manager() = default;
+
+    // Creates a channel and its consumers from a <channel> element, returns its number.
+    virtual int add(const boost::property_tree::wptree& element) = 0;
+
+    virtual void remove(int channel) = 0;
+
+    // Applies a <channel> element to a channel. The channel is recreated when its own settings change, otherwise only
+    // the consumers that were added or changed are created and those that were removed or changed are torn down.
+    virtual std::wstring reconfigure(int channel, const boost::property_tree::wptree& element) = 0;
+
+    // Reads the configuration file again and applies its channels, adding, reconfiguring and removing them as needed.
+    virtual std::wstring reload() = 0;
+};
+
 }}} // namespace caspar::protocol::amcp
\ No newline at end of file
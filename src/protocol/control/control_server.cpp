@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "control_server.h"
+#include "transform_coalescer.h"
+
+#include <common/log.h>
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+using boost::asio::ip::udp;
+
+namespace caspar { namespace protocol { namespace control {
+
+namespace {
+
+const std::size_t record_size = 64;
+
+std::uint64_t read_le(const std::uint8_t* data, std::size_t size)
+{
+    std::uint64_t value = 0;
+    for (std::size_t n = 0; n < size; ++n) {
+        value |= static_cast<std::uint64_t>(data[n]) << (8 * n);
+    }
+    return value;
+}
+
+double read_double(const std::uint8_t* data)
+{
+    auto   bits  = read_le(data, 8);
+    double value = 0.0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+} // namespace
+
+struct control_server::impl : public std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_context> service_;
+    udp::socket                              socket_;
+    udp::endpoint                            sender_;
+    std::array<std::uint8_t, 65536>          buffer_;
+    transform_coalescer                      transforms_;
+
+    impl(std::shared_ptr<boost::asio::io_context>           service,
+         unsigned short                                     port,
+         std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : service_(std::move(service))
+        , socket_(*service_, udp::endpoint(udp::v4(), port))
+        , transforms_(std::move(channels))
+    {
+        CASPAR_LOG(info) << L"[control] Receiving layer transforms on udp port " << port << L".";
+    }
+
+    void receive()
+    {
+        std::weak_ptr<impl> weak_self = shared_from_this();
+        socket_.async_receive_from(
+            boost::asio::buffer(buffer_), sender_, [weak_self](const boost::system::error_code& ec, std::size_t size) {
+                auto self = weak_self.lock();
+                if (!self || ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!ec) {
+                    self->on_datagram(size);
+                }
+                self->receive();
+            });
+    }
+
+    void on_datagram(std::size_t size)
+    {
+        if (size % record_size != 0) {
+            CASPAR_LOG(debug) << L"[control] Ignoring datagram of " << size << L" bytes from "
+                              << sender_.address().to_string();
+            return;
+        }
+
+        using value = transform_coalescer::value;
+
+        // The field bit of each value, fill and fill scale set both their values.
+        static const std::array<std::uint16_t, static_cast<std::size_t>(value::count)> field_bits = {
+            0x01, 0x01, 0x02, 0x02, 0x04, 0x08, 0x10};
+
+        for (std::size_t offset = 0; offset < size; offset += record_size) {
+            auto record  = buffer_.data() + offset;
+            auto channel = static_cast<int>(read_le(record, 2));
+            auto fields  = static_cast<std::uint16_t>(read_le(record + 2, 2));
+            auto layer   = static_cast<int>(static_cast<std::int32_t>(read_le(record + 4, 4)));
+
+            for (std::size_t n = 0; n < field_bits.size(); ++n) {
+                if ((fields & field_bits[n]) &&
+                    !transforms_.set(channel, layer, static_cast<value>(n), read_double(record + 8 + n * 8))) {
+                    CASPAR_LOG(debug) << L"[control] Ignoring record for invalid channel " << channel;
+                    break;
+                }
+            }
+        }
+
+        transforms_.flush();
+    }
+
+    void close()
+    {
+        boost::asio::post(*service_, [self = shared_from_this()] {
+            boost::system::error_code ec;
+            self->socket_.close(ec);
+        });
+    }
+};
+
+control_server::control_server(std::shared_ptr<boost::asio::io_context>           service,
+                               unsigned short                                     port,
+                               std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : impl_(spl::make_shared<impl>(std::move(service), port, std::move(channels)))
+{
+    impl_->receive();
+}
+
+control_server::~control_server() { impl_->close(); }
+
+void control_server::set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    impl_->transforms_.set_channels(std::move(channels));
+}
+
+}}} // namespace caspar::protocol::control
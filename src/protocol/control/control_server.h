@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace control {
+
+// Receives layer transforms as fixed size binary records over UDP, for controllers that update them at a high rate.
+// Each datagram holds one or more 64 byte records, all fields little endian:
+//
+//   offset  0  uint16   channel, starting at 1
+//   offset  2  uint16   fields, a mask of the values below that are set
+//   offset  4  int32    layer
+//   offset  8  double   fill x          (fields & 0x01)
+//   offset 16  double   fill y          (fields & 0x01)
+//   offset 24  double   fill scale x    (fields & 0x02)
+//   offset 32  double   fill scale y    (fields & 0x02)
+//   offset 40  double   rotation, in degrees (fields & 0x04)
+//   offset 48  double   opacity         (fields & 0x08)
+//   offset 56  double   volume          (fields & 0x10)
+//
+// Values apply at once, without a tween, and are coalesced per layer by a transform_coalescer.
+class control_server
+{
+  public:
+    control_server(std::shared_ptr<boost::asio::io_context>           service,
+                   unsigned short                                     port,
+                   std::vector<spl::shared_ptr<core::video_channel>> channels);
+    ~control_server();
+
+    // Channels added or removed at runtime.
+    void set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels);
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+
+    control_server(const control_server&) = delete;
+    control_server& operator=(const control_server&) = delete;
+};
+
+}}} // namespace caspar::protocol::control
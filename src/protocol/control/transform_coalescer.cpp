@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "transform_coalescer.h"
+
+#include <core/frame/frame_transform.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+namespace caspar { namespace protocol { namespace control {
+
+namespace {
+
+struct layer_update
+{
+    std::uint32_t fields = 0;
+    std::array<double, static_cast<std::size_t>(transform_coalescer::value::count)> values{};
+
+    bool has(transform_coalescer::value value) const { return (fields & (1u << static_cast<int>(value))) != 0; }
+
+    double get(transform_coalescer::value value, double current) const
+    {
+        return has(value) ? values[static_cast<std::size_t>(value)] : current;
+    }
+
+    void apply(core::frame_transform& transform) const
+    {
+        using value = transform_coalescer::value;
+
+        static const double PI = 3.141592653589793;
+
+        auto& image = transform.image_transform;
+
+        image.fill_translation = {get(value::fill_x, image.fill_translation[0]),
+                                  get(value::fill_y, image.fill_translation[1])};
+        image.fill_scale = {get(value::scale_x, image.fill_scale[0]), get(value::scale_y, image.fill_scale[1])};
+        image.opacity    = get(value::opacity, image.opacity);
+
+        transform.audio_transform.volume = get(value::volume, transform.audio_transform.volume);
+
+        if (has(value::rotation)) {
+            image.angle = values[static_cast<std::size_t>(value::rotation)] * PI / 180.0;
+        }
+    }
+};
+
+// Values received for the layers of a channel that its stage has not applied yet. A layer is only handed to the stage
+// when it has nothing pending, the stage then takes whatever has been merged into it by the time it runs.
+struct channel_updates
+{
+    spl::shared_ptr<core::video_channel> channel;
+    std::mutex                           mutex;
+    std::map<int, layer_update>          pending;
+
+    explicit channel_updates(spl::shared_ptr<core::video_channel> channel)
+        : channel(std::move(channel))
+    {
+    }
+
+    layer_update take(int layer)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        layer_update update;
+
+        auto it = pending.find(layer);
+        if (it != pending.end()) {
+            update = it->second;
+            pending.erase(it);
+        }
+        return update;
+    }
+};
+
+} // namespace
+
+struct transform_coalescer::impl
+{
+    std::mutex                                    mutex_;
+    std::vector<std::shared_ptr<channel_updates>> channels_;
+
+    // Layers that had nothing pending when they were set, to be handed to the stage on flush.
+    std::map<std::shared_ptr<channel_updates>, std::vector<int>> queued_;
+
+    explicit impl(std::vector<spl::shared_ptr<core::video_channel>> channels) { set_channels(std::move(channels)); }
+
+    void set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels)
+    {
+        std::lock_guard<std::mutex> channels_lock(mutex_);
+
+        // Channels that are still there keep their pending values, and their layers stay queued for the next flush.
+        std::vector<std::shared_ptr<channel_updates>> updates;
+        for (auto& channel : channels) {
+            auto it = std::find_if(channels_.begin(), channels_.end(), [&](const std::shared_ptr<channel_updates>& u) {
+                return u->channel == channel;
+            });
+            updates.push_back(it != channels_.end() ? *it : std::make_shared<channel_updates>(std::move(channel)));
+        }
+        channels_ = std::move(updates);
+
+        for (auto it = queued_.begin(); it != queued_.end();) {
+            if (std::find(channels_.begin(), channels_.end(), it->first) == channels_.end()) {
+                it = queued_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    bool set(int channel, int layer, value value, double x)
+    {
+        std::lock_guard<std::mutex> channels_lock(mutex_);
+
+        if (channel < 1 || channel > static_cast<int>(channels_.size())) {
+            return false;
+        }
+
+        auto& updates = channels_[channel - 1];
+
+        std::lock_guard<std::mutex> lock(updates->mutex);
+
+        auto it = updates->pending.find(layer);
+        if (it == updates->pending.end()) {
+            it = updates->pending.emplace(layer, layer_update()).first;
+            queued_[updates].push_back(layer);
+        }
+        it->second.fields |= 1u << static_cast<int>(value);
+        it->second.values[static_cast<std::size_t>(value)] = x;
+
+        return true;
+    }
+
+    void flush()
+    {
+        std::lock_guard<std::mutex> channels_lock(mutex_);
+
+        for (auto& p : queued_) {
+            auto updates = p.first;
+
+            std::vector<core::stage::transform_tuple_t> transforms;
+            for (auto layer : p.second) {
+                transforms.emplace_back(layer,
+                                        [updates, layer](core::frame_transform transform) {
+                                            updates->take(layer).apply(transform);
+                                            return transform;
+                                        },
+                                        0,
+                                        tweener(L"linear"));
+            }
+
+            updates->channel->stage().apply_transforms(transforms);
+        }
+        queued_.clear();
+    }
+};
+
+transform_coalescer::transform_coalescer(std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : impl_(spl::make_unique<impl>(std::move(channels)))
+{
+}
+
+transform_coalescer::~transform_coalescer() {}
+
+bool transform_coalescer::set(int channel, int layer, value value, double x)
+{
+    return impl_->set(channel, layer, value, x);
+}
+
+void transform_coalescer::flush() { impl_->flush(); }
+
+void transform_coalescer::set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    impl_->set_channels(std::move(channels));
+}
+
+}}} // namespace caspar::protocol::control
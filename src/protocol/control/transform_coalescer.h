@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <vector>
+
+namespace caspar { namespace protocol { namespace control {
+
+// Collects layer transform values from high rate controllers and applies them to the stages without a tween. Values
+// of a layer that arrive before its stage has applied the previous ones are merged into them, so a layer is changed
+// at most once per stage invocation however fast they arrive. Each receiver has its own.
+class transform_coalescer
+{
+  public:
+    enum class value
+    {
+        fill_x,
+        fill_y,
+        scale_x,
+        scale_y,
+        rotation, // degrees
+        opacity,
+        volume,
+        count
+    };
+
+    explicit transform_coalescer(std::vector<spl::shared_ptr<core::video_channel>> channels);
+    ~transform_coalescer();
+
+    // Channels start at 1. Returns false if there is no such channel.
+    bool set(int channel, int layer, value value, double x);
+
+    // Hands the layers that have values pending since the last flush to their stages.
+    void flush();
+
+    // Replaces the channels when they are added or removed at runtime.
+    void set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels);
+
+  private:
+    struct impl;
+    spl::unique_ptr<impl> impl_;
+
+    transform_coalescer(const transform_coalescer&) = delete;
+    transform_coalescer& operator=(const transform_coalescer&) = delete;
+};
+
+}}} // namespace caspar::protocol::control
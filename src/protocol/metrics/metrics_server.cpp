@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "metrics_server.h"
+
+#include "../amcp/amcp_command_stats.h"
+
+#include <common/diagnostics/graph.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/diagnostics/call_context.h>
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+using boost::asio::ip::tcp;
+
+namespace caspar { namespace protocol { namespace metrics {
+
+namespace {
+
+// Graph values are fractions of the diagnostics window height, where timings are scaled so that 0.5 is one frame.
+const std::array<double, 8> buckets = {0.05, 0.1, 0.25, 0.5, 0.75, 1.0, 1.5, 2.0};
+
+struct histogram
+{
+    std::array<std::uint64_t, buckets.size()> counts{};
+    std::uint64_t                             count = 0;
+    double                                    sum   = 0.0;
+    double                                    last  = 0.0;
+
+    void observe(double value)
+    {
+        for (std::size_t n = 0; n < buckets.size(); ++n) {
+            if (value <= buckets[n]) {
+                ++counts[n];
+            }
+        }
+        ++count;
+        sum += value;
+        last = value;
+    }
+
+    histogram& operator+=(const histogram& other)
+    {
+        for (std::size_t n = 0; n < buckets.size(); ++n) {
+            counts[n] += other.counts[n];
+        }
+        count += other.count;
+        sum += other.sum;
+        last = other.last;
+        return *this;
+    }
+};
+
+std::string escape(const std::string& value)
+{
+    std::string result;
+    for (auto c : value) {
+        if (c == '\\' || c == '"') {
+            result += '\\';
+        }
+        if (c != '\n') {
+            result += c;
+        }
+    }
+    return result;
+}
+
+class metrics_sink : public caspar::diagnostics::spi::graph_sink
+{
+    const core::diagnostics::call_context context_ = core::diagnostics::call_context::for_thread();
+
+    mutable std::mutex                         mutex_;
+    std::string                                kind_;
+    std::unordered_map<std::string, histogram> values_;
+    std::map<std::string, std::uint64_t>       tags_;
+
+  public:
+    void activate() override {}
+
+    void set_text(const std::wstring& value) override
+    {
+        // The text usually carries the file name or frame numbers. Only the kind before the brackets is used as a
+        // label, so that the number of series stays bounded.
+        auto kind = u8(value.substr(0, value.find(L'[')));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        kind_ = std::move(kind);
+    }
+
+    void set_value(const std::string& name, double value) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        values_[name].observe(value);
+    }
+
+    void set_color(const std::string&, int) override {}
+
+    void set_tag(caspar::diagnostics::tag_severity, const std::string& name) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++tags_[name];
+    }
+
+    void auto_reset() override {}
+
+    std::string labels(const std::string& name) const
+    {
+        std::string result = "graph=\"" + escape(kind_) + "\",channel=\"";
+        if (context_.video_channel != -1) {
+            result += std::to_string(context_.video_channel);
+        }
+        result += "\",layer=\"";
+        if (context_.layer != -1) {
+            result += std::to_string(context_.layer);
+        }
+        return result + "\",name=\"" + escape(name) + "\"";
+    }
+
+    void collect(std::map<std::string, histogram>& values, std::map<std::string, std::uint64_t>& tags) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& p : values_) {
+            values[labels(p.first)] += p.second;
+        }
+        for (auto& p : tags_) {
+            tags[labels(p.first)] += p.second;
+        }
+    }
+};
+
+std::mutex                              sinks_mutex;
+std::list<std::weak_ptr<metrics_sink>> sinks;
+
+std::string scrape()
+{
+    // Graphs with the same labels, e.g. consecutive clips on a layer, are summed into one series.
+    std::map<std::string, histogram>     values;
+    std::map<std::string, std::uint64_t> tags;
+    {
+        std::lock_guard<std::mutex> lock(sinks_mutex);
+        for (auto it = sinks.begin(); it != sinks.end();) {
+            auto sink = it->lock();
+            if (sink) {
+                sink->collect(values, tags);
+                ++it;
+            } else {
+                it = sinks.erase(it);
+            }
+        }
+    }
+
+    std::ostringstream out;
+
+    out << "# HELP caspar_graph Diagnostics graph values, timings are scaled so that 0.5 is one frame.\n";
+    out << "# TYPE caspar_graph histogram\n";
+    for (auto& p : values) {
+        for (std::size_t n = 0; n < buckets.size(); ++n) {
+            out << "caspar_graph_bucket{" << p.first << ",le=\"" << buckets[n] << "\"} " << p.second.counts[n] << "\n";
+        }
+        out << "caspar_graph_bucket{" << p.first << ",le=\"+Inf\"} " << p.second.count << "\n";
+        out << "caspar_graph_sum{" << p.first << "} " << p.second.sum << "\n";
+        out << "caspar_graph_count{" << p.first << "} " << p.second.count << "\n";
+    }
+
+    out << "# HELP caspar_graph_last Last diagnostics graph value.\n";
+    out << "# TYPE caspar_graph_last gauge\n";
+    for (auto& p : values) {
+        out << "caspar_graph_last{" << p.first << "} " << p.second.last << "\n";
+    }
+
+    out << "# HELP caspar_graph_tags_total Diagnostics graph tags, such as dropped-frame and late-frame.\n";
+    out << "# TYPE caspar_graph_tags_total counter\n";
+    for (auto& p : tags) {
+        out << "caspar_graph_tags_total{" << p.first << "} " << p.second << "\n";
+    }
+
+    out << amcp::export_command_times();
+
+    return out.str();
+}
+
+class connection : public std::enable_shared_from_this<connection>
+{
+    tcp::socket            socket_;
+    boost::asio::streambuf request_;
+    std::string            response_;
+
+  public:
+    explicit connection(tcp::socket socket)
+        : socket_(std::move(socket))
+    {
+    }
+
+    void start()
+    {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(
+            socket_, request_, "\r\n\r\n", [self](const boost::system::error_code& ec, std::size_t) {
+                if (!ec) {
+                    self->respond();
+                }
+            });
+    }
+
+  private:
+    void respond()
+    {
+        std::istream request(&request_);
+        std::string  method;
+        std::string  path;
+        request >> method >> path;
+
+        if (method == "GET" && (path == "/metrics" || path.compare(0, 9, "/metrics?") == 0)) {
+            auto body = scrape();
+            response_ = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        } else {
+            response_ = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        }
+
+        auto self = shared_from_this();
+        boost::asio::async_write(
+            socket_, boost::asio::buffer(response_), [self](const boost::system::error_code&, std::size_t) {
+                boost::system::error_code ec;
+                self->socket_.shutdown(tcp::socket::shutdown_both, ec);
+            });
+    }
+};
+
+} // namespace
+
+void register_sink()
+{
+    caspar::diagnostics::spi::register_sink_factory([] {
+        auto sink = spl::make_shared<metrics_sink>();
+
+        std::lock_guard<std::mutex> lock(sinks_mutex);
+        sinks.push_back(sink);
+        return sink;
+    });
+
+    // Values are always collected, not only while the diagnostics window is open.
+    caspar::diagnostics::spi::set_sink_visible(true);
+}
+
+struct metrics_server::impl : public std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_context> service_;
+    tcp::acceptor                            acceptor_;
+
+    impl(std::shared_ptr<boost::asio::io_context> service, unsigned short port)
+        : service_(std::move(service))
+        , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
+    {
+        CASPAR_LOG(info) << L"[metrics] Serving metrics on port " << port << L".";
+    }
+
+    void accept()
+    {
+        std::weak_ptr<impl> weak_self = shared_from_this();
+        acceptor_.async_accept([weak_self](const boost::system::error_code& ec, tcp::socket socket) {
+            auto self = weak_self.lock();
+            if (!self || ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+            if (!ec) {
+                std::make_shared<connection>(std::move(socket))->start();
+            }
+            self->accept();
+        });
+    }
+
+    void close()
+    {
+        boost::asio::post(*service_, [self = shared_from_this()] {
+            boost::system::error_code ec;
+            self->acceptor_.close(ec);
+        });
+    }
+};
+
+metrics_server::metrics_server(std::shared_ptr<boost::asio::io_context> service, unsigned short port)
+    : impl_(spl::make_shared<impl>(std::move(service), port))
+{
+    impl_->accept();
+}
+
+metrics_server::~metrics_server() { impl_->close(); }
+
+}}} // namespace caspar::protocol::metrics
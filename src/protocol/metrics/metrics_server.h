@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <memory>
+
+namespace caspar { namespace protocol { namespace metrics {
+
+// Collects the diagnostics graphs of every channel, producer and consumer. Only graphs created after this are
+// collected, so it is called before the channels are set up.
+void register_sink();
+
+// Serves the collected graphs over HTTP in the Prometheus text format, on GET /metrics.
+class metrics_server
+{
+  public:
+    metrics_server(std::shared_ptr<boost::asio::io_context> service, unsigned short port);
+    ~metrics_server();
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+
+    metrics_server(const metrics_server&) = delete;
+    metrics_server& operator=(const metrics_server&) = delete;
+};
+
+}}} // namespace caspar::protocol::metrics
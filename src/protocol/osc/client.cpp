@@ -27,6 +27,7 @@
 #include "oscpack/OscOutboundPacketStream.h"
 
 #include <common/endian.h>
+#include <common/env.h>
 #include <common/utf.h>
 
 #include <core/monitor/monitor.h>
@@ -34,6 +35,8 @@
 #include <boost/asio.hpp>
 #include <boost/optional.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -64,18 +67,111 @@ struct param_visitor : public boost::static_visitor<void>
     void operator()(const std::wstring& value) { o << u8(value).c_str(); }
 };
 
+namespace {
+
+// Encoded size of an argument, padded to 4 bytes as in the OSC spec.
+struct param_size_visitor : public boost::static_visitor<std::size_t>
+{
+    static std::size_t padded(std::size_t size) { return (size + 3) & ~std::size_t(3); }
+
+    std::size_t operator()(const bool) const { return 0; }
+    std::size_t operator()(const int32_t) const { return 4; }
+    std::size_t operator()(const int64_t) const { return 8; }
+    std::size_t operator()(const float) const { return 4; }
+    std::size_t operator()(const double) const { return 4; }
+    std::size_t operator()(const std::string& value) const { return padded(value.size() + 1); }
+    std::size_t operator()(const std::wstring& value) const { return padded(u8(value).size() + 1); }
+};
+
+// Size of a message including its bundle element size prefix.
+std::size_t message_size(const std::string& address, const core::monitor::vector_t& params)
+{
+    param_size_visitor visitor;
+
+    auto size = 4 + param_size_visitor::padded(address.size() + 1) + param_size_visitor::padded(params.size() + 2);
+    for (const auto& param : params) {
+        size += boost::apply_visitor(visitor, param);
+    }
+    return size;
+}
+
+// "#bundle" and the time tag.
+const std::size_t bundle_header_size = 16;
+
+// '*' matches any run of characters, including '/', and '?' matches a single character.
+bool match(const char* pattern, const char* address)
+{
+    const char* star      = nullptr;
+    const char* backtrack = nullptr;
+
+    while (*address) {
+        if (*pattern == '*') {
+            star      = pattern++;
+            backtrack = address;
+        } else if (*pattern == '?' || *pattern == *address) {
+            ++pattern;
+            ++address;
+        } else if (star) {
+            pattern = star + 1;
+            address = ++backtrack;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        ++pattern;
+    }
+    return !*pattern;
+}
+
+} // namespace
+
 struct client::impl : public spl::enable_shared_from_this<client::impl>
 {
-    std::shared_ptr<boost::asio::io_context> service_;
-    udp::socket                              socket_;
-    std::map<udp::endpoint, int>             reference_counts_by_endpoint_;
-    std::vector<char>                        buffer_;
+    struct subscriber
+    {
+        int          reference_count = 0;
+        subscription options;
+        bool         needs_full = true;
+
+        // Only touched by the send thread.
+        core::monitor::data_map_t             pending;
+        std::chrono::steady_clock::time_point last_send;
+
+        bool accepts(const std::string& address) const
+        {
+            return options.address_patterns.empty() ||
+                   std::any_of(options.address_patterns.begin(),
+                               options.address_patterns.end(),
+                               [&](const std::string& pattern) { return match(pattern.c_str(), address.c_str()); });
+        }
+
+        void merge(const core::monitor::data_map_t& messages)
+        {
+            for (auto& p : messages) {
+                if (accepts(p.first)) {
+                    pending[p.first] = p.second;
+                }
+            }
+        }
+    };
+
+    std::shared_ptr<boost::asio::io_context>             service_;
+    udp::socket                                          socket_;
+    std::map<udp::endpoint, std::shared_ptr<subscriber>> subscribers_;
+    std::vector<char>                                    buffer_;
+    const std::size_t max_packet_size_ = env::properties().get(L"configuration.osc.max-packet-size", 1472);
 
     std::mutex              mutex_;
     std::condition_variable cond_;
-    core::monitor::state    bundle_;
     uint64_t                bundle_time_ = 0;
 
+    // Messages waiting to be sent, merged across channels so that a tick is never lost to the next one.
+    core::monitor::data_map_t bundle_;
+    // Last value sent for every address. Unchanged values are not sent again unless a new client subscribes.
+    core::monitor::data_map_t sent_;
+    const bool                changes_only_ = env::properties().get(L"configuration.osc.send-changes-only", true);
+
     uint64_t time_ = 0;
 
     std::atomic<bool> abort_request_{false};
@@ -90,13 +186,17 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_ = std::thread([=] {
             try {
                 while (!abort_request_) {
-                    core::monitor::state       bundle;
-                    uint64_t                   bundle_time;
-                    std::vector<udp::endpoint> endpoints;
+                    core::monitor::data_map_t                                          bundle;
+                    uint64_t                                                           bundle_time;
+                    std::vector<std::pair<udp::endpoint, std::shared_ptr<subscriber>>> subscribers;
 
                     {
                         std::unique_lock<std::mutex> lock(mutex_);
-                        cond_.wait(lock, [&] { return bundle_time_ > 0 || abort_request_; });
+                        // Wake up regularly so that rate limited subscribers get their pending messages even
+                        // when nothing changes.
+                        cond_.wait_for(lock, std::chrono::milliseconds(100), [&] {
+                            return !bundle_.empty() || abort_request_;
+                        });
 
                         if (abort_request_) {
                             return;
@@ -105,44 +205,36 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
                         bundle       = std::move(bundle_);
                         bundle_time  = bundle_time_;
                         bundle_time_ = 0;
+                        bundle_.clear();
 
-                        for (auto& p : reference_counts_by_endpoint_) {
-                            endpoints.push_back(p.first);
+                        for (auto& p : subscribers_) {
+                            if (p.second->needs_full) {
+                                p.second->merge(sent_);
+                                p.second->needs_full = false;
+                            }
+                            subscribers.push_back(p);
                         }
                     }
 
-                    if (endpoints.empty()) {
-                        continue;
-                    }
+                    auto now = std::chrono::steady_clock::now();
 
-                    auto it = std::begin(bundle);
+                    for (auto& p : subscribers) {
+                        auto& sub = *p.second;
 
-                    while (it != std::end(bundle)) {
-                        ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
-                                                      static_cast<unsigned long>(buffer_.size()));
+                        sub.merge(bundle);
 
-                        o << ::osc::BeginBundle(bundle_time);
-
-                        // TODO (fix): < 2048 is a hack. Properly calculate if messages will fit.
-                        while (it != std::end(bundle) && o.Size() < 2048) {
-                            o << ::osc::BeginMessage(it->first.c_str());
-
-                            param_visitor<decltype(o)> param_visitor(o);
-                            for (const auto& element : it->second) {
-                                boost::apply_visitor(param_visitor, element);
-                            }
-
-                            o << ::osc::EndMessage;
-
-                            ++it;
+                        if (sub.pending.empty()) {
+                            continue;
                         }
 
-                        o << ::osc::EndBundle;
-
-                        boost::system::error_code ec;
-                        for (const auto& endpoint : endpoints) {
-                            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
+                        if (sub.options.max_rate > 0.0 &&
+                            now - sub.last_send < std::chrono::duration<double>(1.0 / sub.options.max_rate)) {
+                            continue;
                         }
+
+                        send_to(sub.pending, bundle_time, p.first);
+                        sub.pending.clear();
+                        sub.last_send = now;
                     }
                 }
             } catch (...) {
@@ -158,12 +250,52 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         thread_.join();
     }
 
+    void send_to(const core::monitor::data_map_t& messages, uint64_t time, const udp::endpoint& endpoint)
+    {
+        auto it = std::begin(messages);
+
+        while (it != std::end(messages)) {
+            ::osc::OutboundPacketStream o(reinterpret_cast<char*>(buffer_.data()),
+                                          static_cast<unsigned long>(buffer_.size()));
+
+            o << ::osc::BeginBundle(time);
+
+            // Fill the packet up to the maximum size. A message that does not fit on its own is still sent, alone.
+            auto size = bundle_header_size;
+            do {
+                size += message_size(it->first, it->second);
+
+                o << ::osc::BeginMessage(it->first.c_str());
+
+                param_visitor<decltype(o)> param_visitor(o);
+                for (const auto& element : it->second) {
+                    boost::apply_visitor(param_visitor, element);
+                }
+
+                o << ::osc::EndMessage;
+
+                ++it;
+            } while (it != std::end(messages) && size + message_size(it->first, it->second) <= max_packet_size_);
+
+            o << ::osc::EndBundle;
+
+            boost::system::error_code ec;
+            socket_.send_to(boost::asio::buffer(o.Data(), o.Size()), endpoint, 0, ec);
+        }
+    }
+
     // TODO (refactor) This is wierd...
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription&                   options)
     {
         std::lock_guard<std::mutex> lock(mutex_);
 
-        ++reference_counts_by_endpoint_[endpoint];
+        auto& sub = subscribers_[endpoint];
+        if (!sub) {
+            sub          = std::make_shared<subscriber>();
+            sub->options = options;
+        }
+        ++sub->reference_count;
 
         std::weak_ptr<impl> weak_self = shared_from_this();
 
@@ -177,10 +309,9 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
 
             std::lock_guard<std::mutex> lock(self.mutex_);
 
-            int reference_count_after = --self.reference_counts_by_endpoint_[endpoint];
-
-            if (reference_count_after == 0) {
-                self.reference_counts_by_endpoint_.erase(endpoint);
+            auto it = self.subscribers_.find(endpoint);
+            if (it != self.subscribers_.end() && --it->second->reference_count == 0) {
+                self.subscribers_.erase(it);
             }
         });
     }
@@ -190,9 +321,26 @@ struct client::impl : public spl::enable_shared_from_this<client::impl>
         {
             std::lock_guard<std::mutex> lock(mutex_);
 
+            for (auto& p : state) {
+                if (changes_only_) {
+                    auto it = sent_.find(p.first);
+                    if (it == sent_.end()) {
+                        sent_.emplace(p.first, p.second);
+                    } else if (it->second == p.second) {
+                        continue;
+                    } else {
+                        it->second = p.second;
+                    }
+                }
+                bundle_[p.first] = p.second;
+            }
+
+            if (bundle_.empty()) {
+                return;
+            }
+
             // TODO: time_++ is a hack. Use proper channel time.
             bundle_time_ = time_++;
-            bundle_      = state;
         }
         cond_.notify_all();
     }
@@ -216,9 +364,10 @@ client& client::operator=(client&& other)
 
 client::~client() {}
 
-std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint)
+std::shared_ptr<void> client::get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                     const subscription&                   options)
 {
-    return impl_->get_subscription_token(endpoint);
+    return impl_->get_subscription_token(endpoint, options);
 }
 
 void client::send(core::monitor::state state) { impl_->send(state); }
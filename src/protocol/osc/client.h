@@ -27,8 +27,19 @@
 #include <common/memory.h>
 #include <core/monitor/monitor.h>
 
+#include <string>
+#include <vector>
+
 namespace caspar { namespace protocol { namespace osc {
 
+struct subscription
+{
+    // OSC addresses to send, '*' matches any characters and '?' a single one. Empty sends everything.
+    std::vector<std::string> address_patterns;
+    // Maximum number of bundles per second, changes in between are merged. 0 sends on every change.
+    double max_rate = 0.0;
+};
+
 class client
 {
     client(const client&);
@@ -46,10 +57,13 @@ class client
      * previously been checked out.
      *
      * @param endpoint The UDP endpoint to send OSC messages to.
+     * @param options  Address filter and rate limit for the endpoint. Only the
+     *                 options of the first token to an endpoint are used.
      *
      * @return The token. It is ok for the token to outlive the client
      */
-    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint);
+    std::shared_ptr<void> get_subscription_token(const boost::asio::ip::udp::endpoint& endpoint,
+                                                 const subscription&                   options = {});
 
     ~client();
 
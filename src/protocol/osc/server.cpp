@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../StdAfx.h"
+
+#include "server.h"
+
+#include "oscpack/OscException.h"
+#include "oscpack/OscReceivedElements.h"
+
+#include "../control/transform_coalescer.h"
+
+#include <common/log.h>
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using boost::asio::ip::udp;
+
+namespace caspar { namespace protocol { namespace osc {
+
+namespace {
+
+double as_double(const ::osc::ReceivedMessageArgument& arg)
+{
+    if (arg.IsInt32())
+        return arg.AsInt32();
+    if (arg.IsInt64())
+        return static_cast<double>(arg.AsInt64());
+    if (arg.IsFloat())
+        return arg.AsFloat();
+    return arg.AsDouble();
+}
+
+} // namespace
+
+struct server::impl : public std::enable_shared_from_this<impl>
+{
+    std::shared_ptr<boost::asio::io_context> service_;
+    udp::socket                              socket_;
+    udp::endpoint                            sender_;
+    std::array<char, 65536>                  buffer_;
+    control::transform_coalescer             transforms_;
+
+    impl(std::shared_ptr<boost::asio::io_context>           service,
+         unsigned short                                     port,
+         std::vector<spl::shared_ptr<core::video_channel>> channels)
+        : service_(std::move(service))
+        , socket_(*service_, udp::endpoint(udp::v4(), port))
+        , transforms_(std::move(channels))
+    {
+        CASPAR_LOG(info) << L"[osc] Receiving layer transforms on udp port " << port << L".";
+    }
+
+    void receive()
+    {
+        std::weak_ptr<impl> weak_self = shared_from_this();
+        socket_.async_receive_from(
+            boost::asio::buffer(buffer_), sender_, [weak_self](const boost::system::error_code& ec, std::size_t size) {
+                auto self = weak_self.lock();
+                if (!self || ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                if (!ec) {
+                    try {
+                        self->on_packet(::osc::ReceivedPacket(self->buffer_.data(), static_cast<int>(size)));
+                    } catch (::osc::Exception& e) {
+                        CASPAR_LOG(debug) << L"[osc] Ignoring malformed packet from "
+                                          << self->sender_.address().to_string() << L": " << e.what();
+                    }
+                    self->transforms_.flush();
+                }
+                self->receive();
+            });
+    }
+
+    void on_packet(const ::osc::ReceivedPacket& packet)
+    {
+        if (packet.IsBundle()) {
+            on_bundle(::osc::ReceivedBundle(packet));
+        } else {
+            on_message(::osc::ReceivedMessage(packet));
+        }
+    }
+
+    void on_bundle(const ::osc::ReceivedBundle& bundle)
+    {
+        for (auto it = bundle.ElementsBegin(); it != bundle.ElementsEnd(); ++it) {
+            if (it->IsBundle()) {
+                on_bundle(::osc::ReceivedBundle(*it));
+            } else {
+                on_message(::osc::ReceivedMessage(*it));
+            }
+        }
+    }
+
+    void on_message(const ::osc::ReceivedMessage& message)
+    {
+        using value = control::transform_coalescer::value;
+
+        auto address  = message.AddressPattern();
+        int  channel  = 0;
+        int  layer    = 0;
+        char name[16] = {};
+        int  length   = 0;
+        if (std::sscanf(address, "/channel/%d/stage/layer/%d/mixer/%15[a-z]%n", &channel, &layer, name, &length) != 3 ||
+            address[length] != '\0') {
+            CASPAR_LOG(debug) << L"[osc] Ignoring message to " << address;
+            return;
+        }
+
+        std::vector<double> args;
+        for (auto it = message.ArgumentsBegin(); it != message.ArgumentsEnd(); ++it) {
+            args.push_back(as_double(*it));
+        }
+
+        std::vector<value> values;
+        if (std::strcmp(name, "fill") == 0 && (args.size() == 2 || args.size() == 4)) {
+            values = {value::fill_x, value::fill_y, value::scale_x, value::scale_y};
+        } else if (std::strcmp(name, "rotation") == 0 && args.size() == 1) {
+            values = {value::rotation};
+        } else if (std::strcmp(name, "opacity") == 0 && args.size() == 1) {
+            values = {value::opacity};
+        } else if (std::strcmp(name, "volume") == 0 && args.size() == 1) {
+            values = {value::volume};
+        } else {
+            CASPAR_LOG(debug) << L"[osc] Ignoring message to " << address;
+            return;
+        }
+
+        for (std::size_t n = 0; n < args.size(); ++n) {
+            if (!transforms_.set(channel, layer, values[n], args[n])) {
+                CASPAR_LOG(debug) << L"[osc] Ignoring message for invalid channel " << channel;
+                return;
+            }
+        }
+    }
+
+    void close()
+    {
+        boost::asio::post(*service_, [self = shared_from_this()] {
+            boost::system::error_code ec;
+            self->socket_.close(ec);
+        });
+    }
+};
+
+server::server(std::shared_ptr<boost::asio::io_context>           service,
+               unsigned short                                     port,
+               std::vector<spl::shared_ptr<core::video_channel>> channels)
+    : impl_(spl::make_shared<impl>(std::move(service), port, std::move(channels)))
+{
+    impl_->receive();
+}
+
+server::~server() { impl_->close(); }
+
+void server::set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels)
+{
+    impl_->transforms_.set_channels(std::move(channels));
+}
+
+}}} // namespace caspar::protocol::osc
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <common/memory.h>
+
+#include <core/fwd.h>
+
+#include <boost/asio/io_context.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace caspar { namespace protocol { namespace osc {
+
+// Receives OSC messages, or bundles of them, that set layer transforms:
+//
+//   /channel/1/stage/layer/10/mixer/fill      x y [scale-x scale-y]
+//   /channel/1/stage/layer/10/mixer/rotation  degrees
+//   /channel/1/stage/layer/10/mixer/opacity   opacity
+//   /channel/1/stage/layer/10/mixer/volume    volume
+//
+// Arguments may be int32, int64, float or double. Values apply at once, without a tween, and are coalesced per layer
+// by a control::transform_coalescer, so high rate controllers do not flood the stages.
+class server
+{
+  public:
+    server(std::shared_ptr<boost::asio::io_context>           service,
+           unsigned short                                     port,
+           std::vector<spl::shared_ptr<core::video_channel>> channels);
+    ~server();
+
+    // Channels added or removed at runtime.
+    void set_channels(std::vector<spl::shared_ptr<core::video_channel>> channels);
+
+  private:
+    struct impl;
+    spl::shared_ptr<impl> impl_;
+
+    server(const server&) = delete;
+    server& operator=(const server&) = delete;
+};
+
+}}} // namespace caspar::protocol::osc
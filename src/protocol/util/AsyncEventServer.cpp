@@ -27,6 +27,7 @@
 #include <array>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -34,7 +35,6 @@
 
 #include <tbb/concurrent_hash_map.h>
 #include <tbb/concurrent_queue.h>
-#include <tbb/mutex.h>
 
 using boost::asio::ip::tcp;
 
@@ -42,7 +42,15 @@ namespace caspar { namespace IO {
 
 class connection;
 
-using connection_set = std::set<spl::shared_ptr<connection>>;
+// Queued messages sent together in one write.
+const std::size_t max_coalesced_writes = 256;
+
+// Shared by the acceptor and its connections, which may run on different io_service threads.
+struct connection_set
+{
+    std::mutex                            mutex;
+    std::set<spl::shared_ptr<connection>> connections;
+};
 
 class connection : public spl::enable_shared_from_this<connection>
 {
@@ -51,6 +59,7 @@ class connection : public spl::enable_shared_from_this<connection>
 
     const spl::shared_ptr<tcp::socket>       socket_;
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_;
     const std::wstring                       listen_port_;
     const spl::shared_ptr<connection_set>    connection_set_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
@@ -61,6 +70,10 @@ class connection : public spl::enable_shared_from_this<connection>
     send_queue              send_queue_;
     bool                    is_writing_;
 
+    // Messages of the write in flight and their buffers, reused between writes.
+    std::vector<std::string>               writing_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
+
     class connection_holder : public client_connection<char>
     {
         std::weak_ptr<connection> connection_;
@@ -123,7 +136,12 @@ class connection : public spl::enable_shared_from_this<connection>
         spl::shared_ptr<connection> con(
             new connection(std::move(service), std::move(socket), std::move(protocol), std::move(connection_set)));
         con->init();
-        con->read_some();
+        {
+            // Before the first read, which may complete and stop the connection on another thread.
+            std::lock_guard<std::mutex> lock(con->connection_set_->mutex);
+            con->connection_set_->connections.insert(con);
+        }
+        con->strand_.dispatch([con] { con->read_some(); });
         return con;
     }
 
@@ -144,13 +162,13 @@ class connection : public spl::enable_shared_from_this<connection>
     {
         send_queue_.push(std::move(data));
         auto self = shared_from_this();
-        service_->dispatch([=] { self->do_write(); });
+        strand_.dispatch([=] { self->do_write(); });
     }
 
     void disconnect()
     {
         std::weak_ptr<connection> self = shared_from_this();
-        service_->dispatch([=] {
+        strand_.dispatch([=] {
             auto strong = self.lock();
 
             if (strong)
@@ -176,21 +194,29 @@ class connection : public spl::enable_shared_from_this<connection>
     }
 
   private:
-    void do_write() // always called from the asio-service-thread
+    void do_write() // always called from the connection strand
     {
         if (!is_writing_) {
             std::string data;
-            if (send_queue_.try_pop(data)) {
-                write_some(std::move(data));
+            while (writing_.size() < max_coalesced_writes && send_queue_.try_pop(data)) {
+                writing_.push_back(std::move(data));
+            }
+            if (!writing_.empty()) {
+                write();
             }
         }
     }
 
-    void stop() // always called from the asio-service-thread
+    void stop() // always called from the connection strand
     {
-        connection_set_->erase(shared_from_this());
+        std::size_t connection_count;
+        {
+            std::lock_guard<std::mutex> lock(connection_set_->mutex);
+            connection_set_->connections.erase(shared_from_this());
+            connection_count = connection_set_->connections.size();
+        }
 
-        CASPAR_LOG(info) << print() << L" Client " << ipv4_address() << L" disconnected (" << connection_set_->size()
+        CASPAR_LOG(info) << print() << L" Client " << ipv4_address() << L" disconnected (" << connection_count
                          << L" connections).";
 
         boost::system::error_code ec;
@@ -204,17 +230,24 @@ class connection : public spl::enable_shared_from_this<connection>
                const spl::shared_ptr<connection_set>&          connection_set)
         : socket_(socket)
         , service_(service)
+        , strand_(*service)
         , listen_port_(socket_->is_open() ? std::to_wstring(socket_->local_endpoint().port()) : L"no-port")
         , connection_set_(connection_set)
         , protocol_factory_(protocol_factory)
         , is_writing_(false)
     {
-        CASPAR_LOG(info) << print() << L" Accepted connection from " << ipv4_address() << L" ("
-                         << connection_set_->size() + 1 << L" connections).";
+        std::size_t connection_count;
+        {
+            std::lock_guard<std::mutex> lock(connection_set_->mutex);
+            connection_count = connection_set_->connections.size();
+        }
+
+        CASPAR_LOG(info) << print() << L" Accepted connection from " << ipv4_address() << L" (" << connection_count + 1
+                         << L" connections).";
     }
 
     void handle_read(const boost::system::error_code& error,
-                     size_t                           bytes_transferred) // always called from the asio-service-thread
+                     size_t                           bytes_transferred) // always called from the connection strand
     {
         if (!error) {
             try {
@@ -230,42 +263,42 @@ class connection : public spl::enable_shared_from_this<connection>
             stop();
     }
 
-    void handle_write(const spl::shared_ptr<std::string>& str,
-                      const boost::system::error_code&    error,
-                      size_t bytes_transferred) // always called from the asio-service-thread
+    void handle_write(const boost::system::error_code& error,
+                      size_t bytes_transferred) // always called from the connection strand
     {
+        writing_.clear();
+        write_buffers_.clear();
+
         if (!error) {
-            if (bytes_transferred != str->size()) {
-                str->assign(str->substr(bytes_transferred));
-                socket_->async_write_some(boost::asio::buffer(str->data(), str->size()),
-                                          std::bind(&connection::handle_write,
-                                                    shared_from_this(),
-                                                    str,
-                                                    std::placeholders::_1,
-                                                    std::placeholders::_2));
-            } else {
-                is_writing_ = false;
-                do_write();
-            }
+            is_writing_ = false;
+            do_write();
         } else if (error != boost::asio::error::operation_aborted && socket_->is_open())
             stop();
     }
 
-    void read_some() // always called from the asio-service-thread
+    void read_some() // always called from the connection strand
     {
         socket_->async_read_some(
             boost::asio::buffer(data_.data(), data_.size()),
-            std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+            boost::asio::bind_executor(
+                strand_,
+                std::bind(&connection::handle_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
     }
 
-    void write_some(std::string&& data) // always called from the asio-service-thread
+    void write() // always called from the connection strand
     {
         is_writing_ = true;
-        auto str    = spl::make_shared<std::string>(std::move(data));
-        socket_->async_write_some(
-            boost::asio::buffer(str->data(), str->size()),
-            std::bind(
-                &connection::handle_write, shared_from_this(), str, std::placeholders::_1, std::placeholders::_2));
+        for (auto& str : writing_) {
+            write_buffers_.push_back(boost::asio::buffer(str));
+        }
+        // async_write keeps track of partial writes itself and sends the whole sequence with as few calls as the
+        // socket allows.
+        boost::asio::async_write(
+            *socket_,
+            write_buffers_,
+            boost::asio::bind_executor(
+                strand_,
+                std::bind(&connection::handle_write, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
     }
 
     friend struct AsyncEventServer::implementation;
@@ -274,16 +307,17 @@ class connection : public spl::enable_shared_from_this<connection>
 struct AsyncEventServer::implementation : public spl::enable_shared_from_this<implementation>
 {
     std::shared_ptr<boost::asio::io_service> service_;
+    boost::asio::io_service::strand          strand_;
     tcp::acceptor                            acceptor_;
     protocol_strategy_factory<char>::ptr     protocol_factory_;
     spl::shared_ptr<connection_set>          connection_set_;
     std::vector<lifecycle_factory_t>         lifecycle_factories_;
-    tbb::mutex                               mutex_;
 
     implementation(std::shared_ptr<boost::asio::io_service>    service,
                    const protocol_strategy_factory<char>::ptr& protocol,
                    unsigned short                              port)
         : service_(std::move(service))
+        , strand_(*service_)
         , acceptor_(*service_, tcp::endpoint(tcp::v4(), port))
         , protocol_factory_(protocol)
     {
@@ -301,20 +335,24 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
 
     ~implementation()
     {
-        auto conns_set = connection_set_;
+        std::set<spl::shared_ptr<connection>> connections;
+        {
+            std::lock_guard<std::mutex> lock(connection_set_->mutex);
+            connections = connection_set_->connections;
+        }
 
-        service_->post([conns_set] {
-            auto connections = *conns_set;
-            for (auto& connection : connections)
-                connection->stop();
-        });
+        for (auto& connection : connections)
+            connection->disconnect();
     }
 
     void start_accept()
     {
         spl::shared_ptr<tcp::socket> socket(new tcp::socket(*service_));
         acceptor_.async_accept(
-            *socket, std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1));
+            *socket,
+            boost::asio::bind_executor(
+                strand_,
+                std::bind(&implementation::handle_accept, shared_from_this(), socket, std::placeholders::_1)));
     }
 
     void handle_accept(const spl::shared_ptr<tcp::socket>& socket, const boost::system::error_code& error)
@@ -330,7 +368,6 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
                 CASPAR_LOG(warning) << print() << L" Failed to enable TCP keep-alive on socket";
 
             auto conn = connection::create(service_, socket, protocol_factory_, connection_set_);
-            connection_set_->insert(conn);
 
             for (auto& lifecycle_factory : lifecycle_factories_) {
                 auto lifecycle_bound = lifecycle_factory(u8(conn->ipv4_address()));
@@ -348,7 +385,7 @@ struct AsyncEventServer::implementation : public spl::enable_shared_from_this<im
     void add_client_lifecycle_object_factory(const lifecycle_factory_t& factory)
     {
         auto self = shared_from_this();
-        service_->post([=] { self->lifecycle_factories_.push_back(factory); });
+        strand_.post([=] { self->lifecycle_factories_.push_back(factory); });
     }
 };
 
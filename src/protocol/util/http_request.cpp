@@ -1,105 +1,262 @@
 #include "http_request.h"
 
 #include <common/except.h>
+#include <common/os/thread.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+
 #include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace caspar { namespace http {
 
-HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
-{
-    using boost::asio::ip::tcp;
-    using namespace boost;
+namespace {
 
-    HTTPResponse res;
+using boost::asio::ip::tcp;
 
-    asio::io_service io_service;
+const int POOL_THREADS = 4;
 
-    // Get a list of endpoints corresponding to the server name.
-    tcp::resolver           resolver(io_service);
-    tcp::resolver::query    query(host, port, boost::asio::ip::resolver_query_base::numeric_service);
-    tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+// Requests are sent as HTTP/1.1 with keep-alive. A response is delimited by Content-Length or chunked encoding, and
+// its connection goes back to the pool unless the server asked to close it.
+class connection_pool
+{
+    boost::asio::io_service                        io_service_;
+    std::unique_ptr<boost::asio::io_service::work> work_;
+    std::vector<std::thread>                       threads_;
 
-    // Try each endpoint until we successfully establish a connection.
-    tcp::socket               socket(io_service);
-    boost::system::error_code error;
-    asio::connect(socket, endpoint_iterator, error);
-    if (error == asio::error::connection_refused) {
-        res.status_code    = 503;
-        res.status_message = "Connection refused";
-        return res;
-    }
-    if (error) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    std::mutex                                                        mutex_;
+    std::map<std::string, std::vector<std::shared_ptr<tcp::socket>>> idle_;
+
+  public:
+    connection_pool()
+        : work_(new boost::asio::io_service::work(io_service_))
+    {
+        for (int n = 0; n < POOL_THREADS; ++n) {
+            threads_.emplace_back([this] {
+                set_thread_name(L"[http::request]");
+                io_service_.run();
+            });
+        }
     }
 
-    // Form the request. We specify the "Connection: close" header so that the
-    // server will close the socket after transmitting the response. This will
-    // allow us to treat all data up until the EOF as the content.
-    asio::streambuf request;
-    std::ostream    request_stream(&request);
-    request_stream << "GET " << path << " HTTP/1.0\r\n";
-    request_stream << "Host: " << host << ":" << port << "\r\n";
-    request_stream << "Accept: */*\r\n";
-    request_stream << "Connection: close\r\n\r\n";
-
-    // Send the request.
-    asio::write(socket, request);
-
-    // Read the response status line. The response streambuf will automatically
-    // grow to accommodate the entire line. The growth may be limited by passing
-    // a maximum size to the streambuf constructor.
-    asio::streambuf response;
-    asio::read_until(socket, response, "\r\n");
-
-    // Check that response is OK.
-    std::istream response_stream(&response);
-    std::string  http_version;
-    response_stream >> http_version;
-    response_stream >> res.status_code;
-    std::getline(response_stream, res.status_message);
-
-    if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
-        // TODO
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+    ~connection_pool()
+    {
+        work_.reset();
+        io_service_.stop();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
     }
 
-    if (res.status_code < 200 || res.status_code >= 300) {
-        // TODO
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+    std::future<HTTPResponse> post(const std::string& host, const std::string& port, const std::string& path)
+    {
+        auto promise = std::make_shared<std::promise<HTTPResponse>>();
+        io_service_.post([=] {
+            try {
+                promise->set_value(execute(host, port, path));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return promise->get_future();
     }
 
-    // Read the response headers, which are terminated by a blank line.
-    asio::read_until(socket, response, "\r\n\r\n");
+  private:
+    HTTPResponse execute(const std::string& host, const std::string& port, const std::string& path)
+    {
+        const auto key = host + ":" + port;
 
-    // Process the response headers.
-    std::string header;
-    while (std::getline(response_stream, header) && header != "\r") {
-        // TODO
+        // An idle connection may have been closed by the server in the meantime, the request is then sent again on a
+        // new one.
+        while (true) {
+            auto socket = acquire(key);
+            if (!socket) {
+                HTTPResponse res;
+                socket = connect(host, port, res);
+                if (!socket) {
+                    return res;
+                }
+                return exchange(key, socket, host, port, path);
+            }
+
+            try {
+                return exchange(key, socket, host, port, path);
+            } catch (boost::system::system_error&) {
+                // Retry.
+            }
+        }
     }
 
-    std::stringstream body;
+    std::shared_ptr<tcp::socket> acquire(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto&                       sockets = idle_[key];
+        if (sockets.empty()) {
+            return nullptr;
+        }
+        auto socket = std::move(sockets.back());
+        sockets.pop_back();
+        return socket;
+    }
 
-    // Write whatever content we already have to output.
-    if (response.size() > 0) {
-        body << &response;
+    void release(const std::string& key, std::shared_ptr<tcp::socket> socket)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_[key].push_back(std::move(socket));
     }
 
-    // Read until EOF, writing data to output as we go.
-    while (asio::read(socket, response, asio::transfer_at_least(1), error)) {
-        body << &response;
+    std::shared_ptr<tcp::socket> connect(const std::string& host, const std::string& port, HTTPResponse& res)
+    {
+        // Get a list of endpoints corresponding to the server name.
+        tcp::resolver           resolver(io_service_);
+        tcp::resolver::query    query(host, port, boost::asio::ip::resolver_query_base::numeric_service);
+        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+
+        // Try each endpoint until we successfully establish a connection.
+        auto                      socket = std::make_shared<tcp::socket>(io_service_);
+        boost::system::error_code error;
+        boost::asio::connect(*socket, endpoint_iterator, error);
+        if (error == boost::asio::error::connection_refused) {
+            res.status_code    = 503;
+            res.status_message = "Connection refused";
+            return nullptr;
+        }
+        if (error) {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+        }
+        socket->set_option(tcp::no_delay(true));
+        return socket;
     }
 
-    if (error != asio::error::eof) {
-        CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+    HTTPResponse exchange(const std::string&           key,
+                          std::shared_ptr<tcp::socket> socket,
+                          const std::string&           host,
+                          const std::string&           port,
+                          const std::string&           path)
+    {
+        using namespace boost;
+
+        HTTPResponse res;
+
+        asio::streambuf request;
+        std::ostream    request_stream(&request);
+        request_stream << "GET " << path << " HTTP/1.1\r\n";
+        request_stream << "Host: " << host << ":" << port << "\r\n";
+        request_stream << "Accept: */*\r\n";
+        request_stream << "Connection: keep-alive\r\n\r\n";
+
+        asio::write(*socket, request);
+
+        // Read the response status line and headers, which are terminated by a blank line.
+        asio::streambuf response;
+        asio::read_until(*socket, response, "\r\n\r\n");
+
+        std::istream response_stream(&response);
+        std::string  http_version;
+        response_stream >> http_version;
+        response_stream >> res.status_code;
+        std::getline(response_stream, res.status_message);
+
+        if (!response_stream || http_version.substr(0, 5) != "HTTP/") {
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+        }
+
+        std::string header;
+        while (std::getline(response_stream, header) && header != "\r") {
+            const auto colon = header.find(':');
+            if (colon != std::string::npos) {
+                res.headers[algorithm::to_lower_copy(header.substr(0, colon))] =
+                    algorithm::trim_copy(header.substr(colon + 1));
+            }
+        }
+
+        const auto connection = algorithm::to_lower_copy(res.headers["connection"]);
+        auto       keep_alive = http_version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+        // Reads until at least count bytes are buffered.
+        auto fill = [&](std::size_t count) {
+            if (response.size() < count) {
+                asio::read(*socket, response, asio::transfer_exactly(count - response.size()));
+            }
+        };
+        auto take = [&](std::size_t count) {
+            fill(count);
+            std::string data(count, '\0');
+            response_stream.read(&data[0], count);
+            return data;
+        };
+
+        if (algorithm::iequals(res.headers["transfer-encoding"], "chunked")) {
+            while (true) {
+                asio::read_until(*socket, response, "\r\n");
+                std::string line;
+                std::getline(response_stream, line);
+                const auto size = std::stoul(line, nullptr, 16);
+                if (size == 0) {
+                    // Skip trailers up to the terminating blank line.
+                    do {
+                        asio::read_until(*socket, response, "\r\n");
+                        std::getline(response_stream, line);
+                    } while (line != "\r");
+                    break;
+                }
+                res.body += take(size);
+                take(2);
+            }
+        } else if (res.headers.count("content-length")) {
+            res.body = take(std::stoul(res.headers["content-length"]));
+        } else {
+            // Read until EOF, the connection can not be reused.
+            boost::system::error_code error;
+            while (asio::read(*socket, response, asio::transfer_at_least(1), error)) {
+            }
+            if (error != asio::error::eof) {
+                CASPAR_THROW_EXCEPTION(io_error() << msg_info(error.message()));
+            }
+            std::stringstream body;
+            if (response.size() > 0) {
+                body << &response;
+            }
+            res.body   = body.str();
+            keep_alive = false;
+        }
+
+        if (keep_alive) {
+            release(key, std::move(socket));
+        }
+
+        if (res.status_code < 200 || res.status_code >= 300) {
+            // TODO
+            CASPAR_THROW_EXCEPTION(io_error() << msg_info("Invalid Response"));
+        }
+
+        return res;
     }
+};
+
+connection_pool& get_connection_pool()
+{
+    static connection_pool pool;
+    return pool;
+}
 
-    res.body = body.str();
+} // namespace
 
-    return res;
+HTTPResponse request(const std::string& host, const std::string& port, const std::string& path)
+{
+    return request_async(host, port, path).get();
+}
+
+std::future<HTTPResponse> request_async(const std::string& host, const std::string& port, const std::string& path)
+{
+    return get_connection_pool().post(host, port, path);
 }
 
 std::string url_encode(const std::string& str)
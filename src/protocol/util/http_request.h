@@ -1,5 +1,6 @@
 #pragma once
 
+#include <future>
 #include <map>
 #include <string>
 
@@ -15,6 +16,10 @@ struct HTTPResponse
 
 HTTPResponse request(const std::string& host, const std::string& port, const std::string& path);
 
+// Sends the GET on a background thread. Connections are kept alive and pooled per server, so repeated queries skip
+// the connection setup.
+std::future<HTTPResponse> request_async(const std::string& host, const std::string& port, const std::string& path);
+
 std::string url_encode(const std::string& str);
 
 }} // namespace caspar::http
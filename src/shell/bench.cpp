@@ -0,0 +1,673 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures how many channels and layers a machine sustains, without devices or media. Channels are filled with
+// synthetic producers and run unpaced into a null consumer, the results are written as JSON:
+//
+//   casparcg-bench [config] [--format 1080i5000] [--channels 1] [--layers 8] [--producer moving]
+//                  [--frames 1000] [--warmup 50] [--pipeline-depth 1] [--output file]
+//
+// The producer is moving, a YUV pattern that changes every frame and is uploaded like decoded video, color, or the
+// parameters of a LOAD command such as "AMB LOOP" for image and ffmpeg producers. The configuration file,
+// casparcg.config by default, provides the paths and the accelerator as for the server.
+//
+//   casparcg-bench [config] --decode file [--decode file...] [--vf filter...] [--hwaccel type] [--frames 1000]
+//
+// Decodes each file with each video filter, none by default, as fast as the ffmpeg producer can, into frames in host
+// memory instead of a channel, up to frames per file. The format sets the frame rate and audio cadence. Decode,
+// filter and make_frame times and the threads of the decoders are reported.
+
+#include <accelerator/accelerator.h>
+
+#include <common/diagnostics/trace.h>
+#include <common/env.h>
+#include <common/except.h>
+#include <common/future.h>
+#include <common/log.h>
+#include <common/tweener.h>
+#include <common/utf.h>
+
+#include <core/consumer/frame_consumer.h>
+#include <core/consumer/output.h>
+#include <core/frame/draw_frame.h>
+#include <core/frame/frame.h>
+#include <core/frame/frame_factory.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/image_mixer.h>
+#include <core/module_dependencies.h>
+#include <core/monitor/monitor.h>
+#include <core/producer/cg_proxy.h>
+#include <core/producer/color/color_producer.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/media_scanner.h>
+#include <core/producer/stage.h>
+#include <core/video_channel.h>
+#include <core/video_format.h>
+
+#include <modules/ffmpeg/ffmpeg.h>
+#include <modules/ffmpeg/producer/av_producer.h>
+#include <modules/image/image.h>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace caspar {
+
+namespace {
+
+struct options
+{
+    std::wstring              config         = L"casparcg.config";
+    std::wstring              format         = L"1080p5000";
+    std::wstring              producer       = L"moving";
+    std::wstring              output;
+    std::vector<std::wstring> decode;
+    std::vector<std::wstring> filters;
+    std::wstring              hwaccel;
+    int                       channels       = 1;
+    int                       layers         = 8;
+    int                       frames         = 1000;
+    int                       warmup         = 50;
+    int                       pipeline_depth = 1;
+};
+
+options parse_options(int argc, char** argv)
+{
+    options result;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg = u16(argv[n]);
+        if (!boost::starts_with(arg, L"--")) {
+            result.config = arg;
+            continue;
+        }
+        if (n + 1 >= argc) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Missing value of " + arg));
+        }
+        auto value = u16(argv[++n]);
+        if (arg == L"--format") {
+            result.format = value;
+        } else if (arg == L"--producer") {
+            result.producer = value;
+        } else if (arg == L"--output") {
+            result.output = value;
+        } else if (arg == L"--decode") {
+            result.decode.push_back(value);
+        } else if (arg == L"--vf") {
+            result.filters.push_back(value);
+        } else if (arg == L"--hwaccel") {
+            result.hwaccel = value;
+        } else if (arg == L"--channels") {
+            result.channels = boost::lexical_cast<int>(value);
+        } else if (arg == L"--layers") {
+            result.layers = boost::lexical_cast<int>(value);
+        } else if (arg == L"--frames") {
+            result.frames = boost::lexical_cast<int>(value);
+        } else if (arg == L"--warmup") {
+            result.warmup = boost::lexical_cast<int>(value);
+        } else if (arg == L"--pipeline-depth") {
+            result.pipeline_depth = boost::lexical_cast<int>(value);
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown option " + arg));
+        }
+    }
+
+    if (result.channels < 1 || result.layers < 0 || result.frames < 1 || result.warmup < 0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channels, layers, frames or warmup"));
+    }
+    if (result.filters.empty()) {
+        result.filters.push_back(L"");
+    }
+    return result;
+}
+
+// A 4:2:2 YUV pattern moving a few pixels every frame, uploaded like decoded video since no two frames are the same.
+class moving_producer : public core::frame_producer
+{
+    spl::shared_ptr<core::frame_factory> frame_factory_;
+    core::pixel_format_desc              desc_{core::pixel_format::ycbcr};
+    std::vector<std::uint8_t>            gradient_;
+    int                                  offset_;
+
+  public:
+    moving_producer(spl::shared_ptr<core::frame_factory> frame_factory,
+                    const core::video_format_desc&       format_desc,
+                    int                                  index)
+        : frame_factory_(std::move(frame_factory))
+        , gradient_(static_cast<std::size_t>(format_desc.width) * 2)
+        , offset_(index * 37)
+    {
+        desc_.planes.push_back(core::pixel_format_desc::plane(format_desc.width, format_desc.height, 1));
+        desc_.planes.push_back(core::pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 1));
+        desc_.planes.push_back(core::pixel_format_desc::plane(format_desc.width / 2, format_desc.height, 1));
+
+        for (std::size_t n = 0; n < gradient_.size(); ++n) {
+            gradient_[n] = static_cast<std::uint8_t>(16 + (n * 219 / 256) % 220);
+        }
+    }
+
+    core::draw_frame receive_impl(int nb_samples) override
+    {
+        auto frame = frame_factory_->create_frame(this, desc_);
+
+        offset_ += 4;
+        for (std::size_t plane = 0; plane < desc_.planes.size(); ++plane) {
+            auto& p    = desc_.planes[plane];
+            auto  data = frame.image_data(plane).data();
+            for (int y = 0; y < p.height; ++y) {
+                auto start = static_cast<std::size_t>((offset_ + y) % p.width) * (plane == 0 ? 1 : 2);
+                std::memcpy(data + static_cast<std::size_t>(y) * p.linesize,
+                            gradient_.data() + start % (gradient_.size() - p.linesize),
+                            p.linesize);
+            }
+        }
+
+        return core::draw_frame(std::move(frame));
+    }
+
+    std::wstring print() const override { return L"moving[]"; }
+    std::wstring name() const override { return L"moving"; }
+};
+
+// Takes every frame at once, the channel has no clock and runs as fast as it can.
+class null_consumer : public core::frame_consumer
+{
+  public:
+    std::future<bool> send(core::const_frame frame) override { return make_ready_future(true); }
+    void              initialize(const core::video_format_desc& format_desc, int channel_index) override {}
+    std::wstring      print() const override { return L"null[]"; }
+    std::wstring      name() const override { return L"null"; }
+    int               index() const override { return 100000; }
+    bool              accepts_fields() const override { return true; }
+};
+
+// Frames in host memory, which are never uploaded.
+class null_frame_factory : public core::frame_factory
+{
+  public:
+    core::mutable_frame create_frame(const void* tag, const core::pixel_format_desc& desc) override
+    {
+        std::vector<array<std::uint8_t>> image_data;
+        for (auto& plane : desc.planes) {
+            image_data.emplace_back(plane.size);
+        }
+        return core::mutable_frame(tag, std::move(image_data), array<std::int32_t>{}, desc);
+    }
+};
+
+// Seconds of CPU time used by all threads of the process.
+double cpu_seconds()
+{
+#ifdef WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    auto to_seconds = [](const FILETIME& time) {
+        return static_cast<double>((static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) *
+               1e-7;
+    };
+    return to_seconds(kernel) + to_seconds(user);
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+struct as_number : public boost::static_visitor<double>
+{
+    template <typename T>
+    double operator()(const T& value) const
+    {
+        return static_cast<double>(value);
+    }
+    double operator()(const std::string&) const { return 0.0; }
+    double operator()(const std::wstring&) const { return 0.0; }
+};
+
+// Per channel, written on its thread by the tick callback.
+struct channel_counters
+{
+    std::mutex                    mutex;
+    std::int64_t                  ticks = 0;
+    std::map<std::string, double> mixer_ms; // Accumulated time of the image mixer, such as gpu-render-ms.
+};
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Durations of the traced stages since construction. The trace keeps a few seconds per thread, so its events are
+// gathered while running.
+class stage_times
+{
+    std::int64_t                               start_us_  = diagnostics::trace::now();
+    std::int64_t                               polled_us_ = start_us_;
+    std::map<std::string, std::vector<double>> stages_;
+
+  public:
+    void poll()
+    {
+        auto now_us = diagnostics::trace::now();
+        for (auto& e : diagnostics::trace::collect(static_cast<double>(now_us - polled_us_) * 1e-6 + 0.1)) {
+            if (e.end > polled_us_ && e.begin >= start_us_) {
+                stages_[e.name].push_back(static_cast<double>(e.end - e.begin) / 1000.0);
+            }
+        }
+        polled_us_ = now_us;
+    }
+
+    // Writes the percentiles of each stage as an object, with their total time per frame when frames is given.
+    void write(std::ostream& out, const std::string& indent, double frames = 0.0)
+    {
+        out << "{";
+        auto first = true;
+        for (auto& p : stages_) {
+            auto& values = p.second;
+            std::sort(values.begin(), values.end());
+            out << (first ? "\n" : ",\n") << indent << "  \"" << p.first << "\": {\"count\": " << values.size()
+                << ", \"p50\": " << percentile(values, 0.5) << ", \"p90\": " << percentile(values, 0.9)
+                << ", \"p99\": " << percentile(values, 0.99) << ", \"max\": " << values.back();
+            if (frames > 0.0) {
+                out << ", \"per_frame\": " << std::accumulate(values.begin(), values.end(), 0.0) / frames;
+            }
+            out << "}";
+            first = false;
+        }
+        out << "\n" << indent << "}";
+    }
+};
+
+spl::shared_ptr<core::frame_producer>
+create_producer(const options&                                           options,
+                const spl::shared_ptr<core::video_channel>&              channel,
+                const std::vector<spl::shared_ptr<core::video_channel>>& channels,
+                const core::module_dependencies&                         dependencies,
+                int                                                      layer)
+{
+    auto format_desc = channel->video_format_desc();
+
+    if (boost::iequals(options.producer, L"moving")) {
+        return spl::make_shared<moving_producer>(channel->frame_factory(), format_desc, layer);
+    }
+    if (boost::iequals(options.producer, L"color")) {
+        // A colour per layer, the same one would let the mixer reuse the whole frame.
+        return core::create_color_producer(channel->frame_factory(),
+                                           0xFF000000u | static_cast<std::uint32_t>(layer * 0x10305));
+    }
+
+    core::frame_producer_dependencies producer_dependencies(
+        channel->frame_factory(), channels, format_desc, dependencies.producer_registry, dependencies.cg_registry);
+    producer_dependencies.latency = channel->latency();
+    producer_dependencies.offline = channel->offline();
+
+    auto producer = dependencies.producer_registry->create_producer(producer_dependencies, options.producer);
+    if (producer == core::frame_producer::empty()) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"No producer for " + options.producer));
+    }
+    return producer;
+}
+
+std::string escape(const std::wstring& str)
+{
+    return u8(boost::replace_all_copy(boost::replace_all_copy(str, L"\\", L"\\\\"), L"\"", L"\\\""));
+}
+
+std::string run(const options& options)
+{
+    accelerator::accelerator accelerator(env::properties().get(L"configuration.accelerator", L"auto"));
+
+    core::module_dependencies dependencies(spl::make_shared<core::cg_producer_registry>(),
+                                           spl::make_shared<core::frame_producer_registry>(),
+                                           spl::make_shared<core::frame_consumer_registry>(),
+                                           spl::make_shared<core::media_scanner_registry>());
+    ffmpeg::init(dependencies);
+    image::init(dependencies);
+
+    auto format_desc = core::video_format_desc(options.format);
+    if (format_desc.format == core::video_format::invalid) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid format: " + options.format));
+    }
+
+    std::vector<std::unique_ptr<channel_counters>>    counters;
+    std::vector<spl::shared_ptr<core::video_channel>> channels;
+    for (int n = 1; n <= options.channels; ++n) {
+        counters.push_back(std::make_unique<channel_counters>());
+        auto& counter = *counters.back();
+        channels.push_back(spl::make_shared<core::video_channel>(
+            n,
+            format_desc,
+            accelerator.create_image_mixer(n),
+            [&counter](core::monitor::state state) {
+                std::lock_guard<std::mutex> lock(counter.mutex);
+                counter.ticks += 1;
+                for (auto& p : state) {
+                    if (boost::starts_with(p.first, "mixer/image/") && boost::ends_with(p.first, "-ms") &&
+                        !p.second.empty()) {
+                        counter.mixer_ms[p.first.substr(12)] += boost::apply_visitor(as_number(), p.second[0]);
+                    }
+                }
+            },
+            options.pipeline_depth,
+            false,
+            2,
+            -2));
+    }
+
+    for (auto& channel : channels) {
+        channel->output().add(spl::make_shared<null_consumer>());
+        for (int layer = 1; layer <= options.layers; ++layer) {
+            channel->stage().load(layer, create_producer(options, channel, channels, dependencies, layer)).get();
+            channel->stage().play(layer).get();
+
+            // Slightly translucent, so that no layer hides those below and all of them are drawn.
+            channel->stage()
+                .apply_transform(
+                    layer,
+                    [](core::frame_transform transform) {
+                        transform.image_transform.opacity = 0.9;
+                        return transform;
+                    },
+                    0,
+                    tweener(L"linear"))
+                .get();
+        }
+    }
+
+    auto ticks = [&] {
+        std::vector<std::int64_t> result;
+        for (auto& counter : counters) {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            result.push_back(counter->ticks);
+        }
+        return result;
+    };
+    // Frames done by the channel that has done the fewest since the given counts.
+    auto slowest = [&](const std::vector<std::int64_t>& since) {
+        auto         t      = ticks();
+        std::int64_t result = t[0] - since[0];
+        for (std::size_t n = 1; n < t.size(); ++n) {
+            result = std::min(result, t[n] - since[n]);
+        }
+        return result;
+    };
+    auto mixer_ms = [&] {
+        std::map<std::string, double> result;
+        for (auto& counter : counters) {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            for (auto& p : counter->mixer_ms) {
+                result[p.first] += p.second;
+            }
+        }
+        return result;
+    };
+
+    while (slowest(std::vector<std::int64_t>(counters.size(), 0)) < options.warmup) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    const auto  start_ticks    = ticks();
+    const auto  start_mixer_ms = mixer_ms();
+    const auto  start_cpu      = cpu_seconds();
+    const auto  start          = std::chrono::steady_clock::now();
+    stage_times stages;
+
+    while (slowest(start_ticks) < options.frames) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        stages.poll();
+    }
+    stages.poll();
+
+    const auto seconds      = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const auto cpu          = cpu_seconds() - start_cpu;
+    const auto end_ticks    = ticks();
+    const auto end_mixer_ms = mixer_ms();
+
+    for (auto& channel : channels) {
+        channel->stage().clear().get();
+    }
+    channels.clear();
+
+    image::uninit();
+    ffmpeg::uninit();
+
+    std::ostringstream out;
+    out.precision(4);
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"format\": \"" << u8(format_desc.name) << "\",\n";
+    out << "  \"producer\": \"" << escape(options.producer) << "\",\n";
+    out << "  \"channels\": " << options.channels << ",\n";
+    out << "  \"layers\": " << options.layers << ",\n";
+    out << "  \"seconds\": " << seconds << ",\n";
+
+    // Realtime is the slowest channel's rate against the rate of the format, 1 or more sustains it.
+    double total_fps = 0.0;
+    double min_fps   = 0.0;
+    out << "  \"channel_fps\": [";
+    for (std::size_t n = 0; n < end_ticks.size(); ++n) {
+        auto fps = static_cast<double>(end_ticks[n] - start_ticks[n]) / seconds;
+        total_fps += fps;
+        min_fps = n == 0 ? fps : std::min(min_fps, fps);
+        out << (n == 0 ? "" : ", ") << fps;
+    }
+    out << "],\n";
+    out << "  \"fps\": " << total_fps << ",\n";
+    out << "  \"realtime\": " << min_fps / format_desc.fps << ",\n";
+
+    out << "  \"stages_ms\": ";
+    stages.write(out, "  ");
+    out << ",\n";
+
+    // Utilisation of the whole machine, and of the mixer devices as the time they were busy per second.
+    const auto cores = std::max(1u, std::thread::hardware_concurrency());
+    out << "  \"cpu\": {\"cores\": " << cores << ", \"seconds\": " << cpu
+        << ", \"utilisation\": " << cpu / seconds / cores << "},\n";
+
+    out << "  \"mixer_ms_per_frame\": {";
+    auto   first   = true;
+    double busy_ms = 0.0;
+    double frames  = 0.0;
+    for (std::size_t n = 0; n < end_ticks.size(); ++n) {
+        frames += static_cast<double>(end_ticks[n] - start_ticks[n]);
+    }
+    for (auto& p : end_mixer_ms) {
+        auto it = start_mixer_ms.find(p.first);
+        auto ms = p.second - (it != start_mixer_ms.end() ? it->second : 0.0);
+        busy_ms += ms;
+        out << (first ? "" : ", ") << "\"" << p.first << "\": " << ms / std::max(1.0, frames);
+        first = false;
+    }
+    out << "},\n";
+    out << "  \"mixer_utilisation\": " << busy_ms / (seconds * 1000.0) << "\n";
+    out << "}\n";
+
+    return out.str();
+}
+
+// Decodes every file with every filter, frames are pulled as soon as the producer has them.
+std::string run_decode(const options& options)
+{
+    core::module_dependencies dependencies(spl::make_shared<core::cg_producer_registry>(),
+                                           spl::make_shared<core::frame_producer_registry>(),
+                                           spl::make_shared<core::frame_consumer_registry>(),
+                                           spl::make_shared<core::media_scanner_registry>());
+    ffmpeg::init(dependencies);
+
+    auto format_desc = core::video_format_desc(options.format);
+    if (format_desc.format == core::video_format::invalid) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid format: " + options.format));
+    }
+
+    auto frame_factory = std::make_shared<null_frame_factory>();
+
+    std::ostringstream out;
+    out.precision(4);
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"format\": \"" << u8(format_desc.name) << "\",\n";
+    out << "  \"runs\": [";
+
+    auto first = true;
+    for (auto& path : options.decode) {
+        for (auto& filter : options.filters) {
+            ffmpeg::AVProducer producer(frame_factory,
+                                        format_desc,
+                                        u8(path),
+                                        u8(path),
+                                        filter.empty() ? boost::none : boost::optional<std::string>(u8(filter)),
+                                        boost::none,
+                                        boost::none,
+                                        boost::none,
+                                        false,
+                                        options.hwaccel.empty() ? boost::none
+                                                                : boost::optional<std::string>(u8(options.hwaccel)));
+
+            const auto  start_cpu = cpu_seconds();
+            const auto  start     = std::chrono::steady_clock::now();
+            auto        polled    = start;
+            stage_times stages;
+
+            // At the end the producer repeats its last frame, whose time then no longer changes.
+            std::int64_t frames = 0;
+            std::int64_t time   = -1;
+            while (frames < options.frames || options.frames == 0) {
+                auto frame = producer.next_frame();
+                if (!frame) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                } else if (producer.time() == time) {
+                    break;
+                } else {
+                    time = producer.time();
+                    frames += 1;
+                }
+                if (std::chrono::steady_clock::now() - polled > std::chrono::milliseconds(200)) {
+                    polled = std::chrono::steady_clock::now();
+                    stages.poll();
+                }
+            }
+            stages.poll();
+
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            const auto cpu     = cpu_seconds() - start_cpu;
+
+            out << (first ? "\n" : ",\n") << "    {\n";
+            out << "      \"file\": \"" << escape(path) << "\",\n";
+            out << "      \"filter\": \"" << escape(filter) << "\",\n";
+            out << "      \"frames\": " << frames << ",\n";
+            out << "      \"seconds\": " << seconds << ",\n";
+            out << "      \"fps\": " << static_cast<double>(frames) / seconds << ",\n";
+            out << "      \"cpu_cores_used\": " << cpu / seconds << ",\n";
+
+            // Codec, size and decoder threads of each stream, as the producer reports them.
+            out << "      \"streams\": {";
+            auto first_value = true;
+            for (auto& p : producer.state()) {
+                if (!boost::starts_with(p.first, "file/streams/") ||
+                    !(boost::ends_with(p.first, "/codec") || boost::ends_with(p.first, "/size") ||
+                      boost::ends_with(p.first, "/threads"))) {
+                    continue;
+                }
+                out << (first_value ? "" : ", ") << "\"" << p.first.substr(13) << "\": [";
+                for (std::size_t n = 0; n < p.second.size(); ++n) {
+                    out << (n == 0 ? "" : ", ");
+                    if (auto str = boost::get<std::string>(&p.second[n])) {
+                        out << "\"" << *str << "\"";
+                    } else {
+                        out << boost::apply_visitor(as_number(), p.second[n]);
+                    }
+                }
+                out << "]";
+                first_value = false;
+            }
+            out << "},\n";
+
+            out << "      \"stages_ms\": ";
+            stages.write(out, "      ", static_cast<double>(frames));
+            out << "\n    }";
+            first = false;
+        }
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+
+    ffmpeg::uninit();
+
+    return out.str();
+}
+
+} // namespace
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    tbb::task_scheduler_init init;
+
+    try {
+        auto options = parse_options(argc, argv);
+
+        env::configure(options.config);
+        log::set_log_level(L"warning");
+        log::add_file_sink(env::log_folder() + L"casparcg-bench");
+
+        auto result = options.decode.empty() ? run(options) : run_decode(options);
+        if (options.output.empty()) {
+            std::cout << result;
+        } else {
+            boost::filesystem::ofstream file(boost::filesystem::path(options.output));
+            file << result;
+        }
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        std::wcerr << L"casparcg-bench failed, see the log for details." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Times the BGRA conversions of common/pixel_convert on a frame of a video format:
+//
+//   casparcg-convert-bench [--format 1080p5000] [--frames 200] [--warmup 10] [--conversion name] [--output file]
+//
+// Conversions are uyvy, v210, pgroup, nv12, yuv420p, alpha and key, all of them by default. The source is a gradient
+// with varying alpha, converted over and over into the same buffers.
+
+#include <common/except.h>
+#include <common/log.h>
+#include <common/pixel_convert.h>
+#include <common/utf.h>
+
+#include <core/video_format.h>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace caspar {
+
+namespace {
+
+struct options
+{
+    std::wstring              format = L"1080p5000";
+    std::wstring              output;
+    std::vector<std::wstring> conversions;
+    int                       frames = 200;
+    int                       warmup = 10;
+};
+
+const std::vector<std::wstring> all_conversions =
+    {L"uyvy", L"v210", L"pgroup", L"nv12", L"yuv420p", L"alpha", L"key"};
+
+options parse_options(int argc, char** argv)
+{
+    options result;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg = u16(argv[n]);
+        if (n + 1 >= argc) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Missing value of " + arg));
+        }
+        auto value = u16(argv[++n]);
+        if (arg == L"--format") {
+            result.format = value;
+        } else if (arg == L"--output") {
+            result.output = value;
+        } else if (arg == L"--conversion") {
+            if (std::find(all_conversions.begin(), all_conversions.end(), value) == all_conversions.end()) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown conversion " + value));
+            }
+            result.conversions.push_back(value);
+        } else if (arg == L"--frames") {
+            result.frames = boost::lexical_cast<int>(value);
+        } else if (arg == L"--warmup") {
+            result.warmup = boost::lexical_cast<int>(value);
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown option " + arg));
+        }
+    }
+
+    if (result.conversions.empty()) {
+        result.conversions = all_conversions;
+    }
+    if (result.frames < 1 || result.warmup < 0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid frames or warmup"));
+    }
+    return result;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// Returns the conversion of the source into buffers sized for the format.
+std::function<void()> create_conversion(const std::wstring&              name,
+                                        const std::vector<std::uint8_t>& source,
+                                        int                              width,
+                                        int                              height,
+                                        std::vector<std::uint8_t>&       y,
+                                        std::vector<std::uint8_t>&       cb,
+                                        std::vector<std::uint8_t>&       cr)
+{
+    const auto src      = source.data();
+    const auto linesize = static_cast<std::size_t>(width) * 4;
+    const auto matrix   = height > 700 ? convert::ycbcr_matrix::bt709 : convert::ycbcr_matrix::bt601;
+    const auto half     = static_cast<std::size_t>((width + 1) / 2);
+    const auto rows     = static_cast<std::size_t>((height + 1) / 2);
+
+    if (name == L"uyvy") {
+        y.resize(half * 4 * height);
+        return [=, &y] { convert::bgra_to_uyvy(src, linesize, width, height, y.data(), half * 4, matrix); };
+    }
+    if (name == L"v210") {
+        const auto v210_linesize = static_cast<std::size_t>((width + 47) / 48) * 128;
+        y.resize(v210_linesize * height);
+        return [=, &y] { convert::bgra_to_v210(src, linesize, width, height, y.data(), v210_linesize, matrix); };
+    }
+    if (name == L"pgroup") {
+        y.resize(half * 5 * height);
+        return [=, &y] { convert::bgra_to_pgroup(src, linesize, width, height, y.data(), half * 5, matrix); };
+    }
+    if (name == L"nv12") {
+        y.resize(static_cast<std::size_t>(width) * height);
+        cb.resize(half * 2 * rows);
+        return [=, &y, &cb] {
+            convert::bgra_to_nv12(src, linesize, width, height, y.data(), width, cb.data(), half * 2, matrix);
+        };
+    }
+    if (name == L"yuv420p") {
+        y.resize(static_cast<std::size_t>(width) * height);
+        cb.resize(half * rows);
+        cr.resize(half * rows);
+        return [=, &y, &cb, &cr] {
+            convert::bgra_to_yuv420p(
+                src, linesize, width, height, y.data(), width, cb.data(), half, cr.data(), half, matrix);
+        };
+    }
+    if (name == L"alpha") {
+        y.resize(static_cast<std::size_t>(width) * height);
+        return [=, &y] { convert::bgra_to_alpha(src, linesize, width, height, y.data(), width); };
+    }
+    y.resize(linesize * height);
+    return [=, &y] { convert::bgra_to_key(src, linesize, width, height, y.data(), linesize); };
+}
+
+void run_conversion(const options&                   options,
+                    const std::wstring&              name,
+                    const std::vector<std::uint8_t>& source,
+                    const core::video_format_desc&   format,
+                    std::ostream&                    out)
+{
+    std::vector<std::uint8_t> y, cb, cr;
+    auto                      conversion = create_conversion(name, source, format.width, format.height, y, cb, cr);
+
+    std::vector<double> wall_ms;
+    for (int frame = 0; frame < options.warmup + options.frames; ++frame) {
+        const auto start = std::chrono::steady_clock::now();
+        conversion();
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        if (frame >= options.warmup) {
+            wall_ms.push_back(elapsed.count());
+        }
+    }
+
+    std::sort(wall_ms.begin(), wall_ms.end());
+
+    out << "    \"" << u8(name) << "\": {\"frames\": " << wall_ms.size()
+        << ", \"ms\": {\"p50\": " << percentile(wall_ms, 0.5) << ", \"p90\": " << percentile(wall_ms, 0.9)
+        << ", \"p99\": " << percentile(wall_ms, 0.99) << ", \"max\": " << wall_ms.back() << "}}";
+}
+
+std::string run(const options& options)
+{
+    auto format = core::video_format_desc(options.format);
+    if (format.format == core::video_format::invalid) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid format: " + options.format));
+    }
+
+    std::vector<std::uint8_t> source(static_cast<std::size_t>(format.width) * format.height * 4);
+    for (int y = 0; y < format.height; ++y) {
+        for (int x = 0; x < format.width; ++x) {
+            auto pixel = source.data() + (static_cast<std::size_t>(y) * format.width + x) * 4;
+            pixel[0]   = static_cast<std::uint8_t>(x);
+            pixel[1]   = static_cast<std::uint8_t>(y);
+            pixel[2]   = static_cast<std::uint8_t>(x + y);
+            pixel[3]   = static_cast<std::uint8_t>(x * 255 / format.width);
+        }
+    }
+
+    std::ostringstream out;
+    out.precision(4);
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"format\": \"" << u8(format.name) << "\",\n";
+    out << "  \"conversions\": {\n";
+    for (std::size_t n = 0; n < options.conversions.size(); ++n) {
+        run_conversion(options, options.conversions[n], source, format, out);
+        out << (n + 1 < options.conversions.size() ? ",\n" : "\n");
+    }
+    out << "  }\n";
+    out << "}\n";
+
+    return out.str();
+}
+
+} // namespace
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        auto options = parse_options(argc, argv);
+
+        log::set_log_level(L"warning");
+
+        auto result = run(options);
+        if (options.output.empty()) {
+            std::cout << result;
+        } else {
+            boost::filesystem::ofstream file(boost::filesystem::path(options.output));
+            file << result;
+        }
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        std::wcerr << L"casparcg-convert-bench failed." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -42,6 +42,8 @@
 #include <common/env.h>
 #include <common/except.h>
 #include <common/log.h>
+#include <common/os/memory.h>
+#include <common/os/thread.h>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
@@ -174,6 +176,7 @@ void terminate_handler()
     } catch (...) {
         CASPAR_LOG_CURRENT_EXCEPTION();
     }
+    log::flush();
     std::abort();
 }
 
@@ -244,6 +247,13 @@ int main(int argc, char** argv)
         // Once logging to file, log configuration warnings.
         env::log_configuration_warnings();
 
+        // Pin and prioritise threads by name, including TBB's workers.
+        configure_threads(env::properties());
+        auto tbb_workers = observe_tbb_workers();
+
+        // Huge pages and locking for frame sized buffers.
+        configure_memory(env::properties());
+
         // Setup console window.
         setup_console_window();
 
@@ -274,5 +284,7 @@ int main(int argc, char** argv)
         std::this_thread::sleep_for(std::chrono::milliseconds(4000));
     }
 
+    log::flush();
+
     return return_code;
 }
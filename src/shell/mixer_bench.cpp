@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Times the OpenGL image mixer on typical compositions, to compare changes to the kernel, shaders and renderer:
+//
+//   casparcg-mixer-bench [config] [--format 1080p5000] [--layers 8] [--frames 500] [--warmup 20]
+//                        [--scene name] [--upload] [--output file]
+//
+// Scenes are yuv420 (fullscreen 4:2:0 video), graphics (small BGRA items), blend (a stack of blend modes), keyed
+// (key and fill pairs) and chroma (chroma keyed video), all of them by default. Frames are uploaded once and only
+// composited, unless --upload creates new frames every time. GPU times come from the mixer's timer queries, the
+// configuration file, casparcg.config by default, provides the OpenGL settings as for the server.
+
+#include <accelerator/ogl/image/image_mixer.h>
+#include <accelerator/ogl/util/device.h>
+
+#include <common/env.h>
+#include <common/except.h>
+#include <common/log.h>
+#include <common/utf.h>
+
+#include <core/frame/frame.h>
+#include <core/frame/frame_transform.h>
+#include <core/frame/pixel_format.h>
+#include <core/mixer/image/blend_modes.h>
+#include <core/video_format.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace caspar {
+
+namespace {
+
+struct options
+{
+    std::wstring              config = L"casparcg.config";
+    std::wstring              format = L"1080p5000";
+    std::wstring              output;
+    std::vector<std::wstring> scenes;
+    int                       layers = 8;
+    int                       frames = 500;
+    int                       warmup = 20;
+    bool                      upload = false;
+};
+
+const std::vector<std::wstring> all_scenes = {L"yuv420", L"graphics", L"blend", L"keyed", L"chroma"};
+
+options parse_options(int argc, char** argv)
+{
+    options result;
+
+    for (int n = 1; n < argc; ++n) {
+        auto arg = u16(argv[n]);
+        if (!boost::starts_with(arg, L"--")) {
+            result.config = arg;
+            continue;
+        }
+        if (arg == L"--upload") {
+            result.upload = true;
+            continue;
+        }
+        if (n + 1 >= argc) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Missing value of " + arg));
+        }
+        auto value = u16(argv[++n]);
+        if (arg == L"--format") {
+            result.format = value;
+        } else if (arg == L"--output") {
+            result.output = value;
+        } else if (arg == L"--scene") {
+            if (std::find(all_scenes.begin(), all_scenes.end(), value) == all_scenes.end()) {
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown scene " + value));
+            }
+            result.scenes.push_back(value);
+        } else if (arg == L"--layers") {
+            result.layers = boost::lexical_cast<int>(value);
+        } else if (arg == L"--frames") {
+            result.frames = boost::lexical_cast<int>(value);
+        } else if (arg == L"--warmup") {
+            result.warmup = boost::lexical_cast<int>(value);
+        } else {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Unknown option " + arg));
+        }
+    }
+
+    if (result.scenes.empty()) {
+        result.scenes = all_scenes;
+    }
+    if (result.layers < 1 || result.frames < 1 || result.warmup < 0) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid layers, frames or warmup"));
+    }
+    return result;
+}
+
+// An item of a composition, the frame is created by the mixer being measured.
+struct item
+{
+    core::pixel_format_desc desc;
+    core::frame_transform   transform;
+    std::uint8_t            fill = 0;
+};
+
+core::pixel_format_desc yuv420_desc(int width, int height)
+{
+    core::pixel_format_desc desc(core::pixel_format::ycbcr);
+    desc.planes.push_back(core::pixel_format_desc::plane(width, height, 1));
+    desc.planes.push_back(core::pixel_format_desc::plane(width / 2, height / 2, 1));
+    desc.planes.push_back(core::pixel_format_desc::plane(width / 2, height / 2, 1));
+    return desc;
+}
+
+core::pixel_format_desc bgra_desc(int width, int height)
+{
+    core::pixel_format_desc desc(core::pixel_format::bgra);
+    desc.planes.push_back(core::pixel_format_desc::plane(width, height, 4));
+    return desc;
+}
+
+// The layers of a scene, each a list of items drawn in order. Fullscreen items are slightly translucent, the mixer
+// would otherwise skip everything below the topmost one.
+std::vector<std::vector<item>> create_scene(const std::wstring& name, const core::video_format_desc& format, int layers)
+{
+    std::vector<std::vector<item>> result;
+
+    for (int n = 0; n < layers; ++n) {
+        item video;
+        video.desc                              = yuv420_desc(format.width, format.height);
+        video.transform.image_transform.opacity = 0.9;
+        video.fill                              = static_cast<std::uint8_t>(40 + n * 20);
+
+        if (name == L"yuv420") {
+            result.push_back({video});
+        } else if (name == L"graphics") {
+            // Lower thirds and bugs, an eighth of the screen each, spread over it.
+            item graphic;
+            graphic.desc                                       = bgra_desc(format.width / 4, format.height / 8);
+            graphic.transform.image_transform.fill_scale       = {0.25, 0.125};
+            graphic.transform.image_transform.fill_translation = {0.25 * (n % 4), 0.125 * (n / 4 % 8)};
+            graphic.fill                                       = static_cast<std::uint8_t>(128 + n);
+            result.push_back({graphic});
+        } else if (name == L"blend") {
+            // Normal at the bottom, the modes above cycle through those that need the layers below.
+            video.transform.image_transform.blend_mode =
+                n == 0 ? core::blend_mode::normal
+                       : static_cast<core::blend_mode>(1 + (n - 1) % (static_cast<int>(core::blend_mode::mix) - 1));
+            result.push_back({video});
+        } else if (name == L"keyed") {
+            item key                             = video;
+            key.transform.image_transform.is_key = true;
+            key.desc                             = bgra_desc(format.width, format.height);
+            key.fill                             = 200;
+            result.push_back({key, video});
+        } else if (name == L"chroma") {
+            auto& chroma          = video.transform.image_transform.chroma;
+            chroma.enable         = true;
+            chroma.target_hue     = 120.0;
+            chroma.hue_width      = 0.1;
+            chroma.min_saturation = 0.2;
+            chroma.min_brightness = 0.1;
+            chroma.softness       = 0.1;
+            chroma.spill_suppress = 10.0;
+            result.push_back({video});
+        }
+    }
+
+    return result;
+}
+
+core::const_frame create_frame(accelerator::ogl::image_mixer& mixer, const item& item, const void* tag)
+{
+    auto frame = mixer.create_frame(tag, item.desc);
+    for (std::size_t n = 0; n < item.desc.planes.size(); ++n) {
+        std::memset(frame.image_data(n).data(), n == 0 ? item.fill : 128, frame.image_data(n).size());
+    }
+    return core::const_frame(std::move(frame));
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    auto index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+double state_ms(const core::monitor::state& state, const std::string& key)
+{
+    for (auto& p : state) {
+        if (p.first == key && !p.second.empty()) {
+            return boost::get<double>(p.second[0]);
+        }
+    }
+    return 0.0;
+}
+
+void run_scene(const options&                                    options,
+               const std::wstring&                               name,
+               const spl::shared_ptr<accelerator::ogl::device>& device,
+               const core::video_format_desc&                    format,
+               std::ostream&                                     out)
+{
+    accelerator::ogl::image_mixer mixer(device, 1);
+
+    const auto scene   = create_scene(name, format, options.layers);
+    const auto outputs = std::vector<core::pixel_format_desc>{bgra_desc(format.width, format.height)};
+
+    std::vector<std::vector<core::const_frame>> frames;
+    auto                                        create_frames = [&] {
+        frames.clear();
+        for (auto& layer : scene) {
+            frames.emplace_back();
+            for (auto& item : layer) {
+                frames.back().push_back(create_frame(mixer, item, &item));
+            }
+        }
+    };
+    create_frames();
+
+    std::vector<double> wall_ms;
+    double              render_ms   = 0.0;
+    double              upload_ms   = 0.0;
+    double              readback_ms = 0.0;
+
+    for (int frame = 0; frame < options.warmup + options.frames; ++frame) {
+        if (options.upload) {
+            create_frames();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (std::size_t layer = 0; layer < scene.size(); ++layer) {
+            for (std::size_t n = 0; n < scene[layer].size(); ++n) {
+                // Moved by a fraction of a pixel every other frame, so that the mixer does not reuse its output.
+                auto transform                        = scene[layer][n].transform;
+                transform.image_transform.layer_depth = 1;
+                transform.image_transform.fill_translation[0] += (frame % 2) * 1e-6;
+                mixer.push(transform);
+                mixer.visit(frames[layer][n]);
+                mixer.pop();
+            }
+        }
+        mixer(format, outputs).get();
+
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+        // The timer queries publish the time of frames that have finished on the GPU, a frame or two later.
+        auto state = mixer.state();
+        if (frame >= options.warmup) {
+            wall_ms.push_back(elapsed.count());
+            render_ms += state_ms(state, "gpu-render-ms");
+            upload_ms += state_ms(state, "gpu-upload-ms");
+            readback_ms += state_ms(state, "gpu-readback-ms");
+        }
+    }
+
+    std::sort(wall_ms.begin(), wall_ms.end());
+    const auto count = static_cast<double>(wall_ms.size());
+
+    out << "    \"" << u8(name) << "\": {\"frames\": " << wall_ms.size()
+        << ", \"ms\": {\"p50\": " << percentile(wall_ms, 0.5) << ", \"p90\": " << percentile(wall_ms, 0.9)
+        << ", \"p99\": " << percentile(wall_ms, 0.99) << ", \"max\": " << wall_ms.back()
+        << "}, \"gpu_ms\": {\"render\": " << render_ms / count
+        << ", \"upload\": " << upload_ms / count << ", \"readback\": " << readback_ms / count << "}}";
+}
+
+std::string run(const options& options)
+{
+    auto format = core::video_format_desc(options.format);
+    if (format.format == core::video_format::invalid) {
+        CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid format: " + options.format));
+    }
+
+    auto platform = env::properties().get(L"configuration.accelerator", std::wstring(L"auto"));
+    auto device   = spl::make_shared<accelerator::ogl::device>(platform == L"cpu" ? L"auto" : platform);
+
+    std::ostringstream out;
+    out.precision(4);
+    out << std::fixed;
+    out << "{\n";
+    out << "  \"format\": \"" << u8(format.name) << "\",\n";
+    out << "  \"layers\": " << options.layers << ",\n";
+    out << "  \"upload\": " << (options.upload ? "true" : "false") << ",\n";
+    out << "  \"scenes\": {\n";
+    for (std::size_t n = 0; n < options.scenes.size(); ++n) {
+        run_scene(options, options.scenes[n], device, format, out);
+        out << (n + 1 < options.scenes.size() ? ",\n" : "\n");
+    }
+    out << "  }\n";
+    out << "}\n";
+
+    return out.str();
+}
+
+} // namespace
+
+} // namespace caspar
+
+int main(int argc, char** argv)
+{
+    using namespace caspar;
+
+    try {
+        auto options = parse_options(argc, argv);
+
+        env::configure(options.config);
+        log::set_log_level(L"warning");
+        log::add_file_sink(env::log_folder() + L"casparcg-mixer-bench");
+
+        auto result = run(options);
+        if (options.output.empty()) {
+            std::cout << result;
+        } else {
+            boost::filesystem::ofstream file(boost::filesystem::path(options.output));
+            file << result;
+        }
+    } catch (...) {
+        CASPAR_LOG_CURRENT_EXCEPTION();
+        std::wcerr << L"casparcg-mixer-bench failed, see the log for details." << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2011 Sveriges Television AB <info@casparcg.com>
+ *
+ * This file is part of CasparCG (www.casparcg.com).
+ *
+ * CasparCG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * CasparCG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Replays commands recorded by a server with amcp.record set against another server, for load tests that reproduce
+// what automation sent:
+//
+//   casparcg-replay recording [--host localhost] [--port 5250] [--speed 1]
+//
+// Each recorded connection is replayed on a connection of its own, opened when its first command is due, so commands
+// keep their order and queue as they did. Commands are sent at their recorded times divided by speed, 0 sends them as
+// fast as the server reads them. Replies are read, replies with an error code are printed, and a summary per
+// connection is written at the end. Run the target with the configuration and media of the recording, and
+// casparcg-bench or the metrics endpoint to measure it.
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using boost::asio::ip::tcp;
+using replay_clock = std::chrono::steady_clock;
+
+struct options
+{
+    std::string recording;
+    std::string host  = "localhost";
+    std::string port  = "5250";
+    double      speed = 1.0;
+};
+
+struct command
+{
+    std::int64_t time; // Milliseconds from the start of the recording.
+    std::string  message;
+};
+
+struct connection
+{
+    std::string               address; // Of the recorded client.
+    std::vector<command>      commands;
+    std::atomic<std::int64_t> replies{0};
+    std::atomic<std::int64_t> errors{0};
+    std::int64_t              max_lag = 0; // Milliseconds a command was sent after it was due.
+};
+
+options parse_options(int argc, char** argv)
+{
+    options result;
+
+    for (int n = 1; n < argc; ++n) {
+        std::string arg = argv[n];
+        if (!boost::starts_with(arg, "--")) {
+            result.recording = arg;
+            continue;
+        }
+        if (n + 1 >= argc) {
+            throw std::runtime_error("Missing value of " + arg);
+        }
+        std::string value = argv[++n];
+        if (arg == "--host") {
+            result.host = value;
+        } else if (arg == "--port") {
+            result.port = value;
+        } else if (arg == "--speed") {
+            result.speed = boost::lexical_cast<double>(value);
+        } else {
+            throw std::runtime_error("Unknown option " + arg);
+        }
+    }
+
+    if (result.recording.empty() || result.speed < 0.0) {
+        throw std::runtime_error("Usage: casparcg-replay recording [--host localhost] [--port 5250] [--speed 1]");
+    }
+    return result;
+}
+
+// Lines of milliseconds, connection, client address and message, separated by tabs.
+std::map<int, std::unique_ptr<connection>> read_recording(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    std::map<int, std::unique_ptr<connection>> result;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        boost::split(fields, line, boost::is_any_of("\t"));
+        if (fields.size() < 4) {
+            continue;
+        }
+        // The message may itself hold tabs.
+        auto message = line.substr(fields[0].size() + fields[1].size() + fields[2].size() + 3);
+
+        auto& conn = result[boost::lexical_cast<int>(fields[1])];
+        if (!conn) {
+            conn          = std::make_unique<connection>();
+            conn->address = fields[2];
+        }
+        conn->commands.push_back(command{boost::lexical_cast<std::int64_t>(fields[0]), std::move(message)});
+    }
+    return result;
+}
+
+// Reads replies until the server closes the connection. Replies start with a status code, after RES and the request
+// id of REQ commands, and are followed by data lines for some commands.
+void read_replies(tcp::socket& socket, connection& conn)
+{
+    boost::asio::streambuf    buffer;
+    boost::system::error_code ec;
+    while (boost::asio::read_until(socket, buffer, "\r\n", ec) > 0 || !ec) {
+        std::istream stream(&buffer);
+        std::string  line;
+        std::getline(stream, line);
+        boost::trim_right(line);
+
+        std::vector<std::string> words;
+        boost::split(words, line, boost::is_any_of(" "));
+        auto code = words.size() > 2 && words[0] == "RES" ? words[2] : words[0];
+        if (code.size() != 3 || !std::all_of(code.begin(), code.end(), ::isdigit)) {
+            continue;
+        }
+        ++conn.replies;
+        if (code[0] == '4' || code[0] == '5') {
+            ++conn.errors;
+            std::cerr << conn.address << ": " << line << std::endl;
+        }
+        if (ec) {
+            break;
+        }
+    }
+}
+
+void replay(const options& options, connection& conn, replay_clock::time_point start)
+{
+    auto due = [&](const command& c) {
+        return options.speed > 0.0 ? start + std::chrono::microseconds(static_cast<std::int64_t>(c.time * 1000.0 /
+                                                                                                 options.speed))
+                                   : replay_clock::now();
+    };
+
+    std::this_thread::sleep_until(due(conn.commands.front()));
+
+    boost::asio::io_context service;
+    tcp::socket             socket(service);
+    boost::asio::connect(socket, tcp::resolver(service).resolve(options.host, options.port));
+
+    std::thread reader([&] { read_replies(socket, conn); });
+
+    for (auto& c : conn.commands) {
+        const auto time = due(c);
+        std::this_thread::sleep_until(time);
+
+        auto lag     = std::chrono::duration_cast<std::chrono::milliseconds>(replay_clock::now() - time).count();
+        conn.max_lag = std::max<std::int64_t>(conn.max_lag, lag);
+
+        boost::asio::write(socket, boost::asio::buffer(c.message + "\r\n"));
+    }
+
+    // Replies still on their way get a few seconds once all commands have been answered or nothing arrives.
+    auto last    = conn.replies.load();
+    auto waiting = replay_clock::now();
+    while (conn.replies < static_cast<std::int64_t>(conn.commands.size()) &&
+           replay_clock::now() - waiting < std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        if (conn.replies != last) {
+            last    = conn.replies;
+            waiting = replay_clock::now();
+        }
+    }
+
+    boost::system::error_code ec;
+    socket.shutdown(tcp::socket::shutdown_both, ec);
+    reader.join();
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    try {
+        auto options     = parse_options(argc, argv);
+        auto connections = read_recording(options.recording);
+
+        const auto start = replay_clock::now();
+
+        std::vector<std::thread> threads;
+        for (auto& p : connections) {
+            threads.emplace_back([&options, &conn = *p.second, start] {
+                try {
+                    replay(options, conn, start);
+                } catch (const std::exception& e) {
+                    std::cerr << conn.address << ": " << e.what() << std::endl;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        const auto elapsed = std::chrono::duration<double>(replay_clock::now() - start).count();
+
+        std::cout << "connection address commands replies errors max-lag-ms" << std::endl;
+        for (auto& p : connections) {
+            auto& conn = *p.second;
+            std::cout << p.first << " " << conn.address << " " << conn.commands.size() << " " << conn.replies << " "
+                      << conn.errors << " " << conn.max_lag << std::endl;
+        }
+        std::cout << "Replayed in " << elapsed << "s." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "casparcg-replay failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
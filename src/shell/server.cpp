@@ -24,12 +24,17 @@
 
 #include <accelerator/accelerator.h>
 
+#include <common/diagnostics/memory.h>
 #include <common/env.h>
 #include <common/except.h>
 #include <common/memory.h>
+#include <common/os/thread.h>
 #include <common/ptree.h>
+#include <common/timer.h>
 #include <common/utf.h>
 
+#include <core/channel_arena.h>
+#include <core/channel_group.h>
 #include <core/consumer/output.h>
 #include <core/diagnostics/call_context.h>
 #include <core/diagnostics/osd_graph.h>
@@ -37,6 +42,7 @@
 #include <core/producer/cg_proxy.h>
 #include <core/producer/color/color_producer.h>
 #include <core/producer/frame_producer.h>
+#include <core/producer/media_scanner.h>
 #include <core/video_channel.h>
 #include <core/video_format.h>
 
@@ -45,18 +51,26 @@
 #include <protocol/amcp/AMCPCommandsImpl.h>
 #include <protocol/amcp/AMCPProtocolStrategy.h>
 #include <protocol/amcp/amcp_command_repository.h>
+#include <protocol/amcp/amcp_shared.h>
 #include <protocol/cii/CIIProtocolStrategy.h>
 #include <protocol/clk/CLKProtocolStrategy.h>
+#include <protocol/control/control_server.h>
+#include <protocol/metrics/metrics_server.h>
 #include <protocol/osc/client.h>
+#include <protocol/osc/server.h>
 #include <protocol/util/AsyncEventServer.h>
 #include <protocol/util/strategy_adapters.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
 
 #include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <thread>
 #include <utility>
 
@@ -65,50 +79,91 @@ namespace caspar {
 using namespace core;
 using namespace protocol;
 
-std::shared_ptr<boost::asio::io_service> create_running_io_service()
+std::shared_ptr<boost::asio::io_service> create_running_io_service(int thread_count = 1)
 {
     auto service = std::make_shared<boost::asio::io_service>();
     // To keep the io_service::run() running although no pending async
     // operations are posted.
     auto work      = std::make_shared<boost::asio::io_service::work>(*service);
     auto weak_work = std::weak_ptr<boost::asio::io_service::work>(work);
-    auto thread    = std::make_shared<std::thread>([service, weak_work] {
-        while (auto strong = weak_work.lock()) {
-            try {
-                service->run();
-            } catch (...) {
-                CASPAR_LOG_CURRENT_EXCEPTION();
+    auto threads   = std::make_shared<std::vector<std::thread>>();
+    for (int n = 0; n < thread_count; ++n) {
+        threads->emplace_back([service, weak_work] {
+            set_thread_name(L"asio");
+
+            while (auto strong = weak_work.lock()) {
+                try {
+                    service->run();
+                } catch (...) {
+                    CASPAR_LOG_CURRENT_EXCEPTION();
+                }
             }
-        }
 
-        CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
-    });
+            CASPAR_LOG(info) << "[asio] Global io_service uninitialized.";
+        });
+    }
 
-    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, thread](void*) mutable {
+    return std::shared_ptr<boost::asio::io_service>(service.get(), [service, work, threads](void*) mutable {
         CASPAR_LOG(info) << "[asio] Shutting down global io_service.";
         work.reset();
         service->stop();
-        if (thread->get_id() != std::this_thread::get_id())
-            thread->join();
-        else
-            thread->detach();
+        for (auto& thread : *threads) {
+            if (thread.get_id() != std::this_thread::get_id())
+                thread.join();
+            else
+                thread.detach();
+        }
     });
 }
 
+// A consumer as configured, so that a reconfiguration can tell which ones changed.
+struct configured_consumer
+{
+    std::wstring                          name;
+    boost::property_tree::wptree          element;
+    std::shared_ptr<core::frame_consumer> consumer;
+};
+
+// The settings of a channel without its consumers, and its consumers.
+struct configured_channel
+{
+    boost::property_tree::wptree     settings;
+    std::vector<configured_consumer> consumers;
+};
+
+// Channels ticking in lockstep by group name, with the framerate all members must share.
+using channel_group_entry = std::pair<std::shared_ptr<core::channel_group>, boost::rational<int>>;
+
+boost::property_tree::wptree channel_settings(boost::property_tree::wptree xml_channel)
+{
+    xml_channel.erase(L"consumers");
+    return xml_channel;
+}
+
 struct server::impl
 {
-    std::shared_ptr<boost::asio::io_service>           io_service_ = create_running_io_service();
+    std::shared_ptr<boost::asio::io_service>           io_service_ =
+        create_running_io_service(std::max(1, env::properties().get(L"configuration.io-threads", 1)));
     accelerator::accelerator                           accelerator_;
     std::shared_ptr<amcp::amcp_command_repository>     amcp_command_repo_;
     std::vector<spl::shared_ptr<IO::AsyncEventServer>> async_servers_;
     std::shared_ptr<IO::AsyncEventServer>              primary_amcp_server_;
-    std::shared_ptr<osc::client>                       osc_client_ = std::make_shared<osc::client>(io_service_);
+    std::shared_ptr<osc::client>                       osc_client_ =
+        std::make_shared<osc::client>(create_running_io_service());
+    std::shared_ptr<osc::server>                       osc_server_;
     std::vector<std::shared_ptr<void>>                 predefined_osc_subscriptions_;
+    std::shared_ptr<metrics::metrics_server>           metrics_server_;
+    std::shared_ptr<control::control_server>           control_server_;
     std::vector<spl::shared_ptr<video_channel>>        channels_;
+    std::vector<configured_channel>                    configured_channels_;
+    std::map<std::wstring, channel_group_entry>        groups_;
+    std::mutex                                         reconfigure_mutex_;
     spl::shared_ptr<core::cg_producer_registry>        cg_registry_;
     spl::shared_ptr<core::frame_producer_registry>     producer_registry_;
     spl::shared_ptr<core::frame_consumer_registry>     consumer_registry_;
+    spl::shared_ptr<core::media_scanner_registry>      scanner_registry_;
     std::function<void(bool)>                          shutdown_server_now_;
+    std::shared_ptr<void>                              memory_log_;
 
     impl(const impl&) = delete;
     impl& operator=(const impl&) = delete;
@@ -121,7 +176,11 @@ struct server::impl
     {
         caspar::core::diagnostics::osd::register_sink();
 
-        module_dependencies dependencies(cg_registry_, producer_registry_, consumer_registry_);
+        if (env::properties().get_optional<unsigned short>(L"configuration.metrics.port")) {
+            metrics::register_sink();
+        }
+
+        module_dependencies dependencies(cg_registry_, producer_registry_, consumer_registry_, scanner_registry_);
 
         initialize_modules(dependencies);
         core::init_cg_proxy_as_producer(dependencies);
@@ -129,14 +188,27 @@ struct server::impl
 
     void start()
     {
+        caspar::timer start_timer;
+        caspar::timer timer;
+
         setup_channels(env::properties());
-        CASPAR_LOG(info) << L"Initialized channels.";
+        CASPAR_LOG(info) << L"Initialized channels (" << timer.elapsed() << L"s).";
 
+        timer.restart();
         setup_controllers(env::properties());
-        CASPAR_LOG(info) << L"Initialized controllers.";
+        CASPAR_LOG(info) << L"Initialized controllers (" << timer.elapsed() << L"s).";
 
+        timer.restart();
         setup_osc(env::properties());
-        CASPAR_LOG(info) << L"Initialized osc.";
+        CASPAR_LOG(info) << L"Initialized osc (" << timer.elapsed() << L"s).";
+
+        setup_metrics(env::properties());
+
+        setup_control(env::properties());
+
+        setup_memory_log(env::properties());
+
+        CASPAR_LOG(info) << L"Started in " << start_timer.elapsed() << L"s.";
     }
 
     ~impl()
@@ -144,6 +216,10 @@ struct server::impl
         std::weak_ptr<boost::asio::io_service> weak_io_service = io_service_;
         io_service_.reset();
         osc_client_.reset();
+        osc_server_.reset();
+        metrics_server_.reset();
+        control_server_.reset();
+        memory_log_.reset();
         amcp_command_repo_.reset();
         primary_amcp_server_.reset();
         async_servers_.clear();
@@ -162,54 +238,456 @@ struct server::impl
     {
         using boost::property_tree::wptree;
 
+        caspar::timer       timer;
         std::vector<wptree> xml_channels;
 
         for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
             xml_channels.push_back(xml_channel.second);
             ptree_verify_element_name(xml_channel, L"channel");
 
-            auto format_desc_str = xml_channel.second.get(L"video-mode", L"PAL");
-            auto format_desc     = video_format_desc(format_desc_str);
-            if (format_desc.format == video_format::invalid)
-                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
-
-            auto weak_client = std::weak_ptr<osc::client>(osc_client_);
-            auto channel_id  = static_cast<int>(channels_.size() + 1);
-            auto channel =
-                spl::make_shared<video_channel>(channel_id,
-                                                format_desc,
-                                                accelerator_.create_image_mixer(channel_id),
-                                                [channel_id, weak_client](core::monitor::state channel_state) {
-                                                    monitor::state state;
-                                                    state[""]["channel"][channel_id] = channel_state;
-                                                    auto client                      = weak_client.lock();
-                                                    if (client) {
-                                                        client->send(std::move(state));
-                                                    }
-                                                });
-
-            channels_.push_back(channel);
+            channels_.push_back(create_channel(xml_channel.second, static_cast<int>(channels_.size() + 1)));
+            configured_channels_.push_back(configured_channel{channel_settings(xml_channel.second), {}});
         }
 
+        CASPAR_LOG(info) << L"Created " << channels_.size() << L" channels (" << timer.elapsed() << L"s).";
+
+        // Consumers are created once every channel exists, since they may refer to other channels. Device enumeration
+        // and preroll can take seconds per consumer, so each channel adds its consumers on a thread of its own, in the
+        // configured order.
+        std::vector<std::future<void>> consumers;
         for (auto& channel : channels_) {
-            core::diagnostics::scoped_call_context save;
-            core::diagnostics::call_context::for_thread().video_channel = channel->index();
-
-            if (xml_channels.at(channel->index() - 1).get_child_optional(L"consumers")) {
-                for (auto& xml_consumer : xml_channels.at(channel->index() - 1) | witerate_children(L"consumers") |
-                                              welement_context_iteration) {
-                    auto name = xml_consumer.first;
-
-                    try {
-                        if (name != L"<xmlcomment>")
-                            channel->output().add(
-                                consumer_registry_->create_consumer(name, xml_consumer.second, channels_));
-                    } catch (...) {
-                        CASPAR_LOG_CURRENT_EXCEPTION();
-                    }
+            consumers.push_back(std::async(std::launch::async, [&, channel] {
+                caspar::timer consumers_timer;
+
+                configured_channels_.at(channel->index() - 1).consumers =
+                    add_consumers(channel, xml_channels.at(channel->index() - 1));
+
+                CASPAR_LOG(info) << L"Initialized consumers of channel " << channel->index() << L" ("
+                                 << consumers_timer.elapsed() << L"s).";
+            }));
+        }
+
+        for (auto& f : consumers)
+            f.get();
+    }
+
+    spl::shared_ptr<video_channel> create_channel(const boost::property_tree::wptree& xml_channel, int channel_id)
+    {
+        auto format_desc_str = xml_channel.get(L"video-mode", L"PAL");
+        auto format_desc     = video_format_desc(format_desc_str);
+        if (format_desc.format == video_format::invalid)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid video-mode: " + format_desc_str));
+
+        format_desc.audio_channels = xml_channel.get(L"audio-channels", 8);
+        if (format_desc.audio_channels != 2 && format_desc.audio_channels != 8 && format_desc.audio_channels != 16)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid audio-channels: " +
+                                                            std::to_wstring(format_desc.audio_channels)));
+
+        // The profile sets the defaults of the depths below and of the buffers of the channel's producers and
+        // consumers, see latency_profile.
+        auto latency_str = xml_channel.get(L"latency", L"normal");
+        auto latency     = latency_profile::normal;
+        if (boost::iequals(latency_str, L"low")) {
+            latency = latency_profile::low;
+        } else if (boost::iequals(latency_str, L"safe")) {
+            latency = latency_profile::safe;
+        } else if (!boost::iequals(latency_str, L"normal")) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid latency: " + latency_str));
+        }
+
+        auto pipeline_depth = xml_channel.get(L"pipeline-depth", latency == latency_profile::safe ? 2 : 1);
+        if (pipeline_depth < 1 || pipeline_depth > 3)
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"Invalid pipeline-depth: " + std::to_wstring(pipeline_depth)));
+
+        auto parallel_receive = xml_channel.get(L"parallel-receive", false);
+
+        auto arena_concurrency = xml_channel.get(L"arena-concurrency", 0);
+        if (arena_concurrency < 0)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid arena-concurrency: " +
+                                                            std::to_wstring(arena_concurrency)));
+
+        auto readback_depth = xml_channel.get(
+            L"readback-depth", latency == latency_profile::low ? 1 : latency == latency_profile::safe ? 3 : 2);
+        if (readback_depth < 1 || readback_depth > 4)
+            CASPAR_THROW_EXCEPTION(user_error()
+                                   << msg_info(L"Invalid readback-depth: " + std::to_wstring(readback_depth)));
+
+        auto gpu = xml_channel.get(L"gpu", 0);
+        if (gpu < 0)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid gpu: " + std::to_wstring(gpu)));
+
+        auto mixer_bit_depth = xml_channel.get(L"mixer-bit-depth", 8);
+        if (mixer_bit_depth != 8 && mixer_bit_depth != 10 && mixer_bit_depth != 16)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid mixer-bit-depth: " +
+                                                            std::to_wstring(mixer_bit_depth)));
+
+        auto watchdog = xml_channel.get(L"watchdog", 4.0);
+        if (watchdog != 0.0 && watchdog < 1.0)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid watchdog: " + std::to_wstring(watchdog)));
+
+        auto audio_only = xml_channel.get(L"audio-only", false);
+
+        auto loudness_interval = xml_channel.get(L"loudness-interval", 100);
+        if (loudness_interval < 0)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid loudness-interval: " +
+                                                            std::to_wstring(loudness_interval)));
+
+        auto loudness_channels = xml_channel.get(L"loudness-channels", 2);
+        if (loudness_channels < 1)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid loudness-channels: " +
+                                                            std::to_wstring(loudness_channels)));
+
+        auto group_name = xml_channel.get(L"group", L"");
+        auto group      = std::shared_ptr<core::channel_group>();
+        if (!group_name.empty()) {
+            auto it = groups_.find(group_name);
+            if (it == groups_.end()) {
+                it = groups_
+                         .emplace(group_name,
+                                  std::make_pair(std::make_shared<core::channel_group>(group_name),
+                                                 format_desc.framerate))
+                         .first;
+            } else if (it->second.first->members() == 0) {
+                it->second.second = format_desc.framerate;
+            } else if (it->second.second != format_desc.framerate) {
+                CASPAR_THROW_EXCEPTION(user_error()
+                                       << msg_info(L"Channels of group " + group_name + L" differ in framerate."));
+            }
+            group = it->second.first;
+        }
+
+        // A consumer port, auto for the lowest port with a synchronization clock, system or none to render offline.
+        // The members of a group after the first follow it by default.
+        auto clock_str = xml_channel.get(L"clock", group && group->members() > 0 ? L"group" : L"auto");
+        auto clock     = boost::iequals(clock_str, L"auto")    ? -1
+                         : boost::iequals(clock_str, L"none")  ? -2
+                         : boost::iequals(clock_str, L"group") ? -4
+                                                               : 0;
+        if (clock == -4 && !group)
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Clock group needs a group."));
+        if (!boost::iequals(clock_str, L"auto") && !boost::iequals(clock_str, L"system") &&
+            !boost::iequals(clock_str, L"none") && !boost::iequals(clock_str, L"group")) {
+            try {
+                clock = std::stoi(clock_str);
+            } catch (...) {
+                clock = -1;
+            }
+            if (clock < 1)
+                CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid clock: " + clock_str));
+        }
+
+        core::configure_channel_arena(channel_id, arena_concurrency);
+
+        auto weak_client = std::weak_ptr<osc::client>(osc_client_);
+        auto channel =
+            spl::make_shared<video_channel>(channel_id,
+                                            format_desc,
+                                            accelerator_.create_image_mixer(channel_id, gpu, mixer_bit_depth),
+                                            [channel_id, weak_client](core::monitor::state channel_state) {
+                                                monitor::state state;
+                                                state[""]["channel"][channel_id] = channel_state;
+                                                auto client                      = weak_client.lock();
+                                                if (client) {
+                                                    client->send(std::move(state));
+                                                }
+                                            },
+                                            pipeline_depth,
+                                            parallel_receive,
+                                            readback_depth,
+                                            clock,
+                                            latency,
+                                            watchdog,
+                                            audio_only);
+        channel->mixer().set_loudness(loudness_interval, loudness_channels);
+        if (group) {
+            channel->group(group);
+        }
+
+        return channel;
+    }
+
+    std::vector<configured_consumer> add_consumers(const spl::shared_ptr<video_channel>&  channel,
+                                                   const boost::property_tree::wptree& xml_channel)
+    {
+        std::vector<configured_consumer> consumers;
+        if (xml_channel.get_child_optional(L"consumers")) {
+            for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
+                if (xml_consumer.first != L"<xmlcomment>") {
+                    consumers.push_back(add_consumer(channel, xml_consumer.first, xml_consumer.second));
+                }
+            }
+        }
+        return consumers;
+    }
+
+    // A consumer that fails to be created is logged and kept without one, so that it is tried again when the channel
+    // is reconfigured with it changed.
+    configured_consumer add_consumer(const spl::shared_ptr<video_channel>&  channel,
+                                     const std::wstring&                 name,
+                                     const boost::property_tree::wptree& element)
+    {
+        core::diagnostics::scoped_call_context save;
+        core::diagnostics::call_context::for_thread().video_channel = channel->index();
+
+        configured_consumer configured{name, element, nullptr};
+        try {
+            auto consumer = consumer_registry_->create_consumer(name, element, channels_);
+            channel->output().add(consumer);
+            configured.consumer = consumer;
+        } catch (...) {
+            CASPAR_LOG_CURRENT_EXCEPTION();
+        }
+        return configured;
+    }
+
+    void remove_consumer(video_channel& channel, const configured_consumer& configured)
+    {
+        if (configured.consumer) {
+            channel.output().remove(spl::make_shared_ptr(configured.consumer));
+        }
+    }
+
+    // Hands the current channels to everything that addresses them by number.
+    void publish_channels()
+    {
+        if (amcp_command_repo_) {
+            amcp_command_repo_->set_channels(channels_);
+        }
+        if (osc_server_) {
+            osc_server_->set_channels(channels_);
+        }
+        if (control_server_) {
+            control_server_->set_channels(channels_);
+        }
+    }
+
+    // Channels are changed at runtime one at a time, from the AMCP general queue. Numbers stay stable: channels are
+    // added after the last one, and only the last one is removed.
+    int add_channel(const boost::property_tree::wptree& xml_channel)
+    {
+        auto channel = create_channel(xml_channel, static_cast<int>(channels_.size() + 1));
+        channels_.push_back(channel);
+        configured_channels_.push_back(
+            configured_channel{channel_settings(xml_channel), add_consumers(channel, xml_channel)});
+
+        CASPAR_LOG(info) << L"Added channel " << channel->index() << L".";
+        return channel->index();
+    }
+
+    void remove_channel(int index)
+    {
+        if (channels_.empty() || index != static_cast<int>(channels_.size()))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Only the last channel can be removed."));
+
+        auto channel = channels_.back();
+        for (auto& configured : configured_channels_.back().consumers) {
+            remove_consumer(*channel, configured);
+        }
+        channel->group(nullptr);
+
+        channels_.pop_back();
+        configured_channels_.pop_back();
+        core::configure_channel_arena(index, 0);
+
+        CASPAR_LOG(info) << L"Removed channel " << index << L".";
+    }
+
+    // Recreates the channel when anything but its consumers changed, otherwise removes the consumers that are no
+    // longer configured and adds the new ones. Returns what was done.
+    std::wstring reconfigure_channel(int index, const boost::property_tree::wptree& xml_channel)
+    {
+        if (index < 1 || index > static_cast<int>(channels_.size()))
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid channel: " + std::to_wstring(index)));
+
+        auto& channel    = channels_.at(index - 1);
+        auto& configured = configured_channels_.at(index - 1);
+        auto  settings   = channel_settings(xml_channel);
+
+        if (settings != configured.settings) {
+            // The consumers of the old channel let go of their devices first, the new one may need them.
+            for (auto& consumer : configured.consumers) {
+                remove_consumer(*channel, consumer);
+            }
+            configured.consumers.clear();
+
+            auto previous_group = std::shared_ptr<core::channel_group>();
+            auto group_name     = configured.settings.get(L"group", L"");
+            if (!group_name.empty()) {
+                previous_group = groups_.at(group_name).first;
+                channel->group(nullptr);
+            }
+
+            try {
+                channel = create_channel(xml_channel, index);
+            } catch (...) {
+                channel->group(previous_group);
+                throw;
+            }
+            configured.settings  = settings;
+            configured.consumers = add_consumers(channel, xml_channel);
+
+            CASPAR_LOG(info) << L"Recreated channel " << index << L".";
+            return L"RECREATED";
+        }
+
+        std::vector<configured_consumer> wanted;
+        if (xml_channel.get_child_optional(L"consumers")) {
+            for (auto& xml_consumer : xml_channel | witerate_children(L"consumers") | welement_context_iteration) {
+                if (xml_consumer.first != L"<xmlcomment>") {
+                    wanted.push_back(configured_consumer{xml_consumer.first, xml_consumer.second, nullptr});
+                }
+            }
+        }
+
+        // Consumers are matched by name and element, in order, so that unchanged ones keep running.
+        std::vector<bool> kept(configured.consumers.size(), false);
+        for (auto& consumer : wanted) {
+            for (std::size_t n = 0; n < configured.consumers.size(); ++n) {
+                auto& existing = configured.consumers[n];
+                if (!kept[n] && existing.consumer && existing.name == consumer.name &&
+                    existing.element == consumer.element) {
+                    kept[n]           = true;
+                    consumer.consumer = existing.consumer;
+                    break;
                 }
             }
         }
+
+        int removed = 0;
+        for (std::size_t n = 0; n < configured.consumers.size(); ++n) {
+            if (!kept[n]) {
+                remove_consumer(*channel, configured.consumers[n]);
+                ++removed;
+            }
+        }
+
+        int added = 0;
+        for (auto& consumer : wanted) {
+            if (!consumer.consumer) {
+                consumer = add_consumer(channel, consumer.name, consumer.element);
+                ++added;
+            }
+        }
+        configured.consumers = std::move(wanted);
+
+        CASPAR_LOG(info) << L"Reconfigured channel " << index << L", " << removed << L" consumers removed, " << added
+                         << L" added.";
+        return std::to_wstring(removed) + L" REMOVED " + std::to_wstring(added) + L" ADDED";
+    }
+
+    // Applies the channels of the configuration file as it is now: existing channels are reconfigured, new ones added
+    // and those no longer configured removed.
+    std::wstring reload_channels()
+    {
+        using boost::property_tree::wptree;
+
+        wptree pt;
+        try {
+            boost::filesystem::wifstream file(env::configuration_file());
+            boost::property_tree::read_xml(file,
+                                           pt,
+                                           boost::property_tree::xml_parser::trim_whitespace |
+                                               boost::property_tree::xml_parser::no_comments);
+        } catch (const boost::property_tree::xml_parser_error& e) {
+            CASPAR_THROW_EXCEPTION(user_error() << msg_info(L"Invalid configuration file: " + u16(e.what())));
+        }
+
+        std::vector<wptree> xml_channels;
+        for (auto& xml_channel : pt | witerate_children(L"configuration.channels") | welement_context_iteration) {
+            ptree_verify_element_name(xml_channel, L"channel");
+            xml_channels.push_back(xml_channel.second);
+        }
+
+        std::wstringstream result;
+        for (std::size_t n = 0; n < xml_channels.size(); ++n) {
+            if (n < channels_.size()) {
+                result << n + 1 << L" " << reconfigure_channel(static_cast<int>(n + 1), xml_channels[n]) << L"\r\n";
+            } else {
+                result << add_channel(xml_channels[n]) << L" ADDED\r\n";
+            }
+        }
+        while (channels_.size() > xml_channels.size()) {
+            auto index = static_cast<int>(channels_.size());
+            remove_channel(index);
+            result << index << L" REMOVED\r\n";
+        }
+
+        auto str = result.str();
+        return str.empty() ? str : str.substr(0, str.size() - 2);
+    }
+
+    struct channel_manager final : public amcp::channel_manager
+    {
+        impl& self;
+
+        explicit channel_manager(impl& self)
+            : self(self)
+        {
+        }
+
+        int add(const boost::property_tree::wptree& element) override
+        {
+            std::lock_guard<std::mutex> lock(self.reconfigure_mutex_);
+            auto                        index = self.add_channel(element);
+            self.publish_channels();
+            return index;
+        }
+
+        void remove(int channel) override
+        {
+            std::lock_guard<std::mutex> lock(self.reconfigure_mutex_);
+            self.remove_channel(channel);
+            self.publish_channels();
+        }
+
+        std::wstring reconfigure(int channel, const boost::property_tree::wptree& element) override
+        {
+            std::lock_guard<std::mutex> lock(self.reconfigure_mutex_);
+            auto                        result = self.reconfigure_channel(channel, element);
+            self.publish_channels();
+            return result;
+        }
+
+        std::wstring reload() override
+        {
+            std::lock_guard<std::mutex> lock(self.reconfigure_mutex_);
+            try {
+                auto result = self.reload_channels();
+                self.publish_channels();
+                return result;
+            } catch (...) {
+                // Whatever was applied before the failure stays applied.
+                self.publish_channels();
+                throw;
+            }
+        }
+    };
+
+    void setup_metrics(const boost::property_tree::wptree& pt)
+    {
+        auto port = pt.get_optional<unsigned short>(L"configuration.metrics.port");
+        if (port) {
+            metrics_server_ = std::make_shared<metrics::metrics_server>(io_service_, *port);
+            CASPAR_LOG(info) << L"Initialized metrics.";
+        }
+    }
+
+    void setup_control(const boost::property_tree::wptree& pt)
+    {
+        auto port = pt.get_optional<unsigned short>(L"configuration.control.port");
+        if (port) {
+            control_server_ = std::make_shared<control::control_server>(io_service_, *port, channels_);
+            CASPAR_LOG(info) << L"Initialized control.";
+        }
+    }
+
+    void setup_memory_log(const boost::property_tree::wptree& pt)
+    {
+        auto interval = pt.get(L"configuration.memory-log-interval", 3600);
+        if (interval > 0) {
+            memory_log_ = caspar::diagnostics::memory::log_periodically(std::chrono::seconds(interval));
+        }
     }
 
     void setup_osc(const boost::property_tree::wptree& pt)
@@ -229,11 +707,21 @@ struct server::impl
                 const auto address = ptree_get<std::wstring>(predefined_client.second, L"address");
                 const auto port    = ptree_get<unsigned short>(predefined_client.second, L"port");
 
+                osc::subscription options;
+                options.max_rate = predefined_client.second.get(L"max-rate", 0.0);
+                if (predefined_client.second.get_child_optional(L"address-patterns")) {
+                    for (auto& pattern : predefined_client.second | witerate_children(L"address-patterns") |
+                                             welement_context_iteration) {
+                        ptree_verify_element_name(pattern, L"address-pattern");
+                        options.address_patterns.push_back(u8(pattern.second.get_value<std::wstring>()));
+                    }
+                }
+
                 boost::system::error_code ec;
                 auto                      ipaddr = address_v4::from_string(u8(address), ec);
                 if (!ec)
                     predefined_osc_subscriptions_.push_back(
-                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port)));
+                        osc_client_->get_subscription_token(udp::endpoint(ipaddr, port), options));
                 else
                     CASPAR_LOG(warning) << "Invalid OSC client. Must be valid ipv4 address: " << address;
             }
@@ -248,12 +736,21 @@ struct server::impl
                                           osc_client_->get_subscription_token(
                                               udp::endpoint(address_v4::from_string(ipv4_address), default_port)));
                 });
+
+        auto listen_port = pt.get_optional<unsigned short>(L"configuration.osc.listen-port");
+        if (listen_port)
+            osc_server_ = std::make_shared<osc::server>(io_service_, *listen_port, channels_);
     }
 
     void setup_controllers(const boost::property_tree::wptree& pt)
     {
-        amcp_command_repo_ = spl::make_shared<amcp::amcp_command_repository>(
-            channels_, cg_registry_, producer_registry_, consumer_registry_, shutdown_server_now_);
+        amcp_command_repo_ = spl::make_shared<amcp::amcp_command_repository>(channels_,
+                                                                             cg_registry_,
+                                                                             producer_registry_,
+                                                                             consumer_registry_,
+                                                                             scanner_registry_,
+                                                                             shutdown_server_now_,
+                                                                             std::make_shared<channel_manager>(*this));
         amcp::register_commands(*amcp_command_repo_);
 
         using boost::property_tree::wptree;